@@ -21,7 +21,7 @@ e.g.:
 
     10474959 start flip #cplayer
 
-<text> is what MP_STATS(log, "...") writes. The rest is added by msg.c.
+<text> is written for MP_STATS_START/END/VALUE/SIGNAL(obj, ...) calls.
 
 Currently, the following event types are supported:
 
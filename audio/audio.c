@@ -18,7 +18,9 @@
 #include <stdint.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/buffer.h>
 #include <libavutil/frame.h>
@@ -27,6 +29,7 @@
 
 #include "mpv_talloc.h"
 #include "common/common.h"
+#include "common/mem_usage.h"
 #include "fmt-conversion.h"
 #include "audio.h"
 
@@ -134,6 +137,99 @@ static void mp_audio_destructor(void *ptr)
         av_buffer_unref(&mpa->allocated[n]);
 }
 
+// Process-wide pool for audio plane buffers, shared by all filters, decoders
+// and audio buffers. Class n holds buffers of (POOL_MIN_SIZE << n) bytes.
+// Larger buffers bypass the pool.
+#define POOL_MIN_SIZE 1024
+#define POOL_NUM_CLASSES 16
+// Maximum number of unused buffers kept per size class.
+#define POOL_MAX_FREE 32
+// Maximum total size of unused buffers kept.
+#define POOL_MAX_CACHED_BYTES (16 * 1024 * 1024)
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *pool_free_bufs[POOL_NUM_CLASSES][POOL_MAX_FREE];
+static int pool_num_free[POOL_NUM_CLASSES];
+static struct mp_audio_pool_stats pool_stats;
+
+// Return the size class for the given size, or -1 if it's too large.
+static int pool_size_class(int size)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        if (size <= (POOL_MIN_SIZE << c))
+            return c;
+    }
+    return -1;
+}
+
+static void pool_buffer_free(void *opaque, uint8_t *data)
+{
+    int c = (intptr_t)opaque;
+    int size = POOL_MIN_SIZE << c;
+
+    pthread_mutex_lock(&pool_lock);
+    pool_stats.used_bytes -= size;
+    if (pool_num_free[c] < POOL_MAX_FREE &&
+        pool_stats.cached_bytes + size <= POOL_MAX_CACHED_BYTES &&
+        !mp_mem_usage_over_limit(MP_MEM_AUDIO_BUFFERS, 0))
+    {
+        pool_free_bufs[c][pool_num_free[c]++] = data;
+        pool_stats.cached_bytes += size;
+        data = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if (data)
+        mp_mem_usage_add(MP_MEM_AUDIO_BUFFERS, -size);
+    av_free(data);
+}
+
+// Allocate a buffer with at least size bytes. If it comes from the pool, the
+// buffer size is rounded up to the size class.
+static AVBufferRef *pool_alloc(int size)
+{
+    int c = pool_size_class(size);
+    if (c < 0)
+        return av_buffer_alloc(size);
+    size = POOL_MIN_SIZE << c;
+
+    pthread_mutex_lock(&pool_lock);
+    void *data = NULL;
+    if (pool_num_free[c]) {
+        data = pool_free_bufs[c][--pool_num_free[c]];
+        pool_stats.cached_bytes -= size;
+        pool_stats.hits++;
+    } else {
+        pool_stats.misses++;
+    }
+    pool_stats.used_bytes += size;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!data) {
+        data = av_malloc(size);
+        if (data)
+            mp_mem_usage_add(MP_MEM_AUDIO_BUFFERS, size);
+    }
+    AVBufferRef *buf = NULL;
+    if (data)
+        buf = av_buffer_create(data, size, pool_buffer_free, (void *)(intptr_t)c, 0);
+    if (!buf) {
+        if (data)
+            mp_mem_usage_add(MP_MEM_AUDIO_BUFFERS, -size);
+        pthread_mutex_lock(&pool_lock);
+        pool_stats.used_bytes -= size;
+        pthread_mutex_unlock(&pool_lock);
+        av_free(data);
+    }
+    return buf;
+}
+
+void mp_audio_pool_get_stats(struct mp_audio_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool_lock);
+    *stats = pool_stats;
+    pthread_mutex_unlock(&pool_lock);
+}
+
 /* Reallocate the data stored in mpa->planes[n] so that enough samples are
  * available on every plane. The previous data is kept (for the smallest
  * common number of samples before/after resize).
@@ -163,9 +259,18 @@ void mp_audio_realloc(struct mp_audio *mpa, int samples)
         }
     }
     for (int n = 0; n < mpa->num_planes; n++) {
-        if (!mpa->allocated[n] || size != mpa->allocated[n]->size) {
-            if (av_buffer_realloc(&mpa->allocated[n], size) < 0)
+        AVBufferRef *old = mpa->allocated[n];
+        // Keep the buffer if it's large enough and doesn't waste a size class.
+        if (!old || old->size < size ||
+            pool_size_class(old->size) != pool_size_class(size))
+        {
+            AVBufferRef *new = pool_alloc(size);
+            if (!new)
                 abort(); // OOM
+            if (old)
+                memcpy(new->data, old->data, MPMIN(old->size, new->size));
+            av_buffer_unref(&old);
+            mpa->allocated[n] = new;
         }
         mpa->planes[n] = mpa->allocated[n]->data;
     }
@@ -489,9 +594,10 @@ fail:
     return NULL;
 }
 
+// All allocations go to the process-wide size classes above, so this is only
+// a handle kept for the existing callers.
 struct mp_audio_pool {
-    AVBufferPool *avpool;
-    int element_size;
+    int unused;
 };
 
 struct mp_audio_pool *mp_audio_pool_create(void *ta_parent)
@@ -499,12 +605,6 @@ struct mp_audio_pool *mp_audio_pool_create(void *ta_parent)
     return talloc_zero(ta_parent, struct mp_audio_pool);
 }
 
-static void mp_audio_pool_destructor(void *p)
-{
-    struct mp_audio_pool *pool = p;
-    av_buffer_pool_uninit(&pool->avpool);
-}
-
 // Allocate data using the given format and number of samples.
 // Returns NULL on error.
 struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
@@ -513,24 +613,13 @@ struct mp_audio *mp_audio_pool_get(struct mp_audio_pool *pool,
     int size = get_plane_size(fmt, samples);
     if (size < 0)
         return NULL;
-    if (!pool->avpool || size > pool->element_size) {
-        size_t alloc = ta_calc_prealloc_elems(size);
-        if (alloc >= INT_MAX)
-            return NULL;
-        av_buffer_pool_uninit(&pool->avpool);
-        pool->element_size = alloc;
-        pool->avpool = av_buffer_pool_init(pool->element_size, NULL);
-        if (!pool->avpool)
-            return NULL;
-        talloc_set_destructor(pool, mp_audio_pool_destructor);
-    }
     struct mp_audio *new = talloc_ptrtype(NULL, new);
     talloc_set_destructor(new, mp_audio_destructor);
     *new = *fmt;
     mp_audio_set_null_data(new);
     new->samples = samples;
     for (int n = 0; n < new->num_planes; n++) {
-        new->allocated[n] = av_buffer_pool_get(pool->avpool);
+        new->allocated[n] = pool_alloc(size);
         if (!new->allocated[n]) {
             talloc_free(new);
             return NULL;
@@ -92,4 +92,13 @@ struct mp_audio *mp_audio_pool_new_copy(struct mp_audio_pool *pool,
 int mp_audio_pool_make_writeable(struct mp_audio_pool *pool,
                                  struct mp_audio *frame);
 
+struct mp_audio_pool_stats {
+    int64_t hits;           // allocations served from recycled buffers
+    int64_t misses;         // allocations that had to allocate new memory
+    int64_t used_bytes;     // size of pool buffers currently referenced
+    int64_t cached_bytes;   // size of unused buffers kept for reuse
+};
+
+void mp_audio_pool_get_stats(struct mp_audio_pool_stats *stats);
+
 #endif
@@ -29,6 +29,8 @@
 #include "common/msg.h"
 #include "common/recorder.h"
 #include "misc/bstr.h"
+#include "options/options.h"
+#include "osdep/threads.h"
 
 #include "stream/stream.h"
 #include "demux/demux.h"
@@ -53,9 +55,32 @@ static const struct ad_functions * const ad_drivers[] = {
     NULL
 };
 
+// Must be called with d_audio->lock held.
+static void flush_queue(struct dec_audio *d_audio)
+{
+    for (int n = 0; n < d_audio->num_queue; n++)
+        talloc_free(d_audio->queue[n]);
+    d_audio->num_queue = 0;
+    d_audio->queue_duration = 0;
+}
+
+static void reset_decoder(struct dec_audio *d_audio)
+{
+    if (d_audio->ad_driver)
+        d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
+    d_audio->pts = MP_NOPTS_VALUE;
+    talloc_free(d_audio->current_frame);
+    d_audio->current_frame = NULL;
+    talloc_free(d_audio->packet);
+    d_audio->packet = NULL;
+    talloc_free(d_audio->new_segment);
+    d_audio->new_segment = NULL;
+    d_audio->start = d_audio->end = MP_NOPTS_VALUE;
+}
+
 static void uninit_decoder(struct dec_audio *d_audio)
 {
-    audio_reset_decoding(d_audio);
+    reset_decoder(d_audio);
     if (d_audio->ad_driver) {
         MP_VERBOSE(d_audio, "Uninit audio decoder.\n");
         d_audio->ad_driver->uninit(d_audio);
@@ -115,7 +140,8 @@ static const struct ad_functions *find_driver(const char *name)
     return NULL;
 }
 
-int audio_init_best_codec(struct dec_audio *d_audio)
+// If threaded, the caller must hold dec_lock.
+static int init_best_codec(struct dec_audio *d_audio)
 {
     uninit_decoder(d_audio);
     assert(!d_audio->ad_driver);
@@ -152,26 +178,90 @@ int audio_init_best_codec(struct dec_audio *d_audio)
     return !!d_audio->ad_driver;
 }
 
+int audio_init_best_codec(struct dec_audio *d_audio)
+{
+    if (!d_audio->threaded)
+        return init_best_codec(d_audio);
+    pthread_mutex_lock(&d_audio->dec_lock);
+    pthread_mutex_lock(&d_audio->lock);
+    flush_queue(d_audio);
+    d_audio->thread_eof = false;
+    pthread_mutex_unlock(&d_audio->lock);
+    int r = init_best_codec(d_audio);
+    pthread_mutex_unlock(&d_audio->dec_lock);
+    return r;
+}
+
+static void stop_thread(struct dec_audio *d_audio)
+{
+    pthread_mutex_lock(&d_audio->lock);
+    d_audio->thread_exit = true;
+    pthread_cond_signal(&d_audio->wakeup);
+    pthread_mutex_unlock(&d_audio->lock);
+    pthread_join(d_audio->thread, NULL);
+
+    MP_VERBOSE(d_audio, "Decoder queue: %d underruns.\n",
+               d_audio->queue_underruns);
+
+    flush_queue(d_audio);
+    d_audio->threaded = false;
+    pthread_cond_destroy(&d_audio->wakeup);
+    pthread_mutex_destroy(&d_audio->lock);
+    pthread_mutex_destroy(&d_audio->dec_lock);
+}
+
 void audio_uninit(struct dec_audio *d_audio)
 {
     if (!d_audio)
         return;
+    if (d_audio->threaded)
+        stop_thread(d_audio);
     uninit_decoder(d_audio);
     talloc_free(d_audio);
 }
 
 void audio_reset_decoding(struct dec_audio *d_audio)
 {
-    if (d_audio->ad_driver)
-        d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
-    d_audio->pts = MP_NOPTS_VALUE;
-    talloc_free(d_audio->current_frame);
-    d_audio->current_frame = NULL;
-    talloc_free(d_audio->packet);
-    d_audio->packet = NULL;
-    talloc_free(d_audio->new_segment);
-    d_audio->new_segment = NULL;
-    d_audio->start = d_audio->end = MP_NOPTS_VALUE;
+    if (!d_audio->threaded) {
+        reset_decoder(d_audio);
+        return;
+    }
+    pthread_mutex_lock(&d_audio->dec_lock);
+    pthread_mutex_lock(&d_audio->lock);
+    flush_queue(d_audio);
+    d_audio->thread_run = false;
+    d_audio->thread_eof = false;
+    d_audio->underrun = true;
+    pthread_mutex_unlock(&d_audio->lock);
+    reset_decoder(d_audio);
+    pthread_mutex_unlock(&d_audio->dec_lock);
+}
+
+void audio_set_recorder_sink(struct dec_audio *d_audio,
+                             struct mp_recorder_sink *sink)
+{
+    if (d_audio->threaded)
+        pthread_mutex_lock(&d_audio->dec_lock);
+    d_audio->recorder_sink = sink;
+    if (d_audio->threaded)
+        pthread_mutex_unlock(&d_audio->dec_lock);
+}
+
+// Returns false if there is no decoder thread.
+bool audio_get_queue_state(struct dec_audio *d_audio,
+                           struct audio_queue_state *st)
+{
+    if (!d_audio->threaded)
+        return false;
+    pthread_mutex_lock(&d_audio->lock);
+    *st = (struct audio_queue_state){
+        .duration = d_audio->queue_duration,
+        .limit = d_audio->queue_limit,
+        .frames = d_audio->num_queue,
+        .underruns = d_audio->queue_underruns,
+    };
+    pthread_mutex_unlock(&d_audio->lock);
+    return true;
 }
 
 static void fix_audio_pts(struct dec_audio *da)
@@ -183,7 +273,7 @@ static void fix_audio_pts(struct dec_audio *da)
         double newpts = da->current_frame->pts;
 
         if (da->pts != MP_NOPTS_VALUE)
-            MP_STATS(da, "value %f audio-pts-err", da->pts - newpts);
+            MP_STATS_VALUE(da, "audio-pts-err", da->pts - newpts);
 
         // Keep the interpolated timestamp if it doesn't deviate more
         // than 1 ms from the real one. (MKV rounded timestamps.)
@@ -200,7 +290,9 @@ static void fix_audio_pts(struct dec_audio *da)
         da->pts += da->current_frame->samples / (double)da->current_frame->rate;
 }
 
-void audio_work(struct dec_audio *da)
+// Decode until a frame is output, or the decoder needs more input.
+// If threaded, the caller must hold dec_lock.
+static void decode_step(struct dec_audio *da)
 {
     if (da->current_frame || !da->ad_driver)
         return;
@@ -257,13 +349,13 @@ void audio_work(struct dec_audio *da)
         da->new_segment = NULL;
 
         if (da->codec == new_segment->codec) {
-            audio_reset_decoding(da);
+            reset_decoder(da);
         } else {
             da->codec = new_segment->codec;
             if (da->ad_driver)
                 da->ad_driver->uninit(da);
             da->ad_driver = NULL;
-            audio_init_best_codec(da);
+            init_best_codec(da);
         }
 
         da->start = new_segment->start;
@@ -276,14 +368,150 @@ void audio_work(struct dec_audio *da)
     }
 }
 
+static double frame_duration(struct mp_audio *frame)
+{
+    return frame->rate > 0 ? frame->samples / (double)frame->rate : 0;
+}
+
+static void *decode_thread(void *p)
+{
+    struct dec_audio *da = p;
+
+    mpthread_set_name("ad");
+    mpthread_set_role(da->global, "decoder");
+
+    pthread_mutex_lock(&da->lock);
+    while (!da->thread_exit) {
+        // Always allow at least 1 queued frame, whatever its duration.
+        bool full = da->num_queue && da->queue_duration >= da->queue_limit;
+        if (!da->thread_run || da->thread_eof || full) {
+            pthread_cond_wait(&da->wakeup, &da->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&da->lock);
+
+        pthread_mutex_lock(&da->dec_lock);
+        decode_step(da);
+        int state = da->ad_driver ? da->current_state : DATA_EOF;
+        struct mp_audio *frame = da->current_frame;
+        da->current_frame = NULL;
+
+        // Take the queue lock before releasing dec_lock, so that a concurrent
+        // audio_reset_decoding() can't be overtaken by a frame from before
+        // the reset.
+        pthread_mutex_lock(&da->lock);
+        pthread_mutex_unlock(&da->dec_lock);
+
+        bool wakeup = false;
+        if (frame) {
+            MP_TARRAY_APPEND(da, da->queue, da->num_queue, frame);
+            da->queue_duration += frame_duration(frame);
+            wakeup = true;
+        } else if (state == DATA_WAIT) {
+            // Sleep until audio_work() is called again. The demuxer wakes up
+            // the player when new packets are available.
+            da->thread_run = false;
+        } else if (state == DATA_EOF) {
+            da->thread_eof = true;
+            wakeup = true;
+        }
+
+        if (wakeup && da->wakeup_cb) {
+            pthread_mutex_unlock(&da->lock);
+            da->wakeup_cb(da->wakeup_cb_ctx);
+            pthread_mutex_lock(&da->lock);
+        }
+    }
+    pthread_mutex_unlock(&da->lock);
+
+    return NULL;
+}
+
+static void start_thread(struct dec_audio *da, double limit)
+{
+    da->queue_limit = limit;
+    da->underrun = true;
+
+    pthread_mutex_init(&da->dec_lock, NULL);
+    pthread_mutex_init(&da->lock, NULL);
+    pthread_cond_init(&da->wakeup, NULL);
+
+    if (pthread_create(&da->thread, NULL, decode_thread, da)) {
+        MP_ERR(da, "Could not create decoder thread.\n");
+        pthread_cond_destroy(&da->wakeup);
+        pthread_mutex_destroy(&da->lock);
+        pthread_mutex_destroy(&da->dec_lock);
+        return;
+    }
+
+    da->threaded = true;
+    MP_VERBOSE(da, "Decoding in a separate thread, up to %f seconds ahead.\n",
+               da->queue_limit);
+}
+
+// Start the decoder thread with the given queue limit, regardless of
+// --ad-queue-secs, and start decoding. Returns false if there is no thread
+// (including if it was already running).
+bool audio_start_thread(struct dec_audio *da, double secs)
+{
+    if (da->threaded || !da->ad_driver || secs <= 0)
+        return false;
+    start_thread(da, secs);
+    if (!da->threaded)
+        return false;
+    audio_work(da);
+    return true;
+}
+
+void audio_work(struct dec_audio *da)
+{
+    if (!da->threaded && !da->queue_limit && da->opts->ad_queue_secs > 0 &&
+        da->ad_driver)
+        start_thread(da, da->opts->ad_queue_secs);
+
+    if (!da->threaded) {
+        decode_step(da);
+        return;
+    }
+
+    pthread_mutex_lock(&da->lock);
+    if (!da->thread_run) {
+        da->thread_run = true;
+        pthread_cond_signal(&da->wakeup);
+    }
+    pthread_mutex_unlock(&da->lock);
+}
+
 // Fetch an audio frame decoded with audio_work(). Returns one of:
 //  DATA_OK:    *out_frame is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
+//  DATA_WAIT:  waiting for demuxer or decoder thread; will receive a wakeup
 //  DATA_EOF:   end of file, no more frames to be expected
 //  DATA_AGAIN: dropped frame or something similar
 int audio_get_frame(struct dec_audio *da, struct mp_audio **out_frame)
 {
     *out_frame = NULL;
+    if (da->threaded) {
+        int res = DATA_WAIT;
+        pthread_mutex_lock(&da->lock);
+        if (da->num_queue) {
+            *out_frame = da->queue[0];
+            MP_TARRAY_REMOVE_AT(da->queue, da->num_queue, 0);
+            da->queue_duration -= frame_duration(*out_frame);
+            if (!da->num_queue)
+                da->queue_duration = 0; // avoid accumulating rounding errors
+            da->underrun = false;
+            pthread_cond_signal(&da->wakeup);
+            res = DATA_OK;
+        } else if (da->thread_eof) {
+            res = DATA_EOF;
+        } else if (da->thread_run && !da->underrun) {
+            // Only count once per stall, and not right after seeks.
+            da->underrun = true;
+            da->queue_underruns++;
+        }
+        pthread_mutex_unlock(&da->lock);
+        return res;
+    }
     if (da->current_frame) {
         *out_frame = da->current_frame;
         da->current_frame = NULL;
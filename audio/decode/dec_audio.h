@@ -18,6 +18,8 @@
 #ifndef MPLAYER_DEC_AUDIO_H
 #define MPLAYER_DEC_AUDIO_H
 
+#include <pthread.h>
+
 #include "audio/chmap.h"
 #include "audio/audio.h"
 #include "demux/demux.h"
@@ -26,6 +28,13 @@
 struct mp_audio_buffer;
 struct mp_decoder_list;
 
+struct audio_queue_state {
+    double duration;    // seconds of decoded audio currently queued
+    double limit;       // maximum queued duration (0 if no decoder thread)
+    int frames;         // number of queued frames
+    int underruns;      // the player had to wait for the decoder thread
+};
+
 struct dec_audio {
     struct mp_log *log;
     struct MPOpts *opts;
@@ -39,6 +48,10 @@ struct dec_audio {
 
     struct mp_recorder_sink *recorder_sink;
 
+    // Called from the decoder thread when a new frame or EOF is available.
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+
     // For free use by the ad_driver
     void *priv;
 
@@ -50,16 +63,39 @@ struct dec_audio {
     struct demux_packet *new_segment;
     struct mp_audio *current_frame;
     int current_state;
+
+    // Decoder thread (only with --ad-queue-secs > 0). While it's running, all
+    // decoder state above is owned by the thread, and dec_lock must be held
+    // to touch it from outside.
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t dec_lock;   // held by the thread while decoding
+    pthread_mutex_t lock;       // protects the fields below
+    pthread_cond_t wakeup;
+    bool thread_exit;
+    bool thread_run;            // decode ahead until queue full/wait/EOF
+    bool thread_eof;
+    struct mp_audio **queue;
+    int num_queue;
+    double queue_duration;
+    double queue_limit;
+    bool underrun;
+    int queue_underruns;
 };
 
 struct mp_decoder_list *audio_decoder_list(void);
 int audio_init_best_codec(struct dec_audio *d_audio);
 void audio_uninit(struct dec_audio *d_audio);
 
+bool audio_start_thread(struct dec_audio *d_audio, double secs);
 void audio_work(struct dec_audio *d_audio);
 int audio_get_frame(struct dec_audio *d_audio, struct mp_audio **out_frame);
 
 void audio_reset_decoding(struct dec_audio *d_audio);
+void audio_set_recorder_sink(struct dec_audio *d_audio,
+                             struct mp_recorder_sink *sink);
+bool audio_get_queue_state(struct dec_audio *d_audio,
+                           struct audio_queue_state *st);
 
 // ad_spdif.c
 struct mp_decoder_list *select_spdif_codec(const char *codec, const char *pref);
@@ -792,6 +792,31 @@ int af_make_writeable(struct af_instance *af, struct mp_audio *frame)
     return mp_audio_pool_make_writeable(af->out_pool, frame);
 }
 
+// Get the frame a filter writes its output for the input frame to. For filters
+// which can process in place (every output sample depends only on the input
+// sample at the same position), and if the output doesn't need more space per
+// sample than the input, this returns the input frame itself if it's not
+// shared, with the config switched to af->fmt_out. Otherwise, a new frame is
+// allocated from the pool. This avoids copying shared frames, because
+// processing into a new buffer is cheaper than af_make_writeable() followed
+// by processing in place.
+// If the result is not in, the caller still owns in. Returns NULL on OOM.
+struct mp_audio *af_get_inplace_frame(struct af_instance *af,
+                                      struct mp_audio *in)
+{
+    struct mp_audio *out_fmt = &af->fmt_out;
+    if (mp_audio_is_writeable(in) && in->num_planes == out_fmt->num_planes &&
+        in->sstride >= out_fmt->sstride)
+    {
+        mp_audio_copy_config(in, out_fmt);
+        return in;
+    }
+    struct mp_audio *out = mp_audio_pool_get(af->out_pool, out_fmt, in->samples);
+    if (out)
+        mp_audio_copy_attributes(out, in);
+    return out;
+}
+
 void af_seek_reset(struct af_stream *s)
 {
     af_control_all(s, AF_CONTROL_RESET, NULL);
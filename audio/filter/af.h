@@ -120,6 +120,7 @@ enum af_control {
     AF_CONTROL_GET_PAN_BALANCE,
     AF_CONTROL_SET_PLAYBACK_SPEED,
     AF_CONTROL_SET_PLAYBACK_SPEED_RESAMPLE,
+    AF_CONTROL_GET_RESAMPLE_SPEED,
     AF_CONTROL_GET_METADATA,
     AF_CONTROL_COMMAND,
 };
@@ -150,6 +151,8 @@ int af_output_frame(struct af_stream *s, bool eof);
 struct mp_audio *af_read_output_frame(struct af_stream *s);
 void af_unread_output_frame(struct af_stream *s, struct mp_audio *frame);
 int af_make_writeable(struct af_instance *af, struct mp_audio *frame);
+struct mp_audio *af_get_inplace_frame(struct af_instance *af,
+                                      struct mp_audio *in);
 
 double af_calc_delay(struct af_stream *s);
 
@@ -157,5 +160,9 @@ int af_test_output(struct af_instance *af, struct mp_audio *out);
 
 int af_from_ms(int n, float *in, int *out, int rate, float mi, float ma);
 float af_softclip(float a);
+void af_volume_s16(int16_t *a, int num, int vol);
+void af_volume_clip_float(float *a, int num, float vol);
+float af_sum_squares_s16(const int16_t *a, int num);
+float af_sum_squares_float(const float *a, int num);
 
 #endif /* MPLAYER_AF_H */
@@ -104,12 +104,7 @@ static void method1_int16(af_drc_t *s, struct mp_audio *c)
   float curavg = 0.0, newavg, neededmul;
   int tmp;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = sqrt(af_sum_squares_s16(data, len) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -143,14 +138,9 @@ static void method1_float(af_drc_t *s, struct mp_audio *c)
   register int i = 0;
   float *data = (float*)c->planes[0];   // Audio data
   int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, neededmul, tmp;
+  float curavg = 0.0, newavg, neededmul;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = sqrt(af_sum_squares_float(data, len) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -183,12 +173,7 @@ static void method2_int16(af_drc_t *s, struct mp_audio *c)
   float curavg = 0.0, newavg, avg = 0.0;
   int tmp, totallen = 0;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = sqrt(af_sum_squares_s16(data, len) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -230,15 +215,10 @@ static void method2_float(af_drc_t *s, struct mp_audio *c)
   register int i = 0;
   float *data = (float*)c->planes[0];   // Audio data
   int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, avg = 0.0, tmp;
+  float curavg = 0.0, newavg, avg = 0.0;
   int totallen = 0;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = sqrt(af_sum_squares_float(data, len) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
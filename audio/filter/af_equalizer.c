@@ -30,6 +30,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "biquad.h"
 
 #define L       2      // Storage for filter taps
 #define KM      10     // Max number of bands
@@ -62,7 +63,7 @@ typedef struct af_equalizer_s
 {
   float   a[KM][L];             // A weights
   float   b[KM][L];             // B weights
-  float   wq[AF_NCH][KM][L];    // Circular buffer for W data
+  struct af_biquad *bq;         // Filter cascade, all channels at once
   float   g[AF_NCH][KM];        // Gain factor for each channel and band
   int     K;                    // Number of used eq bands
   int     channels;             // Number of channels
@@ -134,6 +135,30 @@ static int control(struct af_instance* af, int cmd, void* arg)
         s->gain_factor=1;
     }
 
+    // Map each band to a generic biquad per channel. With B = b[k][0] and
+    // gain g, the band computes w = B*x + a0*w1 + a1*w2, y = x + g*(w + b1*w2).
+    // Substituting x gives the same response in direct form II with the
+    // state scaled by 1/B. The output gain is folded into the last stage.
+    talloc_free(s->bq);
+    s->bq = af_biquad_create(af, af->data->nch, MPMAX(s->K, 1));
+    for(i=0;i<af->data->nch;i++){
+      if(!s->K){
+        af_biquad_set(s->bq, 0, i, (struct af_biquad_coeffs){
+          .b0 = s->gain_factor});
+      }
+      for(k=0;k<s->K;k++){
+        float gb = s->g[i][k] * s->b[k][0];
+        float out = k == s->K - 1 ? s->gain_factor : 1.0;
+        af_biquad_set(s->bq, k, i, (struct af_biquad_coeffs){
+          .b0 = (1.0 + gb) * out,
+          .b1 = -s->a[k][0] * out,
+          .b2 = (gb * s->b[k][1] - s->a[k][1]) * out,
+          .a1 = -s->a[k][0],
+          .a2 = -s->a[k][1],
+        });
+      }
+    }
+
     return af_test_output(af,arg);
   }
   }
@@ -146,42 +171,14 @@ static int filter(struct af_instance* af, struct mp_audio* data)
   if (!c)
     return 0;
   af_equalizer_t*  s    = (af_equalizer_t*)af->priv;    // Setup
-  uint32_t         ci   = af->data->nch;                // Index for channels
-  uint32_t         nch  = af->data->nch;                // Number of channels
 
   if (af_make_writeable(af, data) < 0) {
     talloc_free(data);
     return -1;
   }
 
-  while(ci--){
-    float*      g   = s->g[ci];      // Gain factor
-    float*      in  = ((float*)c->planes[0])+ci;
-    float*      out = ((float*)c->planes[0])+ci;
-    float*      end = in + c->samples*c->nch; // Block loop end
-
-    while(in < end){
-      register int      k  = 0;         // Frequency band index
-      register float    yt = *in;       // Current input sample
-      in+=nch;
-
-      // Run the filters
-      for(;k<s->K;k++){
-        // Pointer to circular buffer wq
-        register float* wq = s->wq[ci][k];
-        // Calculate output from AR part of current filter
-        register float w=yt*s->b[k][0] + wq[0]*s->a[k][0] + wq[1]*s->a[k][1];
-        // Calculate output form MA part of current filter
-        yt+=(w + wq[1]*s->b[k][1])*g[k];
-        // Update circular buffer
-        wq[1] = wq[0];
-        wq[0] = w;
-      }
-      // Calculate output
-      *out=yt*s->gain_factor;
-      out+=nch;
-    }
-  }
+  af_biquad_process(s->bq, c->planes[0], c->samples);
+
   af_add_output_frame(af, data);
   return 0;
 }
@@ -24,6 +24,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -44,6 +45,8 @@
 #define AC3_MAX_CHANNELS 6
 #define AC3_MAX_CODED_FRAME_SIZE 3840
 #define AC3_FRAME_SIZE (6  * 256)
+// Number of AC3 frames that can be queued to or be in the encoder thread.
+#define MAX_QUEUED 4
 const uint16_t ac3_bitrate_tab[19] = {
     32, 40, 48, 56, 64, 80, 96, 112, 128,
     160, 192, 224, 256, 320, 384, 448, 512, 576, 640
@@ -58,7 +61,24 @@ typedef struct af_ac3enc_s {
     struct mp_audio *pending;   // unconsumed input data
     int in_samples;     // samples of input per AC3 frame
     int out_samples;    // upper bound on encoded output per AC3 frame
-    int64_t encoder_buffered;
+    bool draining;      // EOF was signaled; wait for all queued frames
+
+    // Encoding runs on a separate thread, so that the filter can return
+    // encoded frames without waiting for the encoder if enough input was
+    // queued (the player feeds audio ahead of time).
+    pthread_t thread;
+    bool thread_valid;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    AVFrame **in_queue;         // frames to encode, oldest first
+    int num_in_queue;
+    AVPacket **out_queue;       // encoded packets, oldest first
+    int num_out_queue;
+    bool busy;                  // worker is in the encoder
+    bool failed;
+    bool terminate;
+    int64_t encoder_buffered;   // input samples that have no output yet
 
     int cfg_add_iec61937_header;
     int cfg_bit_rate;
@@ -104,6 +124,72 @@ done_fmt: ;
         mp_audio_set_channels(fmt, &res);
 }
 
+static void *encode_thread(void *p)
+{
+    af_ac3enc_t *s = p;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->terminate) {
+        if (!s->num_in_queue || s->failed) {
+            pthread_cond_wait(&s->wakeup, &s->lock);
+            continue;
+        }
+        AVFrame *frame = s->in_queue[0];
+        MP_TARRAY_REMOVE_AT(s->in_queue, s->num_in_queue, 0);
+        s->busy = true;
+        pthread_mutex_unlock(&s->lock);
+
+        bool ok = avcodec_send_frame(s->lavc_actx, frame) >= 0;
+        av_frame_free(&frame);
+        AVPacket **pkts = NULL;
+        int num_pkts = 0;
+        while (ok) {
+            AVPacket *pkt = av_packet_alloc();
+            if (!pkt) {
+                ok = false;
+                break;
+            }
+            int r = avcodec_receive_packet(s->lavc_actx, pkt);
+            if (r < 0) {
+                av_packet_free(&pkt);
+                ok = r == AVERROR(EAGAIN);
+                break;
+            }
+            MP_TARRAY_APPEND(NULL, pkts, num_pkts, pkt);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        for (int n = 0; n < num_pkts; n++)
+            MP_TARRAY_APPEND(s, s->out_queue, s->num_out_queue, pkts[n]);
+        talloc_free(pkts);
+        s->failed |= !ok;
+        s->busy = false;
+        pthread_cond_broadcast(&s->wakeup);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+// Wait until the encoder thread is idle, and discard all queued data. After
+// this, the encoder can be accessed by the filter until the next frame is
+// queued.
+static void stop_encoding(af_ac3enc_t *s)
+{
+    pthread_mutex_lock(&s->lock);
+    for (int n = 0; n < s->num_in_queue; n++)
+        av_frame_free(&s->in_queue[n]);
+    s->num_in_queue = 0;
+    while (s->busy)
+        pthread_cond_wait(&s->wakeup, &s->lock);
+    for (int n = 0; n < s->num_out_queue; n++)
+        av_packet_free(&s->out_queue[n]);
+    s->num_out_queue = 0;
+    s->encoder_buffered = 0;
+    s->failed = false;
+    s->draining = false;
+    pthread_mutex_unlock(&s->lock);
+}
+
 // Initialization and runtime control
 static int control(struct af_instance *af, int cmd, void *arg)
 {
@@ -114,6 +200,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
     switch (cmd){
     case AF_CONTROL_REINIT: {
         struct mp_audio *in = arg;
+        stop_encoding(s);
         struct mp_audio orig_in = *in;
 
         if (!af_fmt_is_pcm(in->format) || in->nch < s->cfg_min_channel_num)
@@ -171,16 +258,15 @@ static int control(struct af_instance *af, int cmd, void *arg)
         s->in_samples = s->lavc_actx->frame_size;
         mp_audio_realloc(s->input, s->in_samples);
         s->input->samples = 0;
-        s->encoder_buffered = 0;
         return AF_OK;
     }
     case AF_CONTROL_RESET:
+        stop_encoding(s);
         if (avcodec_is_open(s->lavc_actx))
             avcodec_flush_buffers(s->lavc_actx);
         talloc_free(s->pending);
         s->pending = NULL;
         s->input->samples = 0;
-        s->encoder_buffered = 0;
         return AF_OK;
     }
     return AF_UNKNOWN;
@@ -192,6 +278,16 @@ static void uninit(struct af_instance* af)
     af_ac3enc_t *s = af->priv;
 
     if (s) {
+        if (s->thread_valid) {
+            stop_encoding(s);
+            pthread_mutex_lock(&s->lock);
+            s->terminate = true;
+            pthread_cond_broadcast(&s->wakeup);
+            pthread_mutex_unlock(&s->lock);
+            pthread_join(s->thread, NULL);
+        }
+        pthread_cond_destroy(&s->wakeup);
+        pthread_mutex_destroy(&s->lock);
         if(s->lavc_actx) {
             avcodec_close(s->lavc_actx);
             av_free(s->lavc_actx);
@@ -203,8 +299,11 @@ static void uninit(struct af_instance* af)
 static void update_delay(struct af_instance *af)
 {
     af_ac3enc_t *s = af->priv;
+    pthread_mutex_lock(&s->lock);
+    int64_t buffered = s->encoder_buffered;
+    pthread_mutex_unlock(&s->lock);
     af->delay = ((s->pending ? s->pending->samples : 0) + s->input->samples +
-                  s->encoder_buffered) / (double)s->input->rate;
+                  buffered) / (double)s->input->rate;
 }
 
 static int filter_frame(struct af_instance *af, struct mp_audio *audio)
@@ -217,6 +316,8 @@ static int filter_frame(struct af_instance *af, struct mp_audio *audio)
 
     talloc_free(s->pending);
     s->pending = audio;
+    if (!audio)
+        s->draining = true;
     update_delay(af);
     return 0;
 }
@@ -267,66 +368,72 @@ static int filter_out(struct af_instance *af)
 {
     af_ac3enc_t *s = af->priv;
 
-    if (!s->pending)
-        return 0;
-
-    AVFrame *frame = av_frame_alloc();
-    if (!frame) {
-        MP_FATAL(af, "Could not allocate memory \n");
-        return -1;
-    }
     int err = -1;
+    AVPacket *pkt = NULL;
 
-    AVPacket pkt = {0};
-    av_init_packet(&pkt);
-
-    // Send input as long as it wants.
+    // Queue complete input frames. Only wait for the encoder if too much is
+    // queued already.
     while (1) {
-        err = read_input_frame(af, frame);
-        if (err < 0)
-            goto done;
-        if (err == 0)
-            break;
-        err = -1;
-        int lavc_ret = avcodec_send_frame(s->lavc_actx, frame);
-        // On EAGAIN, we're supposed to read remaining output.
-        if (lavc_ret == AVERROR(EAGAIN))
+        AVFrame *frame = av_frame_alloc();
+        if (!frame) {
+            MP_FATAL(af, "Could not allocate memory \n");
+            return -1;
+        }
+        int r = read_input_frame(af, frame);
+        if (r <= 0) {
+            av_frame_free(&frame);
+            if (r < 0)
+                return -1;
             break;
-        if (lavc_ret < 0) {
-            MP_FATAL(af, "Encode failed.\n");
-            goto done;
         }
+        pthread_mutex_lock(&s->lock);
+        while (s->num_in_queue + s->busy >= MAX_QUEUED && !s->failed)
+            pthread_cond_wait(&s->wakeup, &s->lock);
+        MP_TARRAY_APPEND(s, s->in_queue, s->num_in_queue, frame);
         s->encoder_buffered += s->input->samples;
+        pthread_cond_broadcast(&s->wakeup);
+        pthread_mutex_unlock(&s->lock);
         s->input->samples = 0;
     }
-    int lavc_ret = avcodec_receive_packet(s->lavc_actx, &pkt);
-    if (lavc_ret == AVERROR(EAGAIN)) {
-        // Need to buffer more input.
-        err = 0;
-        goto done;
+
+    pthread_mutex_lock(&s->lock);
+    // On EOF, everything queued must be output.
+    while (s->draining && !s->num_out_queue && !s->failed &&
+           (s->num_in_queue || s->busy))
+        pthread_cond_wait(&s->wakeup, &s->lock);
+    if (s->num_out_queue) {
+        pkt = s->out_queue[0];
+        MP_TARRAY_REMOVE_AT(s->out_queue, s->num_out_queue, 0);
+        s->encoder_buffered -= AC3_FRAME_SIZE;
     }
-    if (lavc_ret < 0) {
-        MP_FATAL(af, "Encode failed.\n");
+    bool failed = s->failed;
+    pthread_mutex_unlock(&s->lock);
+
+    if (!pkt) {
+        if (failed) {
+            MP_FATAL(af, "Encode failed.\n");
+            goto done;
+        }
+        err = 0; // need more input
         goto done;
     }
 
     MP_DBG(af, "avcodec_encode_audio got %d, pending %d.\n",
-           pkt.size, s->pending->samples + s->input->samples);
-
-    s->encoder_buffered -= AC3_FRAME_SIZE;
+           pkt->size, (s->pending ? s->pending->samples : 0) + s->input->samples);
 
     struct mp_audio *out =
         mp_audio_pool_get(af->out_pool, af->data, s->out_samples);
     if (!out)
         goto done;
-    mp_audio_copy_attributes(out, s->pending);
+    if (s->pending)
+        mp_audio_copy_attributes(out, s->pending);
 
-    int frame_size = pkt.size;
+    int frame_size = pkt->size;
     int header_len = 0;
     char hdr[8];
 
-    if (s->cfg_add_iec61937_header && pkt.size > 5) {
-        int bsmod = pkt.data[5] & 0x7;
+    if (s->cfg_add_iec61937_header && pkt->size > 5) {
+        int bsmod = pkt->data[5] & 0x7;
         int len = frame_size;
 
         frame_size = AC3_FRAME_SIZE * 2 * 2;
@@ -344,17 +451,16 @@ static int filter_out(struct af_instance *af)
 
     char *buf = (char *)out->planes[0];
     memcpy(buf, hdr, header_len);
-    memcpy(buf + header_len, pkt.data, pkt.size);
-    memset(buf + header_len + pkt.size, 0,
-           frame_size - (header_len + pkt.size));
-    swap_16((uint16_t *)(buf + header_len), pkt.size / 2);
+    memcpy(buf + header_len, pkt->data, pkt->size);
+    memset(buf + header_len + pkt->size, 0,
+           frame_size - (header_len + pkt->size));
+    swap_16((uint16_t *)(buf + header_len), pkt->size / 2);
     out->samples = frame_size / out->sstride;
     af_add_output_frame(af, out);
 
     err = 0;
 done:
-    av_packet_unref(&pkt);
-    av_frame_free(&frame);
+    av_packet_free(&pkt);
     update_delay(af);
     return err;
 }
@@ -367,6 +473,9 @@ static int af_open(struct af_instance* af){
     af->filter_frame = filter_frame;
     af->filter_out = filter_out;
 
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wakeup, NULL);
+
     s->lavc_acodec = avcodec_find_encoder_by_name(s->cfg_encoder);
     if (!s->lavc_acodec) {
         MP_ERR(af, "Couldn't find encoder %s.\n", s->cfg_encoder);
@@ -409,6 +518,12 @@ static int af_open(struct af_instance* af){
         }
     }
 
+    if (pthread_create(&s->thread, NULL, encode_thread, s)) {
+        MP_ERR(af, "Could not create encoder thread.\n");
+        return AF_ERROR;
+    }
+    s->thread_valid = true;
+
     return AF_OK;
 }
 
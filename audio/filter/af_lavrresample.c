@@ -70,6 +70,7 @@ struct af_resample_opts {
     int linear;
     double cutoff;
     int normalize;
+    double max_compensation;
 };
 
 struct af_resample {
@@ -94,6 +95,7 @@ struct af_resample {
     int out_rate;
     int out_format;
     struct mp_chmap out_channels;
+    double effective_speed; // playback speed actually applied
 };
 
 #if HAVE_LIBAVRESAMPLE
@@ -238,6 +240,7 @@ static int configure_lavrr(struct af_instance *af, struct mp_audio *in,
     s->in_format   = in->format;
     s->out_channels= out->channels;
     s->in_channels = in->channels;
+    s->effective_speed = s->in_rate / (double)s->in_rate_af;
 
     av_opt_set_int(s->avrctx, "filter_size",        s->opts.filter_size, 0);
     av_opt_set_int(s->avrctx, "phase_shift",        s->opts.phase_shift, 0);
@@ -395,6 +398,11 @@ static int control(struct af_instance *af, int cmd, void *arg)
         s->playback_speed = *(double *)arg;
         return AF_OK;
     }
+    case AF_CONTROL_GET_RESAMPLE_SPEED:
+        if (!s->avrctx || s->playback_speed == 1.0)
+            return AF_UNKNOWN;
+        *(double *)arg = s->effective_speed;
+        return AF_OK;
     case AF_CONTROL_RESET:
         if (s->avrctx) {
 #if HAVE_LIBSWRESAMPLE
@@ -442,8 +450,7 @@ static void extra_output_conversion(struct af_instance *af, struct mp_audio *mpa
         void *ptr = mpa->planes[p];
         int total = mpa->samples * mpa->spf;
         if (af_fmt_from_planar(mpa->format) == AF_FORMAT_FLOAT) {
-            for (int s = 0; s < total; s++)
-                ((float *)ptr)[s] = av_clipf(((float *)ptr)[s], -1.0f, 1.0f);
+            af_volume_clip_float(ptr, total, 1.0f);
         } else if (af_fmt_from_planar(mpa->format) == AF_FORMAT_DOUBLE) {
             for (int s = 0; s < total; s++)
                 ((double *)ptr)[s] = MPCLAMP(((double *)ptr)[s], -1.0, 1.0);
@@ -542,11 +549,16 @@ static int filter(struct af_instance *af, struct mp_audio *in)
     struct af_resample *s = af->priv;
 
     int new_rate = rate_from_speed(s->in_rate_af, s->playback_speed);
-    bool need_reinit = fabs(new_rate / (double)s->in_rate - 1) > 0.01;
+    // Small deviations from the rate the resampler was configured for are
+    // applied by the compensation mechanism, which changes the ratio
+    // continuously. A full reinit drains the resampler, which can glitch.
+    bool need_reinit =
+        fabs(new_rate / (double)s->in_rate - 1) > s->opts.max_compensation;
 
     if (s->avrctx) {
         AVRational r = av_d2q(s->playback_speed * s->in_rate_af / s->in_rate,
                               INT_MAX / 2);
+        s->effective_speed = s->in_rate * av_q2d(r) / s->in_rate_af;
         // Essentially, swr/avresample_set_compensation() does 2 things:
         // - adjust output sample rate by sample_delta/compensation_distance
         // - reset the adjustment after compensation_distance output samples
@@ -560,6 +572,8 @@ static int filter(struct af_instance *af, struct mp_audio *in)
     }
 
     if (need_reinit && new_rate != s->in_rate) {
+        MP_VERBOSE(af, "Reinitializing for speed %f (%d -> %d Hz).\n",
+                   s->playback_speed, s->in_rate, new_rate);
         // Before reconfiguring, drain the audio that is still buffered
         // in the resampler.
         filter_resample(af, NULL);
@@ -599,6 +613,7 @@ const struct af_info af_info_lavrresample = {
             .cutoff      = 0.0,
             .phase_shift = 10,
             .normalize   = -1,
+            .max_compensation = 0.05,
         },
         .playback_speed = 1.0,
         .allow_detach = 1,
@@ -608,6 +623,8 @@ const struct af_info af_info_lavrresample = {
         OPT_INTRANGE("phase-shift", opts.phase_shift, 0, 0, 30),
         OPT_FLAG("linear", opts.linear, 0),
         OPT_DOUBLE("cutoff", opts.cutoff, M_OPT_RANGE, .min = 0, .max = 1),
+        OPT_DOUBLE("max-compensation", opts.max_compensation, M_OPT_RANGE,
+                   .min = 0, .max = 0.5),
         OPT_FLAG("detach", allow_detach, 0),
         OPT_CHOICE("normalize", opts.normalize, 0,
                    ({"no", 0}, {"yes", 1}, {"auto", -1})),
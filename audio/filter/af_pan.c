@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <inttypes.h>
 #include <math.h>
@@ -140,19 +141,19 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
 {
     if (!c)
         return 0;
-    struct mp_audio *l = mp_audio_pool_get(af->out_pool, &af->fmt_out, c->samples);
+    int           nchi = c->nch;          // Number of input channels
+    struct mp_audio *l = af_get_inplace_frame(af, c);
     if (!l) {
         talloc_free(c);
         return -1;
     }
-    mp_audio_copy_attributes(l, c);
 
     af_pan_t*     s    = af->priv;        // Setup for this instance
     float         *in  = c->planes[0];    // Input audio data
     float         *out = NULL;            // Output audio data
-    float         *end = in+c->samples * c->nch;    // End of loop
-    int           nchi = c->nch;          // Number of input channels
+    float         *end = in+c->samples * nchi;      // End of loop
     int           ncho = l->nch;          // Number of output channels
+    float         tmp[AF_NCH];            // Output sample (in may be out)
     register int  j, k;
 
     out = l->planes[0];
@@ -164,13 +165,15 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
             register float  *tin = in;
             for (k = 0; k < nchi; k++)
                 x += tin[k] * s->level[j][k];
-            out[j] = x;
+            tmp[j] = x;
         }
+        memcpy(out, tmp, ncho * sizeof(float));
         out += ncho;
         in += nchi;
     }
 
-    talloc_free(c);
+    if (l != c)
+        talloc_free(c);
     af_add_output_frame(af, l);
     return 0;
 }
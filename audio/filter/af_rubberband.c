@@ -17,26 +17,56 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <rubberband/rubberband-c.h>
 
 #include "common/common.h"
+#include "osdep/threads.h"
 #include "af.h"
 
+// The actual processing runs on a worker thread, which keeps up to this much
+// input and output audio buffered.
+#define MAX_IN_SECS 0.5
+#define MAX_OUT_SECS 0.5
+
 struct priv {
     RubberBandState rubber;
     double speed;
     double pitch;
-    struct mp_audio *pending;
+
+    pthread_t thread;
+    bool thread_valid;
+    // Held by the worker while it uses rubber and the fields up to the next
+    // comment. The player thread holds it while changing the rubberband
+    // state.
+    pthread_mutex_t rb_lock;
+    struct mp_audio out_fmt;
     bool needs_reset;
     // Estimate how much librubberband has buffered internally.
     // I could not find a way to do this with the librubberband API.
     double rubber_delay;
+
+    // Protected by lock.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // for both, worker and player thread
+    bool thread_exit;
+    struct mp_audio **in_queue;
+    int num_in_queue;
+    int in_samples;
+    struct mp_audio **out_queue;
+    int num_out_queue;
+    int out_samples;
+    bool eof;                   // the player sent EOF
+    bool eof_done;              // the worker has flushed rubber on EOF
+    int delay_samples;          // rubber_delay + in_samples
+
     // command line options
     int opt_transients, opt_detector, opt_phase, opt_window,
         opt_smoothing, opt_formant, opt_pitch, opt_channels;
 };
 
+// Call with rb_lock held.
 static void update_speed(struct af_instance *af, double new_speed)
 {
     struct priv *p = af->priv;
@@ -45,6 +75,7 @@ static void update_speed(struct af_instance *af, double new_speed)
     rubberband_set_time_ratio(p->rubber, 1.0 / p->speed);
 }
 
+// Call with rb_lock held.
 static void update_pitch(struct af_instance *af, double new_pitch)
 {
     struct priv *p = af->priv;
@@ -53,6 +84,33 @@ static void update_pitch(struct af_instance *af, double new_pitch)
     rubberband_set_pitch_scale(p->rubber, p->pitch);
 }
 
+static void free_queue(struct mp_audio ***queue, int *num_queue)
+{
+    for (int n = 0; n < *num_queue; n++)
+        talloc_free((*queue)[n]);
+    *num_queue = 0;
+}
+
+// Call with rb_lock held.
+static void reset(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    pthread_mutex_lock(&p->lock);
+    free_queue(&p->in_queue, &p->num_in_queue);
+    free_queue(&p->out_queue, &p->num_out_queue);
+    p->in_samples = p->out_samples = 0;
+    p->eof = p->eof_done = false;
+    p->delay_samples = 0;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    if (p->rubber)
+        rubberband_reset(p->rubber);
+    p->needs_reset = false;
+    p->rubber_delay = 0;
+}
+
 static int control(struct af_instance *af, int cmd, void *arg)
 {
     struct priv *p = af->priv;
@@ -66,6 +124,8 @@ static int control(struct af_instance *af, int cmd, void *arg)
         in->format = AF_FORMAT_FLOATP;
         mp_audio_copy_config(out, in);
 
+        pthread_mutex_lock(&p->rb_lock);
+
         if (p->rubber)
             rubberband_delete(p->rubber);
 
@@ -76,26 +136,31 @@ static int control(struct af_instance *af, int cmd, void *arg)
 
         p->rubber = rubberband_new(in->rate, in->channels.num, opts, 1.0, 1.0);
         if (!p->rubber) {
+            pthread_mutex_unlock(&p->rb_lock);
             MP_FATAL(af, "librubberband initialization failed.\n");
             return AF_ERROR;
         }
 
+        mp_audio_copy_config(&p->out_fmt, out);
         update_speed(af, p->speed);
         update_pitch(af, p->pitch);
-        control(af, AF_CONTROL_RESET, NULL);
+        reset(af);
+
+        pthread_mutex_unlock(&p->rb_lock);
 
         return mp_audio_config_equals(in, &orig_in) ? AF_OK : AF_FALSE;
     }
     case AF_CONTROL_SET_PLAYBACK_SPEED: {
-        update_speed(af, *(double *)arg);
+        pthread_mutex_lock(&p->rb_lock);
+        if (p->rubber)
+            update_speed(af, *(double *)arg);
+        pthread_mutex_unlock(&p->rb_lock);
         return AF_OK;
     }
     case AF_CONTROL_RESET:
-        if (p->rubber)
-            rubberband_reset(p->rubber);
-        talloc_free(p->pending);
-        p->pending = NULL;
-        p->rubber_delay = 0;
+        pthread_mutex_lock(&p->rb_lock);
+        reset(af);
+        pthread_mutex_unlock(&p->rb_lock);
         return AF_OK;
     case AF_CONTROL_COMMAND: {
         char **args = arg;
@@ -104,7 +169,10 @@ static int control(struct af_instance *af, int cmd, void *arg)
             double pitch = strtod(args[1], &endptr);
             if (*endptr || pitch < 0.01 || pitch > 100.0)
                 return CONTROL_ERROR;
-            update_pitch(af, pitch);
+            pthread_mutex_lock(&p->rb_lock);
+            if (p->rubber)
+                update_pitch(af, pitch);
+            pthread_mutex_unlock(&p->rb_lock);
             return CONTROL_OK;
         } else {
             return CONTROL_ERROR;
@@ -114,72 +182,182 @@ static int control(struct af_instance *af, int cmd, void *arg)
     return AF_UNKNOWN;
 }
 
-static int filter_frame(struct af_instance *af, struct mp_audio *data)
+// Worker thread, with rb_lock held. Retrieve all output rubber has, and
+// append it to out_frames.
+static void retrieve_output(struct af_instance *af, struct mp_audio ***out_frames,
+                            int *num_out_frames)
 {
     struct priv *p = af->priv;
 
-    talloc_free(p->pending);
-    p->pending = data;
-
-    return 0;
+    int samples;
+    while ((samples = rubberband_available(p->rubber)) > 0) {
+        struct mp_audio *out = mp_audio_pool_get(af->out_pool, &p->out_fmt,
+                                                 samples);
+        if (!out) {
+            MP_ERR(af, "Out of memory.\n");
+            return;
+        }
+        float **out_data = (void *)&out->planes;
+        out->samples = rubberband_retrieve(p->rubber, out_data, out->samples);
+        p->rubber_delay -= out->samples * p->speed;
+        MP_TARRAY_APPEND(NULL, *out_frames, *num_out_frames, out);
+    }
 }
 
-static int filter_out(struct af_instance *af)
+// Worker thread, with rb_lock held. Feed the frame (or EOF if in==NULL) to
+// rubber.
+static void process(struct af_instance *af, struct mp_audio *in,
+                    struct mp_audio ***out_frames, int *num_out_frames)
 {
     struct priv *p = af->priv;
 
-    while (rubberband_available(p->rubber) <= 0) {
+    if (!in) {
         const float *dummy[MP_NUM_CHANNELS] = {0};
-        const float **in_data = dummy;
-        size_t in_samples = 0;
-        if (p->pending) {
-            if (!p->pending->samples)
-                break;
-
-            // recover from previous EOF
-            if (p->needs_reset) {
-                rubberband_reset(p->rubber);
-                p->rubber_delay = 0;
-            }
-            p->needs_reset = false;
-
-            size_t needs = rubberband_get_samples_required(p->rubber);
-            in_data = (void *)&p->pending->planes;
-            in_samples = MPMIN(p->pending->samples, needs);
-        }
+        if (!p->needs_reset)
+            rubberband_process(p->rubber, dummy, 0, true);
+        p->needs_reset = true;
+        retrieve_output(af, out_frames, num_out_frames);
+        return;
+    }
 
-        if (p->needs_reset)
-            break; // previous EOF
-        p->needs_reset = !p->pending; // EOF
+    // recover from previous EOF
+    if (p->needs_reset) {
+        rubberband_reset(p->rubber);
+        p->rubber_delay = 0;
+    }
+    p->needs_reset = false;
 
-        rubberband_process(p->rubber, in_data, in_samples, p->needs_reset);
+    while (in->samples > 0) {
+        size_t needs = rubberband_get_samples_required(p->rubber);
+        size_t in_samples = MPMIN(in->samples, MPMAX(needs, 1));
+        const float **in_data = (void *)&in->planes;
+        rubberband_process(p->rubber, in_data, in_samples, false);
         p->rubber_delay += in_samples;
+        mp_audio_skip_samples(in, in_samples);
 
-        if (!p->pending)
-            break;
-        mp_audio_skip_samples(p->pending, in_samples);
+        retrieve_output(af, out_frames, num_out_frames);
     }
+}
 
-    int out_samples = rubberband_available(p->rubber);
-    if (out_samples > 0) {
-        struct mp_audio *out =
-            mp_audio_pool_get(af->out_pool, af->data, out_samples);
-        if (!out)
-            return -1;
-        if (p->pending)
-            mp_audio_copy_config(out, p->pending);
+static bool has_work(struct priv *p)
+{
+    if (!p->num_in_queue && !(p->eof && !p->eof_done))
+        return false;
+    return p->out_samples < p->out_fmt.rate * MAX_OUT_SECS;
+}
 
-        float **out_data = (void *)&out->planes;
-        out->samples = rubberband_retrieve(p->rubber, out_data, out->samples);
-        p->rubber_delay -= out->samples * p->speed;
+static void *worker_thread(void *arg)
+{
+    struct af_instance *af = arg;
+    struct priv *p = af->priv;
+
+    mpthread_set_name("rubberband");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->thread_exit) {
+        if (!has_work(p)) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        pthread_mutex_lock(&p->rb_lock);
+        pthread_mutex_lock(&p->lock);
+        // Recheck, as a reset might have happened while the lock was released.
+        struct mp_audio *in = NULL;
+        bool work = has_work(p);
+        if (work && p->num_in_queue) {
+            in = p->in_queue[0];
+            MP_TARRAY_REMOVE_AT(p->in_queue, p->num_in_queue, 0);
+            p->in_samples -= in->samples;
+            pthread_cond_broadcast(&p->wakeup);
+        }
+        pthread_mutex_unlock(&p->lock);
 
-        af_add_output_frame(af, out);
+        struct mp_audio **out_frames = NULL;
+        int num_out_frames = 0;
+        if (work && p->rubber) {
+            process(af, in, &out_frames, &num_out_frames);
+        } else {
+            work = false;
+        }
+        talloc_free(in);
+        double rubber_delay = p->rubber_delay;
+
+        // Hold rb_lock until the output is queued, so a concurrent reset
+        // can't be overtaken by output from before the reset.
+        pthread_mutex_lock(&p->lock);
+        pthread_mutex_unlock(&p->rb_lock);
+        for (int n = 0; n < num_out_frames; n++) {
+            MP_TARRAY_APPEND(p, p->out_queue, p->num_out_queue, out_frames[n]);
+            p->out_samples += out_frames[n]->samples;
+        }
+        if (work && !in)
+            p->eof_done = true;
+        p->delay_samples = rubber_delay + p->in_samples;
+        pthread_cond_broadcast(&p->wakeup);
+        talloc_free(out_frames);
     }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
 
-    int delay_samples = p->rubber_delay;
-    if (p->pending)
-        delay_samples += p->pending->samples;
-    af->delay = delay_samples / (af->data->rate * p->speed);
+// Call with lock held.
+static void add_output(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    for (int n = 0; n < p->num_out_queue; n++)
+        af_add_output_frame(af, p->out_queue[n]);
+    p->num_out_queue = 0;
+    p->out_samples = 0;
+    pthread_cond_broadcast(&p->wakeup);
+}
+
+static int filter_frame(struct af_instance *af, struct mp_audio *data)
+{
+    struct priv *p = af->priv;
+
+    pthread_mutex_lock(&p->lock);
+    if (data) {
+        // Don't let the player get too far ahead of the worker. Also finish
+        // draining on EOF before accepting new data. Taking the output makes
+        // sure the worker isn't stalled by a full output queue meanwhile.
+        while ((p->in_samples >= af->data->rate * MAX_IN_SECS ||
+                (p->eof && !p->eof_done)) && p->rubber)
+        {
+            add_output(af);
+            pthread_cond_wait(&p->wakeup, &p->lock);
+        }
+        p->eof = p->eof_done = false;
+        if (data->samples) {
+            MP_TARRAY_APPEND(p, p->in_queue, p->num_in_queue, data);
+            p->in_samples += data->samples;
+            p->delay_samples += data->samples;
+            data = NULL;
+        }
+    } else {
+        p->eof = true;
+    }
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    talloc_free(data);
+    return 0;
+}
+
+static int filter_out(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    pthread_mutex_lock(&p->lock);
+    // On EOF, the caller expects all remaining output to be returned now.
+    while (p->eof && !p->eof_done && !p->num_out_queue && p->rubber)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    add_output(af);
+    af->delay = p->delay_samples / (af->data->rate * p->speed);
+    pthread_mutex_unlock(&p->lock);
 
     return 0;
 }
@@ -188,17 +366,44 @@ static void uninit(struct af_instance *af)
 {
     struct priv *p = af->priv;
 
+    if (p->thread_valid) {
+        pthread_mutex_lock(&p->lock);
+        p->thread_exit = true;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->thread, NULL);
+    }
+
+    free_queue(&p->in_queue, &p->num_in_queue);
+    free_queue(&p->out_queue, &p->num_out_queue);
     if (p->rubber)
         rubberband_delete(p->rubber);
-    talloc_free(p->pending);
+
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->rb_lock);
 }
 
 static int af_open(struct af_instance *af)
 {
+    struct priv *p = af->priv;
+
     af->control = control;
     af->filter_frame = filter_frame;
     af->filter_out = filter_out;
     af->uninit = uninit;
+
+    pthread_mutex_init(&p->rb_lock, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
+    if (pthread_create(&p->thread, NULL, worker_thread, af)) {
+        MP_ERR(af, "Could not create worker thread.\n");
+        uninit(af);
+        return AF_ERROR;
+    }
+    p->thread_valid = true;
+
     return AF_OK;
 }
 
@@ -35,6 +35,9 @@
 #include <limits.h>
 #include <assert.h>
 
+#include <libavutil/cpu.h>
+
+#include "config.h"
 #include "common/common.h"
 
 #include "af.h"
@@ -70,6 +73,8 @@ typedef struct af_scaletempo_s
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct af_scaletempo_s *s);
+    float (*corr_float)(const float *ppc, const float *ps, int n);
+    int64_t (*corr_s16)(const int32_t *ppc, const int16_t *ps, int n);
     // command line
     float scale_nominal;
     float ms_stride;
@@ -117,6 +122,195 @@ static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
 
 #define UNROLL_PADDING (4 * 4)
 
+// Cross correlation kernels: return sum(ppc[i] * ps[i]) for i in [0, n).
+// The s16 variants are bit-exact with each other, since the products always
+// fit into int32 (|ppc| <= 65535) and are summed as int64. The float variants
+// only differ in summation order.
+
+static float corr_float_c(const float *ppc, const float *ps, int n)
+{
+    float corr = 0;
+    for (int i = 0; i < n; i++)
+        corr += ppc[i] * ps[i];
+    return corr;
+}
+
+// Relies on UNROLL_PADDING zeros after ppc[n - 1].
+static int64_t corr_s16_c(const int32_t *ppc, const int16_t *ps, int n)
+{
+    int64_t corr = 0;
+    ppc += n;
+    ps  += n;
+    long i = -n;
+    do {
+        corr += ppc[i + 0] * ps[i + 0];
+        corr += ppc[i + 1] * ps[i + 1];
+        corr += ppc[i + 2] * ps[i + 2];
+        corr += ppc[i + 3] * ps[i + 3];
+        i += 4;
+    } while (i < 0);
+    return corr;
+}
+
+#if HAVE_SSE4_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#include <smmintrin.h>
+
+static float corr_float_sse2(const float *ppc, const float *ps, int n)
+{
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(ppc + i),
+                                           _mm_loadu_ps(ps + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(ppc + i + 4),
+                                           _mm_loadu_ps(ps + i + 4)));
+    }
+    float tmp[4];
+    _mm_storeu_ps(tmp, _mm_add_ps(acc0, acc1));
+    float corr = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    for (; i < n; i++)
+        corr += ppc[i] * ps[i];
+    return corr;
+}
+
+static int64_t corr_s16_sse4(const int32_t *ppc, const int16_t *ps, int n)
+{
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(ppc + i));
+        __m128i b = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(ps + i)));
+        __m128i p = _mm_mullo_epi32(a, b);
+        acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(p));
+        acc = _mm_add_epi64(acc, _mm_cvtepi32_epi64(_mm_srli_si128(p, 8)));
+    }
+    int64_t tmp[2];
+    _mm_storeu_si128((__m128i *)tmp, acc);
+    int64_t corr = tmp[0] + tmp[1];
+    for (; i < n; i++)
+        corr += ppc[i] * ps[i];
+    return corr;
+}
+
+#pragma GCC pop_options
+#endif
+
+#if HAVE_AVX2_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static float corr_float_avx2(const float *ppc, const float *ps, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(ppc + i),
+                                                 _mm256_loadu_ps(ps + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(ppc + i + 8),
+                                                 _mm256_loadu_ps(ps + i + 8)));
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+                            _mm256_extractf128_ps(acc, 1));
+    float tmp[4];
+    _mm_storeu_ps(tmp, sum);
+    float corr = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    for (; i < n; i++)
+        corr += ppc[i] * ps[i];
+    return corr;
+}
+
+static int64_t corr_s16_avx2(const int32_t *ppc, const int16_t *ps, int n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(ppc + i));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(ps + i)));
+        __m256i p = _mm256_mullo_epi32(a, b);
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+    }
+    int64_t tmp[4];
+    _mm256_storeu_si256((__m256i *)tmp, acc);
+    int64_t corr = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    for (; i < n; i++)
+        corr += ppc[i] * ps[i];
+    return corr;
+}
+
+#pragma GCC pop_options
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+static float corr_float_neon(const float *ppc, const float *ps, int n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(ppc + i), vld1q_f32(ps + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(ppc + i + 4), vld1q_f32(ps + i + 4));
+    }
+    float tmp[4];
+    vst1q_f32(tmp, vaddq_f32(acc0, acc1));
+    float corr = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    for (; i < n; i++)
+        corr += ppc[i] * ps[i];
+    return corr;
+}
+
+static int64_t corr_s16_neon(const int32_t *ppc, const int16_t *ps, int n)
+{
+    int64x2_t acc = vdupq_n_s64(0);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int32x4_t p = vmulq_s32(vld1q_s32(ppc + i), vmovl_s16(vld1_s16(ps + i)));
+        acc = vpadalq_s32(acc, p);
+    }
+    int64_t corr = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+    for (; i < n; i++)
+        corr += ppc[i] * ps[i];
+    return corr;
+}
+#endif
+
+// Pick the fastest available correlation kernels.
+static void select_corr(struct af_instance *af, af_scaletempo_t *s)
+{
+    const char *name = "C";
+    s->corr_float = corr_float_c;
+    s->corr_s16 = corr_s16_c;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    name = "NEON";
+    s->corr_float = corr_float_neon;
+    s->corr_s16 = corr_s16_neon;
+#endif
+#if HAVE_SSE4_INTRINSICS
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_SSE2) {
+        name = "SSE2";
+        s->corr_float = corr_float_sse2;
+    }
+    if (flags & AV_CPU_FLAG_SSE4) {
+        name = "SSE4";
+        s->corr_s16 = corr_s16_sse4;
+    }
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2) {
+        name = "AVX2";
+        s->corr_float = corr_float_avx2;
+        s->corr_s16 = corr_s16_avx2;
+    }
+#endif
+#endif
+    MP_VERBOSE(af, "Using %s correlation.\n", name);
+}
+
 static int best_overlap_offset_float(af_scaletempo_t *s)
 {
     float best_corr = INT_MIN;
@@ -129,13 +323,10 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
     for (int i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = *pw++ **po++;
 
+    int n = s->samples_overlap - s->num_channels;
     float *search_start = (float *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        float corr = s->corr_float(s->buf_pre_corr, search_start, n);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -158,21 +349,10 @@ static int best_overlap_offset_s16(af_scaletempo_t *s)
     for (long i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = (*pw++ **po++) >> 15;
 
+    int n = s->samples_overlap - s->num_channels;
     int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        int64_t corr = 0;
-        int16_t *ps = search_start;
-        ppc = s->buf_pre_corr;
-        ppc += s->samples_overlap - s->num_channels;
-        ps  += s->samples_overlap - s->num_channels;
-        long i  = -(s->samples_overlap - s->num_channels);
-        do {
-            corr += ppc[i + 0] * ps[i + 0];
-            corr += ppc[i + 1] * ps[i + 1];
-            corr += ppc[i + 2] * ps[i + 2];
-            corr += ppc[i + 3] * ps[i + 3];
-            i += 4;
-        } while (i < 0);
+        int64_t corr = s->corr_s16(s->buf_pre_corr, search_start, n);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -358,6 +538,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
         if (s->frames_search <= 0)
             s->best_overlap_offset = NULL;
         else {
+            select_corr(af, s);
             if (use_int) {
                 int64_t t = frames_overlap;
                 int32_t n = 8589934588LL / (t * t); // 4 * (2^31 - 1) / t^2
@@ -128,9 +128,13 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
             if (af_make_writeable(af, data) < 0)
                 return; // oom
             int16_t *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                int x = (a[i] * vol) >> 8;
-                a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
+            if (vol <= INT16_MAX) {
+                af_volume_s16(a, num_samples, vol);
+            } else {
+                for (int i = 0; i < num_samples; i++) {
+                    int x = (a[i] * vol) >> 8;
+                    a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
+                }
             }
         }
     } else if (af_fmt_from_planar(af->data->format) == AF_FORMAT_FLOAT) {
@@ -139,9 +143,11 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
             if (af_make_writeable(af, data) < 0)
                 return; // oom
             float *a = data->planes[p];
-            for (int i = 0; i < num_samples; i++) {
-                float x = a[i] * vol;
-                a[i] = s->soft ? af_softclip(x) : MPCLAMP(x, -1.0, 1.0);
+            if (s->soft) {
+                for (int i = 0; i < num_samples; i++)
+                    a[i] = af_softclip(a[i] * vol);
+            } else {
+                af_volume_clip_float(a, num_samples, vol);
             }
         }
     }
@@ -0,0 +1,233 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Each filter depends on its previous outputs, so samples of one channel
+// can't be computed in parallel. Instead, the channels are the SIMD lanes:
+// the input is copied to a buffer in which every sample frame is padded to a
+// multiple of 4 channels, and the stages run one after another over the whole
+// buffer, keeping coefficients and history in registers. The coefficients
+// and the history are stored as [stage][coefficient][channel] (structure of
+// arrays), so they can be loaded as vectors as well.
+
+#include <string.h>
+#include <assert.h>
+
+#include <libavutil/cpu.h>
+
+#include "config.h"
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "biquad.h"
+
+#define NUM_COEFFS 5 // b0 b1 b2 a1 a2
+
+struct af_biquad {
+    int num_channels;
+    int num_stages;
+    int width;          // num_channels rounded up to 4
+    float *coeffs;      // [num_stages][NUM_COEFFS][width]
+    float *state;       // [num_stages][2][width] (w[n-1], w[n-2])
+    float *buf;         // [buf_samples][width]
+    int buf_samples;
+};
+
+struct af_biquad *af_biquad_create(void *ta_parent, int num_channels,
+                                   int num_stages)
+{
+    assert(num_channels > 0 && num_stages > 0);
+    struct af_biquad *bq = talloc_zero(ta_parent, struct af_biquad);
+    bq->num_channels = num_channels;
+    bq->num_stages = num_stages;
+    bq->width = MP_ALIGN_UP(num_channels, 4);
+    bq->coeffs = talloc_zero_array(bq, float, num_stages * NUM_COEFFS * bq->width);
+    bq->state = talloc_zero_array(bq, float, num_stages * 2 * bq->width);
+    return bq;
+}
+
+void af_biquad_set(struct af_biquad *bq, int stage, int channel,
+                   struct af_biquad_coeffs c)
+{
+    assert(stage >= 0 && stage < bq->num_stages);
+    assert(channel >= 0 && channel < bq->num_channels);
+    float *k = bq->coeffs + stage * NUM_COEFFS * bq->width + channel;
+    float v[NUM_COEFFS] = {c.b0, c.b1, c.b2, c.a1, c.a2};
+    for (int n = 0; n < NUM_COEFFS; n++)
+        k[n * bq->width] = v[n];
+}
+
+void af_biquad_reset(struct af_biquad *bq)
+{
+    memset(bq->state, 0, bq->num_stages * 2 * bq->width * sizeof(float));
+}
+
+// Process lanes [c, c + 1) of one stage. The operation order is the same as
+// in the SIMD variants.
+static void run_stage_c(float *buf, int samples, int width, int c,
+                        const float *k, float *st)
+{
+    float b0 = k[0 * width], b1 = k[1 * width], b2 = k[2 * width];
+    float a1 = k[3 * width], a2 = k[4 * width];
+    float w1 = st[0], w2 = st[width];
+    for (int i = 0; i < samples; i++) {
+        float *x = buf + i * width + c;
+        float w = *x - (a1 * w1 + a2 * w2);
+        *x = b0 * w + (b1 * w1 + b2 * w2);
+        w2 = w1;
+        w1 = w;
+    }
+    st[0] = w1;
+    st[width] = w2;
+}
+
+#if HAVE_SSE4_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+static void run_stage_sse2(float *buf, int samples, int width, int c,
+                           const float *k, float *st)
+{
+    __m128 b0 = _mm_loadu_ps(k + 0 * width), b1 = _mm_loadu_ps(k + 1 * width);
+    __m128 b2 = _mm_loadu_ps(k + 2 * width), a1 = _mm_loadu_ps(k + 3 * width);
+    __m128 a2 = _mm_loadu_ps(k + 4 * width);
+    __m128 w1 = _mm_loadu_ps(st), w2 = _mm_loadu_ps(st + width);
+    for (int i = 0; i < samples; i++) {
+        float *x = buf + i * width + c;
+        __m128 w = _mm_sub_ps(_mm_loadu_ps(x), _mm_add_ps(_mm_mul_ps(a1, w1),
+                                                          _mm_mul_ps(a2, w2)));
+        __m128 y = _mm_add_ps(_mm_mul_ps(b0, w), _mm_add_ps(_mm_mul_ps(b1, w1),
+                                                            _mm_mul_ps(b2, w2)));
+        _mm_storeu_ps(x, y);
+        w2 = w1;
+        w1 = w;
+    }
+    _mm_storeu_ps(st, w1);
+    _mm_storeu_ps(st + width, w2);
+}
+
+#pragma GCC pop_options
+#endif
+
+#if HAVE_AVX2_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static void run_stage_avx2(float *buf, int samples, int width, int c,
+                           const float *k, float *st)
+{
+    __m256 b0 = _mm256_loadu_ps(k + 0 * width);
+    __m256 b1 = _mm256_loadu_ps(k + 1 * width);
+    __m256 b2 = _mm256_loadu_ps(k + 2 * width);
+    __m256 a1 = _mm256_loadu_ps(k + 3 * width);
+    __m256 a2 = _mm256_loadu_ps(k + 4 * width);
+    __m256 w1 = _mm256_loadu_ps(st), w2 = _mm256_loadu_ps(st + width);
+    for (int i = 0; i < samples; i++) {
+        float *x = buf + i * width + c;
+        __m256 w = _mm256_sub_ps(_mm256_loadu_ps(x),
+                                 _mm256_add_ps(_mm256_mul_ps(a1, w1),
+                                               _mm256_mul_ps(a2, w2)));
+        __m256 y = _mm256_add_ps(_mm256_mul_ps(b0, w),
+                                 _mm256_add_ps(_mm256_mul_ps(b1, w1),
+                                               _mm256_mul_ps(b2, w2)));
+        _mm256_storeu_ps(x, y);
+        w2 = w1;
+        w1 = w;
+    }
+    _mm256_storeu_ps(st, w1);
+    _mm256_storeu_ps(st + width, w2);
+}
+
+#pragma GCC pop_options
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+static void run_stage_neon(float *buf, int samples, int width, int c,
+                           const float *k, float *st)
+{
+    float32x4_t b0 = vld1q_f32(k + 0 * width), b1 = vld1q_f32(k + 1 * width);
+    float32x4_t b2 = vld1q_f32(k + 2 * width), a1 = vld1q_f32(k + 3 * width);
+    float32x4_t a2 = vld1q_f32(k + 4 * width);
+    float32x4_t w1 = vld1q_f32(st), w2 = vld1q_f32(st + width);
+    for (int i = 0; i < samples; i++) {
+        float *x = buf + i * width + c;
+        float32x4_t w = vsubq_f32(vld1q_f32(x), vaddq_f32(vmulq_f32(a1, w1),
+                                                          vmulq_f32(a2, w2)));
+        float32x4_t y = vaddq_f32(vmulq_f32(b0, w), vaddq_f32(vmulq_f32(b1, w1),
+                                                              vmulq_f32(b2, w2)));
+        vst1q_f32(x, y);
+        w2 = w1;
+        w1 = w;
+    }
+    vst1q_f32(st, w1);
+    vst1q_f32(st + width, w2);
+}
+#endif
+
+typedef void (*run_stage_fn)(float *buf, int samples, int width, int c,
+                             const float *k, float *st);
+
+void af_biquad_process(struct af_biquad *bq, float *data, int samples)
+{
+    int nch = bq->num_channels, width = bq->width;
+
+    if (bq->buf_samples < samples) {
+        bq->buf = talloc_realloc(bq, bq->buf, float, samples * width);
+        bq->buf_samples = samples;
+    }
+    float *buf = bq->buf;
+
+    for (int i = 0; i < samples; i++) {
+        float *dst = buf + i * width;
+        memcpy(dst, data + i * nch, nch * sizeof(float));
+        for (int c = nch; c < width; c++)
+            dst[c] = 0;
+    }
+
+    run_stage_fn run = NULL;
+    int lanes = 1;
+#if HAVE_SSE4_INTRINSICS
+    int flags = av_get_cpu_flags();
+#if HAVE_AVX2_INTRINSICS
+    if ((flags & AV_CPU_FLAG_AVX2) && width % 8 == 0) {
+        run = run_stage_avx2;
+        lanes = 8;
+    }
+#endif
+    if (!run && (flags & AV_CPU_FLAG_SSE2)) {
+        run = run_stage_sse2;
+        lanes = 4;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    run = run_stage_neon;
+    lanes = 4;
+#endif
+    if (!run)
+        run = run_stage_c;
+
+    for (int s = 0; s < bq->num_stages; s++) {
+        const float *k = bq->coeffs + s * NUM_COEFFS * width;
+        float *st = bq->state + s * 2 * width;
+        for (int c = 0; c < nch; c += lanes)
+            run(buf, samples, width, c, k + c, st + c);
+    }
+
+    for (int i = 0; i < samples; i++)
+        memcpy(data + i * nch, buf + i * width, nch * sizeof(float));
+}
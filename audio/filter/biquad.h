@@ -0,0 +1,43 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AF_BIQUAD_H
+#define MP_AF_BIQUAD_H
+
+// Cascade of biquad (2nd order IIR) filters, run on interleaved float audio.
+// Each stage can have different coefficients per channel.
+
+struct af_biquad;
+
+// Direct form II, with a0 normalized to 1:
+//  w[n] = x[n] - a1 * w[n-1] - a2 * w[n-2]
+//  y[n] = b0 * w[n] + b1 * w[n-1] + b2 * w[n-2]
+struct af_biquad_coeffs {
+    float b0, b1, b2, a1, a2;
+};
+
+// All coefficients are initially 0 (every stage outputs silence).
+struct af_biquad *af_biquad_create(void *ta_parent, int num_channels,
+                                   int num_stages);
+void af_biquad_set(struct af_biquad *bq, int stage, int channel,
+                   struct af_biquad_coeffs c);
+// Clear the filter history.
+void af_biquad_reset(struct af_biquad *bq);
+// Filter samples*num_channels interleaved samples in place.
+void af_biquad_process(struct af_biquad *bq, float *data, int samples);
+
+#endif
@@ -17,7 +17,12 @@
 
 #include <math.h>
 #include <string.h>
+#include <limits.h>
+#include <assert.h>
 
+#include <libavutil/cpu.h>
+
+#include "config.h"
 #include "common/common.h"
 #include "af.h"
 
@@ -70,3 +75,288 @@ float af_softclip(float a)
     else
         return sin(a);
 }
+
+#if HAVE_SSE4_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+static int volume_s16_sse2(int16_t *a, int num, int vol)
+{
+    __m128i v = _mm_set1_epi16(vol);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m128i x = _mm_loadu_si128((__m128i *)(a + i));
+        __m128i lo = _mm_mullo_epi16(x, v);
+        __m128i hi = _mm_mulhi_epi16(x, v);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8);
+        _mm_storeu_si128((__m128i *)(a + i), _mm_packs_epi32(p0, p1));
+    }
+    return i;
+}
+
+static int volume_float_sse2(float *a, int num, float vol)
+{
+    __m128 v = _mm_set1_ps(vol), min = _mm_set1_ps(-1), max = _mm_set1_ps(1);
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), v);
+        _mm_storeu_ps(a + i, _mm_min_ps(_mm_max_ps(x, min), max));
+    }
+    return i;
+}
+
+static float hsum_sse2(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+static int sum_squares_s16_sse2(const int16_t *a, int num, float *sum)
+{
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        // sign extend to 32 bit
+        __m128 p0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        __m128 p1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        acc = _mm_add_ps(acc, _mm_add_ps(_mm_mul_ps(p0, p0), _mm_mul_ps(p1, p1)));
+    }
+    *sum = hsum_sse2(acc);
+    return i;
+}
+
+static int sum_squares_float_sse2(const float *a, int num, float *sum)
+{
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        __m128 x = _mm_loadu_ps(a + i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(x, x));
+    }
+    *sum = hsum_sse2(acc);
+    return i;
+}
+
+#pragma GCC pop_options
+#endif
+
+#if HAVE_AVX2_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static int volume_s16_avx2(int16_t *a, int num, int vol)
+{
+    __m256i v = _mm256_set1_epi16(vol);
+    int i = 0;
+    for (; i + 16 <= num; i += 16) {
+        __m256i x = _mm256_loadu_si256((__m256i *)(a + i));
+        __m256i lo = _mm256_mullo_epi16(x, v);
+        __m256i hi = _mm256_mulhi_epi16(x, v);
+        // unpack and pack both work per 128 bit lane, so the order is kept
+        __m256i p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 8);
+        __m256i p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 8);
+        _mm256_storeu_si256((__m256i *)(a + i), _mm256_packs_epi32(p0, p1));
+    }
+    return i;
+}
+
+static int volume_float_avx2(float *a, int num, float vol)
+{
+    __m256 v = _mm256_set1_ps(vol);
+    __m256 min = _mm256_set1_ps(-1), max = _mm256_set1_ps(1);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i), v);
+        _mm256_storeu_ps(a + i, _mm256_min_ps(_mm256_max_ps(x, min), max));
+    }
+    return i;
+}
+
+static float hsum_avx2(__m256 v)
+{
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+}
+
+static int sum_squares_s16_avx2(const int16_t *a, int num, float *sum)
+{
+    __m256 acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= num; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256 p0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+        __m256 p1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+        acc = _mm256_add_ps(acc, _mm256_add_ps(_mm256_mul_ps(p0, p0),
+                                               _mm256_mul_ps(p1, p1)));
+    }
+    *sum = hsum_avx2(acc);
+    return i;
+}
+
+static int sum_squares_float_avx2(const float *a, int num, float *sum)
+{
+    __m256 acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m256 x = _mm256_loadu_ps(a + i);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(x, x));
+    }
+    *sum = hsum_avx2(acc);
+    return i;
+}
+
+#pragma GCC pop_options
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+static int volume_s16_neon(int16_t *a, int num, int vol)
+{
+    int16x4_t v = vdup_n_s16(vol);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        int16x8_t x = vld1q_s16(a + i);
+        int32x4_t p0 = vshrq_n_s32(vmull_s16(vget_low_s16(x), v), 8);
+        int32x4_t p1 = vshrq_n_s32(vmull_s16(vget_high_s16(x), v), 8);
+        vst1q_s16(a + i, vcombine_s16(vqmovn_s32(p0), vqmovn_s32(p1)));
+    }
+    return i;
+}
+
+static int volume_float_neon(float *a, int num, float vol)
+{
+    float32x4_t min = vdupq_n_f32(-1), max = vdupq_n_f32(1);
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        float32x4_t x = vmulq_n_f32(vld1q_f32(a + i), vol);
+        vst1q_f32(a + i, vminq_f32(vmaxq_f32(x, min), max));
+    }
+    return i;
+}
+
+static float hsum_neon(float32x4_t v)
+{
+    float32x2_t x = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(x, x), 0);
+}
+
+static int sum_squares_s16_neon(const int16_t *a, int num, float *sum)
+{
+    float32x4_t acc = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        int16x8_t x = vld1q_s16(a + i);
+        float32x4_t p0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+        float32x4_t p1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+        acc = vaddq_f32(acc, vaddq_f32(vmulq_f32(p0, p0), vmulq_f32(p1, p1)));
+    }
+    *sum = hsum_neon(acc);
+    return i;
+}
+
+static int sum_squares_float_neon(const float *a, int num, float *sum)
+{
+    float32x4_t acc = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 4 <= num; i += 4) {
+        float32x4_t x = vld1q_f32(a + i);
+        acc = vaddq_f32(acc, vmulq_f32(x, x));
+    }
+    *sum = hsum_neon(acc);
+    return i;
+}
+#endif
+
+// a[n] = clamp((a[n] * vol) >> 8), for vol in [0, INT16_MAX]. All variants
+// give the same result.
+void af_volume_s16(int16_t *a, int num, int vol)
+{
+    assert(vol >= 0 && vol <= INT16_MAX);
+    int i = 0;
+#if HAVE_SSE4_INTRINSICS
+    int flags = av_get_cpu_flags();
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2)
+        i = volume_s16_avx2(a, num, vol);
+#endif
+    if (!i && (flags & AV_CPU_FLAG_SSE2))
+        i = volume_s16_sse2(a, num, vol);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    i = volume_s16_neon(a, num, vol);
+#endif
+    for (; i < num; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
+    }
+}
+
+// a[n] = clamp(a[n] * vol, -1, 1)
+void af_volume_clip_float(float *a, int num, float vol)
+{
+    int i = 0;
+#if HAVE_SSE4_INTRINSICS
+    int flags = av_get_cpu_flags();
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2)
+        i = volume_float_avx2(a, num, vol);
+#endif
+    if (!i && (flags & AV_CPU_FLAG_SSE2))
+        i = volume_float_sse2(a, num, vol);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    i = volume_float_neon(a, num, vol);
+#endif
+    for (; i < num; i++) {
+        float x = a[i] * vol;
+        a[i] = MPCLAMP(x, -1.0f, 1.0f);
+    }
+}
+
+// Sum of a[n]^2. The SIMD variants add in a different order, so the result
+// can differ in the last bits.
+float af_sum_squares_s16(const int16_t *a, int num)
+{
+    float sum = 0;
+    int i = 0;
+#if HAVE_SSE4_INTRINSICS
+    int flags = av_get_cpu_flags();
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2)
+        i = sum_squares_s16_avx2(a, num, &sum);
+#endif
+    if (!i && (flags & AV_CPU_FLAG_SSE2))
+        i = sum_squares_s16_sse2(a, num, &sum);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    i = sum_squares_s16_neon(a, num, &sum);
+#endif
+    for (; i < num; i++)
+        sum += a[i] * a[i];
+    return sum;
+}
+
+float af_sum_squares_float(const float *a, int num)
+{
+    float sum = 0;
+    int i = 0;
+#if HAVE_SSE4_INTRINSICS
+    int flags = av_get_cpu_flags();
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2)
+        i = sum_squares_float_avx2(a, num, &sum);
+#endif
+    if (!i && (flags & AV_CPU_FLAG_SSE2))
+        i = sum_squares_float_sse2(a, num, &sum);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    i = sum_squares_float_neon(a, num, &sum);
+#endif
+    for (; i < num; i++)
+        sum += a[i] * a[i];
+    return sum;
+}
@@ -57,6 +57,7 @@ struct ao_alsa_opts {
     int resample;
     int ni;
     int ignore_chmap;
+    int mmap;
 };
 
 #define OPT_BASE_STRUCT struct ao_alsa_opts
@@ -69,6 +70,7 @@ static const struct m_sub_options ao_alsa_conf = {
         OPT_INTRANGE("alsa-mixer-index", mixer_index, 0, 0, 99),
         OPT_FLAG("alsa-non-interleaved", ni, 0),
         OPT_FLAG("alsa-ignore-chmap", ignore_chmap, 0),
+        OPT_FLAG("alsa-mmap", mmap, 0),
         {0}
     },
     .defaults = &(const struct ao_alsa_opts) {
@@ -90,6 +92,7 @@ struct priv {
     double delay_before_pause;
     snd_pcm_uframes_t buffersize;
     snd_pcm_uframes_t outburst;
+    bool mmap;              // using SND_PCM_ACCESS_MMAP_*
 
     snd_output_t *output;
 
@@ -688,14 +691,32 @@ static int init_device(struct ao *ao, int mode)
     }
     dump_hw_params(ao, MSGL_DEBUG, "HW params after rate:\n", alsa_hwparams);
 
-    snd_pcm_access_t access = af_fmt_is_planar(ao->format)
-                                    ? SND_PCM_ACCESS_RW_NONINTERLEAVED
-                                    : SND_PCM_ACCESS_RW_INTERLEAVED;
-    err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
-    if (err < 0 && af_fmt_is_planar(ao->format)) {
-        ao->format = af_fmt_from_planar(ao->format);
-        access = SND_PCM_ACCESS_RW_INTERLEAVED;
+    p->mmap = false;
+    err = -1;
+    if (p->opts->mmap) {
+        snd_pcm_access_t access = af_fmt_is_planar(ao->format)
+                                    ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED
+                                    : SND_PCM_ACCESS_MMAP_INTERLEAVED;
         err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        if (err < 0 && af_fmt_is_planar(ao->format)) {
+            access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+            err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+            if (err >= 0)
+                ao->format = af_fmt_from_planar(ao->format);
+        }
+        CHECK_ALSA_WARN("Unable to set mmap access type, using read/write");
+        p->mmap = err >= 0;
+    }
+    if (err < 0) {
+        snd_pcm_access_t access = af_fmt_is_planar(ao->format)
+                                        ? SND_PCM_ACCESS_RW_NONINTERLEAVED
+                                        : SND_PCM_ACCESS_RW_INTERLEAVED;
+        err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        if (err < 0 && af_fmt_is_planar(ao->format)) {
+            ao->format = af_fmt_from_planar(ao->format);
+            access = SND_PCM_ACCESS_RW_INTERLEAVED;
+            err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        }
     }
     CHECK_ALSA_ERROR("Unable to set access type");
     dump_hw_params(ao, MSGL_DEBUG, "HW params after access:\n", alsa_hwparams);
@@ -826,6 +847,10 @@ static int init_device(struct ao *ao, int mode)
             (p->alsa, alsa_swparams, p->outburst);
     CHECK_ALSA_ERROR("Unable to set start threshold");
 
+    /* wake up audio_wait() on period boundaries */
+    err = snd_pcm_sw_params_set_avail_min(p->alsa, alsa_swparams, p->outburst);
+    CHECK_ALSA_ERROR("Unable to set avail min");
+
     /* disable underrun reporting */
     err = snd_pcm_sw_params_set_stop_threshold
             (p->alsa, alsa_swparams, boundary);
@@ -840,6 +865,7 @@ static int init_device(struct ao *ao, int mode)
     CHECK_ALSA_ERROR("Unable to set sw-parameters");
 
     MP_VERBOSE(ao, "hw pausing supported: %s\n", p->can_pause ? "yes" : "no");
+    MP_VERBOSE(ao, "mmap access: %s\n", p->mmap ? "yes" : "no");
     MP_VERBOSE(ao, "buffersize: %d samples\n", (int)p->buffersize);
     MP_VERBOSE(ao, "period size: %d samples\n", (int)p->outburst);
 
@@ -1059,6 +1085,85 @@ static void reset(struct ao *ao)
 alsa_error: ;
 }
 
+// Copy frames samples, starting at sample pos in data, to the ring buffer
+// areas returned by snd_pcm_mmap_begin().
+static void copy_to_areas(struct ao *ao, const snd_pcm_channel_area_t *areas,
+                          snd_pcm_uframes_t offset, void **data, int pos,
+                          int frames)
+{
+    int nch = ao->channels.num;
+    int bps = af_fmt_to_bytes(ao->format);
+    bool planar = af_fmt_is_planar(ao->format);
+
+    // Usual case for interleaved access: a single block in our own layout.
+    bool contiguous = !planar;
+    for (int c = 0; c < nch && contiguous; c++) {
+        contiguous = areas[c].addr == areas[0].addr &&
+                     areas[c].first == areas[0].first + c * bps * 8 &&
+                     areas[c].step == ao->sstride * 8;
+    }
+    if (contiguous) {
+        char *dst = (char *)areas[0].addr + areas[0].first / 8 +
+                    offset * ao->sstride;
+        memcpy(dst, (char *)data[0] + pos * ao->sstride, frames * ao->sstride);
+        return;
+    }
+
+    for (int c = 0; c < nch; c++) {
+        char *src = planar ? (char *)data[c] + pos * bps
+                           : (char *)data[0] + pos * ao->sstride + c * bps;
+        int src_step = planar ? bps : ao->sstride;
+        int dst_step = areas[c].step / 8;
+        char *dst = (char *)areas[c].addr + areas[c].first / 8 +
+                    offset * dst_step;
+        if (src_step == bps && dst_step == bps) {
+            memcpy(dst, src, frames * bps);
+        } else {
+            for (int n = 0; n < frames; n++)
+                memcpy(dst + n * dst_step, src + n * src_step, bps);
+        }
+    }
+}
+
+// Like snd_pcm_writei()/snd_pcm_writen(), but write directly into the mmap'ed
+// ring buffer. Returns the number of samples written (0 if there is no space
+// right now), or a negative ALSA error code.
+static snd_pcm_sframes_t write_mmap(struct ao *ao, void **data, int samples)
+{
+    struct priv *p = ao->priv;
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(p->alsa);
+    if (avail < 0)
+        return avail;
+
+    int written = 0;
+    while (written < samples && avail > 0) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = MPMIN(samples - written, avail);
+        int err = snd_pcm_mmap_begin(p->alsa, &areas, &offset, &frames);
+        if (err < 0)
+            return err;
+        copy_to_areas(ao, areas, offset, data, written, frames);
+        snd_pcm_sframes_t res = snd_pcm_mmap_commit(p->alsa, offset, frames);
+        if (res < 0)
+            return res;
+        if (res != (snd_pcm_sframes_t)frames)
+            return -EPIPE;
+        written += frames;
+        avail -= frames;
+    }
+
+    // Unlike with the write functions, the start threshold isn't checked.
+    if (written && snd_pcm_state(p->alsa) == SND_PCM_STATE_PREPARED) {
+        int err = snd_pcm_start(p->alsa);
+        if (err < 0)
+            return err;
+    }
+
+    return written;
+}
+
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct priv *p = ao->priv;
@@ -1070,7 +1175,12 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         return 0;
 
     do {
-        if (af_fmt_is_planar(ao->format)) {
+        if (p->mmap) {
+            res = write_mmap(ao, data, samples);
+            // Block until there's space, like the write functions.
+            if (res == 0)
+                snd_pcm_wait(p->alsa, 1000);
+        } else if (af_fmt_is_planar(ao->format)) {
             res = snd_pcm_writen(p->alsa, data, samples);
         } else {
             res = snd_pcm_writei(p->alsa, data[0], samples);
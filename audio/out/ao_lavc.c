@@ -54,9 +54,13 @@ struct priv {
     AVRational worst_time_base;
     int worst_time_base_is_stream;
 
+    struct encode_worker *worker;
+
     bool shutdown;
 };
 
+static void on_packet(void *priv, AVPacket *packet, AVFrame *frame);
+
 static bool supports_format(AVCodec *codec, int format)
 {
     for (const enum AVSampleFormat *sampleformat = codec->sample_fmts;
@@ -162,6 +166,11 @@ static int init(struct ao *ao)
     if (ao->channels.num > AV_NUM_DATA_POINTERS)
         goto fail;
 
+    ac->worker = encode_worker_create(ao->encode_lavc_ctx, ao->log, ac->codec,
+                                      on_packet, ao);
+    if (!ac->worker)
+        goto fail;
+
     pthread_mutex_unlock(&ao->encode_lavc_ctx->lock);
     return 0;
 
@@ -185,20 +194,20 @@ static void uninit(struct ao *ao)
 
     if (!encode_lavc_start(ectx)) {
         MP_WARN(ao, "not even ready to encode audio at end -> dropped\n");
-        pthread_mutex_unlock(&ectx->lock);
-        return;
-    }
-
-    if (ac->stream) {
+    } else if (ac->stream) {
         double outpts = ac->expected_next_pts;
         if (!ectx->options->rawts && ectx->options->copyts)
             outpts += ectx->discontinuity_pts_offset;
         outpts += encode_lavc_getoffset(ectx, ac->codec);
         encode(ao, outpts, NULL);
+        encode_worker_drain(ac->worker);
     }
 
     pthread_mutex_unlock(&ectx->lock);
 
+    encode_worker_destroy(ac->worker);
+    ac->worker = NULL;
+
     ac->shutdown = true;
 }
 
@@ -252,50 +261,17 @@ static void write_packet(struct ao *ao, AVPacket *packet)
     }
 }
 
-static void encode_audio_and_write(struct ao *ao, AVFrame *frame)
+// Called on the encoder thread, with the encode_lavc_context lock held.
+static void on_packet(void *priv, AVPacket *packet, AVFrame *frame)
 {
-    // TODO: Can we unify this with the equivalent video code path?
+    struct ao *ao = priv;
     struct priv *ac = ao->priv;
-    AVPacket packet = {0};
-
-    int status = avcodec_send_frame(ac->codec, frame);
-    if (status < 0) {
-        MP_ERR(ao, "error encoding at %d %d/%d\n",
-               frame ? (int) frame->pts : -1,
-               ac->codec->time_base.num,
-               ac->codec->time_base.den);
-        return;
-    }
-    for (;;) {
-        av_init_packet(&packet);
-        status = avcodec_receive_packet(ac->codec, &packet);
-        if (status == AVERROR(EAGAIN)) { // No more packets for now.
-            if (frame == NULL) {
-                MP_ERR(ao, "sent flush frame, got EAGAIN");
-            }
-            break;
-        }
-        if (status == AVERROR_EOF) { // No more packets, ever.
-            if (frame != NULL) {
-                MP_ERR(ao, "sent audio frame, got EOF");
-            }
-            break;
-        }
-        if (status < 0) {
-            MP_ERR(ao, "error encoding at %d %d/%d\n",
-                   frame ? (int) frame->pts : -1,
-                   ac->codec->time_base.num,
-                   ac->codec->time_base.den);
-            break;
-        }
-        if (frame) {
-            if (ac->savepts == AV_NOPTS_VALUE)
-                ac->savepts = frame->pts;
-        }
-        encode_lavc_write_stats(ao->encode_lavc_ctx, ac->codec);
-        write_packet(ao, &packet);
-        av_packet_unref(&packet);
+
+    if (frame) {
+        if (ac->savepts == AV_NOPTS_VALUE)
+            ac->savepts = frame->pts;
     }
+    write_packet(ao, packet);
 }
 
 // must get exactly ac->aframesize amount of data
@@ -315,13 +291,15 @@ static void encode(struct ao *ao, double apts, void **data)
         AVFrame *frame = av_frame_alloc();
         frame->format = af_to_avformat(ao->format);
         frame->nb_samples = ac->aframesize;
+        frame->channel_layout = ac->codec->channel_layout;
+        av_frame_set_channels(frame, ao->channels.num);
 
-        size_t num_planes = af_fmt_is_planar(ao->format) ? ao->channels.num : 1;
-        assert(num_planes <= AV_NUM_DATA_POINTERS);
-        for (int n = 0; n < num_planes; n++)
-            frame->extended_data[n] = data[n];
-
-        frame->linesize[0] = frame->nb_samples * ao->sstride;
+        // The encoder thread accesses the samples after this returns, so
+        // they must be copied.
+        if (av_frame_get_buffer(frame, 0) < 0)
+            abort();
+        av_samples_copy(frame->extended_data, (uint8_t **)data, 0, 0,
+                        frame->nb_samples, ao->channels.num, frame->format);
 
         if (ectx->options->rawts || ectx->options->copyts) {
             // real audio pts
@@ -343,11 +321,10 @@ static void encode(struct ao *ao, double apts, void **data)
         ac->lastpts = frame_pts;
 
         frame->quality = ac->codec->global_quality;
-        encode_audio_and_write(ao, frame);
-        av_frame_free(&frame);
+        encode_worker_queue(ac->worker, frame);
     }
     else
-        encode_audio_and_write(ao, NULL);
+        encode_worker_queue(ac->worker, NULL);
 }
 
 // this should round samples down to frame sizes
@@ -32,11 +32,12 @@
 
 struct priv {
     SLObjectItf sl, output_mix, player;
-    SLBufferQueueItf buffer_queue;
+    SLAndroidSimpleBufferQueueItf buffer_queue;
     SLEngineItf engine;
     SLPlayItf play;
     char *curbuf, *buf1, *buf2;
     size_t buffer_size;
+    double audio_latency;       // latency after our buffer queue, in seconds
     pthread_mutex_t buffer_lock;
 
     int cfg_frames_per_buffer;
@@ -77,7 +78,8 @@ static void uninit(struct ao *ao)
 
 #undef DESTROY
 
-static void buffer_callback(SLBufferQueueItf buffer_queue, void *context)
+static void buffer_callback(SLAndroidSimpleBufferQueueItf buffer_queue,
+                            void *context)
 {
     struct ao *ao = context;
     struct priv *p = ao->priv;
@@ -87,8 +89,9 @@ static void buffer_callback(SLBufferQueueItf buffer_queue, void *context)
 
     pthread_mutex_lock(&p->buffer_lock);
 
+    // The other buffer is still queued, and the rest is the track's latency.
     data[0] = p->curbuf;
-    delay = 2 * p->buffer_size / (double)ao->bps;
+    delay = p->buffer_size / (double)ao->bps + p->audio_latency;
     ao_read_data(ao, data, p->buffer_size / ao->sstride,
         mp_time_us() + 1000000LL * delay);
 
@@ -103,6 +106,25 @@ static void buffer_callback(SLBufferQueueItf buffer_queue, void *context)
 
 #define DEFAULT_BUFFER_SIZE_MS 50
 
+// Latency of the AudioTrack behind the player, as reported by Android, or a
+// negative value if unknown.
+static double get_audio_latency(struct ao *ao)
+{
+    struct priv *p = ao->priv;
+    SLAndroidConfigurationItf config;
+    SLuint32 latency_ms = 0;
+    SLuint32 size = sizeof(latency_ms);
+
+    if ((*p->player)->GetInterface(p->player, SL_IID_ANDROIDCONFIGURATION,
+                                   (void*)&config) != SL_RESULT_SUCCESS)
+        return -1;
+    // Not part of the official API, but supported by all Android versions.
+    if ((*config)->GetConfiguration(config, (const SLchar *)"androidGetAudioLatency",
+                                    &size, &latency_ms) != SL_RESULT_SUCCESS)
+        return -1;
+    return latency_ms / 1000.0;
+}
+
 #define CHK(stmt) \
     { \
         SLresult res = stmt; \
@@ -115,7 +137,7 @@ static void buffer_callback(SLBufferQueueItf buffer_queue, void *context)
 static int init(struct ao *ao)
 {
     struct priv *p = ao->priv;
-    SLDataLocator_BufferQueue locator_buffer_queue;
+    SLDataLocator_AndroidSimpleBufferQueue locator_buffer_queue;
     SLDataLocator_OutputMix locator_output_mix;
     SLDataFormat_PCM pcm;
     SLDataSource audio_source;
@@ -130,7 +152,9 @@ static int init(struct ao *ao)
     CHK((*p->engine)->CreateOutputMix(p->engine, &p->output_mix, 0, NULL, NULL));
     CHK((*p->output_mix)->Realize(p->output_mix, SL_BOOLEAN_FALSE));
 
-    locator_buffer_queue.locatorType = SL_DATALOCATOR_BUFFERQUEUE;
+    // Android only uses the low latency ("fast") mixer path for the Android
+    // simple buffer queue, with the native sample rate and buffer size.
+    locator_buffer_queue.locatorType = SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE;
     locator_buffer_queue.numBuffers = 2;
 
     pcm.formatType = SL_DATAFORMAT_PCM;
@@ -188,17 +212,41 @@ static int init(struct ao *ao)
     audio_sink.pLocator = (void*)&locator_output_mix;
     audio_sink.pFormat = NULL;
 
-    SLboolean required[] = { SL_BOOLEAN_TRUE };
-    SLInterfaceID iid_array[] = { SL_IID_BUFFERQUEUE };
+    SLboolean required[] = { SL_BOOLEAN_TRUE, SL_BOOLEAN_FALSE };
+    SLInterfaceID iid_array[] = { SL_IID_ANDROIDSIMPLEBUFFERQUEUE,
+                                  SL_IID_ANDROIDCONFIGURATION };
     CHK((*p->engine)->CreateAudioPlayer(p->engine, &p->player, &audio_source,
-        &audio_sink, 1, iid_array, required));
+        &audio_sink, 2, iid_array, required));
+
+#ifdef SL_ANDROID_KEY_PERFORMANCE_MODE
+    // Android 7.1+: explicitly ask for the low latency path. The player still
+    // works if this fails.
+    SLAndroidConfigurationItf config;
+    if ((*p->player)->GetInterface(p->player, SL_IID_ANDROIDCONFIGURATION,
+                                   (void*)&config) == SL_RESULT_SUCCESS)
+    {
+        SLuint32 mode = SL_ANDROID_PERFORMANCE_LATENCY;
+        SLresult res = (*config)->SetConfiguration(config,
+            SL_ANDROID_KEY_PERFORMANCE_MODE, &mode, sizeof(mode));
+        if (res != SL_RESULT_SUCCESS)
+            MP_VERBOSE(ao, "Could not set performance mode: %d\n", res);
+    }
+#endif
+
     CHK((*p->player)->Realize(p->player, SL_BOOLEAN_FALSE));
     CHK((*p->player)->GetInterface(p->player, SL_IID_PLAY, (void*)&p->play));
-    CHK((*p->player)->GetInterface(p->player, SL_IID_BUFFERQUEUE,
+    CHK((*p->player)->GetInterface(p->player, SL_IID_ANDROIDSIMPLEBUFFERQUEUE,
         (void*)&p->buffer_queue));
     CHK((*p->buffer_queue)->RegisterCallback(p->buffer_queue,
         buffer_callback, ao));
 
+    p->audio_latency = get_audio_latency(ao);
+    if (p->audio_latency < 0) {
+        p->audio_latency = ao->device_buffer / (double)ao->samplerate;
+    } else {
+        MP_VERBOSE(ao, "Device latency: %.1f ms\n", p->audio_latency * 1000);
+    }
+
     return 1;
 error:
     uninit(ao);
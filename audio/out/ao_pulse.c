@@ -53,15 +53,11 @@ struct priv {
 
     int retval;
 
-    // for wakeup handling
-    pthread_mutex_t wakeup_lock;
-    pthread_cond_t wakeup;
-    int wakeup_status;
-
     char *cfg_host;
     char *cfg_sink;
     int cfg_buffer;
     int cfg_latency_hacks;
+    int cfg_low_latency;
 };
 
 #define GENERIC_ERR_MSG(str) \
@@ -119,38 +115,14 @@ static void stream_state_cb(pa_stream *s, void *userdata)
     }
 }
 
-static void wakeup(struct ao *ao)
-{
-    struct priv *priv = ao->priv;
-    pthread_mutex_lock(&priv->wakeup_lock);
-    priv->wakeup_status = 1;
-    pthread_cond_signal(&priv->wakeup);
-    pthread_mutex_unlock(&priv->wakeup_lock);
-}
-
 static void stream_request_cb(pa_stream *s, size_t length, void *userdata)
 {
     struct ao *ao = userdata;
     struct priv *priv = ao->priv;
-    wakeup(ao);
+    ao_wakeup_event(ao);
     pa_threaded_mainloop_signal(priv->mainloop, 0);
 }
 
-static int wait_audio(struct ao *ao, pthread_mutex_t *lock)
-{
-    struct priv *priv = ao->priv;
-    // We don't use this mutex, because pulse like to call stream_request_cb
-    // while we have the central mutex held.
-    pthread_mutex_unlock(lock);
-    pthread_mutex_lock(&priv->wakeup_lock);
-    while (!priv->wakeup_status)
-        pthread_cond_wait(&priv->wakeup, &priv->wakeup_lock);
-    priv->wakeup_status = 0;
-    pthread_mutex_unlock(&priv->wakeup_lock);
-    pthread_mutex_lock(lock);
-    return 0;
-}
-
 static void stream_latency_update_cb(pa_stream *s, void *userdata)
 {
     struct ao *ao = userdata;
@@ -305,9 +277,6 @@ static void uninit(struct ao *ao)
         pa_threaded_mainloop_free(priv->mainloop);
         priv->mainloop = NULL;
     }
-
-    pthread_cond_destroy(&priv->wakeup);
-    pthread_mutex_destroy(&priv->wakeup_lock);
 }
 
 static int pa_init_boilerplate(struct ao *ao)
@@ -316,9 +285,6 @@ static int pa_init_boilerplate(struct ao *ao)
     char *host = priv->cfg_host && priv->cfg_host[0] ? priv->cfg_host : NULL;
     bool locked = false;
 
-    pthread_mutex_init(&priv->wakeup_lock, NULL);
-    pthread_cond_init(&priv->wakeup, NULL);
-
     if (!(priv->mainloop = pa_threaded_mainloop_new())) {
         MP_ERR(ao, "Failed to allocate main loop\n");
         goto fail;
@@ -469,6 +435,16 @@ static int init(struct ao *ao)
     if (!priv->cfg_latency_hacks)
         flags |= PA_STREAM_INTERPOLATE_TIMING|PA_STREAM_AUTO_TIMING_UPDATE;
 
+    // Make --pulse-buffer the total latency including the sink, and request
+    // data in small chunks, so that the server doesn't raise the latency to
+    // fit large writes.
+    if (priv->cfg_low_latency && buf_size > 0) {
+        int frame = af_fmt_to_bytes(ao->format) * ao->channels.num;
+        bufattr.minreq = MPMAX(bufattr.tlength / 4 / frame, 1) * frame;
+        flags |= PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING |
+                 PA_STREAM_AUTO_TIMING_UPDATE;
+    }
+
     if (pa_stream_connect_playback(priv->stream, sink, &bufattr,
                                    flags, NULL, NULL) < 0)
         goto unlock_and_fail;
@@ -488,6 +464,14 @@ static int init(struct ao *ao)
         goto unlock_and_fail;
     }
 
+    const pa_buffer_attr *attr = pa_stream_get_buffer_attr(priv->stream);
+    const pa_sample_spec *ss = pa_stream_get_sample_spec(priv->stream);
+    if (attr && ss) {
+        MP_VERBOSE(ao, "Server buffer: tlength=%.1fms minreq=%.1fms\n",
+                   pa_bytes_to_usec(attr->tlength, ss) / 1000.0,
+                   pa_bytes_to_usec(attr->minreq, ss) / 1000.0);
+    }
+
     pa_threaded_mainloop_unlock(priv->mainloop);
     return 0;
 
@@ -825,8 +809,8 @@ const struct ao_driver audio_out_pulse = {
     .pause     = pause,
     .resume    = resume,
     .drain     = drain,
-    .wait      = wait_audio,
-    .wakeup    = wakeup,
+    .wait      = ao_wait_event,
+    .wakeup    = ao_wakeup_event,
     .hotplug_init = hotplug_init,
     .hotplug_uninit = hotplug_uninit,
     .list_devs = list_devs,
@@ -839,6 +823,7 @@ const struct ao_driver audio_out_pulse = {
         OPT_STRING("sink", cfg_sink, 0, DEVICE_OPT_DEPRECATION),
         OPT_CHOICE_OR_INT("buffer", cfg_buffer, 0, 1, 2000, ({"native", 0})),
         OPT_FLAG("latency-hacks", cfg_latency_hacks, 0),
+        OPT_FLAG("low-latency", cfg_low_latency, 0),
         {0}
     },
     .options_prefix = "pulse",
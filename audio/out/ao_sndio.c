@@ -263,6 +263,27 @@ static void update(struct ao *ao)
     sio_revents(p->hdl, p->pfd);
 }
 
+/*
+ * wait until sio_write() doesn't block, or ao_wakeup_poll() is called
+ */
+static int audio_wait(struct ao *ao, pthread_mutex_t *lock)
+{
+    struct priv *p = ao->priv;
+
+    while (1) {
+        int n = sio_pollfd(p->hdl, p->pfd, POLLOUT);
+        int r = ao_wait_poll(ao, p->pfd, n, lock);
+        if (r)
+            return r;
+
+        int revents = sio_revents(p->hdl, p->pfd);
+        if (revents & POLLHUP)
+            return -1;
+        if (revents & POLLOUT)
+            return 0;
+    }
+}
+
 /*
  * how many samples can be played without blocking
  */
@@ -318,6 +339,8 @@ const struct ao_driver audio_out_sndio = {
     .pause     = audio_pause,
     .resume    = audio_resume,
     .reset     = reset,
+    .wait      = audio_wait,
+    .wakeup    = ao_wakeup_poll,
     .priv_size = sizeof(struct priv),
     .options = (const struct m_option[]) {
         OPT_STRING("device", dev, 0, OPTDEF_STR(SIO_DEVANY),
@@ -496,4 +496,9 @@ const struct ao_driver audio_out_wasapi = {
     .hotplug_init   = hotplug_init,
     .hotplug_uninit = hotplug_uninit,
     .priv_size      = sizeof(wasapi_state),
+    .options        = (const struct m_option[]) {
+        OPT_FLAG("low-latency", opt_low_latency, 0),
+        {0}
+    },
+    .options_prefix = "wasapi",
 };
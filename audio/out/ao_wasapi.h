@@ -96,6 +96,7 @@ typedef struct wasapi_state {
 
     // ao options
     int opt_exclusive;
+    int opt_low_latency;
 
     // format info
     WAVEFORMATEXTENSIBLE format;
@@ -580,12 +580,12 @@ static HRESULT fix_format(struct ao *ao)
 {
     struct wasapi_state *state = ao->priv;
 
-    REFERENCE_TIME devicePeriod, bufferDuration, bufferPeriod;
+    REFERENCE_TIME devicePeriod, minPeriod, bufferDuration, bufferPeriod;
     MP_DBG(state, "IAudioClient::GetDevicePeriod\n");
     HRESULT hr = IAudioClient_GetDevicePeriod(state->pAudioClient,&devicePeriod,
-                                              NULL);
-    MP_VERBOSE(state, "Device period: %.2g ms\n",
-               (double) devicePeriod / 10000.0 );
+                                              &minPeriod);
+    MP_VERBOSE(state, "Device period: %.2g ms (minimum: %.2g ms)\n",
+               (double) devicePeriod / 10000.0, (double) minPeriod / 10000.0);
 
     if (state->share_mode == AUDCLNT_SHAREMODE_SHARED) {
         // for shared mode, use integer multiple of device period close to 50ms
@@ -594,6 +594,10 @@ static HRESULT fix_format(struct ao *ao)
     } else {
         // in exclusive mode, these should all be the same
         bufferPeriod = bufferDuration = devicePeriod;
+        // The device wakes us up every minPeriod, and we exchange buffers of
+        // that size. If the size isn't aligned, the retry below fixes it up.
+        if (state->opt_low_latency && minPeriod > 0)
+            bufferPeriod = bufferDuration = minPeriod;
     }
 
     // handle unsupported buffer size hopefully this shouldn't happen because of
@@ -660,6 +664,14 @@ reinit:
     MP_VERBOSE(state, "Buffer frame count: %"PRIu32" (%.2g ms)\n",
                state->bufferFrameCount, (double) bufferDuration / 10000.0 );
 
+    REFERENCE_TIME streamLatency;
+    if (SUCCEEDED(IAudioClient_GetStreamLatency(state->pAudioClient,
+                                                &streamLatency)))
+    {
+        MP_VERBOSE(state, "Stream latency: %.2g ms\n",
+                   (double) streamLatency / 10000.0);
+    }
+
     hr = init_clock(state);
     EXIT_ON_ERROR(hr);
 
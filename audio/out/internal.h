@@ -158,6 +158,9 @@ struct ao_driver {
     //          the audio thread takes data again. Often, it will just copy
     //          the complete soft-buffer to the AO, and then wait for the
     //          decoder instead. Don't do necessary work in this callback.
+    // AOs with pollable file descriptors can use ao_wait_poll() and
+    // ao_wakeup_poll(), AOs notified by callbacks ao_wait_event() and
+    // ao_wakeup_event().
     int (*wait)(struct ao *ao, pthread_mutex_t *lock);
     // In combination with wait(). Lock may or may not be held.
     void (*wakeup)(struct ao *ao);
@@ -190,6 +193,8 @@ struct ao_driver {
 
 int ao_play_silence(struct ao *ao, int samples);
 int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us);
+int ao_wait_event(struct ao *ao, pthread_mutex_t *lock);
+void ao_wakeup_event(struct ao *ao);
 struct pollfd;
 int ao_wait_poll(struct ao *ao, struct pollfd *fds, int num_fds,
                  pthread_mutex_t *lock);
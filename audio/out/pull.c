@@ -18,6 +18,9 @@
 #include <stddef.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "ao.h"
 #include "internal.h"
@@ -28,14 +31,27 @@
 
 #include "input/input.h"
 
+#include "osdep/io.h"
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 #include "osdep/atomic.h"
 #include "misc/ring.h"
 
+#ifndef __MINGW32__
+#include <poll.h>
+#define HAVE_WAKEUP_THREAD 1
+#else
+#define HAVE_WAKEUP_THREAD 0
+#endif
+
 /*
  * Note: there is some stupid stuff in this file in order to avoid mutexes.
  * This requirement is dictated by several audio APIs, at least jackaudio.
+ *
+ * ao_read_data() runs on the audio API's realtime thread. It must never block:
+ * it only uses the SPSC ringbuffers and atomics, and doesn't allocate. Waking
+ * up the player can take locks, so it's offloaded to a helper thread, which
+ * the callback signals with a non-blocking write to a pipe.
  */
 
 enum {
@@ -57,8 +73,86 @@ struct ao_pull_state {
 
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
+
+    // Set by the audio callback if the player should be woken up. Cleared by
+    // the wakeup thread.
+    atomic_bool wakeup_pending;
+    atomic_bool wakeup_exit;
+    bool wakeup_thread_valid;
+    pthread_t wakeup_thread;
+    int wakeup_pipe[2];
 };
 
+// Called from the audio callback.
+static void request_wakeup(struct ao *ao)
+{
+    struct ao_pull_state *p = ao->api_priv;
+#if HAVE_WAKEUP_THREAD
+    if (p->wakeup_thread_valid) {
+        // Only the first request since the last wakeup does a syscall.
+        if (!atomic_compare_exchange_strong(&p->wakeup_pending,
+                                            &(bool){false}, true))
+            return;
+        (void)write(p->wakeup_pipe[1], &(char){0}, 1);
+        return;
+    }
+#endif
+    ao->wakeup_cb(ao->wakeup_ctx);
+}
+
+#if HAVE_WAKEUP_THREAD
+static void *wakeup_thread(void *arg)
+{
+    struct ao *ao = arg;
+    struct ao_pull_state *p = ao->api_priv;
+
+    mpthread_set_name("ao-wakeup");
+
+    while (!atomic_load(&p->wakeup_exit)) {
+        struct pollfd fd = { .fd = p->wakeup_pipe[0], .events = POLLIN };
+        if (poll(&fd, 1, -1) < 0 && errno != EINTR)
+            break;
+        mp_flush_wakeup_pipe(p->wakeup_pipe[0]);
+        // Clear before waking up, so a new request can't get lost.
+        if (atomic_compare_exchange_strong(&p->wakeup_pending,
+                                           &(bool){true}, false))
+            ao->wakeup_cb(ao->wakeup_ctx);
+    }
+
+    return NULL;
+}
+#endif
+
+static void start_wakeup_thread(struct ao *ao)
+{
+#if HAVE_WAKEUP_THREAD
+    struct ao_pull_state *p = ao->api_priv;
+    if (mp_make_wakeup_pipe(p->wakeup_pipe) < 0)
+        return;
+    if (pthread_create(&p->wakeup_thread, NULL, wakeup_thread, ao)) {
+        close(p->wakeup_pipe[0]);
+        close(p->wakeup_pipe[1]);
+        return;
+    }
+    p->wakeup_thread_valid = true;
+#endif
+}
+
+static void stop_wakeup_thread(struct ao *ao)
+{
+#if HAVE_WAKEUP_THREAD
+    struct ao_pull_state *p = ao->api_priv;
+    if (!p->wakeup_thread_valid)
+        return;
+    atomic_store(&p->wakeup_exit, true);
+    (void)write(p->wakeup_pipe[1], &(char){0}, 1);
+    pthread_join(p->wakeup_thread, NULL);
+    close(p->wakeup_pipe[0]);
+    close(p->wakeup_pipe[1]);
+    p->wakeup_thread_valid = false;
+#endif
+}
+
 static void set_state(struct ao *ao, int new_state)
 {
     struct ao_pull_state *p = ao->api_priv;
@@ -152,7 +246,7 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
 end:
 
     if (need_wakeup)
-        ao->wakeup_cb(ao->wakeup_ctx);
+        request_wakeup(ao);
 
     // pad with silence (underflow/paused/eof)
     for (int n = 0; n < ao->num_planes; n++)
@@ -194,7 +288,7 @@ static void reset(struct ao *ao)
     atomic_store(&p->end_time_us, 0);
 }
 
-static void pause(struct ao *ao)
+static void audio_pause(struct ao *ao)
 {
     if (!ao->stream_silence && ao->driver->reset)
         ao->driver->reset(ao);
@@ -237,6 +331,8 @@ static void drain(struct ao *ao)
 static void uninit(struct ao *ao)
 {
     ao->driver->uninit(ao);
+    // The audio callback is stopped now.
+    stop_wakeup_thread(ao);
 }
 
 static int init(struct ao *ao)
@@ -247,6 +343,15 @@ static int init(struct ao *ao)
     atomic_store(&p->state, AO_STATE_NONE);
     assert(ao->driver->resume);
 
+#if HAVE_STDATOMIC
+    if (!atomic_is_lock_free(&p->state) || !atomic_is_lock_free(&p->end_time_us))
+        MP_WARN(ao, "Atomics are not lock-free; the audio callback may block.\n");
+#else
+    MP_WARN(ao, "No C11 atomics; the audio callback may block.\n");
+#endif
+
+    start_wakeup_thread(ao);
+
     if (ao->stream_silence)
         ao->driver->resume(ao);
 
@@ -263,7 +368,7 @@ const struct ao_driver ao_api_pull = {
     .play = play,
     .get_delay = get_delay,
     .get_eof = get_eof,
-    .pause = pause,
+    .pause = audio_pause,
     .resume = resume,
     .priv_size = sizeof(struct ao_pull_state),
 };
@@ -62,6 +62,11 @@ struct ao_push_state {
     double expected_end_time;
 
     int wakeup_pipe[2];
+
+    // --- for ao_wait_event()/ao_wakeup_event(), protected by event_lock
+    pthread_mutex_t event_lock;
+    pthread_cond_t event;
+    bool event_pending;
 };
 
 // lock must be held
@@ -169,8 +174,11 @@ static void drain(struct ao *ao)
     if (ao->driver->drain) {
         ao->driver->drain(ao);
     } else {
+        // Wait for the device buffer to play out. Don't hold the lock while
+        // doing this, and ignore spurious wakeups.
         double time = unlocked_get_delay(ao);
-        mp_sleep_us(MPMIN(time, maxbuffer) * 1e6);
+        until = mp_rel_time_to_timespec(MPMIN(time, maxbuffer));
+        while (pthread_cond_timedwait(&p->wakeup, &p->lock, &until) == 0) {}
     }
 
 done:
@@ -297,11 +305,11 @@ static void ao_play_data(struct ao *ao)
     int flags = 0;
     if (p->final_chunk && data.samples == max)
         flags |= AOPLAY_FINAL_CHUNK;
-    MP_STATS(ao, "start ao fill");
+    MP_STATS_START(ao, "ao fill");
     int r = 0;
     if (data.samples)
         r = ao->driver->play(ao, data.planes, data.samples, flags);
-    MP_STATS(ao, "end ao fill");
+    MP_STATS_END(ao, "ao fill");
     if (r > data.samples) {
         MP_WARN(ao, "Audio device returned non-sense value.\n");
         r = data.samples;
@@ -342,6 +350,7 @@ static void *playthread(void *arg)
     struct ao *ao = arg;
     struct ao_push_state *p = ao->api_priv;
     mpthread_set_name("ao");
+    mpthread_set_role(ao->global, "ao");
     pthread_mutex_lock(&p->lock);
     while (!p->terminate) {
         bool playing = !p->paused || ao->stream_silence;
@@ -349,7 +358,7 @@ static void *playthread(void *arg)
             ao_play_data(ao);
 
         if (!p->need_wakeup) {
-            MP_STATS(ao, "start audio wait");
+            MP_STATS_START(ao, "audio wait");
             if (!p->wait_on_ao || !playing) {
                 // Avoid busy waiting, because the audio API will still report
                 // that it needs new data, even if we're not ready yet, or if
@@ -398,7 +407,7 @@ static void *playthread(void *arg)
                     }
                 }
             }
-            MP_STATS(ao, "end audio wait");
+            MP_STATS_END(ao, "audio wait");
         }
         p->need_wakeup = false;
     }
@@ -417,6 +426,8 @@ static void destroy_no_thread(struct ao *ao)
 
     pthread_cond_destroy(&p->wakeup);
     pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->event);
+    pthread_mutex_destroy(&p->event_lock);
 }
 
 static void uninit(struct ao *ao)
@@ -439,6 +450,8 @@ static int init(struct ao *ao)
 
     pthread_mutex_init(&p->lock, NULL);
     pthread_cond_init(&p->wakeup, NULL);
+    pthread_mutex_init(&p->event_lock, NULL);
+    pthread_cond_init(&p->event, NULL);
     mp_make_wakeup_pipe(p->wakeup_pipe);
 
     if (ao->device_buffer <= 0) {
@@ -490,6 +503,42 @@ int ao_play_silence(struct ao *ao, int samples)
     return r;
 }
 
+// For AOs which are notified about free buffer space by a callback (usually
+// on a thread owned by the audio API). This can be used as ao_driver.wait, and
+// blocks until ao_wakeup_event() is called. Unlocks the lock temporarily.
+// Always returns 0.
+int ao_wait_event(struct ao *ao, pthread_mutex_t *lock)
+{
+    struct ao_push_state *p = ao->api_priv;
+    assert(ao->api == &ao_api_push);
+    assert(&p->lock == lock);
+
+    // Don't use the AO lock for signaling, because audio APIs like to invoke
+    // their callbacks while we're calling them with the lock held.
+    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_lock(&p->event_lock);
+    while (!p->event_pending)
+        pthread_cond_wait(&p->event, &p->event_lock);
+    p->event_pending = false;
+    pthread_mutex_unlock(&p->event_lock);
+    pthread_mutex_lock(&p->lock);
+    return 0;
+}
+
+// Signal that the device has buffer space available, or that ao_wait_event()
+// should return for other reasons. Can be called from any thread, with or
+// without the AO lock held. Can be used as ao_driver.wakeup.
+void ao_wakeup_event(struct ao *ao)
+{
+    assert(ao->api == &ao_api_push);
+    struct ao_push_state *p = ao->api_priv;
+
+    pthread_mutex_lock(&p->event_lock);
+    p->event_pending = true;
+    pthread_cond_signal(&p->event);
+    pthread_mutex_unlock(&p->event_lock);
+}
+
 #ifndef __MINGW32__
 
 #include <poll.h>
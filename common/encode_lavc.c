@@ -29,6 +29,7 @@
 #include "options/m_option.h"
 #include "options/options.h"
 #include "osdep/timer.h"
+#include "osdep/threads.h"
 #include "video/out/vo.h"
 #include "mpv_talloc.h"
 #include "stream/stream.h"
@@ -174,6 +175,7 @@ struct encode_lavc_context *encode_lavc_init(struct encode_opts *options,
 
     ctx = talloc_zero(NULL, struct encode_lavc_context);
     pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wakeup, NULL);
     ctx->log = mp_log_new(ctx, global->log, "encode-lavc");
     ctx->global = global;
     encode_lavc_discontinuity(ctx);
@@ -292,6 +294,11 @@ int encode_lavc_start(struct encode_lavc_context *ctx)
 
     CHECK_FAIL(ctx, 0);
 
+    // vo_lavc opens the encoder with the first frame for hardware input, and
+    // the header needs the codec parameters.
+    if (ctx->vcc && !avcodec_is_open(ctx->vcc))
+        return 0;
+
     if (ctx->expect_video && ctx->vcc == NULL) {
         if (ctx->avc->oformat->video_codec != AV_CODEC_ID_NONE ||
             ctx->options->vcodec) {
@@ -358,6 +365,7 @@ void encode_lavc_free(struct encode_lavc_context *ctx)
         encode_lavc_fail(ctx,
                          "called encode_lavc_free without encode_lavc_finish\n");
 
+    pthread_cond_destroy(&ctx->wakeup);
     pthread_mutex_destroy(&ctx->lock);
     talloc_free(ctx);
 }
@@ -372,6 +380,12 @@ void encode_lavc_finish(struct encode_lavc_context *ctx)
     if (ctx->finished)
         return;
 
+    // Encoder threads must not be using the codecs freed below. This only
+    // waits if called from encode_lavc_fail() (with the lock held); when
+    // called from the player at the end, all workers were destroyed already.
+    while (ctx->encoders_busy)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+
     if (ctx->avc) {
         if (ctx->header_written > 0)
             av_write_trailer(ctx->avc);  // this is allowed to fail
@@ -1207,3 +1221,170 @@ enum mp_csp_levels encode_lavc_get_csp_levels(struct encode_lavc_context *ctx,
 }
 
 // vim: ts=4 sw=4 et
+
+// Maximum number of frames queued per encoder thread. The VO/AO block when
+// queuing more.
+#define WORKER_MAX_FRAMES 4
+
+struct encode_worker {
+    struct encode_lavc_context *ctx;
+    struct mp_log *log;
+    AVCodecContext *codec;
+    encode_worker_packet_fn on_packet;
+    void *on_packet_priv;
+
+    pthread_t thread;
+
+    // All fields below are protected by ctx->lock.
+    AVFrame **frames;           // NULL entries mean flush
+    int num_frames;
+    bool busy;                  // a frame is being encoded
+    bool terminate;
+};
+
+// Called without lock. Encodes a frame, and passes the resulting packets to
+// the owner's callback with the lock held.
+static void worker_encode(struct encode_worker *w, AVFrame *frame)
+{
+    struct encode_lavc_context *ctx = w->ctx;
+    AVCodecContext *codec = w->codec;
+    AVPacket packet = {0};
+
+    int status = avcodec_send_frame(codec, frame);
+    if (status < 0) {
+        MP_ERR(w, "error encoding at %d %d/%d\n",
+               frame ? (int) frame->pts : -1,
+               codec->time_base.num, codec->time_base.den);
+        return;
+    }
+    for (;;) {
+        av_init_packet(&packet);
+        status = avcodec_receive_packet(codec, &packet);
+        if (status == AVERROR(EAGAIN)) { // No more packets for now.
+            if (frame == NULL)
+                MP_ERR(w, "sent flush frame, got EAGAIN\n");
+            break;
+        }
+        if (status == AVERROR_EOF) { // No more packets, ever.
+            if (frame != NULL)
+                MP_ERR(w, "sent frame, got EOF\n");
+            break;
+        }
+        if (status < 0) {
+            MP_ERR(w, "error encoding at %d %d/%d\n",
+                   frame ? (int) frame->pts : -1,
+                   codec->time_base.num, codec->time_base.den);
+            break;
+        }
+        pthread_mutex_lock(&ctx->lock);
+        encode_lavc_write_stats(ctx, codec);
+        w->on_packet(w->on_packet_priv, &packet, frame);
+        pthread_mutex_unlock(&ctx->lock);
+        av_packet_unref(&packet);
+    }
+}
+
+static void *worker_thread(void *p)
+{
+    struct encode_worker *w = p;
+    struct encode_lavc_context *ctx = w->ctx;
+
+    mpthread_set_name(w->codec->codec_type == AVMEDIA_TYPE_VIDEO
+                      ? "venc" : "aenc");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        if (!w->num_frames) {
+            if (w->terminate)
+                break;
+            pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+            continue;
+        }
+
+        AVFrame *frame = w->frames[0];
+        MP_TARRAY_REMOVE_AT(w->frames, w->num_frames, 0);
+        pthread_cond_broadcast(&ctx->wakeup);
+
+        // The codec is freed once encoding failed or finished.
+        if (ctx->failed || ctx->finished) {
+            av_frame_free(&frame);
+            continue;
+        }
+
+        w->busy = true;
+        ctx->encoders_busy++;
+        pthread_mutex_unlock(&ctx->lock);
+
+        worker_encode(w, frame);
+        av_frame_free(&frame);
+
+        pthread_mutex_lock(&ctx->lock);
+        w->busy = false;
+        ctx->encoders_busy--;
+        pthread_cond_broadcast(&ctx->wakeup);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+// Start a thread that encodes frames for the given (opened) codec. Packets are
+// passed to on_packet(priv, packet, frame) with ctx->lock held, in encoding
+// order; frame is the input frame that was last sent to the encoder (NULL
+// when flushing). Returns NULL on failure.
+struct encode_worker *encode_worker_create(struct encode_lavc_context *ctx,
+                                           struct mp_log *log,
+                                           AVCodecContext *codec,
+                                           encode_worker_packet_fn on_packet,
+                                           void *priv)
+{
+    struct encode_worker *w = talloc_ptrtype(NULL, w);
+    *w = (struct encode_worker){
+        .ctx = ctx,
+        .log = log,
+        .codec = codec,
+        .on_packet = on_packet,
+        .on_packet_priv = priv,
+    };
+    if (pthread_create(&w->thread, NULL, worker_thread, w)) {
+        talloc_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+// Queue a frame for encoding (takes ownership), or flush the encoder if frame
+// is NULL. Must be called with ctx->lock held; blocks (releasing the lock
+// meanwhile) if the queue is full.
+void encode_worker_queue(struct encode_worker *w, AVFrame *frame)
+{
+    struct encode_lavc_context *ctx = w->ctx;
+
+    while (w->num_frames >= WORKER_MAX_FRAMES)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    MP_TARRAY_APPEND(w, w->frames, w->num_frames, frame);
+    pthread_cond_broadcast(&ctx->wakeup);
+}
+
+// Wait until all queued frames have been encoded and written. Must be called
+// with ctx->lock held.
+void encode_worker_drain(struct encode_worker *w)
+{
+    while (w->num_frames || w->busy)
+        pthread_cond_wait(&w->ctx->wakeup, &w->ctx->lock);
+}
+
+// Stop the thread after encoding all queued frames. Must be called without
+// ctx->lock held.
+void encode_worker_destroy(struct encode_worker *w)
+{
+    if (!w)
+        return;
+
+    pthread_mutex_lock(&w->ctx->lock);
+    w->terminate = true;
+    pthread_cond_broadcast(&w->ctx->wakeup);
+    pthread_mutex_unlock(&w->ctx->lock);
+
+    pthread_join(w->thread, NULL);
+    talloc_free(w);
+}
@@ -44,6 +44,11 @@ struct encode_lavc_context {
     // must lock manually before accessing state.
     pthread_mutex_t lock;
 
+    // Signaled on changes of encode_worker state. Uses the lock above.
+    pthread_cond_t wakeup;
+    // Number of encode_workers currently using their codec.
+    int encoders_busy;
+
     float vo_fps;
 
     // FFmpeg contexts.
@@ -121,4 +126,17 @@ enum mp_csp encode_lavc_get_csp(struct encode_lavc_context *ctx,
 enum mp_csp_levels encode_lavc_get_csp_levels(struct encode_lavc_context *ctx,
                                               AVCodecContext *codec);
 
+// per-stream encoder threads, used by ao_lavc.c and vo_lavc.c
+struct encode_worker;
+typedef void (*encode_worker_packet_fn)(void *priv, AVPacket *packet,
+                                        AVFrame *frame);
+struct encode_worker *encode_worker_create(struct encode_lavc_context *ctx,
+                                           struct mp_log *log,
+                                           AVCodecContext *codec,
+                                           encode_worker_packet_fn on_packet,
+                                           void *priv);
+void encode_worker_queue(struct encode_worker *w, AVFrame *frame);
+void encode_worker_drain(struct encode_worker *w);
+void encode_worker_destroy(struct encode_worker *w);
+
 #endif
@@ -0,0 +1,103 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "common/common.h"
+#include "osdep/atomic.h"
+
+#include "mem_usage.h"
+
+static const char *const category_names[MP_MEM_CATEGORY_COUNT] = {
+    [MP_MEM_DEMUX_PACKETS]  = "demuxer-packets",
+    [MP_MEM_STREAM_CACHE]   = "stream-cache",
+    [MP_MEM_IMAGE_POOLS]    = "image-pools",
+    [MP_MEM_AUDIO_BUFFERS]  = "audio-buffers",
+    [MP_MEM_GPU_TEXTURES]   = "gpu-textures",
+};
+
+// Highest priority first (see mp_mem_usage_set_budget()).
+static const enum mp_mem_category priority_order[MP_MEM_CATEGORY_COUNT] = {
+    MP_MEM_GPU_TEXTURES,
+    MP_MEM_IMAGE_POOLS,
+    MP_MEM_AUDIO_BUFFERS,
+    MP_MEM_DEMUX_PACKETS,
+    MP_MEM_STREAM_CACHE,
+};
+
+// Updated on every packet allocation, so use atomics instead of a lock.
+static atomic_llong usage[MP_MEM_CATEGORY_COUNT];
+static atomic_llong peak[MP_MEM_CATEGORY_COUNT];
+static atomic_llong budget;
+
+void mp_mem_usage_add(enum mp_mem_category cat, int64_t bytes)
+{
+    assert(cat >= 0 && cat < MP_MEM_CATEGORY_COUNT);
+    long long new = atomic_fetch_add(&usage[cat], bytes) + bytes;
+    long long old = atomic_load(&peak[cat]);
+    while (new > old && !atomic_compare_exchange_strong(&peak[cat], &old, new))
+        ;
+}
+
+const char *mp_mem_category_name(enum mp_mem_category cat)
+{
+    return cat >= 0 && cat < MP_MEM_CATEGORY_COUNT ? category_names[cat] : NULL;
+}
+
+struct mp_mem_usage mp_mem_usage_get(enum mp_mem_category cat)
+{
+    assert(cat >= 0 && cat < MP_MEM_CATEGORY_COUNT);
+    return (struct mp_mem_usage){
+        .bytes = atomic_load(&usage[cat]),
+        .peak_bytes = atomic_load(&peak[cat]),
+    };
+}
+
+int64_t mp_mem_usage_total(void)
+{
+    int64_t total = 0;
+    for (int n = 0; n < MP_MEM_CATEGORY_COUNT; n++)
+        total += atomic_load(&usage[n]);
+    return total;
+}
+
+void mp_mem_usage_set_budget(int64_t bytes)
+{
+    atomic_store(&budget, bytes);
+}
+
+int64_t mp_mem_usage_get_limit(enum mp_mem_category cat)
+{
+    assert(cat >= 0 && cat < MP_MEM_CATEGORY_COUNT);
+    int64_t limit = atomic_load(&budget);
+    if (limit <= 0)
+        return INT64_MAX;
+    for (int n = 0; n < MP_MEM_CATEGORY_COUNT; n++) {
+        if (priority_order[n] == cat)
+            break;
+        limit -= atomic_load(&usage[priority_order[n]]);
+    }
+    return MPMAX(limit, 0);
+}
+
+bool mp_mem_usage_over_limit(enum mp_mem_category cat, int64_t new_bytes)
+{
+    int64_t limit = mp_mem_usage_get_limit(cat);
+    return limit != INT64_MAX &&
+           atomic_load(&usage[cat]) + new_bytes > limit;
+}
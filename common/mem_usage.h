@@ -0,0 +1,67 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_MEM_USAGE_H
+#define MP_MEM_USAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Process-wide accounting of the large allocations of each subsystem. The
+// counters are updated at the allocation sites, and are only estimates (for
+// example, GPU memory is computed from texture sizes and formats).
+enum mp_mem_category {
+    MP_MEM_DEMUX_PACKETS,   // demux_packet payloads
+    MP_MEM_STREAM_CACHE,    // stream cache buffer
+    MP_MEM_IMAGE_POOLS,     // images owned by mp_image_pools
+    MP_MEM_AUDIO_BUFFERS,   // audio frame buffers, including free ones
+    MP_MEM_GPU_TEXTURES,    // vo_opengl textures and FBOs
+    MP_MEM_CATEGORY_COUNT
+};
+
+struct mp_mem_usage {
+    int64_t bytes;
+    int64_t peak_bytes;
+};
+
+// Account bytes (negative to release) to the category. Thread-safe.
+void mp_mem_usage_add(enum mp_mem_category cat, int64_t bytes);
+
+// Name as used for the memory-usage property.
+const char *mp_mem_category_name(enum mp_mem_category cat);
+
+// Return the current usage of the category.
+struct mp_mem_usage mp_mem_usage_get(enum mp_mem_category cat);
+
+// Sum of the current usage of all categories.
+int64_t mp_mem_usage_total(void);
+
+// Set the process-wide memory budget in bytes (0 for no limit). Categories
+// have a fixed priority: GPU textures, image pools, audio buffers, demux
+// packets, stream cache. When the budget is reached, the lower priority
+// categories are supposed to shrink their caches first.
+void mp_mem_usage_set_budget(int64_t bytes);
+
+// Return the number of bytes the category may use: the budget minus the
+// current usage of all categories with higher priority, or INT64_MAX if there
+// is no budget.
+int64_t mp_mem_usage_get_limit(enum mp_mem_category cat);
+
+// Whether allocating new_bytes in the category would exceed its limit.
+bool mp_mem_usage_over_limit(enum mp_mem_category cat, int64_t new_bytes);
+
+#endif
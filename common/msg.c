@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 
 #include "mpv_talloc.h"
@@ -30,18 +31,21 @@
 #include "osdep/atomic.h"
 #include "common/common.h"
 #include "common/global.h"
+#include "misc/mpsc_queue.h"
 #include "misc/ring.h"
 #include "misc/bstr.h"
 #include "options/options.h"
 #include "options/path.h"
 #include "osdep/terminal.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "libmpv/client.h"
 
 #include "msg.h"
 #include "msg_control.h"
+#include "stats.h"
 
 struct mp_log_root {
     struct mpv_global *global;
@@ -53,34 +57,71 @@ struct mp_log_root {
     bool termosd;       // use terminal control codes for status line
     int blank_lines;    // number of lines usable by status
     int status_lines;   // number of current status lines
+    char *status_text;  // current status line if it's a single line, or NULL
+    bool status_notty;  // print status lines even if !termosd
     bool color;
     int verbose;
     bool force_stderr;
     struct mp_log_buffer **buffers;
     int num_buffers;
     FILE *log_file;
-    FILE *stats_file;
     char *log_path;
     char *stats_path;
+    bool stats_enabled;
+    struct mp_stats *stats;     // set on init, never changes
+    bstr buffer;                // for merging partial lines
     // --- must be accessed atomically
     /* This is incremented every time the msglevels must be reloaded.
      * (This is perhaps better than maintaining a globally accessible and
      * synchronized mp_log tree.) */
     atomic_ulong reload_counter;
-    // --- protected by mp_msg_lock
-    bstr buffer;
+    // --- writer thread
+    // Formatted messages (struct msg_entry*) are queued by the logging
+    // threads, and output by the writer thread. Output and delivery to log
+    // buffers is done under mp_msg_lock, either by the writer thread, or if it
+    // is not running, by the logging thread itself.
+    struct mp_mpsc_queue *queue;
+    atomic_bool writer_running;
+    atomic_bool writer_waiting; // writer is (about to be) blocked on wakeup
+    atomic_ullong queued;       // number of entries added to queue
+    atomic_ullong dropped;      // number of entries dropped (queue full)
+    pthread_t writer;
+    pthread_mutex_t writer_lock;
+    pthread_cond_t wakeup;      // signals writer (new entries or exit)
+    pthread_cond_t done;        // signals drain_queue()
+    // --- protected by writer_lock
+    unsigned long long processed; // number of entries output by the writer
+    unsigned long long reported_drops;
+    bool writer_exit;
 };
 
 struct mp_log {
     struct mp_log_root *root;
     const char *prefix;
     const char *verbose_prefix;
-    int level;                  // minimum log level for any outputs
-    int terminal_level;         // minimum log level for terminal output
+    atomic_int level;           // minimum log level for any outputs
+    atomic_int terminal_level;  // minimum log level for terminal output
     atomic_ulong reload_counter;
+    // --- protected by mp_msg_lock
     char *partial;
+    atomic_bool has_partial;    // partial[0] != 0 (readable without lock)
+};
+
+// A formatted log message, plus the state of its mp_log at the time it was
+// logged (the mp_log can be destroyed before the message is output).
+struct msg_entry {
+    int lev;
+    int terminal_level;
+    int64_t time;
+    const char *prefix;
+    const char *verbose_prefix;
+    char text[]; // followed by the prefix strings
 };
 
+// Queued log messages; if the writer thread doesn't keep up, messages above
+// MSGL_INFO are dropped, while more important ones wait for free space.
+#define QUEUE_SIZE 4096
+
 struct mp_log_buffer {
     struct mp_log_root *root;
     struct mp_ring *ring;
@@ -92,6 +133,8 @@ struct mp_log_buffer {
 // Protects some (not all) state in mp_log_root
 static pthread_mutex_t mp_msg_lock = PTHREAD_MUTEX_INITIALIZER;
 
+static void drain_queue(struct mp_log_root *root);
+
 static const struct mp_log null_log = {0};
 struct mp_log *const mp_null_log = (struct mp_log *)&null_log;
 
@@ -108,18 +151,19 @@ static void update_loglevel(struct mp_log *log)
 {
     struct mp_log_root *root = log->root;
     pthread_mutex_lock(&mp_msg_lock);
-    log->level = MSGL_STATUS + log->root->verbose; // default log level
+    int level = MSGL_STATUS + log->root->verbose; // default log level
     for (int n = 0; root->msg_levels && root->msg_levels[n * 2 + 0]; n++) {
         if (match_mod(log->verbose_prefix, root->msg_levels[n * 2 + 0]))
-            log->level = mp_msg_find_level(root->msg_levels[n * 2 + 1]);
+            level = mp_msg_find_level(root->msg_levels[n * 2 + 1]);
     }
-    log->terminal_level = log->level;
+    atomic_store(&log->terminal_level, level);
     for (int n = 0; n < log->root->num_buffers; n++)
-        log->level = MPMAX(log->level, log->root->buffers[n]->level);
+        level = MPMAX(level, log->root->buffers[n]->level);
     if (log->root->log_file)
-        log->level = MPMAX(log->level, MSGL_V);
-    if (log->root->stats_file)
-        log->level = MPMAX(log->level, MSGL_STATS);
+        level = MPMAX(level, MSGL_V);
+    if (log->root->stats_enabled)
+        level = MPMAX(level, MSGL_STATS);
+    atomic_store(&log->level, level);
     atomic_store(&log->reload_counter, atomic_load(&log->root->reload_counter));
     pthread_mutex_unlock(&mp_msg_lock);
 }
@@ -136,7 +180,7 @@ bool mp_msg_test(struct mp_log *log, int lev)
     {
         update_loglevel(log);
     }
-    return lev <= log->level;
+    return lev <= atomic_load_explicit(&log->level, memory_order_relaxed);
 }
 
 // Reposition cursor and clear lines for outputting the status line. In certain
@@ -175,6 +219,64 @@ static void prepare_status_line(struct mp_log_root *root, char *new_status)
     root->blank_lines = MPMAX(root->blank_lines, new_lines);
 }
 
+// Whether s consists of printable ASCII only, so byte offsets are columns.
+static bool is_plain_line(const char *s)
+{
+    for (; *s; s++) {
+        if ((unsigned char)*s < 32 || (unsigned char)*s > 126)
+            return false;
+    }
+    return true;
+}
+
+// Single line status updates usually change only a few characters (the
+// playback time), so move the cursor there and write only the changed span.
+// Returns false if the full line has to be printed instead.
+static bool update_status_line(struct mp_log_root *root, struct msg_entry *e,
+                               const char *text)
+{
+    const char *old = root->status_text;
+    // Prefixes and timestamps are not part of status_text.
+    if (!old || root->status_lines != 1 || root->show_time ||
+        e->prefix || root->verbose || root->module || !is_plain_line(text))
+        return false;
+
+    // A line wrapped by the terminal can't be updated this way.
+    int w = 80, h = 24;
+    terminal_get_size(&w, &h);
+    size_t new_len = strlen(text), old_len = strlen(old);
+    if (new_len >= w || old_len >= w)
+        return false;
+
+    size_t start = 0;
+    while (start < new_len && start < old_len && text[start] == old[start])
+        start++;
+    size_t end = new_len;
+    if (new_len == old_len) {
+        while (end > start && text[end - 1] == old[end - 1])
+            end--;
+    }
+
+    // The cursor is at the start of the status line (see output_entry()).
+    FILE *f = stderr;
+    if (start)
+        fprintf(f, "\033[%dC", (int)start);
+    fprintf(f, "%.*s", (int)(end - start), text + start);
+    if (new_len < old_len)
+        fprintf(f, "\033[K");
+    fprintf(f, "\r");
+    fflush(f);
+    return true;
+}
+
+static void set_status_text(struct mp_log_root *root, const char *text)
+{
+    talloc_free(root->status_text);
+    root->status_text = NULL;
+    if (root->status_lines == 1 && is_plain_line(text))
+        root->status_text = talloc_strdup(root, text);
+}
+
 static void flush_status_line(struct mp_log_root *root)
 {
     // If there was a status line, don't overwrite it, but skip it.
@@ -182,18 +284,33 @@ static void flush_status_line(struct mp_log_root *root)
         fprintf(stderr, "\n");
     root->status_lines = 0;
     root->blank_lines = 0;
+    set_status_text(root, "");
 }
 
 void mp_msg_flush_status_line(struct mp_log *log)
 {
+    if (log->root)
+        drain_queue(log->root);
     pthread_mutex_lock(&mp_msg_lock);
     if (log->root)
         flush_status_line(log->root);
     pthread_mutex_unlock(&mp_msg_lock);
 }
 
+// Whether status lines are output at all. They are not printed if stderr is
+// not a terminal (unless --term-status-notty is set).
+bool mp_msg_has_terminal_status(struct mpv_global *global)
+{
+    struct mp_log_root *root = global->log->root;
+    pthread_mutex_lock(&mp_msg_lock);
+    bool r = root->use_terminal && (root->termosd || root->status_notty);
+    pthread_mutex_unlock(&mp_msg_lock);
+    return r;
+}
+
 bool mp_msg_has_status_line(struct mpv_global *global)
 {
+    drain_queue(global->log->root);
     pthread_mutex_lock(&mp_msg_lock);
     bool r = global->log->root->status_lines > 0;
     pthread_mutex_unlock(&mp_msg_lock);
@@ -235,19 +352,20 @@ static void pretty_print_module(FILE* stream, const char *prefix, bool use_color
         set_msg_color(stream, lev);
 }
 
-static bool test_terminal_level(struct mp_log *log, int lev)
+static bool test_terminal_level(struct mp_log_root *root,
+                                struct msg_entry *e, int lev)
 {
-    return lev <= log->terminal_level && log->root->use_terminal &&
+    return lev <= e->terminal_level && root->use_terminal &&
            !(lev == MSGL_STATUS && terminal_in_background());
 }
 
-static void print_terminal_line(struct mp_log *log, int lev,
+static void print_terminal_line(struct mp_log_root *root, struct msg_entry *e,
                                 char *text,  char *trail)
 {
-    if (!test_terminal_level(log, lev))
+    int lev = e->lev;
+    if (!test_terminal_level(root, e, lev))
         return;
 
-    struct mp_log_root *root = log->root;
     FILE *stream = (root->force_stderr || lev == MSGL_STATUS) ? stderr : stdout;
 
     if (lev != MSGL_STATUS)
@@ -257,11 +375,11 @@ static void print_terminal_line(struct mp_log *log, int lev,
         set_msg_color(stream, lev);
 
     if (root->show_time)
-        fprintf(stream, "[%" PRId64 "] ", mp_time_us());
+        fprintf(stream, "[%" PRId64 "] ", e->time);
 
-    const char *prefix = log->prefix;
+    const char *prefix = e->prefix;
     if ((lev >= MSGL_V) || root->verbose || root->module)
-        prefix = log->verbose_prefix;
+        prefix = e->verbose_prefix;
 
     if (prefix) {
         if (root->module) {
@@ -278,28 +396,28 @@ static void print_terminal_line(struct mp_log *log, int lev,
     fflush(stream);
 }
 
-static void write_log_file(struct mp_log *log, int lev, char *text)
+static void write_log_file(struct mp_log_root *root, struct msg_entry *e,
+                           char *text)
 {
-    struct mp_log_root *root = log->root;
-
-    if (lev > MSGL_V || !root->log_file)
+    if (e->lev > MSGL_V || !root->log_file)
         return;
 
     fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-            (mp_time_us() - MP_START_TIME) / 1e6,
-            mp_log_levels[lev][0],
-            log->verbose_prefix, text);
+            (e->time - MP_START_TIME) / 1e6,
+            mp_log_levels[e->lev][0],
+            e->verbose_prefix, text);
     fflush(root->log_file);
 }
 
-static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
+static void write_msg_to_buffers(struct mp_log_root *root, struct msg_entry *e,
+                                 char *text)
 {
-    struct mp_log_root *root = log->root;
+    int lev = e->lev;
     for (int n = 0; n < root->num_buffers; n++) {
         struct mp_log_buffer *buffer = root->buffers[n];
         int buffer_level = buffer->level;
         if (buffer_level == MP_LOG_BUFFER_MSGL_TERM)
-            buffer_level = log->terminal_level;
+            buffer_level = e->terminal_level;
         if (lev <= buffer_level && lev != MSGL_STATUS) {
             // Assuming a single writer (serialized by msg lock)
             int avail = mp_ring_available(buffer->ring) / sizeof(void *);
@@ -308,7 +426,7 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
             struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
             if (avail > 1) {
                 *entry = (struct mp_log_buffer_entry) {
-                    .prefix = talloc_strdup(entry, log->verbose_prefix),
+                    .prefix = talloc_strdup(entry, e->verbose_prefix),
                     .level = lev,
                     .text = talloc_strdup(entry, text),
                 };
@@ -327,68 +445,253 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
     }
 }
 
-static void dump_stats(struct mp_log *log, int lev, char *text)
+// Output a queued message to all destinations. Must be called with
+// mp_msg_lock held. Apart from status messages, e->text consists of full lines.
+static void output_entry(struct mp_log_root *root, struct msg_entry *e)
 {
-    struct mp_log_root *root = log->root;
-    if (lev == MSGL_STATS && root->stats_file)
-        fprintf(root->stats_file, "%"PRId64" %s\n", mp_time_us(), text);
+    int lev = e->lev;
+    char *text = e->text;
+
+    if (lev == MSGL_STATUS && (!test_terminal_level(root, e, lev) ||
+                               !(root->termosd || root->status_notty)))
+        return; // discard
+
+    if (lev == MSGL_STATUS && root->termosd) {
+        if (!strchr(text, '\n') && update_status_line(root, e, text)) {
+            set_status_text(root, text);
+            return;
+        }
+        prepare_status_line(root, text);
+    }
+
+    // Split away each line.
+    while (1) {
+        char *end = strchr(text, '\n');
+        if (!end)
+            break;
+        char *next = &end[1];
+        char saved = next[0];
+        next[0] = '\0';
+        print_terminal_line(root, e, text, "");
+        write_log_file(root, e, text);
+        write_msg_to_buffers(root, e, text);
+        next[0] = saved;
+        text = next;
+    }
+
+    if (lev == MSGL_STATUS && text[0])
+        print_terminal_line(root, e, text, root->termosd ? "\r" : "\n");
+
+    if (lev == MSGL_STATUS && root->termosd)
+        set_status_text(root, text);
 }
 
-void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
+static void *msg_writer_thread(void *p)
 {
-    if (!mp_msg_test(log, lev))
-        return; // do not display
+    struct mp_log_root *root = p;
+    mpthread_set_name("msg");
 
-    pthread_mutex_lock(&mp_msg_lock);
+    pthread_mutex_lock(&root->writer_lock);
+    while (1) {
+        // Producers increment queued before checking writer_waiting, so
+        // either we see the new entry here, or they see the flag and wake us.
+        atomic_store(&root->writer_waiting, true);
+        if (atomic_load(&root->queued) <= root->processed) {
+            if (root->writer_exit)
+                break;
+            pthread_cond_wait(&root->wakeup, &root->writer_lock);
+            continue;
+        }
+        atomic_store(&root->writer_waiting, false);
+        pthread_mutex_unlock(&root->writer_lock);
+
+        int num = 0;
+        struct msg_entry *e;
+        pthread_mutex_lock(&mp_msg_lock);
+        while (mp_mpsc_queue_pop(root->queue, &e)) {
+            output_entry(root, e);
+            talloc_free(e);
+            num++;
+        }
+        unsigned long long dropped = atomic_load(&root->dropped);
+        if (dropped != root->reported_drops) {
+            struct msg_entry warn = {
+                .lev = MSGL_WARN,
+                .terminal_level = MSGL_WARN,
+                .time = mp_time_us(),
+                .verbose_prefix = "global",
+            };
+            char *text = talloc_asprintf(NULL, "%llu log messages dropped.\n",
+                                         dropped - root->reported_drops);
+            e = talloc_size(NULL, sizeof(warn) + strlen(text) + 1);
+            *e = warn;
+            strcpy(e->text, text);
+            output_entry(root, e);
+            talloc_free(e);
+            talloc_free(text);
+            root->reported_drops = dropped;
+        }
+        pthread_mutex_unlock(&mp_msg_lock);
+
+        pthread_mutex_lock(&root->writer_lock);
+        root->processed += num;
+        pthread_cond_broadcast(&root->done);
+        if (!num) {
+            // An entry was counted, but an earlier producer has not finished
+            // pushing its own entry yet.
+            pthread_mutex_unlock(&root->writer_lock);
+            sched_yield();
+            pthread_mutex_lock(&root->writer_lock);
+        }
+    }
+    pthread_mutex_unlock(&root->writer_lock);
+    return NULL;
+}
 
-    struct mp_log_root *root = log->root;
+// Wait until the writer thread has output all messages queued so far.
+static void drain_queue(struct mp_log_root *root)
+{
+    if (!atomic_load(&root->writer_running) ||
+        pthread_equal(pthread_self(), root->writer))
+        return;
+    unsigned long long queued = atomic_load(&root->queued);
+    pthread_mutex_lock(&root->writer_lock);
+    while (root->processed < queued)
+        pthread_cond_wait(&root->done, &root->writer_lock);
+    pthread_mutex_unlock(&root->writer_lock);
+}
 
-    root->buffer.len = 0;
+static void queue_entry(struct mp_log_root *root, struct msg_entry *e)
+{
+    if (!atomic_load(&root->writer_running)) {
+        pthread_mutex_lock(&mp_msg_lock);
+        output_entry(root, e);
+        pthread_mutex_unlock(&mp_msg_lock);
+        talloc_free(e);
+        return;
+    }
 
-    if (log->partial[0])
-        bstr_xappend_asprintf(root, &root->buffer, "%s", log->partial);
-    log->partial[0] = '\0';
+    int lev = e->lev;
+    while (!mp_mpsc_queue_push(root->queue, &e)) {
+        if (lev > MSGL_INFO) {
+            atomic_fetch_add(&root->dropped, 1);
+            talloc_free(e);
+            return;
+        }
+        sched_yield();
+    }
 
-    bstr_xappend_vasprintf(root, &root->buffer, format, va);
+    atomic_fetch_add(&root->queued, 1);
+    if (atomic_load(&root->writer_waiting)) {
+        pthread_mutex_lock(&root->writer_lock);
+        pthread_cond_signal(&root->wakeup);
+        pthread_mutex_unlock(&root->writer_lock);
+    }
 
-    char *text = root->buffer.start;
+    // Make sure it's visible before the caller possibly aborts.
+    if (lev == MSGL_FATAL)
+        drain_queue(root);
+}
+
+// Copy text[0..len-1] and the log's current state into a new entry.
+static struct msg_entry *new_entry(struct mp_log *log, int lev,
+                                   const char *text, size_t len)
+{
+    size_t prefix_len = log->prefix ? strlen(log->prefix) + 1 : 0;
+    size_t vprefix_len = log->verbose_prefix ? strlen(log->verbose_prefix) + 1 : 0;
+    struct msg_entry *e =
+        talloc_size(NULL, sizeof(*e) + len + 1 + prefix_len + vprefix_len);
+    *e = (struct msg_entry){
+        .lev = lev,
+        .terminal_level = atomic_load(&log->terminal_level),
+        .time = mp_time_us(),
+    };
+    memcpy(e->text, text, len);
+    e->text[len] = '\0';
+    char *pos = e->text + len + 1;
+    if (log->prefix) {
+        memcpy(pos, log->prefix, prefix_len);
+        e->prefix = pos;
+        pos += prefix_len;
+    }
+    if (log->verbose_prefix) {
+        memcpy(pos, log->verbose_prefix, vprefix_len);
+        e->verbose_prefix = pos;
+    }
+    return e;
+}
 
-    if (lev == MSGL_STATS) {
-        dump_stats(log, lev, text);
-    } else if (lev == MSGL_STATUS && !test_terminal_level(log, lev)) {
-        /* discard */
+void mp_msg_stats(struct mp_log *log, enum mp_stats_type type,
+                  const char *name, double value)
+{
+    if (mp_msg_test(log, MSGL_STATS) && log->root->stats)
+        mp_stats_add(log->root->stats, type, name, value);
+}
+
+void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
+{
+    if (lev == MSGL_STATS)
+        return; // discard; use mp_msg_stats()
+
+    if (!mp_msg_test(log, lev))
+        return; // do not display
+
+    struct mp_log_root *root = log->root;
+
+    // Format without holding any lock. Most messages fit into the stack buffer.
+    char stack_buf[256];
+    char *text = stack_buf;
+    va_list copy;
+    va_copy(copy, va);
+    int len = vsnprintf(stack_buf, sizeof(stack_buf), format, va);
+    if (len >= (int)sizeof(stack_buf)) {
+        text = talloc_size(NULL, len + 1);
+        vsnprintf(text, len + 1, format, copy);
+    }
+    va_end(copy);
+    if (len < 0)
+        return;
+
+    struct msg_entry *e = NULL;
+    bool complete = lev == MSGL_STATUS || (len > 0 && text[len - 1] == '\n');
+    if (complete && !atomic_load(&log->has_partial)) {
+        // Fast path: nothing to merge with.
+        if (len || lev == MSGL_STATUS)
+            e = new_entry(log, lev, text, len);
     } else {
-        if (lev == MSGL_STATUS && root->termosd)
-            prepare_status_line(root, text);
-
-        // Split away each line. Normally we require full lines; buffer partial
-        // lines if they happen.
-        while (1) {
-            char *end = strchr(text, '\n');
-            if (!end)
-                break;
-            char *next = &end[1];
-            char saved = next[0];
-            next[0] = '\0';
-            print_terminal_line(log, lev, text, "");
-            write_log_file(log, lev, text);
-            write_msg_to_buffers(log, lev, text);
-            next[0] = saved;
-            text = next;
+        // Normally we require full lines; buffer partial lines if they happen.
+        pthread_mutex_lock(&mp_msg_lock);
+
+        root->buffer.len = 0;
+        bstr_xappend(root, &root->buffer, bstr0(log->partial));
+        bstr_xappend(root, &root->buffer, (bstr){text, len});
+        log->partial[0] = '\0';
+
+        bstr merged = root->buffer;
+        if (lev != MSGL_STATUS) {
+            int end = bstrrchr(merged, '\n') + 1;
+            bstr rest = bstr_cut(merged, end);
+            merged.len = end;
+            if (rest.len) {
+                size_t size = rest.len + 1;
+                if (talloc_get_size(log->partial) < size)
+                    log->partial = talloc_realloc(NULL, log->partial, char, size);
+                memcpy(log->partial, rest.start, size);
+            }
         }
+        atomic_store(&log->has_partial, !!log->partial[0]);
 
-        if (lev == MSGL_STATUS) {
-            if (text[0])
-                print_terminal_line(log, lev, text, root->termosd ? "\r" : "\n");
-        } else if (text[0]) {
-            int size = strlen(text) + 1;
-            if (talloc_get_size(log->partial) < size)
-                log->partial = talloc_realloc(NULL, log->partial, char, size);
-            memcpy(log->partial, text, size);
-        }
+        if (merged.len || lev == MSGL_STATUS)
+            e = new_entry(log, lev, merged.start, merged.len);
+
+        pthread_mutex_unlock(&mp_msg_lock);
     }
 
-    pthread_mutex_unlock(&mp_msg_lock);
+    if (text != stack_buf)
+        talloc_free(text);
+
+    if (e)
+        queue_entry(root, e);
 }
 
 static void destroy_log(void *ptr)
@@ -458,7 +761,17 @@ void mp_msg_init(struct mpv_global *global)
 
     global->log = log;
 
+    root->stats = mp_stats_create(root, log);
+
     mp_msg_update_msglevels(global);
+
+    root->queue = mp_mpsc_queue_new(root, sizeof(struct msg_entry *), QUEUE_SIZE);
+    pthread_mutex_init(&root->writer_lock, NULL);
+    pthread_cond_init(&root->wakeup, NULL);
+    pthread_cond_init(&root->done, NULL);
+    // If this fails, messages are output synchronously by the logging thread.
+    if (pthread_create(&root->writer, NULL, msg_writer_thread, root) == 0)
+        atomic_store(&root->writer_running, true);
 }
 
 // If opt is different from *current_path, reopen *file and update *current_path.
@@ -498,6 +811,38 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
     talloc_free(tmp);
 }
 
+// Like reopen_file(), for --dump-stats.
+static void reopen_stats(struct mpv_global *global)
+{
+    struct mp_log_root *root = global->log->root;
+    struct MPOpts *opts = global->opts;
+    void *tmp = talloc_new(NULL);
+
+    char *new_path = mp_get_user_path(tmp, global, opts->dump_stats);
+    if (!new_path)
+        new_path = "";
+    char *format = opts->dump_stats_format ? "json" : "text";
+    char *new_id = talloc_asprintf(tmp, "%s:%s", format, new_path);
+
+    // Only the thread which changes options calls this, so reading
+    // stats_path without lock is fine.
+    char *old_id = root->stats_path ? root->stats_path : "text:";
+    if (root->stats && strcmp(old_id, new_id) != 0) {
+        bool ok = mp_stats_set_file(root->stats, new_path,
+                                    opts->dump_stats_format);
+        pthread_mutex_lock(&mp_msg_lock);
+        talloc_free(root->stats_path);
+        root->stats_path = talloc_strdup(NULL, new_id);
+        root->stats_enabled = ok && new_path[0];
+        atomic_fetch_add(&root->reload_counter, 1);
+        pthread_mutex_unlock(&mp_msg_lock);
+        if (!ok)
+            mp_err(global->log, "Failed to open stats file '%s'\n", new_path);
+    }
+
+    talloc_free(tmp);
+}
+
 void mp_msg_update_msglevels(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
@@ -516,6 +861,7 @@ void mp_msg_update_msglevels(struct mpv_global *global)
         root->color = opts->msg_color && isatty(STDOUT_FILENO);
         root->termosd = isatty(STDERR_FILENO);
     }
+    root->status_notty = opts->term_status_notty;
 
     m_option_type_msglevels.free(&root->msg_levels);
     m_option_type_msglevels.copy(NULL, &root->msg_levels,
@@ -527,8 +873,7 @@ void mp_msg_update_msglevels(struct mpv_global *global)
     reopen_file(opts->log_file, &root->log_path, &root->log_file,
                 "log", global);
 
-    reopen_file(opts->dump_stats, &root->stats_path, &root->stats_file,
-                "stats", global);
+    reopen_stats(global);
 }
 
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
@@ -541,8 +886,19 @@ void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
 void mp_msg_uninit(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
-    if (root->stats_file)
-        fclose(root->stats_file);
+    if (atomic_load(&root->writer_running)) {
+        pthread_mutex_lock(&root->writer_lock);
+        root->writer_exit = true;
+        pthread_cond_signal(&root->wakeup);
+        pthread_mutex_unlock(&root->writer_lock);
+        pthread_join(root->writer, NULL);
+        atomic_store(&root->writer_running, false);
+    }
+    pthread_cond_destroy(&root->wakeup);
+    pthread_cond_destroy(&root->done);
+    pthread_mutex_destroy(&root->writer_lock);
+    talloc_free(root->stats);
+    root->stats = NULL;
     talloc_free(root->stats_path);
     if (root->log_file)
         fclose(root->log_file);
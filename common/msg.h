@@ -76,9 +76,26 @@ bool mp_msg_test(struct mp_log *log, int lev);
 #define MP_DBG(obj, ...)        MP_MSG(obj, MSGL_DEBUG, __VA_ARGS__)
 #define MP_TRACE(obj, ...)      MP_MSG(obj, MSGL_TRACE, __VA_ARGS__)
 
-// This is a bit special. See TOOLS/stats-conv.py what rules text passed
-// to these functions should follow. Also see --dump-stats.
-#define mp_stats(obj, ...)      mp_msg(obj, MSGL_STATS, __VA_ARGS__)
-#define MP_STATS(obj, ...)      MP_MSG(obj, MSGL_STATS, __VA_ARGS__)
+// Timing statistics for --dump-stats. They are not logged as text, but
+// recorded in binary form, see common/stats.c. The name must be a string
+// literal.
+enum mp_stats_type {
+    MP_STATS_TYPE_START,    // start of the named event
+    MP_STATS_TYPE_END,      // end of the named event
+    MP_STATS_TYPE_VALUE,    // a value (a point in a graph)
+    MP_STATS_TYPE_SIGNAL,   // singular event
+};
+
+void mp_msg_stats(struct mp_log *log, enum mp_stats_type type,
+                  const char *name, double value);
+
+#define MP_STATS_START(obj, name) \
+    mp_msg_stats((obj)->log, MP_STATS_TYPE_START, "" name, 0)
+#define MP_STATS_END(obj, name) \
+    mp_msg_stats((obj)->log, MP_STATS_TYPE_END, "" name, 0)
+#define MP_STATS_VALUE(obj, name, value) \
+    mp_msg_stats((obj)->log, MP_STATS_TYPE_VALUE, "" name, value)
+#define MP_STATS_SIGNAL(obj, name) \
+    mp_msg_stats((obj)->log, MP_STATS_TYPE_SIGNAL, "" name, 0)
 
 #endif /* MPLAYER_MP_MSG_H */
@@ -49,6 +49,26 @@ void playlist_entry_add_params(struct playlist_entry *e,
         playlist_entry_add_param(e, params[n].name, params[n].value);
 }
 
+// Whether e->pl_index is valid.
+static bool is_indexed(struct playlist *pl, struct playlist_entry *e)
+{
+    return e->pl_index < pl->num_valid && pl->entries[e->pl_index] == e;
+}
+
+static void update_index(struct playlist *pl)
+{
+    if (pl->num_valid == pl->num_entries)
+        return;
+    MP_TARRAY_GROW(pl, pl->entries, pl->num_entries);
+    struct playlist_entry *e =
+        pl->num_valid ? pl->entries[pl->num_valid - 1]->next : pl->first;
+    for (; e; e = e->next) {
+        e->pl_index = pl->num_valid;
+        pl->entries[pl->num_valid++] = e;
+    }
+    assert(pl->num_valid == pl->num_entries);
+}
+
 // Add entry "add" after entry "after".
 // If "after" is NULL, add as first entry.
 // Post condition: add->prev == after
@@ -60,6 +80,11 @@ void playlist_insert(struct playlist *pl, struct playlist_entry *after,
         assert(after->pl == pl);
         assert(pl->first && pl->last);
     }
+    if (!after) {
+        pl->num_valid = 0;
+    } else if (is_indexed(pl, after)) {
+        pl->num_valid = MPMIN(pl->num_valid, after->pl_index + 1);
+    }
     add->prev = after;
     if (after) {
         add->next = after->next;
@@ -75,6 +100,13 @@ void playlist_insert(struct playlist *pl, struct playlist_entry *after,
     }
     add->pl = pl;
     talloc_steal(pl, add);
+    pl->num_entries++;
+    // Appending to a fully indexed list (the common case) keeps it indexed.
+    if (!add->next && pl->num_valid == pl->num_entries - 1) {
+        MP_TARRAY_GROW(pl, pl->entries, pl->num_valid);
+        add->pl_index = pl->num_valid;
+        pl->entries[pl->num_valid++] = add;
+    }
 }
 
 void playlist_add(struct playlist *pl, struct playlist_entry *add)
@@ -86,6 +118,10 @@ static void playlist_unlink(struct playlist *pl, struct playlist_entry *entry)
 {
     assert(pl && entry->pl == pl);
 
+    if (is_indexed(pl, entry))
+        pl->num_valid = entry->pl_index;
+    pl->num_entries--;
+
     if (pl->current == entry) {
         pl->current = entry->next;
         pl->current_was_replaced = true;
@@ -150,19 +186,11 @@ void playlist_add_file(struct playlist *pl, const char *filename)
     playlist_add(pl, playlist_entry_new(filename));
 }
 
-static int playlist_count(struct playlist *pl)
-{
-    int c = 0;
-    for (struct playlist_entry *e = pl->first; e; e = e->next)
-        c++;
-    return c;
-}
-
 void playlist_shuffle(struct playlist *pl)
 {
     struct playlist_entry *save_current = pl->current;
     bool save_replaced = pl->current_was_replaced;
-    int count = playlist_count(pl);
+    int count = pl->num_entries;
     struct playlist_entry **arr = talloc_array(NULL, struct playlist_entry *,
                                                count);
     for (int n = 0; n < count; n++) {
@@ -247,32 +275,25 @@ void playlist_append_entries(struct playlist *pl, struct playlist *source_pl)
 // Return -1 if e is not on the list, or if e is NULL.
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
-    struct playlist_entry *cur = pl->first;
-    int pos = 0;
-    if (!e)
+    if (!e || e->pl != pl)
         return -1;
-    while (cur && cur != e) {
-        cur = cur->next;
-        pos++;
-    }
-    return cur == e ? pos : -1;
+    update_index(pl);
+    return e->pl_index;
 }
 
 int playlist_entry_count(struct playlist *pl)
 {
-    return playlist_entry_to_index(pl, pl->last) + 1;
+    return pl->num_entries;
 }
 
 // Return entry for which playlist_entry_to_index() would return index.
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    struct playlist_entry *e = pl->first;
-    for (int n = 0; ; n++) {
-        if (!e || n == index)
-            return e;
-        e = e->next;
-    }
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    update_index(pl);
+    return pl->entries[index];
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mpv_global *global)
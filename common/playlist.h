@@ -19,15 +19,26 @@
 #define MPLAYER_PLAYLIST_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "misc/bstr.h"
 
 struct playlist_param {
     bstr name, value;
 };
 
+// File information as determined by the playlist-probe command.
+struct playlist_probe {
+    bool failed;            // file could not be opened
+    double duration;        // -1 if unknown
+    char *title;            // from the file's metadata, NULL if none
+    int w, h;               // display size of the first video stream, or 0
+};
+
 struct playlist_entry {
     struct playlist_entry *prev, *next;
     struct playlist *pl;
+    // Position in pl; only valid if pl->entries[pl_index] == this entry.
+    int pl_index;
 
     char *filename;
 
@@ -50,6 +61,8 @@ struct playlist_entry {
     bool init_failed : 1;
     // Entry was removed with playlist_remove (etc.), but not deallocated.
     bool removed : 1;
+    // Entry is being probed by playlist-probe (and is reserved for it).
+    bool probe_queued : 1;
     // Additional refcount. Normally (reserved==0), the entry is owned by the
     // playlist, and this can be used to keep the entry alive.
     int reserved;
@@ -59,6 +72,13 @@ struct playlist_entry {
     //  STREAM_NETWORK_ONLY: only allow streams marked with is_network
     // The value 0 allows everything.
     int stream_flags;
+
+    // If >0, this is the unparsed rest of a playlist file, of which only
+    // the entries before this byte position were loaded.
+    int64_t playlist_offset;
+
+    // Result of playlist-probe, or NULL. Allocated as child of the entry.
+    struct playlist_probe *probe;
 };
 
 struct playlist {
@@ -71,6 +91,13 @@ struct playlist {
     bool current_was_replaced;
 
     bool disable_safety;
+
+    // Internal. Index for playlist_entry_from_index() etc.: entries[n] is the
+    // n-th entry for n < num_valid. Changes to the list reduce num_valid to
+    // the first changed position, and the rest is rebuilt on access.
+    struct playlist_entry **entries;
+    int num_valid;
+    int num_entries;
 };
 
 void playlist_entry_add_param(struct playlist_entry *e, bstr name, bstr value);
@@ -16,6 +16,7 @@
  */
 
 #include <math.h>
+#include <pthread.h>
 
 #include <libavformat/avformat.h>
 
@@ -25,6 +26,10 @@
 #include "common/msg.h"
 #include "demux/packet.h"
 #include "demux/stheader.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "recorder.h"
 
@@ -39,9 +44,29 @@
 // Keyframe flags can trigger this earlier.
 #define QUEUE_MIN_PACKETS 16
 
+struct recorder_opts {
+    int queue_size;     // in KiB
+    int queue_full;
+};
+
+#define OPT_BASE_STRUCT struct recorder_opts
+const struct m_sub_options recorder_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_INTRANGE("queue-size", queue_size, 0, 0, 0x7fffffff / 1024),
+        OPT_CHOICE("queue-full", queue_full, 0,
+                   ({"wait", 0}, {"drop", 1})),
+        {0}
+    },
+    .size = sizeof(struct recorder_opts),
+    .defaults = &(const struct recorder_opts){
+        .queue_size = 32 * 1024,
+    },
+};
+
 struct mp_recorder {
     struct mpv_global *global;
     struct mp_log *log;
+    struct recorder_opts *opts;
 
     struct mp_recorder_sink **streams;
     int num_streams;
@@ -59,6 +84,26 @@ struct mp_recorder {
     double rebase_ts;
 
     AVFormatContext *mux;
+
+    // Packets are written to the file by a separate thread, so that slow
+    // storage does not stall the decoders feeding the recorder.
+    pthread_t thread;
+    bool thread_valid;
+    bool closing;           // flushing remaining packets on destroy
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- Protected by lock
+    bool terminate;
+    AVPacket **queue;       // queue[queue_pos..num_queue] are pending
+    int queue_pos, num_queue;
+    int64_t queue_bytes;
+    // Statistics, logged on destroy.
+    int64_t peak_queue_bytes;
+    int64_t written_packets, written_bytes;
+    int64_t dropped_packets;
+    int64_t write_time;     // in us, spent in the writer thread
+    int64_t wait_time;      // in us, spent by the caller waiting for space
 };
 
 struct mp_recorder_sink {
@@ -68,6 +113,7 @@ struct mp_recorder_sink {
     double max_out_pts;
     bool discont;
     bool proper_eof;
+    bool dropping;  // the write queue was full; wait for the next keyframe
     struct demux_packet **packets;
     int num_packets;
 };
@@ -114,6 +160,97 @@ static int add_stream(struct mp_recorder *priv, struct sh_stream *sh)
     return 0;
 }
 
+static void *write_thread(void *p)
+{
+    struct mp_recorder *priv = p;
+
+    mpthread_set_name("recorder");
+
+    pthread_mutex_lock(&priv->lock);
+    while (1) {
+        if (priv->queue_pos < priv->num_queue) {
+            AVPacket *pkt = priv->queue[priv->queue_pos++];
+            if (priv->queue_pos == priv->num_queue) {
+                priv->queue_pos = priv->num_queue = 0;
+            } else if (priv->queue_pos > priv->num_queue / 2) {
+                memmove(&priv->queue[0], &priv->queue[priv->queue_pos],
+                        (priv->num_queue - priv->queue_pos) *
+                        sizeof(priv->queue[0]));
+                priv->num_queue -= priv->queue_pos;
+                priv->queue_pos = 0;
+            }
+            int size = pkt->size;
+            pthread_mutex_unlock(&priv->lock);
+
+            int64_t start = mp_time_us();
+            if (av_interleaved_write_frame(priv->mux, pkt) < 0)
+                MP_ERR(priv, "Failed writing packet.\n");
+            av_packet_free(&pkt);
+            int64_t elapsed = mp_time_us() - start;
+
+            pthread_mutex_lock(&priv->lock);
+            priv->queue_bytes -= size;
+            priv->written_packets += 1;
+            priv->written_bytes += size;
+            priv->write_time += elapsed;
+            pthread_cond_broadcast(&priv->wakeup);
+        } else if (priv->terminate) {
+            break;
+        } else {
+            pthread_cond_wait(&priv->wakeup, &priv->lock);
+        }
+    }
+    pthread_mutex_unlock(&priv->lock);
+
+    return NULL;
+}
+
+// Pass pkt to the writer thread, which takes ownership of it. If the queue is
+// full, either wait until there is space, or drop the packet (and all further
+// packets of the stream up to the next keyframe).
+static void queue_packet(struct mp_recorder_sink *rst, AVPacket *pkt)
+{
+    struct mp_recorder *priv = rst->owner;
+    int64_t limit = priv->opts->queue_size * 1024LL;
+    bool keyframe = pkt->flags & AV_PKT_FLAG_KEY;
+
+    pthread_mutex_lock(&priv->lock);
+
+    if (rst->dropping && !keyframe && !priv->closing)
+        goto drop;
+
+    // Always accept a packet into an empty queue, even if it's larger.
+    int64_t wait_start = 0;
+    while (priv->queue_bytes > 0 && priv->queue_bytes + pkt->size > limit) {
+        if (priv->opts->queue_full && !priv->closing) {
+            if (!rst->dropping) {
+                MP_WARN(priv, "Write queue full (output too slow), dropping "
+                        "packets of stream %d.\n", rst->av_stream->index);
+            }
+            rst->dropping = true;
+            goto drop;
+        }
+        if (!wait_start)
+            wait_start = mp_time_us();
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    }
+    if (wait_start)
+        priv->wait_time += mp_time_us() - wait_start;
+    rst->dropping = false;
+
+    MP_TARRAY_APPEND(priv, priv->queue, priv->num_queue, pkt);
+    priv->queue_bytes += pkt->size;
+    priv->peak_queue_bytes = MPMAX(priv->peak_queue_bytes, priv->queue_bytes);
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+    return;
+
+drop:
+    priv->dropped_packets += 1;
+    pthread_mutex_unlock(&priv->lock);
+    av_packet_free(&pkt);
+}
+
 struct mp_recorder *mp_recorder_create(struct mpv_global *global,
                                        const char *target_file,
                                        struct sh_stream **streams,
@@ -123,6 +260,10 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
 
     priv->global = global;
     priv->log = mp_log_new(priv, global->log, "recorder");
+    priv->opts = mp_get_config_group(priv, global, &recorder_conf);
+
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
 
     if (!num_streams) {
         MP_ERR(priv, "No streams.\n");
@@ -167,6 +308,12 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
     priv->opened = true;
     priv->muxing_from_start = true;
 
+    if (pthread_create(&priv->thread, NULL, write_thread, priv)) {
+        MP_ERR(priv, "Failed to start writer thread.\n");
+        goto error;
+    }
+    priv->thread_valid = true;
+
     priv->base_ts = MP_NOPTS_VALUE;
     priv->rebase_ts = 0;
 
@@ -217,8 +364,7 @@ static void mux_packet(struct mp_recorder_sink *rst,
         return;
     }
 
-    if (av_interleaved_write_frame(priv->mux, new_packet) < 0)
-        MP_ERR(priv, "Failed writing packet.\n");
+    queue_packet(rst, new_packet);
 }
 
 // Write all packets that currently can be written.
@@ -290,9 +436,35 @@ static void check_restart(struct mp_recorder *priv)
         MP_WARN(priv, "Discontinuity at timestamp %f.\n", priv->rebase_ts);
 }
 
+static void stop_thread(struct mp_recorder *priv)
+{
+    if (!priv->thread_valid)
+        return;
+
+    pthread_mutex_lock(&priv->lock);
+    priv->terminate = true;
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+    pthread_join(priv->thread, NULL);
+    priv->thread_valid = false;
+
+    MP_VERBOSE(priv, "Wrote %"PRId64" packets (%.1f MiB) in %.3f s of write "
+               "time (%.1f MiB/s), peak queue %"PRId64" KiB, waited %.3f s "
+               "for queue space.\n", priv->written_packets,
+               priv->written_bytes / (1024.0 * 1024),
+               priv->write_time / 1e6, priv->write_time > 0 ?
+               priv->written_bytes / (1024.0 * 1024) / (priv->write_time / 1e6)
+               : 0, priv->peak_queue_bytes / 1024, priv->wait_time / 1e6);
+    if (priv->dropped_packets) {
+        MP_WARN(priv, "Dropped %"PRId64" packets because the write queue "
+                "was full.\n", priv->dropped_packets);
+    }
+}
+
 void mp_recorder_destroy(struct mp_recorder *priv)
 {
     if (priv->opened) {
+        priv->closing = true;
         for (int n = 0; n < priv->num_streams; n++) {
             struct mp_recorder_sink *rst = priv->streams[n];
             if (!rst->proper_eof)
@@ -300,10 +472,15 @@ void mp_recorder_destroy(struct mp_recorder *priv)
             mux_packets(rst, true);
         }
 
+        stop_thread(priv);
+
         if (av_write_trailer(priv->mux) < 0)
             MP_ERR(priv, "Writing trailer failed.\n");
     }
 
+    for (int n = priv->queue_pos; n < priv->num_queue; n++)
+        av_packet_free(&priv->queue[n]);
+
     if (priv->mux) {
         if (avio_closep(&priv->mux->pb) < 0)
             MP_ERR(priv, "Closing file failed\n");
@@ -312,6 +489,8 @@ void mp_recorder_destroy(struct mp_recorder *priv)
     }
 
     flush_packets(priv);
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
     talloc_free(priv);
 }
 
@@ -0,0 +1,284 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+
+#include "common/common.h"
+#include "misc/ring.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+
+#include "stats.h"
+
+// Events a thread can record between two flushes without dropping some.
+#define THREAD_EVENTS 4096
+#define FLUSH_INTERVAL 0.1
+
+struct event {
+    int64_t time;
+    const char *name;
+    double value;
+    int type;       // enum mp_stats_type
+    int tid;        // set when collecting only
+};
+
+struct thread_buf {
+    struct mp_ring *ring;
+    int tid;
+    atomic_bool exited;
+    atomic_ullong dropped;
+};
+
+struct mp_stats {
+    struct mp_log *log;
+    pthread_key_t key;
+    atomic_bool active;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t thread;
+    bool thread_running;
+    bool terminate;
+    // --- protected by lock
+    struct thread_buf **bufs;
+    int num_bufs;
+    int next_tid;
+    FILE *file;
+    bool json;
+    bool written;
+    struct event *events;
+    int num_events;
+};
+
+static void thread_exit(void *p)
+{
+    struct thread_buf *buf = p;
+    atomic_store(&buf->exited, true);
+}
+
+static struct thread_buf *register_thread(struct mp_stats *st)
+{
+    struct thread_buf *buf = talloc_zero(NULL, struct thread_buf);
+    buf->ring = mp_ring_new(buf, THREAD_EVENTS * sizeof(struct event));
+    atomic_store(&buf->exited, false);
+    atomic_store(&buf->dropped, 0);
+    pthread_mutex_lock(&st->lock);
+    buf->tid = ++st->next_tid;
+    talloc_steal(st, buf);
+    MP_TARRAY_APPEND(st, st->bufs, st->num_bufs, buf);
+    pthread_mutex_unlock(&st->lock);
+    pthread_setspecific(st->key, buf);
+    return buf;
+}
+
+void mp_stats_add(struct mp_stats *st, enum mp_stats_type type,
+                  const char *name, double value)
+{
+    if (!atomic_load_explicit(&st->active, memory_order_relaxed))
+        return;
+    struct thread_buf *buf = pthread_getspecific(st->key);
+    if (!buf)
+        buf = register_thread(st);
+    struct event ev = {
+        .time = mp_time_us(),
+        .name = name,
+        .value = value,
+        .type = type,
+    };
+    // Only this thread writes to the ring, so the space can't shrink.
+    if (mp_ring_available(buf->ring) < sizeof(ev)) {
+        atomic_fetch_add(&buf->dropped, 1);
+        return;
+    }
+    mp_ring_write(buf->ring, (unsigned char *)&ev, sizeof(ev));
+}
+
+static int cmp_event(const void *pa, const void *pb)
+{
+    const struct event *a = pa, *b = pb;
+    if (a->time != b->time)
+        return a->time < b->time ? -1 : 1;
+    return a->tid - b->tid;
+}
+
+static void write_event(struct mp_stats *st, struct event *ev)
+{
+    static const char *const names[] = {
+        [MP_STATS_TYPE_START]   = "start",
+        [MP_STATS_TYPE_END]     = "end",
+        [MP_STATS_TYPE_VALUE]   = "value",
+        [MP_STATS_TYPE_SIGNAL]  = "signal",
+    };
+    static const char *const phases[] = {
+        [MP_STATS_TYPE_START]   = "B",
+        [MP_STATS_TYPE_END]     = "E",
+        [MP_STATS_TYPE_VALUE]   = "C",
+        [MP_STATS_TYPE_SIGNAL]  = "i",
+    };
+    FILE *f = st->file;
+    if (!st->json) {
+        fprintf(f, "%"PRId64" %s ", ev->time, names[ev->type]);
+        if (ev->type == MP_STATS_TYPE_VALUE)
+            fprintf(f, "%f ", ev->value);
+        fprintf(f, "%s\n", ev->name);
+        return;
+    }
+    // Names are string literals from the source code, which never need to
+    // be escaped.
+    fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%"PRId64","
+            "\"pid\":1,\"tid\":%d", st->written ? ",\n" : "", ev->name,
+            phases[ev->type], ev->time, ev->tid);
+    if (ev->type == MP_STATS_TYPE_VALUE)
+        fprintf(f, ",\"args\":{\"value\":%f}", ev->value);
+    if (ev->type == MP_STATS_TYPE_SIGNAL)
+        fprintf(f, ",\"s\":\"t\"");
+    fprintf(f, "}");
+    st->written = true;
+}
+
+// Write all buffered events, ordered by time. Called with lock held.
+static void flush(struct mp_stats *st)
+{
+    st->num_events = 0;
+    for (int n = st->num_bufs - 1; n >= 0; n--) {
+        struct thread_buf *buf = st->bufs[n];
+        // Read this before draining, so no event is left behind.
+        bool exited = atomic_load(&buf->exited);
+        struct event ev;
+        while (mp_ring_read(buf->ring, (unsigned char *)&ev, sizeof(ev))) {
+            ev.tid = buf->tid;
+            MP_TARRAY_APPEND(st, st->events, st->num_events, ev);
+        }
+        unsigned long long dropped = atomic_load(&buf->dropped);
+        if (dropped) {
+            atomic_fetch_add(&buf->dropped, -dropped);
+            MP_TARRAY_APPEND(st, st->events, st->num_events, (struct event){
+                .time = mp_time_us(),
+                .name = "stats-dropped",
+                .value = dropped,
+                .type = MP_STATS_TYPE_VALUE,
+                .tid = buf->tid,
+            });
+        }
+        if (exited) {
+            talloc_free(buf);
+            MP_TARRAY_REMOVE_AT(st->bufs, st->num_bufs, n);
+        }
+    }
+    if (!st->file)
+        return;
+    qsort(st->events, st->num_events, sizeof(st->events[0]), cmp_event);
+    for (int n = 0; n < st->num_events; n++)
+        write_event(st, &st->events[n]);
+    fflush(st->file);
+}
+
+static void *stats_thread(void *p)
+{
+    struct mp_stats *st = p;
+    mpthread_set_name("stats");
+    pthread_mutex_lock(&st->lock);
+    while (!st->terminate) {
+        struct timespec ts = mp_rel_time_to_timespec(FLUSH_INTERVAL);
+        pthread_cond_timedwait(&st->wakeup, &st->lock, &ts);
+        flush(st);
+    }
+    pthread_mutex_unlock(&st->lock);
+    return NULL;
+}
+
+static void close_file(struct mp_stats *st)
+{
+    if (!st->file)
+        return;
+    flush(st);
+    if (st->json)
+        fprintf(st->file, "\n]\n");
+    fclose(st->file);
+    st->file = NULL;
+}
+
+static void stop_thread(struct mp_stats *st)
+{
+    if (!st->thread_running)
+        return;
+    pthread_mutex_lock(&st->lock);
+    st->terminate = true;
+    pthread_cond_signal(&st->wakeup);
+    pthread_mutex_unlock(&st->lock);
+    pthread_join(st->thread, NULL);
+    st->thread_running = false;
+    st->terminate = false;
+}
+
+bool mp_stats_set_file(struct mp_stats *st, const char *path, bool json)
+{
+    atomic_store(&st->active, false);
+    stop_thread(st);
+
+    pthread_mutex_lock(&st->lock);
+    close_file(st);
+    if (path && path[0]) {
+        st->file = fopen(path, "wb");
+        st->json = json;
+        st->written = false;
+        if (st->file && json)
+            fprintf(st->file, "[\n");
+    }
+    bool ok = !path || !path[0] || st->file;
+    pthread_mutex_unlock(&st->lock);
+
+    if (st->file) {
+        if (pthread_create(&st->thread, NULL, stats_thread, st)) {
+            MP_ERR(st, "Could not start stats thread.\n");
+        } else {
+            st->thread_running = true;
+            atomic_store(&st->active, true);
+        }
+    }
+    return ok;
+}
+
+static void destroy_stats(void *p)
+{
+    struct mp_stats *st = p;
+    mp_stats_set_file(st, NULL, false);
+    pthread_key_delete(st->key);
+    pthread_cond_destroy(&st->wakeup);
+    pthread_mutex_destroy(&st->lock);
+}
+
+struct mp_stats *mp_stats_create(void *ta_parent, struct mp_log *log)
+{
+    struct mp_stats *st = talloc_zero(ta_parent, struct mp_stats);
+    st->log = log;
+    atomic_store(&st->active, false);
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_cond_init(&st->wakeup, NULL);
+    if (pthread_key_create(&st->key, thread_exit)) {
+        talloc_free(st);
+        return NULL;
+    }
+    talloc_set_destructor(st, destroy_stats);
+    return st;
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_STATS_H
+#define MP_STATS_H
+
+#include <stdbool.h>
+
+#include "msg.h"
+
+// Buffers --dump-stats events per thread in binary form, and writes them to
+// the file from a separate thread. Recording an event doesn't format text,
+// and doesn't take a lock (except on the first event of a thread).
+struct mp_stats;
+
+struct mp_stats *mp_stats_create(void *ta_parent, struct mp_log *log);
+
+// Switch to a new output file. path==NULL or "" stops recording (and closes
+// the current file). If json is set, write Chrome trace event format, which
+// can be loaded into chrome://tracing or Perfetto, otherwise the text format
+// expected by TOOLS/stats-conv.py. Returns false if the file couldn't be
+// opened.
+bool mp_stats_set_file(struct mp_stats *st, const char *path, bool json);
+
+// Record an event. name must have static lifetime (a string literal), as it
+// is accessed after the call returns. Thread-safe.
+void mp_stats_add(struct mp_stats *st, enum mp_stats_type type,
+                  const char *name, double value);
+
+#endif
@@ -28,19 +28,26 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <libavutil/buffer.h>
+
 #include "config.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "mpv_talloc.h"
+#include "common/mem_usage.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
+#include "probe_cache.h"
 
 // Demuxer list
 extern const struct demuxer_desc demuxer_desc_edl;
@@ -86,10 +93,13 @@ const demuxer_desc_t *const demuxer_list[] = {
 struct demux_opts {
     int max_packs;
     int max_bytes;
+    int max_bytes_bw;
     double min_secs;
     int force_seekable;
     double min_secs_cache;
     int access_references;
+    int probe_cache;
+    int cache_adaptive;
 };
 
 #define OPT_BASE_STRUCT struct demux_opts
@@ -99,9 +109,12 @@ const struct m_sub_options demux_conf = {
         OPT_DOUBLE("demuxer-readahead-secs", min_secs, M_OPT_MIN, .min = 0),
         OPT_INTRANGE("demuxer-max-packets", max_packs, 0, 0, INT_MAX),
         OPT_INTRANGE("demuxer-max-bytes", max_bytes, 0, 0, INT_MAX),
+        OPT_INTRANGE("demuxer-max-back-bytes", max_bytes_bw, 0, 0, INT_MAX),
         OPT_FLAG("force-seekable", force_seekable, 0),
         OPT_DOUBLE("cache-secs", min_secs_cache, M_OPT_MIN, .min = 0),
         OPT_FLAG("access-references", access_references, 0),
+        OPT_FLAG("demuxer-probe-cache", probe_cache, 0),
+        OPT_FLAG("cache-adaptive", cache_adaptive, 0),
         {0}
     },
     .size = sizeof(struct demux_opts),
@@ -151,6 +164,14 @@ struct demux_internal {
     double min_secs;
     int max_packs;
     int max_bytes;
+    int max_bytes_bw;           // max. bytes of already read packets to keep
+
+    // Shared limits with other demuxers (NULL if none). The budget_* fields
+    // are protected by budget->lock (and written with in->lock held too).
+    struct demux_budget *budget;
+    size_t budget_packs, budget_bytes;
+    double budget_buffered;     // least readahead duration of active streams
+    bool budget_throttled;      // readahead denied by budget
 
     // Set if we know that we are at the start of the file. This is used to
     // avoid a redundant initial seek after enabling streams. We could just
@@ -178,6 +199,12 @@ struct demux_internal {
     int64_t stream_size;
     // Updated during init only.
     char *stream_base_filename;
+    bool cache_adaptive;
+
+    // Used by the demuxer thread only (for cache_adaptive).
+    int64_t cache_adapt_max;    // initial cache size, used as upper bound
+    int64_t cache_adapt_speed;  // last download speed measured while reading
+    double cache_adapt_last;    // time of last adjustment
 };
 
 struct demux_stream {
@@ -193,15 +220,25 @@ struct demux_stream {
     bool refreshing;
     bool correct_dts;       // packet DTS is strictly monotonically increasing
     bool correct_pos;       // packet pos is strictly monotonically increasing
-    size_t packs;           // number of packets in buffer
-    size_t bytes;           // total bytes of packets in buffer
+    size_t packs;           // number of packets in buffer (after head)
+    size_t bytes;           // total bytes of packets in buffer (after head)
+    size_t bw_bytes;        // total bytes of already returned packets
+    double seek_start;      // lowest keyframe ts that can be seeked to in
+                            // the packet queue (or NOPTS)
+    double seek_end;        // highest ts covered by the packet queue (or NOPTS)
     double base_ts;         // timestamp of the last packet returned to decoder
     double last_ts;         // timestamp of the last packet added to queue
     double last_br_ts;      // timestamp of last packet bitrate was calculated
     size_t last_br_bytes;   // summed packet sizes since last bitrate calculation
     double bitrate;
+    bool underrun;          // reader found no packet, and none was added since
+    int64_t underruns;      // number of times underrun was set
     int64_t last_pos;
     double last_dts;
+    // Packet queue. queue_head is the oldest packet still kept around (only
+    // differs from head if already returned packets are kept for seeking),
+    // head is the next packet to return to the decoder, tail the newest one.
+    struct demux_packet *queue_head;
     struct demux_packet *head;
     struct demux_packet *tail;
 
@@ -220,6 +257,18 @@ struct demux_stream {
 
 #define MP_ADD_PTS(a, b) ((a) == MP_NOPTS_VALUE ? (a) : ((a) + (b)))
 
+// Readahead limits shared by all demuxers of a playback session, so that
+// external tracks don't multiply the memory used for packet queues. The
+// members' queue sizes are added up against --demuxer-max-bytes/-packets.
+// Above 3/4 of the limit, only the member with the least buffered time may
+// read ahead; above the limit, members read only what's needed to make
+// progress (a packet for streams whose queues are empty).
+struct demux_budget {
+    pthread_mutex_t lock;
+    struct demux_internal **members;
+    int num_members;
+};
+
 static void demuxer_sort_chapters(demuxer_t *demuxer);
 static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
@@ -227,18 +276,21 @@ static void update_cache(struct demux_internal *in);
 // called locked
 static void ds_flush(struct demux_stream *ds)
 {
-    demux_packet_t *dp = ds->head;
+    demux_packet_t *dp = ds->queue_head;
     while (dp) {
         demux_packet_t *dn = dp->next;
         free_demux_packet(dp);
         dp = dn;
     }
-    ds->head = ds->tail = NULL;
+    ds->queue_head = ds->head = ds->tail = NULL;
     ds->packs = 0;
     ds->bytes = 0;
+    ds->bw_bytes = 0;
+    ds->seek_start = ds->seek_end = MP_NOPTS_VALUE;
     ds->last_ts = ds->base_ts = ds->last_br_ts = MP_NOPTS_VALUE;
     ds->last_br_bytes = 0;
     ds->bitrate = -1;
+    ds->underrun = false;
     ds->eof = false;
     ds->active = false;
     ds->refreshing = false;
@@ -290,6 +342,8 @@ void demux_add_sh_stream(struct demuxer *demuxer, struct sh_stream *sh)
         .in = in,
         .type = sh->type,
         .selected = in->autoselect,
+        .seek_start = MP_NOPTS_VALUE,
+        .seek_end = MP_NOPTS_VALUE,
     };
 
     if (!sh->codec->codec)
@@ -375,6 +429,7 @@ void free_demuxer(demuxer_t *demuxer)
     assert(demuxer == in->d_user);
 
     demux_stop_thread(demuxer);
+    demux_set_budget(demuxer, NULL);
 
     if (demuxer->desc->close)
         demuxer->desc->close(in->d_thread);
@@ -382,6 +437,15 @@ void free_demuxer(demuxer_t *demuxer)
         ds_flush(in->streams[n]->ds);
         talloc_free(in->streams[n]);
     }
+    if (demuxer->packet_pool) {
+        struct demux_packet_pool_stats st;
+        demux_packet_pool_get_stats(demuxer->packet_pool, &st);
+        if (st.hits || st.misses) {
+            MP_VERBOSE(demuxer, "packet pool: %"PRId64" hits, %"PRId64" misses\n",
+                       st.hits, st.misses);
+        }
+    }
+    demux_packet_pool_release(demuxer->packet_pool);
     pthread_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(demuxer);
@@ -565,11 +629,14 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         ds->tail = dp;
     } else {
         // first packet in stream
-        ds->head = ds->tail = dp;
+        ds->queue_head = ds->tail = dp;
     }
+    if (!ds->head)
+        ds->head = dp;
 
     // obviously not true anymore
     ds->eof = false;
+    ds->underrun = false;
     in->last_eof = in->eof = false;
 
     // For video, PTS determination is not trivial, but for other media types
@@ -583,16 +650,123 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     if (ds->base_ts == MP_NOPTS_VALUE)
         ds->base_ts = ds->last_ts;
 
+    // The seekable range starts at the first keyframe. If the queue starts
+    // with a non-keyframe (e.g. after a refresh seek), the range begins with
+    // the next keyframe.
+    if (in->max_bytes_bw > 0) {
+        double pts = PTS_OR_DEF(dp->pts, dp->dts);
+        if (ds->seek_start == MP_NOPTS_VALUE && dp->keyframe)
+            ds->seek_start = pts;
+        if (ds->seek_start != MP_NOPTS_VALUE)
+            ds->seek_end = MP_PTS_MAX(ds->seek_end, pts);
+    }
+
     MP_DBG(in, "append packet to %s: size=%d pts=%f dts=%f pos=%"PRIi64" "
            "[num=%zd size=%zd]\n", stream_type_name(stream->type),
            dp->len, dp->pts, dp->dts, dp->pos, ds->packs, ds->bytes);
 
-    if (ds->in->wakeup_cb && !ds->head->next)
+    if (ds->in->wakeup_cb && ds->head == dp)
         ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
     pthread_cond_signal(&in->wakeup);
     pthread_mutex_unlock(&in->lock);
 }
 
+static void budget_destroy(void *p)
+{
+    struct demux_budget *b = p;
+    assert(!b->num_members);
+    pthread_mutex_destroy(&b->lock);
+}
+
+struct demux_budget *demux_budget_create(void *ta_parent)
+{
+    struct demux_budget *b = talloc_zero(ta_parent, struct demux_budget);
+    pthread_mutex_init(&b->lock, NULL);
+    talloc_set_destructor(b, budget_destroy);
+    return b;
+}
+
+// Make the demuxer's packet queues count against budget (or unregister it
+// if budget is NULL). The budget must outlive the demuxer's membership.
+void demux_set_budget(struct demuxer *demuxer, struct demux_budget *budget)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    struct demux_budget *old = in->budget;
+    if (old != budget) {
+        if (old) {
+            pthread_mutex_lock(&old->lock);
+            for (int n = 0; n < old->num_members; n++) {
+                if (old->members[n] == in) {
+                    MP_TARRAY_REMOVE_AT(old->members, old->num_members, n);
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&old->lock);
+        }
+        in->budget = budget;
+        in->budget_packs = in->budget_bytes = 0;
+        in->budget_buffered = INFINITY;
+        in->budget_throttled = false;
+        if (budget) {
+            pthread_mutex_lock(&budget->lock);
+            MP_TARRAY_APPEND(budget, budget->members, budget->num_members, in);
+            pthread_mutex_unlock(&budget->lock);
+        }
+        pthread_cond_signal(&in->wakeup);
+    }
+    pthread_mutex_unlock(&in->lock);
+}
+
+// Publish the queue sizes of in to its budget, and return whether it may read
+// ahead. Called locked.
+static bool budget_update(struct demux_internal *in, size_t packs, size_t bytes,
+                          double buffered)
+{
+    struct demux_budget *b = in->budget;
+    pthread_mutex_lock(&b->lock);
+    bool freed = bytes < in->budget_bytes || packs < in->budget_packs;
+    in->budget_packs = packs;
+    in->budget_bytes = bytes;
+    in->budget_buffered = buffered;
+    size_t total_packs = 0, total_bytes = 0;
+    bool most_starved = true;
+    for (int n = 0; n < b->num_members; n++) {
+        struct demux_internal *m = b->members[n];
+        total_packs += m->budget_packs;
+        total_bytes += m->budget_bytes;
+        if (m != in && m->budget_buffered < buffered)
+            most_starved = false;
+    }
+    bool allow = true;
+    if (total_packs >= in->max_packs || total_bytes >= in->max_bytes) {
+        allow = false;
+    } else if (total_packs >= in->max_packs / 4 * 3 ||
+               total_bytes >= in->max_bytes / 4 * 3)
+    {
+        allow = most_starved;
+    }
+    if (allow != !in->budget_throttled) {
+        MP_DBG(in, "budget: %zd/%d packets, %zd/%d bytes, readahead %s\n",
+               total_packs, in->max_packs, total_bytes, in->max_bytes,
+               allow ? "resumed" : "throttled");
+    }
+    in->budget_throttled = !allow;
+    // Let throttled members re-check. (Signaling without holding their lock
+    // might get lost, which is why they use a timed wait.)
+    if (freed) {
+        for (int n = 0; n < b->num_members; n++) {
+            struct demux_internal *m = b->members[n];
+            if (m != in && m->budget_throttled)
+                pthread_cond_signal(&m->wakeup);
+        }
+    }
+    pthread_mutex_unlock(&b->lock);
+    return allow;
+}
+
 // Returns true if there was "progress" (lock was released temporarily).
 static bool read_packet(struct demux_internal *in)
 {
@@ -602,18 +776,29 @@ static bool read_packet(struct demux_internal *in)
     // Check if we need to read a new packet. We do this if all queues are below
     // the minimum, or if a stream explicitly needs new packets. Also includes
     // safe-guards against packet queue overflow.
-    bool active = false, read_more = false;
+    bool active = false, read_more = false, prefetch = false;
     size_t packs = 0, bytes = 0;
+    double buffered = INFINITY;
+    // Over --memory-budget, read ahead only as far as needed for playback.
+    bool readahead = in->min_secs > 0 &&
+                     !mp_mem_usage_over_limit(MP_MEM_DEMUX_PACKETS, 0);
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
         active |= ds->active;
         read_more |= (ds->active && !ds->head) || ds->refreshing;
         packs += ds->packs;
         bytes += ds->bytes;
-        if (ds->active && ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
+        if (ds->active && ds->last_ts != MP_NOPTS_VALUE && readahead &&
             ds->last_ts >= ds->base_ts)
-            read_more |= ds->last_ts - ds->base_ts < in->min_secs;
+        {
+            double secs = ds->last_ts - ds->base_ts;
+            prefetch |= secs < in->min_secs;
+            buffered = MPMIN(buffered, secs);
+        }
     }
+    if (in->budget && !budget_update(in, packs, bytes, buffered))
+        prefetch = false;
+    read_more |= prefetch;
     MP_DBG(in, "packets=%zd, bytes=%zd, active=%d, more=%d\n",
            packs, bytes, active, read_more);
     if (packs >= in->max_packs || bytes >= in->max_bytes) {
@@ -727,6 +912,7 @@ static void *demux_thread(void *pctx)
 {
     struct demux_internal *in = pctx;
     mpthread_set_name("demux");
+    mpthread_set_role(in->d_thread->global, "demux");
     pthread_mutex_lock(&in->lock);
     while (!in->thread_terminate) {
         if (in->run_fn) {
@@ -755,12 +941,176 @@ static void *demux_thread(void *pctx)
             continue;
         }
         pthread_cond_signal(&in->wakeup);
-        pthread_cond_wait(&in->wakeup, &in->lock);
+        if (in->budget_throttled) {
+            // Other members don't always wake us up when they free budget.
+            struct timespec ts = mp_rel_time_to_timespec(0.1);
+            pthread_cond_timedwait(&in->wakeup, &in->lock, &ts);
+        } else {
+            pthread_cond_wait(&in->wakeup, &in->lock);
+        }
     }
     pthread_mutex_unlock(&in->lock);
     return NULL;
 }
 
+// Recompute the start of the seekable range after packets were removed from
+// the start of the queue. Must be called locked.
+static void update_seek_start(struct demux_stream *ds)
+{
+    ds->seek_start = MP_NOPTS_VALUE;
+    for (struct demux_packet *dp = ds->queue_head; dp; dp = dp->next) {
+        if (dp->keyframe) {
+            ds->seek_start = PTS_OR_DEF(dp->pts, dp->dts);
+            break;
+        }
+    }
+    if (ds->seek_start == MP_NOPTS_VALUE)
+        ds->seek_end = MP_NOPTS_VALUE;
+}
+
+// Remove already read packets from the start of the queues, until the total
+// size of such packets is below the --demuxer-max-back-bytes limit. Packets
+// are always removed up to the next keyframe, so that the remaining data
+// still starts at a seekable position.
+// Must be called locked.
+static void prune_old_packets(struct demux_internal *in)
+{
+    for (;;) {
+        size_t bw_bytes = 0;
+        struct demux_stream *earliest = NULL;
+        double earliest_ts = MP_NOPTS_VALUE;
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            bw_bytes += ds->bw_bytes;
+            if (ds->queue_head && ds->queue_head != ds->head) {
+                struct demux_packet *dp = ds->queue_head;
+                double ts = dp->dts == MP_NOPTS_VALUE ? dp->pts : dp->dts;
+                if (!earliest || (ts != MP_NOPTS_VALUE &&
+                                  (earliest_ts == MP_NOPTS_VALUE ||
+                                   ts < earliest_ts)))
+                {
+                    earliest = ds;
+                    earliest_ts = ts;
+                }
+            }
+        }
+
+        // The seek range is the first thing given up over --memory-budget.
+        if ((bw_bytes <= in->max_bytes_bw &&
+             !mp_mem_usage_over_limit(MP_MEM_DEMUX_PACKETS, 0)) || !earliest)
+            break;
+
+        struct demux_stream *ds = earliest;
+        bool first = true;
+        while (ds->queue_head && ds->queue_head != ds->head) {
+            struct demux_packet *dp = ds->queue_head;
+            if (dp->keyframe && !first)
+                break;
+            first = false;
+            ds->queue_head = dp->next;
+            ds->bw_bytes -= dp->len;
+            free_demux_packet(dp);
+        }
+
+        if (!ds->queue_head)
+            ds->tail = ds->head = NULL;
+        update_seek_start(ds);
+    }
+}
+
+// Return the packet the reader should be positioned at for a seek to pts,
+// or NULL if the queue doesn't contain a suitable packet.
+// For subtitles this is the first packet that could be visible at the target,
+// for other streams the closest keyframe in the requested seek direction.
+static struct demux_packet *find_seek_target(struct demux_stream *ds,
+                                             double pts, int flags)
+{
+    struct demux_packet *target = NULL;
+    for (struct demux_packet *dp = ds->queue_head; dp; dp = dp->next) {
+        double ts = PTS_OR_DEF(dp->pts, dp->dts);
+        if (ts == MP_NOPTS_VALUE)
+            continue;
+        if (ds->type == STREAM_SUB) {
+            if (ts + MPMAX(dp->duration, 0) >= pts)
+                return dp;
+        } else if (dp->keyframe) {
+            if (flags & SEEK_FORWARD) {
+                if (ts >= pts)
+                    return dp;
+            } else {
+                if (ts > pts && target)
+                    break;
+                target = dp;
+            }
+        }
+    }
+    return target;
+}
+
+// Whether all selected audio/video streams contain the target in their
+// seekable range. Must be called locked. pts is without ts_offset.
+static bool cache_has_target(struct demux_internal *in, double pts, int flags)
+{
+    if (in->max_bytes_bw <= 0 || (flags & SEEK_FACTOR) || in->seeking)
+        return false;
+
+    bool any = false;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (!ds->selected || ds->type == STREAM_SUB || ds->attached_picture)
+            continue;
+        if (ds->seek_start == MP_NOPTS_VALUE || ds->seek_end == MP_NOPTS_VALUE ||
+            pts < ds->seek_start || pts > ds->seek_end || ds->refreshing ||
+            ds->need_refresh || !find_seek_target(ds, pts, flags))
+            return false;
+        any = true;
+    }
+    return any;
+}
+
+// Try to satisfy a seek from the packets still in the queues. If successful,
+// the reader positions are changed, and the demuxer itself is not touched at
+// all. Must be called locked. pts is without ts_offset.
+static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
+{
+    if (!cache_has_target(in, pts, flags))
+        return false;
+
+    MP_VERBOSE(in, "in-cache seek to %f\n", pts);
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (!ds->selected)
+            continue;
+
+        struct demux_packet *target = find_seek_target(ds, pts, flags);
+
+        // Recompute the forward/backward byte counters.
+        ds->head = target;
+        ds->packs = ds->bytes = ds->bw_bytes = 0;
+        bool fw = false;
+        for (struct demux_packet *dp = ds->queue_head; dp; dp = dp->next) {
+            fw |= dp == target;
+            if (fw) {
+                ds->packs++;
+                ds->bytes += dp->len;
+            } else {
+                ds->bw_bytes += dp->len;
+            }
+        }
+
+        ds->base_ts = pts;
+        if (target)
+            ds->base_ts = PTS_OR_DEF(PTS_OR_DEF(target->dts, target->pts), pts);
+        ds->last_br_ts = MP_NOPTS_VALUE;
+        ds->last_br_bytes = 0;
+        ds->eof = false;
+        ds->attached_picture_added = false;
+    }
+
+    return true;
+}
+
 static struct demux_packet *dequeue_packet(struct demux_stream *ds)
 {
     if (ds->attached_picture) {
@@ -774,12 +1124,24 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
         return NULL;
     struct demux_packet *pkt = ds->head;
     ds->head = pkt->next;
-    pkt->next = NULL;
-    if (!ds->head)
-        ds->tail = NULL;
     ds->bytes -= pkt->len;
     ds->packs--;
 
+    if (ds->in->max_bytes_bw > 0) {
+        // Keep the packet in the queue for seeking, and return a new reference
+        // to the same data.
+        ds->bw_bytes += pkt->len;
+        pkt = demux_copy_packet(pkt);
+        prune_old_packets(ds->in);
+        if (!pkt)
+            return NULL;
+    } else {
+        ds->queue_head = ds->head;
+        pkt->next = NULL;
+        if (!ds->head)
+            ds->tail = NULL;
+    }
+
     double ts = pkt->dts == MP_NOPTS_VALUE ? pkt->pts : pkt->dts;
     if (ts != MP_NOPTS_VALUE)
         ds->base_ts = ts;
@@ -838,6 +1200,16 @@ static bool use_lazy_packet_reading(struct demux_stream *ds)
 // Read a packet from the given stream. The returned packet belongs to the
 // caller, who has to free it with talloc_free(). Might block. Returns NULL
 // on EOF.
+// called locked
+static void note_underrun(struct demux_stream *ds)
+{
+    // Not reading anything while seeking is expected.
+    if (!ds->underrun && !ds->in->seeking && !ds->eof) {
+        ds->underrun = true;
+        ds->underruns++;
+    }
+}
+
 struct demux_packet *demux_read_packet(struct sh_stream *sh)
 {
     struct demux_stream *ds = sh ? sh->ds : NULL;
@@ -850,6 +1222,7 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
             MP_DBG(in, "reading packet for %s\n", t);
             in->eof = false; // force retry
             while (ds->selected && !ds->head) {
+                note_underrun(ds);
                 ds->active = true;
                 // Note: the following code marks EOF if it can't continue
                 if (in->threading) {
@@ -895,6 +1268,8 @@ int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
                 r = *out_pkt ? 1 : -1;
             } else {
                 r = *out_pkt ? 1 : ((ds->eof || !ds->selected) ? -1 : 0);
+                if (r == 0)
+                    note_underrun(ds);
                 ds->active = ds->selected; // enable readahead
                 ds->in->eof = false; // force retry
                 pthread_cond_signal(&ds->in->wakeup); // possibly read more
@@ -1246,6 +1621,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .is_network = stream->is_network,
         .access_references = opts->access_references,
         .events = DEMUX_EVENT_ALL,
+        .packet_pool = demux_packet_pool_create(),
     };
     demuxer->seekable = stream->seekable;
     if (demuxer->stream->underlying && !demuxer->stream->underlying->seekable)
@@ -1260,6 +1636,8 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .min_secs = opts->min_secs,
         .max_packs = opts->max_packs,
         .max_bytes = opts->max_bytes,
+        .max_bytes_bw = opts->max_bytes_bw,
+        .cache_adaptive = opts->cache_adaptive,
         .initial_state = true,
     };
     pthread_mutex_init(&in->lock, NULL);
@@ -1329,6 +1707,73 @@ static struct demuxer *open_given_type(struct mpv_global *global,
     return NULL;
 }
 
+// Identifies the file for the probe cache. Returns NULL if it can't be cached.
+// Since a cache hit skips probing (and forces the libavformat format), only
+// local files are cached, for which size and mtime detect changed contents.
+static char *probe_cache_key(void *ta_ctx, struct stream *stream)
+{
+    struct stream *s = stream->underlying ? stream->underlying : stream;
+    if (!s->is_local_file || !s->path)
+        return NULL;
+
+    char *cwd = mp_getcwd(ta_ctx);
+    if (!cwd)
+        return NULL;
+    char *path = mp_path_join(ta_ctx, cwd, s->path);
+    struct stat st;
+    if (stat(path, &st) || !S_ISREG(st.st_mode) || st.st_mtime < 0 ||
+        stream_get_size(stream) != st.st_size)
+        return NULL;
+
+    return talloc_asprintf(ta_ctx, "%lld\t%lld\t%s\t%s",
+                           (long long)st.st_size, (long long)st.st_mtime,
+                           stream->mime_type ? stream->mime_type : "-", path);
+}
+
+// Try to open the demuxer recorded in the probe cache for this key.
+static struct demuxer *open_cached_type(struct mpv_global *global,
+                                        struct mp_log *log,
+                                        struct stream *stream,
+                                        struct demuxer_params *params,
+                                        const char *key)
+{
+    void *tmp = talloc_new(NULL);
+    struct demuxer *demuxer = NULL;
+
+    struct demux_probe_entry e;
+    if (!demux_probe_cache_lookup(tmp, global, key, &e))
+        goto done;
+
+    const struct demuxer_desc *desc = NULL;
+    for (int n = 0; demuxer_list[n]; n++) {
+        if (strcmp(demuxer_list[n]->name, e.demuxer) == 0)
+            desc = demuxer_list[n];
+    }
+    if (!desc || (e.check != DEMUX_CHECK_NORMAL && e.check != DEMUX_CHECK_UNSAFE))
+        goto done;
+
+    mp_verbose(log, "Using cached probe result: %s%s%s\n", desc->name,
+               e.lavf_format ? "/" : "", e.lavf_format ? e.lavf_format : "");
+
+    // demux_lavf skips its own probing if the stream provides a format.
+    bool set_format = desc == &demuxer_desc_lavf && e.lavf_format &&
+                      !stream->lavf_type;
+    if (set_format)
+        stream->lavf_type = e.lavf_format;
+    demuxer = open_given_type(global, log, desc, stream, params, e.check);
+    if (set_format)
+        stream->lavf_type = NULL;
+
+    if (!demuxer) {
+        mp_verbose(log, "Cached probe result is stale.\n");
+        demux_probe_cache_store(global, key, NULL);
+    }
+
+done:
+    talloc_free(tmp);
+    return demuxer;
+}
+
 static const int d_normal[]  = {DEMUX_CHECK_NORMAL, DEMUX_CHECK_UNSAFE, -1};
 static const int d_request[] = {DEMUX_CHECK_REQUEST, -1};
 static const int d_force[]   = {DEMUX_CHECK_FORCE, -1};
@@ -1342,6 +1787,7 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     struct mp_log *log = mp_log_new(NULL, global->log, "!demux");
     struct demuxer *demuxer = NULL;
     char *force_format = params ? params->force_format : NULL;
+    char *probe_key = NULL;
 
     if (!force_format)
         force_format = stream->demuxer;
@@ -1362,6 +1808,19 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         }
     }
 
+    struct demux_opts *opts = mp_get_config_group(log, global, &demux_conf);
+    if (opts->probe_cache && !check_desc && !(params && params->timeline)) {
+        probe_key = probe_cache_key(log, stream);
+        if (probe_key) {
+            demuxer = open_cached_type(global, log, stream, params, probe_key);
+            if (demuxer) {
+                talloc_steal(demuxer, log);
+                log = NULL;
+                goto done;
+            }
+        }
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
@@ -1371,6 +1830,17 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
             if (!check_desc || desc == check_desc) {
                 demuxer = open_given_type(global, log, desc, stream, params, level);
                 if (demuxer) {
+                    if (probe_key) {
+                        // Might be wrapped by demux_timeline.
+                        bool lavf = desc == &demuxer_desc_lavf &&
+                                    demuxer->desc == desc;
+                        struct demux_probe_entry e = {
+                            .demuxer = (char *)desc->name,
+                            .lavf_format = lavf ? (char *)demuxer->filetype : NULL,
+                            .check = level,
+                        };
+                        demux_probe_cache_store(global, probe_key, &e);
+                    }
                     talloc_steal(demuxer, log);
                     log = NULL;
                     goto done;
@@ -1452,12 +1922,22 @@ int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
     MP_VERBOSE(in, "queuing seek to %f%s\n", seek_pts,
                in->seeking ? " (cascade)" : "");
 
+    if (!(flags & SEEK_FACTOR))
+        seek_pts = MP_ADD_PTS(seek_pts, -in->ts_offset);
+
+    if (try_seek_cache(in, seek_pts, flags)) {
+        in->eof = false;
+        in->idle = true;
+        demuxer->filepos = -1;
+        pthread_cond_signal(&in->wakeup);
+        pthread_mutex_unlock(&in->lock);
+        return 1;
+    }
+
     flush_locked(demuxer);
     in->seeking = true;
     in->seek_flags = flags;
     in->seek_pts = seek_pts;
-    if (!(flags & SEEK_FACTOR))
-        in->seek_pts = MP_ADD_PTS(in->seek_pts, -in->ts_offset);
 
     if (!in->threading)
         execute_seek(in);
@@ -1468,6 +1948,27 @@ int demux_seek(demuxer_t *demuxer, double seek_pts, int flags)
     return 1;
 }
 
+// Whether demux_seek() with the same arguments would be served from the
+// packet queues, without a seek in the underlying file.
+bool demux_seek_is_cached(demuxer_t *demuxer, double seek_pts, int flags)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    if (!demuxer->seekable || seek_pts == MP_NOPTS_VALUE)
+        return false;
+
+    if (!(flags & SEEK_FORWARD))
+        flags |= SEEK_BACKWARD;
+
+    pthread_mutex_lock(&in->lock);
+    if (!(flags & SEEK_FACTOR))
+        seek_pts = MP_ADD_PTS(seek_pts, -in->ts_offset);
+    bool r = cache_has_target(in, seek_pts, flags);
+    pthread_mutex_unlock(&in->lock);
+    return r;
+}
+
 struct sh_stream *demuxer_stream_by_demuxer_id(struct demuxer *d,
                                                enum stream_type t, int id)
 {
@@ -1522,8 +2023,8 @@ bool demux_stream_is_selected(struct sh_stream *stream)
     return r;
 }
 
-int demuxer_add_attachment(demuxer_t *demuxer, char *name, char *type,
-                           void *data, size_t data_size)
+static struct demux_attachment *new_attachment(demuxer_t *demuxer, char *name,
+                                               char *type, size_t data_size)
 {
     if (!(demuxer->num_attachments % 32))
         demuxer->attachments = talloc_realloc(demuxer, demuxer->attachments,
@@ -1531,14 +2032,81 @@ int demuxer_add_attachment(demuxer_t *demuxer, char *name, char *type,
                                               demuxer->num_attachments + 32);
 
     struct demux_attachment *att = &demuxer->attachments[demuxer->num_attachments];
-    att->name = talloc_strdup(demuxer->attachments, name);
-    att->type = talloc_strdup(demuxer->attachments, type);
+    *att = (struct demux_attachment){
+        .name = talloc_strdup(demuxer->attachments, name),
+        .type = talloc_strdup(demuxer->attachments, type),
+        .data_size = data_size,
+    };
+    return att;
+}
+
+int demuxer_add_attachment(demuxer_t *demuxer, char *name, char *type,
+                           void *data, size_t data_size)
+{
+    struct demux_attachment *att = new_attachment(demuxer, name, type, data_size);
     att->data = talloc_memdup(demuxer->attachments, data, data_size);
-    att->data_size = data_size;
+    return demuxer->num_attachments++;
+}
 
+// Add an attachment whose data is read from the given file only when needed.
+int demuxer_add_attachment_ref(demuxer_t *demuxer, char *name, char *type,
+                               char *file, int64_t offset, size_t data_size)
+{
+    struct demux_attachment *att = new_attachment(demuxer, name, type, data_size);
+    att->data_file = talloc_strdup(demuxer->attachments, file);
+    att->data_offset = offset;
     return demuxer->num_attachments++;
 }
 
+// mmap() offsets must be aligned to the page size (or the allocation
+// granularity on win32).
+#define ATTACHMENT_MAP_ALIGN (64 * 1024)
+
+struct attachment_map {
+    void *ptr;
+    size_t size;
+};
+
+static void attachment_map_destroy(void *p)
+{
+    struct attachment_map *map = p;
+    munmap(map->ptr, map->size);
+}
+
+// Return the attachment data, or NULL on failure. If the data is not in
+// memory, it's mapped from the file, and stays valid until ta_parent is freed.
+void *demux_attachment_get_data(void *ta_parent, struct demux_attachment *att)
+{
+    if (att->data || !att->data_file)
+        return att->data;
+
+    int fd = open(att->data_file, O_RDONLY | O_BINARY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    void *res = NULL;
+    // Accessing a mapping beyond the end of the file would crash.
+    struct stat st;
+    if (fstat(fd, &st) || att->data_offset < 0 ||
+        att->data_offset + (int64_t)att->data_size > st.st_size)
+        goto done;
+
+    int64_t start = att->data_offset / ATTACHMENT_MAP_ALIGN * ATTACHMENT_MAP_ALIGN;
+    size_t size = att->data_offset - start + att->data_size;
+    void *ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, start);
+    if (!ptr || ptr == MAP_FAILED)
+        goto done;
+
+    struct attachment_map *map = talloc_ptrtype(ta_parent, map);
+    *map = (struct attachment_map){ptr, size};
+    talloc_set_destructor(map, attachment_map_destroy);
+    res = (char *)ptr + (att->data_offset - start);
+
+done:
+    close(fd);
+    return res;
+}
+
 static int chapter_compare(const void *p1, const void *p2)
 {
     struct demux_chapter *c1 = (void *)p1;
@@ -1580,6 +2148,41 @@ double demuxer_get_time_length(struct demuxer *demuxer)
 }
 
 // must be called not locked
+// Minimum time between cache size changes with --cache-adaptive.
+#define CACHE_ADAPT_INTERVAL 5.0
+// Never shrink the cache below this.
+#define CACHE_ADAPT_MIN_BYTES (2 * 1024 * 1024)
+
+// Resize the stream cache according to the ratio of download speed and the
+// bitrate of the selected streams: on fast links, caching in->min_secs worth
+// of data is enough, while slow links get up to 8 times as much.
+static void adapt_cache_size(struct demux_internal *in,
+                             struct stream_cache_info *info, double bitrate)
+{
+    if (in->cache_adapt_max <= 0)
+        in->cache_adapt_max = info->size;
+    // The speed is meaningless if the cache is full.
+    if (!info->idle && info->speed > 0)
+        in->cache_adapt_speed = info->speed;
+
+    double now = mp_time_sec();
+    if (bitrate <= 0 || now - in->cache_adapt_last < CACHE_ADAPT_INTERVAL)
+        return;
+    in->cache_adapt_last = now;
+
+    double ratio = in->cache_adapt_speed > 0 ? in->cache_adapt_speed / bitrate
+                                             : 1.0;
+    double secs = MPMAX(in->min_secs, 1.0) * MPCLAMP(4.0 / ratio, 1.0, 8.0);
+    int64_t size = MPCLAMP(bitrate * secs, CACHE_ADAPT_MIN_BYTES,
+                           MPMAX(in->cache_adapt_max, CACHE_ADAPT_MIN_BYTES));
+    if (llabs(size - info->size) <= info->size / 4)
+        return;
+
+    MP_VERBOSE(in, "Adapting cache size to %lld KiB (speed/bitrate=%.2f).\n",
+               (long long)(size / 1024), ratio);
+    stream_control(in->d_thread->stream, STREAM_CTRL_SET_CACHE_SIZE, &size);
+}
+
 static void update_cache(struct demux_internal *in)
 {
     struct demuxer *demuxer = in->d_thread;
@@ -1608,7 +2211,16 @@ static void update_cache(struct demux_internal *in)
         in->stream_metadata = talloc_steal(in, stream_metadata);
         in->d_buffer->events |= DEMUX_EVENT_METADATA;
     }
+    double bitrate = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->selected && ds->bitrate > 0)
+            bitrate += ds->bitrate;
+    }
     pthread_mutex_unlock(&in->lock);
+
+    if (in->cache_adaptive && stream_cache_info.size >= 0)
+        adapt_cache_size(in, &stream_cache_info, bitrate);
 }
 
 // must be called locked
@@ -1695,6 +2307,42 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
         r->ts_range[1] = MP_ADD_PTS(r->ts_range[1], in->ts_offset);
         return DEMUXER_CTRL_OK;
     }
+    case DEMUXER_CTRL_GET_CACHE_STATE: {
+        struct demux_ctrl_cache_state *c = arg;
+        *c = (struct demux_ctrl_cache_state){
+            .streams = talloc_array(NULL, struct demux_ctrl_stream_state,
+                                    in->num_streams),
+            .num_streams = in->num_streams,
+            .cache_size = -1,
+            .cache_fill = -1,
+            .cache_speed = -1,
+        };
+        cached_demux_control(in, DEMUXER_CTRL_GET_READER_STATE, &c->reader);
+        for (int n = 0; n < in->num_streams; n++) {
+            struct sh_stream *sh = in->streams[n];
+            struct demux_stream *ds = sh->ds;
+            c->streams[n] = (struct demux_ctrl_stream_state){
+                .type = ds->type,
+                .index = sh->index,
+                .selected = ds->selected,
+                .active = ds->active,
+                .eof = ds->eof,
+                .packets = ds->packs,
+                .fw_bytes = ds->bytes,
+                .bw_bytes = ds->bw_bytes,
+                .bitrate = ds->bitrate,
+                .ts_start = MP_ADD_PTS(ds->base_ts, in->ts_offset),
+                .ts_end = MP_ADD_PTS(ds->last_ts, in->ts_offset),
+                .underruns = ds->underruns,
+            };
+        }
+        if (in->stream_cache_info.size >= 0) {
+            c->cache_size = in->stream_cache_info.size;
+            c->cache_fill = in->stream_cache_info.fill;
+            c->cache_speed = in->stream_cache_info.speed;
+        }
+        return DEMUXER_CTRL_OK;
+    }
     }
     return DEMUXER_CTRL_DONTKNOW;
 }
@@ -1778,6 +2426,28 @@ bool demux_cancel_test(struct demuxer *demuxer)
     return mp_cancel_test(demuxer->stream->cancel);
 }
 
+// If the stream is a memory mapped file (--stream-file-mmap), and the next
+// len bytes plus padding bytes are within the mapping, set *data to the
+// current stream position in it, skip len bytes, and return a new reference
+// to the mapping. Packets created from it reference the file data without
+// copying. Otherwise, return NULL without changing the stream position.
+struct AVBufferRef *demux_read_mapped(struct demuxer *demuxer, size_t len,
+                                      size_t padding, unsigned char **data)
+{
+    struct stream *s = demuxer->stream;
+    struct stream_mapping map;
+    if (stream_control(s, STREAM_CTRL_GET_MAPPING, &map) != STREAM_OK)
+        return NULL;
+    int64_t pos = stream_tell(s);
+    if (len > map.size || padding > map.size - len ||
+        pos < 0 || pos > map.size - (int64_t)(len + padding))
+        return NULL;
+    if (!stream_seek(s, pos + len))
+        return NULL;
+    *data = map.data + pos;
+    return av_buffer_ref(map.buf);
+}
+
 struct demux_chapter *demux_copy_chapter_data(struct demux_chapter *c, int num)
 {
     struct demux_chapter *new = talloc_array(NULL, struct demux_chapter, num);
@@ -44,6 +44,7 @@ enum demux_ctrl {
     DEMUXER_CTRL_GET_READER_STATE,
     DEMUXER_CTRL_GET_BITRATE_STATS, // double[STREAM_TYPE_COUNT]
     DEMUXER_CTRL_REPLACE_STREAM,
+    DEMUXER_CTRL_GET_CACHE_STATE,   // struct demux_ctrl_cache_state*
 };
 
 struct demux_ctrl_reader_state {
@@ -52,6 +53,27 @@ struct demux_ctrl_reader_state {
     double ts_duration;
 };
 
+struct demux_ctrl_stream_state {
+    enum stream_type type;
+    int index;              // sh_stream.index
+    bool selected, active, eof;
+    int64_t packets;        // number of queued packets not read yet
+    int64_t fw_bytes;       // bytes of queued packets not read yet
+    int64_t bw_bytes;       // bytes of already read packets kept for seeking
+    double bitrate;         // in bytes per second, or -1 if unknown
+    double ts_start, ts_end; // timestamps of last read/queued packet, or NOPTS
+    int64_t underruns;      // number of times the reader found the queue empty
+};
+
+struct demux_ctrl_cache_state {
+    struct demux_ctrl_reader_state reader;
+    // Allocated by the demuxer; free with talloc_free().
+    struct demux_ctrl_stream_state *streams;
+    int num_streams;
+    // Stream cache state, all -1 if there is no cache.
+    int64_t cache_size, cache_fill, cache_speed;
+};
+
 struct demux_ctrl_stream_ctrl {
     int ctrl;
     void *arg;
@@ -152,6 +174,10 @@ typedef struct demux_attachment
     char *type;
     void *data;
     unsigned int data_size;
+    // If data==NULL, the data_size bytes at data_offset in data_file are the
+    // attachment data. Use demux_attachment_get_data() to access it.
+    char *data_file;
+    int64_t data_offset;
 } demux_attachment_t;
 
 struct demuxer_params {
@@ -165,6 +191,7 @@ struct demuxer_params {
     bool initial_readahead;
     bstr init_fragment;
     bool skip_lavf_probing;
+    int64_t playlist_offset;    // demux_playlist: continue parsing here
     // -- demux_open_url() only
     int stream_flags;
     bool disable_cache;
@@ -215,6 +242,10 @@ typedef struct demuxer {
     struct mp_log *log, *glog;
     struct demuxer_params *params;
 
+    // Pool for packet data allocations; can be passed to
+    // demux_packet_pool_new() by demuxer implementations.
+    struct demux_packet_pool *packet_pool;
+
     // internal to demux.c
     struct demux_internal *in;
     struct mp_tags **update_stream_tags;
@@ -260,14 +291,23 @@ struct demuxer *demux_open_url(const char *url,
                                struct mp_cancel *cancel,
                                struct mpv_global *global);
 
+struct demux_budget;
+struct demux_budget *demux_budget_create(void *ta_parent);
+void demux_set_budget(struct demuxer *demuxer, struct demux_budget *budget);
+
 void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
 
 bool demux_cancel_test(struct demuxer *demuxer);
 
+struct AVBufferRef;
+struct AVBufferRef *demux_read_mapped(struct demuxer *demuxer, size_t len,
+                                      size_t padding, unsigned char **data);
+
 void demux_flush(struct demuxer *demuxer);
 int demux_seek(struct demuxer *demuxer, double rel_seek_secs, int flags);
+bool demux_seek_is_cached(struct demuxer *demuxer, double seek_pts, int flags);
 void demux_set_ts_offset(struct demuxer *demuxer, double offset);
 
 int demux_control(struct demuxer *demuxer, int cmd, void *arg);
@@ -278,6 +318,10 @@ void demux_set_stream_autoselect(struct demuxer *demuxer, bool autoselect);
 
 void demuxer_help(struct mp_log *log);
 
+int demuxer_add_attachment_ref(struct demuxer *demuxer, char *name,
+                               char *type, char *file, int64_t offset,
+                               size_t data_size);
+void *demux_attachment_get_data(void *ta_parent, struct demux_attachment *att);
 int demuxer_add_attachment(struct demuxer *demuxer, char *name,
                            char *type, void *data, size_t data_size);
 int demuxer_add_chapter(demuxer_t *demuxer, char *name,
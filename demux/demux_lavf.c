@@ -44,6 +44,7 @@
 
 #include "stream/stream.h"
 #include "demux.h"
+#include "hls_prefetch.h"
 #include "stheader.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -57,6 +58,9 @@
 // Should correspond to IO_BUFFER_SIZE in libavformat/aviobuf.c (not public)
 // libavformat (almost) always reads data in blocks of this size.
 #define BIO_BUFFER_SIZE 32768
+// Default AVIO buffer size. mp_read() starts with BIO_BUFFER_SIZE sized reads
+// after each seek, and grows them up to the buffer size with sequential reads.
+#define BIO_MAX_BUFFER_SIZE (256 * 1024)
 
 #define OPT_BASE_STRUCT struct demux_lavf_opts
 struct demux_lavf_opts {
@@ -70,8 +74,10 @@ struct demux_lavf_opts {
     char **avopts;
     int hacks;
     int genptsmode;
+    int probeinfo;
     char *sub_cp;
     int rtsp_transport;
+    int hls_prefetch;
 };
 
 const struct m_sub_options demux_lavf_conf = {
@@ -81,7 +87,7 @@ const struct m_sub_options demux_lavf_conf = {
         OPT_FLOATRANGE("demuxer-lavf-analyzeduration", analyzeduration, 0,
                        0, 3600),
         OPT_INTRANGE("demuxer-lavf-buffersize", buffersize, 0, 1,
-                     10 * 1024 * 1024, OPTDEF_INT(BIO_BUFFER_SIZE)),
+                     10 * 1024 * 1024, OPTDEF_INT(BIO_MAX_BUFFER_SIZE)),
         OPT_FLAG("demuxer-lavf-allow-mimetype", allow_mimetype, 0),
         OPT_INTRANGE("demuxer-lavf-probescore", probescore, 0,
                      1, AVPROBE_SCORE_MAX),
@@ -89,7 +95,10 @@ const struct m_sub_options demux_lavf_conf = {
         OPT_FLAG("demuxer-lavf-hacks", hacks, 0),
         OPT_CHOICE("demuxer-lavf-genpts-mode", genptsmode, 0,
                    ({"lavf", 1}, {"no", 0})),
+        OPT_CHOICE("demuxer-lavf-probe-info", probeinfo, 0,
+                   ({"no", 0}, {"yes", 1}, {"nostreams", -2})),
         OPT_KEYVALUELIST("demuxer-lavf-o", avopts, 0),
+        OPT_INTRANGE("demuxer-lavf-hls-prefetch", hls_prefetch, 0, 0, 16),
         OPT_STRING("sub-codepage", sub_cp, 0),
         OPT_CHOICE("rtsp-transport", rtsp_transport, 0,
                ({"lavf", 0},
@@ -102,6 +111,7 @@ const struct m_sub_options demux_lavf_conf = {
     .defaults = &(const struct demux_lavf_opts){
         .allow_mimetype = 1,
         .hacks = 1,
+        .probeinfo = 1,
         // AVPROBE_SCORE_MAX/4 + 1 is the "recommended" limit. Below that, the
         // user is supposed to retry with larger probe sizes until a higher
         // value is reached.
@@ -185,15 +195,23 @@ typedef struct lavf_priv {
     AVFormatContext *avfc;
     bstr init_fragment;
     int64_t stream_pos;
+    int read_size;      // maximum size of the next mp_read() call
     AVIOContext *pb;
     struct sh_stream **streams; // NULL for unknown streams
+    // Streams whose codec is still being probed by libavformat (only if
+    // avformat_find_stream_info() was skipped). Same indexes as streams[].
+    bool *pending_streams;
+    int num_pending;
     int num_streams;
     int cur_program;
+    bool probed_info;   // avformat_find_stream_info() was called
     char *mime_type;
     double seek_delay;
 
     struct demux_lavf_opts *opts;
     double mf_fps;
+
+    struct hls_prefetch *prefetch;
 } lavf_priv_t;
 
 // At least mp4 has name="mov,mp4,m4a,3gp,3g2,mj2", so we split the name
@@ -225,8 +243,12 @@ static int mp_read(void *opaque, uint8_t *buf, int size)
         memcpy(buf, priv->init_fragment.start + priv->stream_pos, ret);
         priv->stream_pos += ret;
     } else {
-        ret = stream_read(stream, buf, size);
+        // Return what's available instead of blocking until the (possibly
+        // large) AVIO buffer is full, which matters for live streams.
+        ret = stream_read_partial(stream, buf, MPMIN(size, priv->read_size));
         priv->stream_pos = priv->init_fragment.len + stream_tell(stream);
+        // Like stream_fill_buffer(): sequential reads get larger.
+        priv->read_size = MPMIN(priv->read_size * 2, priv->opts->buffersize);
     }
 
     MP_TRACE(demuxer, "%d=mp_read(%p, %p, %d), pos: %"PRId64", eof:%d\n",
@@ -234,6 +256,21 @@ static int mp_read(void *opaque, uint8_t *buf, int size)
     return ret;
 }
 
+// Read and discard len bytes. Returns false on EOF or cancellation.
+static bool skip_forward(struct stream *stream, int64_t len)
+{
+    char buf[4096];
+    while (len > 0) {
+        if (mp_cancel_test(stream->cancel))
+            return false;
+        int r = stream_read_partial(stream, buf, MPMIN(len, sizeof(buf)));
+        if (r <= 0)
+            return false;
+        len -= r;
+    }
+    return true;
+}
+
 static int64_t mp_seek(void *opaque, int64_t pos, int whence)
 {
     struct demuxer *demuxer = opaque;
@@ -266,6 +303,19 @@ static int64_t mp_seek(void *opaque, int64_t pos, int whence)
         stream_target = 0; // within init segment - seek real stream to 0
 
     int64_t current_pos = stream_tell(stream);
+
+    // Skip short distances forward by reading. Seeking would discard the
+    // data the stream (or the cache) has already fetched, and might require
+    // a new request for network streams and network filesystems.
+    if (!seek_before && stream_target > current_pos &&
+        stream_target - current_pos <= priv->read_size &&
+        skip_forward(stream, stream_target - current_pos))
+    {
+        priv->stream_pos = pos;
+        return pos;
+    }
+
+    priv->read_size = MPMIN(BIO_BUFFER_SIZE, priv->opts->buffersize);
     if (stream_seek(stream, stream_target) == 0) {
         stream_seek(stream, current_pos);
         return -1;
@@ -542,6 +592,9 @@ static void select_tracks(struct demuxer *demuxer, int start)
         AVStream *st = priv->avfc->streams[n];
         bool selected = stream && demux_stream_is_selected(stream) &&
                         !stream->attached_picture;
+        // Pending streams need packets, or libavformat can't probe them.
+        if (priv->pending_streams[n])
+            selected = true;
         st->discard = selected ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
     }
 }
@@ -601,7 +654,12 @@ static void handle_new_stream(demuxer_t *demuxer, int i)
     AVCodecParameters *codec = st->codecpar;
     int lavc_delay = codec->initial_padding;
 
-    switch (codec->codec_type) {
+    // Without avformat_find_stream_info(), libavformat might only know the
+    // codec after reading some packets. Add the stream once it does.
+    bool pending = !priv->probed_info && codec->codec_id == AV_CODEC_ID_NONE &&
+                   codec->codec_type != AVMEDIA_TYPE_ATTACHMENT;
+
+    switch (pending ? AVMEDIA_TYPE_UNKNOWN : codec->codec_type) {
     case AVMEDIA_TYPE_AUDIO: {
         sh = demux_alloc_sh_stream(STREAM_AUDIO);
 
@@ -688,8 +746,18 @@ static void handle_new_stream(demuxer_t *demuxer, int i)
     default: ;
     }
 
-    assert(priv->num_streams == i); // directly mapped
-    MP_TARRAY_APPEND(priv, priv->streams, priv->num_streams, sh);
+    assert(i <= priv->num_streams); // directly mapped
+    if (i == priv->num_streams) {
+        MP_TARRAY_GROW(priv, priv->pending_streams, priv->num_streams);
+        priv->pending_streams[i] = false;
+        MP_TARRAY_APPEND(priv, priv->streams, priv->num_streams, sh);
+    } else {
+        priv->streams[i] = sh;
+    }
+    if (priv->pending_streams[i] != pending) {
+        priv->pending_streams[i] = pending;
+        priv->num_pending += pending ? 1 : -1;
+    }
 
     if (sh) {
         sh->ff_index = st->index;
@@ -728,10 +796,19 @@ static void handle_new_stream(demuxer_t *demuxer, int i)
     select_tracks(demuxer, i);
 }
 
-// Add any new streams that might have been added
+// Add any new streams that might have been added, and pending streams whose
+// codec is known now
 static void add_new_streams(demuxer_t *demuxer)
 {
     lavf_priv_t *priv = demuxer->priv;
+    for (int n = 0; n < priv->num_streams && priv->num_pending; n++) {
+        if (priv->pending_streams[n] &&
+            priv->avfc->streams[n]->codecpar->codec_id != AV_CODEC_ID_NONE)
+        {
+            MP_VERBOSE(demuxer, "Codec of stream %d detected.\n", n);
+            handle_new_stream(demuxer, n);
+        }
+    }
     while (priv->num_streams < priv->avfc->nb_streams)
         handle_new_stream(demuxer, priv->num_streams);
 }
@@ -771,6 +848,21 @@ static int block_io_open(struct AVFormatContext *s, AVIOContext **pb,
     return AVERROR(EACCES);
 }
 
+static int prefetch_io_open(struct AVFormatContext *s, AVIOContext **pb,
+                            const char *url, int flags, AVDictionary **options)
+{
+    struct demuxer *demuxer = s->opaque;
+    lavf_priv_t *priv = demuxer->priv;
+    return hls_prefetch_io_open(priv->prefetch, s, pb, url, flags, options);
+}
+
+static void prefetch_io_close(struct AVFormatContext *s, AVIOContext *pb)
+{
+    struct demuxer *demuxer = s->opaque;
+    lavf_priv_t *priv = demuxer->priv;
+    hls_prefetch_io_close(priv->prefetch, s, pb);
+}
+
 static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 {
     AVFormatContext *avfc;
@@ -840,6 +932,7 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
         void *buffer = av_malloc(lavfdopts->buffersize);
         if (!buffer)
             return -1;
+        priv->read_size = MPMIN(BIO_BUFFER_SIZE, lavfdopts->buffersize);
         priv->pb = avio_alloc_context(buffer, lavfdopts->buffersize, 0,
                                       demuxer, mp_read, NULL, mp_seek);
         if (!priv->pb) {
@@ -873,8 +966,16 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     };
 
     avfc->opaque = demuxer;
-    if (!demuxer->access_references)
+    if (!demuxer->access_references) {
         avfc->io_open = block_io_open;
+    } else if (lavfdopts->hls_prefetch && matches_avinputformat_name(priv, "hls")) {
+        priv->prefetch = hls_prefetch_create(priv, demuxer->log, avfc,
+                                             lavfdopts->hls_prefetch);
+        if (priv->prefetch) {
+            avfc->io_open = prefetch_io_open;
+            avfc->io_close = prefetch_io_close;
+        }
+    }
 
     mp_set_avdict(&dopts, lavfdopts->avopts);
 
@@ -889,15 +990,20 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 
     priv->avfc = avfc;
 
-    if (!demuxer->params || !demuxer->params->skip_lavf_probing) {
+    bool probe_info = lavfdopts->probeinfo == 1 ||
+                      (lavfdopts->probeinfo == -2 && !avfc->nb_streams);
+    if (demuxer->params && demuxer->params->skip_lavf_probing)
+        probe_info = false;
+    if (probe_info) {
         if (avformat_find_stream_info(avfc, NULL) < 0) {
             MP_ERR(demuxer, "av_find_stream_info() failed\n");
             return -1;
         }
-    }
 
-    MP_VERBOSE(demuxer, "avformat_find_stream_info() finished after %"PRId64
-               " bytes.\n", stream_tell(priv->stream));
+        MP_VERBOSE(demuxer, "avformat_find_stream_info() finished after %"PRId64
+                   " bytes.\n", stream_tell(priv->stream));
+    }
+    priv->probed_info = probe_info;
 
     for (int i = 0; i < avfc->nb_chapters; i++) {
         AVChapter *c = avfc->chapters[i];
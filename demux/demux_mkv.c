@@ -25,12 +25,18 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <math.h>
+#include <limits.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
 #include <libavutil/intreadwrite.h>
+#include <libavutil/intfloat.h>
 #include <libavutil/avstring.h>
+#include <libavutil/md5.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>
@@ -45,6 +51,8 @@
 #include "common/av_common.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "misc/bstr.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
@@ -160,7 +168,8 @@ struct block_info {
     int64_t timecode;
     mkv_track_t *track;
     bstr data;
-    void *alloc;
+    AVBufferRef *buf;   // refcounted allocation that contains data
+    bool mapped;        // buf is the file mapping (all of data is padded)
     int64_t filepos;
     struct ebml_block_additions *additions;
 };
@@ -203,6 +212,12 @@ typedef struct mkv_demuxer {
 
     bool index_has_durations;
 
+    // Sidecar index cache file (NULL if not used), and the index state that
+    // was loaded from it (used to avoid rewriting an unchanged file).
+    char *index_cache_file;
+    size_t index_cache_entries;
+    double index_cache_duration;
+
     bool eof_warning, keyframe_warning;
 
     struct block_info tmp_block;
@@ -215,6 +230,7 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     int probe_start_time;
+    int index_cache;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -228,6 +244,7 @@ const struct m_sub_options demux_mkv_conf = {
         OPT_CHOICE("probe-video-duration", probe_duration, 0,
                    ({"no", 0}, {"yes", 1}, {"full", 2})),
         OPT_FLAG("probe-start-time", probe_start_time, 0),
+        OPT_FLAG("index-cache", index_cache, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -854,6 +871,170 @@ done:
     return 0;
 }
 
+#define INDEX_CACHE_DIR "mkv_index"
+#define INDEX_CACHE_MAGIC "mpvmkvi1"
+#define INDEX_CACHE_HEADER_SIZE (8 + 8 + 8 + 4)
+#define INDEX_CACHE_ENTRY_SIZE (4 + 8 + 8 + 8)
+
+// Return the name of the sidecar index file for the current file, or NULL if
+// the file can't be identified reliably. The name is derived from the
+// absolute path, the file size, and the modification time, so that changed
+// files never use a stale index.
+static char *get_index_cache_filename(struct demuxer *demuxer)
+{
+    struct stream *s = demuxer->stream;
+    if (s->underlying)
+        s = s->underlying;
+    if (!s->is_local_file || !s->path)
+        return NULL;
+
+    void *tmp = talloc_new(NULL);
+    char *res = NULL;
+    char *cwd = mp_getcwd(tmp);
+    if (!cwd)
+        goto done;
+    char *path = mp_path_join(tmp, cwd, s->path);
+
+    struct stat st;
+    if (stat(path, &st))
+        goto done;
+
+    char *key = talloc_asprintf(tmp, "%s\n%lld\n%lld", path,
+                                (long long)st.st_size, (long long)st.st_mtime);
+    uint8_t md5[16];
+    av_md5_sum(md5, key, strlen(key));
+    char *name = talloc_strdup(tmp, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+
+    char *dir = mp_find_user_config_file(tmp, demuxer->global, INDEX_CACHE_DIR);
+    if (dir)
+        res = mp_path_join(NULL, dir, name);
+
+done:
+    talloc_free(tmp);
+    return res;
+}
+
+static mkv_track_t *find_track_by_num(struct mkv_demuxer *d, int n)
+{
+    for (int i = 0; i < d->num_tracks; i++) {
+        if (d->tracks[i]->tnum == n)
+            return d->tracks[i];
+    }
+    return NULL;
+}
+
+// Load the incremental index built during previous playback (only used for
+// files without Cues). On success, the index is merged as if it had been
+// built by add_block_position().
+static void load_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (!mkv_d->index_cache_file)
+        return;
+
+    FILE *f = fopen(mkv_d->index_cache_file, "rb");
+    if (!f)
+        return;
+
+    uint8_t *data = NULL;
+    uint8_t hdr[INDEX_CACHE_HEADER_SIZE];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr, INDEX_CACHE_MAGIC, 8) != 0)
+        goto error;
+    int64_t tc_scale = AV_RL64(hdr + 8);
+    double duration = av_int2double(AV_RL64(hdr + 16));
+    uint32_t num = AV_RL32(hdr + 24);
+    if (tc_scale != mkv_d->tc_scale || num > INT_MAX / INDEX_CACHE_ENTRY_SIZE)
+        goto error;
+
+    data = talloc_size(NULL, (size_t)num * INDEX_CACHE_ENTRY_SIZE);
+    if (num && fread(data, num * INDEX_CACHE_ENTRY_SIZE, 1, f) != 1)
+        goto error;
+
+    int64_t size = stream_get_size(demuxer->stream);
+    mkv_d->num_indexes = 0;
+    for (int n = 0; n < mkv_d->num_tracks; n++)
+        mkv_d->tracks[n]->last_index_entry = (size_t)-1;
+    for (uint32_t n = 0; n < num; n++) {
+        uint8_t *e = data + n * INDEX_CACHE_ENTRY_SIZE;
+        mkv_track_t *track = find_track_by_num(mkv_d, AV_RL32(e));
+        uint64_t filepos = AV_RL64(e + 20);
+        if (!track || (size >= 0 && filepos >= size))
+            goto error;
+        add_block_position(demuxer, track, filepos, AV_RL64(e + 4),
+                           AV_RL64(e + 12));
+    }
+
+    mkv_d->index_cache_entries = mkv_d->num_indexes;
+    mkv_d->index_cache_duration = duration;
+    if (mkv_d->duration <= 0 && duration > 0)
+        mkv_d->duration = duration;
+
+    MP_VERBOSE(demuxer, "Loaded %zu index entries from %s\n",
+               mkv_d->num_indexes, mkv_d->index_cache_file);
+    talloc_free(data);
+    fclose(f);
+    return;
+
+error:
+    MP_WARN(demuxer, "Ignoring invalid index cache file %s\n",
+            mkv_d->index_cache_file);
+    mkv_d->num_indexes = 0;
+    mkv_d->index_has_durations = false;
+    for (int n = 0; n < mkv_d->num_tracks; n++)
+        mkv_d->tracks[n]->last_index_entry = (size_t)-1;
+    talloc_free(data);
+    fclose(f);
+}
+
+static void save_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (!mkv_d->index_cache_file || mkv_d->index_complete)
+        return;
+    if (mkv_d->num_indexes <= mkv_d->index_cache_entries &&
+        mkv_d->duration == mkv_d->index_cache_duration)
+        return;
+
+    mp_mk_config_dir(demuxer->global, INDEX_CACHE_DIR);
+
+    size_t size = INDEX_CACHE_HEADER_SIZE +
+                  mkv_d->num_indexes * INDEX_CACHE_ENTRY_SIZE;
+    uint8_t *data = talloc_size(NULL, size);
+    memcpy(data, INDEX_CACHE_MAGIC, 8);
+    AV_WL64(data + 8, mkv_d->tc_scale);
+    AV_WL64(data + 16, av_double2int(mkv_d->duration));
+    AV_WL32(data + 24, mkv_d->num_indexes);
+    for (size_t n = 0; n < mkv_d->num_indexes; n++) {
+        mkv_index_t *index = &mkv_d->indexes[n];
+        uint8_t *e = data + INDEX_CACHE_HEADER_SIZE + n * INDEX_CACHE_ENTRY_SIZE;
+        AV_WL32(e, index->tnum);
+        AV_WL64(e + 4, index->timecode);
+        AV_WL64(e + 12, index->duration);
+        AV_WL64(e + 20, index->filepos);
+    }
+
+    // Write to a temporary file first, so that concurrent readers never see
+    // a partially written index.
+    char *tmpname = talloc_asprintf(data, "%s.tmp", mkv_d->index_cache_file);
+    FILE *f = fopen(tmpname, "wb");
+    if (f) {
+        bool ok = fwrite(data, size, 1, f) == 1;
+        ok &= fclose(f) == 0;
+        if (ok && rename(tmpname, mkv_d->index_cache_file) == 0) {
+            MP_VERBOSE(demuxer, "Wrote %zu index entries to %s\n",
+                       mkv_d->num_indexes, mkv_d->index_cache_file);
+        } else {
+            unlink(tmpname);
+        }
+    }
+    talloc_free(data);
+}
+
 static int demux_mkv_read_chapters(struct demuxer *demuxer)
 {
     mkv_demuxer_t *mkv_d = demuxer->priv;
@@ -1083,34 +1264,109 @@ static void process_tags(demuxer_t *demuxer)
     }
 }
 
+// Read an AttachedFile element (the ID was already read). If data_file is
+// set, the attachment data is not read, but referenced by its file position.
+static int read_attached_file(demuxer_t *demuxer, int64_t parent_end,
+                              char *data_file)
+{
+    stream_t *s = demuxer->stream;
+    void *tmp = talloc_new(NULL);
+    int res = -1;
+
+    uint64_t len = ebml_read_length(s);
+    int64_t end = stream_tell(s);
+    if (len == EBML_UINT_INVALID || len > parent_end - end)
+        goto done;
+    end += len;
+
+    char *name = NULL, *mime = NULL;
+    int64_t data_pos = -1;
+    uint64_t data_len = 0;
+    void *data = NULL;
+    while (stream_tell(s) < end && !s->eof) {
+        uint32_t id = ebml_read_id(s);
+        uint64_t elem_len = ebml_read_length(s);
+        int64_t elem_pos = stream_tell(s);
+        if (elem_len == EBML_UINT_INVALID || elem_len > end - elem_pos)
+            goto done;
+        switch (id) {
+        case MATROSKA_ID_FILENAME:
+        case MATROSKA_ID_FILEMIMETYPE: {
+            if (elem_len > 4096)
+                break;
+            char *str = talloc_zero_size(tmp, elem_len + 1);
+            if (stream_read(s, str, elem_len) != elem_len)
+                goto done;
+            if (id == MATROSKA_ID_FILENAME) {
+                name = str;
+            } else {
+                mime = str;
+            }
+            break;
+        }
+        case MATROSKA_ID_FILEDATA:
+            if (elem_len > UINT_MAX)
+                break;
+            data_pos = elem_pos;
+            data_len = elem_len;
+            if (!data_file) {
+                data = talloc_size(tmp, MPMAX(data_len, 1));
+                if (stream_read(s, data, data_len) != data_len)
+                    goto done;
+            }
+            break;
+        }
+        if (!stream_seek(s, elem_pos + elem_len))
+            goto done;
+    }
+
+    if (!name || !mime || data_pos < 0) {
+        MP_WARN(demuxer, "Malformed attachment\n");
+    } else {
+        if (data_file) {
+            demuxer_add_attachment_ref(demuxer, name, mime, data_file,
+                                       data_pos, data_len);
+        } else {
+            demuxer_add_attachment(demuxer, name, mime, data, data_len);
+        }
+        MP_VERBOSE(demuxer, "Attachment: %s, %s, %"PRIu64" bytes%s\n",
+                   name, mime, data_len, data_file ? " (deferred)" : "");
+    }
+
+    res = stream_seek(s, end) ? 0 : -1;
+done:
+    talloc_free(tmp);
+    return res;
+}
+
 static int demux_mkv_read_attachments(demuxer_t *demuxer)
 {
     stream_t *s = demuxer->stream;
 
     MP_VERBOSE(demuxer, "Parsing attachments...\n");
 
-    struct ebml_attachments attachments = {0};
-    struct ebml_parse_ctx parse_ctx = {demuxer->log};
-    if (ebml_read_element(s, &parse_ctx, &attachments,
-                          &ebml_attachments_desc) < 0)
+    // Fonts in particular can be large, so don't read them into memory if
+    // they can be mapped from the file later.
+    struct stream *src = s->underlying ? s->underlying : s;
+    char *data_file = src->is_local_file ? src->path : NULL;
+
+    uint64_t len = ebml_read_length(s);
+    int64_t end = stream_tell(s);
+    if (len == EBML_UINT_INVALID || len >= INT64_MAX - end)
         return -1;
+    end += len;
 
-    for (int i = 0; i < attachments.n_attached_file; i++) {
-        struct ebml_attached_file *attachment = &attachments.attached_file[i];
-        if (!attachment->file_name || !attachment->file_mime_type
-            || !attachment->n_file_data) {
-            MP_WARN(demuxer, "Malformed attachment\n");
-            continue;
+    while (stream_tell(s) < end && !s->eof) {
+        uint32_t id = ebml_read_id(s);
+        if (id == MATROSKA_ID_ATTACHEDFILE) {
+            if (read_attached_file(demuxer, end, data_file) < 0)
+                return -1;
+        } else {
+            if (ebml_read_skip(demuxer->log, end, s))
+                return -1;
         }
-        char *name = attachment->file_name;
-        char *mime = attachment->file_mime_type;
-        demuxer_add_attachment(demuxer, name, mime, attachment->file_data.start,
-                               attachment->file_data.len);
-        MP_VERBOSE(demuxer, "Attachment: %s, %s, %zu bytes\n",
-                   name, mime, attachment->file_data.len);
     }
 
-    talloc_free(parse_ctx.talloc_ctx);
     return 0;
 }
 
@@ -1261,7 +1517,11 @@ static void add_coverart(struct demuxer *demuxer)
         struct sh_stream *sh = demux_alloc_sh_stream(STREAM_VIDEO);
         sh->demuxer_id = -1 - sh->index; // don't clash with mkv IDs
         sh->codec->codec = codec;
-        sh->attached_picture = new_demux_packet_from(att->data, att->data_size);
+        void *tmp = talloc_new(NULL);
+        void *data = demux_attachment_get_data(tmp, att);
+        if (data)
+            sh->attached_picture = new_demux_packet_from(data, att->data_size);
+        talloc_free(tmp);
         if (sh->attached_picture) {
             sh->attached_picture->pts = 0;
             talloc_steal(sh, sh->attached_picture);
@@ -1999,8 +2259,17 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     add_coverart(demuxer);
     process_tags(demuxer);
 
+    bool has_cues = false;
+    for (int n = 0; n < mkv_d->num_headers; n++)
+        has_cues |= mkv_d->headers[n].id == MATROSKA_ID_CUES;
+    if (mkv_d->opts->index_cache && mkv_d->index_mode == 1 && !has_cues) {
+        mkv_d->index_cache_file = get_index_cache_filename(demuxer);
+        talloc_steal(mkv_d, mkv_d->index_cache_file);
+        load_index_cache(demuxer);
+    }
+
     probe_first_timestamp(demuxer);
-    if (mkv_d->opts->probe_duration)
+    if (mkv_d->opts->probe_duration && !mkv_d->index_cache_duration)
         probe_last_timestamp(demuxer, start_pos);
 
     return 0;
@@ -2177,8 +2446,9 @@ static bool handle_realaudio(demuxer_t *demuxer, mkv_track_t *track,
             goto error;
         // Release all the audio packets
         for (int x = 0; x < sph * w / apk_usize; x++) {
-            dp = new_demux_packet_from(track->audio_buf + x * apk_usize,
-                                        apk_usize);
+            dp = demux_packet_pool_new_from(demuxer->packet_pool,
+                                            track->audio_buf + x * apk_usize,
+                                            apk_usize);
             if (!dp)
                 goto error;
             /* Put timestamp only on packets that correspond to original
@@ -2313,7 +2583,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         int size = dp->len;
         uint8_t *parsed;
         if (libav_parse_wavpack(track, dp->buffer, &parsed, &size) >= 0) {
-            struct demux_packet *new = new_demux_packet_from(parsed, size);
+            struct demux_packet *new =
+                demux_packet_pool_new_from(demuxer->packet_pool, parsed, size);
             if (new) {
                 demux_packet_copy_attribs(new, dp);
                 talloc_free(dp);
@@ -2325,7 +2596,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
 
     if (strcmp(stream->codec->codec, "prores") == 0) {
         size_t newlen = dp->len + 8;
-        struct demux_packet *new = new_demux_packet(newlen);
+        struct demux_packet *new =
+            demux_packet_pool_new(demuxer->packet_pool, newlen);
         if (new) {
             AV_WB32(new->buffer + 0, newlen);
             AV_WB32(new->buffer + 4, MKBETAG('i', 'c', 'p', 'f'));
@@ -2366,7 +2638,8 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
         dp->len -= len;
         dp->pos += len;
         if (size) {
-            struct demux_packet *new = new_demux_packet_from(data, size);
+            struct demux_packet *new =
+                demux_packet_pool_new_from(demuxer->packet_pool, data, size);
             if (!new)
                 break;
             demux_packet_copy_attribs(new, dp);
@@ -2390,9 +2663,9 @@ static void mkv_parse_and_add_packet(demuxer_t *demuxer, mkv_track_t *track,
 
 static void free_block(struct block_info *block)
 {
-    free(block->alloc);
-    block->alloc = NULL;
+    av_buffer_unref(&block->buf);
     block->data = (bstr){0};
+    block->mapped = false;
     talloc_free(block->additions);
     block->additions = NULL;
 }
@@ -2420,13 +2693,27 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     length = ebml_read_length(s);
     if (length > 500000000 || stream_tell(s) + length > (uint64_t)end)
         goto exit;
-    block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
-    if (!block->alloc)
-        goto exit;
-    block->data = (bstr){block->alloc, length};
     block->filepos = stream_tell(s);
-    if (stream_read(s, block->data.start, block->data.len) != block->data.len)
-        goto exit;
+    unsigned char *mapped = NULL;
+    block->buf = demux_read_mapped(demuxer, length,
+                                   MPMAX(AV_LZO_INPUT_PADDING,
+                                         AV_INPUT_BUFFER_PADDING_SIZE),
+                                   &mapped);
+    block->mapped = !!block->buf;
+    if (block->mapped) {
+        block->data = (bstr){mapped, length};
+    } else {
+        // The padding also makes it possible to reference the data of the
+        // last lace directly from a packet (see handle_block()).
+        block->buf = demux_packet_pool_alloc_buffer(demuxer->packet_pool,
+                                        length + AV_LZO_INPUT_PADDING);
+        if (!block->buf)
+            goto exit;
+        block->data = (bstr){block->buf->data, length};
+        if (stream_read(s, block->data.start, block->data.len) != block->data.len)
+            goto exit;
+        memset(block->data.start + block->data.len, 0, AV_LZO_INPUT_PADDING);
+    }
 
     // Parse header of the Block element
     /* first byte(s): track num */
@@ -2531,9 +2818,24 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
             bstr block = bstr_splice(data, 0, lace_size[i]);
             data = bstr_cut(data, lace_size[i]);
 
+            bstr raw = block;
             block = demux_mkv_decode(demuxer->log, track, block, 1);
 
-            demux_packet_t *dp = new_demux_packet_from(block.start, block.len);
+            // If the data was not transformed, and is followed by the padding
+            // of the block buffer only (normally true for the last lace), or
+            // by more file data in the mapping, reference it directly instead
+            // of copying.
+            demux_packet_t *dp;
+            if (block.start == raw.start && (block_info->mapped ||
+                    raw.start + raw.len ==
+                        block_info->data.start + block_info->data.len))
+            {
+                dp = new_demux_packet_from_buf(block_info->buf, block.start,
+                                               block.len);
+            } else {
+                dp = demux_packet_pool_new_from(demuxer->packet_pool,
+                                                block.start, block.len);
+            }
             if (!dp)
                 break;
             dp->keyframe = keyframe;
@@ -2657,7 +2959,7 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
     stream_t *s = demuxer->stream;
 
-    if (mkv_d->tmp_block.alloc) {
+    if (mkv_d->tmp_block.buf) {
         *block = mkv_d->tmp_block;
         mkv_d->tmp_block = (struct block_info){0};
         return 1;
@@ -3102,6 +3404,7 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    save_index_cache(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
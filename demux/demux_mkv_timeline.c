@@ -25,6 +25,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <libavutil/common.h>
 
 #include "osdep/io.h"
@@ -39,6 +40,7 @@
 #include "options/options.h"
 #include "options/path.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/common.h"
 #include "common/playlist.h"
 #include "stream/stream.h"
@@ -160,27 +162,13 @@ static bool has_source_request(struct tl_ctx *ctx,
     return false;
 }
 
-// segment = get Nth segment of a multi-segment file
-static bool check_file_seg(struct tl_ctx *ctx, char *filename, int segment)
+// Check whether the opened demuxer d provides one of the missing sources.
+// Returns 1 if it was added to ctx->sources, 0 if it didn't match (the caller
+// keeps ownership of d), or -1 if it matched but reopening failed (d was
+// freed).
+static int accept_source(struct tl_ctx *ctx, struct demuxer *d, char *filename,
+                          struct demuxer_params *params)
 {
-    bool was_valid = false;
-    struct demuxer_params params = {
-        .force_format = "mkv",
-        .matroska_num_wanted_uids = ctx->num_sources,
-        .matroska_wanted_uids = ctx->uids,
-        .matroska_wanted_segment = segment,
-        .matroska_was_valid = &was_valid,
-        .disable_timeline = true,
-        .disable_cache = true,
-    };
-    struct mp_cancel *cancel = ctx->tl->cancel;
-    if (mp_cancel_test(cancel))
-        return false;
-
-    struct demuxer *d = demux_open_url(filename, &params, cancel, ctx->global);
-    if (!d)
-        return false;
-
     struct matroska_data *m = &d->matroska_data;
 
     for (int i = 1; i < ctx->num_sources; i++) {
@@ -217,18 +205,48 @@ static bool check_file_seg(struct tl_ctx *ctx, char *filename, int segment)
 
             if (stream_wants_cache(d->stream, ctx->opts->stream_cache)) {
                 free_demuxer_and_stream(d);
-                params.disable_cache = false;
-                params.matroska_wanted_uids = ctx->uids; // potentially reallocated, same data
-                d = demux_open_url(filename, &params, cancel, ctx->global);
+                params->disable_cache = false;
+                params->matroska_wanted_uids = ctx->uids; // potentially reallocated, same data
+                params->matroska_num_wanted_uids = ctx->num_sources;
+                d = demux_open_url(filename, params, ctx->tl->cancel,
+                                   ctx->global);
                 if (!d)
-                    return false;
+                    return -1;
             }
 
             ctx->sources[i] = d;
-            return true;
+            return 1;
         }
     }
 
+    return 0;
+}
+
+// segment = get Nth segment of a multi-segment file
+static bool check_file_seg(struct tl_ctx *ctx, char *filename, int segment)
+{
+    bool was_valid = false;
+    struct demuxer_params params = {
+        .force_format = "mkv",
+        .matroska_num_wanted_uids = ctx->num_sources,
+        .matroska_wanted_uids = ctx->uids,
+        .matroska_wanted_segment = segment,
+        .matroska_was_valid = &was_valid,
+        .disable_timeline = true,
+        .disable_cache = true,
+    };
+    struct mp_cancel *cancel = ctx->tl->cancel;
+    if (mp_cancel_test(cancel))
+        return false;
+
+    struct demuxer *d = demux_open_url(filename, &params, cancel, ctx->global);
+    if (!d)
+        return false;
+
+    int r = accept_source(ctx, d, filename, &params);
+    if (r != 0)
+        return r > 0;
+
     free_demuxer_and_stream(d);
     return was_valid;
 }
@@ -250,6 +268,143 @@ static bool missing(struct tl_ctx *ctx)
     return false;
 }
 
+// Maximum number of files opened concurrently when scanning for sources.
+#define MAX_PROBE_THREADS 4
+
+struct probe_ctx {
+    struct tl_ctx *ctx;
+    pthread_mutex_t lock;
+    // Snapshot of the wanted UIDs when probing was started (read-only).
+    struct matroska_segment_uid *uids;
+    int num_uids;
+    // Set for each UID that was found by any probe so far (protected by lock).
+    bool *found;
+};
+
+struct probe_file {
+    struct probe_ctx *p;
+    char *filename;
+    // Segments of the file that matched a wanted UID (in segment order).
+    struct probe_segment {
+        struct demuxer *d;
+        int segment;
+    } *segments;
+    int num_segments;
+};
+
+static bool probe_all_found(struct probe_ctx *p)
+{
+    pthread_mutex_lock(&p->lock);
+    bool all = true;
+    for (int i = 1; i < p->num_uids; i++)
+        all &= p->found[i];
+    pthread_mutex_unlock(&p->lock);
+    return all;
+}
+
+// Run on a worker thread: open all segments of a file, and keep those which
+// might be one of the wanted sources. Matching against the actual ctx state
+// happens later on the calling thread (see find_ordered_chapter_sources()).
+static void probe_file_worker(void *arg)
+{
+    struct probe_file *pf = arg;
+    struct probe_ctx *p = pf->p;
+    struct tl_ctx *ctx = p->ctx;
+    struct mp_cancel *cancel = ctx->tl->cancel;
+
+    for (int segment = 0; ; segment++) {
+        if (mp_cancel_test(cancel) || probe_all_found(p))
+            break;
+
+        bool was_valid = false;
+        struct demuxer_params params = {
+            .force_format = "mkv",
+            .matroska_num_wanted_uids = p->num_uids,
+            .matroska_wanted_uids = p->uids,
+            .matroska_wanted_segment = segment,
+            .matroska_was_valid = &was_valid,
+            .disable_timeline = true,
+            .disable_cache = true,
+        };
+        struct demuxer *d = demux_open_url(pf->filename, &params, cancel,
+                                           ctx->global);
+        if (!d)
+            break;
+
+        bool keep = false;
+        pthread_mutex_lock(&p->lock);
+        for (int i = 1; i < p->num_uids; i++) {
+            if (!memcmp(p->uids[i].segment, d->matroska_data.uid.segment, 16)) {
+                p->found[i] = true;
+                keep = true;
+            }
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        if (keep) {
+            struct probe_segment seg = {d, segment};
+            MP_TARRAY_APPEND(pf, pf->segments, pf->num_segments, seg);
+        } else {
+            free_demuxer_and_stream(d);
+            if (!was_valid)
+                break;
+        }
+    }
+}
+
+// Open the given files concurrently on a bounded number of threads, and add
+// the matching sources in the original file order (so the result is the
+// same as with sequential probing). Returns false (and probes nothing) if
+// the threads could not be created.
+static bool probe_files_parallel(struct tl_ctx *ctx, char **filenames,
+                                 int num_filenames)
+{
+    struct mp_thread_pool *pool =
+        mp_thread_pool_create(NULL, MPMIN(num_filenames, MAX_PROBE_THREADS));
+    if (!pool)
+        return false;
+
+    void *tmp = talloc_new(NULL);
+
+    struct probe_ctx *p = talloc_ptrtype(tmp, p);
+    *p = (struct probe_ctx){
+        .ctx = ctx,
+        .uids = talloc_memdup(tmp, ctx->uids,
+                              sizeof(ctx->uids[0]) * ctx->num_sources),
+        .num_uids = ctx->num_sources,
+        .found = talloc_zero_array(tmp, bool, ctx->num_sources),
+    };
+    pthread_mutex_init(&p->lock, NULL);
+
+    struct probe_file *files = talloc_zero_array(tmp, struct probe_file,
+                                                 num_filenames);
+    for (int i = 0; i < num_filenames; i++) {
+        files[i] = (struct probe_file){ .p = p, .filename = filenames[i] };
+        MP_VERBOSE(ctx, "Checking file %s\n", filenames[i]);
+        mp_thread_pool_queue(pool, probe_file_worker, &files[i]);
+    }
+    mp_thread_pool_wait(pool);
+
+    for (int i = 0; i < num_filenames; i++) {
+        struct probe_file *pf = &files[i];
+        for (int n = 0; n < pf->num_segments; n++) {
+            struct demuxer *d = pf->segments[n].d;
+            struct demuxer_params params = {
+                .force_format = "mkv",
+                .matroska_wanted_segment = pf->segments[n].segment,
+                .disable_timeline = true,
+            };
+            if (accept_source(ctx, d, pf->filename, &params) == 0)
+                free_demuxer_and_stream(d);
+        }
+    }
+
+    talloc_free(pool);
+    pthread_mutex_destroy(&p->lock);
+    talloc_free(tmp);
+    return true;
+}
+
 static void find_ordered_chapter_sources(struct tl_ctx *ctx)
 {
     struct MPOpts *opts = ctx->opts;
@@ -281,8 +436,22 @@ static void find_ordered_chapter_sources(struct tl_ctx *ctx)
         check_file(ctx, main_filename, 1);
     }
 
+    // Probe the candidate files concurrently first. Sources that are only
+    // discovered through the files found here (nested ordered editions) are
+    // searched for with the sequential loop below, which is also used if the
+    // probe threads can't be created.
+    bool probed = false;
+    if (num_filenames > 1 && missing(ctx)) {
+        int num_sources = ctx->num_sources;
+        // Sequential probing would find nothing new if no sources were added.
+        probed = probe_files_parallel(ctx, filenames, num_filenames) &&
+                 ctx->num_sources == num_sources;
+    }
+
     int old_source_count;
     do {
+        if (probed)
+            break;
         old_source_count = ctx->num_sources;
         for (int i = 0; i < num_filenames; i++) {
             if (!missing(ctx))
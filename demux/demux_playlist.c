@@ -16,6 +16,7 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <strings.h>
 #include <dirent.h>
@@ -25,6 +26,8 @@
 #include "options/options.h"
 #include "common/msg.h"
 #include "common/playlist.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 #include "options/path.h"
 #include "stream/stream.h"
 #include "osdep/io.h"
@@ -32,6 +35,20 @@
 
 #define PROBE_SIZE (8 * 1024)
 
+struct demux_playlist_opts {
+    int chunk_size;
+};
+
+#define OPT_BASE_STRUCT struct demux_playlist_opts
+
+const struct m_sub_options demux_playlist_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_INTRANGE("chunk-size", chunk_size, 0, 0, INT_MAX),
+        {0}
+    },
+    .size = sizeof(struct demux_playlist_opts),
+};
+
 static bool check_mimetype(struct stream *s, const char *const *list)
 {
     if (s->mime_type) {
@@ -56,6 +73,10 @@ struct pl_parser {
     enum demux_check check_level;
     struct stream *real_stream;
     char *format;
+    bool continuing;    // the header was consumed by a previous chunk
+    int max_entries;    // stop after this many entries (0 = unlimited)
+    int num_entries;
+    int64_t next_offset;
 };
 
 static char *pl_get_line0(struct pl_parser *p)
@@ -76,13 +97,29 @@ static bstr pl_get_line(struct pl_parser *p)
     return bstr0(pl_get_line0(p));
 }
 
+static void pl_add_entry(struct pl_parser *p, struct playlist_entry *e)
+{
+    playlist_add(p->pl, e);
+    p->num_entries++;
+}
+
 static void pl_add(struct pl_parser *p, bstr entry)
 {
     char *s = bstrto0(NULL, entry);
-    playlist_add_file(p->pl, s);
+    pl_add_entry(p, playlist_entry_new(s));
     talloc_free(s);
 }
 
+// Return true if the chunk size was reached. The rest of the file is parsed
+// when the continuation entry added by open_file() is played.
+static bool pl_chunk_full(struct pl_parser *p)
+{
+    if (!p->max_entries || p->num_entries < p->max_entries)
+        return false;
+    p->next_offset = stream_tell(p->s);
+    return true;
+}
+
 static bool pl_eof(struct pl_parser *p)
 {
     return p->error || p->s->eof;
@@ -137,7 +174,9 @@ ok:
             talloc_free(fn);
             e->title = talloc_steal(e, title);
             title = NULL;
-            playlist_add(p->pl, e);
+            pl_add_entry(p, e);
+            if (pl_chunk_full(p))
+                break;
         }
         line = bstr_strip(pl_get_line(p));
     }
@@ -180,10 +219,12 @@ static int parse_ref_init(struct pl_parser *p)
 static int parse_pls(struct pl_parser *p)
 {
     bstr line = {0};
-    while (!line.len && !pl_eof(p))
-        line = bstr_strip(pl_get_line(p));
-    if (bstrcasecmp0(line, "[playlist]") != 0)
-        return -1;
+    if (!p->continuing) {
+        while (!line.len && !pl_eof(p))
+            line = bstr_strip(pl_get_line(p));
+        if (bstrcasecmp0(line, "[playlist]") != 0)
+            return -1;
+    }
     if (p->probing)
         return 0;
     while (!pl_eof(p)) {
@@ -196,6 +237,8 @@ static int parse_pls(struct pl_parser *p)
             if (bstr_startswith0(value, "\"") && bstr_endswith0(value, "\""))
                 value = bstr_splice(value, 1, -1);
             pl_add(p, value);
+            if (pl_chunk_full(p))
+                break;
         }
     }
     return 0;
@@ -213,6 +256,8 @@ static int parse_txt(struct pl_parser *p)
         if (line.len == 0)
             continue;
         pl_add(p, line);
+        if (pl_chunk_full(p))
+            break;
     }
     return 0;
 }
@@ -310,16 +355,18 @@ struct pl_format {
     const char *name;
     int (*parse)(struct pl_parser *p);
     const char *const *mime_types;
+    bool chunked;       // parser supports pl_parser.max_entries
 };
 
 static const struct pl_format formats[] = {
     {"directory", parse_dir},
     {"m3u", parse_m3u,
-     MIME_TYPES("audio/mpegurl", "audio/x-mpegurl", "application/x-mpegurl")},
+     MIME_TYPES("audio/mpegurl", "audio/x-mpegurl", "application/x-mpegurl"),
+     .chunked = true},
     {"ini", parse_ref_init},
     {"pls", parse_pls,
-     MIME_TYPES("audio/x-scpls")},
-    {"txt", parse_txt},
+     MIME_TYPES("audio/x-scpls"), .chunked = true},
+    {"txt", parse_txt, .chunked = true},
 };
 
 static const struct pl_format *probe_pl(struct pl_parser *p)
@@ -371,9 +418,27 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     p->error = false;
     p->s = demuxer->stream;
     p->utf16 = stream_skip_bom(p->s);
-    bool ok = fmt->parse(p) >= 0 && !p->error;
+
+    struct demux_playlist_opts *opts =
+        mp_get_config_group(p, demuxer->global, &demux_playlist_conf);
+    if (fmt->chunked && p->s->seekable)
+        p->max_entries = opts->chunk_size;
+    int64_t offset = demuxer->params ? demuxer->params->playlist_offset : 0;
+    if (offset > 0) {
+        MP_VERBOSE(demuxer, "Continuing playlist at byte %"PRId64".\n", offset);
+        p->continuing = true;
+        if (!stream_seek(p->s, offset))
+            p->error = true;
+    }
+
+    bool ok = !p->error && fmt->parse(p) >= 0 && !p->error;
     if (p->add_base)
         playlist_add_base_path(p->pl, mp_dirname(demuxer->filename));
+    if (ok && p->next_offset > 0 && !pl_eof(p)) {
+        struct playlist_entry *e = playlist_entry_new(demuxer->filename);
+        e->playlist_offset = p->next_offset;
+        playlist_add(p->pl, e);
+    }
     demuxer->playlist = talloc_steal(demuxer, p->pl);
     demuxer->filetype = p->format ? p->format : fmt->name;
     demuxer->fully_read = true;
@@ -22,6 +22,8 @@
 #include <unistd.h>
 #include <string.h>
 
+#include <libavcodec/avcodec.h>
+
 #include "options/m_config.h"
 #include "options/m_option.h"
 
@@ -262,17 +264,30 @@ static int raw_fill_buffer(demuxer_t *demuxer)
     if (demuxer->stream->eof)
         return 0;
 
-    struct demux_packet *dp = new_demux_packet(p->frame_size * p->read_frames);
+    int64_t pos = stream_tell(demuxer->stream);
+    size_t size = p->frame_size * p->read_frames;
+
+    struct demux_packet *dp = NULL;
+    unsigned char *data;
+    struct AVBufferRef *buf =
+        demux_read_mapped(demuxer, size, AV_INPUT_BUFFER_PADDING_SIZE, &data);
+    if (buf) {
+        dp = new_demux_packet_from_buf(buf, data, size);
+        av_buffer_unref(&buf);
+    } else {
+        dp = demux_packet_pool_new(demuxer->packet_pool, size);
+        if (dp) {
+            int len = stream_read(demuxer->stream, dp->buffer, dp->len);
+            demux_packet_shorten(dp, len);
+        }
+    }
     if (!dp) {
         MP_ERR(demuxer, "Can't read packet.\n");
         return 1;
     }
 
-    dp->pos = stream_tell(demuxer->stream);
+    dp->pos = pos;
     dp->pts = (dp->pos  / p->frame_size) / p->frame_rate;
-
-    int len = stream_read(demuxer->stream, dp->buffer, dp->len);
-    demux_packet_shorten(dp, len);
     demux_add_packet(p->sh, dp);
 
     return 1;
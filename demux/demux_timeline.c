@@ -20,6 +20,8 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "osdep/atomic.h"
 
 #include "demux.h"
 #include "timeline.h"
@@ -50,6 +52,27 @@ struct virtual_stream {
     int eos_packets;            // deal with b-frame delay
 };
 
+// Start opening the next lazy segment if the current one ends within this
+// many seconds.
+#define PREFETCH_SECS 5.0
+// Limits for the packets read ahead from the next segment.
+#define PREFETCH_MAX_SECS 2.0
+#define PREFETCH_MAX_BYTES (16 * 1024 * 1024)
+
+// State for opening and reading ahead the next segment on a worker thread.
+// While the work is queued, only the worker accesses the fields below.
+struct prefetch {
+    struct demuxer *timeline;   // the demux_timeline instance (read-only)
+    struct segment *seg;        // target segment (not accessed by worker)
+    struct segment *tmp;        // receives stream_map and demuxer
+    struct demuxer_params params;
+    bool dash;
+    bool *selected;             // snapshot of virtual_stream.selected
+    atomic_bool abort;
+    // Packets read from tmp->d, in demuxing order.
+    struct demux_packet *head, *tail;
+};
+
 struct priv {
     struct timeline *tl;
 
@@ -67,6 +90,13 @@ struct priv {
     // Total number of packets received past end of segment. Used
     // to be clever about determining when to switch segments.
     int eos_packets;
+
+    struct mp_thread_pool *prefetch_pool;
+    struct prefetch *prefetch;  // in progress or finished, not adopted yet
+
+    // Packets read ahead by a prefetch that was adopted by p->current. They
+    // are returned before reading from the segment's demuxer.
+    struct demux_packet *prefetched_head, *prefetched_tail;
 };
 
 static bool target_stream_used(struct segment *seg, int target_index)
@@ -174,6 +204,149 @@ static void reopen_lazy_segments(struct demuxer *demuxer)
     associate_streams(demuxer, p->current);
 }
 
+static void free_packet_list(struct demux_packet **head,
+                             struct demux_packet **tail)
+{
+    while (*head) {
+        struct demux_packet *pkt = *head;
+        *head = pkt->next;
+        talloc_free(pkt);
+    }
+    *tail = NULL;
+}
+
+static void prefetch_worker(void *ctx)
+{
+    struct prefetch *pf = ctx;
+    struct demuxer *demuxer = pf->timeline;
+    struct segment *seg = pf->tmp;
+
+    seg->d = demux_open_url(seg->url, &pf->params, demuxer->stream->cancel,
+                            demuxer->global);
+    if (!seg->d)
+        return;
+    associate_streams(demuxer, seg);
+
+    for (int n = 0; n < seg->num_stream_map; n++) {
+        bool selected = seg->stream_map[n] >= 0 &&
+                        pf->selected[seg->stream_map[n]];
+        demuxer_select_track(seg->d, demux_get_stream(seg->d, n),
+                             MP_NOPTS_VALUE, selected);
+    }
+    if (!pf->dash) {
+        demux_set_ts_offset(seg->d, seg->start - seg->d_start);
+        demux_seek(seg->d, seg->start, SEEK_BACKWARD | SEEK_HR);
+    }
+
+    size_t bytes = 0;
+    while (!atomic_load(&pf->abort) && bytes < PREFETCH_MAX_BYTES) {
+        struct demux_packet *pkt = demux_read_any_packet(seg->d);
+        if (!pkt)
+            break;
+        pkt->next = NULL;
+        if (pf->tail) {
+            pf->tail->next = pkt;
+        } else {
+            pf->head = pkt;
+        }
+        pf->tail = pkt;
+        bytes += pkt->len;
+        if (pkt->pts != MP_NOPTS_VALUE &&
+            pkt->pts >= MPMIN(seg->start + PREFETCH_MAX_SECS, seg->end))
+            break;
+    }
+
+    MP_VERBOSE(demuxer, "prefetched %zu bytes of segment %d\n",
+               bytes, seg->index);
+}
+
+static void start_prefetch(struct demuxer *demuxer, struct segment *seg)
+{
+    struct priv *p = demuxer->priv;
+
+    assert(!p->prefetch);
+
+    struct prefetch *pf = talloc_zero(p, struct prefetch);
+    *pf = (struct prefetch){
+        .timeline = demuxer,
+        .seg = seg,
+        .tmp = talloc_ptrtype(pf, pf->tmp),
+        .params = {
+            .init_fragment = p->tl->init_fragment,
+            .skip_lavf_probing = true,
+        },
+        .dash = p->dash,
+        .selected = talloc_array(pf, bool, p->num_streams),
+    };
+    *pf->tmp = (struct segment){
+        .index = seg->index,
+        .start = seg->start,
+        .end = seg->end,
+        .d_start = seg->d_start,
+        .url = seg->url,
+    };
+    atomic_init(&pf->abort, false);
+    for (int n = 0; n < p->num_streams; n++)
+        pf->selected[n] = p->streams[n].selected;
+
+    MP_VERBOSE(demuxer, "prefetching segment %d\n", seg->index);
+
+    if (!p->prefetch_pool)
+        p->prefetch_pool = mp_thread_pool_create(p, 1);
+    p->prefetch = pf;
+    mp_thread_pool_queue(p->prefetch_pool, prefetch_worker, pf);
+}
+
+// Wait until the prefetch worker is done, and return the prefetch if it is
+// usable for seg. Otherwise, discard it and return NULL.
+static struct prefetch *finish_prefetch(struct demuxer *demuxer,
+                                        struct segment *seg)
+{
+    struct priv *p = demuxer->priv;
+    struct prefetch *pf = p->prefetch;
+
+    if (!pf)
+        return NULL;
+
+    if (pf->seg != seg)
+        atomic_store(&pf->abort, true);
+    mp_thread_pool_wait(p->prefetch_pool);
+    p->prefetch = NULL;
+
+    // The packets are useless if the track selection changed meanwhile.
+    bool usable = pf->seg == seg && pf->tmp->d && !seg->d;
+    for (int n = 0; n < p->num_streams; n++)
+        usable &= pf->selected[n] == p->streams[n].selected;
+
+    if (!usable) {
+        free_packet_list(&pf->head, &pf->tail);
+        if (pf->tmp->d)
+            free_demuxer_and_stream(pf->tmp->d);
+        talloc_free(pf);
+        return NULL;
+    }
+
+    return pf;
+}
+
+// Open and seek the next lazy segment in the background, so that switching to
+// it does not block on network or disk access.
+static void maybe_prefetch(struct demuxer *demuxer, struct demux_packet *pkt)
+{
+    struct priv *p = demuxer->priv;
+    struct segment *cur = p->current;
+
+    if (p->prefetch || !pkt || pkt->pts == MP_NOPTS_VALUE ||
+        pkt->pts < cur->end - PREFETCH_SECS)
+        return;
+
+    if (cur->index + 1 >= p->num_segments)
+        return;
+    struct segment *next = p->segments[cur->index + 1];
+    if (next->lazy && !next->d && next->url)
+        start_prefetch(demuxer, next);
+}
+
 static void switch_segment(struct demuxer *demuxer, struct segment *new,
                            double start_pts, int flags, bool init)
 {
@@ -184,15 +357,31 @@ static void switch_segment(struct demuxer *demuxer, struct segment *new,
 
     MP_VERBOSE(demuxer, "switch to segment %d\n", new->index);
 
+    free_packet_list(&p->prefetched_head, &p->prefetched_tail);
+
+    // A prefetch is only valid for the implicit switch at the segment start.
+    struct prefetch *pf = finish_prefetch(demuxer, init ? new : NULL);
+
     p->current = new;
+    if (pf) {
+        close_lazy_segments(demuxer);
+        new->d = pf->tmp->d;
+        new->stream_map = talloc_steal(new, pf->tmp->stream_map);
+        new->num_stream_map = pf->tmp->num_stream_map;
+        p->prefetched_head = pf->head;
+        p->prefetched_tail = pf->tail;
+        talloc_free(pf);
+    }
     reopen_lazy_segments(demuxer);
     if (!new->d)
         return;
     reselect_streams(demuxer);
-    if (!p->dash)
-        demux_set_ts_offset(new->d, new->start - new->d_start);
-    if (!p->dash || !init)
-        demux_seek(new->d, start_pts, flags);
+    if (!pf) {
+        if (!p->dash)
+            demux_set_ts_offset(new->d, new->start - new->d_start);
+        if (!p->dash || !init)
+            demux_seek(new->d, start_pts, flags);
+    }
 
     for (int n = 0; n < p->num_streams; n++) {
         struct virtual_stream *vs = &p->streams[n];
@@ -233,10 +422,20 @@ static int d_fill_buffer(struct demuxer *demuxer)
     if (!seg || !seg->d)
         return 0;
 
-    struct demux_packet *pkt = demux_read_any_packet(seg->d);
+    struct demux_packet *pkt = p->prefetched_head;
+    if (pkt) {
+        p->prefetched_head = pkt->next;
+        if (!p->prefetched_head)
+            p->prefetched_tail = NULL;
+        pkt->next = NULL;
+    } else {
+        pkt = demux_read_any_packet(seg->d);
+    }
     if (!pkt || pkt->pts >= seg->end)
         p->eos_packets += 1;
 
+    maybe_prefetch(demuxer, pkt);
+
     // Test for EOF. Do this here to properly run into EOF even if other
     // streams are disabled etc. If it somehow doesn't manage to reach the end
     // after demuxing a high (bit arbitrary) number of packets, assume one of
@@ -423,6 +622,8 @@ static void d_close(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
     struct demuxer *master = p->tl->demuxer;
+    finish_prefetch(demuxer, NULL);
+    free_packet_list(&p->prefetched_head, &p->prefetched_tail);
     p->current = NULL;
     close_lazy_segments(demuxer);
     timeline_destroy(p->tl);
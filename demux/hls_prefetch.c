@@ -0,0 +1,667 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Segment prefetching for the libavformat HLS demuxer.
+//
+// libavformat fetches HLS segments one after another, so each of them costs a
+// full request round trip. This hooks the nested I/O of the demuxer: media
+// playlists it opens are read here (and then served to it from memory), which
+// tells us the URLs of the upcoming segments. When the demuxer opens segment
+// i of a playlist, segments i+1..i+N are downloaded into memory in parallel
+// by worker threads. If the demuxer then opens one of them, it's read from
+// memory (while its download may still be running), instead of making a new
+// request.
+//
+// Playlists with byte range segments are not prefetched, and nothing but
+// http(s) URLs is opened by the prefetcher on its own.
+
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <libavutil/opt.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+
+#include "hls_prefetch.h"
+
+#define MAX_THREADS 16
+#define MAX_PLAYLIST_SIZE (16 * 1024 * 1024)
+#define MAX_SEGMENT_SIZE (256 * 1024 * 1024)
+#define READ_CHUNK (64 * 1024)
+#define READER_BUFFER_SIZE (32 * 1024)
+
+enum seg_state {
+    SEG_QUEUED,     // waiting for a worker
+    SEG_LOADING,    // owned by a worker, data is being appended
+    SEG_DONE,
+    SEG_FAILED,
+};
+
+struct playlist {
+    char *url;
+    char **segs;        // absolute segment URLs, in playlist order
+    int num_segs;
+};
+
+struct segment {
+    char *url;
+    struct hls_prefetch *p;
+    struct playlist *pl;    // NULL for media playlists
+    enum seg_state state;
+    atomic_bool cancel;
+    bool removed;           // not in hls_prefetch.segs anymore
+    int refs;               // number of open readers
+    unsigned char *data;
+    int64_t size;
+    // mp_time_us() of download start, first byte and end (0 if not yet)
+    int64_t start, first_byte, end;
+};
+
+struct hls_prefetch {
+    struct mp_log *log;
+    AVFormatContext *avfc;
+    int num_segments;
+
+    int (*io_open)(AVFormatContext *s, AVIOContext **pb, const char *url,
+                   int flags, AVDictionary **options);
+    void (*io_close)(AVFormatContext *s, AVIOContext *pb);
+
+    pthread_t threads[MAX_THREADS];
+    int num_threads;
+    atomic_bool terminate;
+
+    // Protected by lock. The condition is signaled on all state changes.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    AVDictionary *opts;         // as passed to the last nested open
+    struct playlist **playlists;
+    int num_playlists;
+    struct segment **segs;      // queued and prefetched segments, in order
+    int num_segs;
+    int hits, misses;
+};
+
+struct seg_reader {
+    const AVClass *av_class;    // for exporting the "location" AVOption
+    char *location;
+    struct hls_prefetch *p;
+    struct segment *seg;
+    int64_t pos;
+    int64_t waited;             // time spent blocking on the download
+};
+
+static const AVOption reader_options[] = {
+    {"location", "", offsetof(struct seg_reader, location), AV_OPT_TYPE_STRING,
+     .flags = AV_OPT_FLAG_EXPORT},
+    {0}
+};
+
+static const AVClass reader_class = {
+    .class_name = "hls_prefetch",
+    .item_name  = av_default_item_name,
+    .option     = reader_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+// The hls demuxer uses the "location" option of the AVIOContext to resolve
+// relative URLs after redirects, so export it like a real protocol would.
+static void *reader_child_next(void *obj, void *prev)
+{
+    AVIOContext *pb = obj;
+    return prev ? NULL : pb->opaque;
+}
+
+static const AVClass reader_avio_class = {
+    .class_name = "AVIOContext",
+    .item_name  = av_default_item_name,
+    .version    = LIBAVUTIL_VERSION_INT,
+    .child_next = reader_child_next,
+};
+
+static bool is_http(const char *url)
+{
+    return bstr_startswith0(bstr0(url), "http://") ||
+           bstr_startswith0(bstr0(url), "https://");
+}
+
+static bool is_playlist_url(const char *url)
+{
+    bstr path = bstr0(url);
+    path = bstr_splice(path, 0, bstrcspn(path, "?#"));
+    return bstr_endswith0(path, ".m3u8") || bstr_endswith0(path, ".m3u");
+}
+
+// Resolve rel against the playlist URL base. Returns NULL if not possible.
+static char *resolve_url(void *ta_parent, const char *base, bstr rel)
+{
+    if (bstr_find0(rel, "://") >= 0)
+        return bstrto0(ta_parent, rel);
+    bstr b = bstr0(base);
+    b = bstr_splice(b, 0, bstrcspn(b, "?#"));
+    int scheme = bstr_find0(b, "://");
+    if (scheme < 0)
+        return NULL;
+    if (bstr_startswith0(rel, "//")) {
+        return talloc_asprintf(ta_parent, "%.*s:%.*s", scheme, b.start,
+                               BSTR_P(rel));
+    }
+    if (bstr_startswith0(rel, "/")) {
+        int host_end = bstrchr(bstr_cut(b, scheme + 3), '/');
+        if (host_end >= 0)
+            b = bstr_splice(b, 0, scheme + 3 + host_end);
+        return talloc_asprintf(ta_parent, "%.*s%.*s", BSTR_P(b), BSTR_P(rel));
+    }
+    int dir_end = bstrrchr(b, '/');
+    if (dir_end < scheme + 3)
+        return talloc_asprintf(ta_parent, "%.*s/%.*s", BSTR_P(b), BSTR_P(rel));
+    return talloc_asprintf(ta_parent, "%.*s/%.*s", dir_end, b.start,
+                           BSTR_P(rel));
+}
+
+// Called with lock held.
+static void maybe_free_segment(struct segment *seg)
+{
+    if (seg->removed && seg->state != SEG_LOADING && !seg->refs)
+        talloc_free(seg);
+}
+
+// Called with lock held.
+static void remove_segment(struct hls_prefetch *p, struct segment *seg)
+{
+    for (int n = 0; n < p->num_segs; n++) {
+        if (p->segs[n] == seg) {
+            MP_TARRAY_REMOVE_AT(p->segs, p->num_segs, n);
+            break;
+        }
+    }
+    seg->removed = true;
+    if (!seg->refs)
+        atomic_store(&seg->cancel, true);
+    maybe_free_segment(seg);
+}
+
+// Called with lock held.
+static struct segment *find_segment(struct hls_prefetch *p, const char *url)
+{
+    for (int n = 0; n < p->num_segs; n++) {
+        if (strcmp(p->segs[n]->url, url) == 0)
+            return p->segs[n];
+    }
+    return NULL;
+}
+
+// Called with lock held. Returns the index of url in *out_pl, or -1.
+static int find_in_playlists(struct hls_prefetch *p, const char *url,
+                             struct playlist **out_pl)
+{
+    for (int n = 0; n < p->num_playlists; n++) {
+        struct playlist *pl = p->playlists[n];
+        for (int i = 0; i < pl->num_segs; i++) {
+            if (strcmp(pl->segs[i], url) == 0) {
+                *out_pl = pl;
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// Called with lock held. Make the segments following index in pl the only
+// queued/prefetched segments of this playlist.
+static void schedule(struct hls_prefetch *p, struct playlist *pl, int index)
+{
+    int end = MPMIN(index + 1 + p->num_segments, pl->num_segs);
+
+    for (int n = p->num_segs - 1; n >= 0; n--) {
+        struct segment *seg = p->segs[n];
+        if (seg->pl != pl)
+            continue;
+        bool keep = false;
+        for (int i = index + 1; i < end; i++)
+            keep |= strcmp(pl->segs[i], seg->url) == 0;
+        if (!keep)
+            remove_segment(p, seg);
+    }
+
+    for (int i = index + 1; i < end; i++) {
+        const char *url = pl->segs[i];
+        if (!is_http(url) || find_segment(p, url))
+            continue;
+        struct segment *seg = talloc_zero(NULL, struct segment);
+        seg->url = talloc_strdup(seg, url);
+        seg->p = p;
+        seg->pl = pl;
+        seg->state = SEG_QUEUED;
+        MP_TARRAY_APPEND(p, p->segs, p->num_segs, seg);
+    }
+
+    pthread_cond_broadcast(&p->wakeup);
+}
+
+// Called with lock held.
+static void parse_playlist(struct hls_prefetch *p, const char *url, bstr data)
+{
+    struct playlist *pl = NULL;
+    for (int n = 0; n < p->num_playlists; n++) {
+        if (strcmp(p->playlists[n]->url, url) == 0)
+            pl = p->playlists[n];
+    }
+    if (!pl) {
+        pl = talloc_zero(p, struct playlist);
+        pl->url = talloc_strdup(pl, url);
+        MP_TARRAY_APPEND(p, p->playlists, p->num_playlists, pl);
+    }
+
+    void *old = pl->segs;
+    pl->segs = NULL;
+    pl->num_segs = 0;
+
+    bool segment_follows = false;
+    while (data.len) {
+        bstr line = bstr_strip(bstr_getline(data, &data));
+        if (bstr_startswith0(line, "#")) {
+            if (bstr_startswith0(line, "#EXTINF:"))
+                segment_follows = true;
+            if (bstr_startswith0(line, "#EXT-X-BYTERANGE:")) {
+                MP_VERBOSE(p, "Byte range segments, not prefetching.\n");
+                pl->num_segs = 0;
+                break;
+            }
+            continue;
+        }
+        if (line.len && segment_follows) {
+            char *seg_url = resolve_url(pl, url, line);
+            if (seg_url)
+                MP_TARRAY_APPEND(pl, pl->segs, pl->num_segs, seg_url);
+        }
+        segment_follows = false;
+    }
+
+    talloc_free(old);
+    if (pl->segs)
+        talloc_steal(pl, pl->segs);
+}
+
+static int download_interrupt(void *ctx)
+{
+    struct segment *seg = ctx;
+    return atomic_load(&seg->p->terminate) || atomic_load(&seg->cancel);
+}
+
+// Called without lock. The worker owns seg while it's in SEG_LOADING state.
+static void download(struct hls_prefetch *p, struct segment *seg,
+                     unsigned char *buf)
+{
+    AVDictionary *opts = NULL;
+    pthread_mutex_lock(&p->lock);
+    av_dict_copy(&opts, p->opts, 0);
+    pthread_mutex_unlock(&p->lock);
+
+    seg->start = mp_time_us();
+
+    AVIOInterruptCB cb = {download_interrupt, seg};
+    AVIOContext *pb = NULL;
+    int r = avio_open2(&pb, seg->url, AVIO_FLAG_READ, &cb, &opts);
+    av_dict_free(&opts);
+
+    while (r >= 0) {
+        int len = avio_read(pb, buf, READ_CHUNK);
+        if (len <= 0) {
+            r = len == 0 || len == AVERROR_EOF ? 0 : len;
+            break;
+        }
+        pthread_mutex_lock(&p->lock);
+        if (!seg->first_byte)
+            seg->first_byte = mp_time_us();
+        if (seg->size + len > MAX_SEGMENT_SIZE) {
+            r = AVERROR(ENOMEM);
+        } else {
+            seg->data = talloc_realloc_size(seg, seg->data, seg->size + len);
+            memcpy(seg->data + seg->size, buf, len);
+            seg->size += len;
+            pthread_cond_broadcast(&p->wakeup);
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+    avio_closep(&pb);
+
+    pthread_mutex_lock(&p->lock);
+    seg->end = mp_time_us();
+    seg->state = r >= 0 ? SEG_DONE : SEG_FAILED;
+    if (r < 0 && !atomic_load(&seg->cancel) && !atomic_load(&p->terminate)) {
+        char err[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(r, err, sizeof(err));
+        MP_WARN(p, "Prefetching %s failed: %s\n", seg->url, err);
+    }
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *worker_thread(void *arg)
+{
+    struct hls_prefetch *p = arg;
+    mpthread_set_name("hls-prefetch");
+
+    unsigned char *buf = talloc_size(NULL, READ_CHUNK);
+
+    pthread_mutex_lock(&p->lock);
+    while (!atomic_load(&p->terminate)) {
+        struct segment *seg = NULL;
+        for (int n = 0; n < p->num_segs; n++) {
+            if (p->segs[n]->state == SEG_QUEUED) {
+                seg = p->segs[n];
+                break;
+            }
+        }
+        if (!seg) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        seg->state = SEG_LOADING;
+        pthread_mutex_unlock(&p->lock);
+        download(p, seg, buf);
+        pthread_mutex_lock(&p->lock);
+        maybe_free_segment(seg);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    talloc_free(buf);
+    return NULL;
+}
+
+static int reader_read(void *opaque, uint8_t *buf, int size)
+{
+    struct seg_reader *r = opaque;
+    struct hls_prefetch *p = r->p;
+    struct segment *seg = r->seg;
+    AVIOInterruptCB *cb = &p->avfc->interrupt_callback;
+
+    pthread_mutex_lock(&p->lock);
+    while (r->pos >= seg->size && seg->state == SEG_LOADING) {
+        bool interrupted = cb->callback && cb->callback(cb->opaque);
+        if (interrupted || atomic_load(&p->terminate)) {
+            pthread_mutex_unlock(&p->lock);
+            return AVERROR_EXIT;
+        }
+        int64_t wait_start = mp_time_us();
+        struct timespec ts = mp_rel_time_to_timespec(0.05);
+        pthread_cond_timedwait(&p->wakeup, &p->lock, &ts);
+        r->waited += mp_time_us() - wait_start;
+    }
+    int res;
+    if (r->pos < seg->size) {
+        res = MPMIN(size, seg->size - r->pos);
+        memcpy(buf, seg->data + r->pos, res);
+        r->pos += res;
+    } else {
+        res = seg->state == SEG_FAILED ? AVERROR(EIO) : AVERROR_EOF;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return res;
+}
+
+static int64_t reader_seek(void *opaque, int64_t pos, int whence)
+{
+    struct seg_reader *r = opaque;
+    struct hls_prefetch *p = r->p;
+    struct segment *seg = r->seg;
+
+    pthread_mutex_lock(&p->lock);
+    bool known_size = seg->state == SEG_DONE;
+    int64_t res = AVERROR(ENOSYS);
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        if (known_size)
+            res = seg->size;
+        break;
+    case SEEK_SET:
+        res = pos;
+        break;
+    case SEEK_CUR:
+        res = r->pos + pos;
+        break;
+    case SEEK_END:
+        if (known_size)
+            res = seg->size + pos;
+        break;
+    }
+    if ((whence & ~AVSEEK_FORCE) != AVSEEK_SIZE && res != AVERROR(ENOSYS)) {
+        if (res < 0) {
+            res = AVERROR(EINVAL);
+        } else {
+            r->pos = res;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    return res;
+}
+
+// Takes over the reference to seg the caller obtained.
+static int open_reader(struct hls_prefetch *p, AVIOContext **pb,
+                       struct segment *seg)
+{
+    struct seg_reader *r = talloc_zero(NULL, struct seg_reader);
+    r->av_class = &reader_class;
+    r->location = talloc_strdup(r, seg->url);
+    r->p = p;
+    r->seg = seg;
+
+    unsigned char *buffer = av_malloc(READER_BUFFER_SIZE);
+    if (buffer) {
+        *pb = avio_alloc_context(buffer, READER_BUFFER_SIZE, 0, r, reader_read,
+                                 NULL, reader_seek);
+    }
+    if (!buffer || !*pb) {
+        av_free(buffer);
+        talloc_free(r);
+        pthread_mutex_lock(&p->lock);
+        seg->refs--;
+        maybe_free_segment(seg);
+        pthread_mutex_unlock(&p->lock);
+        return AVERROR(ENOMEM);
+    }
+    (*pb)->av_class = &reader_avio_class;
+    (*pb)->seekable = AVIO_SEEKABLE_NORMAL;
+    return 0;
+}
+
+// Read the whole media playlist, remember its segments, and serve it from
+// memory.
+static int open_playlist(struct hls_prefetch *p, AVFormatContext *s,
+                         AVIOContext **pb, const char *url, int flags,
+                         AVDictionary **options)
+{
+    AVIOContext *in = NULL;
+    int r = p->io_open(s, &in, url, flags, options);
+    if (r < 0)
+        return r;
+
+    struct segment *seg = talloc_zero(NULL, struct segment);
+    seg->p = p;
+    seg->state = SEG_DONE;
+    seg->removed = true;
+    seg->refs = 1;
+
+    uint8_t *location = NULL;
+    av_opt_get(in, "location", AV_OPT_SEARCH_CHILDREN, &location);
+    seg->url = talloc_strdup(seg, location ? (char *)location : url);
+    av_free(location);
+
+    unsigned char buf[4096];
+    while (1) {
+        int len = avio_read(in, buf, sizeof(buf));
+        if (len <= 0) {
+            r = len == 0 || len == AVERROR_EOF ? 0 : len;
+            break;
+        }
+        if (seg->size + len > MAX_PLAYLIST_SIZE) {
+            r = AVERROR_INVALIDDATA;
+            break;
+        }
+        seg->data = talloc_realloc_size(seg, seg->data, seg->size + len);
+        memcpy(seg->data + seg->size, buf, len);
+        seg->size += len;
+    }
+    p->io_close(s, in);
+
+    if (r < 0) {
+        talloc_free(seg);
+        return r;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    parse_playlist(p, seg->url, (bstr){seg->data, seg->size});
+    pthread_mutex_unlock(&p->lock);
+
+    return open_reader(p, pb, seg);
+}
+
+int hls_prefetch_io_open(struct hls_prefetch *p, AVFormatContext *s,
+                         AVIOContext **pb, const char *url, int flags,
+                         AVDictionary **options)
+{
+    if (flags & AVIO_FLAG_WRITE)
+        return p->io_open(s, pb, url, flags, options);
+
+    pthread_mutex_lock(&p->lock);
+    // Contains the HTTP headers, cookies etc. the demuxer uses.
+    if (options && *options) {
+        av_dict_free(&p->opts);
+        av_dict_copy(&p->opts, *options, 0);
+    }
+    struct segment *seg = find_segment(p, url);
+    if (seg && seg->state == SEG_QUEUED) {
+        // Not started yet; no point in waiting for a worker.
+        remove_segment(p, seg);
+        seg = NULL;
+    }
+    if (seg) {
+        seg->refs++;
+        p->hits++;
+    }
+    struct playlist *pl = NULL;
+    int index = find_in_playlists(p, url, &pl);
+    if (index >= 0) {
+        if (!seg)
+            p->misses++;
+        schedule(p, pl, index);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (seg) {
+        MP_DBG(p, "Opening prefetched %s\n", url);
+        return open_reader(p, pb, seg);
+    }
+    if (is_playlist_url(url))
+        return open_playlist(p, s, pb, url, flags, options);
+    return p->io_open(s, pb, url, flags, options);
+}
+
+void hls_prefetch_io_close(struct hls_prefetch *p, AVFormatContext *s,
+                           AVIOContext *pb)
+{
+    if (!pb || pb->read_packet != reader_read) {
+        p->io_close(s, pb);
+        return;
+    }
+
+    struct seg_reader *r = pb->opaque;
+    struct segment *seg = r->seg;
+
+    pthread_mutex_lock(&p->lock);
+    if (seg->pl) {
+        if (seg->end) {
+            MP_VERBOSE(p, "Segment %s: %"PRId64" bytes, first byte after "
+                       "%"PRId64" ms, done after %"PRId64" ms, waited "
+                       "%"PRId64" ms\n", seg->url, seg->size,
+                       (seg->first_byte ? seg->first_byte - seg->start : 0) / 1000,
+                       (seg->end - seg->start) / 1000, r->waited / 1000);
+        } else {
+            MP_VERBOSE(p, "Segment %s: closed while loading, waited "
+                       "%"PRId64" ms\n", seg->url, r->waited / 1000);
+        }
+    }
+    seg->refs--;
+    // Never read twice; a reopen after seeking back makes a new request.
+    if (!seg->removed)
+        remove_segment(p, seg);
+    if (!seg->refs)
+        atomic_store(&seg->cancel, true);
+    maybe_free_segment(seg);
+    pthread_mutex_unlock(&p->lock);
+
+    av_freep(&pb->buffer);
+    av_free(pb);
+    talloc_free(r);
+}
+
+static void destroy_prefetch(void *ptr)
+{
+    struct hls_prefetch *p = ptr;
+
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->terminate, true);
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int n = 0; n < p->num_threads; n++)
+        pthread_join(p->threads[n], NULL);
+
+    MP_VERBOSE(p, "%d segments read from prefetched data, %d not.\n",
+               p->hits, p->misses);
+
+    while (p->num_segs)
+        remove_segment(p, p->segs[0]);
+    av_dict_free(&p->opts);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+}
+
+struct hls_prefetch *hls_prefetch_create(void *ta_parent, struct mp_log *log,
+                                         AVFormatContext *avfc,
+                                         int num_segments)
+{
+    struct hls_prefetch *p = talloc_zero(ta_parent, struct hls_prefetch);
+    p->log = mp_log_new(p, log, "hls-prefetch");
+    p->avfc = avfc;
+    p->num_segments = num_segments;
+    p->io_open = avfc->io_open;
+    p->io_close = avfc->io_close;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    atomic_init(&p->terminate, false);
+    talloc_set_destructor(p, destroy_prefetch);
+
+    for (int n = 0; n < MPMIN(num_segments, MAX_THREADS); n++) {
+        if (pthread_create(&p->threads[n], NULL, worker_thread, p))
+            break;
+        p->num_threads++;
+    }
+    if (!p->num_threads) {
+        talloc_free(p);
+        return NULL;
+    }
+
+    MP_VERBOSE(p, "Prefetching up to %d segments.\n", num_segments);
+    return p;
+}
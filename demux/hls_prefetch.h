@@ -0,0 +1,22 @@
+#ifndef MP_DEMUX_HLS_PREFETCH_H_
+#define MP_DEMUX_HLS_PREFETCH_H_
+
+#include <libavformat/avformat.h>
+
+struct mp_log;
+struct hls_prefetch;
+
+// Download up to num_segments HLS media segments ahead of the libavformat hls
+// demuxer. The caller must route avfc->io_open/io_close through the functions
+// below. Must be freed (with talloc) after avformat_close_input().
+struct hls_prefetch *hls_prefetch_create(void *ta_parent, struct mp_log *log,
+                                         AVFormatContext *avfc,
+                                         int num_segments);
+
+int hls_prefetch_io_open(struct hls_prefetch *p, AVFormatContext *s,
+                         AVIOContext **pb, const char *url, int flags,
+                         AVDictionary **options);
+void hls_prefetch_io_close(struct hls_prefetch *p, AVFormatContext *s,
+                           AVIOContext *pb);
+
+#endif
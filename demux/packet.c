@@ -18,20 +18,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
+#include <libavutil/mem.h>
 
 #include "config.h"
 
 #include "common/av_common.h"
 #include "common/common.h"
+#include "common/mem_usage.h"
 
 #include "packet.h"
 
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
+    mp_mem_usage_add(MP_MEM_DEMUX_PACKETS, -(int64_t)dp->avpacket->size);
     av_packet_unref(dp->avpacket);
 }
 
@@ -70,6 +74,7 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
     }
     dp->buffer = dp->avpacket->data;
     dp->len = dp->avpacket->size;
+    mp_mem_usage_add(MP_MEM_DEMUX_PACKETS, dp->len);
     return dp;
 }
 
@@ -110,6 +115,7 @@ void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *sr
     dst->pos = src->pos;
     dst->start = src->start;
     dst->end = src->end;
+    dst->codec = src->codec;
     dst->new_segment = src->new_segment;
     dst->keyframe = src->keyframe;
     dst->stream = src->stream;
@@ -164,3 +170,200 @@ int demux_packet_add_blockadditional(struct demux_packet *dp, uint64_t id,
 #endif
     return 0;
 }
+
+// Size classes: class n holds buffers of (POOL_MIN_SIZE << n) bytes (plus
+// padding). Larger packets bypass the pool.
+#define POOL_MIN_SIZE 1024
+#define POOL_NUM_CLASSES 15
+// Maximum number of unused buffers kept per size class.
+#define POOL_MAX_FREE 32
+// Maximum total size of unused buffers kept.
+#define POOL_MAX_CACHED_BYTES (32 * 1024 * 1024)
+// Space reserved before the actual buffer data to remember the size class.
+// Must keep the alignment av_malloc() guarantees.
+#define POOL_HEADER_SIZE 64
+
+struct demux_packet_pool {
+    pthread_mutex_t lock;
+    // Owner reference + 1 reference per outstanding buffer. The pool is
+    // destroyed when this reaches 0, so buffers can outlive the demuxer.
+    int refcount;
+    // Set by demux_packet_pool_release(); unused buffers are not cached
+    // anymore once the owner is gone.
+    bool released;
+    void *free_bufs[POOL_NUM_CLASSES][POOL_MAX_FREE];
+    int num_free[POOL_NUM_CLASSES];
+    struct demux_packet_pool_stats stats;
+};
+
+struct demux_packet_pool *demux_packet_pool_create(void)
+{
+    struct demux_packet_pool *pool = talloc_zero(NULL, struct demux_packet_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->refcount = 1;
+    return pool;
+}
+
+static void pool_drop_free_buffers(struct demux_packet_pool *pool)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        for (int n = 0; n < pool->num_free[c]; n++) {
+            av_free(pool->free_bufs[c][n]);
+            pool->stats.cached_bytes -= POOL_MIN_SIZE << c;
+        }
+        pool->num_free[c] = 0;
+    }
+}
+
+// Call with pool->lock held; unlocks it.
+static void pool_unref_unlock(struct demux_packet_pool *pool)
+{
+    bool destroy = --pool->refcount == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (destroy) {
+        pool_drop_free_buffers(pool);
+        pthread_mutex_destroy(&pool->lock);
+        talloc_free(pool);
+    }
+}
+
+// Drop the owner reference. Buffers still referenced by packets stay valid,
+// and are freed normally once the last packet using them is freed.
+void demux_packet_pool_release(struct demux_packet_pool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->released = true;
+    pool_drop_free_buffers(pool);
+    pool_unref_unlock(pool);
+}
+
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_buffer_free(void *opaque, uint8_t *data)
+{
+    struct demux_packet_pool *pool = opaque;
+    uint8_t *base = data - POOL_HEADER_SIZE;
+    int c = base[0];
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.used_bytes -= POOL_MIN_SIZE << c;
+    // Only recycle while the owner exists.
+    if (!pool->released && pool->num_free[c] < POOL_MAX_FREE &&
+        pool->stats.cached_bytes + (POOL_MIN_SIZE << c) <= POOL_MAX_CACHED_BYTES)
+    {
+        pool->free_bufs[c][pool->num_free[c]++] = base;
+        pool->stats.cached_bytes += POOL_MIN_SIZE << c;
+        base = NULL;
+    }
+    pool_unref_unlock(pool);
+    av_free(base);
+}
+
+// Allocate a refcounted buffer with at least len bytes, followed by
+// AV_INPUT_BUFFER_PADDING_SIZE zeroed padding bytes. The buffer is taken from
+// the pool if possible. (pool can be NULL.)
+// The returned AVBufferRef's size includes the padding.
+struct AVBufferRef *demux_packet_pool_alloc_buffer(struct demux_packet_pool *pool,
+                                                   size_t len)
+{
+    if (len > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE - POOL_HEADER_SIZE)
+        return NULL;
+
+    if (!pool || len > (POOL_MIN_SIZE << (POOL_NUM_CLASSES - 1))) {
+        AVBufferRef *buf = av_buffer_alloc(len + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (buf)
+            memset(buf->data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        return buf;
+    }
+
+    int c = 0;
+    while ((POOL_MIN_SIZE << c) < len)
+        c++;
+    size_t size = POOL_MIN_SIZE << c;
+
+    pthread_mutex_lock(&pool->lock);
+    uint8_t *base = NULL;
+    if (pool->num_free[c]) {
+        base = pool->free_bufs[c][--pool->num_free[c]];
+        pool->stats.cached_bytes -= size;
+        pool->stats.hits++;
+    } else {
+        pool->stats.misses++;
+    }
+    pool->stats.used_bytes += size;
+    pool->refcount++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!base)
+        base = av_malloc(POOL_HEADER_SIZE + size + AV_INPUT_BUFFER_PADDING_SIZE);
+    AVBufferRef *buf = NULL;
+    if (base) {
+        base[0] = c;
+        buf = av_buffer_create(base + POOL_HEADER_SIZE,
+                               size + AV_INPUT_BUFFER_PADDING_SIZE,
+                               pool_buffer_free, pool, 0);
+    }
+    if (!buf) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stats.used_bytes -= size;
+        pool_unref_unlock(pool);
+        av_free(base);
+        return NULL;
+    }
+
+    memset(buf->data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return buf;
+}
+
+// Create a packet that references the data range [data, data + len) within
+// buf, without copying. The caller must make sure that buf contains at least
+// AV_INPUT_BUFFER_PADDING_SIZE readable bytes after the range.
+struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf,
+                                               void *data, size_t len)
+{
+    if (len > INT_MAX)
+        return NULL;
+    assert((uint8_t *)data >= buf->data &&
+           (uint8_t *)data + len + AV_INPUT_BUFFER_PADDING_SIZE <=
+                buf->data + buf->size);
+    AVPacket pkt = {
+        .buf = buf,
+        .data = data,
+        .size = len,
+    };
+    return new_demux_packet_from_avpacket(&pkt);
+}
+
+// Like new_demux_packet(), but take the packet data from the pool. If pool is
+// NULL, or the packet is too large, this falls back to new_demux_packet().
+struct demux_packet *demux_packet_pool_new(struct demux_packet_pool *pool,
+                                           size_t len)
+{
+    if (!pool)
+        return new_demux_packet(len);
+
+    AVBufferRef *buf = demux_packet_pool_alloc_buffer(pool, len);
+    if (!buf)
+        return NULL;
+    struct demux_packet *dp = new_demux_packet_from_buf(buf, buf->data, len);
+    av_buffer_unref(&buf);
+    return dp;
+}
+
+// Like new_demux_packet_from(), but see demux_packet_pool_new().
+struct demux_packet *demux_packet_pool_new_from(struct demux_packet_pool *pool,
+                                                void *data, size_t len)
+{
+    struct demux_packet *dp = demux_packet_pool_new(pool, len);
+    if (dp)
+        memcpy(dp->buffer, data, len);
+    return dp;
+}
@@ -48,12 +48,36 @@ typedef struct demux_packet {
 struct demux_packet *new_demux_packet(size_t len);
 struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
+struct AVBufferRef;
+struct demux_packet *new_demux_packet_from_buf(struct AVBufferRef *buf,
+                                               void *data, size_t len);
 void demux_packet_shorten(struct demux_packet *dp, size_t len);
 void free_demux_packet(struct demux_packet *dp);
 struct demux_packet *demux_copy_packet(struct demux_packet *dp);
 
 void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *src);
 
+// Recycles packet data buffers in a number of size classes.
+struct demux_packet_pool;
+
+struct demux_packet_pool_stats {
+    int64_t hits;           // allocations served from recycled buffers
+    int64_t misses;         // allocations that had to allocate new memory
+    int64_t used_bytes;     // size of buffers currently referenced by packets
+    int64_t cached_bytes;   // size of unused buffers kept for reuse
+};
+
+struct demux_packet_pool *demux_packet_pool_create(void);
+void demux_packet_pool_release(struct demux_packet_pool *pool);
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *stats);
+struct AVBufferRef *demux_packet_pool_alloc_buffer(struct demux_packet_pool *pool,
+                                                   size_t len);
+struct demux_packet *demux_packet_pool_new(struct demux_packet_pool *pool,
+                                           size_t len);
+struct demux_packet *demux_packet_pool_new_from(struct demux_packet_pool *pool,
+                                                void *data, size_t len);
+
 int demux_packet_set_padding(struct demux_packet *dp, int start, int end);
 int demux_packet_add_blockadditional(struct demux_packet *dp, uint64_t id,
                                      void *data, size_t size);
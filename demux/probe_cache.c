@@ -0,0 +1,159 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Remembers which demuxer opened a given file, so that reopening it does not
+// need to probe all demuxers again.
+//
+// The cache is a text file with one entry per line, most recently used last:
+//      <demuxer> <tab> <lavf format or "-"> <tab> <check level> <tab> <key>
+// The key is the rest of the line, and must not contain line breaks.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+#include "options/path.h"
+#include "osdep/io.h"
+
+#include "probe_cache.h"
+
+#define PROBE_CACHE_FILE "demux_probe_cache"
+#define PROBE_CACHE_MAX_ENTRIES 500
+#define PROBE_CACHE_MAX_SIZE (1024 * 1024)
+
+// Serializes file accesses between demuxers opened concurrently.
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Return the entire file, or an empty string if it doesn't exist.
+static bstr read_cache_file(void *ta_ctx, const char *filename)
+{
+    bstr res = {0};
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return res;
+    char *buf = talloc_size(ta_ctx, PROBE_CACHE_MAX_SIZE);
+    size_t len = fread(buf, 1, PROBE_CACHE_MAX_SIZE, f);
+    fclose(f);
+    return (bstr){buf, len};
+}
+
+// Split a cache line into its entry and key. Returns false on garbage.
+static bool parse_line(void *ta_ctx, bstr line, struct demux_probe_entry *e,
+                       bstr *key)
+{
+    bstr name, format, check, rest;
+    if (!bstr_split_tok(line, "\t", &name, &rest) ||
+        !bstr_split_tok(rest, "\t", &format, &rest) ||
+        !bstr_split_tok(rest, "\t", &check, key))
+        return false;
+    if (!name.len || !format.len || !key->len)
+        return false;
+    *e = (struct demux_probe_entry){
+        .demuxer = bstrto0(ta_ctx, name),
+        .lavf_format = bstr_equals0(format, "-") ? NULL : bstrto0(ta_ctx, format),
+        .check = bstrtoll(check, NULL, 10),
+    };
+    return true;
+}
+
+// Look up the demuxer that previously opened a file with the given key.
+// Strings in *out are allocated with ta_ctx.
+bool demux_probe_cache_lookup(void *ta_ctx, struct mpv_global *global,
+                              const char *key, struct demux_probe_entry *out)
+{
+    void *tmp = talloc_new(NULL);
+    bool found = false;
+
+    char *filename = mp_find_user_config_file(tmp, global, PROBE_CACHE_FILE);
+    if (!filename)
+        goto done;
+
+    pthread_mutex_lock(&cache_lock);
+    bstr data = read_cache_file(tmp, filename);
+    pthread_mutex_unlock(&cache_lock);
+
+    // Later entries replace earlier ones with the same key.
+    while (data.len) {
+        bstr line = bstr_strip_linebreaks(bstr_getline(data, &data));
+        struct demux_probe_entry e;
+        bstr line_key;
+        if (parse_line(tmp, line, &e, &line_key) && bstr_equals0(line_key, key))
+        {
+            *out = (struct demux_probe_entry){
+                .demuxer = talloc_strdup(ta_ctx, e.demuxer),
+                .lavf_format = talloc_strdup(ta_ctx, e.lavf_format),
+                .check = e.check,
+            };
+            found = true;
+        }
+    }
+
+done:
+    talloc_free(tmp);
+    return found;
+}
+
+// Add or replace (entry!=NULL) or remove (entry==NULL) the entry for key.
+void demux_probe_cache_store(struct mpv_global *global, const char *key,
+                             const struct demux_probe_entry *entry)
+{
+    if (strchr(key, '\n') || strchr(key, '\r'))
+        return;
+
+    void *tmp = talloc_new(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+
+    char *filename = mp_find_user_config_file(tmp, global, PROBE_CACHE_FILE);
+    if (!filename)
+        goto done;
+    mp_mk_config_dir(global, "");
+
+    bstr data = read_cache_file(tmp, filename);
+
+    bstr *lines = NULL;
+    int num_lines = 0;
+    while (data.len) {
+        bstr line = bstr_strip_linebreaks(bstr_getline(data, &data));
+        struct demux_probe_entry e;
+        bstr line_key;
+        if (parse_line(tmp, line, &e, &line_key) && !bstr_equals0(line_key, key))
+            MP_TARRAY_APPEND(tmp, lines, num_lines, line);
+    }
+
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", filename);
+    FILE *f = fopen(tmpname, "wb");
+    if (!f)
+        goto done;
+    int first = MPMAX(0, num_lines + (entry ? 1 : 0) - PROBE_CACHE_MAX_ENTRIES);
+    for (int n = first; n < num_lines; n++)
+        fprintf(f, "%.*s\n", BSTR_P(lines[n]));
+    if (entry) {
+        fprintf(f, "%s\t%s\t%d\t%s\n", entry->demuxer,
+                entry->lavf_format ? entry->lavf_format : "-", entry->check, key);
+    }
+    bool ok = fclose(f) == 0;
+    if (!ok || rename(tmpname, filename) != 0)
+        unlink(tmpname);
+
+done:
+    pthread_mutex_unlock(&cache_lock);
+    talloc_free(tmp);
+}
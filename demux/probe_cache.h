@@ -0,0 +1,19 @@
+#ifndef MP_DEMUX_PROBE_CACHE_H_
+#define MP_DEMUX_PROBE_CACHE_H_
+
+#include <stdbool.h>
+
+struct mpv_global;
+
+struct demux_probe_entry {
+    char *demuxer;          // demuxer_desc.name
+    char *lavf_format;      // AVInputFormat.name for demux_lavf, or NULL
+    int check;              // enum demux_check level the demuxer accepted
+};
+
+bool demux_probe_cache_lookup(void *ta_ctx, struct mpv_global *global,
+                              const char *key, struct demux_probe_entry *out);
+void demux_probe_cache_store(struct mpv_global *global, const char *key,
+                             const struct demux_probe_entry *entry);
+
+#endif
@@ -76,6 +76,7 @@ const struct mp_cmd_def mp_cmds[] = {
   { MP_CMD_REVERT_SEEK, "revert-seek", {
       OARG_FLAGS(0, ({"mark", 1})),
   }},
+  { MP_CMD_SCRUB, "scrub", { ARG_CHOICE(({"start", 1}, {"stop", 0})) } },
   { MP_CMD_QUIT, "quit", { OARG_INT(0) } },
   { MP_CMD_QUIT_WATCH_LATER, "quit-watch-later", { OARG_INT(0) } },
   { MP_CMD_STOP, "stop", },
@@ -126,6 +127,7 @@ const struct mp_cmd_def mp_cmds[] = {
                       {"window", 1},
                       {"subtitles", 2})),
   }},
+  { MP_CMD_THUMBNAIL, "thumbnail", { ARG_TIME, OARG_INT(0), OARG_INT(0) } },
   { MP_CMD_LOADFILE, "loadfile", {
       ARG_STRING,
       OARG_CHOICE(0, ({"replace", 0},
@@ -143,6 +145,7 @@ const struct mp_cmd_def mp_cmds[] = {
       ARG_CHOICE_OR_INT(0, INT_MAX, ({"current", -1})),
   }},
   { MP_CMD_PLAYLIST_MOVE, "playlist-move", { ARG_INT, ARG_INT } },
+  { MP_CMD_PLAYLIST_PROBE, "playlist-probe", { OARG_INT(0), OARG_INT(-1) } },
   { MP_CMD_RUN, "run", { ARG_STRING, ARG_STRING }, .vararg = true },
 
   { MP_CMD_SET, "set", { ARG_STRING,  ARG_STRING } },
@@ -41,6 +41,7 @@ enum mp_command_type {
     MP_CMD_IGNORE,
     MP_CMD_SEEK,
     MP_CMD_REVERT_SEEK,
+    MP_CMD_SCRUB,
     MP_CMD_QUIT,
     MP_CMD_QUIT_WATCH_LATER,
     MP_CMD_PLAYLIST_NEXT,
@@ -49,12 +50,14 @@ enum mp_command_type {
     MP_CMD_SCREENSHOT,
     MP_CMD_SCREENSHOT_TO_FILE,
     MP_CMD_SCREENSHOT_RAW,
+    MP_CMD_THUMBNAIL,
     MP_CMD_LOADFILE,
     MP_CMD_LOADLIST,
     MP_CMD_PLAYLIST_CLEAR,
     MP_CMD_PLAYLIST_REMOVE,
     MP_CMD_PLAYLIST_MOVE,
     MP_CMD_PLAYLIST_SHUFFLE,
+    MP_CMD_PLAYLIST_PROBE,
     MP_CMD_SUB_STEP,
     MP_CMD_SUB_SEEK,
     MP_CMD_TV_LAST_CHANNEL,
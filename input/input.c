@@ -67,6 +67,7 @@ struct cmd_bind {
     int keys[MP_MAX_KEY_DOWN];
     int num_keys;
     char *cmd;
+    struct mp_cmd *parsed;  // cmd parsed at bind time (NULL if invalid)
     char *location;     // filename/line number of definition
     bool is_builtin;
     struct cmd_bind_section *owner;
@@ -127,6 +128,9 @@ struct input_ctx {
     // Unlike mouse_x/y, this can be used to resolve mouse click bindings.
     int mouse_vo_x, mouse_vo_y;
 
+    // Sent for mouse movement if there is no binding for it.
+    struct mp_cmd *mouse_ignore_cmd;
+
     bool mouse_mangle, mouse_src_mangle;
     struct mp_rect mouse_src, mouse_dst;
 
@@ -276,8 +280,7 @@ static void append_bind_info(struct input_ctx *ictx, char **pmsg,
                              struct cmd_bind *bind)
 {
     char *msg = *pmsg;
-    struct mp_cmd *cmd = mp_input_parse_cmd(ictx, bstr0(bind->cmd),
-                                            bind->location);
+    struct mp_cmd *cmd = bind->parsed;
     bstr stripped = cmd ? cmd->original : bstr0(bind->cmd);
     msg = talloc_asprintf_append(msg, " '%.*s'", BSTR_P(stripped));
     if (!cmd)
@@ -461,12 +464,15 @@ static mp_cmd_t *get_cmd_from_keys(struct input_ctx *ictx, char *force_section,
         int msgl = MSGL_WARN;
         if (MP_KEY_IS_MOUSE_MOVE(code))
             msgl = MSGL_DEBUG;
-        char *key_buf = mp_input_get_key_combo_name(&code, 1);
-        MP_MSG(ictx, msgl, "No key binding found for key '%s'.\n", key_buf);
-        talloc_free(key_buf);
+        if (mp_msg_test(ictx->log, msgl)) {
+            char *key_buf = mp_input_get_key_combo_name(&code, 1);
+            MP_MSG(ictx, msgl, "No key binding found for key '%s'.\n", key_buf);
+            talloc_free(key_buf);
+        }
         return NULL;
     }
-    mp_cmd_t *ret = mp_input_parse_cmd(ictx, bstr0(cmd->cmd), cmd->location);
+    // Parsed when the binding was defined; only copying is needed here.
+    mp_cmd_t *ret = mp_cmd_clone(cmd->parsed);
     if (ret) {
         ret->input_section = cmd->owner->section;
         ret->key_name = talloc_steal(ret, mp_input_get_key_combo_name(&code, 1));
@@ -545,6 +551,34 @@ static struct mp_cmd *resolve_key(struct input_ctx *ictx, int code)
     return NULL;
 }
 
+static bool is_wheel_key(int code)
+{
+    code &= ~MP_KEY_MODIFIER_MASK;
+    return (code >= MP_MOUSE_BTN3 && code <= MP_MOUSE_BTN6) ||
+           (code >= MP_AXIS_UP && code <= MP_AXIS_RIGHT);
+}
+
+// High resolution wheels and touchpads can send steps faster than the player
+// processes them. If the previous step of the same key is still queued, merge
+// cmd into it by adding up the scale. Only done for relative seeks, for which
+// this is exactly equivalent to running the commands one by one (for property
+// changes, it isn't, e.g. "add" on choices always moves by 1 step).
+// Returns true if cmd was merged (and freed).
+static bool coalesce_wheel_cmd(struct input_ctx *ictx, struct mp_cmd *cmd,
+                               double scale)
+{
+    struct mp_cmd *tail = queue_peek_tail(&ictx->cmd_queue);
+    if (!tail || tail->id != MP_CMD_SEEK || cmd->id != MP_CMD_SEEK ||
+        (cmd->args[1].v.i & 3) != 0 || tail->flags != cmd->flags ||
+        tail->is_up_down || !tail->key_name || !cmd->key_name ||
+        strcmp(tail->key_name, cmd->key_name) != 0 ||
+        !bstr_equals(tail->original, cmd->original))
+        return false;
+    tail->scale += scale;
+    talloc_free(cmd);
+    return true;
+}
+
 static void interpret_key(struct input_ctx *ictx, int code, double scale)
 {
     int state = code & (MP_KEY_STATE_DOWN | MP_KEY_STATE_UP);
@@ -607,6 +641,10 @@ static void interpret_key(struct input_ctx *ictx, int code, double scale)
 
     memset(ictx->key_history, 0, sizeof(ictx->key_history));
 
+    // The core was already woken up for the queued command.
+    if (!state && is_wheel_key(code) && coalesce_wheel_cmd(ictx, cmd, scale))
+        return;
+
     cmd->scale = scale;
     mp_input_queue_cmd(ictx, cmd);
 }
@@ -748,7 +786,7 @@ void mp_input_set_mouse_pos_artificial(struct input_ctx *ictx, int x, int y)
     update_mouse_section(ictx);
     struct mp_cmd *cmd = get_cmd_from_keys(ictx, NULL, MP_KEY_MOUSE_MOVE);
     if (!cmd)
-        cmd = mp_input_parse_cmd(ictx, bstr0("ignore"), "<internal>");
+        cmd = mp_cmd_clone(ictx->mouse_ignore_cmd);
 
     if (cmd) {
         cmd->mouse_move = true;
@@ -757,13 +795,16 @@ void mp_input_set_mouse_pos_artificial(struct input_ctx *ictx, int x, int y)
         if (should_drop_cmd(ictx, cmd)) {
             talloc_free(cmd);
         } else {
-            // Coalesce with previous mouse move events (i.e. replace it)
+            // Coalesce with previous mouse move events (i.e. replace it). If
+            // one was still queued, the core was already woken up for it.
             struct mp_cmd *tail = queue_peek_tail(&ictx->cmd_queue);
             if (tail && tail->mouse_move) {
                 queue_remove(&ictx->cmd_queue, tail);
                 talloc_free(tail);
+                queue_add_tail(&ictx->cmd_queue, cmd);
+            } else {
+                mp_input_queue_cmd(ictx, cmd);
             }
-            mp_input_queue_cmd(ictx, cmd);
         }
     }
     input_unlock(ictx);
@@ -997,6 +1038,7 @@ bool mp_input_test_dragging(struct input_ctx *ictx, int x, int y)
 static void bind_dealloc(struct cmd_bind *bind)
 {
     talloc_free(bind->cmd);
+    talloc_free(bind->parsed);
     talloc_free(bind->location);
 }
 
@@ -1089,8 +1131,12 @@ static void bind_keys(struct input_ctx *ictx, bool builtin, bstr section,
 
     bind_dealloc(bind);
 
+    // Also prints warnings if the command is invalid.
+    struct mp_cmd *parsed = mp_input_parse_cmd(ictx, command, loc);
+
     *bind = (struct cmd_bind) {
         .cmd = bstrdup0(bs->binds, command),
+        .parsed = talloc_steal(bs->binds, parsed),
         .location = talloc_strdup(bs->binds, loc),
         .owner = bs,
         .is_builtin = builtin,
@@ -1169,9 +1215,6 @@ static int parse_config(struct input_ctx *ictx, bool builtin, bstr data,
 
         bind_keys(ictx, builtin, section, keys, num_keys, command, cur_loc);
         n_binds++;
-
-        // Print warnings if invalid commands are encountered.
-        talloc_free(mp_input_parse_cmd(ictx, command, cur_loc));
     }
 
     talloc_free(cur_loc);
@@ -1229,6 +1272,9 @@ struct input_ctx *mp_input_init(struct mpv_global *global,
 
     mpthread_mutex_init_recursive(&ictx->mutex);
 
+    ictx->mouse_ignore_cmd =
+        talloc_steal(ictx, mp_input_parse_cmd(ictx, bstr0("ignore"), "<internal>"));
+
     // Setup default section, so that it does nothing.
     mp_input_enable_section(ictx, NULL, MP_INPUT_ALLOW_VO_DRAGGING |
                                         MP_INPUT_ALLOW_HIDE_CURSOR);
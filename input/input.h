@@ -261,13 +261,29 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
                                struct mpv_global *global);
 void mp_uninit_ipc(struct mp_ipc_ctx *ctx);
 
+// Per-connection IPC protocol state. Initialize with {0}.
+struct mp_ipc_conn {
+    bool binary;        // length-prefixed binary frames instead of JSON lines
+    bool next_binary;   // framing after the current message
+};
+
 // Serialize the given mpv_event structure to JSON. Returns an allocated string.
 struct mpv_event;
 char *mp_json_encode_event(struct mpv_event *event);
 
-// Given the raw IPC input buffer "buf", remove the first newline-separated
-// command, execute it and return the result (if any) as an allocated string.
+// Serialize the event with the framing used by conn. The result is allocated
+// under ta_parent.
+bstr mp_ipc_encode_event(struct mp_ipc_conn *conn, void *ta_parent,
+                         struct mpv_event *event);
+
+// Given the raw IPC input buffer "buf", remove the first message (a line, or a
+// binary frame), execute it and set *reply to the result (reply->len==0 if
+// there is none), which is allocated under ctx.
+// Returns 1 if a message was consumed, 0 if buf contains no complete message,
+// and -1 on protocol errors (the connection should be closed).
 struct mpv_handle;
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
+int mp_ipc_consume_next_command(struct mpv_handle *client,
+                                struct mp_ipc_conn *conn, void *ctx, bstr *buf,
+                                bstr *reply);
 
 #endif /* MPLAYER_INPUT_H */
@@ -44,13 +44,27 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// Don't produce more output for a client while this much is still unsent.
+#define OUTPUT_HIGH_WATER (1024 * 1024)
+// Don't read more input from a client while this much is still unprocessed.
+#define INPUT_HIGH_WATER (1024 * 1024)
+
+struct client_arg;
+
+// All clients are served by a single thread (ipc_thread()). Each client still
+// has its own mpv_handle, and thus its own event queue and observed properties.
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const char *path;
+    char *input_file;
 
     pthread_t thread;
     int death_pipe[2];
+
+    // -- accessed by ipc_thread only
+    struct client_arg **clients;
+    int num_clients;
 };
 
 struct client_arg {
@@ -60,175 +74,180 @@ struct client_arg {
     char *client_name;
     int client_fd;
     bool close_client_fd;
+    int wakeup_fd;          // mpv_get_wakeup_pipe()
 
     bool writable;
+    struct mp_ipc_conn conn;
+
+    bstr input;             // received, but not yet executed
+    bstr output;            // not yet sent
+    bool events_pending;    // stopped reading events due to backpressure
+    bool eof;               // client closed its end of the connection
+    bool dead;              // remove the client
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static bool is_congested(struct client_arg *client)
 {
-    size_t count = strlen(buf);
-    while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
-        if (rc <= 0) {
-            if (rc == 0)
-                return -1;
-
-            if (errno == EBADF) {
-                client->writable = false;
-                return 0;
-            }
+    return client->output.len >= OUTPUT_HIGH_WATER;
+}
+
+static void ipc_write(struct client_arg *client, bstr data)
+{
+    if (client->writable && !client->dead)
+        bstr_xappend(client, &client->output, data);
+}
 
+// Send as much buffered output as possible without blocking.
+static void flush_output(struct client_arg *client)
+{
+    size_t done = 0;
+    while (done < client->output.len) {
+        ssize_t rc = send(client->client_fd, client->output.start + done,
+                          client->output.len - done, MSG_NOSIGNAL);
+        if (rc < 0) {
             if (errno == EINTR)
                 continue;
 
-            if (errno == EAGAIN)
-                return 0;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
 
-            return rc;
+            if (errno == EBADF || errno == ENOTSOCK) {
+                client->writable = false;
+            } else {
+                MP_ERR(client, "Write error (%s)\n", mp_strerror(errno));
+                client->dead = true;
+            }
+            done = client->output.len;
+            break;
         }
-
-        count -= rc;
-        buf   += rc;
+        done += rc;
     }
-
-    return 0;
+    memmove(client->output.start, client->output.start + done,
+            client->output.len - done);
+    client->output.len -= done;
 }
 
-static void *client_thread(void *p)
+static void process_events(struct client_arg *client)
 {
-    pthread_detach(pthread_self());
-
-    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
-    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGPIPE, &sa, NULL);
-
-    int rc;
-
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
-
-    mpthread_set_name(arg->client_name);
-
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
-    }
+    client->events_pending = false;
+    while (!client->dead) {
+        if (is_congested(client)) {
+            client->events_pending = true;
+            break;
+        }
 
-    MP_VERBOSE(arg, "Client connected\n");
+        mpv_event *event = mpv_wait_event(client->client, 0);
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+        if (event->event_id == MPV_EVENT_NONE)
+            break;
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            client->dead = true;
+            break;
+        }
 
-    while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0)
-            rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+        if (!client->writable)
             continue;
-        }
 
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
+        bstr event_msg = mp_ipc_encode_event(&client->conn, NULL, event);
+        if (!event_msg.len) {
+            MP_ERR(client, "Encoding error\n");
+            client->dead = true;
+            break;
+        }
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+        ipc_write(client, event_msg);
+        talloc_free(event_msg.start);
+    }
+}
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+static void process_input(struct client_arg *client)
+{
+    // On EOF, the remaining commands are executed regardless of congestion.
+    while (!client->dead && (client->eof || !is_congested(client))) {
+        bstr reply_msg;
+        int rc = mp_ipc_consume_next_command(client->client, &client->conn,
+                                             NULL, &client->input, &reply_msg);
+        if (rc < 0)
+            client->dead = true;
+        if (rc <= 0)
+            break;
+
+        ipc_write(client, reply_msg);
+        talloc_free(reply_msg.start);
+    }
+}
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+static void read_input(struct client_arg *client)
+{
+    while (!client->eof && client->input.len < INPUT_HIGH_WATER) {
+        char buf[4096];
 
-                if (!arg->writable)
-                    continue;
+        ssize_t bytes = read(client->client_fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-            }
+            MP_ERR(client, "Read error (%s)\n", mp_strerror(errno));
+            client->dead = true;
+            break;
         }
 
-        if (fds[1].revents & (POLLIN | POLLHUP)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
-
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
-
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
+        if (bytes == 0) {
+            MP_VERBOSE(client, "Client disconnected\n");
+            client->eof = true;
+            break;
+        }
 
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
+        bstr_xappend(client, &client->input, (bstr){buf, bytes});
+    }
+}
 
-                append.len = bytes;
+static void ipc_add_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
+{
+    client->client = mp_new_client(ctx->client_api, client->client_name);
+    if (!client->client)
+        goto error;
+    client->log = mp_client_get_log(client->client);
+
+    client->wakeup_fd = mpv_get_wakeup_pipe(client->client);
+    if (client->wakeup_fd < 0) {
+        MP_ERR(client, "Could not get wakeup pipe\n");
+        mpv_detach_destroy(client->client);
+        goto error;
+    }
 
-                bstr_xappend(NULL, &client_msg, append);
+    fcntl(client->client_fd, F_SETFL,
+          fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
+    MP_VERBOSE(client, "Client connected\n");
 
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
+    client->input = (bstr){talloc_strdup(client, ""), 0};
+    client->output = (bstr){talloc_strdup(client, ""), 0};
 
-                    talloc_free(reply_msg);
-                }
-            }
-        }
-    }
+    MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_clients, client);
+    return;
 
-done:
-    if (client_msg.len > 0)
-        MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
-    if (arg->close_client_fd)
-        close(arg->client_fd);
-    mpv_detach_destroy(arg->client);
-    talloc_free(arg);
-    return NULL;
+error:
+    if (client->close_client_fd)
+        close(client->client_fd);
+    talloc_free(client);
 }
 
-static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
+static void ipc_remove_client(struct mp_ipc_ctx *ctx, int index)
 {
-    client->client = mp_new_client(ctx->client_api, client->client_name),
-    client->log    = mp_client_get_log(client->client);
-
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client)) {
-        mpv_detach_destroy(client->client);
-        if (client->close_client_fd)
-            close(client->client_fd);
-        talloc_free(client);
-    }
+    struct client_arg *client = ctx->clients[index];
+    MP_TARRAY_REMOVE_AT(ctx->clients, ctx->num_clients, index);
+
+    if (client->input.len > 0 && !client->conn.binary)
+        MP_WARN(client, "Ignoring unterminated command on disconnect.\n");
+    if (client->close_client_fd)
+        close(client->client_fd);
+    mpv_detach_destroy(client->client);
+    talloc_free(client);
 }
 
 static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
@@ -242,7 +261,7 @@ static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
         .writable = true,
     };
 
-    ipc_start_client(ctx, client);
+    ipc_add_client(ctx, client);
 }
 
 static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
@@ -284,26 +303,20 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
         .writable = writable,
     };
 
-    ipc_start_client(ctx, client);
+    ipc_add_client(ctx, client);
 }
 
-static void *ipc_thread(void *p)
+static int ipc_listen(struct mp_ipc_ctx *arg)
 {
     int rc;
 
     int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
-    MP_VERBOSE(arg, "Starting IPC master\n");
-
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
 #if HAVE_FCHMOD
@@ -313,7 +326,7 @@ static void *ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -330,35 +343,107 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
+    return ipc_fd;
+
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
+
+static void *ipc_thread(void *p)
+{
+    int rc;
+
+    struct mp_ipc_ctx *arg = p;
+
+    mpthread_set_name("ipc");
+
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    MP_VERBOSE(arg, "Starting IPC master\n");
+
+    if (arg->input_file && arg->input_file[0])
+        ipc_start_client_text(arg, arg->input_file);
+
+    int ipc_fd = -1;
+    if (arg->path && arg->path[0]) {
+        ipc_fd = ipc_listen(arg);
+        if (ipc_fd < 0 && !arg->num_clients)
+            goto done;
+    }
 
     int client_num = 0;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+    struct pollfd *fds = NULL;
 
     while (1) {
-        rc = poll(fds, 2, -1);
+        // 0: death pipe, 1: listening socket, then 2 entries per client
+        int num_clients = arg->num_clients;
+        fds = talloc_realloc(arg, fds, struct pollfd, 2 + num_clients * 2);
+        fds[0] = (struct pollfd){.events = POLLIN, .fd = arg->death_pipe[0]};
+        fds[1] = (struct pollfd){.events = POLLIN, .fd = ipc_fd};
+        for (int n = 0; n < num_clients; n++) {
+            struct client_arg *client = arg->clients[n];
+            bool congested = is_congested(client);
+            // While output is congested, only wait until it can be sent.
+            fds[2 + n * 2] = (struct pollfd){
+                .events = congested ? 0 : POLLIN,
+                .fd = client->wakeup_fd,
+            };
+            fds[2 + n * 2 + 1] = (struct pollfd){
+                .events = (congested || client->eof ? 0 : POLLIN) |
+                          (client->output.len ? POLLOUT : 0),
+                .fd = client->client_fd,
+            };
+        }
+
+        rc = poll(fds, 2 + num_clients * 2, -1);
         if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+            if (errno != EINTR)
+                MP_ERR(arg, "Poll error\n");
             continue;
         }
 
         if (fds[0].revents & POLLIN)
             goto done;
 
-        if (fds[1].revents & POLLIN) {
+        for (int n = num_clients - 1; n >= 0; n--) {
+            struct client_arg *client = arg->clients[n];
+            short wakeup = fds[2 + n * 2].revents;
+            short io = fds[2 + n * 2 + 1].revents;
+
+            if (io & POLLOUT)
+                flush_output(client);
+            if (io & (POLLIN | POLLHUP | POLLERR))
+                read_input(client);
+            process_input(client);
+            if (wakeup & POLLIN)
+                mp_flush_wakeup_pipe(client->wakeup_fd);
+            if ((wakeup & POLLIN) || client->events_pending)
+                process_events(client);
+            if (client->output.len)
+                flush_output(client);
+
+            // After EOF, stay until the replies were sent.
+            if (client->dead || (client->eof && !client->output.len))
+                ipc_remove_client(arg, n);
+        }
+
+        if ((fds[1].revents & POLLIN) && ipc_fd >= 0) {
             int client_fd = accept(ipc_fd, NULL, NULL);
             if (client_fd < 0) {
                 MP_ERR(arg, "Could not accept IPC client\n");
@@ -370,6 +455,9 @@ static void *ipc_thread(void *p)
     }
 
 done:
+    while (arg->num_clients)
+        ipc_remove_client(arg, arg->num_clients - 1);
+
     if (ipc_fd >= 0)
         close(ipc_fd);
 
@@ -386,14 +474,12 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
         .path       = mp_get_user_path(arg, global, opts->ipc_path),
+        .input_file = mp_get_user_path(arg, global, opts->input_file),
         .death_pipe = {-1, -1},
     };
-    char *input_file = mp_get_user_path(arg, global, opts->input_file);
-
-    if (input_file && *input_file)
-        ipc_start_client_text(arg, input_file);
 
-    if (!opts->ipc_path || !*opts->ipc_path)
+    if ((!arg->input_file || !*arg->input_file) &&
+        (!opts->ipc_path || !*opts->ipc_path))
         goto out;
 
     if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
@@ -179,7 +179,8 @@ static void mpv_event_to_node(void *ta_parent, mpv_event *event, mpv_node *dst)
 
 char *mp_json_encode_event(mpv_event *event)
 {
-    void *ta_parent = talloc_new(NULL);
+    // Many small allocations, all freed at once.
+    void *ta_parent = talloc_new_arena(NULL, 0);
     mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
 
     mpv_event_to_node(ta_parent, event, &event_node);
@@ -193,33 +194,25 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Execute a single command message, and append the reply fields to reply_node
+// (which must be a map).
+static void execute_command(struct mpv_handle *client, struct mp_ipc_conn *conn,
+                            void *ta_parent, mpv_node *msg_node,
+                            mpv_node *reply_node)
 {
     int rc;
     const char *cmd = NULL;
-    struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 3);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received\n");
+    if (msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
+    reqid_node = mpv_node_map_get(msg_node, "request_id");
 
-    reqid_node = mpv_node_map_get(&msg_node, "request_id");
-
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -238,18 +231,18 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (!strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_property", cmd)) {
-        mpv_node result_node;
+        const mpv_node *result_node;
 
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -261,11 +254,14 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
-                              MPV_FORMAT_NODE, &result_node);
+        // Avoids a copy (the reply needs one anyway).
+        rc = mpv_get_property_node_ref(client,
+                                       cmd_node->u.list->values[1].u.string,
+                                       &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
-            mpv_free_node_contents(&result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data",
+                             (mpv_node *)result_node);
+            mpv_node_unref(result_node);
         }
     } else if (!strcmp("get_property_string", cmd)) {
         if (cmd_node->u.list->num != 2) {
@@ -281,9 +277,9 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         char *result = mpv_get_property_string(client,
                                         cmd_node->u.list->values[1].u.string);
         if (!result) {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         } else {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         }
     } else if (!strcmp("set_property", cmd)) {
@@ -371,6 +367,28 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
         rc = mpv_unobserve_property(client,
                                     cmd_node->u.list->values[1].u.int64);
+    } else if (!strcmp("set_ipc_framing", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        // The reply is still sent with the old framing.
+        const char *framing = cmd_node->u.list->values[1].u.string;
+        if (!strcmp(framing, "binary")) {
+            conn->next_binary = true;
+            rc = MPV_ERROR_SUCCESS;
+        } else if (!strcmp(framing, "json")) {
+            conn->next_binary = false;
+            rc = MPV_ERROR_SUCCESS;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+        }
     } else if (!strcmp("request_log_messages", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -421,8 +439,10 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         mpv_node result_node;
 
         rc = mpv_command_node(client, cmd_node, &result_node);
-        if (rc >= 0)
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+        if (rc >= 0) {
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+            mpv_free_node_contents(&result_node);
+        }
     }
 
 error:
@@ -431,10 +451,56 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
+    }
+
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+}
+
+// Execute a single command (a map), or a batch of commands (an array of maps).
+// A batch is answered with one array of replies, in the same order.
+static void execute_message(struct mpv_handle *client, struct mp_ipc_conn *conn,
+                            void *ta_parent, mpv_node *msg_node,
+                            mpv_node *reply_node)
+{
+    if (msg_node->format != MPV_FORMAT_NODE_ARRAY) {
+        *reply_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP};
+        execute_command(client, conn, ta_parent, msg_node, reply_node);
+        return;
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    *reply_node = (mpv_node){.format = MPV_FORMAT_NODE_ARRAY};
+    reply_node->u.list = talloc_zero(ta_parent, mpv_node_list);
+    mpv_node_list *list = reply_node->u.list;
+    for (int n = 0; n < msg_node->u.list->num; n++) {
+        MP_TARRAY_GROW(list, list->values, list->num);
+        mpv_node *reply = &list->values[list->num++];
+        *reply = (mpv_node){.format = MPV_FORMAT_NODE_MAP};
+        execute_command(client, conn, ta_parent, &msg_node->u.list->values[n],
+                        reply);
+    }
+}
+
+// Function is allowed to modify src[n].
+static char *json_execute_command(struct mpv_handle *client,
+                                  struct mp_ipc_conn *conn, void *ta_parent,
+                                  char *src)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    mpv_node reply_node;
+
+    // A batch adds one level.
+    int rc = json_parse(ta_parent, &msg_node, &src, src[0] == '[' ? 4 : 3);
+    if (rc < 0) {
+        mp_err(log, "malformed JSON received\n");
+        reply_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP};
+        mpv_node_map_add_string(ta_parent, &reply_node, "error",
+                                mpv_error_string(MPV_ERROR_INVALID_PARAMETER));
+    } else {
+        execute_message(client, conn, ta_parent, &msg_node, &reply_node);
+    }
 
     char *output = talloc_strdup(ta_parent, "");
     json_write(&output, &reply_node);
@@ -443,6 +509,252 @@ error:
     return output;
 }
 
+/* Binary framing: every message is a 4 byte big endian payload length,
+ * followed by the payload, which is a node in the compact encoding below.
+ * Each node starts with its mpv_format as 1 byte:
+ *   MPV_FORMAT_NONE:       nothing follows
+ *   MPV_FORMAT_STRING:     u32 length, bytes (not 0-terminated)
+ *   MPV_FORMAT_FLAG:       1 byte (0 or 1)
+ *   MPV_FORMAT_INT64:      8 bytes, big endian two's complement
+ *   MPV_FORMAT_DOUBLE:     8 bytes, big endian IEEE 754
+ *   MPV_FORMAT_NODE_ARRAY: u32 count, count nodes
+ *   MPV_FORMAT_NODE_MAP:   u32 count, count times (u32 length, key, node)
+ *   MPV_FORMAT_BYTE_ARRAY: u32 length, bytes
+ */
+
+// Larger frames are a protocol error.
+#define MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+static void bin_write_u8(void *ta_parent, bstr *dst, uint8_t v)
+{
+    bstr_xappend(ta_parent, dst, (bstr){&v, 1});
+}
+
+static void bin_write_u32(void *ta_parent, bstr *dst, uint32_t v)
+{
+    uint8_t b[4] = {v >> 24, v >> 16, v >> 8, v};
+    bstr_xappend(ta_parent, dst, (bstr){b, 4});
+}
+
+static void bin_write_u64(void *ta_parent, bstr *dst, uint64_t v)
+{
+    bin_write_u32(ta_parent, dst, v >> 32);
+    bin_write_u32(ta_parent, dst, v);
+}
+
+static void bin_write_bytes(void *ta_parent, bstr *dst, const void *p, size_t len)
+{
+    bin_write_u32(ta_parent, dst, len);
+    bstr_xappend(ta_parent, dst, (bstr){(unsigned char *)p, len});
+}
+
+static void bin_write_node(void *ta_parent, bstr *dst, mpv_node *src)
+{
+    bin_write_u8(ta_parent, dst, src->format);
+    switch (src->format) {
+    case MPV_FORMAT_STRING:
+        bin_write_bytes(ta_parent, dst, src->u.string, strlen(src->u.string));
+        break;
+    case MPV_FORMAT_FLAG:
+        bin_write_u8(ta_parent, dst, !!src->u.flag);
+        break;
+    case MPV_FORMAT_INT64:
+        bin_write_u64(ta_parent, dst, src->u.int64);
+        break;
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        memcpy(&v, &src->u.double_, sizeof(v));
+        bin_write_u64(ta_parent, dst, v);
+        break;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        mpv_node_list *list = src->u.list;
+        int num = list ? list->num : 0;
+        bin_write_u32(ta_parent, dst, num);
+        for (int n = 0; n < num; n++) {
+            if (src->format == MPV_FORMAT_NODE_MAP) {
+                bin_write_bytes(ta_parent, dst, list->keys[n],
+                                strlen(list->keys[n]));
+            }
+            bin_write_node(ta_parent, dst, &list->values[n]);
+        }
+        break;
+    }
+    case MPV_FORMAT_BYTE_ARRAY:
+        bin_write_bytes(ta_parent, dst, src->u.ba->data, src->u.ba->size);
+        break;
+    }
+}
+
+static bool bin_read_u8(bstr *src, uint8_t *v)
+{
+    if (src->len < 1)
+        return false;
+    *v = src->start[0];
+    *src = bstr_cut(*src, 1);
+    return true;
+}
+
+static bool bin_read_u32(bstr *src, uint32_t *v)
+{
+    if (src->len < 4)
+        return false;
+    unsigned char *b = src->start;
+    *v = ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+    *src = bstr_cut(*src, 4);
+    return true;
+}
+
+static bool bin_read_u64(bstr *src, uint64_t *v)
+{
+    uint32_t hi, lo;
+    if (!bin_read_u32(src, &hi) || !bin_read_u32(src, &lo))
+        return false;
+    *v = ((uint64_t)hi << 32) | lo;
+    return true;
+}
+
+// Read a length-prefixed string as allocated, 0-terminated string.
+static char *bin_read_string(void *ta_parent, bstr *src)
+{
+    uint32_t len;
+    if (!bin_read_u32(src, &len) || len > src->len)
+        return NULL;
+    char *s = bstrto0(ta_parent, (bstr){src->start, len});
+    *src = bstr_cut(*src, len);
+    return s;
+}
+
+// Same conventions and max_depth semantics as json_parse().
+static int bin_read_node(void *ta_parent, mpv_node *dst, bstr *src,
+                         int max_depth)
+{
+    uint8_t format;
+    max_depth -= 1;
+    if (max_depth < 0 || !bin_read_u8(src, &format))
+        return -1;
+    *dst = (mpv_node){.format = format};
+    switch (format) {
+    case MPV_FORMAT_NONE:
+        return 0;
+    case MPV_FORMAT_STRING:
+        dst->u.string = bin_read_string(ta_parent, src);
+        return dst->u.string ? 0 : -1;
+    case MPV_FORMAT_FLAG: {
+        uint8_t v;
+        if (!bin_read_u8(src, &v) || v > 1)
+            return -1;
+        dst->u.flag = v;
+        return 0;
+    }
+    case MPV_FORMAT_INT64: {
+        uint64_t v;
+        if (!bin_read_u64(src, &v))
+            return -1;
+        dst->u.int64 = v;
+        return 0;
+    }
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        if (!bin_read_u64(src, &v))
+            return -1;
+        memcpy(&dst->u.double_, &v, sizeof(v));
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        uint32_t num;
+        // Every entry needs at least 1 byte; reject bogus counts early.
+        if (!bin_read_u32(src, &num) || num > src->len)
+            return -1;
+        mpv_node_list *list = talloc_zero(ta_parent, mpv_node_list);
+        list->values = talloc_array(list, mpv_node, num);
+        if (format == MPV_FORMAT_NODE_MAP)
+            list->keys = talloc_array(list, char *, num);
+        for (list->num = 0; list->num < num; list->num++) {
+            if (format == MPV_FORMAT_NODE_MAP) {
+                list->keys[list->num] = bin_read_string(list, src);
+                if (!list->keys[list->num])
+                    return -1;
+            }
+            if (bin_read_node(list, &list->values[list->num], src,
+                              max_depth) < 0)
+                return -1;
+        }
+        dst->u.list = list;
+        return 0;
+    }
+    case MPV_FORMAT_BYTE_ARRAY: {
+        uint32_t len;
+        if (!bin_read_u32(src, &len) || len > src->len)
+            return -1;
+        dst->u.ba = talloc_ptrtype(ta_parent, dst->u.ba);
+        *dst->u.ba = (mpv_byte_array){
+            .data = talloc_memdup(dst->u.ba, src->start, len),
+            .size = len,
+        };
+        *src = bstr_cut(*src, len);
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+static bstr bin_frame(void *ta_parent, mpv_node *node)
+{
+    bstr frame = {0};
+    bin_write_u32(ta_parent, &frame, 0); // placeholder
+    bin_write_node(ta_parent, &frame, node);
+    uint32_t size = frame.len - 4;
+    frame.start[0] = size >> 24;
+    frame.start[1] = size >> 16;
+    frame.start[2] = size >> 8;
+    frame.start[3] = size;
+    return frame;
+}
+
+static bstr bin_execute_command(struct mpv_handle *client,
+                                struct mp_ipc_conn *conn, void *ta_parent,
+                                bstr payload)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    mpv_node reply_node;
+
+    bool batch = payload.len && payload.start[0] == MPV_FORMAT_NODE_ARRAY;
+    if (bin_read_node(ta_parent, &msg_node, &payload, batch ? 4 : 3) < 0 ||
+        payload.len)
+    {
+        mp_err(log, "malformed binary message received\n");
+        reply_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP};
+        mpv_node_map_add_string(ta_parent, &reply_node, "error",
+                                mpv_error_string(MPV_ERROR_INVALID_PARAMETER));
+    } else {
+        execute_message(client, conn, ta_parent, &msg_node, &reply_node);
+    }
+
+    return bin_frame(ta_parent, &reply_node);
+}
+
+bstr mp_ipc_encode_event(struct mp_ipc_conn *conn, void *ta_parent,
+                         struct mpv_event *event)
+{
+    if (!conn->binary) {
+        char *s = mp_json_encode_event(event);
+        return bstr0(talloc_steal(ta_parent, s));
+    }
+
+    void *tmp = talloc_new_arena(NULL, 0);
+    mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    mpv_event_to_node(tmp, event, &event_node);
+    bstr frame = bin_frame(ta_parent, &event_node);
+    talloc_free(tmp);
+    return frame;
+}
+
 static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
 {
     mpv_command_string(client, src);
@@ -450,28 +762,64 @@ static char *text_execute_command(struct mpv_handle *client, void *tmp, char *sr
     return NULL;
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+// Remove the first n bytes from the buffer, keeping its allocation.
+static void buf_remove(bstr *buf, size_t n)
+{
+    memmove(buf->start, buf->start + n, buf->len - n);
+    buf->len -= n;
+}
+
+int mp_ipc_consume_next_command(struct mpv_handle *client,
+                                struct mp_ipc_conn *conn, void *ctx, bstr *buf,
+                                bstr *reply)
 {
+    *reply = (bstr){0};
+
+    if (conn->binary) {
+        bstr b = *buf;
+        uint32_t size;
+        if (!bin_read_u32(&b, &size))
+            return 0;
+        if (size > MAX_FRAME_SIZE) {
+            mp_err(mp_client_get_log(client), "Frame too large (%u bytes).\n",
+                   (unsigned)size);
+            return -1;
+        }
+        if (b.len < size)
+            return 0;
+        void *tmp = talloc_new(NULL);
+        bstr payload = bstrdup(tmp, (bstr){b.start, size});
+        buf_remove(buf, 4 + size);
+        *reply = bin_execute_command(client, conn, tmp, payload);
+        talloc_steal(ctx, reply->start);
+        conn->binary = conn->next_binary;
+        talloc_free(tmp);
+        return 1;
+    }
+
+    if (bstrchr(*buf, '\n') < 0)
+        return 0;
+
     void *tmp = talloc_new(NULL);
 
     bstr rest;
     bstr line = bstr_getline(*buf, &rest);
     char *line0 = bstrto0(tmp, line);
-    talloc_steal(tmp, buf->start);
-    *buf = bstrdup(NULL, rest);
+    buf_remove(buf, rest.start - buf->start);
 
     json_skip_whitespace(&line0);
 
     char *reply_msg = NULL;
     if (line0[0] == '\0' || line0[0] == '#') {
         // skip
-    } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
+    } else if (line0[0] == '{' || line0[0] == '[') {
+        reply_msg = json_execute_command(client, conn, tmp, line0);
     } else {
         reply_msg = text_execute_command(client, tmp, line0);
     }
 
-    talloc_steal(ctx, reply_msg);
+    *reply = bstr0(talloc_steal(ctx, reply_msg));
+    conn->binary = conn->next_binary;
     talloc_free(tmp);
-    return reply_msg;
+    return 1;
 }
@@ -211,7 +211,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 24)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 30)
 
 /**
  * Return the MPV_CLIENT_API_VERSION the mpv source has been compiled with.
@@ -907,6 +907,31 @@ int mpv_command_async(mpv_handle *ctx, uint64_t reply_userdata,
 int mpv_command_node_async(mpv_handle *ctx, uint64_t reply_userdata,
                            mpv_node *args);
 
+/**
+ * Run a list of commands and property writes asynchronously, in order, and
+ * without any other request or playback activity in between. This is cheaper
+ * than issuing them one by one with mpv_command_node_async() and
+ * mpv_set_property_async(): the whole batch is dispatched to the playback
+ * thread at once, and only a single MPV_EVENT_BATCH_REPLY event is returned.
+ * Its data field points to mpv_event_batch_reply, which contains the error
+ * code of each entry. mpv_event.error is set to the error of the first failed
+ * entry, or 0 if all succeeded.
+ *
+ * All entries are executed, even if an earlier one fails.
+ *
+ * @param reply_userdata the value mpv_event.reply_userdata of the reply will
+ *                       be set to (see section about asynchronous calls)
+ * @param batch a MPV_FORMAT_NODE_ARRAY. Each entry is either a command in the
+ *              form accepted by mpv_command_node() (a MPV_FORMAT_NODE_ARRAY),
+ *              or a MPV_FORMAT_NODE_MAP with a "name" (MPV_FORMAT_STRING) and
+ *              a "data" entry, which sets the property "name" like
+ *              mpv_set_property() with MPV_FORMAT_NODE would.
+ * @return error code (if parsing or queuing the batch fails; in this case,
+ *         none of the entries are run)
+ */
+int mpv_command_batch_async(mpv_handle *ctx, uint64_t reply_userdata,
+                            mpv_node *batch);
+
 /**
  * Set a property to a given value. Properties are essentially variables which
  * can be queried or set at runtime. For example, writing to the pause property
@@ -1009,6 +1034,52 @@ char *mpv_get_property_string(mpv_handle *ctx, const char *name);
  */
 char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 
+/**
+ * Read the value of the given property as MPV_FORMAT_NODE, without copying it.
+ * The returned node is an immutable, reference counted snapshot of the value.
+ *
+ * For big properties ("track-list", "playlist", "chapter-list",
+ * "edition-list", "metadata"), the snapshot is shared between all callers
+ * and the property change events of observers using MPV_FORMAT_NODE, and is
+ * computed only once after each change of the property. Other properties work
+ * too, but get a new snapshot on each call.
+ *
+ * The snapshot stays valid until the last reference is released with
+ * mpv_node_unref(), even if the property changes, or the mpv_handle is
+ * destroyed. You must not change the node or anything it references.
+ *
+ * Example:
+ *
+ *     const mpv_node *list;
+ *     if (mpv_get_property_node_ref(ctx, "playlist", &list) < 0)
+ *         goto error;
+ *     printf("format=%d\n", (int)list->format);
+ *     mpv_node_unref(list);
+ *
+ * @param name The property name.
+ * @param[out] data Set to the snapshot on success, NULL on error.
+ * @return error code
+ */
+int mpv_get_property_node_ref(mpv_handle *ctx, const char *name,
+                              const mpv_node **data);
+
+/**
+ * Add a reference to a node returned by mpv_get_property_node_ref(). Only
+ * nodes returned by this function can be used. This function is thread-safe.
+ *
+ * @return the node argument (can be NULL, which is ignored)
+ */
+const mpv_node *mpv_node_ref(const mpv_node *node);
+
+/**
+ * Release a reference to a node returned by mpv_get_property_node_ref() or
+ * mpv_node_ref(). The snapshot is freed when the last reference is released.
+ * This function is thread-safe.
+ *
+ * @param node the node (can be NULL, which is ignored)
+ */
+void mpv_node_unref(const mpv_node *node);
+
 /**
  * Get a property asynchronously. You will receive the result of the operation
  * as well as the property data with the MPV_EVENT_GET_PROPERTY_REPLY event.
@@ -1265,7 +1336,12 @@ typedef enum mpv_event_id {
      * Event delivery will continue normally once this event was returned
      * (this forces the client to empty the queue completely).
      */
-    MPV_EVENT_QUEUE_OVERFLOW    = 24
+    MPV_EVENT_QUEUE_OVERFLOW    = 24,
+    /**
+     * Reply to a mpv_command_batch_async() request.
+     * See also mpv_event and mpv_event_batch_reply.
+     */
+    MPV_EVENT_BATCH_REPLY       = 25
     // Internal note: adjust INTERNAL_EVENT_BASE when adding new events.
 } mpv_event_id;
 
@@ -1427,6 +1503,19 @@ typedef struct mpv_event_client_message {
     const char **args;
 } mpv_event_client_message;
 
+typedef struct mpv_event_batch_reply {
+    /**
+     * Number of entries in status. This is the same as the number of entries
+     * in the batch passed to mpv_command_batch_async().
+     */
+    int num_status;
+    /**
+     * Error code (0 on success, or a mpv_error value) for each batch entry,
+     * in the same order as in the request.
+     */
+    int *status;
+} mpv_event_batch_reply;
+
 typedef struct mpv_event {
     /**
      * One of mpv_event. Keep in mind that later ABI compatible releases might
@@ -1442,6 +1531,7 @@ typedef struct mpv_event {
      *  MPV_EVENT_GET_PROPERTY_REPLY
      *  MPV_EVENT_SET_PROPERTY_REPLY
      *  MPV_EVENT_COMMAND_REPLY
+     *  MPV_EVENT_BATCH_REPLY
      */
     int error;
     /**
@@ -1452,6 +1542,7 @@ typedef struct mpv_event {
      *  MPV_EVENT_GET_PROPERTY_REPLY
      *  MPV_EVENT_SET_PROPERTY_REPLY
      *  MPV_EVENT_COMMAND_REPLY
+     *  MPV_EVENT_BATCH_REPLY
      *  MPV_EVENT_PROPERTY_CHANGE
      */
     uint64_t reply_userdata;
@@ -1462,6 +1553,7 @@ typedef struct mpv_event {
      *  MPV_EVENT_LOG_MESSAGE:            mpv_event_log_message*
      *  MPV_EVENT_CLIENT_MESSAGE:         mpv_event_client_message*
      *  MPV_EVENT_END_FILE:               mpv_event_end_file*
+     *  MPV_EVENT_BATCH_REPLY:            mpv_event_batch_reply*
      *  other: NULL
      *
      * Note: future enhancements might add new event structs for existing or new
@@ -1478,8 +1570,16 @@ typedef struct mpv_event {
  * (Informational note: currently, all events are enabled by default, except
  *  MPV_EVENT_TICK.)
  *
+ * If enable is 2, the event is enabled and coalesced: while an instance of it
+ * is queued and wasn't returned by mpv_wait_event() yet, further instances
+ * are dropped. This applies only to events without event data (mpv_event.data
+ * is NULL), and can't be used with reply events. It is useful for frequent
+ * notifications like MPV_EVENT_TICK, which would otherwise fill the queue if
+ * the client is slow.
+ *
  * @param event See enum mpv_event_id.
- * @param enable 1 to enable receiving this event, 0 to disable it.
+ * @param enable 1 to enable receiving this event, 0 to disable it, 2 to enable
+ *               and coalesce it (since API version 1.28).
  * @return error code
  */
 int mpv_request_event(mpv_handle *ctx, mpv_event_id event, int enable);
@@ -1650,7 +1750,14 @@ typedef enum mpv_sub_api {
      * Will return NULL if unavailable (if OpenGL support was not compiled in).
      * See opengl_cb.h for details.
      */
-    MPV_SUB_API_OPENGL_CB = 1
+    MPV_SUB_API_OPENGL_CB = 1,
+    /**
+     * For rendering video into memory buffers, without a GPU.
+     * mpv_get_sub_api(MPV_SUB_API_SW_CB) returns mpv_sw_cb_context*.
+     * This context can be used with mpv_sw_cb_* functions.
+     * See sw_cb.h for details.
+     */
+    MPV_SUB_API_SW_CB = 2
 } mpv_sub_api;
 
 /**
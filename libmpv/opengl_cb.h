@@ -333,11 +333,62 @@ int mpv_opengl_cb_render(mpv_opengl_cb_context *ctx, int fbo, int vp[4]);
  *
  * @param time The mpv time (using mpv_get_time_us()) at which the flip call
  *             returned. If 0 is passed, mpv_get_time_us() is used instead.
- *             Currently, this parameter is ignored.
+ *             This is used for mpv_opengl_cb_stats.flip_latency.
  * @return error code
  */
 int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time);
 
+/**
+ * Frame timing statistics, see mpv_opengl_cb_get_stats(). All times are in
+ * microseconds. A frame's target time is the time it should be displayed at
+ * according to the player; in display-sync mode, this is the time the frame
+ * was released for display. Also see the --opengl-cb-queue-size option.
+ *
+ * Warning: this struct is not ABI-stable yet. Fields may be appended in
+ *          future versions (which will bump the API version).
+ */
+typedef struct mpv_opengl_cb_stats {
+    /**
+     * Number of frames that were still queued after the last
+     * mpv_opengl_cb_draw() call took its frame.
+     */
+    int64_t queue_depth;
+    /**
+     * Number of frames rendered by mpv_opengl_cb_draw(), not counting redraws.
+     */
+    int64_t frames_drawn;
+    /**
+     * For the last frame drawn: time at which mpv_opengl_cb_draw() finished
+     * rendering it, minus the target time. Negative if it was ahead of time.
+     */
+    int64_t draw_latency;
+    /**
+     * For the last frame drawn: time passed to mpv_opengl_cb_report_flip(),
+     * minus the target time. 0 if mpv_opengl_cb_report_flip() is not used.
+     */
+    int64_t flip_latency;
+    /**
+     * Frames skipped by mpv_opengl_cb_draw(), because they were late and the
+     * next frame was already due.
+     */
+    int64_t dropped_late;
+    /**
+     * Frames dropped because mpv_opengl_cb_draw() was not called for a while
+     * and the queue was full.
+     */
+    int64_t dropped_timeout;
+} mpv_opengl_cb_stats;
+
+/**
+ * Return the current frame timing statistics. This can be called from any
+ * thread.
+ *
+ * @param stats filled with the statistics
+ * @return error code
+ */
+int mpv_opengl_cb_get_stats(mpv_opengl_cb_context *ctx,
+                            mpv_opengl_cb_stats *stats);
+
 /**
  * Destroy the mpv OpenGL state.
  *
@@ -153,6 +153,40 @@ typedef int64_t (*mpv_stream_cb_size_fn)(void *cookie);
  */
 typedef void (*mpv_stream_cb_close_fn)(void *cookie);
 
+/**
+ * Alternative to mpv_stream_cb_read_fn, which lends data the user holds
+ * already to mpv, instead of copying it into a buffer provided by mpv. This
+ * avoids a copy if the data is in memory anyway (e.g. after decryption).
+ *
+ * The semantics are the same as with mpv_stream_cb_read_fn, except that the
+ * callback sets *data to the data at the current stream position instead of
+ * copying it. It can return more than nbytes bytes; mpv will consume the
+ * data with its following reads. The data must remain valid and unchanged
+ * until mpv passes the returned buf_ctx to release_fn. mpv holds at most one
+ * lent buffer at a time, and releases it before the next lend_fn or seek_fn
+ * call, and before close_fn.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param nbytes number of bytes mpv wants to read (a hint)
+ * @param data set by the callback to the lent data
+ * @param buf_ctx set by the callback to a value identifying the lent data
+ * @return number of bytes at *data
+ * @return 0 on EOF
+ * @return -1 on error
+ */
+typedef int64_t (*mpv_stream_cb_lend_fn)(void *cookie, uint64_t nbytes,
+                                         const char **data, void **buf_ctx);
+
+/**
+ * Release data lent with mpv_stream_cb_lend_fn.
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param buf_ctx the value set by the corresponding lend_fn call
+ */
+typedef void (*mpv_stream_cb_release_fn)(void *cookie, void *buf_ctx);
+
 /**
  * See mpv_stream_cb_open_ro_fn callback.
  */
@@ -170,12 +204,19 @@ typedef struct mpv_stream_cb_info {
      * Callbacks set by the user in the mpv_stream_cb_open_ro_fn callback. Some
      * of them are optional, and can be left unset.
      *
-     * The following callbacks are mandatory: read_fn, close_fn
+     * The following callbacks are mandatory: read_fn (or lend_fn and
+     * release_fn), close_fn
      */
     mpv_stream_cb_read_fn read_fn;
     mpv_stream_cb_seek_fn seek_fn;
     mpv_stream_cb_size_fn size_fn;
     mpv_stream_cb_close_fn close_fn;
+    /**
+     * If set (together with release_fn), this is used instead of read_fn.
+     * Since client API version 1.25.
+     */
+    mpv_stream_cb_lend_fn lend_fn;
+    mpv_stream_cb_release_fn release_fn;
 } mpv_stream_cb_info;
 
 /**
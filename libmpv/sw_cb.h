@@ -0,0 +1,140 @@
+/* Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Note: the client API is licensed under ISC (see above) to ease
+ * interoperability with other licenses. But keep in mind that the
+ * mpv core is still mostly GPLv2+. It's up to lawyers to decide
+ * whether applications using this API are affected by the GPL.
+ * One argument against this is that proprietary applications
+ * using mplayer in slave mode is apparently tolerated, and this
+ * API is basically equivalent to slave mode.
+ */
+
+#ifndef MPV_CLIENT_API_SW_CB_H_
+#define MPV_CLIENT_API_SW_CB_H_
+
+#include <stddef.h>
+
+#include "client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Warning: this API is not stable yet.
+ *
+ * Overview
+ * --------
+ *
+ * This API can be used to make mpv render video into memory buffers provided
+ * by the host application, without any GPU involvement. Video frames are
+ * scaled and converted to the requested format, and OSD and subtitles are
+ * blended into them, all directly into the buffers (there is no intermediate
+ * copy). Once a frame is due for display, mpv calls a presentation callback.
+ *
+ * Usage
+ * -----
+ *
+ * - get the context with mpv_get_sub_api(MPV_SUB_API_SW_CB)
+ * - call mpv_sw_cb_init() with the output format and size, and your
+ *   presentation callback
+ * - register your buffers with mpv_sw_cb_add_buffer()
+ * - set the "vo" option to "sw-cb", and start playback
+ * - when the presentation callback is called, the buffer it passes now
+ *   contains a frame, and belongs to you until you call
+ *   mpv_sw_cb_release_buffer() on it
+ * - call mpv_sw_cb_uninit() before destroying the mpv core, and before
+ *   freeing the buffer memory
+ *
+ * If all buffers are held by the host application when mpv wants to render a
+ * new frame, the frame is dropped. At least 2 buffers should be registered to
+ * avoid dropping frames while the application processes the previous one.
+ *
+ * Threading
+ * ---------
+ *
+ * All functions of this API are thread-safe. The presentation callback is
+ * called from an mpv internal thread, and must not call any libmpv API
+ * functions, except mpv_sw_cb_release_buffer(). It should return quickly, as
+ * video output is blocked while it runs.
+ */
+
+/**
+ * Opaque context, returned by mpv_get_sub_api(MPV_SUB_API_SW_CB).
+ */
+typedef struct mpv_sw_cb_context mpv_sw_cb_context;
+
+/**
+ * Called when a frame was rendered into the given buffer and is due for
+ * display. The buffer is owned by the API user until it is released with
+ * mpv_sw_cb_release_buffer().
+ *
+ * @param cb_ctx the present_ctx parameter passed to mpv_sw_cb_init()
+ * @param buffer the buffer index, as returned by mpv_sw_cb_add_buffer()
+ * @param pts the timestamp of the video frame, in seconds (0 if unknown)
+ */
+typedef void (*mpv_sw_cb_present_fn)(void *cb_ctx, int buffer, double pts);
+
+/**
+ * Set the output format. Can be called only once, until mpv_sw_cb_uninit().
+ *
+ * @param format the pixel format name, as used by --vf=format. Only formats
+ *               with a single plane are supported, such as "bgr0", "rgb0",
+ *               "rgb24", "gray" or "yuyv422".
+ * @param w width of the buffers in pixels
+ * @param h height of the buffers in pixels
+ * @param present the presentation callback; must not be NULL
+ * @param present_ctx opaque pointer passed to the presentation callback
+ * @return error code, e.g. MPV_ERROR_UNSUPPORTED for unsupported formats
+ */
+int mpv_sw_cb_init(mpv_sw_cb_context *ctx, const char *format, int w, int h,
+                   mpv_sw_cb_present_fn present, void *present_ctx);
+
+/**
+ * Register a buffer of the size given to mpv_sw_cb_init(). The memory must
+ * remain valid until mpv_sw_cb_uninit() has returned. Can be called at any
+ * time after mpv_sw_cb_init().
+ *
+ * @param data start of the buffer's first line
+ * @param stride bytes between the start of two lines; must be at least as
+ *               big as the width multiplied with the bytes per pixel
+ * @return the buffer index (>= 0), or an error code (< 0)
+ */
+int mpv_sw_cb_add_buffer(mpv_sw_cb_context *ctx, void *data, size_t stride);
+
+/**
+ * Give a presented buffer back to mpv, so that it can render new frames into
+ * it. Can be called from the presentation callback.
+ *
+ * @param buffer the buffer index, as passed to the presentation callback
+ * @return error code
+ */
+int mpv_sw_cb_release_buffer(mpv_sw_cb_context *ctx, int buffer);
+
+/**
+ * Destroy the video output (which also stops video playback), and unregister
+ * all buffers. After this returns, mpv doesn't access the buffers anymore, and
+ * the presentation callback is not called again. You can call
+ * mpv_sw_cb_init() again afterwards.
+ *
+ * @return error code
+ */
+int mpv_sw_cb_uninit(mpv_sw_cb_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
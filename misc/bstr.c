@@ -66,10 +66,8 @@ int bstrcasecmp(struct bstr str1, struct bstr str2)
 
 int bstrchr(struct bstr str, int c)
 {
-    for (int i = 0; i < str.len; i++)
-        if (str.start[i] == c)
-            return i;
-    return -1;
+    unsigned char *p = str.len ? memchr(str.start, c, str.len) : NULL;
+    return p ? p - str.start : -1;
 }
 
 int bstrrchr(struct bstr str, int c)
@@ -80,29 +78,59 @@ int bstrrchr(struct bstr str, int c)
     return -1;
 }
 
-int bstrcspn(struct bstr str, const char *reject)
+// Lookup table for the chars in set. Like strchr(), this includes the
+// terminating 0 byte.
+static void make_charset(bool table[256], const char *set)
 {
+    memset(table, 0, 256 * sizeof(table[0]));
+    for (const unsigned char *s = set; *s; s++)
+        table[*s] = true;
+    table[0] = true;
+}
+
+static int span(struct bstr str, const char *set, bool in_set)
+{
+    bool table[256];
+    make_charset(table, set);
     int i;
     for (i = 0; i < str.len; i++)
-        if (strchr(reject, str.start[i]))
+        if (table[str.start[i]] != in_set)
             break;
     return i;
 }
 
+int bstrcspn(struct bstr str, const char *reject)
+{
+    if (reject[0] && !reject[1]) {
+        // Common case: single char (plus the 0 byte, as with the table).
+        int len = bstrchr(str, reject[0]);
+        if (len < 0)
+            len = str.len;
+        int z = bstrchr(bstr_splice(str, 0, len), 0);
+        return z >= 0 ? z : len;
+    }
+    return span(str, reject, false);
+}
+
 int bstrspn(struct bstr str, const char *accept)
 {
-    int i;
-    for (i = 0; i < str.len; i++)
-        if (!strchr(accept, str.start[i]))
-            break;
-    return i;
+    return span(str, accept, true);
 }
 
 int bstr_find(struct bstr haystack, struct bstr needle)
 {
-    for (int i = 0; i < haystack.len; i++)
-        if (bstr_startswith(bstr_splice(haystack, i, haystack.len), needle))
-            return i;
+    if (!needle.len)
+        return haystack.len ? 0 : -1;
+    if (needle.len > haystack.len)
+        return -1;
+    // memchr() is usually vectorized, so look for the first byte with it.
+    unsigned char *p = haystack.start;
+    unsigned char *end = haystack.start + haystack.len - needle.len + 1;
+    while (p < end && (p = memchr(p, needle.start[0], end - p))) {
+        if (memcmp(p + 1, needle.start + 1, needle.len - 1) == 0)
+            return p - haystack.start;
+        p++;
+    }
     return -1;
 }
 
@@ -125,12 +153,17 @@ struct bstr bstr_strip(struct bstr str)
 
 struct bstr bstr_split(struct bstr str, const char *sep, struct bstr *rest)
 {
+    bool table[256];
+    make_charset(table, sep);
     int start;
     for (start = 0; start < str.len; start++)
-        if (!strchr(sep, str.start[start]))
+        if (!table[str.start[start]])
             break;
     str = bstr_cut(str, start);
-    int end = bstrcspn(str, sep);
+    int end;
+    for (end = 0; end < str.len; end++)
+        if (table[str.start[end]])
+            break;
     if (rest) {
         *rest = bstr_cut(str, end);
     }
@@ -197,17 +230,17 @@ struct bstr *bstr_splitlines(void *talloc_ctx, struct bstr str)
 {
     if (str.len == 0)
         return NULL;
+    unsigned char *end = str.start + str.len;
     int count = 0;
-    for (int i = 0; i < str.len; i++)
-        if (str.start[i] == '\n')
-            count++;
+    for (unsigned char *p = str.start; (p = memchr(p, '\n', end - p)); p++)
+        count++;
     if (str.start[str.len - 1] != '\n')
         count++;
     struct bstr *r = talloc_array_ptrtype(talloc_ctx, r, count);
     unsigned char *p = str.start;
     for (int i = 0; i < count - 1; i++) {
         r[i].start = p;
-        while (*p++ != '\n');
+        p = (unsigned char *)memchr(p, '\n', end - p) + 1;
         r[i].len = p - r[i].start;
     }
     r[count - 1].start = p;
@@ -322,6 +355,22 @@ struct bstr bstr_split_utf8(struct bstr str, struct bstr *out_next)
 int bstr_validate_utf8(struct bstr s)
 {
     while (s.len) {
+        // Skip ASCII 8 bytes at a time; this is most text.
+        while (s.len >= 8) {
+            uint64_t v;
+            memcpy(&v, s.start, 8);
+            if (v & 0x8080808080808080ULL)
+                break;
+            s.start += 8;
+            s.len -= 8;
+        }
+        if (!s.len)
+            break;
+        if (s.start[0] < 128) {
+            s.start++;
+            s.len--;
+            continue;
+        }
         if (bstr_decode_utf8(s, &s) < 0) {
             // Try to guess whether the sequence was just cut-off.
             unsigned int codepoint = (unsigned char)s.start[0];
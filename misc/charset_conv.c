@@ -64,8 +64,18 @@ static const char *ms_bom_guess(bstr buf)
 }
 
 #if HAVE_UCHARDET
+// Detection on more data is slow, and rarely changes the result.
+#define UCHARDET_MAX_BYTES (256 * 1024)
+
 static const char *mp_uchardet(void *talloc_ctx, struct mp_log *log, bstr buf)
 {
+    if (buf.len > UCHARDET_MAX_BYTES) {
+        // Cut at a line break to avoid splitting a multibyte char.
+        bstr head = bstr_splice(buf, 0, UCHARDET_MAX_BYTES);
+        int pos = bstrrchr(head, '\n');
+        buf = pos > 0 ? bstr_splice(head, 0, pos + 1) : head;
+    }
+
     uchardet_t det = uchardet_new();
     if (!det)
         return NULL;
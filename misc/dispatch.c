@@ -19,19 +19,28 @@
 #include <assert.h>
 
 #include "common/common.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "dispatch.h"
 
 struct mp_dispatch_queue {
+    // Items taken from pending, in order. Accessed under lock only.
     struct mp_dispatch_item *head, *tail;
+    // Lock-free stack (newest first) of newly appended items, as
+    // struct mp_dispatch_item*. Senders push to it without taking the lock;
+    // mp_dispatch_queue_process() moves all of it to head/tail at once.
+    atomic_uintptr_t pending;
+    // Number of threads sleeping in mp_dispatch_queue_process() waiting for
+    // new items. Senders signal cond only if this is non-0.
+    atomic_int sleepers;
     pthread_mutex_t lock;
     pthread_cond_t cond;
     void (*wakeup_fn)(void *wakeup_ctx);
     void *wakeup_ctx;
     // Make mp_dispatch_queue_process() exit if it's idle.
-    bool interrupted;
+    atomic_bool interrupted;
     // The target thread is blocked by mp_dispatch_queue_process(). Note that
     // mp_dispatch_lock() can set this from true to false to keep the thread
     // blocked (this stops if from processing other dispatch items, and from
@@ -67,6 +76,7 @@ static void queue_dtor(void *p)
 {
     struct mp_dispatch_queue *queue = p;
     assert(!queue->head);
+    assert(!atomic_load(&queue->pending));
     assert(!queue->idling);
     assert(!queue->lock_request);
     assert(!queue->frame);
@@ -88,6 +98,9 @@ struct mp_dispatch_queue *mp_dispatch_create(void *ta_parent)
     struct mp_dispatch_queue *queue = talloc_ptrtype(ta_parent, queue);
     *queue = (struct mp_dispatch_queue){0};
     talloc_set_destructor(queue, queue_dtor);
+    atomic_store(&queue->pending, 0);
+    atomic_store(&queue->sleepers, 0);
+    atomic_store(&queue->interrupted, false);
     pthread_mutex_init(&queue->lock, NULL);
     pthread_cond_init(&queue->cond, NULL);
     return queue;
@@ -112,25 +125,53 @@ void mp_dispatch_set_wakeup_fn(struct mp_dispatch_queue *queue,
 static void mp_dispatch_append(struct mp_dispatch_queue *queue,
                                struct mp_dispatch_item *item)
 {
-    pthread_mutex_lock(&queue->lock);
-    if (queue->tail) {
-        queue->tail->next = item;
-    } else {
-        queue->head = item;
-    }
-    queue->tail = item;
-    // Wake up the main thread; note that other threads might wait on this
-    // condition for reasons, so broadcast the condition.
-    pthread_cond_broadcast(&queue->cond);
     // No wakeup callback -> assume mp_dispatch_queue_process() needs to be
     // interrupted instead.
     if (!queue->wakeup_fn)
-        queue->interrupted = true;
-    pthread_mutex_unlock(&queue->lock);
+        atomic_store(&queue->interrupted, true);
+    uintptr_t head = atomic_load(&queue->pending);
+    do {
+        item->next = (struct mp_dispatch_item *)head;
+    } while (!atomic_compare_exchange_strong(&queue->pending, &head,
+                                             (uintptr_t)item));
+    // Wake up the target thread if it's waiting for items. It sets sleepers
+    // and checks pending under the lock before waiting, so taking the lock
+    // here can't miss it. (Both sides use sequentially consistent atomics.)
+    if (atomic_load(&queue->sleepers)) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_broadcast(&queue->cond);
+        pthread_mutex_unlock(&queue->lock);
+    }
     if (queue->wakeup_fn)
         queue->wakeup_fn(queue->wakeup_ctx);
 }
 
+// Move all pending items to the locked queue. Must be called with lock held.
+// Returns whether there are items to process.
+static bool fetch_pending(struct mp_dispatch_queue *queue)
+{
+    uintptr_t list = atomic_load(&queue->pending);
+    while (list && !atomic_compare_exchange_strong(&queue->pending, &list, 0)) {}
+    if (list) {
+        // The stack is newest first; reverse it into append order.
+        struct mp_dispatch_item *last = (struct mp_dispatch_item *)list;
+        struct mp_dispatch_item *items = NULL;
+        while (list) {
+            struct mp_dispatch_item *item = (struct mp_dispatch_item *)list;
+            list = (uintptr_t)item->next;
+            item->next = items;
+            items = item;
+        }
+        if (queue->tail) {
+            queue->tail->next = items;
+        } else {
+            queue->head = items;
+        }
+        queue->tail = last;
+    }
+    return !!queue->head;
+}
+
 // Enqueue a callback to run it on the target thread asynchronously. The target
 // thread will run fn(fn_data) as soon as it enter mp_dispatch_queue_process.
 // Note that mp_dispatch_enqueue() will usually return long before that happens.
@@ -225,7 +266,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
             pthread_cond_wait(&queue->cond, &queue->lock);
             if (queue->frame == &frame && !frame.locked)
                 assert(queue->idling);
-        } else if (queue->head) {
+        } else if (queue->head || fetch_pending(queue)) {
             struct mp_dispatch_item *item = queue->head;
             queue->head = item->next;
             if (!queue->head)
@@ -240,20 +281,28 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 
             item->fn(item->fn_data);
 
+            // Asynchronous items are owned by this function; free them
+            // outside of the lock.
+            bool asynchronous = item->asynchronous;
+            if (asynchronous)
+                talloc_free(item);
+
             pthread_mutex_lock(&queue->lock);
             assert(!queue->idling);
             queue->idling = true;
             // Wakeup mp_dispatch_run(), also mp_dispatch_lock().
             pthread_cond_broadcast(&queue->cond);
-            if (item->asynchronous) {
-                talloc_free(item);
-            } else {
+            if (!asynchronous)
                 item->completed = true;
+        } else if (wait > 0 && !atomic_load(&queue->interrupted)) {
+            atomic_fetch_add(&queue->sleepers, 1);
+            // Recheck after announcing the wait; see mp_dispatch_append().
+            if (!atomic_load(&queue->pending)) {
+                struct timespec ts = mp_time_us_to_timespec(wait);
+                if (pthread_cond_timedwait(&queue->cond, &queue->lock, &ts))
+                    wait = 0;
             }
-        } else if (wait > 0 && !queue->interrupted) {
-            struct timespec ts = mp_time_us_to_timespec(wait);
-            if (pthread_cond_timedwait(&queue->cond, &queue->lock, &ts))
-                wait = 0;
+            atomic_fetch_add(&queue->sleepers, -1);
         } else {
             break;
         }
@@ -262,7 +311,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     assert(!frame.locked);
     assert(queue->frame == &frame);
     queue->frame = frame.prev;
-    queue->interrupted = false;
+    atomic_store(&queue->interrupted, false);
     pthread_mutex_unlock(&queue->lock);
 }
 
@@ -275,7 +324,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 void mp_dispatch_interrupt(struct mp_dispatch_queue *queue)
 {
     pthread_mutex_lock(&queue->lock);
-    queue->interrupted = true;
+    atomic_store(&queue->interrupted, true);
     pthread_cond_broadcast(&queue->cond);
     pthread_mutex_unlock(&queue->lock);
 }
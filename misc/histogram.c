@@ -0,0 +1,129 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "histogram.h"
+
+// Percentiles reported by mp_histogram_get_node().
+static const int percentiles[] = {50, 90, 95, 99};
+
+struct mp_histogram *mp_histogram_create(void *ta_parent, double unit,
+                                         int first, int bin_size, int num_bins)
+{
+    assert(unit > 0 && bin_size > 0 && num_bins > 0);
+    struct mp_histogram *h = talloc_zero(ta_parent, struct mp_histogram);
+    h->unit = unit;
+    h->first = first;
+    h->bin_size = bin_size;
+    h->num_bins = num_bins;
+    h->bins = talloc_zero_array(h, int64_t, num_bins);
+    return h;
+}
+
+void mp_histogram_reset(struct mp_histogram *h)
+{
+    h->count = 0;
+    h->sum = h->min = h->max = 0;
+    memset(h->bins, 0, h->num_bins * sizeof(h->bins[0]));
+}
+
+void mp_histogram_add(struct mp_histogram *h, double value)
+{
+    if (!isfinite(value))
+        return;
+    if (!h->count || value < h->min)
+        h->min = value;
+    if (!h->count || value > h->max)
+        h->max = value;
+    h->count++;
+    h->sum += value;
+    double pos = (rint(value / h->unit) - h->first) / h->bin_size;
+    h->bins[(int)MPCLAMP(floor(pos), 0, h->num_bins - 1)]++;
+}
+
+double mp_histogram_get_percentile(struct mp_histogram *h, int p)
+{
+    int64_t target = MPMAX(1, (h->count * p + 99) / 100);
+    int64_t sum = 0;
+    for (int n = 0; n < h->num_bins; n++) {
+        sum += h->bins[n];
+        if (sum >= target) {
+            double v = (h->first + (double)n * h->bin_size) * h->unit;
+            return MPCLAMP(v, h->min, h->max);
+        }
+    }
+    return h->max;
+}
+
+void mp_histogram_get_node(struct mp_histogram *h, struct mpv_node *dst,
+                           bool bins)
+{
+    node_map_add(dst, "count", MPV_FORMAT_INT64)->u.int64 = h->count;
+    if (!h->count)
+        return;
+    node_map_add(dst, "min", MPV_FORMAT_DOUBLE)->u.double_ = h->min;
+    node_map_add(dst, "max", MPV_FORMAT_DOUBLE)->u.double_ = h->max;
+    node_map_add(dst, "mean", MPV_FORMAT_DOUBLE)->u.double_ = h->sum / h->count;
+    for (int n = 0; n < MP_ARRAY_SIZE(percentiles); n++) {
+        char key[10];
+        snprintf(key, sizeof(key), "p%d", percentiles[n]);
+        node_map_add(dst, key, MPV_FORMAT_DOUBLE)->u.double_ =
+            mp_histogram_get_percentile(h, percentiles[n]);
+    }
+    if (!bins)
+        return;
+    struct mpv_node *list = node_map_add(dst, "histogram", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < h->num_bins; n++) {
+        if (!h->bins[n])
+            continue;
+        struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_ARRAY);
+        node_array_add(e, MPV_FORMAT_INT64)->u.int64 = h->first + n * h->bin_size;
+        node_array_add(e, MPV_FORMAT_INT64)->u.int64 = h->bins[n];
+    }
+}
+
+bool mp_append_json_line(struct mp_log *log, const char *path,
+                         struct mpv_node *node)
+{
+    bool ok = false;
+    char *s = talloc_strdup(NULL, "");
+    if (json_write(&s, node) < 0) {
+        mp_err(log, "Could not serialize results.\n");
+        goto done;
+    }
+    FILE *f = fopen(path, "a");
+    if (!f) {
+        mp_err(log, "Could not open '%s'.\n", path);
+        goto done;
+    }
+    fprintf(f, "%s\n", s);
+    ok = fclose(f) == 0;
+    if (!ok)
+        mp_err(log, "Error writing '%s'.\n", path);
+done:
+    talloc_free(s);
+    return ok;
+}
@@ -0,0 +1,44 @@
+#ifndef MP_MISC_HISTOGRAM_H_
+#define MP_MISC_HISTOGRAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mpv_node;
+struct mp_log;
+
+// Fixed-size histogram of values in seconds, for distributions of times that
+// are recorded for a long time (memory use and recording cost are constant).
+// Values are rounded to integer multiples of unit (in seconds). Bin n counts
+// the rounded values in [first + n * bin_size, first + (n + 1) * bin_size).
+// Values outside of the range are counted in the first/last bin (min/max are
+// still exact).
+struct mp_histogram {
+    int64_t count;
+    double sum, min, max;   // in seconds
+    // Read-only.
+    double unit;
+    int first, bin_size, num_bins;
+    int64_t *bins;
+};
+
+struct mp_histogram *mp_histogram_create(void *ta_parent, double unit,
+                                         int first, int bin_size, int num_bins);
+void mp_histogram_reset(struct mp_histogram *h);
+// Non-finite values are ignored.
+void mp_histogram_add(struct mp_histogram *h, double value);
+// Value (in seconds) below which p percent of the values fall. The result is
+// the lower end of the bin, clamped to min/max.
+double mp_histogram_get_percentile(struct mp_histogram *h, int p);
+// Add count, min, max, mean and common percentiles to the map dst. If bins is
+// set, also add the non-empty bins as "histogram" list of [value, count]
+// pairs, with the value in units.
+void mp_histogram_get_node(struct mp_histogram *h, struct mpv_node *dst,
+                           bool bins);
+
+// Append node as a single line of JSON to the file at path, so one file can
+// collect one object per played file. Errors are logged to log.
+bool mp_append_json_line(struct mp_log *log, const char *path,
+                         struct mpv_node *node);
+
+#endif
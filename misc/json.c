@@ -82,14 +82,17 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     char *str = *src;
     char *cur = str;
     bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
-        }
-        cur++;
+    while (1) {
+        // strcspn() is vectorized by the usual libcs, unlike a byte loop.
+        cur += strcspn(cur, "\"\\");
+        if (cur[0] != '\\')
+            break;
+        has_escapes = true;
+        // skip >\"< and >\\< (latter to handle >\\"< correctly)
+        if (cur[1] == '"' || cur[1] == '\\')
+            cur++;
+        if (cur[0])
+            cur++;
     }
     if (cur[0] != '"')
         return -1; // invalid termination
@@ -109,6 +112,34 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     return 0;
 }
 
+// Fast path for plain decimal integers, which are most numbers in practice.
+// Returns false if the number needs the full strtoll()/strtod() treatment
+// (fractions, exponents, leading zeros, possible overflow).
+static bool read_simple_int(struct mpv_node *dst, char **src)
+{
+    char *cur = *src;
+    bool neg = cur[0] == '-';
+    cur += neg;
+    int64_t v = 0;
+    int digits = 0;
+    // 18 digits can't overflow
+    while (cur[0] >= '0' && cur[0] <= '9' && digits < 18) {
+        v = v * 10 + (cur[0] - '0');
+        cur++;
+        digits++;
+    }
+    if (!digits || (digits > 1 && (*src)[neg] == '0'))
+        return false;
+    char c = cur[0];
+    if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+        c == 'x' || c == 'X')
+        return false;
+    *src = cur;
+    dst->format = MPV_FORMAT_INT64;
+    dst->u.int64 = neg ? -v : v;
+    return true;
+}
+
 static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
                     int max_depth)
 {
@@ -187,6 +218,8 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
     } else if (c == '[' || c == '{') {
         return read_sub(ta_parent, dst, src, max_depth);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
+        if (read_simple_int(dst, src))
+            return 0;
         // The number could be either a float or an int. JSON doesn't make a
         // difference, but the client API does.
         char *nsrci = *src, *nsrcf = *src;
@@ -216,64 +249,161 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 }
 
 
-#define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
+// Output buffer. Unlike bstr_xappend(), appending only checks the cached
+// allocation size, and null-termination is done once at the end.
+struct json_out {
+    bstr b;
+    size_t size;        // allocated size of b.start
+};
+
+static void out_reserve(struct json_out *o, size_t len)
+{
+    if (len < o->size - o->b.len)
+        return;
+    if (o->size >= SIZE_MAX / 4 || len >= SIZE_MAX / 4)
+        abort(); // oom
+    o->size = MPMAX(o->size * 2, o->b.len + len + 1);
+    o->b.start = talloc_realloc_size(NULL, o->b.start, o->size);
+}
+
+static void out_append(struct json_out *o, const void *data, size_t len)
+{
+    out_reserve(o, len);
+    memcpy(o->b.start + o->b.len, data, len);
+    o->b.len += len;
+}
+
+#define APPEND(o, s) out_append((o), (s), strlen(s))
+
+// True if any of the 8 bytes in x is < 32, '"' or '\'. (A 0 byte is < 32.)
+static bool word_needs_escape(uint64_t x)
+{
+    const uint64_t ones = ~(uint64_t)0 / 255, highs = ones * 128;
+    uint64_t q = x ^ (ones * '"'), bs = x ^ (ones * '\\');
+    return (((x - ones * 32) & ~x) | ((q - ones) & ~q) | ((bs - ones) & ~bs))
+           & highs;
+}
 
-static void write_json_str(bstr *b, unsigned char *str)
+static void write_json_str(struct json_out *o, unsigned char *str)
 {
-    APPEND(b, "\"");
+    unsigned char *end = str + strlen(str);
+    out_reserve(o, end - str + 2);
+    APPEND(o, "\"");
     while (1) {
         unsigned char *cur = str;
-        while (cur[0] && cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
+        // Skip 8 bytes at a time while none of them needs escaping.
+        while (end - cur >= 8) {
+            uint64_t x;
+            memcpy(&x, cur, 8);
+            if (word_needs_escape(x))
+                break;
+            cur += 8;
+        }
+        while (cur < end && cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
             cur++;
-        if (!cur[0])
+        out_append(o, str, cur - str);
+        if (cur == end)
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
-        bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+        static const char hex[] = "0123456789abcdef";
+        char esc[6] = {'\\', 'u', '0', '0', hex[cur[0] >> 4], hex[cur[0] & 15]};
+        out_append(o, esc, 6);
         str = cur + 1;
     }
-    APPEND(b, str);
-    APPEND(b, "\"");
+    APPEND(o, "\"");
+}
+
+static void write_json_int(struct json_out *o, int64_t v)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    uint64_t u = v < 0 ? -(uint64_t)v : v;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (v < 0)
+        *--p = '-';
+    out_append(o, p, buf + sizeof(buf) - p);
 }
 
-static int json_append(bstr *b, const struct mpv_node *src)
+static void write_json_double(struct json_out *o, double v)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%f", v);
+    if (len < sizeof(buf)) {
+        out_append(o, buf, len);
+    } else {
+        // Huge values: let snprintf write into the buffer directly.
+        out_reserve(o, len);
+        snprintf(o->b.start + o->b.len, len + 1, "%f", v);
+        o->b.len += len;
+    }
+}
+
+static int json_append(struct json_out *o, const struct mpv_node *src)
 {
     switch (src->format) {
     case MPV_FORMAT_NONE:
-        APPEND(b, "null");
+        APPEND(o, "null");
         return 0;
     case MPV_FORMAT_FLAG:
-        APPEND(b, src->u.flag ? "true" : "false");
+        APPEND(o, src->u.flag ? "true" : "false");
         return 0;
     case MPV_FORMAT_INT64:
-        bstr_xappend_asprintf(NULL, b, "%"PRId64, src->u.int64);
+        write_json_int(o, src->u.int64);
         return 0;
     case MPV_FORMAT_DOUBLE:
-        bstr_xappend_asprintf(NULL, b, "%f", src->u.double_);
+        write_json_double(o, src->u.double_);
         return 0;
     case MPV_FORMAT_STRING:
-        write_json_str(b, src->u.string);
+        write_json_str(o, src->u.string);
         return 0;
     case MPV_FORMAT_NODE_ARRAY:
     case MPV_FORMAT_NODE_MAP: {
         struct mpv_node_list *list = src->u.list;
         bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
-        APPEND(b, is_obj ? "{" : "[");
+        APPEND(o, is_obj ? "{" : "[");
         for (int n = 0; n < list->num; n++) {
             if (n)
-                APPEND(b, ",");
+                APPEND(o, ",");
             if (is_obj) {
-                write_json_str(b, list->keys[n]);
-                APPEND(b, ":");
+                write_json_str(o, list->keys[n]);
+                APPEND(o, ":");
             }
-            json_append(b, &list->values[n]);
+            json_append(o, &list->values[n]);
         }
-        APPEND(b, is_obj ? "}" : "]");
+        APPEND(o, is_obj ? "}" : "]");
         return 0;
     }
     }
     return -1; // unknown format
 }
 
+// Approximate size of the JSON output for src. Exact for strings without
+// characters that need escaping.
+static size_t estimate_size(const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:       return 4;
+    case MPV_FORMAT_FLAG:       return 5;
+    case MPV_FORMAT_INT64:      return 20;
+    case MPV_FORMAT_DOUBLE:     return 16;
+    case MPV_FORMAT_STRING:     return strlen(src->u.string) + 2;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        size_t size = 2;
+        for (int n = 0; n < list->num; n++) {
+            size += estimate_size(&list->values[n]) + 1;
+            if (src->format == MPV_FORMAT_NODE_MAP)
+                size += strlen(list->keys[n]) + 3;
+        }
+        return size;
+    }
+    }
+    return 0;
+}
+
 /* Write the contents of *src as JSON, and append the JSON string to *dst.
  * This will use strlen() to determine the start offset, and ta_get_size()
  * and ta_realloc() to extend the memory allocation of *dst.
@@ -281,8 +411,14 @@ static int json_append(bstr *b, const struct mpv_node *src)
  */
 int json_write(char **dst, struct mpv_node *src)
 {
-    bstr buffer = bstr0(*dst);
-    int r = json_append(&buffer, src);
-    *dst = buffer.start;
+    struct json_out o = {
+        .b = bstr0(*dst),
+        .size = talloc_get_size(*dst),
+    };
+    // Allocate the whole output at once in the common case.
+    out_reserve(&o, estimate_size(src));
+    int r = json_append(&o, src);
+    o.b.start[o.b.len] = '\0';
+    *dst = (char *)o.b.start;
     return r;
 }
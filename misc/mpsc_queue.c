@@ -0,0 +1,105 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Each slot has a sequence number, which tells whether the slot is free for
+// the producer at position pos (seq == pos), or filled for the consumer at
+// position pos (seq == pos + 1). Producers claim positions by incrementing
+// the shared head with a CAS, so a slot is written by one producer only.
+// (This is the bounded queue described by Dmitry Vyukov, with a single
+// consumer, which needs no CAS.)
+
+#include <string.h>
+#include <assert.h>
+
+#include "mpv_talloc.h"
+#include "osdep/atomic.h"
+#include "mpsc_queue.h"
+
+#define CACHE_LINE_SIZE 64
+
+struct mp_mpsc_queue {
+    char *data;
+    atomic_ullong *seqs;
+    size_t elem_size;
+    unsigned long long mask;
+
+    char pad0[CACHE_LINE_SIZE];
+    atomic_ullong head;         // next position to push
+    char pad1[CACHE_LINE_SIZE];
+    unsigned long long tail;    // next position to pop (consumer only)
+    char pad2[CACHE_LINE_SIZE];
+};
+
+struct mp_mpsc_queue *mp_mpsc_queue_new(void *talloc_ctx, size_t elem_size,
+                                        int size)
+{
+    assert(size > 0);
+    int num = 1;
+    while (num < size)
+        num *= 2;
+
+    struct mp_mpsc_queue *queue = talloc_zero(talloc_ctx, struct mp_mpsc_queue);
+    queue->elem_size = elem_size;
+    queue->mask = num - 1;
+    queue->data = talloc_size(queue, elem_size * num);
+    queue->seqs = talloc_array(queue, atomic_ullong, num);
+    for (int n = 0; n < num; n++)
+        atomic_store(&queue->seqs[n], n);
+    atomic_store(&queue->head, 0);
+    return queue;
+}
+
+int mp_mpsc_queue_size(struct mp_mpsc_queue *queue)
+{
+    return queue->mask + 1;
+}
+
+bool mp_mpsc_queue_push(struct mp_mpsc_queue *queue, const void *elem)
+{
+    unsigned long long pos = atomic_load(&queue->head);
+    atomic_ullong *seq;
+    while (1) {
+        seq = &queue->seqs[pos & queue->mask];
+        long long diff = (long long)(atomic_load(seq) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_strong(&queue->head, &pos, pos + 1))
+                break;
+            // pos was updated by the failed CAS.
+        } else if (diff < 0) {
+            return false; // the consumer hasn't freed this slot yet
+        } else {
+            pos = atomic_load(&queue->head);
+        }
+    }
+    memcpy(queue->data + (pos & queue->mask) * queue->elem_size, elem,
+           queue->elem_size);
+    atomic_store(seq, pos + 1);
+    return true;
+}
+
+bool mp_mpsc_queue_pop(struct mp_mpsc_queue *queue, void *elem)
+{
+    unsigned long long pos = queue->tail;
+    atomic_ullong *seq = &queue->seqs[pos & queue->mask];
+    if (atomic_load(seq) != pos + 1)
+        return false; // empty, or the producer is still writing it
+    memcpy(elem, queue->data + (pos & queue->mask) * queue->elem_size,
+           queue->elem_size);
+    atomic_store(seq, pos + queue->mask + 1);
+    queue->tail = pos + 1;
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPV_MP_MPSC_QUEUE_H
+#define MPV_MP_MPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * A bounded, non-blocking MPSC (multiple producers, single consumer) queue of
+ * fixed-size elements. Any number of threads can push concurrently, while one
+ * thread at a time pops. Both operations are lock-free if the atomics are.
+ */
+
+struct mp_mpsc_queue;
+
+/**
+ * Instantiate a new queue
+ *
+ * talloc_ctx: talloc context of the newly created object
+ * elem_size:  size of each element in bytes
+ * size:       minimum number of elements the queue can hold (rounded up to a
+ *             power of 2)
+ * return:     the newly created queue
+ */
+struct mp_mpsc_queue *mp_mpsc_queue_new(void *talloc_ctx, size_t elem_size,
+                                        int size);
+
+/**
+ * Get the number of elements the queue can hold
+ */
+int mp_mpsc_queue_size(struct mp_mpsc_queue *queue);
+
+/**
+ * Append a copy of an element. Can be called from any thread.
+ *
+ * queue:  target queue instance
+ * elem:   element to copy (elem_size bytes)
+ * return: false if the queue was full (nothing is written)
+ */
+bool mp_mpsc_queue_push(struct mp_mpsc_queue *queue, const void *elem);
+
+/**
+ * Remove the oldest element. Only one thread at a time can call this.
+ *
+ * queue:  target queue instance
+ * elem:   destination for the element (elem_size bytes)
+ * return: false if the queue was empty
+ */
+bool mp_mpsc_queue_pop(struct mp_mpsc_queue *queue, void *elem);
+
+#endif
@@ -24,13 +24,22 @@
 #include "osdep/atomic.h"
 #include "ring.h"
 
+// Typical cache line size. Keeping the reader and writer positions on separate
+// cache lines avoids false sharing between the producer and consumer threads.
+#define CACHE_LINE_SIZE 64
+
 struct mp_ring {
     uint8_t  *buffer;
+    int size;
 
     /* Positions of the first readable/writeable chunks. Do not read this
      * fields but use the atomic private accessors `mp_ring_get_wpos`
      * and `mp_ring_get_rpos`. */
-    atomic_ulong rpos, wpos;
+    char pad0[CACHE_LINE_SIZE];
+    atomic_ulong rpos;
+    char pad1[CACHE_LINE_SIZE];
+    atomic_ulong wpos;
+    char pad2[CACHE_LINE_SIZE];
 };
 
 static unsigned long mp_ring_get_wpos(struct mp_ring *buffer)
@@ -50,6 +59,7 @@ struct mp_ring *mp_ring_new(void *talloc_ctx, int size)
 
     *ringbuffer = (struct mp_ring) {
         .buffer = talloc_size(talloc_ctx, size),
+        .size   = size,
     };
 
     return ringbuffer;
@@ -111,7 +121,7 @@ int mp_ring_available(struct mp_ring *buffer)
 
 int mp_ring_size(struct mp_ring *buffer)
 {
-    return talloc_get_size(buffer->buffer);
+    return buffer->size;
 }
 
 int mp_ring_buffered(struct mp_ring *buffer)
@@ -23,6 +23,8 @@
 /**
  * A simple non-blocking SPSC (single producer, single consumer) ringbuffer
  * implementation. Thread safety is accomplished through atomic operations.
+ * Reading and writing are wait-free (no locks, no allocations, no syscalls)
+ * if the atomics are lock-free, so it can be used from realtime threads.
  */
 
 struct mp_ring;
@@ -57,6 +57,11 @@ struct m_config_shadow {
     pthread_mutex_t lock;
     struct m_config *root;
     char *data;
+    // Protected by lock. Each write access gets a new ts value, which is
+    // recorded for the option (opt_ts[] is indexed like root->opts) and set
+    // on all groups containing it.
+    long long ts;
+    long long *opt_ts;
 };
 
 // Represents a sub-struct (OPT_SUBSTRUCT()).
@@ -64,7 +69,7 @@ struct m_config_group {
     const struct m_sub_options *group; // or NULL for top-level options
     int parent_group;   // index of parent group in m_config.groups
     void *opts;         // pointer to group user option struct
-    atomic_llong ts;    // incremented on every write access
+    atomic_llong ts;    // increased on every write access
 };
 
 struct m_profile {
@@ -74,6 +79,13 @@ struct m_profile {
     int num_opts;
     // Option/value pair array.
     char **opts;
+    // Option each pair resolved to when it was added (num_opts items).
+    struct m_profile_opt *resolved;
+};
+
+struct m_profile_opt {
+    struct m_config_option *co;
+    bool negated;               // "no-foo" form, i.e. "foo=no"
 };
 
 // In the file local case, this contains the old global value.
@@ -205,6 +217,62 @@ static void add_options(struct m_config *config,
                         const void *optstruct_def,
                         const struct m_option *defs);
 
+static unsigned hash_name(bstr name)
+{
+    // FNV-1a
+    unsigned h = 2166136261u;
+    for (int n = 0; n < name.len; n++)
+        h = (h ^ name.start[n]) * 16777619u;
+    return h;
+}
+
+static bool is_wildcard_opt(struct m_config_option *co)
+{
+    return (co->opt->type->flags & M_OPT_TYPE_ALLOW_WILDCARD) &&
+           bstr_endswith0(bstr0(co->name), "*");
+}
+
+static int find_opt_index(const struct m_config *config, bstr name)
+{
+    unsigned h = hash_name(name) & config->opt_index_mask;
+    for (; config->opt_index[h] >= 0; h = (h + 1) & config->opt_index_mask) {
+        int i = config->opt_index[h];
+        if (bstr_equals0(name, config->opts[i].name))
+            return i;
+    }
+    return -1;
+}
+
+// Called once all options have been added.
+static void build_opt_index(struct m_config *config)
+{
+    // Keep the load factor at or below 50%.
+    unsigned size = 16;
+    while (size < config->num_opts * 2)
+        size *= 2;
+    config->opt_index_mask = size - 1;
+    config->opt_index = talloc_array(config, int, size);
+    for (int n = 0; n < size; n++)
+        config->opt_index[n] = -1;
+
+    for (int n = 0; n < config->num_opts; n++) {
+        struct m_config_option *co = &config->opts[n];
+        if (is_wildcard_opt(co)) {
+            MP_TARRAY_APPEND(config, config->wildcard_opts,
+                             config->num_wildcard_opts, n);
+            continue;
+        }
+        bstr name = bstr0(co->name);
+        // Duplicate names: the first option wins, as with a linear search.
+        if (find_opt_index(config, name) >= 0)
+            continue;
+        unsigned h = hash_name(name) & config->opt_index_mask;
+        while (config->opt_index[h] >= 0)
+            h = (h + 1) & config->opt_index_mask;
+        config->opt_index[h] = n;
+    }
+}
+
 static void config_destroy(void *p)
 {
     struct m_config *config = p;
@@ -247,6 +315,7 @@ struct m_config *m_config_new(void *talloc_ctx, struct mp_log *log,
 
     if (options)
         add_options(config, NULL, config->optstruct, defaults, options);
+    build_opt_index(config);
     return config;
 }
 
@@ -598,20 +667,20 @@ struct m_config_option *m_config_get_co_raw(const struct m_config *config,
     if (!name.len)
         return NULL;
 
-    for (int n = 0; n < config->num_opts; n++) {
-        struct m_config_option *co = &config->opts[n];
-        struct bstr coname = bstr0(co->name);
-        if ((co->opt->type->flags & M_OPT_TYPE_ALLOW_WILDCARD)
-                && bstr_endswith0(coname, "*")) {
-            coname.len--;
-            if (bstrcmp(bstr_splice(name, 0, coname.len), coname) == 0)
-                return co;
-        } else if (bstrcmp(coname, name) == 0) {
-            return co;
-        }
+    int found = find_opt_index(config, name);
+
+    // A wildcard option listed before the exact match takes precedence.
+    for (int n = 0; n < config->num_wildcard_opts; n++) {
+        int i = config->wildcard_opts[n];
+        if (found >= 0 && i > found)
+            break;
+        struct bstr coname = bstr0(config->opts[i].name);
+        coname.len--;
+        if (bstr_startswith(name, coname))
+            return &config->opts[i];
     }
 
-    return NULL;
+    return found >= 0 ? &config->opts[found] : NULL;
 }
 
 struct m_config_option *m_config_get_co(const struct m_config *config,
@@ -790,23 +859,29 @@ static struct m_config_option *m_config_find_negation_opt(struct m_config *confi
     return co;
 }
 
-static int m_config_parse_option(struct m_config *config, struct bstr name,
-                                 struct bstr param, int flags)
+// Resolve the option name, including aliases and "no-" negation. On success,
+// *name is set to the name as expected by the option itself.
+static int resolve_option(struct m_config *config, struct bstr *name,
+                          struct bstr param, struct m_profile_opt *res)
 {
-    assert(config != NULL);
-
-    struct m_config_option *co = m_config_get_co(config, name);
-    if (!co) {
-        co = m_config_find_negation_opt(config, &name);
-        if (!co)
+    *res = (struct m_profile_opt){ .co = m_config_get_co(config, *name) };
+    if (!res->co) {
+        res->co = m_config_find_negation_opt(config, name);
+        if (!res->co)
             return M_OPT_UNKNOWN;
 
         if (param.len)
             return M_OPT_DISALLOW_PARAM;
 
-        param = bstr0("no");
+        res->negated = true;
     }
+    return 0;
+}
 
+static int m_config_parse_co(struct m_config *config,
+                             struct m_config_option *co, struct bstr name,
+                             struct bstr param, int flags)
+{
     // This is the only mandatory function
     assert(co->opt->type->parse);
 
@@ -849,10 +924,22 @@ static int m_config_parse_option(struct m_config *config, struct bstr name,
     return r;
 }
 
-int m_config_set_option_ext(struct m_config *config, struct bstr name,
-                            struct bstr param, int flags)
+static int m_config_parse_option(struct m_config *config, struct bstr name,
+                                 struct bstr param, int flags)
+{
+    assert(config != NULL);
+
+    struct m_profile_opt res;
+    int r = resolve_option(config, &name, param, &res);
+    if (r < 0)
+        return r;
+
+    return m_config_parse_co(config, res.co, name,
+                             res.negated ? bstr0("no") : param, flags);
+}
+
+static int report_parse_error(struct m_config *config, struct bstr name, int r)
 {
-    int r = m_config_parse_option(config, name, param, flags);
     if (r < 0 && r != M_OPT_EXIT) {
         MP_ERR(config, "Error parsing option %.*s (%s)\n",
                BSTR_P(name), m_option_strerror(r));
@@ -861,6 +948,13 @@ int m_config_set_option_ext(struct m_config *config, struct bstr name,
     return r;
 }
 
+int m_config_set_option_ext(struct m_config *config, struct bstr name,
+                            struct bstr param, int flags)
+{
+    int r = m_config_parse_option(config, name, param, flags);
+    return report_parse_error(config, name, r);
+}
+
 int m_config_set_option(struct m_config *config, struct bstr name,
                                  struct bstr param)
 {
@@ -1049,14 +1143,24 @@ void m_profile_set_desc(struct m_profile *p, bstr desc)
 int m_config_set_profile_option(struct m_config *config, struct m_profile *p,
                                 bstr name, bstr val)
 {
-    int i = m_config_set_option_ext(config, name, val,
-                                    M_SETOPT_CHECK_ONLY |
-                                    M_SETOPT_FROM_CONFIG_FILE);
+    // Resolve the name only once, instead of on every m_config_set_profile().
+    struct m_profile_opt res;
+    bstr co_name = name;
+    int i = resolve_option(config, &co_name, val, &res);
+    if (i >= 0) {
+        i = m_config_parse_co(config, res.co, co_name,
+                              res.negated ? bstr0("no") : val,
+                              M_SETOPT_CHECK_ONLY | M_SETOPT_FROM_CONFIG_FILE);
+    }
+    i = report_parse_error(config, name, i);
     if (i < 0)
         return i;
     p->opts = talloc_realloc(p, p->opts, char *, 2 * (p->num_opts + 2));
     p->opts[p->num_opts * 2] = bstrto0(p, name);
     p->opts[p->num_opts * 2 + 1] = bstrto0(p, val);
+    p->resolved = talloc_realloc(p, p->resolved, struct m_profile_opt,
+                                 p->num_opts + 1);
+    p->resolved[p->num_opts] = res;
     p->num_opts++;
     p->opts[p->num_opts * 2] = p->opts[p->num_opts * 2 + 1] = NULL;
     return 1;
@@ -1076,10 +1180,15 @@ int m_config_set_profile(struct m_config *config, char *name, int flags)
     }
     config->profile_depth++;
     for (int i = 0; i < p->num_opts; i++) {
-        m_config_set_option_ext(config,
-                                bstr0(p->opts[2 * i]),
-                                bstr0(p->opts[2 * i + 1]),
-                                flags | M_SETOPT_FROM_CONFIG_FILE);
+        struct m_profile_opt *res = &p->resolved[i];
+        bstr name = bstr0(p->opts[2 * i]);
+        bstr co_name = name;
+        if (res->negated)
+            bstr_eatstart0(&co_name, "no-");
+        int r = m_config_parse_co(config, res->co, co_name,
+                    res->negated ? bstr0("no") : bstr0(p->opts[2 * i + 1]),
+                    flags | M_SETOPT_FROM_CONFIG_FILE);
+        report_parse_error(config, name, r);
     }
     config->profile_depth--;
 
@@ -1130,6 +1239,13 @@ void m_config_create_shadow(struct m_config *config)
     config->shadow->root = config;
     pthread_mutex_init(&config->shadow->lock, NULL);
 
+    config->shadow->opt_ts = talloc_zero_array(config->shadow, long long,
+                                               config->num_opts);
+    for (int n = 0; n < config->num_groups; n++) {
+        config->shadow->ts = MPMAX(config->shadow->ts,
+                                   atomic_load(&config->groups[n].ts));
+    }
+
     config->global->config = config->shadow;
 
     for (int n = 0; n < config->num_opts; n++) {
@@ -1176,6 +1292,11 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
     cache->ts = -1;
     cache->group = -1;
 
+    // Maps the options in the cache's config to the root config's.
+    cache->opt_index = talloc_array(cache, int, config->num_opts);
+    for (int n = 0; n < config->num_opts; n++)
+        cache->opt_index[n] = n;
+
     for (int n = 0; n < config->num_groups; n++) {
         if (config->groups[n].group == group) {
             cache->opts = config->groups[n].opts;
@@ -1196,6 +1317,7 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
         for (int n = 0; n < num_opts; n++) {
             struct m_config_option *co = &config->opts[n];
             if (is_group_included(config, co->group, cache->group)) {
+                cache->opt_index[config->num_opts] = n;
                 config->opts[config->num_opts++] = *co;
             } else {
                 m_option_free(co->opt, co->data);
@@ -1222,12 +1344,14 @@ bool m_config_cache_update(struct m_config_cache *cache)
         return false;
 
     pthread_mutex_lock(&shadow->lock);
-    cache->ts = atomic_load(&shadow->root->groups[cache->group].ts);
+    // Copy only the options written to since the last update.
     for (int n = 0; n < cache->shadow_config->num_opts; n++) {
         struct m_config_option *co = &cache->shadow_config->opts[n];
-        if (co->shadow_offset >= 0)
+        if (co->shadow_offset >= 0 &&
+            shadow->opt_ts[cache->opt_index[n]] > cache->ts)
             m_option_copy(co->opt, co->data, shadow->data + co->shadow_offset);
     }
+    cache->ts = shadow->ts;
     pthread_mutex_unlock(&shadow->lock);
     return true;
 }
@@ -1239,8 +1363,13 @@ void m_config_notify_change_co(struct m_config *config,
 
     if (shadow) {
         pthread_mutex_lock(&shadow->lock);
+        long long ts = ++shadow->ts;
         if (co->shadow_offset >= 0)
             m_option_copy(co->opt, shadow->data + co->shadow_offset, co->data);
+        shadow->opt_ts[co - config->opts] = ts;
+        for (int group = co->group; group >= 0;
+             group = config->groups[group].parent_group)
+            atomic_store(&config->groups[group].ts, ts);
         pthread_mutex_unlock(&shadow->lock);
     }
 
@@ -1249,7 +1378,8 @@ void m_config_notify_change_co(struct m_config *config,
     int group = co->group;
     while (group >= 0) {
         struct m_config_group *g = &config->groups[group];
-        atomic_fetch_add(&g->ts, 1);
+        if (!shadow)
+            atomic_fetch_add(&g->ts, 1);
         if (g->group)
             changed |= g->group->change_flags;
         group = g->parent_group;
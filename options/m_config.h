@@ -61,6 +61,12 @@ typedef struct m_config {
     struct m_config_option *opts; // all options, even suboptions
     int num_opts;
 
+    // Hash table over the names of opts[] (see m_config_get_co_raw()).
+    int *opt_index;             // indexes into opts, -1 for unused entries
+    unsigned opt_index_mask;    // table size - 1
+    int *wildcard_opts;         // indexes of options like "vf*", ascending
+    int num_wildcard_opts;
+
     // Creation parameters
     size_t size;
     const void *defaults;
@@ -292,6 +298,7 @@ struct m_config_cache {
     // Internal.
     struct m_config_shadow *shadow;
     struct m_config *shadow_config;
+    int *opt_index;     // shadow_config option index -> root option index
     long long ts;
     int group;
 };
@@ -308,7 +315,9 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
 
 // Update the options in cache->opts to current global values. Return whether
 // there was an update notification at all (which may or may not indicate that
-// some options have changed).
+// some options have changed). If the group was not written to, this is a
+// single atomic load. Otherwise, only the options written to since the last
+// update are copied.
 // Keep in mind that while the cache->opts pointer does not change, the option
 // data itself will (e.g. string options might be reallocated).
 bool m_config_cache_update(struct m_config_cache *cache);
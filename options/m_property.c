@@ -46,49 +46,129 @@ struct m_property *m_property_list_find(const struct m_property *list,
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
-                     int action, void *arg, void *ctx)
+struct m_property_index {
+    const struct m_property *list;
+    int *table;     // indexes into list, -1 for unused entries
+    unsigned mask;  // table size - 1
+};
+
+static unsigned hash_name(bstr name)
 {
-    struct m_property *prop;
-    struct m_property_action_arg ka;
+    // FNV-1a
+    unsigned h = 2166136261u;
+    for (int n = 0; n < name.len; n++)
+        h = (h ^ name.start[n]) * 16777619u;
+    return h;
+}
+
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
+{
+    struct m_property_index *index = talloc_zero(ta_parent,
+                                                 struct m_property_index);
+    index->list = list;
+
+    int num = 0;
+    while (list[num].name)
+        num++;
+
+    // Keep the load factor at or below 50%.
+    unsigned size = 16;
+    while (size < num * 2)
+        size *= 2;
+    index->mask = size - 1;
+    index->table = talloc_array(index, int, size);
+    for (int n = 0; n < size; n++)
+        index->table[n] = -1;
+
+    for (int n = 0; n < num; n++) {
+        bstr name = bstr0(list[n].name);
+        if (m_property_index_find(index, name))
+            continue;
+        unsigned h = hash_name(name) & index->mask;
+        while (index->table[h] >= 0)
+            h = (h + 1) & index->mask;
+        index->table[h] = n;
+    }
+
+    return index;
+}
+
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name)
+{
+    unsigned h = hash_name(name) & index->mask;
+    for (; index->table[h] >= 0; h = (h + 1) & index->mask) {
+        const struct m_property *prop = &index->list[index->table[h]];
+        if (bstr_equals0(name, prop->name))
+            return (struct m_property *)prop;
+    }
+    return NULL;
+}
+
+bool m_property_resolve(const struct m_property_index *props, const char *name,
+                        struct m_property_handle *h)
+{
+    bstr base = bstr0(name);
+    const char *key = NULL;
     const char *sep = strchr(name, '/');
     if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+        base = bstr_splice(base, 0, sep - name);
+        key = sep + 1;
+    }
+    *h = (struct m_property_handle){
+        .prop = m_property_index_find(props, base),
+        .name = name,
+        .key = key,
+    };
+    return h->prop;
+}
+
+static int do_action(const struct m_property_handle *h, int action, void *arg,
+                     void *ctx)
+{
+    struct m_property_action_arg ka;
+    if (!h->prop)
+        return M_PROPERTY_UNKNOWN;
+    if (h->key) {
         ka = (struct m_property_action_arg) {
-            .key = sep + 1,
+            .key = h->key,
             .action = action,
             .arg = arg,
         };
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
-    } else
-        prop = m_property_list_find(prop_list, name);
-    if (!prop)
-        return M_PROPERTY_UNKNOWN;
-    return prop->call(ctx, prop, action, arg);
+    }
+    return h->prop->call(ctx, h->prop, action, arg);
 }
 
-// (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_index *props,
                   const char *name, int action, void *arg, void *ctx)
+{
+    struct m_property_handle h;
+    m_property_resolve(props, name, &h);
+    return m_property_do_handle(log, &h, action, arg, ctx);
+}
+
+// (as a hack, log can be NULL on read-only paths)
+int m_property_do_handle(struct mp_log *log, const struct m_property_handle *h,
+                         int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
     int r;
 
     struct m_option opt = {0};
-    r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, &opt, ctx);
+    r = do_action(h, M_PROPERTY_GET_TYPE, &opt, ctx);
     if (r <= 0)
         return r;
     assert(opt.type);
 
     switch (action) {
     case M_PROPERTY_PRINT: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
+        if ((r = do_action(h, M_PROPERTY_PRINT, arg, ctx)) >= 0)
             return r;
         // Fallback to m_option
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_pretty_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -96,7 +176,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return str != NULL;
     }
     case M_PROPERTY_GET_STRING: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -105,45 +185,45 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     }
     case M_PROPERTY_SET_STRING: {
         struct mpv_node node = { .format = MPV_FORMAT_STRING, .u.string = arg };
-        return m_property_do(log, prop_list, name, M_PROPERTY_SET_NODE, &node, ctx);
+        return m_property_do_handle(log, h, M_PROPERTY_SET_NODE, &node, ctx);
     }
     case M_PROPERTY_SWITCH: {
         if (!log)
             return M_PROPERTY_ERROR;
         struct m_property_switch_arg *sarg = arg;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SWITCH, arg, ctx)) !=
+        if ((r = do_action(h, M_PROPERTY_SWITCH, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         // Fallback to m_option
-        r = m_property_do(log, prop_list, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
-                          &opt, ctx);
+        r = m_property_do_handle(log, h, M_PROPERTY_GET_CONSTRICTED_TYPE,
+                                 &opt, ctx);
         if (r <= 0)
             return r;
         assert(opt.type);
         if (!opt.type->add)
             return M_PROPERTY_NOT_IMPLEMENTED;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         opt.type->add(&opt, &val, sarg->inc, sarg->wrap);
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(h, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
     case M_PROPERTY_GET_CONSTRICTED_TYPE: {
-        if ((r = do_action(prop_list, name, action, arg, ctx)) >= 0)
+        if ((r = do_action(h, action, arg, ctx)) >= 0)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
+        if ((r = do_action(h, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
             return r;
         return M_PROPERTY_NOT_IMPLEMENTED;
     }
     case M_PROPERTY_SET: {
-        return do_action(prop_list, name, M_PROPERTY_SET, arg, ctx);
+        return do_action(h, M_PROPERTY_SET, arg, ctx);
     }
     case M_PROPERTY_GET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
+        if ((r = do_action(h, M_PROPERTY_GET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(h, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         struct mpv_node *node = arg;
         int err = m_option_get_node(&opt, NULL, node, &val);
@@ -160,22 +240,22 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     case M_PROPERTY_SET_NODE: {
         if (!log)
             return M_PROPERTY_ERROR;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
+        if ((r = do_action(h, M_PROPERTY_SET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        int err = m_option_set_node_or_string(log, &opt, name, &val, arg);
+        int err = m_option_set_node_or_string(log, &opt, h->name, &val, arg);
         if (err == M_OPT_UNKNOWN) {
             r = M_PROPERTY_NOT_IMPLEMENTED;
         } else if (err < 0) {
             r = M_PROPERTY_INVALID_FORMAT;
         } else {
-            r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+            r = do_action(h, M_PROPERTY_SET, &val, ctx);
         }
         m_option_free(&opt, &val);
         return r;
     }
     default:
-        return do_action(prop_list, name, action, arg, ctx);
+        return do_action(h, action, arg, ctx);
     }
 }
 
@@ -206,14 +286,14 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property_index *props, bstr name,
                               int action, void *arg, void *ctx)
 {
     char name0[64];
     if (name.len >= sizeof(name0))
         return M_PROPERTY_UNKNOWN;
     snprintf(name0, sizeof(name0), "%.*s", BSTR_P(name));
-    return m_property_do(NULL, prop_list, name0, action, arg, ctx);
+    return m_property_do(NULL, props, name0, action, arg, ctx);
 }
 
 static void append_str(char **s, int *len, bstr append)
@@ -224,7 +304,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_index *props, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -238,7 +318,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     int method = raw ? M_PROPERTY_GET_STRING : M_PROPERTY_PRINT;
 
     char *s = NULL;
-    int r = m_property_do_bstr(prop_list, prop, method, &s, ctx);
+    int r = m_property_do_bstr(props, prop, method, &s, ctx);
     bool skip;
     if (comp) {
         skip = ((s && bstr_equals0(comp_with, s)) != cond_yes);
@@ -255,7 +335,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_index *props,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -281,7 +361,7 @@ char *m_properties_expand_string(const struct m_property *prop_list,
             bool have_fallback = bstr_eatstart0(&str, ":");
 
             if (!skip) {
-                skip = expand_property(prop_list, &ret, &ret_len, name,
+                skip = expand_property(props, &ret, &ret_len, name,
                                        have_fallback, ctx);
                 if (skip)
                     skip_level = level;
@@ -137,13 +137,39 @@ struct m_property {
 struct m_property *m_property_list_find(const struct m_property *list,
                                         const char *name);
 
+// Hash table for looking up properties by name. The list (terminated with a
+// {0} item) must not change while the index is in use. On duplicate names,
+// the first entry is found, like with m_property_list_find().
+struct m_property_index;
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list);
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name);
+
+// A property path resolved with m_property_resolve(), for repeated access
+// without name lookups. Points into the name string passed to it, which must
+// stay valid.
+struct m_property_handle {
+    struct m_property *prop;    // NULL if unknown
+    const char *name;           // full path
+    const char *key;            // sub-path for M_PROPERTY_KEY_ACTION, or NULL
+};
+
+// Returns false (and sets h->prop=NULL) if the property is unknown.
+bool m_property_resolve(const struct m_property_index *props, const char *name,
+                        struct m_property_handle *h);
+
 // Access a property.
 // action: one of m_property_action
 // ctx: opaque value passed through to property implementation
 // returns: one of mp_property_return
-int m_property_do(struct mp_log *log, const struct m_property* prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_index *props,
                   const char* property_name, int action, void* arg, void *ctx);
 
+// Like m_property_do(), with an already resolved property.
+int m_property_do_handle(struct mp_log *log, const struct m_property_handle *h,
+                         int action, void *arg, void *ctx);
+
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
 // and rem to "b/c", and return true.
 // If there is no '/' in the path, set prefix to path, and rem to "", and
@@ -166,7 +192,7 @@ void m_properties_print_help_list(struct mp_log *log,
 // STR is recursively expanded using the same rules.
 // "$$" can be used to escape "$", and "$}" to escape "}".
 // "$>" disables parsing of "$" for the rest of the string.
-char* m_properties_expand_string(const struct m_property *prop_list,
+char* m_properties_expand_string(const struct m_property_index *props,
                                  const char *str, void *ctx);
 
 // Trivial helpers for implementing properties.
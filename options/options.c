@@ -72,11 +72,16 @@ extern const struct m_sub_options tv_params_conf;
 extern const struct m_sub_options stream_cdda_conf;
 extern const struct m_sub_options stream_dvb_conf;
 extern const struct m_sub_options stream_lavf_conf;
+extern const struct m_sub_options stream_file_conf;
+extern const struct m_sub_options stream_smb_conf;
 extern const struct m_sub_options sws_conf;
 extern const struct m_sub_options demux_rawaudio_conf;
 extern const struct m_sub_options demux_rawvideo_conf;
 extern const struct m_sub_options demux_lavf_conf;
 extern const struct m_sub_options demux_mkv_conf;
+extern const struct m_sub_options recorder_conf;
+extern const struct m_sub_options thread_conf;
+extern const struct m_sub_options demux_playlist_conf;
 extern const struct m_sub_options vd_lavc_conf;
 extern const struct m_sub_options ad_lavc_conf;
 extern const struct m_sub_options input_config;
@@ -138,6 +143,9 @@ const struct m_sub_options stream_cache_conf = {
         OPT_INTRANGE("cache-backbuffer", back_buffer, 0, 0, 0x7fffffff),
         OPT_STRING("cache-file", file, M_OPT_FILE),
         OPT_INTRANGE("cache-file-size", file_max, 0, 0, 0x7fffffff),
+        OPT_STRING("cache-dir", dir, M_OPT_FILE),
+        OPT_INTRANGE("cache-dir-size", dir_max, 0, 0, 0x7fffffff),
+        OPT_INTRANGE("cache-connections", connections, 0, 1, 16),
         {0}
     },
     .size = sizeof(struct mp_cache_opts),
@@ -148,6 +156,8 @@ const struct m_sub_options stream_cache_conf = {
         .seek_min = 500,
         .back_buffer = 75000,
         .file_max = 1024 * 1024,
+        .dir_max = 4 * 1024 * 1024,
+        .connections = 1,
     },
 };
 
@@ -193,6 +203,7 @@ static const m_option_t mp_vo_opt_list[] = {
     OPT_FLAG("keepaspect", keepaspect, UPDATE_VIDEOPOS),
     OPT_FLAG("keepaspect-window", keepaspect_window, 0),
     OPT_FLAG("hidpi-window-scale", hidpi_window_scale, 0),
+    OPT_INTRANGE("video-timing-spin", timing_spin, 0, 0, 2000),
 #if HAVE_X11
     OPT_CHOICE("x11-netwm", x11_netwm, 0,
                ({"auto", 0}, {"no", -1}, {"yes", 1})),
@@ -206,11 +217,13 @@ static const m_option_t mp_vo_opt_list[] = {
     OPT_STRING_VALIDATE("drm-connector", drm_connector_spec,
                         0, drm_validate_connector_opt),
     OPT_INT("drm-mode", drm_mode_id, 0),
+    OPT_FLAG("drm-overlay", drm_overlay, 0),
 #endif
 #if HAVE_GL
     OPT_STRING_VALIDATE("opengl-hwdec-interop", gl_hwdec_interop, 0,
                         gl_hwdec_validate_opt),
     OPT_REPLACED("hwdec-preload", "opengl-hwdec-interop"),
+    OPT_INTRANGE("opengl-cb-queue-size", opengl_cb_queue_size, 0, 1, 8),
 #endif
     {0}
 };
@@ -236,6 +249,7 @@ const struct m_sub_options vo_sub_opts = {
         .x11_bypass_compositor = 2,
         .mmcss_profile = "Playback",
         .ontop_level = -1,
+        .opengl_cb_queue_size = 1,
     },
 };
 
@@ -288,6 +302,11 @@ const m_option_t mp_opts[] = {
     OPT_GENERAL(char**, "msg-level", msg_levels, CONF_PRE_PARSE | UPDATE_TERM,
                 .type = &m_option_type_msglevels),
     OPT_STRING("dump-stats", dump_stats, UPDATE_TERM | CONF_PRE_PARSE),
+    OPT_CHOICE("dump-stats-format", dump_stats_format,
+               UPDATE_TERM | CONF_PRE_PARSE,
+               ({"text", 0}, {"json", 1})),
+    OPT_STRING("av-sync-stats-file", av_sync_stats_file, 0),
+    OPT_STRING("startup-profile-file", startup_profile_file, 0),
     OPT_FLAG("msg-color", msg_color, CONF_PRE_PARSE | UPDATE_TERM),
     OPT_STRING("log-file", log_file, CONF_PRE_PARSE | M_OPT_FILE | UPDATE_TERM),
     OPT_FLAG("msg-module", msg_module, UPDATE_TERM),
@@ -302,6 +321,7 @@ const m_option_t mp_opts[] = {
                 {"belownormal", BELOW_NORMAL_PRIORITY_CLASS},
                 {"idle",        IDLE_PRIORITY_CLASS})),
 #endif
+    OPT_SUBSTRUCT("thread", thread_opts, thread_conf, 0),
     OPT_FLAG("config", load_config, M_OPT_FIXED | CONF_PRE_PARSE),
     OPT_STRING("config-dir", force_configdir,
                M_OPT_FIXED | CONF_NOCFG | CONF_PRE_PARSE),
@@ -315,6 +335,7 @@ const m_option_t mp_opts[] = {
     OPT_STRING("ytdl-format", lua_ytdl_format, 0),
     OPT_KEYVALUELIST("ytdl-raw-options", lua_ytdl_raw_options, 0),
     OPT_FLAG("load-scripts", auto_load_scripts, 0),
+    OPT_FLAG("script-startup-wait", script_startup_wait, 0),
 #endif
 
 // ------------------------- stream options --------------------
@@ -373,6 +394,7 @@ const m_option_t mp_opts[] = {
     OPT_STRINGLIST("slang", stream_lang[STREAM_SUB], 0),
 
     OPT_STRING("lavfi-complex", lavfi_complex, 0),
+    OPT_INTRANGE("lavfi-complex-threads", lavfi_complex_threads, 0, 0, INT_MAX),
 
     OPT_CHOICE("audio-display", audio_display, 0,
                ({"no", 0}, {"attachment", 1})),
@@ -393,8 +415,12 @@ const m_option_t mp_opts[] = {
     OPT_STRING("audio-demuxer", audio_demuxer_name, 0),
     OPT_STRING("sub-demuxer", sub_demuxer_name, 0),
     OPT_FLAG("demuxer-thread", demuxer_thread, 0),
-    OPT_FLAG("prefetch-playlist", prefetch_open, 0),
+    OPT_CHOICE("prefetch-playlist", prefetch_open, 0,
+               ({"no", 0}, {"yes", 1}, {"fill", 2}, {"decode", 3})),
     OPT_FLAG("cache-pause", cache_pausing, 0),
+    OPT_FLAG("cache-pause-predict", cache_pause_predict, 0),
+    OPT_DOUBLE("cache-pause-confidence", cache_pause_confidence, M_OPT_RANGE,
+               .min = 0.5, .max = 0.999),
 
     OPT_DOUBLE("mf-fps", mf_fps, 0),
     OPT_STRING("mf-type", mf_type, 0),
@@ -405,6 +431,10 @@ const m_option_t mp_opts[] = {
     OPT_SUBSTRUCT("dvbin", stream_dvb_opts, stream_dvb_conf, 0),
 #endif
     OPT_SUBSTRUCT("", stream_lavf_opts, stream_lavf_conf, 0),
+    OPT_SUBSTRUCT("", stream_file_opts, stream_file_conf, 0),
+#if HAVE_LIBSMBCLIENT
+    OPT_SUBSTRUCT("", stream_smb_opts, stream_smb_conf, 0),
+#endif
 
 // ------------------------- a-v sync options --------------------
 
@@ -430,14 +460,24 @@ const m_option_t mp_opts[] = {
     OPT_SETTINGSLIST("af*", af_settings, 0, &af_obj_list, ),
     OPT_SETTINGSLIST("vf-defaults", vf_defs, 0, &vf_obj_list, ),
     OPT_SETTINGSLIST("vf*", vf_settings, 0, &vf_obj_list, ),
+    OPT_INTRANGE("vf-pipeline-frames", vf_pipeline_frames, 0, 0, 16),
 
     OPT_CHOICE("deinterlace", deinterlace, 0,
                ({"auto", -1},
                 {"no", 0},
                 {"yes", 1})),
+    OPT_CHOICE("deinterlace-filter", deinterlace_filter, 0,
+               ({"yadif", 0},
+                {"mtdeint", 1})),
 
     OPT_STRING("ad", audio_decoders, 0),
     OPT_STRING("vd", video_decoders, 0),
+    OPT_INTRANGE("vd-queue-frames", vd_queue_frames, 0, 0, 32),
+    OPT_DOUBLE("ad-queue-secs", ad_queue_secs, CONF_RANGE, .min = 0, .max = 10),
+    OPT_INTRANGE("video-pool-max-size", video_pool_max_size, 0, 0, 4096),
+    OPT_FLAG("video-pool-hugepages", video_pool_hugepages, 0),
+    OPT_INTRANGE("memory-budget", memory_budget, UPDATE_MEMORY_BUDGET,
+                 0, 1024 * 1024),
 
     OPT_STRING("audio-spdif", audio_spdif, 0),
 
@@ -466,6 +506,7 @@ const m_option_t mp_opts[] = {
     OPT_SUBSTRUCT("demuxer-rawaudio", demux_rawaudio, demux_rawaudio_conf, 0),
     OPT_SUBSTRUCT("demuxer-rawvideo", demux_rawvideo, demux_rawvideo_conf, 0),
     OPT_SUBSTRUCT("demuxer-mkv", demux_mkv, demux_mkv_conf, 0),
+    OPT_SUBSTRUCT("demuxer-playlist", demux_playlist, demux_playlist_conf, 0),
 
 // ------------------------- subtitles options --------------------
 
@@ -507,6 +548,9 @@ const m_option_t mp_opts[] = {
     OPT_CHOICE("sub-ass-shaper", ass_shaper, UPDATE_OSD,
                ({"simple", 0}, {"complex", 1})),
     OPT_FLAG("sub-ass-justify", ass_justify, 0),
+    OPT_INTRANGE("sub-ass-render-ahead", ass_render_ahead, 0, 0, 16),
+    OPT_CHOICE_OR_INT("sub-render-height", sub_render_height, UPDATE_OSD,
+                      120, 16384, ({"no", 0}, {"auto", -1})),
     OPT_CHOICE("sub-ass-style-override", ass_style_override, UPDATE_OSD,
                ({"no", 0}, {"yes", 1}, {"force", 3}, {"signfs", 4}, {"strip", 5})),
     OPT_FLAG("sub-scale-by-window", sub_scale_by_window, UPDATE_OSD),
@@ -595,10 +639,13 @@ const m_option_t mp_opts[] = {
                 {"vo", 1},
                 {"decoder", 2},
                 {"decoder+vo", 3})),
+    OPT_FLAG("framedrop-predict", framedrop_predict, 0),
 
     OPT_DOUBLE("display-fps", frame_drop_fps, M_OPT_MIN, .min = 0),
 
     OPT_FLAG("untimed", untimed, 0),
+    OPT_FLAG("benchmark", benchmark, 0),
+    OPT_STRING("benchmark-file", benchmark_file, 0),
 
     OPT_STRING("stream-dump", stream_dump, M_OPT_FILE),
 
@@ -648,10 +695,13 @@ const m_option_t mp_opts[] = {
                M_OPT_MIN | M_OPT_MAX, .min = 0, .max = 1),
     OPT_DOUBLE("video-sync-adrop-size", sync_audio_drop_size,
                M_OPT_MIN | M_OPT_MAX, .min = 0, .max = 1),
+    OPT_INTRANGE("video-render-ahead", video_render_ahead, 0, 0, 2),
     OPT_CHOICE("hr-seek", hr_seek, 0,
                ({"no", -1}, {"absolute", 0}, {"yes", 1}, {"always", 1})),
     OPT_FLOAT("hr-seek-demuxer-offset", hr_seek_demuxer_offset, 0),
-    OPT_FLAG("hr-seek-framedrop", hr_seek_framedrop, 0),
+    OPT_CHOICE("hr-seek-framedrop", hr_seek_framedrop, 0,
+               ({"no", 0}, {"yes", 1}, {"fast", 2})),
+    OPT_INTRANGE("backstep-cache", backstep_cache, 0, 0, 4096),
     OPT_CHOICE_OR_INT("autosync", autosync, 0, 0, 10000,
                       ({"no", -1})),
 
@@ -666,6 +716,8 @@ const m_option_t mp_opts[] = {
     OPT_STRING("term-playing-msg", playing_msg, 0),
     OPT_STRING("osd-playing-msg", osd_playing_msg, 0),
     OPT_STRING("term-status-msg", status_msg, 0),
+    OPT_DOUBLE("term-status-rate", term_status_rate, M_OPT_MIN, .min = 0),
+    OPT_FLAG("term-status-notty", term_status_notty, UPDATE_TERM),
     OPT_STRING("osd-status-msg", osd_status_msg, 0),
     OPT_STRING("osd-msg1", osd_msg[0], 0),
     OPT_STRING("osd-msg2", osd_msg[1], 0),
@@ -688,6 +740,7 @@ const m_option_t mp_opts[] = {
     OPT_STRING("screenshot-directory", screenshot_directory, 0),
 
     OPT_STRING("record-file", record_file, M_OPT_FILE),
+    OPT_SUBSTRUCT("record", recorder_opts, recorder_conf, 0),
 
     OPT_SUBSTRUCT("", input_opts, input_config, 0),
 
@@ -723,7 +776,6 @@ const m_option_t mp_opts[] = {
     OPT_REMOVED("ass-bottom-margin", "use --vf=sub=bottom:top"),
     OPT_REPLACED("ass", "sub-ass"),
     OPT_REPLACED("audiofile", "audio-file"),
-    OPT_REMOVED("benchmark", "use --untimed (no stats)"),
     OPT_REMOVED("capture", NULL),
     OPT_REMOVED("stream-capture", NULL),
     OPT_REMOVED("channels", "use --audio-channels (changed semantics)"),
@@ -874,6 +926,7 @@ const struct MPOpts mp_default_opts = {
     .lua_ytdl_raw_options = NULL,
 #endif
     .auto_load_scripts = 1,
+    .script_startup_wait = 1,
     .loop_times = 1,
     .ordered_chapters = 1,
     .chapter_merge_threshold = 100,
@@ -888,6 +941,7 @@ const struct MPOpts mp_default_opts = {
     .demuxer_thread = 1,
     .hls_bitrate = INT_MAX,
     .cache_pausing = 1,
+    .cache_pause_confidence = 0.9,
     .chapterrange = {-1, -1},
     .ab_loop = {MP_NOPTS_VALUE, MP_NOPTS_VALUE},
     .edition_id = -1,
@@ -895,8 +949,10 @@ const struct MPOpts mp_default_opts = {
     .correct_pts = 1,
     .initial_audio_sync = 1,
     .frame_dropping = 1,
+    .framedrop_predict = 1,
     .term_osd = 2,
     .term_osd_bar_chars = "[-+-]",
+    .term_status_rate = 10,
     .consolecontrols = 1,
     .playlist_pos = -1,
     .play_frames = -1,
@@ -933,6 +989,7 @@ const struct MPOpts mp_default_opts = {
     .ass_vsfilter_blur_compat = 1,
     .ass_style_override = 1,
     .ass_shaper = 1,
+    .ass_render_ahead = 3,
     .use_embedded_fonts = 1,
     .sub_fix_timing = 1,
     .screenshot_template = "mpv-shot%n",
@@ -47,15 +47,20 @@ typedef struct mp_vo_opts {
     float monitor_pixel_aspect;
     int force_window_position;
 
+    int timing_spin;
+
     char *mmcss_profile;
 
     // vo_wayland, vo_drm
     struct sws_opts *sws_opts;
     // vo_opengl, vo_opengl_cb
     char *gl_hwdec_interop;
+    // vo_opengl_cb
+    int opengl_cb_queue_size;
     // vo_drm
     char *drm_connector_spec;
     int drm_mode_id;
+    int drm_overlay;
 } mp_vo_opts;
 
 struct mp_cache_opts {
@@ -66,12 +71,18 @@ struct mp_cache_opts {
     int back_buffer;
     char *file;
     int file_max;
+    char *dir;
+    int dir_max;
+    int connections;
 };
 
 typedef struct MPOpts {
     int property_print_help;
     int use_terminal;
     char *dump_stats;
+    int dump_stats_format;
+    char *av_sync_stats_file;
+    char *startup_profile_file;
     int verbose;
     char **msg_levels;
     int msg_color;
@@ -90,6 +101,7 @@ typedef struct MPOpts {
     char **lua_ytdl_raw_options;
 
     int auto_load_scripts;
+    int script_startup_wait;
 
     struct m_obj_settings *audio_driver_list;
     char *audio_device;
@@ -130,6 +142,11 @@ typedef struct MPOpts {
 
     char *audio_decoders;
     char *video_decoders;
+    int vd_queue_frames;
+    double ad_queue_secs;
+    int video_pool_max_size;
+    int video_pool_hugepages;
+    int memory_budget;
     char *audio_spdif;
 
     int osd_level;
@@ -138,8 +155,11 @@ typedef struct MPOpts {
     int video_osd;
 
     int untimed;
+    int benchmark;
+    char *benchmark_file;
     char *stream_dump;
     char *record_file;
+    struct recorder_opts *recorder_opts;
     int stop_playback_on_init_failure;
     int loop_times;
     int loop_file;
@@ -165,13 +185,16 @@ typedef struct MPOpts {
     double sync_max_video_change;
     double sync_max_audio_change;
     double sync_audio_drop_size;
+    int video_render_ahead;
     int hr_seek;
     float hr_seek_demuxer_offset;
     int hr_seek_framedrop;
+    int backstep_cache;
     float audio_delay;
     float default_max_pts_correction;
     int autosync;
     int frame_dropping;
+    int framedrop_predict;
     double frame_drop_fps;
     int term_osd;
     int term_osd_bar;
@@ -179,6 +202,8 @@ typedef struct MPOpts {
     char *playing_msg;
     char *osd_playing_msg;
     char *status_msg;
+    double term_status_rate;
+    int term_status_notty;
     char *osd_status_msg;
     char *osd_msg[3];
     char *heartbeat_cmd;
@@ -202,6 +227,7 @@ typedef struct MPOpts {
     int keep_open;
     double image_display_duration;
     char *lavfi_complex;
+    int lavfi_complex_threads;
     int stream_id[2][STREAM_TYPE_COUNT];
     int stream_id_ff[STREAM_TYPE_COUNT];
     char **stream_lang[STREAM_TYPE_COUNT];
@@ -227,6 +253,8 @@ typedef struct MPOpts {
     char *sub_demuxer_name;
 
     int cache_pausing;
+    int cache_pause_predict;
+    double cache_pause_confidence;
 
     struct image_writer_opts *screenshot_image_opts;
     char *screenshot_template;
@@ -243,8 +271,10 @@ typedef struct MPOpts {
     double playback_speed;
     int pitch_correction;
     struct m_obj_settings *vf_settings, *vf_defs;
+    int vf_pipeline_frames;
     struct m_obj_settings *af_settings, *af_defs;
     int deinterlace;
+    int deinterlace_filter;
     float movie_aspect;
     int aspect_method;
     int field_dominance;
@@ -284,6 +314,8 @@ typedef struct MPOpts {
     int ass_hinting;
     int ass_shaper;
     int ass_justify;
+    int ass_render_ahead;
+    int sub_render_height;
     int sub_clear_on_seek;
     int teletext_page;
 
@@ -292,12 +324,15 @@ typedef struct MPOpts {
     int videotoolbox_format;
 
     int w32_priority;
+    struct thread_opts *thread_opts;
 
     struct tv_params *tv_params;
     struct pvr_params *stream_pvr_opts;
     struct cdda_params *stream_cdda_opts;
     struct dvb_params *stream_dvb_opts;
     struct stream_lavf_params *stream_lavf_opts;
+    struct stream_file_opts *stream_file_opts;
+    struct stream_smb_opts *stream_smb_opts;
 
     char *cdrom_device;
     char *bluray_device;
@@ -309,6 +344,7 @@ typedef struct MPOpts {
     struct demux_rawvideo_opts *demux_rawvideo;
     struct demux_lavf_opts *demux_lavf;
     struct demux_mkv_opts *demux_mkv;
+    struct demux_playlist_opts *demux_playlist;
 
     struct demux_opts *demux_opts;
 
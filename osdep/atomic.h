@@ -35,6 +35,7 @@ typedef struct { _Bool v;              } atomic_bool;
 typedef struct { long long v;          } atomic_llong;
 typedef struct { uint_least32_t v;     } atomic_uint_least32_t;
 typedef struct { unsigned long long v; } atomic_ullong;
+typedef struct { uintptr_t v;          } atomic_uintptr_t;
 
 #define ATOMIC_VAR_INIT(x) \
     {.v = (x)}
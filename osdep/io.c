@@ -335,6 +335,21 @@ int mp_mkdir(const char *path, int mode)
     return res;
 }
 
+int mp_rename(const char *oldpath, const char *newpath)
+{
+    wchar_t *wold = mp_from_utf8(NULL, oldpath);
+    wchar_t *wnew = mp_from_utf8(NULL, newpath);
+    // Unlike _wrename(), this replaces an existing target like POSIX rename().
+    BOOL ok = MoveFileExW(wold, wnew, MOVEFILE_REPLACE_EXISTING);
+    talloc_free(wold);
+    talloc_free(wnew);
+    if (!ok) {
+        errno = EACCES; // something random
+        return -1;
+    }
+    return 0;
+}
+
 FILE *mp_tmpfile(void)
 {
     // Reserve a file name in the format %TMP%\mpvXXXX.TMP
@@ -224,6 +224,11 @@ void mp_write_console_ansi(HANDLE wstream, char *buf)
             SetConsoleCursorPosition(wstream, info.dwCursorPosition);
             break;
         }
+        case 'C': {     // cursor forward
+            info.dwCursorPosition.X += params[0] > 0 ? params[0] : 1;
+            SetConsoleCursorPosition(wstream, info.dwCursorPosition);
+            break;
+        }
         case 'm': {     // "SGR"
             for (int n = 0; n < num_params; n++) {
                 int p = params[n];
@@ -16,8 +16,10 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "config.h"
 
@@ -25,9 +27,39 @@
 #include <pthread_np.h>
 #endif
 
+#if HAVE_WIN32
+#include <windows.h>
+#include <avrt.h>
+#endif
+
+#if HAVE_OSX_THREAD_QOS
+#include <pthread/qos.h>
+#endif
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 #include "threads.h"
 #include "timer.h"
 
+struct thread_opts {
+    char **priority;
+    char **affinity;
+};
+
+#define OPT_BASE_STRUCT struct thread_opts
+const struct m_sub_options thread_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_KEYVALUELIST("priority", priority, 0),
+        OPT_KEYVALUELIST("affinity", affinity, 0),
+        {0}
+    },
+    .size = sizeof(struct thread_opts),
+};
+
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex)
 {
     pthread_mutexattr_t attr;
@@ -55,3 +87,111 @@ void mpthread_set_name(const char *name)
     pthread_setname_np(tname);
 #endif
 }
+
+static const char *find_role(char **list, const char *role)
+{
+    for (int n = 0; list && list[n * 2]; n++) {
+        if (strcmp(list[n * 2], role) == 0)
+            return list[n * 2 + 1];
+    }
+    return NULL;
+}
+
+// Returns 1 on success, 0 if the OS refused, -1 if the name is unknown.
+static int set_priority(const char *prio)
+{
+    if (strcmp(prio, "default") == 0)
+        return 1;
+    bool rt = strcmp(prio, "realtime") == 0;
+    if (!rt && strcmp(prio, "high") != 0)
+        return -1;
+#if HAVE_WIN32
+    if (rt)
+        return !!AvSetMmThreadCharacteristicsW(L"Playback", &(DWORD){0});
+    return !!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+#elif HAVE_OSX_THREAD_QOS
+    qos_class_t qos = rt ? QOS_CLASS_USER_INTERACTIVE : QOS_CLASS_USER_INITIATED;
+    return pthread_set_qos_class_self_np(qos, 0) == 0;
+#else
+    // "realtime" preempts "high", which shares the CPU in time slices.
+    int policy = rt ? SCHED_FIFO : SCHED_RR;
+    struct sched_param param = {
+        .sched_priority = sched_get_priority_min(policy) + (rt ? 1 : 0),
+    };
+    return pthread_setschedparam(pthread_self(), policy, &param) == 0;
+#endif
+}
+
+// Parse a CPU list like "0-3+6" into a bit mask. Returns 0 on errors.
+static uint64_t parse_cpus(bstr s)
+{
+    uint64_t mask = 0;
+    while (s.len) {
+        bstr item, rest;
+        bstr_split_tok(s, "+", &item, &s);
+        if (!item.len)
+            return 0;
+        long long a = bstrtoll(item, &rest, 10), b = a;
+        if (bstr_eatstart0(&rest, "-"))
+            b = bstrtoll(rest, &rest, 10);
+        if (rest.len || a < 0 || b < a || b > 63)
+            return 0;
+        for (long long n = a; n <= b; n++)
+            mask |= 1ULL << n;
+    }
+    return mask;
+}
+
+static bool set_affinity(uint64_t mask)
+{
+#if HAVE_WIN32
+    return !!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask);
+#elif HAVE_PTHREAD_SETAFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int n = 0; n < 64; n++) {
+        if (mask & (1ULL << n))
+            CPU_SET(n, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+void mpthread_set_role(struct mpv_global *global, const char *role)
+{
+    void *tmp = talloc_new(NULL);
+    struct thread_opts *opts = mp_get_config_group(tmp, global, &thread_conf);
+    struct mp_log *log = mp_log_new(tmp, global->log, "threads");
+
+    const char *prio = find_role(opts->priority, role);
+    if (prio) {
+        int r = set_priority(prio);
+        if (r < 0) {
+            mp_warn(log, "Unknown thread priority '%s' for '%s'.\n",
+                    prio, role);
+        } else if (!r) {
+            mp_warn(log, "Could not set priority '%s' for the %s thread "
+                    "(missing permissions?).\n", prio, role);
+        } else {
+            mp_verbose(log, "Set priority '%s' for the %s thread.\n", prio, role);
+        }
+    }
+
+    const char *cpus = find_role(opts->affinity, role);
+    if (cpus) {
+        uint64_t mask = parse_cpus(bstr0(cpus));
+        if (!mask) {
+            mp_warn(log, "Invalid CPU list '%s' for '%s'.\n", cpus, role);
+        } else if (!set_affinity(mask)) {
+            mp_warn(log, "Could not set CPU affinity for the %s thread.\n",
+                    role);
+        } else {
+            mp_verbose(log, "Set CPU affinity '%s' for the %s thread.\n",
+                       cpus, role);
+        }
+    }
+
+    talloc_free(tmp);
+}
@@ -4,10 +4,16 @@
 #include <pthread.h>
 #include <inttypes.h>
 
+struct mpv_global;
+
 // Helper to reduce boiler plate.
 int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
 
 // Set thread name (for debuggers).
 void mpthread_set_name(const char *name);
 
+// Apply the --thread-priority and --thread-affinity settings for the given
+// role (e.g. "vo") to the calling thread. Failures are only logged.
+void mpthread_set_role(struct mpv_global *global, const char *role);
+
 #endif
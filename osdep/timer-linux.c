@@ -20,6 +20,7 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <time.h>
 #include <sys/time.h>
 #include "config.h"
@@ -52,6 +53,14 @@ uint64_t mp_raw_time_us(void)
         abort();
     return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
 }
+
+void mp_raw_sleep_until_us(uint64_t raw_us)
+{
+    struct timespec ts;
+    ts.tv_sec  =  raw_us / 1000000;
+    ts.tv_nsec = (raw_us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
 #else
 uint64_t mp_raw_time_us(void)
 {
@@ -59,6 +68,11 @@ uint64_t mp_raw_time_us(void)
     gettimeofday(&tv,NULL);
     return tv.tv_sec * 1000000LL + tv.tv_usec;
 }
+
+void mp_raw_sleep_until_us(uint64_t raw_us)
+{
+    mp_sleep_us((int64_t)(raw_us - mp_raw_time_us()));
+}
 #endif
 
 void mp_raw_time_init(void)
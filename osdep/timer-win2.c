@@ -37,6 +37,34 @@ void mp_sleep_us(int64_t us)
     Sleep(us / 1000);
 }
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+void mp_raw_sleep_until_us(uint64_t raw_us)
+{
+    int64_t us = raw_us - mp_raw_time_us();
+    if (us <= 0)
+        return;
+    // High resolution timers are supported since Windows 10 1803 only; older
+    // versions fail, and get a normal waitable timer with timeBeginPeriod()
+    // resolution. Unlike Sleep(), this doesn't round up to full milliseconds.
+    HANDLE timer = CreateWaitableTimerExW(NULL, NULL,
+                                          CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                          TIMER_ALL_ACCESS);
+    if (!timer)
+        timer = CreateWaitableTimerW(NULL, TRUE, NULL);
+    if (!timer) {
+        mp_sleep_us(us);
+        return;
+    }
+    // Negative means relative time, in 100 ns units.
+    LARGE_INTEGER due = {.QuadPart = -us * 10};
+    if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+        WaitForSingleObject(timer, INFINITE);
+    CloseHandle(timer);
+}
+
 uint64_t mp_raw_time_us(void)
 {
     LARGE_INTEGER perf_count;
@@ -54,6 +54,21 @@ int64_t mp_time_us(void)
     return r;
 }
 
+int64_t mp_time_from_raw_us(int64_t raw)
+{
+    return raw - (int64_t)raw_time_offset;
+}
+
+void mp_sleep_until(int64_t time_us, int64_t spin_us)
+{
+    int64_t sleep_until = time_us - MPMAX(spin_us, 0);
+    if (sleep_until > mp_time_us())
+        mp_raw_sleep_until_us(sleep_until + raw_time_offset);
+    while (mp_time_us() < time_us) {
+        // spin
+    }
+}
+
 double mp_time_sec(void)
 {
     return mp_time_us() / (double)(1000 * 1000);
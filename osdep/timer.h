@@ -34,9 +34,23 @@ double mp_time_sec(void);
 void mp_raw_time_init(void);
 uint64_t mp_raw_time_us(void);
 
+// Convert a time in mp_raw_time_us() units (e.g. a timestamp reported by the
+// display system, if it uses the same clock) to mp_time_us() units.
+int64_t mp_time_from_raw_us(int64_t raw);
+
 // Sleep in microseconds.
 void mp_sleep_us(int64_t us);
 
+// Sleep until mp_raw_time_us() reaches raw_us. Unlike mp_sleep_us(), this uses
+// an absolute deadline where the OS supports it, so time spent before the
+// sleep actually starts (e.g. preemption) does not delay the wakeup.
+void mp_raw_sleep_until_us(uint64_t raw_us);
+
+// Sleep until mp_time_us() reaches time_us. The last spin_us microseconds
+// before the deadline are busy-waited, which avoids the OS wakeup latency at
+// the cost of CPU time. Returns immediately if the time has already passed.
+void mp_sleep_until(int64_t time_us, int64_t spin_us);
+
 #define MP_START_TIME 10000000
 
 // Return the amount of time that has passed since the last call, in
@@ -397,7 +397,7 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
 
         mp_audio_set_channels(&afs->output, &afs->output.channels);
 
-        mpctx->ao = ao_init_best(mpctx->global, ao_flags, mp_wakeup_core_cb,
+        mpctx->ao = ao_init_best(mpctx->global, ao_flags, mp_wakeup_ao_cb,
                                  mpctx, mpctx->encode_lavc_ctx, afs->output.rate,
                                  afs->output.format, afs->output.channels);
         ao_c->ao = mpctx->ao;
@@ -474,6 +474,15 @@ int init_audio_decoder(struct MPContext *mpctx, struct track *track)
     if (!track->stream)
         goto init_error;
 
+    struct dec_audio *prefetched = mpctx->prefetched_audio;
+    if (prefetched && prefetched->header == track->stream) {
+        MP_VERBOSE(mpctx, "Using pre-decoded audio.\n");
+        mpctx->prefetched_audio = NULL;
+        track->d_audio = prefetched;
+        return 1;
+    }
+    uninit_prefetched_audio(mpctx);
+
     track->d_audio = talloc_zero(NULL, struct dec_audio);
     struct dec_audio *d_audio = track->d_audio;
     d_audio->log = mp_log_new(d_audio, mpctx->log, "!ad");
@@ -481,6 +490,8 @@ int init_audio_decoder(struct MPContext *mpctx, struct track *track)
     d_audio->opts = mpctx->opts;
     d_audio->header = track->stream;
     d_audio->codec = track->stream->codec;
+    d_audio->wakeup_cb = mp_wakeup_demux_cb;
+    d_audio->wakeup_cb_ctx = mpctx;
 
     d_audio->try_spdif = true;
 
@@ -499,6 +510,12 @@ init_error:
     return 0;
 }
 
+void uninit_prefetched_audio(struct MPContext *mpctx)
+{
+    audio_uninit(mpctx->prefetched_audio);
+    mpctx->prefetched_audio = NULL;
+}
+
 void reinit_audio_chain(struct MPContext *mpctx)
 {
     reinit_audio_chain_src(mpctx, NULL);
@@ -641,7 +658,7 @@ static void dump_audio_stats(struct MPContext *mpctx)
     }
     double current_audio = mpctx->written_audio - delay;
     double current_time = (mp_time_us() - mpctx->audio_stat_start) / 1e6;
-    MP_STATS(mpctx, "value %f ao-dev", current_audio - current_time);
+    MP_STATS_VALUE(mpctx, "ao-dev", current_audio - current_time);
 }
 
 // Return the number of samples that must be skipped or prepended to reach the
@@ -804,7 +821,7 @@ static int filter_audio(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
     if (afs->initialized < 1)
         return AD_ERR;
 
-    MP_STATS(ao_c, "start audio");
+    MP_STATS_START(ao_c, "audio");
 
     double endpts = get_play_end_pts(mpctx);
 
@@ -856,7 +873,7 @@ static int filter_audio(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
     if (res == 0 && mp_audio_buffer_samples(outbuf) < minsamples && eof)
         res = AD_EOF;
 
-    MP_STATS(ao_c, "end audio");
+    MP_STATS_END(ao_c, "audio");
 
     return res;
 }
@@ -1034,10 +1051,10 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
         mpctx->last_av_difference += skip_duplicate / play_samplerate;
         if (skip_duplicate >= 0) {
             mp_audio_buffer_skip(ao_c->ao_buffer, skip_duplicate);
-            MP_STATS(mpctx, "drop-audio");
+            MP_STATS_SIGNAL(mpctx, "drop-audio");
         } else {
             mp_audio_buffer_duplicate(ao_c->ao_buffer, -skip_duplicate);
-            MP_STATS(mpctx, "duplicate-audio");
+            MP_STATS_SIGNAL(mpctx, "duplicate-audio");
         }
         MP_VERBOSE(mpctx, "audio skip_duplicate=%d\n", skip_duplicate);
     }
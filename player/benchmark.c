@@ -0,0 +1,203 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// --benchmark: per-frame times of the video pipeline stages, plus the overall
+// frame rate. Like sync_stats.c, values are collected into fixed histograms,
+// but with 10 us bins, since most stages take well below 1 ms per frame.
+
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+#include "benchmark.h"
+#include "core.h"
+#include "common/common.h"
+#include "common/mem_usage.h"
+#include "common/msg.h"
+#include "misc/histogram.h"
+#include "misc/node.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/timer.h"
+#include "video/out/vo.h"
+
+#define BIN_US 10
+#define NUM_BINS 10000  // up to 100 ms; longer times are counted in the last bin
+
+static const char *const stage_names[BENCH_STAGE_COUNT] = {
+    [BENCH_DECODE]      = "decode",
+    [BENCH_FILTER]      = "filter",
+    [BENCH_DRAW]        = "draw",
+    [BENCH_FLIP]        = "flip",
+    [BENCH_GPU_UPLOAD]  = "gpu-upload",
+    [BENCH_GPU_RENDER]  = "gpu-render",
+    [BENCH_GPU_PRESENT] = "gpu-present",
+};
+
+struct benchmark {
+    struct mp_log *log;
+    // Protected by lock, as the VO thread adds its frame times directly.
+    pthread_mutex_t lock;
+    bool active;
+    struct mp_histogram *hist[BENCH_STAGE_COUNT];
+    int64_t frames;
+    int64_t first_frame, last_frame;    // mp_time_us() of rendered frames
+};
+
+static void destroy_benchmark(void *ptr)
+{
+    struct benchmark *b = ptr;
+    pthread_mutex_destroy(&b->lock);
+}
+
+void benchmark_init(struct MPContext *mpctx)
+{
+    struct benchmark *b = talloc_zero(mpctx, struct benchmark);
+    talloc_set_destructor(b, destroy_benchmark);
+    b->log = mp_log_new(b, mpctx->log, "benchmark");
+    pthread_mutex_init(&b->lock, NULL);
+    mpctx->benchmark = b;
+}
+
+void benchmark_reset(struct MPContext *mpctx)
+{
+    struct benchmark *b = mpctx->benchmark;
+    pthread_mutex_lock(&b->lock);
+    b->active = mpctx->opts->benchmark;
+    for (int n = 0; n < BENCH_STAGE_COUNT; n++) {
+        if (b->active && !b->hist[n])
+            b->hist[n] = mp_histogram_create(b, 1e-6, 0, BIN_US, NUM_BINS);
+        if (b->hist[n])
+            mp_histogram_reset(b->hist[n]);
+    }
+    b->frames = 0;
+    b->first_frame = b->last_frame = 0;
+    pthread_mutex_unlock(&b->lock);
+}
+
+bool benchmark_active(struct MPContext *mpctx)
+{
+    // Only changed by the playback thread.
+    return mpctx->benchmark->active;
+}
+
+static void add_value(struct mp_histogram *h, int64_t us)
+{
+    mp_histogram_add(h, MPMAX(us, 0) / 1e6);
+}
+
+void benchmark_add(struct MPContext *mpctx, enum bench_stage stage, int64_t us)
+{
+    struct benchmark *b = mpctx->benchmark;
+    pthread_mutex_lock(&b->lock);
+    if (b->active)
+        add_value(b->hist[stage], us);
+    pthread_mutex_unlock(&b->lock);
+}
+
+void benchmark_vo_frame_cb(void *ctx, struct vo_frame_timing *t)
+{
+    struct MPContext *mpctx = ctx;
+    struct benchmark *b = mpctx->benchmark;
+    int64_t now = mp_time_us();
+    pthread_mutex_lock(&b->lock);
+    if (b->active) {
+        if (!b->frames)
+            b->first_frame = now;
+        b->last_frame = now;
+        b->frames++;
+        add_value(b->hist[BENCH_DRAW], t->draw);
+        add_value(b->hist[BENCH_FLIP], t->flip);
+        if (t->upload >= 0)
+            add_value(b->hist[BENCH_GPU_UPLOAD], t->upload);
+        if (t->render >= 0)
+            add_value(b->hist[BENCH_GPU_RENDER], t->render);
+        if (t->present >= 0)
+            add_value(b->hist[BENCH_GPU_PRESENT], t->present);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static double get_fps(struct benchmark *b)
+{
+    int64_t duration = b->last_frame - b->first_frame;
+    return b->frames > 1 && duration > 0 ? (b->frames - 1) / (duration / 1e6) : 0;
+}
+
+static void write_file(struct MPContext *mpctx, const char *file)
+{
+    struct benchmark *b = mpctx->benchmark;
+    void *tmp = talloc_new(NULL);
+
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(tmp, root.u.list);
+    node_map_add_string(&root, "filename", mpctx->filename);
+    node_map_add(&root, "frames", MPV_FORMAT_INT64)->u.int64 = b->frames;
+    node_map_add(&root, "duration", MPV_FORMAT_DOUBLE)->u.double_ =
+        (b->last_frame - b->first_frame) / 1e6;
+    node_map_add(&root, "fps", MPV_FORMAT_DOUBLE)->u.double_ = get_fps(b);
+    struct mpv_node *stages = node_map_add(&root, "stages", MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < BENCH_STAGE_COUNT; n++) {
+        struct mpv_node *e = node_map_add(stages, stage_names[n],
+                                          MPV_FORMAT_NODE_MAP);
+        mp_histogram_get_node(b->hist[n], e, true);
+    }
+    struct mpv_node *mem = node_map_add(&root, "memory", MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < MP_MEM_CATEGORY_COUNT; n++) {
+        node_map_add(mem, mp_mem_category_name(n), MPV_FORMAT_INT64)->u.int64 =
+            mp_mem_usage_get(n).peak_bytes;
+    }
+
+    char *path = mp_get_user_path(tmp, mpctx->global, file);
+    mp_append_json_line(b->log, path, &root);
+
+    talloc_free(tmp);
+}
+
+void benchmark_write(struct MPContext *mpctx)
+{
+    struct benchmark *b = mpctx->benchmark;
+    if (!b->active || !mpctx->filename)
+        return;
+
+    pthread_mutex_lock(&b->lock);
+
+    MP_INFO(b, "%"PRId64" frames in %.3f s: %.2f fps\n", b->frames,
+            (b->last_frame - b->first_frame) / 1e6, get_fps(b));
+    for (int n = 0; n < BENCH_STAGE_COUNT; n++) {
+        struct mp_histogram *h = b->hist[n];
+        if (!h->count)
+            continue;
+        MP_INFO(b, "%12s: mean %.3f ms, p50 %.3f ms, p95 %.3f ms, "
+                "p99 %.3f ms, max %.3f ms\n", stage_names[n],
+                h->sum * 1e3 / h->count,
+                mp_histogram_get_percentile(h, 50) * 1e3,
+                mp_histogram_get_percentile(h, 95) * 1e3,
+                mp_histogram_get_percentile(h, 99) * 1e3, h->max * 1e3);
+    }
+    for (int n = 0; n < MP_MEM_CATEGORY_COUNT; n++) {
+        struct mp_mem_usage u = mp_mem_usage_get(n);
+        MP_INFO(b, "%15s: peak %.1f MiB\n", mp_mem_category_name(n),
+                u.peak_bytes / (1024.0 * 1024));
+    }
+
+    char *file = mpctx->opts->benchmark_file;
+    if (file && file[0])
+        write_file(mpctx, file);
+
+    pthread_mutex_unlock(&b->lock);
+}
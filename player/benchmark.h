@@ -0,0 +1,58 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_BENCHMARK_H
+#define MPLAYER_BENCHMARK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct MPContext;
+struct vo_frame_timing;
+
+enum bench_stage {
+    BENCH_DECODE,           // time in the video decoder
+    BENCH_FILTER,           // vf_filter_frame()
+    BENCH_DRAW,             // VO draw_frame (CPU)
+    BENCH_FLIP,             // VO flip_page (CPU)
+    BENCH_GPU_UPLOAD,       // GPU timers from VOCTRL_PERFORMANCE_DATA
+    BENCH_GPU_RENDER,
+    BENCH_GPU_PRESENT,
+    BENCH_STAGE_COUNT
+};
+
+// One time initialization at program start.
+void benchmark_init(struct MPContext *mpctx);
+
+// Drop all values. Called when playback of a file starts.
+void benchmark_reset(struct MPContext *mpctx);
+
+// Whether --benchmark is enabled for the current file.
+bool benchmark_active(struct MPContext *mpctx);
+
+// Record a per-frame time (in microseconds). Playback thread only.
+void benchmark_add(struct MPContext *mpctx, enum bench_stage stage,
+                   int64_t us);
+
+// vo_extra.frame_timing_cb; ctx is the MPContext.
+void benchmark_vo_frame_cb(void *ctx, struct vo_frame_timing *t);
+
+// Print the report, and append it to --benchmark-file, if set. Called when
+// playback of a file ends.
+void benchmark_write(struct MPContext *mpctx);
+
+#endif /* MPLAYER_BENCHMARK_H */
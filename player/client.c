@@ -29,11 +29,14 @@
 #include "input/cmd_list.h"
 #include "misc/ctype.h"
 #include "misc/dispatch.h"
+#include "misc/mpsc_queue.h"
+#include "misc/node.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/m_property.h"
 #include "options/path.h"
 #include "options/parse_configfile.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "osdep/io.h"
@@ -71,10 +74,29 @@ struct mp_client_api {
 
     struct mp_custom_protocol *custom_protocols;
     int num_custom_protocols;
+
+    struct node_snapshot **snapshots;   // cache, see get_snapshot()
+    int num_snapshots;
+    uint64_t snapshots_gen;             // incremented on invalidation
+};
+
+// Immutable, refcounted property value (see mpv_get_property_node_ref()).
+struct node_snapshot {
+    struct mpv_node node;   // must be first; API users get a pointer to it
+    atomic_int refcount;
+    int id;                 // ==mp_get_property_id(name)
+    uint64_t event_mask;    // ==mp_get_property_event_mask(name)
+};
+
+// Element of mpv_handle.events.
+struct queued_event {
+    struct mpv_event event;
+    int64_t queue_time;     // mp_time_us() when it was pushed
 };
 
 struct observe_property {
     char *name;
+    struct m_property_handle handle; // resolved name
     int id;                 // ==mp_get_property_id(name)
     uint64_t event_mask;    // ==mp_get_property_event_mask(name)
     int64_t reply_id;
@@ -85,6 +107,10 @@ struct observe_property {
     bool dead;              // property unobserved while retrieving value
     bool new_value_valid, user_value_valid;
     union m_option_value new_value, user_value;
+    // If set, new_value/user_value are unused, and the values are references
+    // to shared snapshots instead (MPV_FORMAT_NODE with cached properties).
+    bool use_snapshot;
+    struct node_snapshot *new_snap, *user_snap;
     struct mpv_handle *client;
 };
 
@@ -111,32 +137,60 @@ struct mpv_handle {
     void *wakeup_cb_ctx;
     int wakeup_pipe[2];
 
+    // -- lock-free event queue; pushed by any thread, popped by the client
+
+    struct mp_mpsc_queue *events;
+    int max_events;             // ==mp_mpsc_queue_size(events)
+    atomic_int used_events;     // queued events + reserved_events
+    atomic_int reserved_events; // number of entries reserved for replies
+    atomic_bool choked;         // recovering from queue overflow
+    atomic_int dropped_events;  // number of events lost since choked was set
+    atomic_ullong coalesce_pending; // bits of coalesced events still queued
+
+    // -- statistics for mp_client_get_stats(); updated atomically
+
+    atomic_ullong stat_events;          // events returned by mpv_wait_event()
+    atomic_ullong stat_handler_us;      // time from returning an event until
+                                        // the next mpv_wait_event() call
+    atomic_ullong stat_queue_lag_us;    // summed time events were queued
+    atomic_ullong stat_queue_lag_max_us;
+    atomic_ullong stat_lock_count;      // synchronous accesses to the core
+    atomic_ullong stat_lock_wait_us;    // time waiting for the core lock
+    atomic_ullong stat_lock_hold_us;    // time the core lock was held
+    atomic_ullong stat_property_reads;  // including observed properties
+
+    // -- modified with lock held, read atomically by send_event()
+
+    atomic_ullong event_mask;
+    atomic_ullong coalesce_mask;        // events to coalesce
+    atomic_ullong property_event_masks; // or-ed together event masks of all properties
+
     // -- protected by lock
 
-    uint64_t event_mask;
     bool queued_wakeup;
     int suspend_count;
 
-    mpv_event *events;      // ringbuffer of max_events entries
-    int max_events;         // allocated number of entries in events
-    int first_event;        // events[first_event] is the first readable event
-    int num_events;         // number of readable events
-    int reserved_events;    // number of entries reserved for replies
-    bool choked;            // recovering from queue overflow
-
     struct observe_property **properties;
     int num_properties;
     int lowest_changed;     // attempt at making change processing incremental
     int properties_updating;
-    uint64_t property_event_masks; // or-ed together event masks of all properties
 
     bool fuzzy_initialized; // see scripting.c wait_loaded()
+    int64_t create_time;    // mp_time_us() when created (constant)
+    int64_t init_time;      // time until fuzzy_initialized; -1 if still unset
     struct mp_log_buffer *messages;
+    int64_t event_return_time; // when mpv_wait_event() returned an event
+
+    // -- protected by the core lock
+    int64_t lock_time;      // when the core lock was acquired
 };
 
 static bool gen_log_message_event(struct mpv_handle *ctx);
 static bool gen_property_change_event(struct mpv_handle *ctx);
 static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask);
+static void snapshot_unref(struct node_snapshot *snap);
+static void invalidate_snapshots(struct mp_client_api *clients, int id,
+                                 uint64_t event_mask);
 
 void mp_clients_init(struct MPContext *mpctx)
 {
@@ -153,6 +207,9 @@ void mp_clients_destroy(struct MPContext *mpctx)
     if (!mpctx->clients)
         return;
     assert(mpctx->clients->num_clients == 0);
+    pthread_mutex_lock(&mpctx->clients->lock);
+    invalidate_snapshots(mpctx->clients, -1, -1);
+    pthread_mutex_unlock(&mpctx->clients->lock);
     pthread_mutex_destroy(&mpctx->clients->lock);
     talloc_free(mpctx->clients);
     mpctx->clients = NULL;
@@ -166,22 +223,6 @@ int mp_clients_num(struct MPContext *mpctx)
     return num_clients;
 }
 
-// Test for "fuzzy" initialization of all clients. That is, all clients have
-// at least called mpv_wait_event() at least once since creation (or exited).
-bool mp_clients_all_initialized(struct MPContext *mpctx)
-{
-    bool all_ok = true;
-    pthread_mutex_lock(&mpctx->clients->lock);
-    for (int n = 0; n < mpctx->clients->num_clients; n++) {
-        struct mpv_handle *ctx = mpctx->clients->clients[n];
-        pthread_mutex_lock(&ctx->lock);
-        all_ok &= ctx->fuzzy_initialized;
-        pthread_mutex_unlock(&ctx->lock);
-    }
-    pthread_mutex_unlock(&mpctx->clients->lock);
-    return all_ok;
-}
-
 static void invalidate_global_event_mask(struct mpv_handle *ctx)
 {
     pthread_mutex_lock(&ctx->clients->lock);
@@ -207,6 +248,57 @@ bool mp_client_exists(struct MPContext *mpctx, const char *client_name)
     return r;
 }
 
+// Test for "fuzzy" initialization of the given client. That is, it has called
+// mpv_wait_event() at least once since creation, or it has exited.
+bool mp_client_initialized(struct MPContext *mpctx, const char *client_name)
+{
+    bool ok = true;
+    pthread_mutex_lock(&mpctx->clients->lock);
+    struct mpv_handle *ctx = find_client(mpctx->clients, client_name);
+    if (ctx) {
+        pthread_mutex_lock(&ctx->lock);
+        ok = ctx->fuzzy_initialized;
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    pthread_mutex_unlock(&mpctx->clients->lock);
+    return ok;
+}
+
+// Append a map with the statistics of each client to the array dst.
+void mp_client_get_stats(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    struct mp_client_api *clients = mpctx->clients;
+
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_clients; n++) {
+        struct mpv_handle *ctx = clients->clients[n];
+        struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        uint64_t events = atomic_load(&ctx->stat_events);
+        node_map_add_string(e, "name", ctx->name);
+        node_map_add(e, "events", MPV_FORMAT_INT64)->u.int64 = events;
+        node_map_add(e, "event-handler-time", MPV_FORMAT_DOUBLE)->u.double_ =
+            atomic_load(&ctx->stat_handler_us) / 1e6;
+        node_map_add(e, "event-lag-avg", MPV_FORMAT_DOUBLE)->u.double_ =
+            events ? atomic_load(&ctx->stat_queue_lag_us) / 1e6 / events : 0;
+        node_map_add(e, "event-lag-max", MPV_FORMAT_DOUBLE)->u.double_ =
+            atomic_load(&ctx->stat_queue_lag_max_us) / 1e6;
+        node_map_add(e, "core-lock-count", MPV_FORMAT_INT64)->u.int64 =
+            atomic_load(&ctx->stat_lock_count);
+        node_map_add(e, "core-lock-wait-time", MPV_FORMAT_DOUBLE)->u.double_ =
+            atomic_load(&ctx->stat_lock_wait_us) / 1e6;
+        node_map_add(e, "core-lock-hold-time", MPV_FORMAT_DOUBLE)->u.double_ =
+            atomic_load(&ctx->stat_lock_hold_us) / 1e6;
+        node_map_add(e, "property-reads", MPV_FORMAT_INT64)->u.int64 =
+            atomic_load(&ctx->stat_property_reads);
+        pthread_mutex_lock(&ctx->lock);
+        int64_t init_time = ctx->init_time;
+        pthread_mutex_unlock(&ctx->lock);
+        node_map_add(e, "init-time", MPV_FORMAT_DOUBLE)->u.double_ =
+            init_time < 0 ? -1 : init_time / 1e6;
+    }
+    pthread_mutex_unlock(&clients->lock);
+}
+
 void mp_client_enter_shutdown(struct MPContext *mpctx)
 {
     pthread_mutex_lock(&mpctx->clients->lock);
@@ -237,19 +329,35 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         return NULL;
     }
 
-    int num_events = 1000;
-
     struct mpv_handle *client = talloc_ptrtype(NULL, client);
     *client = (struct mpv_handle){
         .log = mp_log_new(client, clients->mpctx->log, nname),
         .mpctx = clients->mpctx,
         .clients = clients,
         .cur_event = talloc_zero(client, struct mpv_event),
-        .events = talloc_array(client, mpv_event, num_events),
-        .max_events = num_events,
-        .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
+        .events = mp_mpsc_queue_new(client, sizeof(struct queued_event), 1000),
         .wakeup_pipe = {-1, -1},
+        .create_time = mp_time_us(),
+        .init_time = -1,
     };
+    client->max_events = mp_mpsc_queue_size(client->events);
+    atomic_store(&client->used_events, 0);
+    atomic_store(&client->reserved_events, 0);
+    atomic_store(&client->choked, false);
+    atomic_store(&client->dropped_events, 0);
+    atomic_store(&client->coalesce_pending, 0);
+    // exclude internal events
+    atomic_store(&client->event_mask, (1ULL << INTERNAL_EVENT_BASE) - 1);
+    atomic_store(&client->coalesce_mask, 0);
+    atomic_store(&client->property_event_masks, 0);
+    atomic_store(&client->stat_events, 0);
+    atomic_store(&client->stat_handler_us, 0);
+    atomic_store(&client->stat_queue_lag_us, 0);
+    atomic_store(&client->stat_queue_lag_max_us, 0);
+    atomic_store(&client->stat_lock_count, 0);
+    atomic_store(&client->stat_lock_wait_us, 0);
+    atomic_store(&client->stat_lock_hold_us, 0);
+    atomic_store(&client->stat_property_reads, 0);
     pthread_mutex_init(&client->lock, NULL);
     pthread_mutex_init(&client->wakeup_lock, NULL);
     pthread_cond_init(&client->wakeup, NULL);
@@ -338,18 +446,23 @@ void mpv_resume(mpv_handle *ctx)
 
 static void lock_core(mpv_handle *ctx)
 {
+    int64_t start = mp_time_us();
     mp_dispatch_lock(ctx->mpctx->dispatch);
+    ctx->lock_time = mp_time_us();
+    atomic_fetch_add(&ctx->stat_lock_count, 1);
+    atomic_fetch_add(&ctx->stat_lock_wait_us, ctx->lock_time - start);
 }
 
 static void unlock_core(mpv_handle *ctx)
 {
+    atomic_fetch_add(&ctx->stat_lock_hold_us, mp_time_us() - ctx->lock_time);
     mp_dispatch_unlock(ctx->mpctx->dispatch);
 }
 
 void mpv_wait_async_requests(mpv_handle *ctx)
 {
     pthread_mutex_lock(&ctx->lock);
-    while (ctx->reserved_events || ctx->properties_updating)
+    while (atomic_load(&ctx->reserved_events) || ctx->properties_updating)
         wait_wakeup(ctx, INT64_MAX);
     pthread_mutex_unlock(&ctx->lock);
 }
@@ -372,13 +485,11 @@ void mpv_detach_destroy(mpv_handle *ctx)
     for (int n = 0; n < clients->num_clients; n++) {
         if (clients->clients[n] == ctx) {
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
-            while (ctx->num_events) {
-                talloc_free(ctx->events[ctx->first_event].data);
-                ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-                ctx->num_events--;
-            }
+            struct queued_event qe;
+            while (mp_mpsc_queue_pop(ctx->events, &qe))
+                talloc_free(qe.event.data);
             mp_msg_log_buffer_destroy(ctx->messages);
-            osd_set_external(ctx->mpctx->osd, ctx, 0, 0, NULL);
+            osd_set_external(ctx->mpctx->osd, ctx, 0, 0, 0, NULL);
             mp_input_remove_sections_by_owner(ctx->mpctx->input, ctx->name);
             pthread_cond_destroy(&ctx->wakeup);
             pthread_mutex_destroy(&ctx->wakeup_lock);
@@ -391,7 +502,7 @@ void mpv_detach_destroy(mpv_handle *ctx)
             ctx = NULL;
             // shutdown_clients() sleeps to avoid wasting CPU.
             // mp_hook_test_completion() also relies on this a bit.
-            mp_wakeup_core(clients->mpctx);
+            mp_wakeup_core_src(clients->mpctx, MP_WAKEUP_CLIENT);
             break;
         }
     }
@@ -479,6 +590,7 @@ mpv_handle *mpv_create(void)
     if (ctx) {
         ctx->owner = true;
         ctx->fuzzy_initialized = true;
+        ctx->init_time = 0;
         m_config_set_profile(mpctx->mconfig, "libmpv", 0);
     } else {
         mp_destroy(mpctx);
@@ -544,55 +656,69 @@ static void dup_event_data(struct mpv_event *ev)
     }
 }
 
-// Reserve an entry in the ring buffer. This can be used to guarantee that the
-// reply can be made, even if the buffer becomes congested _after_ sending
-// the request.
-// Returns an error code if the buffer is full.
-static int reserve_reply(struct mpv_handle *ctx)
+// Claim an entry in the event queue. Every claimed entry is either pushed, or
+// reserved for a reply. Popping the event releases the entry.
+static bool claim_event(struct mpv_handle *ctx)
 {
-    int res = MPV_ERROR_EVENT_QUEUE_FULL;
-    pthread_mutex_lock(&ctx->lock);
-    if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
-    {
-        ctx->reserved_events++;
-        res = 0;
+    int used = atomic_load(&ctx->used_events);
+    while (used < ctx->max_events) {
+        if (atomic_compare_exchange_strong(&ctx->used_events, &used, used + 1))
+            return true;
     }
-    pthread_mutex_unlock(&ctx->lock);
-    return res;
+    return false;
 }
 
-static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool copy)
+// Push an event to a claimed entry. This can't fail, because the number of
+// claimed entries never exceeds the queue size.
+static void push_event(struct mpv_handle *ctx, struct mpv_event *event)
 {
-    if (ctx->num_events + ctx->reserved_events >= ctx->max_events)
-        return -1;
-    if (copy)
-        dup_event_data(&event);
-    ctx->events[(ctx->first_event + ctx->num_events) % ctx->max_events] = event;
-    ctx->num_events++;
+    struct queued_event qe = {*event, mp_time_us()};
+    if (!mp_mpsc_queue_push(ctx->events, &qe))
+        abort(); // not reached
     wakeup_client(ctx);
+}
+
+// Reserve an entry in the ring buffer. This can be used to guarantee that the
+// reply can be made, even if the buffer becomes congested _after_ sending
+// the request.
+// Returns an error code if the buffer is full.
+static int reserve_reply(struct mpv_handle *ctx)
+{
+    if (atomic_load(&ctx->choked) || !claim_event(ctx))
+        return MPV_ERROR_EVENT_QUEUE_FULL;
+    atomic_fetch_add(&ctx->reserved_events, 1);
     return 0;
 }
 
+// Does not need the client lock (unless the event changes properties).
 static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy)
 {
-    pthread_mutex_lock(&ctx->lock);
     uint64_t mask = 1ULL << event->event_id;
-    if (ctx->property_event_masks & mask)
+    if (atomic_load(&ctx->property_event_masks) & mask) {
+        pthread_mutex_lock(&ctx->lock);
         notify_property_events(ctx, mask);
-    int r;
-    if (!(ctx->event_mask & mask)) {
-        r = 0;
-    } else if (ctx->choked) {
-        r = -1;
-    } else {
-        r = append_event(ctx, *event, copy);
-        if (r < 0) {
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    if (!(atomic_load(&ctx->event_mask) & mask))
+        return 0;
+    // Only one instance of a coalesced event is in the queue at a time.
+    bool coalesce = !event->data && (atomic_load(&ctx->coalesce_mask) & mask);
+    if (coalesce && (atomic_fetch_or(&ctx->coalesce_pending, mask) & mask))
+        return 0;
+    if (atomic_load(&ctx->choked) || !claim_event(ctx)) {
+        bool was_choked = false;
+        if (atomic_compare_exchange_strong(&ctx->choked, &was_choked, true))
             MP_ERR(ctx, "Too many events queued.\n");
-            ctx->choked = true;
-        }
+        atomic_fetch_add(&ctx->dropped_events, 1);
+        if (coalesce)
+            atomic_fetch_and(&ctx->coalesce_pending, ~mask);
+        return -1;
     }
-    pthread_mutex_unlock(&ctx->lock);
-    return r;
+    struct mpv_event ev = *event;
+    if (copy)
+        dup_event_data(&ev);
+    push_event(ctx, &ev);
+    return 0;
 }
 
 // Send a reply; the reply must have been previously reserved with
@@ -601,13 +727,11 @@ static void send_reply(struct mpv_handle *ctx, uint64_t userdata,
                        struct mpv_event *event)
 {
     event->reply_userdata = userdata;
-    pthread_mutex_lock(&ctx->lock);
     // If this fails, reserve_reply() probably wasn't called.
-    assert(ctx->reserved_events > 0);
-    ctx->reserved_events--;
-    if (append_event(ctx, *event, false) < 0)
-        abort(); // not reached
-    pthread_mutex_unlock(&ctx->lock);
+    int reserved = atomic_fetch_add(&ctx->reserved_events, -1);
+    assert(reserved > 0);
+    (void)reserved;
+    push_event(ctx, event);
 }
 
 static void status_reply(struct mpv_handle *ctx, int event,
@@ -632,7 +756,8 @@ bool mp_client_event_is_registered(struct MPContext *mpctx, int event)
         for (int n = 0; n < clients->num_clients; n++) {
             struct mpv_handle *ctx = clients->clients[n];
             pthread_mutex_lock(&ctx->lock);
-            clients->event_masks |= ctx->event_mask | ctx->property_event_masks;
+            clients->event_masks |= atomic_load(&ctx->event_mask) |
+                                    atomic_load(&ctx->property_event_masks);
             pthread_mutex_unlock(&ctx->lock);
         }
     }
@@ -649,6 +774,8 @@ void mp_client_broadcast_event(struct MPContext *mpctx, int event, void *data)
 
     pthread_mutex_lock(&clients->lock);
 
+    invalidate_snapshots(clients, -1, 1ULL << event);
+
     for (int n = 0; n < clients->num_clients; n++) {
         struct mpv_event event_data = {
             .event_id = event,
@@ -712,14 +839,22 @@ int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
 
 int mpv_request_event(mpv_handle *ctx, mpv_event_id event, int enable)
 {
-    if (!mpv_event_name(event) || enable < 0 || enable > 1)
+    if (!mpv_event_name(event) || enable < 0 || enable > 2)
+        return MPV_ERROR_INVALID_PARAMETER;
+    if (event == MPV_EVENT_SHUTDOWN && enable != 1)
         return MPV_ERROR_INVALID_PARAMETER;
-    if (event == MPV_EVENT_SHUTDOWN && !enable)
+    if (enable == 2 && (event == MPV_EVENT_GET_PROPERTY_REPLY ||
+                        event == MPV_EVENT_SET_PROPERTY_REPLY ||
+                        event == MPV_EVENT_COMMAND_REPLY ||
+                        event == MPV_EVENT_BATCH_REPLY))
         return MPV_ERROR_INVALID_PARAMETER;
     assert(event < (int)INTERNAL_EVENT_BASE); // excluded above; they have no name
     pthread_mutex_lock(&ctx->lock);
     uint64_t bit = 1ULL << event;
-    ctx->event_mask = enable ? ctx->event_mask | bit : ctx->event_mask & ~bit;
+    uint64_t mask = atomic_load(&ctx->event_mask);
+    atomic_store(&ctx->event_mask, enable ? mask | bit : mask & ~bit);
+    mask = atomic_load(&ctx->coalesce_mask);
+    atomic_store(&ctx->coalesce_mask, enable == 2 ? mask | bit : mask & ~bit);
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
     return 0;
@@ -731,14 +866,23 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
 
     pthread_mutex_lock(&ctx->lock);
 
-    if (!ctx->fuzzy_initialized)
-        mp_wakeup_core(ctx->clients->mpctx);
+    int64_t now = mp_time_us();
+
+    if (!ctx->fuzzy_initialized) {
+        mp_wakeup_core_src(ctx->clients->mpctx, MP_WAKEUP_CLIENT);
+        ctx->init_time = now - ctx->create_time;
+        MP_VERBOSE(ctx, "Initialized after %.1f ms.\n", ctx->init_time / 1e3);
+    }
     ctx->fuzzy_initialized = true;
 
     if (timeout < 0)
         timeout = 1e20;
 
-    int64_t deadline = mp_add_timeout(mp_time_us(), timeout);
+    int64_t deadline = mp_add_timeout(now, timeout);
+
+    if (ctx->event_return_time)
+        atomic_fetch_add(&ctx->stat_handler_us, now - ctx->event_return_time);
+    ctx->event_return_time = 0;
 
     *event = (mpv_event){0};
     talloc_free_children(event);
@@ -746,24 +890,36 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
     while (1) {
         if (ctx->queued_wakeup)
             deadline = 0;
-        // Recover from overflow.
-        if (ctx->choked && !ctx->num_events) {
-            ctx->choked = false;
-            event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
-            break;
-        }
         // This will almost surely lead to a deadlock. (Polling is still ok.)
         if (ctx->suspend_count && timeout > 0) {
             MP_ERR(ctx, "attempting to wait while core is suspended");
             break;
         }
-        if (ctx->num_events) {
-            *event = ctx->events[ctx->first_event];
-            ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-            ctx->num_events--;
+        struct queued_event qe;
+        if (mp_mpsc_queue_pop(ctx->events, &qe)) {
+            *event = qe.event;
+            atomic_fetch_add(&ctx->used_events, -1);
+            uint64_t lag = mp_time_us() - qe.queue_time;
+            atomic_fetch_add(&ctx->stat_queue_lag_us, lag);
+            if (lag > atomic_load(&ctx->stat_queue_lag_max_us))
+                atomic_store(&ctx->stat_queue_lag_max_us, lag);
+            if (!event->data) {
+                // Further events of this type must be queued again.
+                atomic_fetch_and(&ctx->coalesce_pending,
+                                 ~(1ULL << event->event_id));
+            }
             talloc_steal(event, event->data);
             break;
         }
+        // Recover from overflow.
+        if (atomic_load(&ctx->choked)) {
+            int dropped = atomic_load(&ctx->dropped_events);
+            atomic_fetch_add(&ctx->dropped_events, -dropped);
+            atomic_store(&ctx->choked, false);
+            MP_WARN(ctx, "%d events were dropped.\n", dropped);
+            event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
+            break;
+        }
         // If there's a changed property, generate change event (never queued).
         if (gen_property_change_event(ctx))
             break;
@@ -776,6 +932,11 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
     }
     ctx->queued_wakeup = false;
 
+    if (event->event_id != MPV_EVENT_NONE) {
+        atomic_fetch_add(&ctx->stat_events, 1);
+        ctx->event_return_time = mp_time_us();
+    }
+
     pthread_mutex_unlock(&ctx->lock);
 
     return event;
@@ -931,9 +1092,9 @@ int mpv_set_option_string(mpv_handle *ctx, const char *name, const char *data)
 // Run a command in the playback thread.
 static void run_locked(mpv_handle *ctx, void (*fn)(void *fn_data), void *fn_data)
 {
-    mp_dispatch_lock(ctx->mpctx->dispatch);
+    lock_core(ctx);
     fn(fn_data);
-    mp_dispatch_unlock(ctx->mpctx->dispatch);
+    unlock_core(ctx);
 }
 
 // Run a command asynchronously. It's the responsibility of the caller to
@@ -1158,9 +1319,128 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, setproperty_fn, req);
 }
 
+struct batch_entry {
+    struct mp_cmd *cmd;         // if NULL, set property name to value
+    char *name;
+    struct mpv_node value;
+};
+
+struct batch_request {
+    struct MPContext *mpctx;
+    struct batch_entry *entries;
+    int num_entries;
+    struct mpv_handle *reply_ctx;
+    uint64_t userdata;
+};
+
+static void free_batch_req(void *ptr)
+{
+    struct batch_request *req = ptr;
+    for (int n = 0; n < req->num_entries; n++)
+        m_option_free(get_mp_type(MPV_FORMAT_NODE), &req->entries[n].value);
+}
+
+static void batch_fn(void *data)
+{
+    struct batch_request *req = data;
+
+    struct mpv_event_batch_reply *res = talloc_zero(NULL, struct mpv_event_batch_reply);
+    res->status = talloc_zero_array(res, int, req->num_entries);
+    res->num_status = req->num_entries;
+
+    struct mpv_event reply = {
+        .event_id = MPV_EVENT_BATCH_REPLY,
+        .data = res,
+    };
+
+    for (int n = 0; n < req->num_entries; n++) {
+        struct batch_entry *e = &req->entries[n];
+        int status;
+        if (e->cmd) {
+            int r = run_command(req->mpctx, e->cmd, NULL);
+            status = r >= 0 ? 0 : MPV_ERROR_COMMAND;
+        } else {
+            int err = mp_property_do(e->name, M_PROPERTY_SET_NODE, &e->value,
+                                     req->mpctx);
+            status = translate_property_error(err);
+        }
+        res->status[n] = status;
+        if (status < 0 && !reply.error)
+            reply.error = status;
+    }
+
+    send_reply(req->reply_ctx, req->userdata, &reply);
+}
+
+// Parse a {"name": ..., "data": ...} batch entry.
+static bool parse_batch_property(struct batch_request *req,
+                                 struct batch_entry *e, struct mpv_node *map)
+{
+    struct mpv_node_list *list = map->u.list;
+    struct mpv_node *name = NULL, *value = NULL;
+    for (int n = 0; list && n < list->num; n++) {
+        if (strcmp(list->keys[n], "name") == 0) {
+            name = &list->values[n];
+        } else if (strcmp(list->keys[n], "data") == 0) {
+            value = &list->values[n];
+        } else {
+            return false;
+        }
+    }
+    if (!name || name->format != MPV_FORMAT_STRING || !value)
+        return false;
+    e->name = talloc_strdup(req, name->u.string);
+    m_option_copy(get_mp_type(MPV_FORMAT_NODE), &e->value, value);
+    return true;
+}
+
+int mpv_command_batch_async(mpv_handle *ctx, uint64_t ud, mpv_node *batch)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!batch || batch->format != MPV_FORMAT_NODE_ARRAY)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct mpv_node_list *list = batch->u.list;
+    int num = list ? list->num : 0;
+
+    struct batch_request *req = talloc_ptrtype(NULL, req);
+    *req = (struct batch_request){
+        .mpctx = ctx->mpctx,
+        .entries = talloc_zero_array(req, struct batch_entry, num),
+        .reply_ctx = ctx,
+        .userdata = ud,
+    };
+    talloc_set_destructor(req, free_batch_req);
+
+    // Parse everything upfront, so that a bad entry rejects the whole batch
+    // before any of it runs.
+    for (int n = 0; n < num; n++) {
+        struct mpv_node *item = &list->values[n];
+        struct batch_entry *e = &req->entries[req->num_entries++];
+        if (item->format == MPV_FORMAT_NODE_MAP) {
+            if (!parse_batch_property(req, e, item))
+                goto error;
+        } else {
+            e->cmd = mp_input_parse_cmd_node(ctx->log, item);
+            if (!e->cmd)
+                goto error;
+            talloc_steal(req, e->cmd);
+            e->cmd->sender = ctx->name;
+        }
+    }
+
+    return run_async(ctx, batch_fn, req);
+
+error:
+    talloc_free(req);
+    return MPV_ERROR_INVALID_PARAMETER;
+}
+
 struct getproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    const struct m_property_handle *handle; // optional, resolved name
     mpv_format format;
     void *data;
     int status;
@@ -1175,6 +1455,140 @@ static void free_prop_data(void *ptr)
     m_option_free(type, prop->data);
 }
 
+// Read the property as mpv_node. On success, the caller owns the node.
+static int get_property_node(struct MPContext *mpctx,
+                             const struct m_property_handle *h,
+                             struct mpv_node *node)
+{
+    *node = (struct mpv_node){{0}};
+    int err = mp_property_do_handle(h, M_PROPERTY_GET_NODE, node, mpctx);
+    if (err == M_PROPERTY_NOT_IMPLEMENTED) {
+        // Go through explicit string conversion. Same reasoning as on the
+        // GET code path.
+        char *s = NULL;
+        err = mp_property_do_handle(h, M_PROPERTY_GET_STRING, &s, mpctx);
+        if (err != M_PROPERTY_OK)
+            return err;
+        node->format = MPV_FORMAT_STRING;
+        node->u.string = s;
+    }
+    return err;
+}
+
+static void snapshot_free(void *p)
+{
+    struct node_snapshot *snap = p;
+    mpv_free_node_contents(&snap->node);
+}
+
+static struct node_snapshot *snapshot_ref(struct node_snapshot *snap)
+{
+    atomic_fetch_add(&snap->refcount, 1);
+    return snap;
+}
+
+static void snapshot_unref(struct node_snapshot *snap)
+{
+    if (snap && atomic_fetch_add(&snap->refcount, -1) == 1)
+        talloc_free(snap);
+}
+
+// Big properties, whose snapshots are kept until the property changes. All of
+// them must be reliably notified with mp_notify() or mp_notify_property().
+static const char *const cached_properties[] = {
+    "track-list",
+    "playlist",
+    "chapter-list",
+    "edition-list",
+    "metadata",
+    NULL
+};
+
+static bool is_cached_property(const char *name)
+{
+    for (int n = 0; cached_properties[n]; n++) {
+        if (strcmp(cached_properties[n], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Return a new reference to a snapshot of the property value, or NULL on
+// error (*err is set to a M_PROPERTY_* error code). For cached properties,
+// all callers share the same snapshot until the property changes.
+// Must be called with the core locked, and without clients->lock held.
+static struct node_snapshot *get_snapshot(struct MPContext *mpctx,
+                                          const char *name,
+                                          const struct m_property_handle *h,
+                                          int *err)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    int id = mp_get_property_id(mpctx, name);
+    bool cache = id >= 0 && is_cached_property(name);
+
+    uint64_t gen = 0;
+    if (cache) {
+        struct node_snapshot *snap = NULL;
+        pthread_mutex_lock(&clients->lock);
+        for (int n = 0; n < clients->num_snapshots; n++) {
+            if (clients->snapshots[n]->id == id) {
+                snap = snapshot_ref(clients->snapshots[n]);
+                break;
+            }
+        }
+        gen = clients->snapshots_gen;
+        pthread_mutex_unlock(&clients->lock);
+        if (snap) {
+            *err = M_PROPERTY_OK;
+            return snap;
+        }
+    }
+
+    struct mpv_node node;
+    *err = get_property_node(mpctx, h, &node);
+    if (*err <= 0)
+        return NULL;
+
+    struct node_snapshot *snap = talloc_ptrtype(NULL, snap);
+    *snap = (struct node_snapshot){
+        .node = node,
+        .id = id,
+        .event_mask = mp_get_property_event_mask(name),
+    };
+    atomic_store(&snap->refcount, 1);
+    talloc_set_destructor(snap, snapshot_free);
+
+    if (cache) {
+        pthread_mutex_lock(&clients->lock);
+        // Don't cache it if it might already be outdated. (Events can be
+        // broadcast from other threads.)
+        if (gen == clients->snapshots_gen) {
+            MP_TARRAY_APPEND(clients, clients->snapshots,
+                             clients->num_snapshots, snapshot_ref(snap));
+        }
+        pthread_mutex_unlock(&clients->lock);
+    }
+    return snap;
+}
+
+// Drop cached snapshots of the property with the given ID, or of properties
+// affected by the events in event_mask. (id=-1, event_mask=-1 drops all.)
+// Called with clients->lock held.
+static void invalidate_snapshots(struct mp_client_api *clients, int id,
+                                 uint64_t event_mask)
+{
+    clients->snapshots_gen++;
+    for (int n = clients->num_snapshots - 1; n >= 0; n--) {
+        struct node_snapshot *snap = clients->snapshots[n];
+        if (snap->id == id || (snap->event_mask & event_mask) ||
+            event_mask == (uint64_t)-1)
+        {
+            MP_TARRAY_REMOVE_AT(clients->snapshots, clients->num_snapshots, n);
+            snapshot_unref(snap);
+        }
+    }
+}
+
 static void getproperty_fn(void *arg)
 {
     struct getproperty_request *req = arg;
@@ -1183,14 +1597,21 @@ static void getproperty_fn(void *arg)
     union m_option_value xdata = {0};
     void *data = req->data ? req->data : &xdata;
 
+    struct m_property_handle h;
+    if (req->handle) {
+        h = *req->handle;
+    } else {
+        mp_property_resolve(req->mpctx, req->name, &h);
+    }
+
     int err = -1;
     switch (req->format) {
     case MPV_FORMAT_OSD_STRING:
-        err = mp_property_do(req->name, M_PROPERTY_PRINT, data, req->mpctx);
+        err = mp_property_do_handle(&h, M_PROPERTY_PRINT, data, req->mpctx);
         break;
     case MPV_FORMAT_STRING: {
         char *s = NULL;
-        err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s, req->mpctx);
+        err = mp_property_do_handle(&h, M_PROPERTY_GET_STRING, &s, req->mpctx);
         if (err == M_PROPERTY_OK)
             *(char **)data = s;
         break;
@@ -1199,19 +1620,9 @@ static void getproperty_fn(void *arg)
     case MPV_FORMAT_FLAG:
     case MPV_FORMAT_INT64:
     case MPV_FORMAT_DOUBLE: {
-        struct mpv_node node = {{0}};
-        err = mp_property_do(req->name, M_PROPERTY_GET_NODE, &node, req->mpctx);
-        if (err == M_PROPERTY_NOT_IMPLEMENTED) {
-            // Go through explicit string conversion. Same reasoning as on the
-            // GET code path.
-            char *s = NULL;
-            err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s,
-                                 req->mpctx);
-            if (err != M_PROPERTY_OK)
-                break;
-            node.format = MPV_FORMAT_STRING;
-            node.u.string = s;
-        } else if (err <= 0)
+        struct mpv_node node;
+        err = get_property_node(req->mpctx, &h, &node);
+        if (err <= 0)
             break;
         if (req->format == MPV_FORMAT_NODE) {
             *(struct mpv_node *)data = node;
@@ -1264,10 +1675,58 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
         .format = format,
         .data = data,
     };
+    atomic_fetch_add(&ctx->stat_property_reads, 1);
     run_locked(ctx, getproperty_fn, &req);
     return req.status;
 }
 
+struct getsnapshot_request {
+    struct MPContext *mpctx;
+    const char *name;
+    struct node_snapshot *snap;
+    int status;
+};
+
+static void getsnapshot_fn(void *arg)
+{
+    struct getsnapshot_request *req = arg;
+    struct m_property_handle h;
+    mp_property_resolve(req->mpctx, req->name, &h);
+    int err;
+    req->snap = get_snapshot(req->mpctx, req->name, &h, &err);
+    req->status = translate_property_error(err);
+}
+
+int mpv_get_property_node_ref(mpv_handle *ctx, const char *name,
+                              const mpv_node **data)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!data)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    struct getsnapshot_request req = {
+        .mpctx = ctx->mpctx,
+        .name = name,
+    };
+    atomic_fetch_add(&ctx->stat_property_reads, 1);
+    run_locked(ctx, getsnapshot_fn, &req);
+    *data = req.snap ? &req.snap->node : NULL;
+    return req.status;
+}
+
+const mpv_node *mpv_node_ref(const mpv_node *node)
+{
+    if (node)
+        snapshot_ref((struct node_snapshot *)node);
+    return node;
+}
+
+void mpv_node_unref(const mpv_node *node)
+{
+    snapshot_unref((struct node_snapshot *)node);
+}
+
 char *mpv_get_property_string(mpv_handle *ctx, const char *name)
 {
     char *str = NULL;
@@ -1298,6 +1757,7 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
         .reply_ctx = ctx,
         .userdata = ud,
     };
+    atomic_fetch_add(&ctx->stat_property_reads, 1);
     return run_async(ctx, getproperty_fn, req);
 }
 
@@ -1309,6 +1769,8 @@ static void property_free(void *p)
         m_option_free(type, &prop->new_value);
         m_option_free(type, &prop->user_value);
     }
+    snapshot_unref(prop->new_snap);
+    snapshot_unref(prop->user_snap);
 }
 
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
@@ -1332,9 +1794,11 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .format = format,
         .changed = true,
         .need_new_value = true,
+        .use_snapshot = format == MPV_FORMAT_NODE && is_cached_property(name),
     };
+    mp_property_resolve(ctx->mpctx, prop->name, &prop->handle);
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
-    ctx->property_event_masks |= prop->event_mask;
+    atomic_fetch_or(&ctx->property_event_masks, prop->event_mask);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
@@ -1344,7 +1808,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
     pthread_mutex_lock(&ctx->lock);
-    ctx->property_event_masks = 0;
+    uint64_t property_event_masks = 0;
     int count = 0;
     for (int n = ctx->num_properties - 1; n >= 0; n--) {
         struct observe_property *prop = ctx->properties[n];
@@ -1362,8 +1826,9 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
             count++;
         }
         if (!prop->dead)
-            ctx->property_event_masks |= prop->event_mask;
+            property_event_masks |= prop->event_mask;
     }
+    atomic_store(&ctx->property_event_masks, property_event_masks);
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
     invalidate_global_event_mask(ctx);
@@ -1386,6 +1851,9 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 
     pthread_mutex_lock(&clients->lock);
 
+    if (id >= 0)
+        invalidate_snapshots(clients, id, 0);
+
     for (int n = 0; n < clients->num_clients; n++) {
         struct mpv_handle *client = clients->clients[n];
         pthread_mutex_lock(&client->lock);
@@ -1418,29 +1886,55 @@ static void update_prop(void *p)
     struct observe_property *prop = p;
     struct mpv_handle *ctx = prop->client;
 
+    atomic_fetch_add(&ctx->stat_property_reads, 1);
+
     const struct m_option *type = get_mp_type_get(prop->format);
     union m_option_value val = {0};
+    struct node_snapshot *snap = NULL;
+    int status;
 
-    struct getproperty_request req = {
-        .mpctx = ctx->mpctx,
-        .name = prop->name,
-        .format = prop->format,
-        .data = &val,
-    };
-
-    getproperty_fn(&req);
+    if (prop->use_snapshot) {
+        int err;
+        snap = get_snapshot(ctx->mpctx, prop->name, &prop->handle, &err);
+        status = translate_property_error(err);
+    } else {
+        struct getproperty_request req = {
+            .mpctx = ctx->mpctx,
+            .name = prop->name,
+            .handle = &prop->handle,
+            .format = prop->format,
+            .data = &val,
+        };
+        getproperty_fn(&req);
+        status = req.status;
+    }
 
     pthread_mutex_lock(&ctx->lock);
     ctx->properties_updating--;
     prop->updating = false;
-    m_option_free(type, &prop->new_value);
-    prop->new_value_valid = req.status >= 0;
-    if (prop->new_value_valid)
-        memcpy(&prop->new_value, &val, type->type->size);
+    prop->new_value_valid = status >= 0;
+    if (prop->use_snapshot) {
+        snapshot_unref(prop->new_snap);
+        prop->new_snap = snap;
+    } else {
+        m_option_free(type, &prop->new_value);
+        if (prop->new_value_valid)
+            memcpy(&prop->new_value, &val, type->type->size);
+    }
     if (prop->user_value_valid != prop->new_value_valid) {
         prop->changed = true;
     } else if (prop->user_value_valid && prop->new_value_valid) {
-        if (!compare_value(&prop->user_value, &prop->new_value, prop->format))
+        bool equal;
+        if (prop->use_snapshot) {
+            // Unchanged snapshots are the same object; skip the deep compare.
+            equal = prop->user_snap == prop->new_snap ||
+                    compare_value(&prop->user_snap->node, &prop->new_snap->node,
+                                  MPV_FORMAT_NODE);
+        } else {
+            equal = compare_value(&prop->user_value, &prop->new_value,
+                                  prop->format);
+        }
+        if (!equal)
             prop->changed = true;
     }
     if (prop->dead)
@@ -1472,14 +1966,24 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
             } else {
                 const struct m_option *type = get_mp_type_get(prop->format);
                 prop->user_value_valid = prop->new_value_valid;
-                if (prop->new_value_valid)
+                void *data = &prop->user_value;
+                if (prop->use_snapshot) {
+                    // Share the value instead of copying it.
+                    snapshot_unref(prop->user_snap);
+                    prop->user_snap = NULL;
+                    if (prop->new_value_valid) {
+                        prop->user_snap = snapshot_ref(prop->new_snap);
+                        data = &prop->user_snap->node;
+                    }
+                } else if (prop->new_value_valid) {
                     m_option_copy(type, &prop->user_value, &prop->new_value);
+                }
                 ctx->cur_property_event = (struct mpv_event_property){
                     .name = prop->name,
                     .format = prop->user_value_valid ? prop->format : 0,
                 };
                 if (prop->user_value_valid)
-                    ctx->cur_property_event.data = &prop->user_value;
+                    ctx->cur_property_event.data = data;
                 *ctx->cur_event = (struct mpv_event){
                     .event_id = MPV_EVENT_PROPERTY_CHANGE,
                     .reply_userdata = prop->reply_id,
@@ -1642,6 +2146,7 @@ static const char *const event_table[] = {
     [MPV_EVENT_PROPERTY_CHANGE] = "property-change",
     [MPV_EVENT_CHAPTER_CHANGE] = "chapter-change",
     [MPV_EVENT_QUEUE_OVERFLOW] = "event-queue-overflow",
+    [MPV_EVENT_BATCH_REPLY] = "batch-reply",
 };
 
 const char *mpv_event_name(mpv_event_id event)
@@ -1661,7 +2166,7 @@ int64_t mpv_get_time_us(mpv_handle *ctx)
     return mp_time_us();
 }
 
-// Used by vo_opengl_cb to synchronously uninitialize video.
+// Used by vo_opengl_cb and vo_sw_cb to synchronously uninitialize video.
 void kill_video(struct mp_client_api *client_api)
 {
     struct MPContext *mpctx = client_api->mpctx;
@@ -1711,6 +2216,11 @@ int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time)
 {
     return MPV_ERROR_NOT_IMPLEMENTED;
 }
+int mpv_opengl_cb_get_stats(mpv_opengl_cb_context *ctx,
+                            mpv_opengl_cb_stats *stats)
+{
+    return MPV_ERROR_NOT_IMPLEMENTED;
+}
 int mpv_opengl_cb_uninit_gl(mpv_opengl_cb_context *ctx)
 {
     return MPV_ERROR_NOT_IMPLEMENTED;
@@ -1722,6 +2232,16 @@ int mpv_opengl_cb_render(mpv_opengl_cb_context *ctx, int fbo, int vp[4])
     return mpv_opengl_cb_draw(ctx, fbo, vp[2], vp[3]);
 }
 
+static struct mpv_sw_cb_context *sw_cb_get_context(mpv_handle *ctx)
+{
+    struct mpv_sw_cb_context *cb = ctx->mpctx->sw_cb_ctx;
+    if (!cb) {
+        cb = mp_sw_cb_create(ctx->mpctx->global, ctx->clients);
+        ctx->mpctx->sw_cb_ctx = cb;
+    }
+    return cb;
+}
+
 void *mpv_get_sub_api(mpv_handle *ctx, mpv_sub_api sub_api)
 {
     if (!ctx->mpctx->initialized)
@@ -1732,6 +2252,9 @@ void *mpv_get_sub_api(mpv_handle *ctx, mpv_sub_api sub_api)
     case MPV_SUB_API_OPENGL_CB:
         res = opengl_cb_get_context(ctx);
         break;
+    case MPV_SUB_API_SW_CB:
+        res = sw_cb_get_context(ctx);
+        break;
     default:;
     }
     unlock_core(ctx);
@@ -19,9 +19,10 @@ void mp_clients_init(struct MPContext *mpctx);
 void mp_client_enter_shutdown(struct MPContext *mpctx);
 void mp_clients_destroy(struct MPContext *mpctx);
 int mp_clients_num(struct MPContext *mpctx);
-bool mp_clients_all_initialized(struct MPContext *mpctx);
+bool mp_client_initialized(struct MPContext *mpctx, const char *client_name);
 
 bool mp_client_exists(struct MPContext *mpctx, const char *client_name);
+void mp_client_get_stats(struct MPContext *mpctx, struct mpv_node *dst);
 void mp_client_broadcast_event(struct MPContext *mpctx, int event, void *data);
 int mp_client_send_event(struct MPContext *mpctx, const char *client_name,
                          int event, void *data);
@@ -46,6 +47,11 @@ struct mpv_opengl_cb_context *mp_opengl_create(struct mpv_global *g,
                                                struct mp_client_api *client_api);
 void kill_video(struct mp_client_api *client_api);
 
+// vo_sw_cb.c
+struct mpv_sw_cb_context;
+struct mpv_sw_cb_context *mp_sw_cb_create(struct mpv_global *g,
+                                          struct mp_client_api *client_api);
+
 bool mp_streamcb_lookup(struct mpv_global *g, const char *protocol,
                         void **out_user_data, mpv_stream_cb_open_ro_fn *out_fn);
 
@@ -34,6 +34,7 @@
 #include "client.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
+#include "common/mem_usage.h"
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "command.h"
@@ -54,6 +55,7 @@
 #include "video/decode/vd.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "video/mp_image_pool.h"
 #include "audio/audio_buffer.h"
 #include "audio/out/ao.h"
 #include "audio/filter/af.h"
@@ -61,7 +63,12 @@
 #include "audio/decode/dec_audio.h"
 #include "video/out/bitmap_packer.h"
 #include "options/path.h"
+#include "misc/node.h"
 #include "screenshot.h"
+#include "startup_prof.h"
+#include "sync_stats.h"
+#include "thumbnail.h"
+#include "playlist_probe.h"
 
 #include "osdep/io.h"
 #include "osdep/subprocess.h"
@@ -75,6 +82,7 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    struct m_property_index *prop_index;
 
     bool is_idle;
 
@@ -106,6 +114,10 @@ struct command_ctx {
     char *cur_ipc_input;
 
     int silence_option_deprecations;
+
+    // For pushed_properties[].
+    struct m_property_handle *pushed_handles;
+    int *pushed_values;     // last published values, -1 if unavailable
 };
 
 struct overlay {
@@ -450,6 +462,17 @@ static int mp_property_playback_speed(void *ctx, struct m_property *prop,
     return mp_property_generic_option(mpctx, prop, action, arg);
 }
 
+static int mp_property_audio_resample_speed(void *ctx, struct m_property *prop,
+                                            int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->ao_chain)
+        return M_PROPERTY_UNAVAILABLE;
+    double val = 1.0;
+    af_control_any_rev(mpctx->ao_chain->af, AF_CONTROL_GET_RESAMPLE_SPEED, &val);
+    return m_property_double_ro(action, arg, val);
+}
+
 static int mp_property_av_speed_correction(void *ctx, struct m_property *prop,
                                            int action, void *arg)
 {
@@ -709,6 +732,42 @@ static int mp_property_frame_drop_dec(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, mpctx->vo_chain->video_src->dropped_frames);
 }
 
+static int mp_property_frame_drop_dec_stats(void *ctx, struct m_property *prop,
+                                            int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    if (!vo_c || !vo_c->video_src)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    static const char *const types[] = {"unknown", "I", "P", "B"};
+    struct video_decode_cost cost;
+    video_get_decode_cost(vo_c->video_src, &cost);
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add(r, "late", MPV_FORMAT_INT64)->u.int64 = vo_c->drops_late;
+    node_map_add(r, "predicted", MPV_FORMAT_INT64)->u.int64 =
+        vo_c->drops_predicted;
+    node_map_add(r, "decode-time", MPV_FORMAT_DOUBLE)->u.double_ = cost.frame;
+    struct mpv_node *t = node_map_add(r, "decode-time-by-type",
+                                      MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < MP_ARRAY_SIZE(types); n++) {
+        if (cost.type[n] > 0)
+            node_map_add(t, types[n], MPV_FORMAT_DOUBLE)->u.double_ = cost.type[n];
+    }
+    node_map_add(r, "render-time", MPV_FORMAT_DOUBLE)->u.double_ =
+        vo_get_render_time(vo_c->vo);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_mistimed_frame_count(void *ctx, struct m_property *prop,
                                             int action, void *arg)
 {
@@ -1723,6 +1782,224 @@ static int mp_property_demuxer_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, s.idle);
 }
 
+static void node_add_pts(struct mpv_node *dst, const char *key, double pts)
+{
+    if (pts != MP_NOPTS_VALUE)
+        node_map_add(dst, key, MPV_FORMAT_DOUBLE)->u.double_ = pts;
+}
+
+static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct demux_ctrl_cache_state s;
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_CACHE_STATE, &s) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    if (s.reader.ts_duration >= 0) {
+        node_map_add(r, "cache-duration", MPV_FORMAT_DOUBLE)->u.double_ =
+            s.reader.ts_duration;
+    }
+    node_add_pts(r, "cache-end", s.reader.ts_range[1]);
+    node_map_add(r, "eof", MPV_FORMAT_FLAG)->u.flag = s.reader.eof;
+    node_map_add(r, "underrun", MPV_FORMAT_FLAG)->u.flag = s.reader.underrun;
+    node_map_add(r, "idle", MPV_FORMAT_FLAG)->u.flag = s.reader.idle;
+
+    int64_t fw_bytes = 0, bw_bytes = 0;
+    struct mpv_node *streams = node_map_add(r, "streams", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < s.num_streams; n++) {
+        struct demux_ctrl_stream_state *st = &s.streams[n];
+        fw_bytes += st->fw_bytes;
+        bw_bytes += st->bw_bytes;
+
+        struct mpv_node *e = node_array_add(streams, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "type", stream_type_name(st->type));
+        node_map_add(e, "index", MPV_FORMAT_INT64)->u.int64 = st->index;
+        node_map_add(e, "selected", MPV_FORMAT_FLAG)->u.flag = st->selected;
+        node_map_add(e, "active", MPV_FORMAT_FLAG)->u.flag = st->active;
+        node_map_add(e, "eof", MPV_FORMAT_FLAG)->u.flag = st->eof;
+        node_map_add(e, "packets", MPV_FORMAT_INT64)->u.int64 = st->packets;
+        node_map_add(e, "fw-bytes", MPV_FORMAT_INT64)->u.int64 = st->fw_bytes;
+        node_map_add(e, "bw-bytes", MPV_FORMAT_INT64)->u.int64 = st->bw_bytes;
+        if (st->bitrate >= 0) {
+            node_map_add(e, "bitrate", MPV_FORMAT_INT64)->u.int64 =
+                llrint(st->bitrate * 8);
+        }
+        node_add_pts(e, "ts-start", st->ts_start);
+        node_add_pts(e, "ts-end", st->ts_end);
+        node_map_add(e, "underruns", MPV_FORMAT_INT64)->u.int64 = st->underruns;
+    }
+    talloc_free(s.streams);
+
+    node_map_add(r, "fw-bytes", MPV_FORMAT_INT64)->u.int64 = fw_bytes;
+    node_map_add(r, "total-bytes", MPV_FORMAT_INT64)->u.int64 =
+        fw_bytes + bw_bytes;
+
+    if (s.cache_size >= 0) {
+        node_map_add(r, "cache-size", MPV_FORMAT_INT64)->u.int64 = s.cache_size;
+        node_map_add(r, "cache-fill", MPV_FORMAT_INT64)->u.int64 = s.cache_fill;
+        node_map_add(r, "raw-input-rate", MPV_FORMAT_INT64)->u.int64 =
+            s.cache_speed;
+    }
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_demuxer_packet_pool(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer || !mpctx->demuxer->packet_pool)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct demux_packet_pool_stats st;
+    demux_packet_pool_get_stats(mpctx->demuxer->packet_pool, &st);
+
+    struct m_sub_property props[] = {
+        {"hits",            SUB_PROP_INT64(st.hits)},
+        {"misses",          SUB_PROP_INT64(st.misses)},
+        {"used-bytes",      SUB_PROP_INT64(st.used_bytes)},
+        {"cached-bytes",    SUB_PROP_INT64(st.cached_bytes)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_audio_frame_pool(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    struct mp_audio_pool_stats st;
+    mp_audio_pool_get_stats(&st);
+
+    int64_t total = st.hits + st.misses;
+    struct m_sub_property props[] = {
+        {"hits",            SUB_PROP_INT64(st.hits)},
+        {"misses",          SUB_PROP_INT64(st.misses)},
+        {"reuse-rate",      SUB_PROP_DOUBLE(total ? st.hits / (double)total : 0)},
+        {"used-bytes",      SUB_PROP_INT64(st.used_bytes)},
+        {"cached-bytes",    SUB_PROP_INT64(st.cached_bytes)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_memory_usage(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add(r, "total", MPV_FORMAT_INT64)->u.int64 = mp_mem_usage_total();
+    for (int n = 0; n < MP_MEM_CATEGORY_COUNT; n++) {
+        struct mp_mem_usage u = mp_mem_usage_get(n);
+        struct mpv_node *e = node_map_add(r, mp_mem_category_name(n),
+                                          MPV_FORMAT_NODE_MAP);
+        node_map_add(e, "bytes", MPV_FORMAT_INT64)->u.int64 = u.bytes;
+        node_map_add(e, "peak-bytes", MPV_FORMAT_INT64)->u.int64 = u.peak_bytes;
+    }
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_client_stats(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+    mp_client_get_stats(mpctx, r);
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_wakeup_stats(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add(r, "iterations", MPV_FORMAT_INT64)->u.int64 =
+        mpctx->wakeup_iterations;
+    for (int n = 0; n < MP_WAKEUP_SRC_COUNT; n++) {
+        node_map_add(r, mp_wakeup_src_name(n), MPV_FORMAT_INT64)->u.int64 =
+            mpctx->wakeup_counts[n];
+    }
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_av_sync_stats(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->playback_initialized)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    sync_stats_get_node(mpctx, r, true);
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_startup_profile(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    startup_prof_get_node(mpctx, r);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_paused_for_cache(void *ctx, struct m_property *prop,
                                         int action, void *arg)
 {
@@ -1742,6 +2019,15 @@ static int mp_property_cache_buffering(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, state);
 }
 
+static int mp_property_cache_stall(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer || mpctx->cache_stall_estimate < -1)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, mpctx->cache_stall_estimate);
+}
+
 static int mp_property_clock(void *ctx, struct m_property *prop,
                              int action, void *arg)
 {
@@ -1918,7 +2204,7 @@ static void create_hotplug(struct MPContext *mpctx)
     struct command_ctx *cmd = mpctx->command_ctx;
 
     if (!cmd->hotplug) {
-        cmd->hotplug = ao_hotplug_create(mpctx->global, mp_wakeup_core_cb,
+        cmd->hotplug = ao_hotplug_create(mpctx->global, mp_wakeup_ao_cb,
                                          mpctx);
     }
 }
@@ -2050,6 +2336,42 @@ static int mp_property_audio_out_params(void *ctx, struct m_property *prop,
     return property_audiofmt(fmt, action, arg);
 }
 
+static int mp_property_audio_decoder_queue(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_AUDIO];
+    struct dec_audio *da = track ? track->d_audio : NULL;
+
+    struct audio_queue_state st;
+    if (!da || !audio_get_queue_state(da, &st))
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add(r, "duration", MPV_FORMAT_DOUBLE)->u.double_ = st.duration;
+    node_map_add(r, "limit", MPV_FORMAT_DOUBLE)->u.double_ = st.limit;
+    node_map_add(r, "frames", MPV_FORMAT_INT64)->u.int64 = st.frames;
+    node_map_add(r, "underruns", MPV_FORMAT_INT64)->u.int64 = st.underruns;
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_audio_out_latency(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->ao)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, ao_get_delay(mpctx->ao));
+}
+
 /// Balance (RW)
 static int mp_property_balance(void *ctx, struct m_property *prop,
                                int action, void *arg)
@@ -2447,6 +2769,97 @@ static int mp_property_hwdec_current(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_decoder_threading(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct dec_video *vd = track ? track->d_video : NULL;
+
+    char *threading = NULL;
+    if (!vd || video_vd_control(vd, VDCTRL_GET_THREADING, &threading) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_strdup_ro(action, arg, threading);
+}
+
+static int mp_property_hwdec_copy_time(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct dec_video *vd = track ? track->d_video : NULL;
+
+    double t = 0;
+    if (!vd || video_vd_control(vd, VDCTRL_GET_COPY_TIME, &t) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_double_ro(action, arg, t);
+}
+
+static int mp_property_video_decoder_queue(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    struct dec_video *vd = track ? track->d_video : NULL;
+
+    struct video_queue_state st;
+    if (!vd || !video_get_queue_state(vd, &st))
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add(r, "frames", MPV_FORMAT_INT64)->u.int64 = st.frames;
+    node_map_add(r, "limit", MPV_FORMAT_INT64)->u.int64 = st.limit;
+    node_map_add(r, "peak", MPV_FORMAT_INT64)->u.int64 = st.peak;
+    node_map_add(r, "underruns", MPV_FORMAT_INT64)->u.int64 = st.underruns;
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_image_pools(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    void *tmp = talloc_new(NULL);
+    struct mp_image_pool_stats *st;
+    int num = mp_image_pool_get_all_stats(tmp, &st);
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < num; n++) {
+        struct mpv_node *e = node_array_add(r, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", st[n].name);
+        node_map_add(e, "count", MPV_FORMAT_INT64)->u.int64 = st[n].count;
+        node_map_add(e, "max-count", MPV_FORMAT_INT64)->u.int64 = st[n].max_count;
+        node_map_add(e, "bytes", MPV_FORMAT_INT64)->u.int64 = st[n].bytes;
+        node_map_add(e, "peak-bytes", MPV_FORMAT_INT64)->u.int64 =
+            st[n].peak_bytes;
+        node_map_add(e, "max-bytes", MPV_FORMAT_INT64)->u.int64 =
+            st[n].max_bytes;
+        node_map_add(e, "hits", MPV_FORMAT_INT64)->u.int64 = st[n].hits;
+        node_map_add(e, "misses", MPV_FORMAT_INT64)->u.int64 = st[n].misses;
+        uint64_t total = st[n].hits + st[n].misses;
+        node_map_add(e, "hit-rate", MPV_FORMAT_DOUBLE)->u.double_ =
+            total ? st[n].hits / (double)total : 0;
+    }
+    talloc_free(tmp);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_hwdec_interop(void *ctx, struct m_property *prop,
                                      int action, void *arg)
 {
@@ -2929,12 +3342,51 @@ static int mp_property_vo_performance(void *ctx, struct m_property *prop,
         SUB_PROP_PERFDATA(upload),
         SUB_PROP_PERFDATA(render),
         SUB_PROP_PERFDATA(present),
+        {"shader-compiles", SUB_PROP_INT64(data.shader_compiles)},
+        {"shader-evictions", SUB_PROP_INT64(data.shader_evictions)},
+        {"fbo-memory", SUB_PROP_INT64(data.fbo_bytes)},
+        {"fbo-cache-memory", SUB_PROP_INT64(data.fbo_cached_bytes)},
         {0}
     };
 
     return m_property_read_sub(props, action, arg);
 }
 
+static int mp_property_vo_passes(void *ctx, struct m_property *prop,
+                                 int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct voctrl_performance_data *data =
+        talloc_zero(NULL, struct voctrl_performance_data);
+    if (vo_control(mpctx->video_out, VOCTRL_PERFORMANCE_DATA, data) <= 0) {
+        talloc_free(data);
+        return M_PROPERTY_UNAVAILABLE;
+    }
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < data->num_passes; n++) {
+        struct voctrl_pass_perf *pass = &data->passes[n];
+        struct mpv_node *e = node_array_add(r, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "desc", pass->desc);
+        node_map_add(e, "last", MPV_FORMAT_INT64)->u.int64 = pass->perf.last;
+        node_map_add(e, "avg", MPV_FORMAT_INT64)->u.int64 = pass->perf.avg;
+        node_map_add(e, "peak", MPV_FORMAT_INT64)->u.int64 = pass->perf.peak;
+    }
+    talloc_free(data);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3377,11 +3829,21 @@ static int get_playlist_entry(int item, int action, void *arg, void *ctx)
 
     bool current = mpctx->playlist->current == e;
     bool playing = mpctx->playing == e;
+    struct playlist_probe *pr = e->probe;
     struct m_sub_property props[] = {
         {"filename",    SUB_PROP_STR(e->filename)},
         {"current",     SUB_PROP_FLAG(1), .unavailable = !current},
         {"playing",     SUB_PROP_FLAG(1), .unavailable = !playing},
         {"title",       SUB_PROP_STR(e->title), .unavailable = !e->title},
+        {"probe-failed", SUB_PROP_FLAG(pr && pr->failed), .unavailable = !pr},
+        {"duration",    SUB_PROP_DOUBLE(pr ? pr->duration : 0),
+                        .unavailable = !pr || pr->duration < 0},
+        {"media-title", SUB_PROP_STR(pr ? pr->title : NULL),
+                        .unavailable = !pr || !pr->title},
+        {"width",       SUB_PROP_INT(pr ? pr->w : 0),
+                        .unavailable = !pr || !pr->w},
+        {"height",      SUB_PROP_INT(pr ? pr->h : 0),
+                        .unavailable = !pr || !pr->h},
         {0}
     };
 
@@ -3852,6 +4314,7 @@ static const struct m_property mp_properties_base[] = {
     {"speed", mp_property_playback_speed},
     {"audio-speed-correction", mp_property_av_speed_correction, .priv = "a"},
     {"video-speed-correction", mp_property_av_speed_correction, .priv = "v"},
+    {"audio-resample-speed", mp_property_audio_resample_speed},
     {"display-sync-active", mp_property_display_sync_active},
     {"filename", mp_property_filename},
     {"stream-open-filename", mp_property_stream_open_filename},
@@ -3869,6 +4332,7 @@ static const struct m_property mp_properties_base[] = {
     {"mistimed-frame-count", mp_property_mistimed_frame_count},
     {"vsync-ratio", mp_property_vsync_ratio},
     {"decoder-frame-drop-count", mp_property_frame_drop_dec},
+    {"decoder-frame-drop-stats", mp_property_frame_drop_dec_stats},
     {"frame-drop-count", mp_property_frame_drop_vo},
     {"vo-delayed-frame-count", mp_property_vo_delayed_frame_count},
     {"percent-pos", mp_property_percent_pos},
@@ -3904,7 +4368,16 @@ static const struct m_property mp_properties_base[] = {
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
+    {"demuxer-cache-state", mp_property_demuxer_cache_state},
+    {"demuxer-packet-pool", mp_property_demuxer_packet_pool},
+    {"audio-frame-pool", mp_property_audio_frame_pool},
+    {"memory-usage", mp_property_memory_usage},
+    {"client-stats", mp_property_client_stats},
+    {"wakeup-stats", mp_property_wakeup_stats},
+    {"av-sync-stats", mp_property_av_sync_stats},
+    {"startup-profile", mp_property_startup_profile},
     {"cache-buffering-state", mp_property_cache_buffering},
+    {"cache-stall-estimate", mp_property_cache_stall},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"clock", mp_property_clock},
     {"seekable", mp_property_seekable},
@@ -3932,6 +4405,8 @@ static const struct m_property mp_properties_base[] = {
     {"audio-codec", mp_property_audio_codec},
     {"audio-params", mp_property_audio_params},
     {"audio-out-params", mp_property_audio_out_params},
+    {"audio-out-latency", mp_property_audio_out_latency},
+    {"audio-decoder-queue", mp_property_audio_decoder_queue},
     {"aid", mp_property_audio},
     {"balance", mp_property_balance},
     {"audio-device", mp_property_audio_device},
@@ -3966,6 +4441,7 @@ static const struct m_property mp_properties_base[] = {
     {"window-scale", mp_property_window_scale},
     {"vo-configured", mp_property_vo_configured},
     {"vo-performance", mp_property_vo_performance},
+    {"vo-passes", mp_property_vo_passes},
     {"current-vo", mp_property_vo},
     {"container-fps", mp_property_fps},
     {"estimated-vf-fps", mp_property_vf_fps},
@@ -3975,6 +4451,10 @@ static const struct m_property mp_properties_base[] = {
     {"hwdec", mp_property_hwdec},
     {"hwdec-current", mp_property_hwdec_current},
     {"hwdec-interop", mp_property_hwdec_interop},
+    {"decoder-threading", mp_property_decoder_threading},
+    {"hwdec-copy-time", mp_property_hwdec_copy_time},
+    {"video-decoder-queue", mp_property_video_decoder_queue},
+    {"image-pools", mp_property_image_pools},
 
     {"estimated-frame-count", mp_property_frame_count},
     {"estimated-frame-number", mp_property_frame_number},
@@ -4083,14 +4563,13 @@ static const char *const *const mp_event_property_change[] = {
     E(MPV_EVENT_IDLE, "*"),
     E(MPV_EVENT_PAUSE,   "pause", "paused-on-cache", "core-idle", "eof-reached"),
     E(MPV_EVENT_UNPAUSE, "pause", "paused-on-cache", "core-idle", "eof-reached"),
+    // (See also pushed_properties[].)
     E(MPV_EVENT_TICK, "time-pos", "audio-pts", "stream-pos", "avsync",
       "percent-pos", "time-remaining", "playtime-remaining", "playback-time",
-      "estimated-vf-fps", "drop-frame-count", "vo-drop-frame-count",
-      "total-avsync-change", "audio-speed-correction", "video-speed-correction",
-      "vo-delayed-frame-count", "mistimed-frame-count", "vsync-ratio",
-      "estimated-display-fps", "vsync-jitter", "sub-text", "audio-bitrate",
-      "video-bitrate", "sub-bitrate", "decoder-frame-drop-count",
-      "frame-drop-count"),
+      "estimated-vf-fps", "total-avsync-change", "audio-speed-correction",
+      "video-speed-correction", "vsync-ratio", "estimated-display-fps",
+      "vsync-jitter", "sub-text", "audio-bitrate", "video-bitrate",
+      "sub-bitrate"),
     E(MPV_EVENT_VIDEO_RECONFIG, "video-out-params", "video-params",
       "video-format", "video-codec", "video-bitrate", "dwidth", "dheight",
       "width", "height", "fps", "aspect", "vo-configured", "current-vo",
@@ -4108,7 +4587,7 @@ static const char *const *const mp_event_property_change[] = {
     E(MP_EVENT_CACHE_UPDATE, "cache", "cache-free", "cache-used", "cache-idle",
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
       "demuxer-cache-time", "cache-buffering-state", "cache-speed",
-      "cache-percent"),
+      "cache-percent", "demuxer-cache-state", "cache-stall-estimate"),
     E(MP_EVENT_WIN_RESIZE, "window-scale", "osd-width", "osd-height", "osd-par"),
     E(MP_EVENT_WIN_STATE, "window-minimized", "display-names", "display-fps",
       "fullscreen"),
@@ -4117,6 +4596,18 @@ static const char *const *const mp_event_property_change[] = {
 };
 #undef E
 
+// Integer properties which clients don't re-read on every MPV_EVENT_TICK.
+// Instead, the core checks their value once per tick (which is cheap), and
+// publishes a change notification only if it actually changed.
+static const char *const pushed_properties[] = {
+    "decoder-frame-drop-count",
+    "frame-drop-count",
+    "vo-delayed-frame-count",
+    "mistimed-frame-count",
+};
+
+#define NUM_PUSHED MP_ARRAY_SIZE(pushed_properties)
+
 // If there is no prefix, return length+1 (avoids matching full name as prefix).
 static int prefix_len(const char *p)
 {
@@ -4158,11 +4649,14 @@ uint64_t mp_get_property_event_mask(const char *name)
 int mp_get_property_id(struct MPContext *mpctx, const char *name)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    for (int n = 0; ctx->properties[n].name; n++) {
-        if (match_property(ctx->properties[n].name, name))
-            return n;
-    }
-    return -1;
+    // Same as match_property(): options and properties get the same ID, and
+    // sub-properties the ID of the top-level property.
+    if (strncmp(name, "options/", 8) == 0)
+        name += 8;
+    bstr base = bstr0(name);
+    bstr_split_tok(base, "/", &base, &(bstr){0});
+    struct m_property *prop = m_property_index_find(ctx->prop_index, base);
+    return prop ? prop - ctx->properties : -1;
 }
 
 static bool is_property_set(int action, void *val)
@@ -4182,22 +4676,47 @@ static bool is_property_set(int action, void *val)
     }
 }
 
-static int mp_property_do_silent(const char *name, int action, void *val,
-                                 struct MPContext *ctx)
+static int do_property_silent(const struct m_property_handle *h, int action,
+                              void *val, struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
     cmd->silence_option_deprecations += 1;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do_handle(ctx->log, h, action, val, ctx);
     cmd->silence_option_deprecations -= 1;
     if (r == M_PROPERTY_OK && is_property_set(action, val))
-        mp_notify_property(ctx, (char *)name);
+        mp_notify_property(ctx, h->name);
     return r;
 }
 
+static int mp_property_do_silent(const char *name, int action, void *val,
+                                 struct MPContext *ctx)
+{
+    struct m_property_handle h;
+    mp_property_resolve(ctx, name, &h);
+    return do_property_silent(&h, action, val, ctx);
+}
+
+// Look up the property once for repeated mp_property_do_handle() calls. name
+// must stay valid while the handle is used.
+void mp_property_resolve(struct MPContext *mpctx, const char *name,
+                         struct m_property_handle *h)
+{
+    m_property_resolve(mpctx->command_ctx->prop_index, name, h);
+}
+
 int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
-    int r = mp_property_do_silent(name, action, val, ctx);
+    struct m_property_handle h;
+    mp_property_resolve(ctx, name, &h);
+    return mp_property_do_handle(&h, action, val, ctx);
+}
+
+int mp_property_do_handle(const struct m_property_handle *h, int action,
+                          void *val, struct MPContext *ctx)
+{
+    const char *name = h->name;
+    int r = do_property_silent(h, action, val, ctx);
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
         struct m_option ot = {0};
         void *data = val;
@@ -4221,7 +4740,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->prop_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -4893,6 +5412,12 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         break;
     }
 
+    case MP_CMD_SCRUB:
+        if (!mpctx->playback_initialized)
+            return -1;
+        set_scrubbing(mpctx, cmd->args[0].v.i);
+        break;
+
     case MP_CMD_SET: {
         int r = mp_property_do(cmd->args[0].v.s, M_PROPERTY_SET_STRING,
                                cmd->args[1].v.s, mpctx);
@@ -5212,6 +5737,12 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         break;
     }
 
+    case MP_CMD_PLAYLIST_PROBE: {
+        if (playlist_probe_start(mpctx, cmd->args[0].v.i, cmd->args[1].v.i) < 0)
+            return -1;
+        break;
+    }
+
     case MP_CMD_STOP:
         playlist_clear(mpctx->playlist);
         if (mpctx->stop_play != PT_QUIT)
@@ -5361,6 +5892,34 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         break;
     }
 
+    case MP_CMD_THUMBNAIL: {
+        if (!res)
+            return -1;
+        double pts = 0;
+        struct mp_image *img = thumbnail_get(mpctx, cmd->args[0].v.d,
+                                             cmd->args[1].v.i, cmd->args[2].v.i,
+                                             &pts);
+        if (!img)
+            return -1;
+        struct mpv_node_list *info = talloc_zero(NULL, struct mpv_node_list);
+        talloc_steal(info, img);
+        *res = (mpv_node){ .format = MPV_FORMAT_NODE_MAP, .u.list = info };
+        ADD_MAP_INT(res, "w", img->w);
+        ADD_MAP_INT(res, "h", img->h);
+        ADD_MAP_INT(res, "stride", img->stride[0]);
+        ADD_MAP_CSTR(res, "format", "bgr0");
+        *add_map_entry(res, "pts") =
+            (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = pts};
+        struct mpv_byte_array *ba = talloc_ptrtype(info, ba);
+        *ba = (struct mpv_byte_array){
+            .data = img->planes[0],
+            .size = img->stride[0] * img->h,
+        };
+        *add_map_entry(res, "data") =
+            (struct mpv_node){.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = ba,};
+        break;
+    }
+
     case MP_CMD_RUN: {
         char *args[MP_CMD_MAX_ARGS + 1] = {0};
         for (int n = 0; n < cmd->nargs; n++)
@@ -5619,6 +6178,9 @@ void command_init(struct MPContext *mpctx)
     ctx->properties =
         talloc_zero_array(ctx, struct m_property, num_base + num_opts + 1);
     memcpy(ctx->properties, mp_properties_base, sizeof(mp_properties_base));
+    // (ctx->properties is {0}-terminated after the base properties for now.)
+    struct m_property_index *base_index =
+        m_property_index_create(NULL, ctx->properties);
 
     int count = num_base;
     for (int n = 0; n < num_opts; n++) {
@@ -5653,12 +6215,37 @@ void command_init(struct MPContext *mpctx)
 
         if (prop.name) {
             // The option might be covered by a manual property already.
-            if (m_property_list_find(ctx->properties, prop.name))
+            if (m_property_index_find(base_index, bstr0(prop.name)))
                 continue;
 
             ctx->properties[count++] = prop;
         }
     }
+
+    talloc_free(base_index);
+    ctx->prop_index = m_property_index_create(ctx, ctx->properties);
+
+    ctx->pushed_handles = talloc_array(ctx, struct m_property_handle, NUM_PUSHED);
+    ctx->pushed_values = talloc_array(ctx, int, NUM_PUSHED);
+    for (int n = 0; n < NUM_PUSHED; n++) {
+        mp_property_resolve(mpctx, pushed_properties[n], &ctx->pushed_handles[n]);
+        ctx->pushed_values[n] = -1;
+    }
+}
+
+static void notify_pushed_properties(struct MPContext *mpctx)
+{
+    struct command_ctx *ctx = mpctx->command_ctx;
+    for (int n = 0; n < NUM_PUSHED; n++) {
+        int val = -1;
+        if (m_property_do_handle(NULL, &ctx->pushed_handles[n], M_PROPERTY_GET,
+                                 &val, mpctx) <= 0)
+            val = -1;
+        if (val != ctx->pushed_values[n]) {
+            ctx->pushed_values[n] = val;
+            mp_notify_property(mpctx, pushed_properties[n]);
+        }
+    }
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -5678,6 +6265,8 @@ static void command_event(struct MPContext *mpctx, int event, void *arg)
         // Update chapters - does nothing if something else is visible.
         set_osd_bar_chapters(mpctx, OSD_BAR_SEEK);
     }
+    if (event == MPV_EVENT_TICK)
+        notify_pushed_properties(mpctx);
 }
 
 void handle_command_updates(struct MPContext *mpctx)
@@ -5728,6 +6317,11 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags)
     }
 
     if (flags & UPDATE_OSD) {
+        for (int n = 0; n < NUM_PTRACKS; n++) {
+            struct track *track = mpctx->current_track[n][STREAM_SUB];
+            if (track && track->d_sub)
+                sub_control(track->d_sub, SD_CTRL_UPDATE_OPTS, NULL);
+        }
         osd_changed(mpctx->osd);
         mp_wakeup_core(mpctx);
     }
@@ -5768,6 +6362,9 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags)
 
     if (flags & UPDATE_SCREENSAVER)
         update_screensaver_state(mpctx);
+
+    if (flags & UPDATE_MEMORY_BUDGET)
+        mp_mem_usage_set_budget(mpctx->opts->memory_budget * 1024 * 1024LL);
 }
 
 void mp_notify_property(struct MPContext *mpctx, const char *property)
@@ -35,6 +35,11 @@ char *mp_property_expand_escaped_string(struct MPContext *mpctx, const char *str
 void property_print_help(struct MPContext *mpctx);
 int mp_property_do(const char* name, int action, void* val,
                    struct MPContext *mpctx);
+struct m_property_handle;
+void mp_property_resolve(struct MPContext *mpctx, const char *name,
+                         struct m_property_handle *h);
+int mp_property_do_handle(const struct m_property_handle *h, int action,
+                          void *val, struct MPContext *mpctx);
 
 int mp_on_set_option(void *ctx, struct m_config_option *co, void *data, int flags);
 void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags);
@@ -50,7 +55,7 @@ uint64_t mp_get_property_event_mask(const char *name);
 enum {
     // Must start with the first unused positive value in enum mpv_event_id
     // MPV_EVENT_* and MP_EVENT_* must not overlap.
-    INTERNAL_EVENT_BASE = 25,
+    INTERNAL_EVENT_BASE = 26,
     MP_EVENT_CHANGE_ALL,
     MP_EVENT_CACHE_UPDATE,
     MP_EVENT_WIN_RESIZE,
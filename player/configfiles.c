@@ -17,6 +17,10 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -33,6 +37,7 @@
 #include "common/encode.h"
 #include "common/msg.h"
 #include "misc/ctype.h"
+#include "osdep/threads.h"
 #include "options/path.h"
 #include "options/m_config.h"
 #include "options/parse_configfile.h"
@@ -163,6 +168,289 @@ void mp_load_auto_profiles(struct MPContext *mpctx)
 
 #define MP_WATCH_LATER_CONF "watch_later"
 
+// Resume files are written by a separate thread, so that slow (e.g. network
+// mounted) home directories don't delay quitting or switching files. Which
+// resume files exist is read once from the directory listing at startup, and
+// then kept up to date by the playback thread as it queues writes and
+// deletions. (Files created by other mpv instances running at the same time
+// are not noticed.)
+
+struct watch_later_job {
+    char *path;
+    char *data;         // file contents; NULL to delete the file
+};
+
+struct watch_later {
+    struct mp_log *log;
+    char *dir;          // NULL if there is no config directory
+    bool scan_dir;      // whether the thread should read the directory
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- Protected by lock.
+    bool index_loaded;
+    char **index;       // sorted file names in dir
+    int num_index;
+    struct watch_later_job **jobs; // jobs[0] is processed by the thread
+    int num_jobs;
+    bool terminate;
+};
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+// Position at which name is or would be inserted. Caller holds the lock.
+static int index_find(struct watch_later *wl, const char *name, bool *found)
+{
+    int lo = 0, hi = wl->num_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int r = strcmp(wl->index[mid], name);
+        if (r == 0) {
+            *found = true;
+            return mid;
+        }
+        if (r < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = false;
+    return lo;
+}
+
+static void load_index(struct watch_later *wl)
+{
+    void *ta_ctx = talloc_new(NULL);
+    char **index = NULL;
+    int num_index = 0;
+    DIR *d = wl->scan_dir ? opendir(wl->dir) : NULL;
+    if (d) {
+        struct dirent *ep;
+        while ((ep = readdir(d))) {
+            if (ep->d_name[0] != '.')
+                MP_TARRAY_APPEND(ta_ctx, index, num_index,
+                                 talloc_strdup(ta_ctx, ep->d_name));
+        }
+        closedir(d);
+    }
+    qsort(index, num_index, sizeof(index[0]), cmp_name);
+    MP_VERBOSE(wl, "%d resume files.\n", num_index);
+
+    pthread_mutex_lock(&wl->lock);
+    talloc_steal(wl, ta_ctx);
+    wl->index = index;
+    wl->num_index = num_index;
+    wl->index_loaded = true;
+    pthread_cond_broadcast(&wl->wakeup);
+    pthread_mutex_unlock(&wl->lock);
+}
+
+static void run_job(struct watch_later *wl, struct watch_later_job *job,
+                    bool *dir_created)
+{
+    if (!job->data) {
+        unlink(job->path);
+        return;
+    }
+
+    if (!*dir_created) {
+        mp_mkdirp(wl->dir);
+        *dir_created = true;
+    }
+
+    // Write a temporary file and rename it, so that a crash or a concurrent
+    // reader never sees a partial resume file.
+    char *tmpname = talloc_asprintf(job, "%s.tmp", job->path);
+    FILE *f = fopen(tmpname, "wb");
+    if (!f) {
+        MP_ERR(wl, "Could not write '%s'.\n", job->path);
+        return;
+    }
+    size_t len = strlen(job->data);
+    bool ok = fwrite(job->data, len, 1, f) == 1;
+    ok &= fclose(f) == 0;
+    if (!ok || rename(tmpname, job->path) != 0) {
+        MP_ERR(wl, "Could not write '%s'.\n", job->path);
+        unlink(tmpname);
+    }
+}
+
+static void *watch_later_thread(void *p)
+{
+    struct watch_later *wl = p;
+    mpthread_set_name("watch_later");
+
+    load_index(wl);
+
+    bool dir_created = false;
+    pthread_mutex_lock(&wl->lock);
+    while (1) {
+        if (!wl->num_jobs) {
+            if (wl->terminate)
+                break;
+            pthread_cond_wait(&wl->wakeup, &wl->lock);
+            continue;
+        }
+        struct watch_later_job *job = wl->jobs[0];
+        pthread_mutex_unlock(&wl->lock);
+
+        run_job(wl, job, &dir_created);
+
+        pthread_mutex_lock(&wl->lock);
+        MP_TARRAY_REMOVE_AT(wl->jobs, wl->num_jobs, 0);
+        talloc_free(job);
+        pthread_cond_broadcast(&wl->wakeup);
+    }
+    pthread_mutex_unlock(&wl->lock);
+    return NULL;
+}
+
+static char *get_watch_later_dir(struct MPContext *mpctx)
+{
+    if (!mpctx->cached_watch_later_configdir) {
+        char *wl_dir = mpctx->opts->watch_later_directory;
+        if (wl_dir && wl_dir[0]) {
+            mpctx->cached_watch_later_configdir =
+                mp_get_user_path(mpctx, mpctx->global, wl_dir);
+        }
+    }
+
+    if (!mpctx->cached_watch_later_configdir) {
+        mpctx->cached_watch_later_configdir =
+            mp_find_user_config_file(mpctx, mpctx->global, MP_WATCH_LATER_CONF);
+    }
+
+    return mpctx->cached_watch_later_configdir;
+}
+
+void mp_watch_later_init(struct MPContext *mpctx)
+{
+    struct watch_later *wl = talloc_ptrtype(NULL, wl);
+    *wl = (struct watch_later){
+        .log = mp_log_new(wl, mpctx->log, "watch_later"),
+        .dir = talloc_strdup(wl, get_watch_later_dir(mpctx)),
+    };
+    // Without --resume-playback, the index is never needed.
+    wl->scan_dir = wl->dir && mpctx->opts->position_resume;
+    pthread_mutex_init(&wl->lock, NULL);
+    pthread_cond_init(&wl->wakeup, NULL);
+    if (pthread_create(&wl->thread, NULL, watch_later_thread, wl)) {
+        pthread_cond_destroy(&wl->wakeup);
+        pthread_mutex_destroy(&wl->lock);
+        talloc_free(wl);
+        MP_ERR(mpctx, "Could not start watch_later thread.\n");
+        return;
+    }
+    mpctx->watch_later = wl;
+}
+
+// Waits until all queued files are written.
+void mp_watch_later_uninit(struct MPContext *mpctx)
+{
+    struct watch_later *wl = mpctx->watch_later;
+    if (!wl)
+        return;
+
+    pthread_mutex_lock(&wl->lock);
+    wl->terminate = true;
+    pthread_cond_broadcast(&wl->wakeup);
+    pthread_mutex_unlock(&wl->lock);
+    pthread_join(wl->thread, NULL);
+
+    for (int n = 0; n < wl->num_jobs; n++)
+        talloc_free(wl->jobs[n]);
+    pthread_cond_destroy(&wl->wakeup);
+    pthread_mutex_destroy(&wl->lock);
+    talloc_free(wl);
+    mpctx->watch_later = NULL;
+}
+
+// Caller holds the lock.
+static void wait_index(struct watch_later *wl)
+{
+    while (!wl->index_loaded)
+        pthread_cond_wait(&wl->wakeup, &wl->lock);
+}
+
+static bool watch_later_exists(struct MPContext *mpctx, const char *path)
+{
+    struct watch_later *wl = mpctx->watch_later;
+    if (!wl)
+        return mp_path_exists(path);
+
+    bool found;
+    pthread_mutex_lock(&wl->lock);
+    wait_index(wl);
+    index_find(wl, mp_basename(path), &found);
+    pthread_mutex_unlock(&wl->lock);
+    return found;
+}
+
+// Queue writing data to path (or deleting it if data is NULL). Takes
+// ownership of data.
+static void watch_later_queue(struct MPContext *mpctx, const char *path,
+                              char *data)
+{
+    struct watch_later *wl = mpctx->watch_later;
+    struct watch_later_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct watch_later_job){
+        .path = talloc_strdup(job, path),
+        .data = talloc_steal(job, data),
+    };
+
+    if (!wl) {
+        // The thread couldn't be started, so write synchronously.
+        struct watch_later tmp = {
+            .log = mpctx->log,
+            .dir = get_watch_later_dir(mpctx),
+        };
+        bool dir_created = false;
+        run_job(&tmp, job, &dir_created);
+        talloc_free(job);
+        return;
+    }
+
+    pthread_mutex_lock(&wl->lock);
+    wait_index(wl);
+    const char *name = mp_basename(path);
+    bool found;
+    int pos = index_find(wl, name, &found);
+    if (data && !found) {
+        MP_TARRAY_INSERT_AT(wl, wl->index, wl->num_index, pos,
+                            talloc_strdup(wl, name));
+    } else if (!data && found) {
+        talloc_free(wl->index[pos]);
+        MP_TARRAY_REMOVE_AT(wl->index, wl->num_index, pos);
+    }
+    MP_TARRAY_APPEND(wl, wl->jobs, wl->num_jobs, job);
+    pthread_cond_broadcast(&wl->wakeup);
+    pthread_mutex_unlock(&wl->lock);
+}
+
+// Wait until no write to path is pending, so reading it gives the new data.
+static void watch_later_flush(struct MPContext *mpctx, const char *path)
+{
+    struct watch_later *wl = mpctx->watch_later;
+    if (!wl)
+        return;
+
+    pthread_mutex_lock(&wl->lock);
+    while (1) {
+        bool pending = false;
+        for (int n = 0; n < wl->num_jobs; n++)
+            pending |= strcmp(wl->jobs[n]->path, path) == 0;
+        if (!pending)
+            break;
+        pthread_cond_wait(&wl->wakeup, &wl->lock);
+    }
+    pthread_mutex_unlock(&wl->lock);
+}
+
 static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
                                                     const char *fname)
 {
@@ -192,21 +480,9 @@ static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
     for (int i = 0; i < 16; i++)
         conf = talloc_asprintf_append(conf, "%02X", md5[i]);
 
-    if (!mpctx->cached_watch_later_configdir) {
-        char *wl_dir = mpctx->opts->watch_later_directory;
-        if (wl_dir && wl_dir[0]) {
-            mpctx->cached_watch_later_configdir =
-                mp_get_user_path(mpctx, mpctx->global, wl_dir);
-        }
-    }
-
-    if (!mpctx->cached_watch_later_configdir) {
-        mpctx->cached_watch_later_configdir =
-            mp_find_user_config_file(mpctx, mpctx->global, MP_WATCH_LATER_CONF);
-    }
-
-    if (mpctx->cached_watch_later_configdir)
-        res = mp_path_join(NULL, mpctx->cached_watch_later_configdir, conf);
+    char *dir = get_watch_later_dir(mpctx);
+    if (dir)
+        res = mp_path_join(NULL, dir, conf);
 
 exit:
     talloc_free(tmp);
@@ -283,13 +559,13 @@ static bool needs_config_quoting(const char *s)
     return false;
 }
 
-static void write_filename(struct MPContext *mpctx, FILE *file, char *filename)
+static void write_filename(struct MPContext *mpctx, char **data, char *filename)
 {
     if (mpctx->opts->write_filename_in_watch_later_config) {
         char write_name[1024] = {0};
         for (int n = 0; filename[n] && n < sizeof(write_name) - 1; n++)
             write_name[n] = (unsigned char)filename[n] < 32 ? '_' : filename[n];
-        fprintf(file, "# %s\n", write_name);
+        *data = talloc_asprintf_append_buffer(*data, "# %s\n", write_name);
     }
 }
 
@@ -297,12 +573,9 @@ static void write_redirect(struct MPContext *mpctx, char *path)
 {
     char *conffile = mp_get_playback_resume_config_filename(mpctx, path);
     if (conffile) {
-        FILE *file = fopen(conffile, "wb");
-        if (file) {
-            fprintf(file, "# redirect entry\n");
-            write_filename(mpctx, file, path);
-            fclose(file);
-        }
+        char *data = talloc_strdup(NULL, "# redirect entry\n");
+        write_filename(mpctx, &data, path);
+        watch_later_queue(mpctx, conffile, data);
         talloc_free(conffile);
     }
 }
@@ -324,19 +597,14 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
     if (!conffile)
         goto exit;
 
-    mp_mk_config_dir(mpctx->global, mpctx->cached_watch_later_configdir);
-
     MP_INFO(mpctx, "Saving state.\n");
 
-    FILE *file = fopen(conffile, "wb");
-    if (!file)
-        goto exit;
-
-    write_filename(mpctx, file, cur->filename);
+    char *data = talloc_strdup(NULL, "");
+    write_filename(mpctx, &data, cur->filename);
 
     double pos = get_current_time(mpctx);
     if (pos != MP_NOPTS_VALUE)
-        fprintf(file, "start=%f\n", pos);
+        data = talloc_asprintf_append_buffer(data, "start=%f\n", pos);
     for (int i = 0; backup_properties[i]; i++) {
         const char *pname = backup_properties[i];
         char *val = NULL;
@@ -349,15 +617,17 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
             if (!prev || strcmp(prev, val) != 0) {
                 if (needs_config_quoting(val)) {
                     // e.g. '%6%STRING'
-                    fprintf(file, "%s=%%%d%%%s\n", pname, (int)strlen(val), val);
+                    data = talloc_asprintf_append_buffer(data, "%s=%%%d%%%s\n",
+                                                pname, (int)strlen(val), val);
                 } else {
-                    fprintf(file, "%s=%s\n", pname, val);
+                    data = talloc_asprintf_append_buffer(data, "%s=%s\n",
+                                                         pname, val);
                 }
             }
         }
         talloc_free(val);
     }
-    fclose(file);
+    watch_later_queue(mpctx, conffile, data);
 
     // This allows us to recursively resume directories etc., whose entries are
     // expanded the first time it's "played". For example, if "/a/b/c.mkv" is
@@ -399,13 +669,14 @@ void mp_load_playback_resume(struct MPContext *mpctx, const char *file)
     if (!mpctx->opts->position_resume)
         return;
     char *fname = mp_get_playback_resume_config_filename(mpctx, file);
-    if (fname && mp_path_exists(fname)) {
+    if (fname && watch_later_exists(mpctx, fname)) {
+        watch_later_flush(mpctx, fname);
         // Never apply the saved start position to following files
         m_config_backup_opt(mpctx->mconfig, "start");
         MP_INFO(mpctx, "Resuming playback. This behavior can "
                "be disabled with --no-resume-playback.\n");
         try_load_config(mpctx, fname, M_SETOPT_PRESERVE_CMDLINE);
-        unlink(fname);
+        watch_later_queue(mpctx, fname, NULL);
     }
     talloc_free(fname);
 }
@@ -422,7 +693,7 @@ struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
         return NULL;
     for (struct playlist_entry *e = playlist->first; e; e = e->next) {
         char *conf = mp_get_playback_resume_config_filename(mpctx, e->filename);
-        bool exists = conf && mp_path_exists(conf);
+        bool exists = conf && watch_later_exists(mpctx, conf);
         talloc_free(conf);
         if (exists)
             return e;
@@ -86,6 +86,19 @@ enum seek_flags {
     MPSEEK_FLAG_NOFLUSH = 1 << 1, // keeping remaining data for seamless loops
 };
 
+// Reasons for running a playloop iteration (see mp_wakeup_core_src()).
+enum mp_wakeup_src {
+    MP_WAKEUP_CORE,         // playback thread itself, or unspecified
+    MP_WAKEUP_INPUT,
+    MP_WAKEUP_DEMUX,        // demuxer or decoder (new packets, EOF)
+    MP_WAKEUP_AO,
+    MP_WAKEUP_VO,
+    MP_WAKEUP_FILTER,
+    MP_WAKEUP_CLIENT,       // client API requests
+    MP_WAKEUP_TIMEOUT,      // mp_set_timeout() expired
+    MP_WAKEUP_SRC_COUNT
+};
+
 enum video_sync {
     VS_DEFAULT = 0,
     VS_DISP_RESAMPLE,
@@ -183,6 +196,15 @@ struct vo_chain {
     bool is_coverart;
     // Just to avoid decoding the coverart picture again after a seek.
     struct mp_image *cached_coverart;
+
+    // video_get_decode_time() at the last decoded frame (for --benchmark).
+    int64_t decode_time;
+
+    // Decoder framedrop state (see check_framedrop()).
+    int drop_mode;          // mode passed to video_set_framedrop()
+    double drop_debt;       // predicted lateness due to decoding/rendering
+    int last_dropped;       // dec_video.dropped_frames at last update
+    int64_t drops_late, drops_predicted;
 };
 
 // Like vo_chain, for audio.
@@ -242,10 +264,12 @@ typedef struct MPContext {
 
     struct mp_log *statusline;
     struct osd_state *osd;
+    struct mp_ass_font_preload *font_preload;
     char *term_osd_text;
     char *term_osd_status;
     char *term_osd_subs;
     char *term_osd_contents;
+    double term_osd_status_time; // last rebuild of term_osd_status
     char *last_window_title;
     struct voctrl_playback_state vo_playback_state;
 
@@ -287,6 +311,8 @@ typedef struct MPContext {
 
     struct demuxer *demuxer;
     struct mp_tags *filtered_tags;
+    // Shared readahead limits of the main demuxer and external files.
+    struct demux_budget *demux_budget;
 
     struct track **tracks;
     int num_tracks;
@@ -307,11 +333,21 @@ typedef struct MPContext {
     struct vo_chain *vo_chain;
 
     struct vo *video_out;
+    struct vo_init_job *vo_init; // VO creation running in the background
     // next_frame[0] is the next frame, next_frame[1] the one after that.
     // The +1 is for adding 1 additional frame in backstep mode.
     struct mp_image *next_frames[VO_MAX_REQ_FRAMES + 1];
     int num_next_frames;
     struct mp_image *saved_frame;   // for hrseek_lastframe and hrseek_backstep
+    // Recently displayed frames (oldest first), for --backstep-cache. If
+    // backstep_active is set, backstep_frames[backstep_pos] is on screen, and
+    // the decoder and next_frames[] are still at the position after the last
+    // entry.
+    struct mp_image **backstep_frames;
+    int num_backstep_frames;
+    size_t backstep_bytes;
+    bool backstep_active;
+    int backstep_pos;
 
     enum playback_status video_status, audio_status;
     bool restart_complete;
@@ -334,6 +370,11 @@ typedef struct MPContext {
     bool hrseek_lastframe;  // drop everything until last frame reached
     bool hrseek_backstep;   // go to frame before seek target
     double hrseek_pts;
+    // Scrub mode (scrub command): seeks go to keyframes only, and are not
+    // issued while a previous one is still in progress, unless they can be
+    // served from the demuxer cache. scrub_pts is the last target.
+    bool scrubbing;
+    double scrub_pts;
     bool ab_loop_clip;      // clip to the "b" part of an A-B loop if available
     // AV sync: the next frame should be shown when the audio out has this
     // much (in seconds) buffered data left. Increased when more data is
@@ -379,6 +420,12 @@ typedef struct MPContext {
 
     double sleeptime;      // number of seconds to sleep before next iteration
 
+    // Bit mask of (1 << mp_wakeup_src) since the last mp_wait_events().
+    atomic_int wakeup_srcs;
+    // Number of mp_wait_events() calls which were ended by each source.
+    uint64_t wakeup_counts[MP_WAKEUP_SRC_COUNT];
+    uint64_t wakeup_iterations;
+
     double mouse_timer;
     unsigned int mouse_event_ts;
     bool mouse_cursor_visible;
@@ -419,6 +466,14 @@ typedef struct MPContext {
     bool paused_for_cache;
     double cache_stop_time, cache_wait_time;
     int cache_buffer;
+    // Moving average and variance of the download speed (bytes/s), to
+    // predict stalls (see handle_pause_on_low_cache()). Reset per file.
+    double cache_speed_avg, cache_speed_var;
+    int cache_speed_samples;
+    double cache_speed_next_sample;
+    // Wall clock seconds until the buffer is predicted to run empty, -1 if it
+    // isn't expected to, or -2 if unknown (cache-stall-estimate property).
+    double cache_stall_estimate;
 
     // Set after showing warning about decoding being too slow for realtime
     // playback rate. Used to avoid showing it multiple times.
@@ -427,14 +482,22 @@ typedef struct MPContext {
     struct mp_recorder *recorder;
 
     char *cached_watch_later_configdir;
+    struct watch_later *watch_later;
 
     struct screenshot_ctx *screenshot_ctx;
+    struct thumbnailer *thumbnailer;
+    struct playlist_probe_ctx *playlist_probe_ctx;
+    struct sync_stats *sync_stats;
+    struct startup_prof *startup_prof;
+    struct external_files_cache *external_files_cache;
+    struct benchmark *benchmark;
     struct command_ctx *command_ctx;
     struct encode_lavc_context *encode_lavc_ctx;
 
     struct mp_ipc_ctx *ipc_ctx;
 
     struct mpv_opengl_cb_context *gl_cb_ctx;
+    struct mpv_sw_cb_context *sw_cb_ctx;
 
     pthread_mutex_t lock;
 
@@ -451,10 +514,18 @@ typedef struct MPContext {
     char *open_url;
     char *open_format;
     int open_url_flags;
+    int64_t open_playlist_offset;
+    bool open_fill; // select default streams and start the demuxer thread
+    bool open_decode; // also start decoding the audio stream (implies fill)
     // --- All fields below are owned by open_thread, unless open_done was set
     //     to true.
     struct demuxer *open_res_demuxer;
+    struct dec_audio *open_res_audio;
     int open_res_error;
+
+    // Pre-decoded audio of the current file, taken over from the opener
+    // thread. Used by init_audio_decoder() if the stream matches.
+    struct dec_audio *prefetched_audio;
 } MPContext;
 
 // audio.c
@@ -469,6 +540,7 @@ void clear_audio_output_buffers(struct MPContext *mpctx);
 void update_playback_speed(struct MPContext *mpctx);
 void uninit_audio_out(struct MPContext *mpctx);
 void uninit_audio_chain(struct MPContext *mpctx);
+void uninit_prefetched_audio(struct MPContext *mpctx);
 int init_audio_decoder(struct MPContext *mpctx, struct track *track);
 void reinit_audio_chain_src(struct MPContext *mpctx, struct lavfi_pad *src);
 void audio_update_volume(struct MPContext *mpctx);
@@ -479,6 +551,8 @@ void reload_audio_output(struct MPContext *mpctx);
 void mp_parse_cfgfiles(struct MPContext *mpctx);
 void mp_load_auto_profiles(struct MPContext *mpctx);
 void mp_get_resume_defaults(struct MPContext *mpctx);
+void mp_watch_later_init(struct MPContext *mpctx);
+void mp_watch_later_uninit(struct MPContext *mpctx);
 void mp_load_playback_resume(struct MPContext *mpctx, const char *file);
 void mp_write_watch_later_conf(struct MPContext *mpctx);
 struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
@@ -548,13 +622,21 @@ void set_osd_bar_chapters(struct MPContext *mpctx, int type);
 void mp_wait_events(struct MPContext *mpctx);
 void mp_set_timeout(struct MPContext *mpctx, double sleeptime);
 void mp_wakeup_core(struct MPContext *mpctx);
+void mp_wakeup_core_src(struct MPContext *mpctx, enum mp_wakeup_src src);
 void mp_wakeup_core_cb(void *ctx);
+void mp_wakeup_input_cb(void *ctx);
+void mp_wakeup_demux_cb(void *ctx);
+void mp_wakeup_ao_cb(void *ctx);
+void mp_wakeup_vo_cb(void *ctx);
+void mp_wakeup_filter_cb(void *ctx);
+const char *mp_wakeup_src_name(enum mp_wakeup_src src);
 void mp_process_input(struct MPContext *mpctx);
 double get_relative_time(struct MPContext *mpctx);
 void reset_playback_state(struct MPContext *mpctx);
 void pause_player(struct MPContext *mpctx);
 void unpause_player(struct MPContext *mpctx);
 void add_step_frame(struct MPContext *mpctx, int dir);
+void set_scrubbing(struct MPContext *mpctx, bool scrubbing);
 void queue_seek(struct MPContext *mpctx, enum seek_type type, double amount,
                 enum seek_precision exact, int flags);
 double get_time_length(struct MPContext *mpctx);
@@ -601,6 +683,7 @@ int video_set_colors(struct vo_chain *vo_c, const char *item, int value);
 int video_vf_vo_control(struct vo_chain *vo_c, int vf_cmd, void *data);
 void reset_video_state(struct MPContext *mpctx);
 int init_video_decoder(struct MPContext *mpctx, struct track *track);
+void start_vo_init(struct MPContext *mpctx);
 int reinit_video_chain(struct MPContext *mpctx);
 int reinit_video_chain_src(struct MPContext *mpctx, struct lavfi_pad *src);
 int reinit_video_filters(struct MPContext *mpctx);
@@ -612,6 +695,8 @@ double calc_average_frame_duration(struct MPContext *mpctx);
 int init_video_decoder(struct MPContext *mpctx, struct track *track);
 int get_deinterlacing(struct MPContext *mpctx);
 void set_deinterlacing(struct MPContext *mpctx, int opt_val);
+bool backstep_cache_step(struct MPContext *mpctx, int dir);
+void backstep_cache_resync(struct MPContext *mpctx);
 
 // Values of MPOpts.softvol
 enum {
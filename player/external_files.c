@@ -3,6 +3,8 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "osdep/io.h"
 
@@ -87,7 +89,111 @@ static struct bstr guess_lang_from_filename(struct bstr name)
     return (struct bstr){name.start + i + 1, n};
 }
 
+// Directory entry with a subtitle or audio file extension.
+struct dir_entry {
+    char *name;             // UTF-8 file name
+    struct bstr name_trim;  // lowercase, without extension and whitespace
+    int type;               // STREAM_SUB/STREAM_AUDIO
+};
+
+struct dir_listing {
+    char *path;
+    time_t mtime;           // directory mtime at the time it was read
+    time_t scan_time;
+    struct dir_entry *entries;
+    int num_entries;
+};
+
+// Maximum number of directories remembered.
+#define MAX_CACHED_DIRS 16
+
+struct external_files_cache {
+    // Most recently used last.
+    struct dir_listing *dirs[MAX_CACHED_DIRS];
+    int num_dirs;
+};
+
+struct external_files_cache *external_files_cache_new(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct external_files_cache);
+}
+
+static struct dir_listing *read_dir(void *ta_parent, struct mp_log *log,
+                                    const char *path)
+{
+    DIR *d = opendir(path);
+    if (!d)
+        return NULL;
+    struct dir_listing *l = talloc_zero(ta_parent, struct dir_listing);
+    l->path = talloc_strdup(l, path);
+    l->scan_time = time(NULL);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct bstr den = bstr0(de->d_name);
+        int type = test_ext(bstr_get_ext(den));
+        if (type < 0)
+            continue;
+        struct bstr dename = mp_iconv_to_utf8(log, den,
+                                              "UTF-8-MAC", MP_NO_LATIN1_FALLBACK);
+        struct dir_entry e = {
+            .name = bstrdup0(l, dename),
+            .type = type,
+        };
+        if (den.start != dename.start)
+            talloc_free(dename.start);
+        // retrieve various parts of the filename
+        struct bstr noext = bstrdup(l, bstr_strip_ext(bstr0(e.name)));
+        bstr_lower(noext);
+        e.name_trim = bstr_strip(noext);
+        MP_TARRAY_APPEND(l, l->entries, l->num_entries, e);
+    }
+    closedir(d);
+    return l;
+}
+
+// Return the file listing of the directory. The result is owned by the cache,
+// or by ta_parent if cache==NULL. Returns NULL if the directory can't be read.
+static struct dir_listing *get_dir(struct external_files_cache *cache,
+                                   void *ta_parent, struct mp_log *log,
+                                   const char *path)
+{
+    if (!cache)
+        return read_dir(ta_parent, log, path);
+
+    struct stat st;
+    if (stat(path, &st))
+        return NULL;
+
+    for (int n = 0; n < cache->num_dirs; n++) {
+        struct dir_listing *l = cache->dirs[n];
+        if (strcmp(l->path, path) != 0)
+            continue;
+        MP_TARRAY_REMOVE_AT(cache->dirs, cache->num_dirs, n);
+        // A change within the second of the last scan might not have changed
+        // the mtime, so such listings can't be trusted.
+        if (l->mtime == st.st_mtime && l->mtime < l->scan_time) {
+            mp_verbose(log, "Using cached listing of %s\n", path);
+            cache->dirs[cache->num_dirs++] = l;
+            return l;
+        }
+        talloc_free(l);
+        break;
+    }
+
+    struct dir_listing *l = read_dir(cache, log, path);
+    if (!l)
+        return NULL;
+    l->mtime = st.st_mtime;
+    if (cache->num_dirs == MAX_CACHED_DIRS) {
+        talloc_free(cache->dirs[0]);
+        MP_TARRAY_REMOVE_AT(cache->dirs, cache->num_dirs, 0);
+    }
+    cache->dirs[cache->num_dirs++] = l;
+    return l;
+}
+
 static void append_dir_subtitles(struct mpv_global *global,
+                                 struct external_files_cache *cache,
                                  struct subfn **slist, int *nsub,
                                  struct bstr path, const char *fname,
                                  int limit_fuzziness, int limit_type)
@@ -114,27 +220,17 @@ static void append_dir_subtitles(struct mpv_global *global,
     // 2 = any sub file containing movie name
     // 3 = sub file containing movie name and the lang extension
     char *path0 = bstrdup0(tmpmem, path);
-    DIR *d = opendir(path0);
-    if (!d)
+    struct dir_listing *dir = get_dir(cache, tmpmem, log, path0);
+    if (!dir)
         goto out;
     mp_verbose(log, "Loading external files in %.*s\n", BSTR_P(path));
-    struct dirent *de;
-    while ((de = readdir(d))) {
-        void *tmpmem2 = talloc_new(tmpmem);
-        struct bstr den = bstr0(de->d_name);
-        struct bstr dename = mp_iconv_to_utf8(log, den,
-                                              "UTF-8-MAC", MP_NO_LATIN1_FALLBACK);
-        // retrieve various parts of the filename
-        struct bstr tmp_fname_noext = bstrdup(tmpmem2, bstr_strip_ext(dename));
-        bstr_lower(tmp_fname_noext);
-        struct bstr tmp_fname_ext = bstr_get_ext(dename);
-        struct bstr tmp_fname_trim = bstr_strip(tmp_fname_noext);
-
-        if (den.start != dename.start)
-            talloc_steal(tmpmem2, dename.start);
+    for (int i = 0; i < dir->num_entries; i++) {
+        struct dir_entry *de = &dir->entries[i];
+        struct bstr dename = bstr0(de->name);
+        struct bstr tmp_fname_trim = de->name_trim;
 
         // check what it is (most likely)
-        int type = test_ext(tmp_fname_ext);
+        int type = de->type;
         char **langs = NULL;
         int fuzz = -1;
         switch (type) {
@@ -149,7 +245,7 @@ static void append_dir_subtitles(struct mpv_global *global,
         }
 
         if (fuzz < 0 || (limit_type >= 0 && limit_type != type))
-            goto next_sub;
+            continue;
 
         // we have a (likely) subtitle file
         int prio = 0;
@@ -181,7 +277,7 @@ static void append_dir_subtitles(struct mpv_global *global,
         }
 
         mp_dbg(log, "Potential external file: \"%s\"  Priority: %d\n",
-               de->d_name, prio);
+               de->name, prio);
 
         if (prio) {
             prio += prio;
@@ -201,11 +297,7 @@ static void append_dir_subtitles(struct mpv_global *global,
             } else
                 talloc_free(subpath);
         }
-
-    next_sub:
-        talloc_free(tmpmem2);
     }
-    closedir(d);
 
  out:
     talloc_free(tmpmem);
@@ -238,45 +330,52 @@ static void filter_subidx(struct subfn **slist, int *nsub)
     }
 }
 
-static void load_paths(struct mpv_global *global, struct subfn **slist,
+static void load_paths(struct mpv_global *global,
+                       struct external_files_cache *cache, struct subfn **slist,
                        int *nsubs, const char *fname, char **paths,
                        char *cfg_path, int type)
 {
     for (int i = 0; paths && paths[i]; i++) {
         char *path = mp_path_join_bstr(*slist, mp_dirname(fname),
                                        bstr0(paths[i]));
-        append_dir_subtitles(global, slist, nsubs, bstr0(path), fname, 0, type);
+        append_dir_subtitles(global, cache, slist, nsubs, bstr0(path), fname,
+                             0, type);
     }
 
     // Load subtitles in ~/.mpv/sub (or similar) limiting sub fuzziness
     char *mp_subdir = mp_find_config_file(NULL, global, cfg_path);
     if (mp_subdir) {
-        append_dir_subtitles(global, slist, nsubs, bstr0(mp_subdir), fname, 1,
-                             type);
+        append_dir_subtitles(global, cache, slist, nsubs, bstr0(mp_subdir),
+                             fname, 1, type);
     }
     talloc_free(mp_subdir);
 }
 
 // Return a list of subtitles and audio files found, sorted by priority.
 // Last element is terminated with a fname==NULL entry.
-struct subfn *find_external_files(struct mpv_global *global, const char *fname)
+// cache can be NULL; otherwise directory listings are reused if the
+// directories were not modified.
+struct subfn *find_external_files(struct mpv_global *global,
+                                  struct external_files_cache *cache,
+                                  const char *fname)
 {
     struct MPOpts *opts = global->opts;
     struct subfn *slist = talloc_array_ptrtype(NULL, slist, 1);
     int n = 0;
 
     // Load subtitles from current media directory
-    append_dir_subtitles(global, &slist, &n, mp_dirname(fname), fname, 0, -1);
+    append_dir_subtitles(global, cache, &slist, &n, mp_dirname(fname), fname,
+                         0, -1);
 
     // Load subtitles in dirs specified by sub-paths option
     if (opts->sub_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->sub_paths, "sub/",
+        load_paths(global, cache, &slist, &n, fname, opts->sub_paths, "sub/",
                    STREAM_SUB);
     }
 
     if (opts->audiofile_auto >= 0) {
-        load_paths(global, &slist, &n, fname, opts->audiofile_paths, "audio/",
-                   STREAM_AUDIO);
+        load_paths(global, cache, &slist, &n, fname, opts->audiofile_paths,
+                   "audio/", STREAM_AUDIO);
     }
 
     // Sort by name for filter_subidx()
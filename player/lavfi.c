@@ -28,6 +28,7 @@
 #include <libavutil/mathematics.h>
 #include <libavutil/rational.h>
 #include <libavutil/error.h>
+#include <libavutil/hwcontext.h>
 #include <libavfilter/avfilter.h>
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
@@ -51,6 +52,7 @@
 struct lavfi {
     struct mp_log *log;
     char *graph_string;
+    int threads;        // AVFilterGraph.nb_threads (0: one per CPU)
 
     AVFilterGraph *graph;
     // Set to true once all inputs have been initialized, and the graph is
@@ -103,6 +105,7 @@ struct lavfi_pad {
 
     // used to check for format changes manually
     struct mp_image_params in_fmt_v;
+    AVBufferRef *in_hwframes_ref; // hw_frames_ctx of in_fmt_v, if any
     struct mp_audio in_fmt_a;
 
     // -- dir==LAVFI_OUT
@@ -165,6 +168,10 @@ static void precreate_graph(struct lavfi *c)
     c->graph = avfilter_graph_alloc();
     if (!c->graph)
         abort();
+    // Must be set before the first filter is created, as libavfilter sets up
+    // its thread pool on that.
+    c->graph->nb_threads = c->threads;
+    c->graph->thread_type = AVFILTER_THREAD_SLICE;
     AVFilterInOut *in = NULL, *out = NULL;
     if (avfilter_graph_parse2(c->graph, c->graph_string, &in, &out) < 0) {
         c->graph = NULL;
@@ -195,6 +202,7 @@ static void free_graph(struct lavfi *c)
         pad->filter_pad = -1;
         pad->buffer = NULL;
         pad->in_fmt_v = (struct mp_image_params){0};
+        av_buffer_unref(&pad->in_hwframes_ref);
         pad->in_fmt_a = (struct mp_audio){0};
         pad->buffer_is_eof = false;
         pad->input_needed = false;
@@ -231,11 +239,13 @@ void lavfi_seek_reset(struct lavfi *c)
     precreate_graph(c);
 }
 
-struct lavfi *lavfi_create(struct mp_log *log, char *graph_string)
+struct lavfi *lavfi_create(struct mp_log *log, char *graph_string,
+                           int threads)
 {
     struct lavfi *c = talloc_zero(NULL, struct lavfi);
     c->log = log;
     c->graph_string = graph_string;
+    c->threads = threads;
     c->tmp_frame = av_frame_alloc();
     if (!c->tmp_frame)
         abort();
@@ -307,7 +317,7 @@ static bool is_aformat_ok(struct mp_audio *a, struct mp_audio *b)
 }
 static bool is_vformat_ok(struct mp_image_params *a, struct mp_image_params *b)
 {
-    return a->imgfmt == b->imgfmt &&
+    return a->imgfmt == b->imgfmt && a->hw_subfmt == b->hw_subfmt &&
            a->w == b->w && a->h && b->h &&
            a->p_w == b->p_w && a->p_h == b->p_h;
 }
@@ -327,6 +337,10 @@ static void check_format_changes(struct lavfi *c)
         if (pad->type == STREAM_VIDEO && pad->pending_v && pad->in_fmt_v.imgfmt) {
             c->draining_new_format |= !is_vformat_ok(&pad->pending_v->params,
                                                      &pad->in_fmt_v);
+            // Hardware surfaces from a different pool need a new buffersrc.
+            AVBufferRef *hw = pad->pending_v->hwctx;
+            c->draining_new_format |= (hw ? hw->data : NULL) !=
+                (pad->in_hwframes_ref ? pad->in_hwframes_ref->data : NULL);
         }
     }
 
@@ -383,6 +397,12 @@ static bool init_pads(struct lavfi *c)
             } else if (pad->pending_v) {
                 assert(pad->type == STREAM_VIDEO);
                 pad->in_fmt_v = pad->pending_v->params;
+                av_buffer_unref(&pad->in_hwframes_ref);
+                if (pad->pending_v->hwctx) {
+                    pad->in_hwframes_ref = av_buffer_ref(pad->pending_v->hwctx);
+                    if (!pad->in_hwframes_ref)
+                        goto error;
+                }
             } else if (pad->input_eof) {
                 // libavfilter makes this painful. Init it with a dummy config,
                 // just so we can tell it the stream is EOF.
@@ -414,11 +434,6 @@ static bool init_pads(struct lavfi *c)
                 src_filter = avfilter_get_by_name("abuffer");
             } else if (pad->type == STREAM_VIDEO) {
                 pad->timebase = AV_TIME_BASE_Q;
-                snprintf(src_args, sizeof(src_args), "%d:%d:%d:%d:%d:%d:%d",
-                         pad->in_fmt_v.w, pad->in_fmt_v.h,
-                         imgfmt2pixfmt(pad->in_fmt_v.imgfmt),
-                         pad->timebase.num, pad->timebase.den,
-                         pad->in_fmt_v.p_w, pad->in_fmt_v.p_h);
                 src_filter = avfilter_get_by_name("buffer");
             } else {
                 assert(0);
@@ -430,9 +445,36 @@ static bool init_pads(struct lavfi *c)
             char name[256];
             snprintf(name, sizeof(name), "mpv_src_%s", pad->name);
 
-            if (avfilter_graph_create_filter(&pad->buffer, src_filter,
-                                             name, src_args, NULL, c->graph) < 0)
-                goto error;
+            if (pad->type == STREAM_VIDEO) {
+                // Not possible with the string arguments: hw_frames_ctx lets
+                // hardware surfaces enter the graph without a download.
+                pad->buffer = avfilter_graph_alloc_filter(c->graph, src_filter,
+                                                          name);
+                if (!pad->buffer)
+                    goto error;
+
+                AVBufferSrcParameters *params = av_buffersrc_parameters_alloc();
+                if (!params)
+                    goto error;
+
+                params->format = imgfmt2pixfmt(pad->in_fmt_v.imgfmt);
+                params->time_base = pad->timebase;
+                params->width = pad->in_fmt_v.w;
+                params->height = pad->in_fmt_v.h;
+                params->sample_aspect_ratio.num = pad->in_fmt_v.p_w;
+                params->sample_aspect_ratio.den = pad->in_fmt_v.p_h;
+                params->hw_frames_ctx = pad->in_hwframes_ref;
+
+                int r = av_buffersrc_parameters_set(pad->buffer, params);
+                av_free(params);
+                if (r < 0 || avfilter_init_str(pad->buffer, NULL) < 0)
+                    goto error;
+            } else {
+                if (avfilter_graph_create_filter(&pad->buffer, src_filter,
+                                                 name, src_args, NULL,
+                                                 c->graph) < 0)
+                    goto error;
+            }
 
             if (avfilter_link(pad->buffer, 0, pad->filter, pad->filter_pad) < 0)
                 goto error;
@@ -457,6 +499,29 @@ static void dump_graph(struct lavfi *c)
 #endif
 }
 
+// hwaccel filters (like scale_vaapi) need a device to create their output
+// surfaces on. Use the one the input surfaces were allocated from.
+static void set_hw_device(struct lavfi *c)
+{
+    AVBufferRef *device_ref = NULL;
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+        if (pad->dir == LAVFI_IN && pad->in_hwframes_ref) {
+            AVHWFramesContext *fctx = (void *)pad->in_hwframes_ref->data;
+            device_ref = fctx->device_ref;
+            break;
+        }
+    }
+    if (!device_ref)
+        return;
+
+    for (int n = 0; n < c->graph->nb_filters; n++) {
+        AVFilterContext *filter = c->graph->filters[n];
+        if (!filter->hw_device_ctx)
+            filter->hw_device_ctx = av_buffer_ref(device_ref);
+    }
+}
+
 // Initialize the graph if all inputs have formats set. If it's already
 // initialized, or can't be initialized yet, do nothing.
 static void init_graph(struct lavfi *c)
@@ -464,6 +529,8 @@ static void init_graph(struct lavfi *c)
     assert(!c->initialized);
 
     if (init_pads(c)) {
+        set_hw_device(c);
+
         // And here the actual libavfilter initialization happens.
         if (avfilter_graph_config(c->graph, NULL) < 0) {
             MP_FATAL(c, "failed to configure the filter graph\n");
@@ -12,7 +12,8 @@ enum lavfi_direction {
     LAVFI_OUT,
 };
 
-struct lavfi *lavfi_create(struct mp_log *log, char *graph_string);
+struct lavfi *lavfi_create(struct mp_log *log, char *graph_string,
+                           int threads);
 void lavfi_destroy(struct lavfi *c);
 struct lavfi_pad *lavfi_find_pad(struct lavfi *c, char *name);
 enum lavfi_direction lavfi_pad_direction(struct lavfi_pad *pad);
@@ -56,6 +56,10 @@
 
 #include "core.h"
 #include "command.h"
+#include "thumbnail.h"
+#include "benchmark.h"
+#include "startup_prof.h"
+#include "sync_stats.h"
 #include "libmpv/client.h"
 
 // Called by foreign threads when playback should be stopped and such.
@@ -221,11 +225,12 @@ void reselect_demux_stream(struct MPContext *mpctx, struct track *track)
 static void wakeup_demux(void *pctx)
 {
     struct MPContext *mpctx = pctx;
-    mp_wakeup_core(mpctx);
+    mp_wakeup_core_src(mpctx, MP_WAKEUP_DEMUX);
 }
 
 static void enable_demux_thread(struct MPContext *mpctx, struct demuxer *demux)
 {
+    demux_set_budget(demux, mpctx->demux_budget);
     if (mpctx->opts->demuxer_thread && !demux->fully_read) {
         demux_set_wakeup_cb(demux, wakeup_demux, mpctx);
         demux_start_thread(demux);
@@ -639,7 +644,9 @@ void autoload_external_files(struct MPContext *mpctx)
                                     &stream_filename) > 0)
             base_filename = talloc_steal(tmp, stream_filename);
     }
-    struct subfn *list = find_external_files(mpctx->global, base_filename);
+    struct subfn *list = find_external_files(mpctx->global,
+                                             mpctx->external_files_cache,
+                                             base_filename);
     talloc_steal(tmp, list);
 
     int sc[STREAM_TYPE_COUNT] = {0};
@@ -793,6 +800,53 @@ static void load_per_file_options(m_config_t *conf,
     }
 }
 
+// Amount of audio decoded ahead with --prefetch-playlist=decode, unless
+// --ad-queue-secs is set.
+#define PREFETCH_AUDIO_SECS 1.0
+
+// Called from the demuxer thread while prefetching with a decoder.
+static void wakeup_prefetch_audio(void *ctx)
+{
+    audio_work(ctx);
+}
+
+// Start decoding sh ahead of time, so the AO can be fed as soon as the current
+// file ends. The decoder is taken over by init_audio_decoder().
+static void start_prefetch_audio(struct MPContext *mpctx, struct demuxer *demux,
+                                 struct sh_stream *sh)
+{
+    struct dec_audio *d_audio = talloc_zero(NULL, struct dec_audio);
+    d_audio->log = mp_log_new(d_audio, mpctx->log, "!ad");
+    d_audio->global = mpctx->global;
+    d_audio->opts = mpctx->opts;
+    d_audio->header = sh;
+    d_audio->codec = sh->codec;
+    d_audio->wakeup_cb = mp_wakeup_demux_cb;
+    d_audio->wakeup_cb_ctx = mpctx;
+    d_audio->try_spdif = true;
+
+    double secs = mpctx->opts->ad_queue_secs > 0 ? mpctx->opts->ad_queue_secs
+                                                 : PREFETCH_AUDIO_SECS;
+    if (!audio_init_best_codec(d_audio) || !audio_start_thread(d_audio, secs)) {
+        audio_uninit(d_audio);
+        return;
+    }
+
+    // Nobody calls audio_work() until the file is played, so let the demuxer
+    // keep the decoder going.
+    demux_set_wakeup_cb(demux, wakeup_prefetch_audio, d_audio);
+    mpctx->open_res_audio = d_audio;
+}
+
+static void uninit_open_res_audio(struct MPContext *mpctx, struct demuxer *demux)
+{
+    if (!mpctx->open_res_audio)
+        return;
+    demux_set_wakeup_cb(demux, NULL, NULL);
+    audio_uninit(mpctx->open_res_audio);
+    mpctx->open_res_audio = NULL;
+}
+
 static void *open_demux_thread(void *ctx)
 {
     struct MPContext *mpctx = ctx;
@@ -800,11 +854,34 @@ static void *open_demux_thread(void *ctx)
     struct demuxer_params p = {
         .force_format = mpctx->open_format,
         .stream_flags = mpctx->open_url_flags,
+        .playlist_offset = mpctx->open_playlist_offset,
         .initial_readahead = true,
     };
     mpctx->open_res_demuxer =
         demux_open_url(mpctx->open_url, &p, mpctx->open_cancel, mpctx->global);
 
+    struct demuxer *demux = mpctx->open_res_demuxer;
+    if (demux && mpctx->open_fill && !demux->playlist && !demux->fully_read) {
+        // Guess the streams that will be played, so the demuxer can start
+        // filling its packet queue. If the guess is wrong, selecting the
+        // actual tracks later just causes a refresh seek.
+        struct sh_stream *audio = NULL;
+        bool have[STREAM_TYPE_COUNT] = {0};
+        for (int n = 0; n < demux_get_num_stream(demux); n++) {
+            struct sh_stream *sh = demux_get_stream(demux, n);
+            if (sh->type != STREAM_SUB && !have[sh->type]) {
+                demuxer_select_track(demux, sh, MP_NOPTS_VALUE, true);
+                have[sh->type] = true;
+                if (sh->type == STREAM_AUDIO)
+                    audio = sh;
+            }
+        }
+        demux_start_thread(demux);
+
+        if (audio && mpctx->open_decode)
+            start_prefetch_audio(mpctx, demux, audio);
+    }
+
     if (mpctx->open_res_demuxer) {
         MP_VERBOSE(mpctx, "Opening done: %s\n", mpctx->open_url);
     } else {
@@ -835,15 +912,20 @@ static void cancel_open(struct MPContext *mpctx)
     TA_FREEP(&mpctx->open_url);
     TA_FREEP(&mpctx->open_format);
 
-    if (mpctx->open_res_demuxer)
+    if (mpctx->open_res_demuxer) {
+        uninit_open_res_audio(mpctx, mpctx->open_res_demuxer);
         free_demuxer_and_stream(mpctx->open_res_demuxer);
+    }
     mpctx->open_res_demuxer = NULL;
 
     atomic_store(&mpctx->open_done, false);
 }
 
 // Setup all the field to open this url, and make sure a thread is running.
-static void start_open(struct MPContext *mpctx, char *url, int url_flags)
+// If fill is set, the demuxer starts reading packets as soon as it's opened.
+// If decode is set too, the audio stream is also decoded ahead.
+static void start_open(struct MPContext *mpctx, char *url, int url_flags,
+                       int64_t playlist_offset, bool fill, bool decode)
 {
     cancel_open(mpctx);
 
@@ -856,6 +938,9 @@ static void start_open(struct MPContext *mpctx, char *url, int url_flags)
     mpctx->open_url = talloc_strdup(NULL, url);
     mpctx->open_format = talloc_strdup(NULL, mpctx->opts->demuxer_name);
     mpctx->open_url_flags = url_flags;
+    mpctx->open_playlist_offset = playlist_offset;
+    mpctx->open_fill = fill && mpctx->opts->demuxer_thread;
+    mpctx->open_decode = mpctx->open_fill && decode;
     if (mpctx->opts->load_unsafe_playlists)
         mpctx->open_url_flags = 0;
 
@@ -874,7 +959,8 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     if (mpctx->open_active) {
         bool done = atomic_load(&mpctx->open_done);
         bool failed = done && !mpctx->open_res_demuxer;
-        bool correct_url = strcmp(mpctx->open_url, url) == 0;
+        bool correct_url = strcmp(mpctx->open_url, url) == 0 &&
+            mpctx->open_playlist_offset == mpctx->playing->playlist_offset;
 
         if (correct_url && !failed) {
             MP_VERBOSE(mpctx, "Using prefetched/prefetching URL.\n");
@@ -892,7 +978,8 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     }
 
     if (!mpctx->open_active)
-        start_open(mpctx, url, mpctx->playing->stream_flags);
+        start_open(mpctx, url, mpctx->playing->stream_flags,
+                   mpctx->playing->playlist_offset, false, false);
 
     // User abort should cancel the opener now.
     pthread_mutex_lock(&mpctx->lock);
@@ -910,6 +997,12 @@ static void open_demux_reentrant(struct MPContext *mpctx)
         assert(mpctx->demuxer_cancel == mpctx->open_cancel);
         mpctx->demuxer = mpctx->open_res_demuxer;
         mpctx->open_res_demuxer = NULL;
+        if (mpctx->open_res_audio) {
+            // The demuxer must not call into the decoder after this.
+            demux_set_wakeup_cb(mpctx->demuxer, wakeup_demux, mpctx);
+            mpctx->prefetched_audio = mpctx->open_res_audio;
+            mpctx->open_res_audio = NULL;
+        }
         mpctx->open_cancel = NULL;
     } else {
         mpctx->error_playing = mpctx->open_res_error;
@@ -929,7 +1022,10 @@ void prefetch_next(struct MPContext *mpctx)
     struct playlist_entry *new_entry = mp_next_file(mpctx, +1, false, false);
     if (new_entry && !mpctx->open_active && new_entry->filename) {
         MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
-        start_open(mpctx, new_entry->filename, new_entry->stream_flags);
+        start_open(mpctx, new_entry->filename, new_entry->stream_flags,
+                   new_entry->playlist_offset,
+                   mpctx->opts->prefetch_open >= 2,
+                   mpctx->opts->prefetch_open == 3);
     }
 }
 
@@ -942,7 +1038,8 @@ static bool init_complex_filters(struct MPContext *mpctx)
     if (!graph || !graph[0])
         return true;
 
-    mpctx->lavfi = lavfi_create(mpctx->log, graph);
+    mpctx->lavfi = lavfi_create(mpctx->log, graph,
+                                mpctx->opts->lavfi_complex_threads);
     if (!mpctx->lavfi)
         return false;
 
@@ -1050,6 +1147,7 @@ static void play_current_file(struct MPContext *mpctx)
     double playback_start = -1e100;
 
     mp_notify(mpctx, MPV_EVENT_START_FILE, NULL);
+    startup_prof_begin(mpctx, "file");
 
     mp_cancel_reset(mpctx->playback_abort);
 
@@ -1061,10 +1159,15 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->last_vo_pts = MP_NOPTS_VALUE;
     mpctx->last_chapter_seek = -2;
     mpctx->last_chapter_pts = MP_NOPTS_VALUE;
+    mpctx->scrubbing = false;
+    mpctx->scrub_pts = MP_NOPTS_VALUE;
     mpctx->last_chapter = -2;
     mpctx->paused = false;
     mpctx->paused_for_cache = false;
     mpctx->cache_buffer = -1;
+    mpctx->cache_speed_samples = 0;
+    mpctx->cache_speed_next_sample = 0;
+    mpctx->cache_stall_estimate = -2;
     mpctx->playing_msg_shown = false;
     mpctx->max_frames = -1;
     mpctx->video_speed = mpctx->audio_speed = opts->playback_speed;
@@ -1074,6 +1177,7 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->seek = (struct seek_params){ 0 };
 
     reset_playback_state(mpctx);
+    benchmark_reset(mpctx);
 
     mpctx->playing = mpctx->playlist->current;
     if (!mpctx->playing || !mpctx->playing->filename)
@@ -1115,8 +1219,10 @@ reopen_file:
 
     assert(mpctx->demuxer == NULL);
 
+    startup_prof_begin(mpctx, "open-hooks");
     if (process_open_hooks(mpctx) < 0)
         goto terminate_playback;
+    startup_prof_end(mpctx, "open-hooks");
 
     if (opts->stream_dump && opts->stream_dump[0]) {
         if (stream_dump(mpctx, mpctx->stream_open_filename) >= 0)
@@ -1124,9 +1230,11 @@ reopen_file:
         goto terminate_playback;
     }
 
+    startup_prof_begin(mpctx, "demux-open");
     open_demux_reentrant(mpctx);
     if (!mpctx->demuxer || mpctx->stop_play)
         goto terminate_playback;
+    startup_prof_end(mpctx, "demux-open");
 
     if (mpctx->demuxer->playlist) {
         struct playlist *pl = mpctx->demuxer->playlist;
@@ -1151,15 +1259,19 @@ reopen_file:
     load_chapters(mpctx);
     add_demuxer_tracks(mpctx, mpctx->demuxer);
 
+    startup_prof_begin(mpctx, "external-files");
     open_external_files(mpctx, opts->audio_files, STREAM_AUDIO);
     open_external_files(mpctx, opts->sub_name, STREAM_SUB);
     open_external_files(mpctx, opts->external_files, STREAM_TYPE_COUNT);
     autoload_external_files(mpctx);
+    startup_prof_end(mpctx, "external-files");
 
     check_previous_track_selection(mpctx);
 
+    startup_prof_begin(mpctx, "preloaded-hooks");
     if (process_preloaded_hooks(mpctx))
         goto terminate_playback;
+    startup_prof_end(mpctx, "preloaded-hooks");
 
     if (!init_complex_filters(mpctx))
         goto terminate_playback;
@@ -1211,9 +1323,18 @@ reopen_file:
     if (!init_complex_filter_decoders(mpctx))
         goto terminate_playback;
 
-    reinit_video_chain(mpctx);
+    // The VO is created while the audio decoder is initialized.
+    start_vo_init(mpctx);
+    startup_prof_begin(mpctx, "audio-init");
     reinit_audio_chain(mpctx);
+    startup_prof_end(mpctx, "audio-init");
+    startup_prof_begin(mpctx, "video-init");
+    reinit_video_chain(mpctx);
+    startup_prof_end(mpctx, "video-init");
+    startup_prof_begin(mpctx, "sub-init");
     reinit_sub_all(mpctx);
+    startup_prof_end(mpctx, "sub-init");
+    uninit_prefetched_audio(mpctx);
 
     if (!mpctx->vo_chain && !mpctx->ao_chain) {
         MP_FATAL(mpctx, "No video or audio streams selected.\n");
@@ -1263,6 +1384,7 @@ reopen_file:
 
     playback_start = mp_time_sec();
     mpctx->error_playing = 0;
+    startup_prof_begin(mpctx, "first-frame"); // ended by startup_prof_done()
     while (!mpctx->stop_play)
         run_playloop(mpctx);
 
@@ -1270,6 +1392,8 @@ reopen_file:
 
 terminate_playback:
 
+    startup_prof_end(mpctx, "file");
+
     process_unload_hooks(mpctx);
 
     if (mpctx->stop_play == KEEP_PLAYING)
@@ -1288,8 +1412,13 @@ terminate_playback:
     // time to uninit all, except global stuff:
     uninit_complex_filters(mpctx);
     uninit_audio_chain(mpctx);
+    uninit_prefetched_audio(mpctx);
     uninit_video_chain(mpctx);
     uninit_sub_all(mpctx);
+    thumbnail_reset(mpctx);
+    sync_stats_write(mpctx);
+    sync_stats_reset(mpctx);
+    benchmark_write(mpctx);
     uninit_demuxer(mpctx);
     if (!opts->gapless_audio && !mpctx->encode_lavc_ctx)
         uninit_audio_out(mpctx);
@@ -1463,9 +1592,9 @@ static void set_track_recorder_sink(struct track *track,
     if (track->d_sub)
         sub_set_recorder_sink(track->d_sub, sink);
     if (track->d_video)
-        track->d_video->recorder_sink = sink;
+        video_set_recorder_sink(track->d_video, sink);
     if (track->d_audio)
-        track->d_audio->recorder_sink = sink;
+        audio_set_recorder_sink(track->d_audio, sink);
     track->remux_sink = sink;
 }
 
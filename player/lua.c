@@ -965,9 +965,11 @@ static int script_set_osd_ass(lua_State *L)
     int res_x = luaL_checkinteger(L, 1);
     int res_y = luaL_checkinteger(L, 2);
     const char *text = luaL_checkstring(L, 3);
+    int layer = luaL_optinteger(L, 4, 0);
     if (!text[0])
         text = " "; // force external OSD initialization
-    osd_set_external(ctx->mpctx->osd, ctx->client, res_x, res_y, (char *)text);
+    osd_set_external(ctx->mpctx->osd, ctx->client, layer, res_x, res_y,
+                     (char *)text);
     mp_wakeup_core(ctx->mpctx);
     return 0;
 }
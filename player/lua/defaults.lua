@@ -351,12 +351,56 @@ function mp.observe_property(name, t, cb)
     mp.raw_observe_property(id, name, t)
 end
 
+local snapshots = {}
+local dirty_snapshots = {}
+
+function mp.observe_properties(props, cb)
+    local snap = {values = {}, changed = {}, cb = cb, ids = {}}
+    for name, t in pairs(props) do
+        local id = property_id + 1
+        property_id = id
+        snap.ids[#snap.ids + 1] = id
+        properties[id] = function(_, val)
+            snap.values[name] = val
+            snap.changed[name] = true
+            if snap.cb then
+                dirty_snapshots[snap] = true
+            end
+        end
+        mp.raw_observe_property(id, name, t)
+    end
+    snapshots[snap] = true
+    return snap.values
+end
+
+-- Call the callbacks of all snapshots which received changes since the last
+-- call, once per snapshot.
+local function flush_snapshots()
+    local dirty = dirty_snapshots
+    dirty_snapshots = {}
+    for snap, _ in pairs(dirty) do
+        local changed = snap.changed
+        snap.changed = {}
+        snap.cb(snap.values, changed)
+    end
+end
+
 function mp.unobserve_property(cb)
     for prop_id, prop_cb in pairs(properties) do
         if cb == prop_cb then
             properties[prop_id] = nil
         end
     end
+    for snap, _ in pairs(snapshots) do
+        if cb == snap.cb or cb == snap.values then
+            for _, id in ipairs(snap.ids) do
+                properties[id] = nil
+                mp.raw_unobserve_property(id)
+            end
+            snapshots[snap] = nil
+            dirty_snapshots[snap] = nil
+        end
+    end
 end
 
 local function property_change(ev)
@@ -475,6 +519,7 @@ function mp.dispatch_events(allow_wait)
     while mp.keep_running do
         local wait = 0
         if not more_events then
+            flush_snapshots()
             wait = process_timers()
             if wait == nil then
                 for _, handler in ipairs(idle_handlers) do
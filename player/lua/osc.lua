@@ -102,6 +102,15 @@ local state = {
     showhide_enabled = false,
 }
 
+-- properties read on every render, kept up to date by observation
+local props = mp.observe_properties({
+    ["duration"] = "number",
+    ["percent-pos"] = "number",
+    ["chapter-list"] = "native",
+    ["demuxer-cache-duration"] = "number",
+    ["cache-used"] = "number",
+})
+
 
 
 
@@ -496,7 +505,7 @@ end
 -- Element Rendering
 --
 
-function render_elements(master_ass)
+function render_elements(master_ass, tooltip_ass)
 
     for n=1, #elements do
         local element = elements[n]
@@ -627,10 +636,10 @@ function render_elements(master_ass)
                     end
 
                     -- tooltip label
-                    elem_ass:new_event()
-                    elem_ass:pos(tx, ty)
-                    elem_ass:an(an)
-                    elem_ass:append(slider_lo.tooltip_style)
+                    tooltip_ass:new_event()
+                    tooltip_ass:pos(tx, ty)
+                    tooltip_ass:an(an)
+                    tooltip_ass:append(slider_lo.tooltip_style)
 
                     --alpha
                     local ar = slider_lo.alpha
@@ -640,10 +649,10 @@ function render_elements(master_ass)
                             ar[ai] = mult_alpha(av, state.animation)
                         end
                     end
-                    elem_ass:append(string.format("{\\1a&H%X&\\2a&H%X&\\3a&H%X&\\4a&H%X&}",
+                    tooltip_ass:append(string.format("{\\1a&H%X&\\2a&H%X&\\3a&H%X&\\4a&H%X&}",
                         ar[1], ar[2], ar[3], ar[4]))
 
-                    elem_ass:append(tooltiplabel)
+                    tooltip_ass:append(tooltiplabel)
 
                 end
             end
@@ -682,6 +691,17 @@ end
 -- Message display
 --
 
+-- The OSC is submitted to the OSD as separate layers, each of which is only
+-- re-rendered when its own contents change. E.g. a seekbar tooltip following
+-- the mouse doesn't cause the rest of the OSC to be re-rendered.
+local osd_layers = { message = 0, elements = 1, tooltip = 2 }
+
+function set_osd(res_x, res_y, message_text, elements_text, tooltip_text)
+    mp.set_osd_ass(res_x, res_y, message_text, osd_layers.message)
+    mp.set_osd_ass(res_x, res_y, elements_text or "", osd_layers.elements)
+    mp.set_osd_ass(res_x, res_y, tooltip_text or "", osd_layers.tooltip)
+end
+
 -- pos is 1 based
 function limited_list(prop, pos)
     local proplist = mp.get_property_native(prop, {})
@@ -1705,9 +1725,9 @@ function osc_init()
 
     ne.enabled = not (mp.get_property("percent-pos") == nil)
     ne.slider.markerF = function ()
-        local duration = mp.get_property_number("duration", nil)
+        local duration = props["duration"]
         if not (duration == nil) then
-            local chapters = mp.get_property_native("chapter-list", {})
+            local chapters = props["chapter-list"] or {}
             local markers = {}
             for n = 1, #chapters do
                 markers[n] = (chapters[n].time / duration * 100)
@@ -1718,9 +1738,9 @@ function osc_init()
         end
     end
     ne.slider.posF =
-        function () return mp.get_property_number("percent-pos", nil) end
+        function () return props["percent-pos"] end
     ne.slider.tooltipF = function (pos)
-        local duration = mp.get_property_number("duration", nil)
+        local duration = props["duration"]
         if not ((duration == nil) or (pos == nil)) then
             possec = duration * (pos / 100)
             return mp.format_time(possec)
@@ -1736,6 +1756,10 @@ function osc_init()
             local seekto = get_slider_value(element)
             if (element.state.lastseek == nil) or
                 (not (element.state.lastseek == seekto)) then
+                    if not element.state.scrubbing then
+                        mp.commandv("scrub", "start")
+                        element.state.scrubbing = true
+                    end
                     mp.commandv("seek", seekto,
                         "absolute-percent", "keyframes")
                     element.state.lastseek = seekto
@@ -1746,7 +1770,14 @@ function osc_init()
         function (element) mp.commandv("seek", get_slider_value(element),
             "absolute-percent", "exact") end
     ne.eventresponder["reset"] =
-        function (element) element.state.lastseek = nil end
+        function (element)
+            element.state.lastseek = nil
+            -- ending the scrub mode seeks precisely to the last position
+            if element.state.scrubbing then
+                mp.commandv("scrub", "stop")
+                element.state.scrubbing = false
+            end
+        end
 
 
     -- tc_left (current pos)
@@ -1790,13 +1821,13 @@ function osc_init()
     ne = new_element("cache", "button")
 
     ne.content = function ()
-        local dmx_cache = mp.get_property_number("demuxer-cache-duration")
+        local dmx_cache = props["demuxer-cache-duration"]
         if not (dmx_cache == nil) then
             dmx_cache = math.floor(dmx_cache + 0.5) .. "s + "
         else
             dmx_cache = ""
         end
-        local cache_used = mp.get_property_number("cache-used")
+        local cache_used = props["cache-used"]
         if not (cache_used == nil) then
             if (cache_used < 1024) then
                 cache_used = cache_used .. " KB"
@@ -2028,18 +2059,21 @@ function render()
 
 
     -- actual rendering
+    local message_ass = assdraw.ass_new()
     local ass = assdraw.ass_new()
+    local tooltip_ass = assdraw.ass_new()
 
     -- Messages
-    render_message(ass)
+    render_message(message_ass)
 
     -- actual OSC
     if state.osc_visible then
-        render_elements(ass)
+        render_elements(ass, tooltip_ass)
     end
 
     -- submit
-    mp.set_osd_ass(osc_param.playresy * aspect, osc_param.playresy, ass.text)
+    set_osd(osc_param.playresy * aspect, osc_param.playresy,
+        message_ass.text, ass.text, tooltip_ass.text)
 
 
 
@@ -2158,7 +2192,7 @@ function tick()
         ass:pos(320, icon_y+65)
         ass:an(8)
         ass:append("Drop files to play here.")
-        mp.set_osd_ass(640, 360, ass.text)
+        set_osd(640, 360, ass.text)
 
         if state.showhide_enabled then
             mp.disable_key_bindings("showhide")
@@ -2173,7 +2207,7 @@ function tick()
         render()
     else
         -- Flush OSD
-        mp.set_osd_ass(osc_param.playresy, osc_param.playresy, "")
+        set_osd(osc_param.playresy, osc_param.playresy, "")
     end
 end
 
@@ -1,5 +1,14 @@
 local utils = require 'mp.utils'
 local msg = require 'mp.msg'
+local options = require 'mp.options'
+
+local o = {
+    -- resolve the next playlist entry while the current one is playing
+    prefetch = false,
+    -- seconds a youtube-dl result is reused for (0 to disable the cache)
+    cache_ttl = 600,
+}
+options.read_options(o)
 
 local ytdl = {
     path = "youtube-dl",
@@ -8,6 +17,9 @@ local ytdl = {
 
 local chapter_list = {}
 
+-- youtube-dl JSON output, keyed by command line
+local result_cache = {}
+
 local function exec(args)
     local ret = utils.subprocess({args = args})
     return ret.status, ret.stdout, ret
@@ -125,70 +137,123 @@ local function edl_track_joined(fragments, protocol, is_live)
     return edl
 end
 
-mp.add_hook("on_load", 10, function ()
-    local url = mp.get_property("stream-open-filename")
-
-    if (url:find("http://") == 1) or (url:find("https://") == 1)
-        or (url:find("ytdl://") == 1) then
+local function is_ytdl_url(url)
+    return (url:find("http://") == 1) or (url:find("https://") == 1)
+        or (url:find("ytdl://") == 1)
+end
 
-        -- check for youtube-dl in mpv's config dir
-        if not (ytdl.searched) then
-            local ytdl_mcd = mp.find_config_file("youtube-dl")
-            if not (ytdl_mcd == nil) then
-                msg.verbose("found youtube-dl at: " .. ytdl_mcd)
-                ytdl.path = ytdl_mcd
-            end
-            ytdl.searched = true
+local function build_command(url)
+    -- check for youtube-dl in mpv's config dir
+    if not (ytdl.searched) then
+        local ytdl_mcd = mp.find_config_file("youtube-dl")
+        if not (ytdl_mcd == nil) then
+            msg.verbose("found youtube-dl at: " .. ytdl_mcd)
+            ytdl.path = ytdl_mcd
         end
+        ytdl.searched = true
+    end
 
-        -- strip ytdl://
-        if (url:find("ytdl://") == 1) then
-            url = url:sub(8)
-        end
+    -- strip ytdl://
+    if (url:find("ytdl://") == 1) then
+        url = url:sub(8)
+    end
 
-        local format = mp.get_property("options/ytdl-format")
-        local raw_options = mp.get_property_native("options/ytdl-raw-options")
-        local allsubs = true
+    local format = mp.get_property("options/ytdl-format")
+    local raw_options = mp.get_property_native("options/ytdl-raw-options")
+    local allsubs = true
 
-        local command = {
-            ytdl.path, "--no-warnings", "-J", "--flat-playlist",
-            "--sub-format", "ass/srt/best", "--no-playlist"
-        }
+    local command = {
+        ytdl.path, "--no-warnings", "-J", "--flat-playlist",
+        "--sub-format", "ass/srt/best", "--no-playlist"
+    }
 
-        -- Checks if video option is "no", change format accordingly,
-        -- but only if user didn't explicitly set one
-        if (mp.get_property("options/vid") == "no")
-            and not option_was_set("ytdl-format") then
+    -- Checks if video option is "no", change format accordingly,
+    -- but only if user didn't explicitly set one
+    if (mp.get_property("options/vid") == "no")
+        and not option_was_set("ytdl-format") then
 
-            format = "bestaudio/best"
-            msg.verbose("Video disabled. Only using audio")
-        end
+        format = "bestaudio/best"
+        msg.verbose("Video disabled. Only using audio")
+    end
 
-        if (format == "") then
-            format = "bestvideo+bestaudio/best"
-        end
-        table.insert(command, "--format")
-        table.insert(command, format)
+    if (format == "") then
+        format = "bestvideo+bestaudio/best"
+    end
+    table.insert(command, "--format")
+    table.insert(command, format)
 
-        for param, arg in pairs(raw_options) do
-            table.insert(command, "--" .. param)
-            if (arg ~= "") then
-                table.insert(command, arg)
-            end
-            if (param == "sub-lang") and (arg ~= "") then
-                allsubs = false
-            end
+    for param, arg in pairs(raw_options) do
+        table.insert(command, "--" .. param)
+        if (arg ~= "") then
+            table.insert(command, arg)
+        end
+        if (param == "sub-lang") and (arg ~= "") then
+            allsubs = false
         end
+    end
 
-        if (allsubs == true) then
-            table.insert(command, "--all-subs")
+    if (allsubs == true) then
+        table.insert(command, "--all-subs")
+    end
+    table.insert(command, "--")
+    table.insert(command, url)
+    return command
+end
+
+local function expire_cache()
+    local now = mp.get_time()
+    for key, entry in pairs(result_cache) do
+        if now - entry.time > o.cache_ttl then
+            result_cache[key] = nil
         end
-        table.insert(command, "--")
-        table.insert(command, url)
-        msg.debug("Running: " .. table.concat(command,' '))
-        local es, json, result = exec(command)
+    end
+end
+
+-- Return the JSON output of youtube-dl for the command, or nil and the
+-- subprocess result on failure.
+local function run_ytdl(command)
+    local key = table.concat(command, "\0")
+    expire_cache()
+    if result_cache[key] then
+        msg.verbose("Using cached youtube-dl result")
+        return result_cache[key].json
+    end
+
+    msg.debug("Running: " .. table.concat(command,' '))
+    local es, json, result = exec(command)
+
+    if (es < 0) or (json == nil) or (json == "") then
+        return nil, result
+    end
+
+    if o.cache_ttl > 0 then
+        result_cache[key] = {json = json, time = mp.get_time()}
+    end
+    return json
+end
+
+-- Resolve the next playlist entry, so that it starts without delay. This
+-- blocks only this script, not playback.
+local function prefetch_next()
+    local pos = mp.get_property_number("playlist-pos")
+    if not pos or o.cache_ttl <= 0 then
+        return
+    end
+    local url = mp.get_property("playlist/" .. (pos + 1) .. "/filename")
+    if not url or not is_ytdl_url(url) then
+        return
+    end
+    msg.verbose("Prefetching " .. url)
+    run_ytdl(build_command(url))
+end
 
-        if (es < 0) or (json == nil) or (json == "") then
+mp.add_hook("on_load", 10, function ()
+    local url = mp.get_property("stream-open-filename")
+
+    if is_ytdl_url(url) then
+        local json, result = run_ytdl(build_command(url))
+
+        if json == nil then
             if not result.killed_by_us then
                 msg.warn("youtube-dl failed, trying to play URL directly ...")
             end
@@ -396,6 +461,18 @@ mp.add_hook("on_load", 10, function ()
 end)
 
 
+if o.prefetch then
+    local prefetch_done = false
+    mp.register_event("playback-restart", function ()
+        -- Only once per file.
+        if not prefetch_done then
+            prefetch_done = true
+            prefetch_next()
+        end
+    end)
+    mp.register_event("start-file", function () prefetch_done = false end)
+end
+
 mp.add_hook("on_preloaded", 10, function ()
     if next(chapter_list) ~= nil then
         msg.verbose("Setting chapters from video's description")
@@ -54,6 +54,9 @@
 #include "demux/demux.h"
 #include "stream/stream.h"
 #include "sub/osd.h"
+#if HAVE_LIBASS
+#include "sub/ass_mp.h"
+#endif
 #include "video/decode/dec_video.h"
 #include "video/out/vo.h"
 
@@ -61,6 +64,12 @@
 #include "client.h"
 #include "command.h"
 #include "screenshot.h"
+#include "thumbnail.h"
+#include "playlist_probe.h"
+#include "benchmark.h"
+#include "external_files.h"
+#include "startup_prof.h"
+#include "sync_stats.h"
 
 static const char def_config[] =
 #include "player/builtin_conf.inc"
@@ -173,15 +182,29 @@ void mp_destroy(struct MPContext *mpctx)
 
     mpctx->encode_lavc_ctx = NULL;
 
+    startup_prof_write(mpctx);
+
     command_uninit(mpctx);
 
+    screenshot_uninit(mpctx);
+
+    playlist_probe_uninit(mpctx);
+    mp_watch_later_uninit(mpctx);
+
     mp_clients_destroy(mpctx);
 
     talloc_free(mpctx->gl_cb_ctx);
     mpctx->gl_cb_ctx = NULL;
+    talloc_free(mpctx->sw_cb_ctx);
+    mpctx->sw_cb_ctx = NULL;
 
     osd_free(mpctx->osd);
 
+#if HAVE_LIBASS
+    mp_ass_preload_fonts_destroy(mpctx->font_preload);
+    mpctx->font_preload = NULL;
+#endif
+
 #if HAVE_COCOA
     cocoa_set_input_context(NULL);
 #endif
@@ -337,6 +360,7 @@ struct MPContext *mp_create(void)
     };
 
     pthread_mutex_init(&mpctx->lock, NULL);
+    atomic_store(&mpctx->wakeup_srcs, 0);
 
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
 
@@ -345,6 +369,9 @@ struct MPContext *mp_create(void)
     mpctx->log = mp_log_new(mpctx, mpctx->global->log, "!cplayer");
     mpctx->statusline = mp_log_new(mpctx, mpctx->log, "!statusline");
 
+    startup_prof_init(mpctx);
+    startup_prof_begin(mpctx, "create");
+
     // Create the config context and register the options
     mpctx->mconfig = m_config_new(mpctx, mpctx->log, sizeof(struct MPOpts),
                                   &mp_default_opts, mp_opts);
@@ -359,8 +386,14 @@ struct MPContext *mp_create(void)
 
     mpctx->global->opts = mpctx->opts;
 
-    mpctx->input = mp_input_init(mpctx->global, mp_wakeup_core_cb, mpctx);
+    mpctx->input = mp_input_init(mpctx->global, mp_wakeup_input_cb, mpctx);
     screenshot_init(mpctx);
+    thumbnail_init(mpctx);
+    playlist_probe_init(mpctx);
+    sync_stats_init(mpctx);
+    benchmark_init(mpctx);
+    mpctx->external_files_cache = external_files_cache_new(mpctx);
+    mpctx->demux_budget = demux_budget_create(mpctx);
     command_init(mpctx);
     init_libav(mpctx->global);
     mp_clients_init(mpctx);
@@ -376,6 +409,8 @@ struct MPContext *mp_create(void)
     if (verbose_env)
         mpctx->opts->verbose = atoi(verbose_env);
 
+    startup_prof_end(mpctx, "create");
+
     return mpctx;
 }
 
@@ -390,6 +425,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     assert(!mpctx->initialized);
 
+    startup_prof_begin(mpctx, "init");
+
     // Preparse the command line, so we can init the terminal early.
     if (options)
         m_config_preparse_command_line(mpctx->mconfig, mpctx->global, options);
@@ -405,6 +442,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mp_print_version(mpctx->log, false);
 
+    startup_prof_begin(mpctx, "config");
+
     mp_parse_cfgfiles(mpctx);
 
     if (options) {
@@ -414,6 +453,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
             return r == M_OPT_EXIT ? -2 : -1;
     }
 
+    startup_prof_end(mpctx, "config");
+
     if (opts->operation_mode == 1) {
         m_config_set_profile(mpctx->mconfig, "builtin-pseudo-gui",
                              M_SETOPT_NO_OVERWRITE);
@@ -421,8 +462,11 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     }
 
     mp_get_resume_defaults(mpctx);
+    mp_watch_later_init(mpctx);
 
+    startup_prof_begin(mpctx, "input-config");
     mp_input_load_config(mpctx->input);
+    startup_prof_end(mpctx, "input-config");
 
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
@@ -453,7 +497,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     if (!mpctx->playlist->first && !opts->player_idle_mode)
         return -3;
 
-    MP_STATS(mpctx, "start init");
+    MP_STATS_START(mpctx, "init");
 
 #if HAVE_ENCODING
     if (opts->encode_opts->file && opts->encode_opts->file[0]) {
@@ -468,17 +512,28 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     }
 #endif
 
-#if !HAVE_LIBASS
+#if HAVE_LIBASS
+    // Before anything could render OSD or subtitles.
+    startup_prof_begin(mpctx, "fonts");
+    mpctx->font_preload = mp_ass_preload_fonts(opts->sub_style, mpctx->global,
+                                               mpctx->log);
+    startup_prof_end(mpctx, "fonts");
+#else
     MP_WARN(mpctx, "Compiled without libass.\n");
     MP_WARN(mpctx, "There will be no OSD and no text subtitles.\n");
 #endif
 
+    startup_prof_begin(mpctx, "scripts");
     mp_load_scripts(mpctx);
+    startup_prof_end(mpctx, "scripts");
 
+    startup_prof_begin(mpctx, "force-window");
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
+    startup_prof_end(mpctx, "force-window");
 
-    MP_STATS(mpctx, "end init");
+    MP_STATS_END(mpctx, "init");
+    startup_prof_end(mpctx, "init");
 
     return 0;
 }
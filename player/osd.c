@@ -81,7 +81,7 @@ static void term_osd_update(struct MPContext *mpctx)
     int num_parts = 0;
     char *parts[3] = {0};
 
-    if (!mpctx->opts->use_terminal)
+    if (!mpctx->opts->use_terminal || !mp_msg_has_terminal_status(mpctx->global))
         return;
 
     if (mpctx->term_osd_subs && mpctx->term_osd_subs[0])
@@ -171,9 +171,21 @@ static void term_osd_print_status_lazy(struct MPContext *mpctx)
     update_window_title(mpctx, false);
     update_vo_playback_state(mpctx);
 
-    if (!opts->use_terminal)
+    if (!opts->use_terminal || !mp_msg_has_terminal_status(mpctx->global))
         return;
 
+    // The status changes on every video frame, so limit how often it's
+    // rebuilt and printed. OSD messages and subtitles are not delayed.
+    double now = mp_time_sec();
+    double delay = opts->term_status_rate > 0 ? 1.0 / opts->term_status_rate : 0;
+    double diff = now - mpctx->term_osd_status_time;
+    if (diff >= 0 && diff < delay) {
+        mp_set_timeout(mpctx, delay - diff);
+        mpctx->osd_idle_update = true;
+        return;
+    }
+    mpctx->term_osd_status_time = now;
+
     if (opts->quiet || !mpctx->playback_initialized || !mpctx->playing_msg_shown)
     {
         term_osd_set_status_lazy(mpctx, "");
@@ -0,0 +1,220 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// playlist-probe command: open the headers of playlist entries on worker
+// threads (no demuxer thread, no decoders), and attach duration, title and
+// video size to the entries. The playlist itself is touched only by the
+// playback thread; workers get copies of what they need.
+
+#include <pthread.h>
+
+#include "mpv_talloc.h"
+#include "playlist_probe.h"
+#include "core.h"
+#include "command.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "common/tags.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "misc/thread_pool.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+
+// Probing is mostly waiting for I/O, so use more threads than CPUs.
+#define NUM_THREADS 8
+
+struct probe_job {
+    struct playlist_probe_ctx *ctx;
+    struct playlist_entry *entry;   // reserved; accessed by playback thread only
+    char *filename;
+    int stream_flags;
+    struct playlist_probe *res;     // set by the worker
+};
+
+struct playlist_probe_ctx {
+    struct MPContext *mpctx;
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+
+    // Runs the probe jobs. Created on first use.
+    struct mp_thread_pool *pool;
+    int num_queued;                 // jobs not returned by update yet
+    double start_time;
+
+    pthread_mutex_t lock;
+    // Finished jobs. Protected by lock.
+    struct probe_job **done;
+    int num_done;
+};
+
+void playlist_probe_init(struct MPContext *mpctx)
+{
+    struct playlist_probe_ctx *ctx = talloc_ptrtype(mpctx, ctx);
+    *ctx = (struct playlist_probe_ctx){
+        .mpctx = mpctx,
+        .log = mp_log_new(ctx, mpctx->log, "probe"),
+        .cancel = mp_cancel_new(ctx),
+    };
+    pthread_mutex_init(&ctx->lock, NULL);
+    mpctx->playlist_probe_ctx = ctx;
+}
+
+static void free_job(struct probe_job *job)
+{
+    playlist_entry_unref(job->entry);
+    talloc_free(job);
+}
+
+void playlist_probe_uninit(struct MPContext *mpctx)
+{
+    struct playlist_probe_ctx *ctx = mpctx->playlist_probe_ctx;
+    if (!ctx)
+        return;
+
+    // Jobs which didn't start yet return immediately.
+    mp_cancel_trigger(ctx->cancel);
+    talloc_free(ctx->pool);
+
+    for (int n = 0; n < ctx->num_done; n++)
+        free_job(ctx->done[n]);
+
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    mpctx->playlist_probe_ctx = NULL;
+}
+
+static void probe_fn(void *p)
+{
+    struct probe_job *job = p;
+    struct playlist_probe_ctx *ctx = job->ctx;
+    struct MPContext *mpctx = ctx->mpctx;
+
+    if (mp_cancel_test(ctx->cancel))
+        goto done;
+
+    struct playlist_probe *res = talloc_zero(job, struct playlist_probe);
+    res->duration = -1;
+    res->failed = true;
+
+    struct demuxer_params params = {
+        .stream_flags = job->stream_flags,
+        .disable_cache = true,
+    };
+    struct demuxer *demuxer =
+        demux_open_url(job->filename, &params, ctx->cancel, mpctx->global);
+    if (demuxer) {
+        res->failed = false;
+        res->duration = demuxer_get_time_length(demuxer);
+        char *title = mp_tags_get_str(demuxer->metadata, "title");
+        res->title = talloc_strdup(res, title);
+        for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+            struct sh_stream *sh = demux_get_stream(demuxer, n);
+            if (sh->type == STREAM_VIDEO && !sh->attached_picture) {
+                res->w = sh->codec->disp_w;
+                res->h = sh->codec->disp_h;
+                break;
+            }
+        }
+        free_demuxer_and_stream(demuxer);
+    } else if (!mp_cancel_test(ctx->cancel)) {
+        MP_VERBOSE(ctx, "Could not open '%s'.\n", job->filename);
+    }
+    job->res = res;
+
+done:
+    pthread_mutex_lock(&ctx->lock);
+    MP_TARRAY_APPEND(ctx, ctx->done, ctx->num_done, job);
+    pthread_mutex_unlock(&ctx->lock);
+    mp_wakeup_core(mpctx);
+}
+
+int playlist_probe_start(struct MPContext *mpctx, int first, int count)
+{
+    struct playlist_probe_ctx *ctx = mpctx->playlist_probe_ctx;
+
+    struct playlist_entry *e = playlist_entry_from_index(mpctx->playlist, first);
+    if (!e)
+        return -1;
+
+    if (!ctx->pool) {
+        ctx->pool = mp_thread_pool_create(ctx, NUM_THREADS);
+        if (!ctx->pool)
+            return -1;
+    }
+
+    if (!ctx->num_queued)
+        ctx->start_time = mp_time_sec();
+
+    int num = 0;
+    for (; e && (count < 0 || num < count); e = e->next) {
+        if (e->probe || e->probe_queued)
+            continue;
+        struct probe_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct probe_job){
+            .ctx = ctx,
+            .entry = e,
+            .filename = talloc_strdup(job, e->filename),
+            .stream_flags = e->stream_flags,
+        };
+        e->reserved++;
+        e->probe_queued = true;
+        ctx->num_queued++;
+        mp_thread_pool_queue(ctx->pool, probe_fn, job);
+        num++;
+    }
+    MP_VERBOSE(ctx, "Probing %d playlist entries.\n", num);
+    return num;
+}
+
+void playlist_probe_update(struct MPContext *mpctx)
+{
+    struct playlist_probe_ctx *ctx = mpctx->playlist_probe_ctx;
+    if (!ctx->num_queued)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    struct probe_job **done = ctx->done;
+    int num_done = ctx->num_done;
+    ctx->done = NULL;
+    ctx->num_done = 0;
+    pthread_mutex_unlock(&ctx->lock);
+
+    bool changed = false;
+    for (int n = 0; n < num_done; n++) {
+        struct probe_job *job = done[n];
+        struct playlist_entry *e = job->entry;
+        e->probe_queued = false;
+        if (job->res && !e->removed) {
+            talloc_free(e->probe);
+            e->probe = talloc_steal(e, job->res);
+            changed = true;
+        }
+        free_job(job);
+        ctx->num_queued--;
+    }
+    talloc_free(done);
+
+    if (changed)
+        mp_notify_property(mpctx, "playlist");
+
+    if (num_done && !ctx->num_queued) {
+        MP_VERBOSE(ctx, "Probing done after %.3f s.\n",
+                   mp_time_sec() - ctx->start_time);
+    }
+}
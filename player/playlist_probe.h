@@ -0,0 +1,39 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_PLAYLIST_PROBE_H
+#define MPLAYER_PLAYLIST_PROBE_H
+
+struct MPContext;
+
+// One time initialization at program start.
+void playlist_probe_init(struct MPContext *mpctx);
+
+// Abort running probes and wait for the worker threads.
+void playlist_probe_uninit(struct MPContext *mpctx);
+
+// Queue up to count entries (all remaining if count < 0) starting at playlist
+// index first for probing. Entries which were already probed or are queued
+// are skipped. Returns the number of queued entries, or -1 if first is out of
+// range.
+int playlist_probe_start(struct MPContext *mpctx, int first, int count);
+
+// Attach results of finished probes to their playlist entries. Called by the
+// playloop.
+void playlist_probe_update(struct MPContext *mpctx);
+
+#endif /* MPLAYER_PLAYLIST_PROBE_H */
@@ -50,24 +50,78 @@
 
 #include "core.h"
 #include "client.h"
+#include "benchmark.h"
 #include "command.h"
+#include "playlist_probe.h"
+#include "startup_prof.h"
+
+// While paused or idle, timeouts are extended by up to this many seconds, so
+// that timers expiring close to each other (OSD, cursor autohide, cache
+// updates, heartbeat...) are handled by a single wakeup.
+#define TIMER_SLACK 0.02
+
+static const char *const wakeup_src_names[MP_WAKEUP_SRC_COUNT] = {
+    [MP_WAKEUP_CORE]    = "core",
+    [MP_WAKEUP_INPUT]   = "input",
+    [MP_WAKEUP_DEMUX]   = "demux",
+    [MP_WAKEUP_AO]      = "ao",
+    [MP_WAKEUP_VO]      = "vo",
+    [MP_WAKEUP_FILTER]  = "filter",
+    [MP_WAKEUP_CLIENT]  = "client",
+    [MP_WAKEUP_TIMEOUT] = "timeout",
+};
+
+const char *mp_wakeup_src_name(enum mp_wakeup_src src)
+{
+    return wakeup_src_names[src];
+}
+
+// Record why mp_dispatch_queue_process() returned.
+static void account_wakeup(struct MPContext *mpctx, double sleeptime,
+                           int64_t start)
+{
+    int srcs = atomic_exchange(&mpctx->wakeup_srcs, 0);
+    if (!srcs) {
+        // Nothing called mp_wakeup_core(), so either the timeout expired, or
+        // a dispatch item (client API request) interrupted the wait.
+        if (sleeptime <= 0) {
+            srcs = 1 << MP_WAKEUP_CORE;
+        } else if ((mp_time_us() - start) / 1e6 >= sleeptime) {
+            srcs = 1 << MP_WAKEUP_TIMEOUT;
+        } else {
+            srcs = 1 << MP_WAKEUP_CLIENT;
+        }
+    }
+    for (int n = 0; n < MP_WAKEUP_SRC_COUNT; n++) {
+        if (srcs & (1 << n))
+            mpctx->wakeup_counts[n]++;
+    }
+    mpctx->wakeup_iterations++;
+}
 
 // Wait until mp_wakeup_core() is called, since the last time
 // mp_wait_events() was called.
 void mp_wait_events(struct MPContext *mpctx)
 {
-    if (mpctx->sleeptime > 0)
-        MP_STATS(mpctx, "start sleep");
+    double sleeptime = mpctx->sleeptime;
+    bool playing = mpctx->playback_initialized && !mpctx->paused;
+    if (sleeptime > 0 && isfinite(sleeptime) && !playing)
+        sleeptime += TIMER_SLACK;
+
+    if (sleeptime > 0)
+        MP_STATS_START(mpctx, "sleep");
 
     mpctx->in_dispatch = true;
 
-    mp_dispatch_queue_process(mpctx->dispatch, mpctx->sleeptime);
+    int64_t start = mp_time_us();
+    mp_dispatch_queue_process(mpctx->dispatch, sleeptime);
+    account_wakeup(mpctx, sleeptime, start);
 
     mpctx->in_dispatch = false;
     mpctx->sleeptime = INFINITY;
 
-    if (mpctx->sleeptime > 0)
-        MP_STATS(mpctx, "end sleep");
+    if (sleeptime > 0)
+        MP_STATS_END(mpctx, "sleep");
 }
 
 // Set the timeout used when the playloop goes to sleep. This means the
@@ -87,14 +141,45 @@ void mp_set_timeout(struct MPContext *mpctx, double sleeptime)
 // of going to sleep in the next mp_wait_events().
 void mp_wakeup_core(struct MPContext *mpctx)
 {
+    mp_wakeup_core_src(mpctx, MP_WAKEUP_CORE);
+}
+
+// Like mp_wakeup_core(), but record the source for the wakeup-stats property.
+void mp_wakeup_core_src(struct MPContext *mpctx, enum mp_wakeup_src src)
+{
+    atomic_fetch_or(&mpctx->wakeup_srcs, 1 << src);
     mp_dispatch_interrupt(mpctx->dispatch);
 }
 
-// Opaque callback variant of mp_wakeup_core().
+// Opaque callback variants of mp_wakeup_core().
 void mp_wakeup_core_cb(void *ctx)
 {
-    struct MPContext *mpctx = ctx;
-    mp_wakeup_core(mpctx);
+    mp_wakeup_core_src(ctx, MP_WAKEUP_CORE);
+}
+
+void mp_wakeup_input_cb(void *ctx)
+{
+    mp_wakeup_core_src(ctx, MP_WAKEUP_INPUT);
+}
+
+void mp_wakeup_demux_cb(void *ctx)
+{
+    mp_wakeup_core_src(ctx, MP_WAKEUP_DEMUX);
+}
+
+void mp_wakeup_ao_cb(void *ctx)
+{
+    mp_wakeup_core_src(ctx, MP_WAKEUP_AO);
+}
+
+void mp_wakeup_vo_cb(void *ctx)
+{
+    mp_wakeup_core_src(ctx, MP_WAKEUP_VO);
+}
+
+void mp_wakeup_filter_cb(void *ctx)
+{
+    mp_wakeup_core_src(ctx, MP_WAKEUP_FILTER);
 }
 
 // Process any queued input, whether it's user input, or requests from client
@@ -160,6 +245,8 @@ void unpause_player(struct MPContext *mpctx)
     mpctx->osd_function = 0;
     mpctx->osd_force_update = true;
 
+    backstep_cache_resync(mpctx);
+
     if (mpctx->ao && mpctx->ao_chain)
         ao_resume(mpctx->ao);
     if (mpctx->video_out)
@@ -189,12 +276,15 @@ void add_step_frame(struct MPContext *mpctx, int dir)
     if (!mpctx->vo_chain)
         return;
     if (dir > 0) {
+        if (backstep_cache_step(mpctx, 1))
+            return;
         mpctx->step_frames += 1;
         unpause_player(mpctx);
     } else if (dir < 0) {
         if (!mpctx->hrseek_active) {
-            queue_seek(mpctx, MPSEEK_BACKSTEP, 0, MPSEEK_VERY_EXACT, 0);
             pause_player(mpctx);
+            if (!backstep_cache_step(mpctx, -1))
+                queue_seek(mpctx, MPSEEK_BACKSTEP, 0, MPSEEK_VERY_EXACT, 0);
         }
     }
 }
@@ -245,6 +335,9 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
         return;
     }
 
+    if (mpctx->scrubbing)
+        seek.exact = MPSEEK_KEYFRAME;
+
     bool hr_seek_very_exact = seek.exact == MPSEEK_VERY_EXACT;
     double current_time = get_current_time(mpctx);
     if (current_time == MP_NOPTS_VALUE && seek.type == MPSEEK_RELATIVE)
@@ -277,6 +370,9 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
 
     double demux_pts = seek_pts;
 
+    if (mpctx->scrubbing)
+        mpctx->scrub_pts = seek_pts;
+
     bool hr_seek = opts->correct_pts && seek.exact != MPSEEK_KEYFRAME &&
                  ((opts->hr_seek == 0 && seek.type == MPSEEK_ABSOLUTE) ||
                   opts->hr_seek > 0 || seek.exact >= MPSEEK_EXACT) &&
@@ -405,6 +501,52 @@ void queue_seek(struct MPContext *mpctx, enum seek_type type, double amount,
     abort();
 }
 
+// Enter or leave scrub mode. Leaving it seeks precisely to the last position
+// requested while scrubbing.
+void set_scrubbing(struct MPContext *mpctx, bool scrubbing)
+{
+    if (mpctx->scrubbing == scrubbing)
+        return;
+    mpctx->scrubbing = scrubbing;
+    if (scrubbing) {
+        mpctx->scrub_pts = MP_NOPTS_VALUE;
+    } else if (mpctx->seek.type) {
+        mpctx->seek.exact = MPMAX(mpctx->seek.exact, MPSEEK_EXACT);
+    } else if (mpctx->scrub_pts != MP_NOPTS_VALUE) {
+        queue_seek(mpctx, MPSEEK_ABSOLUTE, mpctx->scrub_pts, MPSEEK_EXACT, 0);
+    }
+    mp_wakeup_core(mpctx);
+}
+
+// Whether the queued seek can be executed now in scrub mode.
+static bool scrub_seek_ready(struct MPContext *mpctx)
+{
+    if (mpctx->restart_complete || !mpctx->demuxer)
+        return true;
+    struct seek_params *seek = &mpctx->seek;
+    double pts = MP_NOPTS_VALUE;
+    double now = get_current_time(mpctx);
+    switch (seek->type) {
+    case MPSEEK_ABSOLUTE:
+        pts = seek->amount;
+        break;
+    case MPSEEK_RELATIVE:
+        if (now != MP_NOPTS_VALUE)
+            pts = now + seek->amount;
+        break;
+    case MPSEEK_FACTOR: ;
+        double len = get_time_length(mpctx);
+        if (len >= 0)
+            pts = seek->amount * len;
+        break;
+    default:
+        return true;
+    }
+    // Seeks in the packet queues are cheap; all others wait for the previous
+    // seek to show something, so that there's at most one demuxer seek running.
+    return demux_seek_is_cached(mpctx->demuxer, pts, 0);
+}
+
 void execute_queued_seek(struct MPContext *mpctx)
 {
     if (mpctx->seek.type) {
@@ -418,6 +560,8 @@ void execute_queued_seek(struct MPContext *mpctx)
         if (delay && mpctx->video_status < STATUS_PLAYING &&
             mp_time_sec() - mpctx->start_timestamp < 0.3)
             return;
+        if (mpctx->scrubbing && !scrub_seek_ready(mpctx))
+            return;
         mp_seek(mpctx, mpctx->seek);
         mpctx->seek = (struct seek_params){0};
     }
@@ -589,6 +733,87 @@ static void handle_osd_redraw(struct MPContext *mpctx)
     mp_wakeup_core(mpctx);
 }
 
+#define CACHE_SPEED_ALPHA 0.25     // weight of a new download speed sample
+#define CACHE_MIN_RESUME_SECS 1.0  // minimum buffer for resuming
+
+// Approximate inverse of the standard normal CDF, for p in [0.5, 1)
+// (Abramowitz & Stegun 26.2.23, absolute error < 4.5e-4).
+static double normal_quantile(double p)
+{
+    double t = sqrt(-2 * log(1 - p));
+    return t - (2.515517 + 0.802853 * t + 0.010328 * t * t) /
+               (1 + 1.432788 * t + 0.189269 * t * t + 0.001308 * t * t * t);
+}
+
+// The stream cache measures the download speed once per second, and only
+// while it's actually reading. Keep an exponentially weighted mean and
+// variance of these samples.
+static void update_cache_speed(struct MPContext *mpctx,
+                               struct stream_cache_info *c, double now)
+{
+    if (c->idle || c->speed < 0 || now < mpctx->cache_speed_next_sample)
+        return;
+    mpctx->cache_speed_next_sample = now + 1;
+
+    double x = c->speed;
+    if (!mpctx->cache_speed_samples) {
+        mpctx->cache_speed_avg = x;
+        mpctx->cache_speed_var = 0;
+    } else {
+        double d = x - mpctx->cache_speed_avg;
+        mpctx->cache_speed_avg += CACHE_SPEED_ALPHA * d;
+        mpctx->cache_speed_var = (1 - CACHE_SPEED_ALPHA) *
+                                 (mpctx->cache_speed_var +
+                                  CACHE_SPEED_ALPHA * d * d);
+    }
+    mpctx->cache_speed_samples++;
+}
+
+// Predict when playback stalls if it runs now, with buffered seconds of
+// readahead. The download speed is taken as its mean minus as many standard
+// deviations as --cache-pause-confidence requires, and the data rate is the
+// bitrate of the selected streams. Sets mpctx->cache_stall_estimate, and
+// returns the buffer duration needed to play to the end of the file without
+// a stall at that speed (or -1 if unknown).
+static double predict_cache_stall(struct MPContext *mpctx, double buffered)
+{
+    struct MPOpts *opts = mpctx->opts;
+    mpctx->cache_stall_estimate = -2;
+
+    double rates[STREAM_TYPE_COUNT];
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_BITRATE_STATS, rates) < 1)
+        return -1;
+    double bitrate = 0;
+    for (int n = 0; n < STREAM_TYPE_COUNT; n++)
+        bitrate += MPMAX(rates[n], 0);
+    if (bitrate <= 0 || mpctx->cache_speed_samples < 2 || buffered < 0)
+        return -1;
+
+    double z = normal_quantile(opts->cache_pause_confidence);
+    double speed = mpctx->cache_speed_avg - z * sqrt(mpctx->cache_speed_var);
+    // Media seconds downloaded and played per second.
+    double fill = MPMAX(speed, 0) / bitrate;
+    double drain = opts->playback_speed;
+
+    double remaining = INFINITY;
+    double len = get_time_length(mpctx), pos = get_current_time(mpctx);
+    if (len > 0 && pos != MP_NOPTS_VALUE)
+        remaining = MPMAX(len - pos, 0);
+
+    if (fill >= drain) {
+        mpctx->cache_stall_estimate = -1;
+        return CACHE_MIN_RESUME_SECS;
+    }
+
+    // The readahead grows by fill and shrinks by drain per second, so it runs
+    // out after buffered / (drain - fill) seconds, unless all data up to the
+    // end of the file has been downloaded before.
+    double need = remaining * (1 - fill / drain);
+    mpctx->cache_stall_estimate =
+        buffered >= need ? -1 : buffered / (drain - fill);
+    return MPMAX(need, CACHE_MIN_RESUME_SECS);
+}
+
 static void handle_pause_on_low_cache(struct MPContext *mpctx)
 {
     bool force_update = false;
@@ -607,9 +832,17 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
     int cache_buffer = 100;
 
     if (mpctx->restart_complete && c.size > 0) {
+        update_cache_speed(mpctx, &c, now);
+        double need = predict_cache_stall(mpctx, s.ts_duration);
+        // Resume only once the buffer is expected to last, instead of after
+        // the adaptive minimum time. If that is more than the demuxer reads
+        // ahead, this waits until it stops reading (s.idle).
+        bool predict = opts->cache_pause_predict && need >= 0;
+
         if (mpctx->paused && mpctx->paused_for_cache) {
+            double wait_time = predict ? need : mpctx->cache_wait_time;
             if (!s.underrun && (!opts->cache_pausing || s.idle ||
-                                s.ts_duration >= mpctx->cache_wait_time))
+                                s.ts_duration >= wait_time))
             {
                 double elapsed_time = now - mpctx->cache_stop_time;
                 if (elapsed_time > mpctx->cache_wait_time) {
@@ -635,8 +868,9 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
         }
         mpctx->cache_wait_time = MPCLAMP(mpctx->cache_wait_time, 1, 10);
         if (mpctx->paused_for_cache) {
+            double wait_time = predict ? need : mpctx->cache_wait_time;
             cache_buffer =
-                100 * MPCLAMP(s.ts_duration / mpctx->cache_wait_time, 0, 0.99);
+                100 * MPCLAMP(s.ts_duration / wait_time, 0, 0.99);
         }
     }
 
@@ -660,6 +894,10 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
             } else {
                 double t = now - mpctx->cache_stop_time;
                 MP_VERBOSE(mpctx, "End buffering (waited %f secs).\n", t);
+                if (mpctx->cache_stall_estimate >= 0) {
+                    MP_VERBOSE(mpctx, "Next stall expected in %f secs.\n",
+                               mpctx->cache_stall_estimate);
+                }
             }
         }
         mpctx->cache_buffer = cache_buffer;
@@ -881,8 +1119,11 @@ int handle_force_window(struct MPContext *mpctx, bool force)
             .osd = mpctx->osd,
             .encode_lavc_ctx = mpctx->encode_lavc_ctx,
             .opengl_cb_context = mpctx->gl_cb_ctx,
-            .wakeup_cb = mp_wakeup_core_cb,
+            .wakeup_cb = mp_wakeup_vo_cb,
             .wakeup_ctx = mpctx,
+            .frame_timing_cb = mpctx->opts->benchmark ? benchmark_vo_frame_cb
+                                                      : NULL,
+            .frame_timing_ctx = mpctx,
         };
         mpctx->video_out = init_best_video_out(mpctx->global, &ex);
         if (!mpctx->video_out)
@@ -986,6 +1227,7 @@ static void handle_playback_restart(struct MPContext *mpctx)
         mpctx->audio_allow_second_chance_seek = false;
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
+        startup_prof_done(mpctx);
         if (!mpctx->playing_msg_shown) {
             if (opts->playing_msg && opts->playing_msg[0]) {
                 char *msg =
@@ -1080,6 +1322,7 @@ void run_playloop(struct MPContext *mpctx)
     handle_vo_events(mpctx);
     handle_heartbeat_cmd(mpctx);
     handle_command_updates(mpctx);
+    playlist_probe_update(mpctx);
 
     if (mpctx->lavfi) {
         if (lavfi_process(mpctx->lavfi))
@@ -1136,6 +1379,7 @@ void mp_idle(struct MPContext *mpctx)
     mp_wait_events(mpctx);
     mp_process_input(mpctx);
     handle_command_updates(mpctx);
+    playlist_probe_update(mpctx);
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     update_osd_msg(mpctx);
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "config.h"
 
@@ -28,6 +29,7 @@
 #include "core.h"
 #include "command.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/msg.h"
 #include "options/path.h"
 #include "video/mp_image.h"
@@ -42,6 +44,10 @@
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// Maximum number of screenshots queued for encoding. Taking another one blocks
+// until the oldest has been written (matters with each-frame mode).
+#define MAX_PENDING_WRITES 4
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
 
@@ -50,8 +56,25 @@ typedef struct screenshot_ctx {
     bool osd;
 
     int frameno;
+
+    // Encodes and writes screenshots in the background. Created on first use.
+    struct mp_thread_pool *writer;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // Filenames of queued screenshots, which don't exist on disk yet.
+    // Protected by lock.
+    char **pending;
+    int num_pending;
 } screenshot_ctx;
 
+struct write_job {
+    screenshot_ctx *ctx;
+    struct mp_image *image;
+    struct image_writer_opts opts;
+    char *filename;
+};
+
 void screenshot_init(struct MPContext *mpctx)
 {
     mpctx->screenshot_ctx = talloc(mpctx, screenshot_ctx);
@@ -59,6 +82,23 @@ void screenshot_init(struct MPContext *mpctx)
         .mpctx = mpctx,
         .frameno = 1,
     };
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+    pthread_cond_init(&mpctx->screenshot_ctx->wakeup, NULL);
+}
+
+void screenshot_uninit(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    if (!ctx)
+        return;
+
+    // Waits until all queued screenshots are written.
+    talloc_free(ctx->writer);
+
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    mpctx->screenshot_ctx = NULL;
 }
 
 #define SMSG_OK 0
@@ -265,6 +305,17 @@ error_exit:
     return NULL;
 }
 
+// Whether the file is going to be created by a queued write.
+static bool is_pending(screenshot_ctx *ctx, const char *fname)
+{
+    bool res = false;
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_pending; n++)
+        res |= strcmp(ctx->pending[n], fname) == 0;
+    pthread_mutex_unlock(&ctx->lock);
+    return res;
+}
+
 static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
 {
     int sequence = 0;
@@ -294,7 +345,7 @@ static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
             talloc_free(t);
         }
 
-        if (!mp_path_exists(fname))
+        if (!mp_path_exists(fname) && !is_pending(ctx, fname))
             return fname;
 
         if (sequence == prev_sequence) {
@@ -315,6 +366,68 @@ static void add_subs(struct MPContext *mpctx, struct mp_image *image)
                       OSD_DRAW_SUB_ONLY, image);
 }
 
+// Runs on the writer thread.
+static void write_job_run(void *p)
+{
+    struct write_job *job = p;
+    screenshot_ctx *ctx = job->ctx;
+
+    // Can't touch the OSD from here, so errors only go to the log.
+    if (!write_image(job->image, &job->opts, job->filename, ctx->mpctx->log))
+        MP_ERR(ctx->mpctx, "Error writing screenshot '%s'!\n", job->filename);
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_pending; n++) {
+        if (ctx->pending[n] == job->filename) {
+            MP_TARRAY_REMOVE_AT(ctx->pending, ctx->num_pending, n);
+            break;
+        }
+    }
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+
+    talloc_free(job);
+}
+
+// Write the image on the writer thread. The image is referenced, and opts and
+// filename are copied. Falls back to writing synchronously if the thread can't
+// be created.
+static void queue_write(screenshot_ctx *ctx, struct mp_image *image,
+                        const struct image_writer_opts *opts,
+                        const char *filename)
+{
+    if (!ctx->writer)
+        ctx->writer = mp_thread_pool_create(NULL, 1);
+
+    struct write_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct write_job){
+        .ctx = ctx,
+        .image = mp_image_new_ref(image),
+        .opts = *opts,
+        .filename = talloc_strdup(job, filename),
+    };
+    // The option strings can change while the job is queued.
+    job->opts.format = talloc_strdup(job, opts->format);
+    if (!job->image) {
+        screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
+        talloc_free(job);
+        return;
+    }
+    talloc_steal(job, job->image);
+
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->num_pending >= MAX_PENDING_WRITES)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    MP_TARRAY_APPEND(ctx, ctx->pending, ctx->num_pending, job->filename);
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (ctx->writer) {
+        mp_thread_pool_queue(ctx->writer, write_job_run, job);
+    } else {
+        write_job_run(job);
+    }
+}
+
 static void screenshot_save(struct MPContext *mpctx, struct mp_image *image)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
@@ -324,8 +437,7 @@ static void screenshot_save(struct MPContext *mpctx, struct mp_image *image)
     char *filename = gen_fname(ctx, image_writer_file_ext(opts));
     if (filename) {
         screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", filename);
-        if (!write_image(image, opts, filename, mpctx->log))
-            screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
+        queue_write(ctx, image, opts, filename);
         talloc_free(filename);
     }
 }
@@ -25,11 +25,16 @@ struct MPContext;
 // One time initialization at program start.
 void screenshot_init(struct MPContext *mpctx);
 
+// Wait until all queued screenshots are written, and free the context.
+void screenshot_uninit(struct MPContext *mpctx);
+
 // Request a taking & saving a screenshot of the currently displayed frame.
 // mode: 0: -, 1: save the actual output window contents, 2: with subtitles.
 // each_frame: If set, this toggles per-frame screenshots, exactly like the
 //             screenshot slave command (MP_CMD_SCREENSHOT).
 // osd: show status on OSD
+// The image is encoded and written on a background thread. Write errors are
+// only logged.
 void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
                         bool osd);
 
@@ -27,6 +27,7 @@
 
 #include "osdep/io.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -96,14 +97,36 @@ static void *script_thread(void *p)
     return NULL;
 }
 
-static void wait_loaded(struct MPContext *mpctx)
+// Whether startup should wait until the script has initialized, so that e.g.
+// hooks it registers apply to the first file. --script-startup-wait sets the
+// default, "<name>-startup-wait" in --script-opts overrides it per script.
+static bool script_wants_wait(struct MPContext *mpctx, const char *name)
 {
-    while (!mp_clients_all_initialized(mpctx))
+    bool wait = mpctx->opts->script_startup_wait;
+    char **opts = mpctx->opts->script_opts;
+    char *key = talloc_asprintf(NULL, "%s-startup-wait", name);
+    for (int n = 0; opts && opts[n * 2 + 0]; n++) {
+        if (strcmp(opts[n * 2 + 0], key) == 0)
+            wait = strcmp(opts[n * 2 + 1], "no") != 0;
+    }
+    talloc_free(key);
+    return wait;
+}
+
+static void wait_loaded(struct MPContext *mpctx, const char *name)
+{
+    int64_t start = mp_time_us();
+    while (!mp_client_initialized(mpctx, name))
         mp_idle(mpctx);
     mp_wakeup_core(mpctx); // avoid lost wakeups during waiting
+    MP_VERBOSE(mpctx, "Waited %.1f ms for %s.\n",
+               (mp_time_us() - start) / 1e3, name);
 }
 
-int mp_load_script(struct MPContext *mpctx, const char *fname)
+// Start the script thread, and return the client name (allocated on
+// talloc_ctx), or NULL on failure.
+static char *start_script(void *talloc_ctx, struct MPContext *mpctx,
+                          const char *fname)
 {
     char *ext = mp_splitext(fname, NULL);
     const struct mp_scripting *backend = NULL;
@@ -117,7 +140,7 @@ int mp_load_script(struct MPContext *mpctx, const char *fname)
 
     if (!backend) {
         MP_VERBOSE(mpctx, "Can't load unknown script: %s\n", fname);
-        return -1;
+        return NULL;
     }
 
     struct thread_arg *arg = talloc_ptrtype(NULL, arg);
@@ -132,9 +155,11 @@ int mp_load_script(struct MPContext *mpctx, const char *fname)
     };
     if (!arg->client) {
         talloc_free(arg);
-        return -1;
+        return NULL;
     }
     arg->log = mp_client_get_log(arg->client);
+    // The thread may destroy the client at any time after it was started.
+    char *client_name = talloc_strdup(talloc_ctx, mpv_client_name(arg->client));
 
     MP_VERBOSE(arg, "Loading %s %s...\n", backend->name, fname);
 
@@ -142,15 +167,33 @@ int mp_load_script(struct MPContext *mpctx, const char *fname)
     if (pthread_create(&thread, NULL, script_thread, arg)) {
         mpv_detach_destroy(arg->client);
         talloc_free(arg);
-        return -1;
+        talloc_free(client_name);
+        return NULL;
     }
 
-    wait_loaded(mpctx);
-    MP_VERBOSE(mpctx, "Done loading %s.\n", fname);
+    return client_name;
+}
 
+// If wait is set, wait until the script has initialized if it wants to.
+static int load_script(struct MPContext *mpctx, const char *fname, bool wait)
+{
+    char *name = start_script(NULL, mpctx, fname);
+    if (!name)
+        return -1;
+    if (wait)
+        wait_loaded(mpctx, name);
+    talloc_free(name);
     return 0;
 }
 
+int mp_load_script(struct MPContext *mpctx, const char *fname)
+{
+    void *tmp = talloc_new(NULL);
+    bool wait = script_wants_wait(mpctx, script_name_from_filename(tmp, fname));
+    talloc_free(tmp);
+    return load_script(mpctx, fname, wait);
+}
+
 static int compare_filename(const void *pa, const void *pb)
 {
     char *a = (char *)pa;
@@ -212,23 +255,49 @@ void mp_load_builtin_scripts(struct MPContext *mpctx)
 
 void mp_load_scripts(struct MPContext *mpctx)
 {
-    // Load scripts from options
+    void *tmp = talloc_new(NULL);
+    char **list = NULL;
+    int num_list = 0;
+
+    // Scripts from options
     char **files = mpctx->opts->script_files;
     for (int n = 0; files && files[n]; n++) {
         if (files[n][0])
-            mp_load_script(mpctx, files[n]);
+            MP_TARRAY_APPEND(tmp, list, num_list, files[n]);
     }
-    if (!mpctx->opts->auto_load_scripts)
-        return;
 
-    // Load all scripts
-    void *tmp = talloc_new(NULL);
-    char **scriptsdir = mp_find_all_config_files(tmp, mpctx->global, "scripts");
-    for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
-        files = list_script_files(tmp, scriptsdir[i]);
-        for (int n = 0; files && files[n]; n++)
-            mp_load_script(mpctx, files[n]);
+    // Scripts from the config directories
+    if (mpctx->opts->auto_load_scripts) {
+        char **scriptsdir =
+            mp_find_all_config_files(tmp, mpctx->global, "scripts");
+        for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
+            files = list_script_files(tmp, scriptsdir[i]);
+            for (int n = 0; files && files[n]; n++)
+                MP_TARRAY_APPEND(tmp, list, num_list, files[n]);
+        }
+    }
+
+    // Scripts which don't need to be waited for are started first, so their
+    // initialization overlaps with everything else. The others are still
+    // loaded one after another, so that e.g. the order of their hooks
+    // doesn't depend on thread scheduling.
+    int64_t start = mp_time_us();
+    bool *wait = talloc_array(tmp, bool, num_list);
+    for (int n = 0; n < num_list; n++) {
+        wait[n] = script_wants_wait(mpctx,
+                                    script_name_from_filename(tmp, list[n]));
+        if (!wait[n])
+            load_script(mpctx, list[n], false);
     }
+    for (int n = 0; n < num_list; n++) {
+        if (wait[n])
+            load_script(mpctx, list[n], true);
+    }
+    if (num_list) {
+        MP_VERBOSE(mpctx, "Loading %d scripts took %.1f ms.\n", num_list,
+                   (mp_time_us() - start) / 1e3);
+    }
+
     talloc_free(tmp);
 }
 
@@ -0,0 +1,190 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Tree of the durations of the startup phases, from program start until the
+// first file started playing. Only the playback thread records phases. Work
+// done by other threads (like the VO thread compiling shaders) shows up in
+// the phase which waits for it, such as "first-frame".
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mpv_talloc.h"
+#include "startup_prof.h"
+#include "core.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/timer.h"
+
+// Bounds memory use if many files fail to load before one plays.
+#define MAX_PHASES 256
+
+struct phase {
+    const char *name;
+    int64_t start, end;     // end < 0 if still running
+    int parent;             // index into startup_prof.phases, or -1
+};
+
+struct startup_prof {
+    struct mp_log *log;
+    int64_t start;
+    int64_t done_time;      // < 0 if not done yet
+    struct phase *phases;
+    int num_phases;
+    int current;            // innermost running phase, or -1
+};
+
+void startup_prof_init(struct MPContext *mpctx)
+{
+    struct startup_prof *p = talloc_zero(mpctx, struct startup_prof);
+    mpctx->startup_prof = p;
+    p->log = mp_log_new(p, mpctx->log, "startup-prof");
+    p->start = mp_time_us();
+    p->done_time = -1;
+    p->current = -1;
+}
+
+void startup_prof_begin(struct MPContext *mpctx, const char *name)
+{
+    struct startup_prof *p = mpctx->startup_prof;
+    if (p->done_time >= 0 || p->num_phases >= MAX_PHASES)
+        return;
+    struct phase ph = {
+        .name = name,
+        .start = mp_time_us(),
+        .end = -1,
+        .parent = p->current,
+    };
+    MP_TARRAY_APPEND(p, p->phases, p->num_phases, ph);
+    p->current = p->num_phases - 1;
+}
+
+void startup_prof_end(struct MPContext *mpctx, const char *name)
+{
+    struct startup_prof *p = mpctx->startup_prof;
+    int n = p->current;
+    while (n >= 0 && strcmp(p->phases[n].name, name) != 0)
+        n = p->phases[n].parent;
+    if (n < 0)
+        return;
+    int64_t now = mp_time_us();
+    while (p->current != p->phases[n].parent) {
+        p->phases[p->current].end = now;
+        p->current = p->phases[p->current].parent;
+    }
+}
+
+static double phase_duration(struct startup_prof *p, struct phase *ph)
+{
+    int64_t end = ph->end;
+    if (end < 0)
+        end = p->done_time >= 0 ? p->done_time : mp_time_us();
+    return (end - ph->start) / 1e6;
+}
+
+static void log_phases(struct startup_prof *p, int parent, int depth)
+{
+    for (int n = 0; n < p->num_phases; n++) {
+        struct phase *ph = &p->phases[n];
+        if (ph->parent == parent) {
+            MP_VERBOSE(p, "%*s%s: %.3f ms\n", depth * 2, "", ph->name,
+                       phase_duration(p, ph) * 1e3);
+            log_phases(p, n, depth + 1);
+        }
+    }
+}
+
+void startup_prof_done(struct MPContext *mpctx)
+{
+    struct startup_prof *p = mpctx->startup_prof;
+    if (p->done_time >= 0)
+        return;
+    p->done_time = mp_time_us();
+    while (p->current >= 0) {
+        p->phases[p->current].end = p->done_time;
+        p->current = p->phases[p->current].parent;
+    }
+    MP_VERBOSE(p, "Startup took %.3f ms:\n", (p->done_time - p->start) / 1e3);
+    log_phases(p, -1, 1);
+}
+
+static void add_phases(struct startup_prof *p, struct mpv_node *list, int parent)
+{
+    for (int n = 0; n < p->num_phases; n++) {
+        struct phase *ph = &p->phases[n];
+        if (ph->parent != parent)
+            continue;
+        struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", ph->name);
+        node_map_add(e, "start", MPV_FORMAT_DOUBLE)->u.double_ =
+            (ph->start - p->start) / 1e6;
+        node_map_add(e, "duration", MPV_FORMAT_DOUBLE)->u.double_ =
+            phase_duration(p, ph);
+        struct mpv_node *sub = node_map_add(e, "phases", MPV_FORMAT_NODE_ARRAY);
+        add_phases(p, sub, n);
+    }
+}
+
+void startup_prof_get_node(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    struct startup_prof *p = mpctx->startup_prof;
+    bool done = p->done_time >= 0;
+    int64_t end = done ? p->done_time : mp_time_us();
+    node_map_add(dst, "complete", MPV_FORMAT_FLAG)->u.flag = done;
+    node_map_add(dst, "duration", MPV_FORMAT_DOUBLE)->u.double_ =
+        (end - p->start) / 1e6;
+    add_phases(p, node_map_add(dst, "phases", MPV_FORMAT_NODE_ARRAY), -1);
+}
+
+void startup_prof_write(struct MPContext *mpctx)
+{
+    struct startup_prof *p = mpctx->startup_prof;
+    char *file = mpctx->opts->startup_profile_file;
+    if (!file || !file[0])
+        return;
+
+    void *tmp = talloc_new(NULL);
+
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(tmp, root.u.list);
+    startup_prof_get_node(mpctx, &root);
+
+    char *s = talloc_strdup(tmp, "");
+    if (json_write(&s, &root) < 0) {
+        MP_ERR(p, "Could not serialize profile.\n");
+        goto done;
+    }
+
+    // One JSON object per line and run, so the file can be appended to.
+    char *path = mp_get_user_path(tmp, mpctx->global, file);
+    FILE *f = fopen(path, "a");
+    if (!f) {
+        MP_ERR(p, "Could not open '%s'.\n", path);
+        goto done;
+    }
+    fprintf(f, "%s\n", s);
+    if (fclose(f))
+        MP_ERR(p, "Error writing '%s'.\n", path);
+
+done:
+    talloc_free(tmp);
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_STARTUP_PROF_H
+#define MPLAYER_STARTUP_PROF_H
+
+struct MPContext;
+struct mpv_node;
+
+// One time initialization at program start. Times are relative to this call.
+void startup_prof_init(struct MPContext *mpctx);
+
+// Start a phase, nested into the currently running phase (if any). name must
+// be a static string. Does nothing once the profile is complete.
+void startup_prof_begin(struct MPContext *mpctx, const char *name);
+
+// End the innermost running phase with the given name, and all phases nested
+// into it. Does nothing if there is no such phase, so error paths which skip
+// the call for inner phases are fine.
+void startup_prof_end(struct MPContext *mpctx, const char *name);
+
+// Called when the first file started playing. Ends all phases and freezes the
+// profile.
+void startup_prof_done(struct MPContext *mpctx);
+
+// Write the profile as a map to dst.
+void startup_prof_get_node(struct MPContext *mpctx, struct mpv_node *dst);
+
+// Append the profile to --startup-profile-file, if set. Called on exit.
+void startup_prof_write(struct MPContext *mpctx);
+
+#endif /* MPLAYER_STARTUP_PROF_H */
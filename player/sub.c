@@ -152,8 +152,11 @@ static struct attachment_list *get_all_attachments(struct MPContext *mpctx)
             struct demux_attachment copy = {
                 .name = talloc_strdup(list, att->name),
                 .type = talloc_strdup(list, att->type),
-                .data = talloc_memdup(list, att->data, att->data_size),
+                .data = att->data ?
+                    talloc_memdup(list, att->data, att->data_size) : NULL,
                 .data_size = att->data_size,
+                .data_file = talloc_strdup(list, att->data_file),
+                .data_offset = att->data_offset,
             };
             MP_TARRAY_APPEND(list, list->entries, list->num_entries, copy);
         }
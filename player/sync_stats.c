@@ -0,0 +1,97 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Per-file distributions of A/V sync related values, for certifying sync
+// quality. Values are collected into histograms with 1 ms bins.
+
+#include "mpv_talloc.h"
+#include "sync_stats.h"
+#include "core.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/histogram.h"
+#include "misc/node.h"
+#include "options/options.h"
+#include "options/path.h"
+
+// Histogram range in ms. Values outside are counted in the first/last bin.
+#define MAX_MS 2000
+
+static const char *const stat_names[SYNC_STAT_COUNT] = {
+    [SYNC_STAT_AV_DIFF]     = "av-diff",
+    [SYNC_STAT_AO_DELAY]    = "ao-delay",
+    [SYNC_STAT_VO_DELAY]    = "vo-delay",
+};
+
+struct sync_stats {
+    struct MPContext *mpctx;
+    struct mp_log *log;
+    struct mp_histogram *hist[SYNC_STAT_COUNT];
+};
+
+void sync_stats_init(struct MPContext *mpctx)
+{
+    struct sync_stats *st = talloc_zero(mpctx, struct sync_stats);
+    st->mpctx = mpctx;
+    st->log = mp_log_new(st, mpctx->log, "sync-stats");
+    for (int n = 0; n < SYNC_STAT_COUNT; n++)
+        st->hist[n] = mp_histogram_create(st, 1e-3, -MAX_MS, 1, 2 * MAX_MS + 1);
+    mpctx->sync_stats = st;
+}
+
+void sync_stats_reset(struct MPContext *mpctx)
+{
+    struct sync_stats *st = mpctx->sync_stats;
+    for (int n = 0; n < SYNC_STAT_COUNT; n++)
+        mp_histogram_reset(st->hist[n]);
+}
+
+void sync_stats_add(struct MPContext *mpctx, enum sync_stat type, double value)
+{
+    mp_histogram_add(mpctx->sync_stats->hist[type], value);
+}
+
+void sync_stats_get_node(struct MPContext *mpctx, struct mpv_node *dst,
+                         bool histograms)
+{
+    struct sync_stats *st = mpctx->sync_stats;
+    for (int n = 0; n < SYNC_STAT_COUNT; n++) {
+        struct mpv_node *e = node_map_add(dst, stat_names[n], MPV_FORMAT_NODE_MAP);
+        mp_histogram_get_node(st->hist[n], e, histograms);
+    }
+}
+
+void sync_stats_write(struct MPContext *mpctx)
+{
+    struct sync_stats *st = mpctx->sync_stats;
+    char *file = mpctx->opts->av_sync_stats_file;
+    if (!file || !file[0] || !mpctx->filename)
+        return;
+
+    void *tmp = talloc_new(NULL);
+
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(tmp, root.u.list);
+    node_map_add_string(&root, "filename", mpctx->filename);
+    sync_stats_get_node(mpctx, &root, true);
+
+    char *path = mp_get_user_path(tmp, mpctx->global, file);
+    mp_append_json_line(st->log, path, &root);
+
+    talloc_free(tmp);
+}
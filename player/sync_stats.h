@@ -0,0 +1,50 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_SYNC_STATS_H
+#define MPLAYER_SYNC_STATS_H
+
+#include <stdbool.h>
+
+struct MPContext;
+struct mpv_node;
+
+enum sync_stat {
+    SYNC_STAT_AV_DIFF,      // A/V difference of displayed frames
+    SYNC_STAT_AO_DELAY,     // ao_get_delay()
+    SYNC_STAT_VO_DELAY,     // vo_get_delay() (display sync only)
+    SYNC_STAT_COUNT
+};
+
+// One time initialization at program start.
+void sync_stats_init(struct MPContext *mpctx);
+
+// Drop all values. Called when playback of a file starts.
+void sync_stats_reset(struct MPContext *mpctx);
+
+// Record a value (in seconds).
+void sync_stats_add(struct MPContext *mpctx, enum sync_stat type, double value);
+
+// Write the statistics of the current file as a map to dst.
+void sync_stats_get_node(struct MPContext *mpctx, struct mpv_node *dst,
+                         bool histograms);
+
+// Append the summary of the current file to --av-sync-stats-file, if set.
+// Called when playback of a file ends.
+void sync_stats_write(struct MPContext *mpctx);
+
+#endif /* MPLAYER_SYNC_STATS_H */
@@ -0,0 +1,321 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Cheap preview images for seek bars: a second demuxer and software decoder
+// on the current file, which decode only the keyframe at the requested
+// position. Neither the playback demuxer nor the VO/AO are touched.
+
+#include <math.h>
+
+#include "mpv_talloc.h"
+#include "thumbnail.h"
+#include "core.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "stream/stream.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+#include "video/decode/dec_video.h"
+
+#define DEFAULT_WIDTH 160
+#define MAX_SIZE 1024
+
+// Give up if no frame is output after this many decode steps.
+#define MAX_DECODE_STEPS 300
+
+#define CACHE_MAX_BYTES (32 * 1024 * 1024)
+
+struct thumb_entry {
+    double req_pts;         // requested timestamp
+    double pts;             // actual frame timestamp
+    int req_w, req_h;       // requested size
+    struct mp_image *img;
+    uint64_t last_use;
+};
+
+struct thumbnailer {
+    struct MPContext *mpctx;
+    struct mp_log *log;
+
+    struct demuxer *demuxer;
+    struct dec_video *d_video;
+    bool failed;            // opening failed for the current file
+
+    struct thumb_entry *entries;
+    int num_entries;
+    size_t cache_bytes;
+    uint64_t use_counter;
+};
+
+void thumbnail_init(struct MPContext *mpctx)
+{
+    mpctx->thumbnailer = talloc_ptrtype(mpctx, mpctx->thumbnailer);
+    *mpctx->thumbnailer = (struct thumbnailer){
+        .mpctx = mpctx,
+        .log = mp_log_new(mpctx, mpctx->log, "thumbnail"),
+    };
+}
+
+static size_t image_size(struct mp_image *img)
+{
+    return img->stride[0] * (size_t)img->h;
+}
+
+static void remove_entry(struct thumbnailer *t, int index)
+{
+    t->cache_bytes -= image_size(t->entries[index].img);
+    talloc_free(t->entries[index].img);
+    MP_TARRAY_REMOVE_AT(t->entries, t->num_entries, index);
+}
+
+void thumbnail_reset(struct MPContext *mpctx)
+{
+    struct thumbnailer *t = mpctx->thumbnailer;
+
+    while (t->num_entries)
+        remove_entry(t, t->num_entries - 1);
+
+    video_uninit(t->d_video);
+    t->d_video = NULL;
+    free_demuxer_and_stream(t->demuxer);
+    t->demuxer = NULL;
+    t->failed = false;
+}
+
+static struct sh_stream *find_video_stream(struct thumbnailer *t)
+{
+    struct MPContext *mpctx = t->mpctx;
+
+    // Prefer the stream played back, if it's from the main file.
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    if (track && track->demuxer == mpctx->demuxer && track->stream) {
+        struct sh_stream *sh = demux_get_stream(t->demuxer, track->stream->index);
+        if (sh && sh->type == STREAM_VIDEO && !sh->attached_picture)
+            return sh;
+    }
+
+    for (int n = 0; n < demux_get_num_stream(t->demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(t->demuxer, n);
+        if (sh->type == STREAM_VIDEO && !sh->attached_picture)
+            return sh;
+    }
+    return NULL;
+}
+
+static bool open_source(struct thumbnailer *t)
+{
+    struct MPContext *mpctx = t->mpctx;
+
+    if (t->d_video)
+        return true;
+    if (t->failed || !mpctx->demuxer || !mpctx->stream_open_filename)
+        return false;
+    t->failed = true; // don't retry for this file
+
+    if (!mpctx->demuxer->seekable) {
+        MP_ERR(t, "File is not seekable.\n");
+        return false;
+    }
+
+    struct demuxer_params params = {
+        .disable_cache = true,
+    };
+    t->demuxer = demux_open_url(mpctx->stream_open_filename, &params,
+                                mpctx->playback_abort, mpctx->global);
+    if (!t->demuxer) {
+        MP_ERR(t, "Could not open file.\n");
+        return false;
+    }
+
+    struct sh_stream *sh = find_video_stream(t);
+    if (!sh) {
+        MP_ERR(t, "No video stream.\n");
+        goto fail;
+    }
+    demuxer_select_track(t->demuxer, sh, MP_NOPTS_VALUE, true);
+
+    // No VO, no hwdec interop, no wakeup callback (and thus no decoder thread).
+    struct dec_video *d_video = talloc_zero(NULL, struct dec_video);
+    d_video->global = mpctx->global;
+    d_video->log = mp_log_new(d_video, t->log, "vd");
+    d_video->opts = mpctx->opts;
+    d_video->header = sh;
+    d_video->codec = sh->codec;
+    d_video->fps = sh->codec->fps;
+    if (!video_init_best_codec(d_video)) {
+        video_uninit(d_video);
+        goto fail;
+    }
+    t->d_video = d_video;
+
+    t->failed = false;
+    return true;
+
+fail:
+    free_demuxer_and_stream(t->demuxer);
+    t->demuxer = NULL;
+    return false;
+}
+
+static struct mp_image *decode_keyframe(struct thumbnailer *t, double pts)
+{
+    struct dec_video *d_video = t->d_video;
+
+    demux_seek(t->demuxer, pts, SEEK_BACKWARD);
+    video_reset(d_video);
+
+    for (int n = 0; n < MAX_DECODE_STEPS; n++) {
+        if (mp_cancel_test(t->mpctx->playback_abort))
+            break;
+        video_work(d_video);
+        struct mp_image *mpi = NULL;
+        int res = video_get_frame(d_video, &mpi);
+        if (res == DATA_OK)
+            return mpi;
+        if (res == DATA_EOF)
+            break;
+    }
+
+    MP_ERR(t, "Could not decode a frame at %f.\n", pts);
+    return NULL;
+}
+
+static void get_size(struct mp_image *img, int req_w, int req_h,
+                     int *out_w, int *out_h)
+{
+    int d_w, d_h;
+    mp_image_params_get_dsize(&img->params, &d_w, &d_h);
+    double aspect = d_w > 0 && d_h > 0 ? d_w / (double)d_h : 1;
+
+    int w = req_w, h = req_h;
+    if (w <= 0 && h <= 0)
+        w = DEFAULT_WIDTH;
+    if (w <= 0)
+        w = lrint(h * aspect);
+    if (h <= 0)
+        h = lrint(w / aspect);
+
+    *out_w = MPCLAMP(w, 1, MAX_SIZE);
+    *out_h = MPCLAMP(h, 1, MAX_SIZE);
+}
+
+static struct mp_image *scale_image(struct thumbnailer *t, struct mp_image *src,
+                                    int req_w, int req_h)
+{
+    if (src->fmt.flags & MP_IMGFLAG_HWACCEL) {
+        MP_ERR(t, "Decoder returned a hardware surface.\n");
+        return NULL;
+    }
+
+    int w, h;
+    get_size(src, req_w, req_h, &w, &h);
+
+    struct mp_image *dst = mp_image_alloc(IMGFMT_BGR0, w, h);
+    if (!dst) {
+        MP_ERR(t, "Out of memory.\n");
+        return NULL;
+    }
+    mp_image_copy_attributes(dst, src);
+    dst->params.p_w = dst->params.p_h = 1;
+
+    if (mp_image_swscale(dst, src, mp_sws_hq_flags) < 0) {
+        MP_ERR(t, "Error when scaling image.\n");
+        talloc_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static struct thumb_entry *find_entry(struct thumbnailer *t, bool by_req,
+                                      double pts, int req_w, int req_h)
+{
+    for (int n = 0; n < t->num_entries; n++) {
+        struct thumb_entry *e = &t->entries[n];
+        if ((by_req ? e->req_pts : e->pts) == pts &&
+            e->req_w == req_w && e->req_h == req_h)
+        {
+            e->last_use = ++t->use_counter;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void add_entry(struct thumbnailer *t, double req_pts, double pts,
+                      int req_w, int req_h, struct mp_image *img)
+{
+    size_t size = image_size(img);
+    while (t->num_entries && t->cache_bytes + size > CACHE_MAX_BYTES) {
+        int oldest = 0;
+        for (int n = 1; n < t->num_entries; n++) {
+            if (t->entries[n].last_use < t->entries[oldest].last_use)
+                oldest = n;
+        }
+        remove_entry(t, oldest);
+    }
+
+    struct thumb_entry e = {
+        .req_pts = req_pts,
+        .pts = pts,
+        .req_w = req_w,
+        .req_h = req_h,
+        .img = mp_image_new_ref(img),
+        .last_use = ++t->use_counter,
+    };
+    if (!e.img)
+        return;
+    MP_TARRAY_APPEND(t, t->entries, t->num_entries, e);
+    t->cache_bytes += size;
+}
+
+struct mp_image *thumbnail_get(struct MPContext *mpctx, double pts, int w, int h,
+                               double *out_pts)
+{
+    struct thumbnailer *t = mpctx->thumbnailer;
+
+    struct thumb_entry *e = find_entry(t, true, pts, w, h);
+    if (e) {
+        *out_pts = e->pts;
+        return mp_image_new_ref(e->img);
+    }
+
+    if (!open_source(t))
+        return NULL;
+
+    struct mp_image *frame = decode_keyframe(t, pts);
+    if (!frame)
+        return NULL;
+    double frame_pts = frame->pts;
+
+    *out_pts = frame_pts;
+
+    // Different requested positions often map to the same keyframe.
+    e = find_entry(t, false, frame_pts, w, h);
+    if (e) {
+        talloc_free(frame);
+        e->req_pts = pts;
+        return mp_image_new_ref(e->img);
+    }
+
+    struct mp_image *res = scale_image(t, frame, w, h);
+    talloc_free(frame);
+    if (res)
+        add_entry(t, pts, frame_pts, w, h, res);
+    return res;
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_THUMBNAIL_H
+#define MPLAYER_THUMBNAIL_H
+
+struct MPContext;
+
+// One time initialization at program start.
+void thumbnail_init(struct MPContext *mpctx);
+
+// Close the private demuxer/decoder and drop all cached thumbnails. Called
+// when playback of a file ends.
+void thumbnail_reset(struct MPContext *mpctx);
+
+// Decode the keyframe nearest to (at or before) pts in the current file, and
+// return it scaled to w/h as IMGFMT_BGR0. If w or h is 0, it's computed from
+// the other using the display aspect ratio. If both are 0, a default width is
+// used. *out_pts is set to the actual frame timestamp. Returns NULL on error.
+struct mp_image *thumbnail_get(struct MPContext *mpctx, double pts, int w, int h,
+                               double *out_pts);
+
+#endif /* MPLAYER_THUMBNAIL_H */
@@ -16,10 +16,12 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <inttypes.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "mpv_talloc.h"
@@ -44,10 +46,14 @@
 #include "video/out/vo.h"
 #include "audio/filter/af.h"
 #include "audio/decode/dec_audio.h"
+#include "audio/out/ao.h"
 
 #include "core.h"
 #include "command.h"
 #include "screenshot.h"
+#include "benchmark.h"
+#include "startup_prof.h"
+#include "sync_stats.h"
 
 #define VF_DEINTERLACE_LABEL "deinterlace"
 
@@ -160,6 +166,13 @@ static bool check_output_format(struct vo_chain *vo_c, int imgfmt)
     return vo_c->vf->output_params.imgfmt == imgfmt;
 }
 
+// Formats vf_mtdeint handles without inserting a conversion filter.
+static bool mtdeint_supports(int imgfmt)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+    return (desc.flags & MP_IMGFLAG_YUV_P) && (desc.flags & MP_IMGFLAG_NE);
+}
+
 static int probe_deint_filters(struct vo_chain *vo_c)
 {
     // Usually, we prefer inserting/removing deint filters. But If there's VO
@@ -189,6 +202,10 @@ static int probe_deint_filters(struct vo_chain *vo_c)
     if (check_output_format(vo_c, IMGFMT_D3D11VA) ||
         check_output_format(vo_c, IMGFMT_D3D11NV12))
         return try_filter(vo_c, "d3d11vpp", VF_DEINTERLACE_LABEL, NULL);
+    if (vo_c->vf->opts->deinterlace_filter == 1 &&
+        mtdeint_supports(vo_c->vf->output_params.imgfmt) &&
+        try_filter(vo_c, "mtdeint", VF_DEINTERLACE_LABEL, NULL) >= 0)
+        return 0;
     return try_filter(vo_c, "yadif", VF_DEINTERLACE_LABEL, NULL);
 }
 
@@ -285,7 +302,7 @@ static void recreate_video_filters(struct MPContext *mpctx)
     vf_destroy(vo_c->vf);
     vo_c->vf = vf_new(mpctx->global);
     vo_c->vf->hwdec_devs = vo_c->hwdec_devs;
-    vo_c->vf->wakeup_callback = mp_wakeup_core_cb;
+    vo_c->vf->wakeup_callback = mp_wakeup_filter_cb;
     vo_c->vf->wakeup_callback_ctx = mpctx;
     vo_c->vf->container_fps = vo_c->container_fps;
     vo_control(vo_c->vo, VOCTRL_GET_DISPLAY_FPS, &vo_c->vf->display_fps);
@@ -328,17 +345,30 @@ static void vo_chain_reset_state(struct vo_chain *vo_c)
 
     if (vo_c->video_src)
         video_reset(vo_c->video_src);
+    vo_c->drop_debt = 0;
+    vo_c->last_dropped = 0;
 
     // Prepare for continued playback after a seek.
     if (!vo_c->input_mpi && vo_c->cached_coverart)
         vo_c->input_mpi = mp_image_new_ref(vo_c->cached_coverart);
 }
 
+static void clear_backstep_cache(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_backstep_frames; n++)
+        talloc_free(mpctx->backstep_frames[n]);
+    mpctx->num_backstep_frames = 0;
+    mpctx->backstep_bytes = 0;
+    mpctx->backstep_active = false;
+}
+
 void reset_video_state(struct MPContext *mpctx)
 {
     if (mpctx->vo_chain)
         vo_chain_reset_state(mpctx->vo_chain);
 
+    clear_backstep_cache(mpctx);
+
     for (int n = 0; n < mpctx->num_next_frames; n++)
         mp_image_unrefp(&mpctx->next_frames[n]);
     mpctx->num_next_frames = 0;
@@ -360,8 +390,11 @@ void reset_video_state(struct MPContext *mpctx)
     mpctx->video_status = mpctx->vo_chain ? STATUS_SYNCING : STATUS_EOF;
 }
 
+static bool finish_vo_init(struct MPContext *mpctx);
+
 void uninit_video_out(struct MPContext *mpctx)
 {
+    finish_vo_init(mpctx);
     uninit_video_chain(mpctx);
     if (mpctx->video_out) {
         vo_destroy(mpctx->video_out);
@@ -418,12 +451,16 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track)
     d_video->header = track->stream;
     d_video->codec = track->stream->codec;
     d_video->fps = d_video->header->codec->fps;
+    d_video->wakeup_cb = mp_wakeup_demux_cb;
+    d_video->wakeup_cb_ctx = mpctx;
 
     // Note: at least mpv_opengl_cb_uninit_gl() relies on being able to get
     //       rid of all references to the VO by destroying the VO chain. Thus,
     //       decoders not linked to vo_chain must not use the hwdec context.
-    if (mpctx->vo_chain)
+    if (mpctx->vo_chain) {
         d_video->hwdec_devs = mpctx->vo_chain->hwdec_devs;
+        d_video->vo = mpctx->vo_chain->vo;
+    }
 
     MP_VERBOSE(d_video, "Container reported FPS: %f\n", d_video->fps);
 
@@ -448,6 +485,81 @@ err_out:
     return 0;
 }
 
+static struct vo_extra get_vo_extra(struct MPContext *mpctx)
+{
+    return (struct vo_extra) {
+        .input_ctx = mpctx->input,
+        .osd = mpctx->osd,
+        .encode_lavc_ctx = mpctx->encode_lavc_ctx,
+        .opengl_cb_context = mpctx->gl_cb_ctx,
+        .sw_cb_context = mpctx->sw_cb_ctx,
+        .wakeup_cb = mp_wakeup_vo_cb,
+        .wakeup_ctx = mpctx,
+        .frame_timing_cb = mpctx->opts->benchmark ? benchmark_vo_frame_cb
+                                                  : NULL,
+        .frame_timing_ctx = mpctx,
+    };
+}
+
+struct vo_init_job {
+    pthread_t thread;
+    struct mpv_global *global;
+    struct vo_extra ex;
+    struct vo *vo;              // result, valid after joining the thread
+};
+
+static void *vo_init_thread(void *p)
+{
+    struct vo_init_job *job = p;
+    job->vo = init_best_video_out(job->global, &job->ex);
+    return NULL;
+}
+
+// Create the VO on a separate thread, so that opening the window and the GPU
+// context overlaps with the rest of the file loading (like initializing the
+// audio decoder). This is only the VO probing itself; decoder initialization
+// needs the VO's hwdec devices, and happens in reinit_video_chain(), which
+// waits for the result. Does nothing if the VO already exists, or if there is
+// no video track.
+void start_vo_init(struct MPContext *mpctx)
+{
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    if (mpctx->video_out || mpctx->vo_init || !track || !track->stream)
+        return;
+
+    struct vo_init_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct vo_init_job){
+        .global = mpctx->global,
+        .ex = get_vo_extra(mpctx),
+    };
+    if (pthread_create(&job->thread, NULL, vo_init_thread, job)) {
+        talloc_free(job);
+        return; // reinit_video_chain() will do it synchronously
+    }
+    mpctx->vo_init = job;
+}
+
+// Wait for start_vo_init() to finish, and set mpctx->video_out to the result.
+// Returns false if it was started, but failed.
+static bool finish_vo_init(struct MPContext *mpctx)
+{
+    struct vo_init_job *job = mpctx->vo_init;
+    if (!job)
+        return true;
+    startup_prof_begin(mpctx, "vo-init-wait");
+    pthread_join(job->thread, NULL);
+    startup_prof_end(mpctx, "vo-init-wait");
+    mpctx->vo_init = NULL;
+    bool ok = !!job->vo;
+    if (ok) {
+        assert(!mpctx->video_out);
+        mpctx->video_out = job->vo;
+        mpctx->mouse_cursor_visible = true;
+    }
+    talloc_free(job);
+    return ok;
+}
+
 int reinit_video_chain(struct MPContext *mpctx)
 {
     return reinit_video_chain_src(mpctx, NULL);
@@ -467,16 +579,13 @@ int reinit_video_chain_src(struct MPContext *mpctx, struct lavfi_pad *src)
     }
     assert(!mpctx->vo_chain);
 
+    bool vo_ok = finish_vo_init(mpctx);
     if (!mpctx->video_out) {
-        struct vo_extra ex = {
-            .input_ctx = mpctx->input,
-            .osd = mpctx->osd,
-            .encode_lavc_ctx = mpctx->encode_lavc_ctx,
-            .opengl_cb_context = mpctx->gl_cb_ctx,
-            .wakeup_cb = mp_wakeup_core_cb,
-            .wakeup_ctx = mpctx,
-        };
-        mpctx->video_out = init_best_video_out(mpctx->global, &ex);
+        struct vo_extra ex = get_vo_extra(mpctx);
+        startup_prof_begin(mpctx, "vo-init");
+        if (vo_ok)
+            mpctx->video_out = init_best_video_out(mpctx->global, &ex);
+        startup_prof_end(mpctx, "vo-init");
         if (!mpctx->video_out) {
             MP_FATAL(mpctx, "Error opening/initializing "
                     "the selected video_out (--vo) device.\n");
@@ -560,24 +669,69 @@ void mp_force_video_refresh(struct MPContext *mpctx)
     }
 }
 
-static bool check_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
+static bool can_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
 {
-    struct MPOpts *opts = mpctx->opts;
-    // check for frame-drop:
-    if (mpctx->video_status == STATUS_PLAYING && !mpctx->paused &&
-        mpctx->audio_status == STATUS_PLAYING && !ao_untimed(mpctx->ao) &&
-        vo_c->video_src)
-    {
-        float fps = vo_c->container_fps;
-        double frame_time = fps > 0 ? 1.0 / fps : 0;
-        // we should avoid dropping too many frames in sequence unless we
-        // are too late. and we allow 100ms A-V delay here:
-        int dropped_frames =
-            vo_c->video_src->dropped_frames - mpctx->dropped_frames_start;
-        if (mpctx->last_av_difference - 0.100 > dropped_frames * frame_time)
-            return !!(opts->frame_dropping & 2);
+    return (mpctx->opts->frame_dropping & 2) &&
+           mpctx->video_status == STATUS_PLAYING && !mpctx->paused &&
+           mpctx->audio_status == STATUS_PLAYING && !ao_untimed(mpctx->ao) &&
+           vo_c->video_src && vo_c->container_fps > 0;
+}
+
+// Returns the mode for video_set_framedrop().
+static int check_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
+{
+    if (!can_framedrop(mpctx, vo_c))
+        return 0;
+    double frame_time = 1.0 / vo_c->container_fps;
+    // we should avoid dropping too many frames in sequence unless we
+    // are too late. and we allow 100ms A-V delay here:
+    int dropped_frames =
+        vo_c->video_src->dropped_frames - mpctx->dropped_frames_start;
+    if (mpctx->last_av_difference - 0.100 > dropped_frames * frame_time)
+        return 1;
+    // Drop non-reference frames before A/V sync is lost, if the predicted
+    // decoding or rendering time doesn't fit into the frame duration.
+    if (mpctx->opts->framedrop_predict && vo_c->drop_debt > 0)
+        return 3;
+    return 0;
+}
+
+// Account the result of a decode call for the framedrop prediction. Every
+// frame costs the larger of the average decoding and VO rendering times (they
+// run in different threads), and advances the playback position by its
+// duration. If the cost exceeds the duration, the difference accumulates as
+// debt, and each dropped frame pays it off by a frame duration. In a steady
+// state, this drops the fraction (cost - duration) / cost of the frames.
+static void update_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c,
+                             bool got_frame)
+{
+    struct dec_video *d_video = vo_c->video_src;
+    int dropped = d_video->dropped_frames - vo_c->last_dropped;
+    vo_c->last_dropped = d_video->dropped_frames;
+    if (dropped > 0) {
+        if (vo_c->drop_mode == 3) {
+            vo_c->drops_predicted += dropped;
+        } else {
+            vo_c->drops_late += dropped;
+        }
     }
-    return false;
+
+    if (!can_framedrop(mpctx, vo_c)) {
+        vo_c->drop_debt = 0;
+        return;
+    }
+
+    double frame_time = 1.0 / vo_c->container_fps / mpctx->video_speed;
+    if (got_frame) {
+        struct video_decode_cost cost;
+        video_get_decode_cost(d_video, &cost);
+        double frame_cost = MPMAX(cost.frame, vo_get_render_time(vo_c->vo));
+        vo_c->drop_debt += frame_cost - frame_time;
+    }
+    vo_c->drop_debt -= MPMAX(dropped, 0) * frame_time;
+    // Don't build up credit, and don't drop forever if dropping doesn't help
+    // (e.g. there are no non-reference frames); the A/V sync check remains.
+    vo_c->drop_debt = MPCLAMP(vo_c->drop_debt, -frame_time, 0.5);
 }
 
 // Read a packet, store decoded image into d_video->waiting_decoded_mpi
@@ -597,10 +751,21 @@ static int decode_image(struct MPContext *mpctx)
                       mpctx->video_status == STATUS_SYNCING;
         video_set_start(d_video, hrseek ? mpctx->hrseek_pts : MP_NOPTS_VALUE);
 
-        video_set_framedrop(d_video, check_framedrop(mpctx, vo_c));
+        vo_c->drop_mode = mpctx->scrubbing ? 4 : check_framedrop(mpctx, vo_c);
+        video_set_framedrop(d_video, vo_c->drop_mode);
 
         video_work(d_video);
         res = video_get_frame(d_video, &vo_c->input_mpi);
+        update_framedrop(mpctx, vo_c, res == DATA_OK);
+
+        if (res == DATA_OK && benchmark_active(mpctx)) {
+            // With a decoder thread, this is the time for the frame decoded
+            // while the previous one was consumed, which is the same in the
+            // steady state.
+            int64_t t = video_get_decode_time(d_video);
+            benchmark_add(mpctx, BENCH_DECODE, t - vo_c->decode_time);
+            vo_c->decode_time = t;
+        }
     }
 
     switch (res) {
@@ -666,7 +831,10 @@ static int video_filter(struct MPContext *mpctx, bool eof)
 
     // If something was decoded, and the filter chain is ready, filter it.
     if (!need_vf_reconfig && vo_c->input_mpi) {
+        int64_t start = mp_time_us();
         vf_filter_frame(vf, vo_c->input_mpi);
+        if (benchmark_active(mpctx))
+            benchmark_add(mpctx, BENCH_FILTER, mp_time_us() - start);
         vo_c->input_mpi = NULL;
         return VD_PROGRESS;
     }
@@ -833,6 +1001,124 @@ static void add_new_frame(struct MPContext *mpctx, struct mp_image *frame)
         handle_new_frame(mpctx);
 }
 
+static size_t frame_size(struct mp_image *img)
+{
+    size_t size = 0;
+    for (int n = 0; n < img->num_planes; n++)
+        size += (size_t)abs(img->stride[n]) * mp_image_plane_h(img, n);
+    return size;
+}
+
+// Remember a frame that is being sent to the VO.
+static void backstep_cache_add(struct MPContext *mpctx, struct mp_image *img)
+{
+    size_t max = (size_t)mpctx->opts->backstep_cache * 1024 * 1024;
+    // Hardware decoders allocate surfaces from fixed size pools, so keeping
+    // references to them would stall decoding.
+    if (!max || (img->fmt.flags & MP_IMGFLAG_HWACCEL) ||
+        mpctx->vo_chain->is_coverart)
+        return;
+
+    size_t size = frame_size(img);
+    if (size > max)
+        return;
+    while (mpctx->num_backstep_frames && mpctx->backstep_bytes + size > max) {
+        mpctx->backstep_bytes -= frame_size(mpctx->backstep_frames[0]);
+        talloc_free(mpctx->backstep_frames[0]);
+        MP_TARRAY_REMOVE_AT(mpctx->backstep_frames, mpctx->num_backstep_frames, 0);
+    }
+
+    struct mp_image *ref = mp_image_new_ref(img);
+    if (!ref)
+        return;
+    MP_TARRAY_APPEND(mpctx, mpctx->backstep_frames, mpctx->num_backstep_frames,
+                     ref);
+    mpctx->backstep_bytes += size;
+}
+
+// Put a cached frame on screen, without touching decoder or next_frames[].
+static bool show_backstep_frame(struct MPContext *mpctx, int pos)
+{
+    struct vo *vo = mpctx->video_out;
+    struct mp_image *img = mpctx->backstep_frames[pos];
+
+    if (!vo->params || !mp_image_params_equal(&img->params, vo->params))
+        return false;
+    vo_wait_frame(vo);
+    if (!vo_is_ready_for_frame(vo, -1))
+        return false;
+
+    struct vo_frame dummy = {
+        .pts = mp_time_us(),
+        .duration = -1,
+        .still = true,
+        .num_frames = 1,
+        .num_vsyncs = 1,
+        .frames = {img},
+    };
+    struct vo_frame *frame = vo_frame_ref(&dummy);
+
+    mpctx->backstep_active = true;
+    mpctx->backstep_pos = pos;
+    mpctx->video_pts = img->pts;
+    mpctx->last_vo_pts = img->pts;
+    mpctx->playback_pts = img->pts;
+
+    update_subtitles(mpctx, img->pts);
+    mpctx->osd_force_update = true;
+    update_osd_msg(mpctx);
+
+    vo_queue_frame(vo, frame);
+    mp_notify(mpctx, MPV_EVENT_TICK, NULL);
+    return true;
+}
+
+// Step 1 frame backward (dir<0) or forward (dir>0) using the backstep cache.
+// The player must be paused. Returns false if the frame isn't cached, and the
+// caller has to step the normal way.
+bool backstep_cache_step(struct MPContext *mpctx, int dir)
+{
+    if (!mpctx->vo_chain || !mpctx->num_backstep_frames || !mpctx->paused ||
+        mpctx->video_status < STATUS_READY || mpctx->seek.type)
+        return false;
+
+    int last = mpctx->num_backstep_frames - 1;
+    int pos = mpctx->backstep_pos;
+    if (!mpctx->backstep_active) {
+        // Forward steps continue with the decoder as usual.
+        if (dir > 0)
+            return false;
+        // The newest cached frame must be the one on screen.
+        if (mpctx->backstep_frames[last]->pts != mpctx->last_vo_pts)
+            return false;
+        pos = last;
+    }
+
+    pos += dir > 0 ? 1 : -1;
+    if (pos < 0)
+        return false;
+    if (!show_backstep_frame(mpctx, pos)) {
+        backstep_cache_resync(mpctx);
+        return false;
+    }
+
+    // Back at the frame that was on screen before the first backstep.
+    if (pos == last)
+        mpctx->backstep_active = false;
+    return true;
+}
+
+// If a cached frame is on screen, make the decoder continue from it. Called
+// before playback is resumed.
+void backstep_cache_resync(struct MPContext *mpctx)
+{
+    if (!mpctx->backstep_active)
+        return;
+    double pts = mpctx->backstep_frames[mpctx->backstep_pos]->pts;
+    mpctx->backstep_active = false;
+    queue_seek(mpctx, MPSEEK_ABSOLUTE, pts, MPSEEK_VERY_EXACT, 0);
+}
+
 // Enough video filtered already to push one frame to the VO?
 // Set eof to true if no new frames are to be expected.
 static bool have_new_frame(struct MPContext *mpctx, bool eof)
@@ -931,7 +1217,7 @@ static void update_avsync_before_frame(struct MPContext *mpctx)
         double predicted = mpctx->delay / mpctx->video_speed +
                            mpctx->time_frame;
         double difference = buffered_audio - predicted;
-        MP_STATS(mpctx, "value %f audio-diff", difference);
+        MP_STATS_VALUE(mpctx, "audio-diff", difference);
 
         if (opts->autosync) {
             /* Smooth reported playback position from AO by averaging
@@ -953,7 +1239,8 @@ static void update_avsync_before_frame(struct MPContext *mpctx)
          * If untimed is set always output frames immediately
          * without sleeping.
          */
-        if (mpctx->time_frame < -0.2 || opts->untimed || vo->driver->untimed)
+        if (mpctx->time_frame < -0.2 || opts->untimed || opts->benchmark ||
+            vo->driver->untimed)
             mpctx->time_frame = 0;
     }
 }
@@ -973,7 +1260,10 @@ static void update_av_diff(struct MPContext *mpctx, double offset)
     if (a_pos != MP_NOPTS_VALUE && mpctx->video_pts != MP_NOPTS_VALUE) {
         mpctx->last_av_difference = a_pos - mpctx->video_pts
                                   + opts->audio_delay + offset;
+        sync_stats_add(mpctx, SYNC_STAT_AV_DIFF, mpctx->last_av_difference);
     }
+    if (mpctx->ao)
+        sync_stats_add(mpctx, SYNC_STAT_AO_DELAY, ao_get_delay(mpctx->ao));
 
     if (fabs(mpctx->last_av_difference) > 0.5 && !mpctx->drop_message_shown) {
         MP_WARN(mpctx, "%s", av_desync_help_text);
@@ -1206,7 +1496,7 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
            mpctx->display_sync_error, mpctx->display_sync_error / vsync,
            mpctx->display_sync_error / frame_duration);
 
-    MP_STATS(mpctx, "value %f avdiff", av_diff);
+    MP_STATS_VALUE(mpctx, "avdiff", av_diff);
 
     // Intended number of additional display frames to drop (<0) or repeat (>0)
     int drop_repeat = 0;
@@ -1229,6 +1519,7 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
     // Estimate the video position, so we can calculate a good A/V difference
     // value below. This is used to estimate A/V drift.
     double time_left = vo_get_delay(vo);
+    sync_stats_add(mpctx, SYNC_STAT_VO_DELAY, time_left);
 
     // We also know that the timing is (necessarily) off, because we have to
     // align frame timings on the vsync boundaries. This is unavoidable, and
@@ -1245,7 +1536,7 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
 
     if (drop_repeat) {
         mpctx->mistimed_frames_total += 1;
-        MP_STATS(mpctx, "mistimed");
+        MP_STATS_SIGNAL(mpctx, "mistimed");
     }
 
     mpctx->total_avsync_change = 0;
@@ -1272,8 +1563,8 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
     mpctx->display_sync_active = true;
     update_playback_speed(mpctx);
 
-    MP_STATS(mpctx, "value %f aspeed", mpctx->speed_factor_a - 1);
-    MP_STATS(mpctx, "value %f vspeed", mpctx->speed_factor_v - 1);
+    MP_STATS_VALUE(mpctx, "aspeed", mpctx->speed_factor_a - 1);
+    MP_STATS_VALUE(mpctx, "vspeed", mpctx->speed_factor_v - 1);
 }
 
 static void schedule_frame(struct MPContext *mpctx, struct vo_frame *frame)
@@ -1346,8 +1637,8 @@ static void calculate_frame_duration(struct MPContext *mpctx)
     mpctx->past_frames[0].duration = duration;
     mpctx->past_frames[0].approx_duration = approx_duration;
 
-    MP_STATS(mpctx, "value %f frame-duration", MPMAX(0, duration));
-    MP_STATS(mpctx, "value %f frame-duration-approx", MPMAX(0, approx_duration));
+    MP_STATS_VALUE(mpctx, "frame-duration", MPMAX(0, duration));
+    MP_STATS_VALUE(mpctx, "frame-duration-approx", MPMAX(0, approx_duration));
 }
 
 void write_video(struct MPContext *mpctx)
@@ -1494,7 +1785,7 @@ void write_video(struct MPContext *mpctx)
     struct vo_frame *frame = vo_frame_ref(&dummy);
 
     double diff = mpctx->past_frames[0].approx_duration;
-    if (opts->untimed || vo->driver->untimed)
+    if (opts->untimed || opts->benchmark || vo->driver->untimed)
         diff = -1; // disable frame dropping and aspects of frame timing
     if (diff >= 0) {
         // expected A/V sync correction is ignored
@@ -1509,6 +1800,7 @@ void write_video(struct MPContext *mpctx)
     mpctx->last_frame_duration =
         mpctx->next_frames[0]->pkt_duration / mpctx->video_speed;
 
+    backstep_cache_add(mpctx, mpctx->next_frames[0]);
     shift_frames(mpctx);
 
     schedule_frame(mpctx, frame);
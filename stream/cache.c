@@ -35,6 +35,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -52,6 +53,7 @@
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 
+#include "common/mem_usage.h"
 #include "common/msg.h"
 #include "common/tags.h"
 #include "options/options.h"
@@ -67,10 +69,18 @@ struct priv {
     pthread_mutex_t mutex;
     pthread_cond_t wakeup;
 
+    // Additional connections (--cache-connections)
+    struct cache_conn *conns;
+    int num_conns;
+    pthread_cond_t conn_wakeup;
+
     // Constants (as long as cache thread is running)
     // Some of these might actually be changed by a synced cache resize.
     unsigned char *buffer;  // base pointer of the allocated buffer memory
     int64_t buffer_size;    // size of the allocated buffer memory
+    struct cache_block *blocks; // blocks[n] uses buffer[n * BLOCK_SIZE]
+    int num_blocks;         // buffer_size / BLOCK_SIZE
+    unsigned char *skip_buffer; // for reading data that is cached already
     int64_t back_size;      // keep back_size amount of old bytes for backward seek
     int64_t seek_limit;     // keep filling cache if distance is less that seek limit
     bool seekable;          // underlying stream is seekable
@@ -83,16 +93,23 @@ struct priv {
     // Owned by the cache thread
     stream_t *stream;       // "real" stream, used to read from the source media
 
+    // Set as cancel on stream (and the streams it uses), so that a read can be
+    // aborted on seeks. Triggered by cache->cancel as well.
+    struct mp_cancel *read_cancel;
+
     // All the following members are shared between the threads.
     // You must lock the mutex to access them.
 
-    // Ringbuffer
-    int64_t min_filepos;    // range of file that is cached in the buffer
-    int64_t max_filepos;    // ... max_filepos being the last read position
-    bool eof;               // true if max_filepos = EOF
-    int64_t offset;         // buffer[WRAP(s->max_filepos - offset)] corresponds
-                            // to the byte at max_filepos (must be wrapped by
-                            // buffer_size)
+    // Cached blocks, as indexes into blocks[], sorted by file position
+    int *used;
+    int num_used;
+    int64_t use_counter;    // for cache_block.last_use
+    int64_t stream_pos;     // position of the underlying stream
+    bool eof;               // true if stream_pos = EOF
+    int64_t generation;     // incremented when the cache contents are dropped
+    bool reading;           // cache thread is reading from the stream unlocked
+    struct cache_block *reading_block; // block written to by that read
+    bool read_abort;        // read_cancel was triggered to abort the read
 
     bool idle;              // cache thread has stopped reading
     int64_t reads;          // number of actual read attempts performed
@@ -120,6 +137,27 @@ struct priv {
     bool has_avseek;
 };
 
+// The cache is organized as fixed size blocks, which can cache any aligned
+// block of the file. This allows keeping multiple disjoint ranges. Blocks not
+// needed for the current readahead and backbuffer are evicted in LRU order.
+#define BLOCK_SIZE (64 * 1024)
+
+struct cache_block {
+    int64_t pos;            // file position of the block (aligned); -1 if unused
+    int start, end;         // valid data is at [pos + start, pos + end)
+    int64_t last_use;       // s->use_counter on last access
+};
+
+// With --cache-connections, each additional connection fetches CONN_CHUNK
+// sized ranges ahead of the range read by the main stream.
+#define CONN_CHUNK (16 * BLOCK_SIZE)
+
+struct cache_conn {
+    struct priv *s;
+    pthread_t thread;
+    int64_t pos;            // start of the range being fetched, or -1
+};
+
 enum {
     CACHE_CTRL_NONE = 0,
     CACHE_CTRL_QUIT = -1,
@@ -155,8 +193,11 @@ static bool cache_wakeup_and_wait(struct priv *s, double *retry_time)
 // Runs in the cache thread
 static void cache_drop_contents(struct priv *s)
 {
-    s->offset = s->min_filepos = s->max_filepos = s->read_filepos;
+    for (int n = 0; n < s->num_blocks; n++)
+        s->blocks[n] = (struct cache_block){.pos = -1};
+    s->num_used = 0;
     s->eof = false;
+    s->generation++;
     s->start_pts = MP_NOPTS_VALUE;
 }
 
@@ -170,6 +211,52 @@ static void update_speed(struct priv *s)
     }
 }
 
+// Return the index into s->used of the first block with block.pos >= pos.
+static int find_used_index(struct priv *s, int64_t pos)
+{
+    int lo = 0, hi = s->num_used;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (s->blocks[s->used[mid]].pos < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Return the block that covers the given file position, or NULL.
+static struct cache_block *find_block(struct priv *s, int64_t pos)
+{
+    int64_t bpos = pos - pos % BLOCK_SIZE;
+    int i = find_used_index(s, bpos);
+    if (i < s->num_used && s->blocks[s->used[i]].pos == bpos)
+        return &s->blocks[s->used[i]];
+    return NULL;
+}
+
+static bool block_has(struct cache_block *b, int64_t pos)
+{
+    return b && pos >= b->pos + b->start && pos < b->pos + b->end;
+}
+
+static unsigned char *block_data(struct priv *s, struct cache_block *b)
+{
+    return s->buffer + (b - s->blocks) * (int64_t)BLOCK_SIZE;
+}
+
+// Return the first position >= pos that is not cached.
+static int64_t cached_end(struct priv *s, int64_t pos)
+{
+    for (;;) {
+        struct cache_block *b = find_block(s, pos);
+        if (!block_has(b, pos))
+            return pos;
+        pos = b->pos + b->end;
+    }
+}
+
 // Copy at most dst_size from the cache at the given absolute file position pos.
 // Return number of bytes that could actually be read.
 // Does not advance the file position, or change anything else.
@@ -179,54 +266,86 @@ static size_t read_buffer(struct priv *s, unsigned char *dst,
 {
     size_t read = 0;
     while (read < dst_size) {
-        if (pos >= s->max_filepos || pos < s->min_filepos)
+        struct cache_block *b = find_block(s, pos);
+        if (!block_has(b, pos))
             break;
-        int64_t newb = s->max_filepos - pos; // new bytes in the buffer
-
-        int64_t bpos = pos - s->offset; // file pos to buffer memory pos
-        if (bpos < 0) {
-            bpos += s->buffer_size;
-        } else if (bpos >= s->buffer_size) {
-            bpos -= s->buffer_size;
-        }
-
-        if (newb > s->buffer_size - bpos)
-            newb = s->buffer_size - bpos; // handle wrap...
-
-        newb = MPMIN(newb, dst_size - read);
+        b->last_use = ++s->use_counter;
 
-        assert(newb >= 0 && read + newb <= dst_size);
-        assert(bpos >= 0 && bpos + newb <= s->buffer_size);
-        memcpy(&dst[read], &s->buffer[bpos], newb);
+        int64_t newb = MPMIN(b->pos + b->end - pos, dst_size - read);
+        memcpy(&dst[read], block_data(s, b) + (pos - b->pos), newb);
         read += newb;
         pos += newb;
     }
     return read;
 }
 
-static bool cache_update_stream_position(struct priv *s)
+// Whether the block is within the range that must be kept for the current
+// read position (backbuffer and readahead).
+static bool block_is_needed(struct priv *s, struct cache_block *b)
 {
     int64_t read = s->read_filepos;
+    return b->pos + BLOCK_SIZE > read - s->back_size &&
+           b->pos < read + (s->buffer_size - s->back_size);
+}
 
-    // drop cache contents only if seeking backward or too much fwd.
-    // This is also done for on-disk files, since it loses the backseek cache.
-    // That in turn can cause major bandwidth increase and performance
-    // issues with e.g. mov or badly interleaved files
-    if (read < s->min_filepos || read > s->max_filepos + s->seek_limit) {
-        MP_VERBOSE(s, "Dropping cache at pos %"PRId64", "
-                   "cached range: %"PRId64"-%"PRId64".\n", read,
-                   s->min_filepos, s->max_filepos);
-        cache_drop_contents(s);
+// Return a block for the aligned file position pos, by using an unused block,
+// or by evicting the least recently used one. Return NULL if all blocks are
+// needed.
+static struct cache_block *alloc_block(struct priv *s, int64_t pos)
+{
+    struct cache_block *res = NULL;
+    for (int n = 0; n < s->num_blocks; n++) {
+        struct cache_block *b = &s->blocks[n];
+        if (b == s->reading_block)
+            continue;
+        if (b->pos < 0) {
+            res = b;
+            break;
+        }
+        if (!block_is_needed(s, b) && (!res || b->last_use < res->last_use))
+            res = b;
     }
-
-    if (stream_tell(s->stream) != s->max_filepos && s->seekable) {
-        MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
-                   stream_tell(s->stream), s->max_filepos);
-        if (!stream_seek(s->stream, s->max_filepos))
-            return false;
+    if (!res)
+        return NULL;
+
+    int idx = res - s->blocks;
+    if (res->pos >= 0) {
+        int i = find_used_index(s, res->pos);
+        assert(i < s->num_used && s->used[i] == idx);
+        MP_TARRAY_REMOVE_AT(s->used, s->num_used, i);
     }
+    *res = (struct cache_block){ .pos = pos, .last_use = ++s->use_counter };
+    MP_TARRAY_INSERT_AT(s, s->used, s->num_used, find_used_index(s, pos), idx);
+    return res;
+}
+
+// Position the underlying stream such that reading from it will fill the
+// cache at the read position. Returns false if the data at the read position
+// is neither cached nor reachable.
+static bool cache_update_stream_position(struct priv *s)
+{
+    int64_t fill_pos = cached_end(s, s->read_filepos);
+
+    s->stream_pos = stream_tell(s->stream);
+    if (s->stream_pos == fill_pos)
+        return true;
+
+    // Reading continuously is better for small gaps, even if data that is
+    // already cached is skipped. With additional connections, the gap is
+    // usually data they fetched, and skipping it would defeat their purpose.
+    if (s->stream_pos < fill_pos && (!s->seekable ||
+        (fill_pos - s->stream_pos <= s->seek_limit && !s->num_conns)))
+        return true;
+
+    if (!s->seekable)
+        return fill_pos > s->read_filepos;
 
-    return stream_tell(s->stream) == s->max_filepos;
+    MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
+               s->stream_pos, fill_pos);
+    s->eof = false;
+    bool ok = stream_seek(s->stream, fill_pos);
+    s->stream_pos = stream_tell(s->stream);
+    return ok && s->stream_pos == fill_pos;
 }
 
 // Runs in the cache thread.
@@ -239,52 +358,62 @@ static void cache_fill(struct priv *s)
     if (!cache_update_stream_position(s))
         goto done;
 
-    if (!s->enable_readahead && s->read_min <= s->max_filepos)
-        goto done;
+    int64_t fill_pos = cached_end(s, read);
 
-    if (mp_cancel_test(s->cache->cancel))
+    if (!s->enable_readahead && s->read_min <= fill_pos)
         goto done;
 
-    // number of buffer bytes which should be preserved in backwards direction
-    int64_t back = MPCLAMP(read - s->min_filepos, 0, s->back_size);
-
-    // limit maximum readahead so that the backbuffer space is reserved, even
-    // if the backbuffer is not used. limit it to ensure that we don't stall the
-    // network when starting a file, or we wouldn't download new data until we
-    // get new free space again. (unless everything fits in the cache.)
-    if (s->stream_size > s->buffer_size)
-        back = MPMAX(back, s->back_size);
-
-    // number of buffer bytes that are valid and can be read
-    int64_t newb = FFMAX(s->max_filepos - read, 0);
-
-    // max. number of bytes that can be written (starting from max_filepos)
-    int64_t space = s->buffer_size - (newb + back);
-
-    // offset into the buffer that maps to max_filepos
-    int64_t pos = s->max_filepos - s->offset;
-    if (pos >= s->buffer_size)
-        pos -= s->buffer_size; // wrap-around
+    int64_t readahead = s->buffer_size - s->back_size;
+    if (fill_pos - read >= readahead || s->stream_pos - read >= readahead)
+        goto done;
 
-    if (space < FILL_LIMIT)
+    if (mp_cancel_test(s->cache->cancel))
         goto done;
 
-    // limit to end of buffer (without wrapping)
-    if (pos + space >= s->buffer_size)
-        space = s->buffer_size - pos;
+    int64_t pos = s->stream_pos;
+    struct cache_block *b = find_block(s, pos);
+    unsigned char *dst;
+    int64_t space;
+    if (block_has(b, pos)) {
+        // Already cached; the data is read only to get to fill_pos.
+        b = NULL;
+        dst = s->skip_buffer;
+        space = MPMIN(cached_end(s, pos) - pos, FILL_LIMIT);
+    } else {
+        if (!b)
+            b = alloc_block(s, pos - pos % BLOCK_SIZE);
+        if (!b)
+            goto done; // all memory is used by the needed range
+        if (pos != b->pos + b->end)
+            b->start = b->end = pos - b->pos; // drop the rest of the block
+        dst = block_data(s, b) + b->end;
+        space = BLOCK_SIZE - b->end;
+    }
 
     // limit read size (or else would block and read the entire buffer in 1 call)
     space = FFMIN(space, s->stream->read_chunk);
 
-    // back+newb+space <= buffer_size
-    int64_t back2 = s->buffer_size - (space + newb); // max back size
-    if (s->min_filepos < (read - back2))
-        s->min_filepos = read - back2;
-
     // The read call might take a long time and block, so drop the lock.
+    // Other connections must not reuse the block in the meantime.
+    s->reading = true;
+    s->reading_block = b;
     pthread_mutex_unlock(&s->mutex);
-    len = stream_read_partial(s->stream, &s->buffer[pos], space);
+    len = stream_read_partial(s->stream, dst, space);
     pthread_mutex_lock(&s->mutex);
+    s->reading = false;
+    s->reading_block = NULL;
+
+    if (s->read_abort) {
+        s->read_abort = false;
+        mp_cancel_reset(s->read_cancel);
+        // Re-link to trigger it again if cache->cancel was triggered meanwhile.
+        mp_cancel_set_parent(s->read_cancel, s->cache->cancel);
+        if (len <= 0) {
+            MP_VERBOSE(s, "Read aborted due to seek.\n");
+            s->stream_pos = stream_tell(s->stream);
+            goto done;
+        }
+    }
 
     // Do this after reading a block, because at least libdvdnav updates the
     // stream position only after actually reading something after a seek.
@@ -294,10 +423,10 @@ static void cache_fill(struct priv *s)
             s->start_pts = pts;
     }
 
-    s->max_filepos += len;
-    if (pos + len == s->buffer_size)
-        s->offset += s->buffer_size; // wrap...
-    s->speed_amount += len;
+    if (b && len > 0)
+        b->end += len;
+    s->stream_pos = stream_tell(s->stream);
+    s->speed_amount += MPMAX(len, 0);
 
     read_attempted = true;
 
@@ -316,6 +445,113 @@ done: ;
     update_speed(s);
 
     pthread_cond_signal(&s->wakeup);
+    if (s->num_conns)
+        pthread_cond_broadcast(&s->conn_wakeup);
+}
+
+// Return the start of the next range an additional connection should fetch,
+// or -1 if there is nothing to do.
+static int64_t conn_next_range(struct priv *s)
+{
+    if (!s->enable_readahead)
+        return -1;
+    int64_t end = s->read_filepos + (s->buffer_size - s->back_size);
+    if (s->stream_size >= 0)
+        end = MPMIN(end, s->stream_size);
+    // The range directly after the cached data is left to the main stream.
+    int64_t pos = cached_end(s, s->read_filepos);
+    pos = pos - pos % BLOCK_SIZE + CONN_CHUNK;
+    for (; pos < end; pos += BLOCK_SIZE) {
+        if (block_has(find_block(s, pos), pos))
+            continue;
+        bool claimed = false;
+        for (int n = 0; n < s->num_conns; n++) {
+            struct cache_conn *c = &s->conns[n];
+            claimed |= c->pos >= 0 && pos >= c->pos && pos < c->pos + CONN_CHUNK;
+        }
+        if (!claimed)
+            return pos;
+    }
+    return -1;
+}
+
+// Insert data fetched by an additional connection. Blocks that exist already
+// are left alone, because the main stream might be appending to them.
+static void conn_add_data(struct priv *s, unsigned char *data, int64_t pos,
+                          int len)
+{
+    while (len > 0) {
+        int size = MPMIN(len, BLOCK_SIZE);
+        if (!find_block(s, pos)) {
+            struct cache_block *b = alloc_block(s, pos);
+            if (!b)
+                break;
+            memcpy(block_data(s, b), data, size);
+            b->end = size;
+        }
+        data += size;
+        pos += size;
+        len -= size;
+    }
+}
+
+static void *conn_thread(void *arg)
+{
+    struct cache_conn *c = arg;
+    struct priv *s = c->s;
+    mpthread_set_name("cache-conn");
+
+    stream_t *stream = stream_create(s->stream->url, STREAM_READ,
+                                     s->cache->cancel, s->cache->global);
+    unsigned char *buf = malloc(CONN_CHUNK);
+
+    pthread_mutex_lock(&s->mutex);
+    if (!stream || !buf)
+        MP_WARN(s, "Could not open additional connection.\n");
+    while (stream && buf && s->control != CACHE_CTRL_QUIT) {
+        int64_t pos = conn_next_range(s);
+        if (pos < 0 || mp_cancel_test(s->cache->cancel)) {
+            struct timespec ts = mp_rel_time_to_timespec(CACHE_IDLE_SLEEP_TIME);
+            pthread_cond_timedwait(&s->conn_wakeup, &s->mutex, &ts);
+            continue;
+        }
+        c->pos = pos;
+        int64_t generation = s->generation;
+        pthread_mutex_unlock(&s->mutex);
+
+        int len = 0;
+        if (stream_seek(stream, pos))
+            len = stream_read(stream, buf, CONN_CHUNK);
+
+        pthread_mutex_lock(&s->mutex);
+        c->pos = -1;
+        if (len > 0 && generation == s->generation) {
+            conn_add_data(s, buf, pos, len);
+            s->speed_amount += len;
+            pthread_cond_signal(&s->wakeup);
+        }
+        if (len <= 0) {
+            // Don't retry the same range in a busy loop.
+            struct timespec ts = mp_rel_time_to_timespec(CACHE_IDLE_SLEEP_TIME);
+            pthread_cond_timedwait(&s->conn_wakeup, &s->mutex, &ts);
+        }
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    free(buf);
+    free_stream(stream);
+    return NULL;
+}
+
+struct block_prio {
+    int64_t prio;
+    int index;
+};
+
+static int compare_block_priority(const void *pa, const void *pb)
+{
+    const struct block_prio *a = pa, *b = pb;
+    return a->prio > b->prio ? -1 : (a->prio < b->prio ? 1 : 0);
 }
 
 // This is called both during init and at runtime.
@@ -337,43 +573,71 @@ static int resize_cache(struct priv *s, int64_t size)
     s->back_size = MPCLAMP(s->back_size, min_size, max_size);
     buffer_size += s->back_size;
 
+    // The cache has the lowest priority with --memory-budget.
+    int64_t limit = MPMAX(mp_mem_usage_get_limit(MP_MEM_STREAM_CACHE),
+                          min_size * 2);
+    if (buffer_size > limit) {
+        MP_WARN(s, "Reducing cache size to %lld KB due to --memory-budget.\n",
+                (long long)(limit / 1024));
+        buffer_size = limit;
+        s->back_size = MPMIN(s->back_size, buffer_size / 2);
+    }
+    // Round up to full blocks (and one more, for unaligned reads).
+    int num_blocks = MPMIN((buffer_size + BLOCK_SIZE - 1) / BLOCK_SIZE + 1,
+                           INT_MAX / BLOCK_SIZE);
+    buffer_size = num_blocks * (int64_t)BLOCK_SIZE;
+
     unsigned char *buffer = malloc(buffer_size);
-    if (!buffer)
+    struct cache_block *blocks = talloc_array(s, struct cache_block, num_blocks);
+    if (!buffer) {
+        talloc_free(blocks);
         return STREAM_ERROR;
-
-    if (s->buffer) {
-        // Copy & free the old ringbuffer data.
-        // If the buffer is too small, prefer to copy these regions:
-        // 1. Data starting from read_filepos, until cache end
-        size_t read_1 = read_buffer(s, buffer, buffer_size, s->read_filepos);
-        // 2. then data from before read_filepos until cache start
-        //    (this one needs to be copied to the end of the ringbuffer)
-        size_t read_2 = 0;
-        if (s->min_filepos < s->read_filepos) {
-            size_t copy_len = buffer_size - read_1;
-            copy_len = MPMIN(copy_len, s->read_filepos - s->min_filepos);
-            assert(copy_len + read_1 <= buffer_size);
-            read_2 = read_buffer(s, buffer + buffer_size - copy_len, copy_len,
-                                 s->read_filepos - copy_len);
-            // This shouldn't happen, unless copy_len was computed incorrectly.
-            assert(read_2 == copy_len);
-        }
-        // Set it up such that read_1 is at buffer pos 0, and read_2 wraps
-        // around below it, so that it is located at the end of the buffer.
-        s->min_filepos = s->read_filepos - read_2;
-        s->max_filepos = s->read_filepos + read_1;
-        s->offset = s->max_filepos - read_1;
-    } else {
-        cache_drop_contents(s);
     }
+    if (!s->skip_buffer)
+        s->skip_buffer = talloc_size(s, FILL_LIMIT);
+
+    for (int n = 0; n < num_blocks; n++)
+        blocks[n] = (struct cache_block){.pos = -1};
+
+    // Copy the old cache contents. If the new buffer is too small, prefer
+    // blocks needed for the current read position, then recently used ones.
+    struct block_prio *prio = talloc_array(NULL, struct block_prio,
+                                           s->num_used + 1);
+    for (int n = 0; n < s->num_used; n++) {
+        struct cache_block *b = &s->blocks[s->used[n]];
+        prio[n] = (struct block_prio){
+            .prio = block_is_needed(s, b) ? INT64_MAX : b->last_use,
+            .index = s->used[n],
+        };
+    }
+    qsort(prio, s->num_used, sizeof(prio[0]), compare_block_priority);
+    int num_used = MPMIN(s->num_used, num_blocks);
+    for (int n = 0; n < num_used; n++) {
+        blocks[n] = s->blocks[prio[n].index];
+        memcpy(buffer + n * (int64_t)BLOCK_SIZE,
+               s->buffer + prio[n].index * (int64_t)BLOCK_SIZE, BLOCK_SIZE);
+    }
+    talloc_free(prio);
 
     free(s->buffer);
+    talloc_free(s->blocks);
 
+    mp_mem_usage_add(MP_MEM_STREAM_CACHE, buffer_size - s->buffer_size);
     s->buffer_size = buffer_size;
     s->buffer = buffer;
+    s->blocks = blocks;
+    s->num_blocks = num_blocks;
     s->idle = false;
     s->eof = false;
 
+    s->num_used = 0;
+    for (int n = 0; n < num_used; n++) {
+        int i = find_used_index(s, blocks[n].pos);
+        MP_TARRAY_INSERT_AT(s, s->used, s->num_used, i, n);
+    }
+    if (!s->num_used)
+        s->start_pts = MP_NOPTS_VALUE;
+
     //make sure that we won't wait from cache_fill
     //more data than it is allowed to fill
     if (s->seek_limit > s->buffer_size - FILL_LIMIT)
@@ -388,6 +652,29 @@ static int resize_cache(struct priv *s, int64_t size)
     return STREAM_OK;
 }
 
+// Fill the ranges of cached data, merging adjacent blocks.
+static void get_cached_ranges(struct priv *s, struct stream_cache_info *info)
+{
+    info->num_ranges = 0;
+    for (int n = 0; n < s->num_used; n++) {
+        struct cache_block *b = &s->blocks[s->used[n]];
+        if (b->start == b->end)
+            continue;
+        int64_t start = b->pos + b->start, end = b->pos + b->end;
+        int i = info->num_ranges - 1;
+        if (i >= 0 && info->ranges[i].end == start) {
+            info->ranges[i].end = end;
+        } else if (info->num_ranges < STREAM_CACHE_MAX_RANGES) {
+            info->ranges[info->num_ranges++] = (struct stream_cache_range){
+                .start = start,
+                .end = end,
+            };
+        } else {
+            break;
+        }
+    }
+}
+
 static void update_cached_controls(struct priv *s)
 {
     int64_t i64;
@@ -415,10 +702,11 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     case STREAM_CTRL_GET_CACHE_INFO:
         *(struct stream_cache_info *)arg = (struct stream_cache_info) {
             .size = s->buffer_size - s->back_size,
-            .fill = s->max_filepos - s->read_filepos,
+            .fill = cached_end(s, s->read_filepos) - s->read_filepos,
             .idle = s->idle,
             .speed = llrint(s->speed),
         };
+        get_cached_ranges(s, arg);
         return STREAM_OK;
     case STREAM_CTRL_SET_READAHEAD:
         s->enable_readahead = *(int *)arg;
@@ -509,6 +797,7 @@ static void *cache_thread(void *arg)
 {
     struct priv *s = arg;
     mpthread_set_name("cache");
+    mpthread_set_role(s->cache->global, "cache");
     pthread_mutex_lock(&s->mutex);
     update_cached_controls(s);
     double last = mp_time_sec();
@@ -561,7 +850,7 @@ static int cache_fill_buffer(struct stream *cache, char *buffer, int max_len)
             s->read_filepos += readb;
             if (readb > 0)
                 break;
-            if (s->eof && s->read_filepos >= s->max_filepos && s->reads >= retry)
+            if (s->eof && s->reads >= retry)
                 break;
             s->idle = false;
             if (!cache_wakeup_and_wait(s, &retry_time))
@@ -583,17 +872,25 @@ static int cache_seek(stream_t *cache, int64_t pos)
 
     pthread_mutex_lock(&s->mutex);
 
-    MP_DBG(s, "request seek: %" PRId64 " <= to=%" PRId64
-           " (cur=%" PRId64 ") <= %" PRId64 "  \n",
-           s->min_filepos, pos, s->read_filepos, s->max_filepos);
+    MP_DBG(s, "request seek: to=%" PRId64 " (cur=%" PRId64 ", stream=%"
+           PRId64 ")\n", pos, s->read_filepos, s->stream_pos);
 
-    if (!s->seekable && pos > s->max_filepos) {
+    bool cached = block_has(find_block(s, pos), pos);
+    if (!s->seekable && !cached && pos > s->stream_pos) {
         MP_ERR(s, "Attempting to seek past cached data in unseekable stream.\n");
         r = 0;
-    } else if (!s->seekable && pos < s->min_filepos) {
-        MP_ERR(s, "Attempting to seek before cached data in unseekable stream.\n");
+    } else if (!s->seekable && !cached && pos < s->stream_pos) {
+        MP_ERR(s, "Attempting to seek outside of cached data in unseekable stream.\n");
         r = 0;
     } else {
+        // Abort an ongoing read, unless it will provide the data soon.
+        int64_t fill_pos = cached_end(s, pos);
+        if (s->reading && s->seekable && (fill_pos < s->stream_pos ||
+                                          fill_pos > s->stream_pos + s->seek_limit))
+        {
+            s->read_abort = true;
+            mp_cancel_trigger(s->read_cancel);
+        }
         cache->pos = s->read_filepos = s->read_min = pos;
         s->eof = false; // so that cache_read() will actually wait for new data
         s->control = CACHE_CTRL_SEEK;
@@ -656,12 +953,21 @@ static void cache_uninit(stream_t *cache)
         pthread_mutex_lock(&s->mutex);
         s->control = CACHE_CTRL_QUIT;
         pthread_cond_signal(&s->wakeup);
+        pthread_cond_broadcast(&s->conn_wakeup);
         pthread_mutex_unlock(&s->mutex);
+        for (int n = 0; n < s->num_conns; n++)
+            pthread_join(s->conns[n].thread, NULL);
         pthread_join(s->cache_thread, NULL);
     }
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
+    pthread_cond_destroy(&s->conn_wakeup);
+    for (stream_t *st = s->stream; st; st = st->underlying) {
+        if (st->cancel == s->read_cancel)
+            st->cancel = cache->cancel;
+    }
     free(s->buffer);
+    mp_mem_usage_add(MP_MEM_STREAM_CACHE, -s->buffer_size);
     talloc_free(s);
 }
 
@@ -695,11 +1001,19 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     pthread_mutex_init(&s->mutex, NULL);
     pthread_cond_init(&s->wakeup, NULL);
+    pthread_cond_init(&s->conn_wakeup, NULL);
 
     cache->priv = s;
     s->cache = cache;
     s->stream = stream;
 
+    s->read_cancel = mp_cancel_new(s);
+    mp_cancel_set_parent(s->read_cancel, cache->cancel);
+    for (stream_t *st = stream; st; st = st->underlying) {
+        if (st->cancel == cache->cancel)
+            st->cancel = s->read_cancel;
+    }
+
     cache->seek = cache_seek;
     cache->fill_buffer = cache_fill_buffer;
     cache->control = cache_control;
@@ -717,6 +1031,23 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     }
     s->cache_thread_running = true;
 
+    // Only useful for network streams which support range requests.
+    if (opts->connections > 1 && stream->is_network && s->seekable &&
+        s->stream_size > 0)
+    {
+        s->conns = talloc_array(s, struct cache_conn, opts->connections - 1);
+        pthread_mutex_lock(&s->mutex);
+        for (int n = 0; n < opts->connections - 1; n++) {
+            struct cache_conn *c = &s->conns[s->num_conns];
+            *c = (struct cache_conn){ .s = s, .pos = -1 };
+            if (pthread_create(&c->thread, NULL, conn_thread, c) != 0)
+                break;
+            s->num_conns++;
+        }
+        pthread_mutex_unlock(&s->mutex);
+        MP_VERBOSE(s, "Using %d connections.\n", s->num_conns + 1);
+    }
+
     // wait until cache is filled with at least min bytes
     if (min < 1)
         return 1;
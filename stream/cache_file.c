@@ -17,27 +17,50 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+
+#include <libavutil/md5.h>
 
 #include "osdep/io.h"
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/bstr.h"
 
 #include "options/options.h"
+#include "options/path.h"
 
 #include "stream.h"
 
 #define BLOCK_SIZE 1024LL
 #define BLOCK_ALIGN(p) ((p) & ~(BLOCK_SIZE - 1))
 
+// Persistent cache entries consist of <name>.data (the cache file) and
+// <name>.bits, which starts with this magic and the entry key on separate
+// lines, followed by the block_bits array.
+#define PERSISTENT_MAGIC "mpv-cache-1"
+
 struct priv {
     struct stream *original;
     FILE *cache_file;
     uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
     int64_t size;           // currently known size
     int64_t max_size;       // max. size for block_bits and cache_file
+    // For --cache-dir
+    char *bits_file;        // if not NULL, save block_bits to this on close
+    char *key;              // entry key, identifies the source stream version
+    char *name;             // entry name in persistent_in_use
 };
 
+// Names of persistent entries opened in this process. Streams reading the
+// same URL at the same time (like with --audio-file) can't share an entry.
+static pthread_mutex_t persistent_lock = PTHREAD_MUTEX_INITIALIZER;
+static char **persistent_in_use;
+static int num_persistent_in_use;
+
 static bool test_bit(struct priv *p, int64_t pos)
 {
     if (pos < 0 || pos >= p->size)
@@ -112,42 +135,240 @@ static int control(stream_t *s, int cmd, void *arg)
     return stream_control(p->original, cmd, arg);
 }
 
+static size_t block_bits_size(int64_t size)
+{
+    return (size / BLOCK_SIZE + 1) / 8 + 1;
+}
+
+static void save_block_bits(stream_t *s)
+{
+    struct priv *p = s->priv;
+    char *tmpname = talloc_asprintf(NULL, "%s.tmp", p->bits_file);
+    FILE *f = fopen(tmpname, "wb");
+    bool ok = false;
+    if (f) {
+        fprintf(f, "%s\n%s\n", PERSISTENT_MAGIC, p->key);
+        size_t len = block_bits_size(p->max_size);
+        ok = fwrite(p->block_bits, len, 1, f) == 1;
+        ok &= fclose(f) == 0;
+    }
+    if (!ok || rename(tmpname, p->bits_file) != 0) {
+        MP_WARN(s, "could not write '%s'\n", p->bits_file);
+        unlink(tmpname);
+    }
+    talloc_free(tmpname);
+}
+
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
-    if (p->cache_file)
+    if (p->cache_file) {
+        fflush(p->cache_file);
+        if (p->bits_file)
+            save_block_bits(s);
         fclose(p->cache_file);
+    }
+    if (p->name) {
+        pthread_mutex_lock(&persistent_lock);
+        for (int n = 0; n < num_persistent_in_use; n++) {
+            if (strcmp(persistent_in_use[n], p->name) == 0) {
+                talloc_free(persistent_in_use[n]);
+                MP_TARRAY_REMOVE_AT(persistent_in_use, num_persistent_in_use, n);
+                break;
+            }
+        }
+        if (!num_persistent_in_use)
+            TA_FREEP(&persistent_in_use);
+        pthread_mutex_unlock(&persistent_lock);
+    }
     talloc_free(p);
 }
 
+struct cache_entry {
+    char *name;             // without extension
+    int64_t size;           // size of the .data file
+    int64_t last_use;       // mtime of the .bits file
+};
+
+static int compare_entry_use(const void *pa, const void *pb)
+{
+    const struct cache_entry *a = pa, *b = pb;
+    return a->last_use < b->last_use ? -1 : (a->last_use > b->last_use ? 1 : 0);
+}
+
+// Remove the least recently used entries in dir, until the total size of the
+// other entries is at most max_size.
+static void prune_cache_dir(struct mp_log *log, const char *dir,
+                            int64_t max_size, const char *keep)
+{
+    void *tmp = talloc_new(NULL);
+    DIR *d = opendir(dir);
+    if (!d)
+        goto done;
+
+    struct cache_entry *entries = NULL;
+    int num_entries = 0;
+    int64_t total = 0;
+    struct dirent *ep;
+    while ((ep = readdir(d))) {
+        bstr name = bstr0(ep->d_name);
+        if (!bstr_eatend0(&name, ".data") || bstr_equals0(name, keep))
+            continue;
+        struct cache_entry e = { .name = bstrto0(tmp, name) };
+        struct stat st;
+        char *path = mp_path_join(tmp, dir, ep->d_name);
+        if (stat(path, &st) != 0)
+            continue;
+        e.size = st.st_size;
+        e.last_use = st.st_mtime;
+        path = mp_path_join(tmp, dir, talloc_asprintf(tmp, "%s.bits", e.name));
+        if (stat(path, &st) == 0)
+            e.last_use = st.st_mtime;
+        total += e.size;
+        MP_TARRAY_APPEND(tmp, entries, num_entries, e);
+    }
+    closedir(d);
+
+    qsort(entries, num_entries, sizeof(entries[0]), compare_entry_use);
+    for (int n = 0; n < num_entries && total > max_size; n++) {
+        mp_verbose(log, "removing cache entry '%s'\n", entries[n].name);
+        for (int i = 0; i < 2; i++) {
+            char *f = talloc_asprintf(tmp, "%s.%s", entries[n].name,
+                                      i ? "bits" : "data");
+            unlink(mp_path_join(tmp, dir, f));
+        }
+        total -= entries[n].size;
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+// Load the block_bits of the entry, if the entry is for the same key.
+static bool load_block_bits(struct priv *p, const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return false;
+    char *header = talloc_asprintf(NULL, "%s\n%s\n", PERSISTENT_MAGIC, p->key);
+    size_t header_len = strlen(header);
+    size_t len = block_bits_size(p->max_size);
+    char *buf = talloc_size(header, header_len + len);
+    bool ok = fread(buf, header_len + len, 1, f) == 1 &&
+              memcmp(buf, header, header_len) == 0;
+    if (ok)
+        memcpy(p->block_bits, buf + header_len, len);
+    fclose(f);
+    talloc_free(header);
+    return ok;
+}
+
+// Open the --cache-dir entry for the stream. The entry is identified by the
+// URL, the stream size and the mime type, so a changed remote file will not
+// reuse stale data.
+static FILE *open_persistent(stream_t *cache, stream_t *stream,
+                             struct mp_cache_opts *opts)
+{
+    struct priv *p = cache->priv;
+
+    int64_t size = stream_get_size(stream);
+    if (size <= 0) {
+        MP_VERBOSE(cache, "unknown stream size, not using --cache-dir\n");
+        return NULL;
+    }
+    p->max_size = MPMIN(p->max_size, size);
+    p->size = p->max_size;
+    p->key = talloc_asprintf(p, "%s\t%lld\t%s", stream->url, (long long)size,
+                             stream->mime_type ? stream->mime_type : "");
+    p->key[strcspn(p->key, "\r\n")] = '\0';
+
+    uint8_t md5[16];
+    av_md5_sum(md5, p->key, strlen(p->key));
+    char *name = talloc_strdup(p, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+
+    pthread_mutex_lock(&persistent_lock);
+    for (int n = 0; n < num_persistent_in_use; n++) {
+        if (strcmp(persistent_in_use[n], name) == 0) {
+            pthread_mutex_unlock(&persistent_lock);
+            MP_VERBOSE(cache, "cache entry in use, not using --cache-dir\n");
+            return NULL;
+        }
+    }
+    MP_TARRAY_APPEND(NULL, persistent_in_use, num_persistent_in_use,
+                     talloc_strdup(NULL, name));
+    pthread_mutex_unlock(&persistent_lock);
+    p->name = name;
+
+    char *dir = mp_get_user_path(p, cache->global, opts->dir);
+    mkdir(dir, 0700);
+
+    int64_t limit = opts->dir_max * 1024LL - p->max_size;
+    prune_cache_dir(cache->log, dir, MPMAX(limit, 0), name);
+
+    char *data = mp_path_join(p, dir, talloc_asprintf(p, "%s.data", name));
+    p->bits_file = mp_path_join(p, dir, talloc_asprintf(p, "%s.bits", name));
+
+    FILE *file = NULL;
+    if (load_block_bits(p, p->bits_file)) {
+        file = fopen(data, "rb+");
+        if (file) {
+            MP_VERBOSE(cache, "reusing cache entry '%s'\n", data);
+            return file;
+        }
+        memset(p->block_bits, 0, block_bits_size(p->max_size));
+    }
+    MP_VERBOSE(cache, "creating cache entry '%s'\n", data);
+    file = fopen(data, "wb+");
+    if (!file)
+        p->bits_file = NULL;
+    return file;
+}
+
 // return 1 on success, 0 if disabled, -1 on error
 int stream_file_cache_init(stream_t *cache, stream_t *stream,
                            struct mp_cache_opts *opts)
 {
-    if (!opts->file || !opts->file[0] || opts->file_max < 1)
+    bool use_file = opts->file && opts->file[0];
+    bool use_dir = !use_file && opts->dir && opts->dir[0] &&
+                   !stream->is_local_file;
+    if ((!use_file && !use_dir) || opts->file_max < 1)
         return 0;
 
     if (!stream->seekable) {
+        if (use_dir)
+            return 0;
         MP_ERR(cache, "can't cache unseekable stream\n");
         return -1;
     }
 
-    bool use_anon_file = strcmp(opts->file, "TMP") == 0;
-    FILE *file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
-    if (!file) {
-        MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
-        return -1;
-    }
-
     struct priv *p = talloc_zero(NULL, struct priv);
 
     cache->priv = p;
     p->original = stream;
-    p->cache_file = file;
     p->max_size = opts->file_max * 1024LL;
 
     // file_max can be INT_MAX, so this is at most about 256MB
-    p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
+    p->block_bits = talloc_zero_size(p, block_bits_size(p->max_size));
+
+    FILE *file = NULL;
+    if (use_dir) {
+        file = open_persistent(cache, stream, opts);
+        if (!file) {
+            s_close(cache);
+            return 0;
+        }
+    } else {
+        bool use_anon_file = strcmp(opts->file, "TMP") == 0;
+        file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+        if (!file) {
+            MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
+            talloc_free(p);
+            return -1;
+        }
+    }
+    p->cache_file = file;
 
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
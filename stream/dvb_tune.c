@@ -238,8 +238,22 @@ int dvb_set_ts_filt(dvb_priv_t *priv, int fd, uint16_t pid,
     return 1;
 }
 
+static int find_pmt_pid(dvb_state_t *state, int service_id)
+{
+    for (int n = 0; n < state->pat_cnt; n++) {
+        if (state->pat_service_ids[n] == service_id)
+            return state->pat_pmt_pids[n];
+    }
+    return -1;
+}
+
 int dvb_get_pmt_pid(dvb_priv_t *priv, int card, int service_id)
 {
+    dvb_state_t *state = priv->state;
+
+    if (state->pat_valid)
+        return find_pmt_pid(state, service_id);
+
     /* We need special filters on the demux,
        so open one locally, and close also here. */
     char demux_dev[32];
@@ -271,8 +285,6 @@ int dvb_get_pmt_pid(dvb_priv_t *priv, int card, int service_id)
     unsigned char buft[4096];
     unsigned char *bufptr = buft;
 
-    int pmt_pid = -1;
-
     bool pat_read = false;
     while (!pat_read) {
         if (((bytes_read =
@@ -290,23 +302,28 @@ int dvb_get_pmt_pid(dvb_priv_t *priv, int card, int service_id)
             continue;
 
         bufptr += 8;
-        section_length -= 8;
+        section_length -= 5 + 4; // remaining header, CRC
 
         /* assumes one section contains the whole pat */
         pat_read = true;
-        while (section_length > 0) {
+        state->pat_cnt = 0;
+        while (section_length >= 4 && state->pat_cnt < DVB_MAX_PAT_PROGRAMS) {
             int this_service_id = (bufptr[0] << 8) | bufptr[1];
-            if (this_service_id == service_id) {
-                pmt_pid = ((bufptr[2] & 0x1f) << 8) | bufptr[3];
-                section_length = 0;
+            // Program 0 is the network PID, not a PMT.
+            if (this_service_id) {
+                state->pat_service_ids[state->pat_cnt] = this_service_id;
+                state->pat_pmt_pids[state->pat_cnt] =
+                    ((bufptr[2] & 0x1f) << 8) | bufptr[3];
+                state->pat_cnt++;
             }
             bufptr += 4;
             section_length -= 4;
         }
+        state->pat_valid = true;
     }
     close(pat_fd);
 
-    return pmt_pid;
+    return find_pmt_pid(state, service_id);
 }
 
 int dvb_demux_stop(int fd)
@@ -60,6 +60,9 @@
 #define DMX_FILTER_SIZE 32
 #endif
 
+// A PAT section has at most 1021 bytes, with 4 bytes per program.
+#define DVB_MAX_PAT_PROGRAMS 256
+
 typedef struct {
     char *name;
     int freq, srate, diseqc, tone;
@@ -104,7 +107,14 @@ typedef struct {
     int is_on;
     int retry;
     int timeout;
-    int last_freq;
+    dvb_channel_t *tuned;   // last tuned channel (NULL if none)
+    int card_tuned;         // card the tuned channel is on
+    // Programs from the PAT of the tuned transponder (if pat_valid), so
+    // that switching between its services doesn't wait for a new PAT.
+    bool pat_valid;
+    int pat_cnt;
+    int pat_service_ids[DVB_MAX_PAT_PROGRAMS];
+    int pat_pmt_pids[DVB_MAX_PAT_PROGRAMS];
     bool switching_channel;
     bool stream_used;
 } dvb_state_t;
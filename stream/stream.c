@@ -24,6 +24,7 @@
 
 #include <strings.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include "osdep/atomic.h"
@@ -393,9 +394,15 @@ static int stream_fill_buffer_by(stream_t *s, int64_t len)
     return s->buf_len;
 }
 
+// Refill the buffer after it has been consumed. Each refill without seek in
+// between doubles the fill size, so reading many small pieces does fewer and
+// larger fill_buffer calls.
 int stream_fill_buffer(stream_t *s)
 {
-    return stream_fill_buffer_by(s, STREAM_BUFFER_SIZE);
+    int len = stream_fill_buffer_by(s, MPMAX(s->fill_size, STREAM_BUFFER_SIZE));
+    int max = MPMIN(s->read_chunk, STREAM_MAX_BUFFER_SIZE);
+    s->fill_size = MPCLAMP(s->fill_size * 2, STREAM_BUFFER_SIZE, max);
+    return len;
 }
 
 // Read between 1..buf_size bytes of data, return how much data has been read.
@@ -408,7 +415,7 @@ int stream_read_partial(stream_t *s, char *buf, int buf_size)
         s->buf_pos = s->buf_len = 0;
         // Do a direct read, but only if there's no sector alignment requirement
         // Also, small reads will be more efficient with buffering & copying
-        if (!s->sector_size && buf_size >= STREAM_BUFFER_SIZE)
+        if (!s->sector_size && buf_size >= MPMAX(s->fill_size, STREAM_BUFFER_SIZE))
             return stream_read_unbuffered(s, buf, buf_size);
         if (!stream_fill_buffer(s))
             return 0;
@@ -528,6 +535,7 @@ static bool stream_seek_unbuffered(stream_t *s, int64_t newpos)
         }
         stream_drop_buffers(s);
         s->pos = newpos;
+        s->fill_size = STREAM_BUFFER_SIZE;
     }
     return true;
 }
@@ -866,15 +874,25 @@ struct bstr stream_read_file(const char *filename, void *talloc_ctx,
     return res;
 }
 
+// Protects mp_cancel.parent/slaves of all instances.
+static pthread_mutex_t cancel_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void cancel_signal(struct mp_cancel *c);
+static void cancel_unlink(struct mp_cancel *c);
+
 #ifndef __MINGW32__
 struct mp_cancel {
     atomic_bool triggered;
     int wakeup_pipe[2];
+    struct mp_cancel *parent;
+    struct mp_cancel **slaves;
+    int num_slaves;
 };
 
 static void cancel_destroy(void *p)
 {
     struct mp_cancel *c = p;
+    cancel_unlink(c);
     close(c->wakeup_pipe[0]);
     close(c->wakeup_pipe[1]);
 }
@@ -888,8 +906,7 @@ struct mp_cancel *mp_cancel_new(void *talloc_ctx)
     return c;
 }
 
-// Request abort.
-void mp_cancel_trigger(struct mp_cancel *c)
+static void cancel_signal(struct mp_cancel *c)
 {
     atomic_store(&c->triggered, true);
     (void)write(c->wakeup_pipe[1], &(char){0}, 1);
@@ -937,11 +954,15 @@ int mp_cancel_get_fd(struct mp_cancel *c)
 struct mp_cancel {
     atomic_bool triggered;
     HANDLE event;
+    struct mp_cancel *parent;
+    struct mp_cancel **slaves;
+    int num_slaves;
 };
 
 static void cancel_destroy(void *p)
 {
     struct mp_cancel *c = p;
+    cancel_unlink(c);
     CloseHandle(c->event);
 }
 
@@ -954,7 +975,7 @@ struct mp_cancel *mp_cancel_new(void *talloc_ctx)
     return c;
 }
 
-void mp_cancel_trigger(struct mp_cancel *c)
+static void cancel_signal(struct mp_cancel *c)
 {
     atomic_store(&c->triggered, true);
     SetEvent(c->event);
@@ -989,6 +1010,61 @@ int mp_cancel_get_fd(struct mp_cancel *c)
 
 #endif
 
+static void cancel_trigger_locked(struct mp_cancel *c)
+{
+    cancel_signal(c);
+    for (int n = 0; n < c->num_slaves; n++)
+        cancel_trigger_locked(c->slaves[n]);
+}
+
+// Request abort.
+void mp_cancel_trigger(struct mp_cancel *c)
+{
+    pthread_mutex_lock(&cancel_lock);
+    cancel_trigger_locked(c);
+    pthread_mutex_unlock(&cancel_lock);
+}
+
+static void cancel_set_parent_locked(struct mp_cancel *slave,
+                                     struct mp_cancel *parent)
+{
+    struct mp_cancel *old = slave->parent;
+    if (old) {
+        for (int n = 0; n < old->num_slaves; n++) {
+            if (old->slaves[n] == slave) {
+                MP_TARRAY_REMOVE_AT(old->slaves, old->num_slaves, n);
+                break;
+            }
+        }
+    }
+    slave->parent = parent;
+    if (parent)
+        MP_TARRAY_APPEND(parent, parent->slaves, parent->num_slaves, slave);
+}
+
+static void cancel_unlink(struct mp_cancel *c)
+{
+    pthread_mutex_lock(&cancel_lock);
+    cancel_set_parent_locked(c, NULL);
+    for (int n = 0; n < c->num_slaves; n++)
+        c->slaves[n]->parent = NULL;
+    c->num_slaves = 0;
+    pthread_mutex_unlock(&cancel_lock);
+}
+
+// Make mp_cancel_trigger() on parent also trigger slave, until this is called
+// again with a different parent. parent==NULL removes the link. If parent is
+// triggered already, slave is triggered immediately.
+// Note that mp_cancel_reset() does not propagate.
+void mp_cancel_set_parent(struct mp_cancel *slave, struct mp_cancel *parent)
+{
+    pthread_mutex_lock(&cancel_lock);
+    cancel_set_parent_locked(slave, parent);
+    if (mp_cancel_test(parent))
+        cancel_trigger_locked(slave);
+    pthread_mutex_unlock(&cancel_lock);
+}
+
 char **stream_get_proto_list(void)
 {
     char **list = NULL;
@@ -51,6 +51,7 @@
 
 enum stream_ctrl {
     STREAM_CTRL_GET_SIZE = 1,
+    STREAM_CTRL_GET_MAPPING,
 
     // Cache
     STREAM_CTRL_GET_CACHE_INFO,
@@ -106,11 +107,21 @@ enum stream_ctrl {
 };
 
 // for STREAM_CTRL_GET_CACHE_INFO
+#define STREAM_CACHE_MAX_RANGES 10
+
+struct stream_cache_range {
+    int64_t start, end;                 // byte range [start, end)
+};
+
 struct stream_cache_info {
     int64_t size;
     int64_t fill;
     bool idle;
     int64_t speed;
+    // Cached byte ranges, sorted by position (only the first few if there
+    // are more than STREAM_CACHE_MAX_RANGES).
+    struct stream_cache_range ranges[STREAM_CACHE_MAX_RANGES];
+    int num_ranges;
 };
 
 struct stream_lang_req {
@@ -130,6 +141,14 @@ struct stream_dvd_info_req {
 #define TV_COLOR_SATURATION     3
 #define TV_COLOR_CONTRAST       4
 
+// for STREAM_CTRL_GET_MAPPING
+struct stream_mapping {
+    unsigned char *data;        // contents of the stream, starting at pos 0
+    int64_t size;               // number of bytes at data
+    struct AVBufferRef *buf;    // owned by the stream; av_buffer_ref() it to
+                                // keep data around
+};
+
 // for STREAM_CTRL_AVSEEK
 struct stream_avseek {
     int stream_index;
@@ -166,6 +185,7 @@ typedef struct stream {
 
     int sector_size; // sector size (seek will be aligned on this size if non 0)
     int read_chunk; // maximum amount of data to read at once to limit latency
+    int fill_size; // size of buffered reads; grows with sequential reading
     unsigned int buf_pos, buf_len;
     int64_t pos;
     int eof;
@@ -260,6 +280,7 @@ void mp_cancel_trigger(struct mp_cancel *c);
 bool mp_cancel_test(struct mp_cancel *c);
 bool mp_cancel_wait(struct mp_cancel *c, double timeout);
 void mp_cancel_reset(struct mp_cancel *c);
+void mp_cancel_set_parent(struct mp_cancel *slave, struct mp_cancel *parent);
 void *mp_cancel_get_event(struct mp_cancel *c); // win32 HANDLE
 int mp_cancel_get_fd(struct mp_cancel *c);
 
@@ -26,9 +26,13 @@
  *
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <limits.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <libbluray/bluray.h>
 #include <libbluray/meta_data.h>
@@ -36,6 +40,8 @@
 #include <libbluray/keys.h>
 #include <libbluray/bluray-version.h>
 #include <libavutil/common.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/md5.h>
 
 #include "config.h"
 #include "mpv_talloc.h"
@@ -43,6 +49,7 @@
 #include "common/msg.h"
 #include "options/m_config.h"
 #include "options/path.h"
+#include "osdep/io.h"
 #include "stream.h"
 #include "osdep/timer.h"
 #include "sub/osd.h"
@@ -72,9 +79,21 @@
 #define AACS_ERROR_MMC_FAILURE    -7 /* MMC failed */
 #define AACS_ERROR_NO_DK          -8 /* no matching device key */
 
+// Title list cache, see get_title_cache_filename().
+#define TITLE_CACHE_DIR "bluray_titles"
+#define TITLE_CACHE_MAGIC "mpvbdti1"
+#define TITLE_CACHE_HEADER_SIZE (8 + 4)
+#define TITLE_CACHE_ENTRY_SIZE (4 + 8)
+
+struct bluray_title {
+    uint32_t playlist;
+    uint64_t duration;      // in BD_TIMEBASE units
+};
+
 struct bluray_priv_s {
     BLURAY *bd;
     BLURAY_TITLE_INFO *title_info;
+    struct bluray_title *titles;
     int num_titles;
     int current_angle;
     int current_title;
@@ -99,9 +118,20 @@ inline static int play_playlist(struct bluray_priv_s *priv, int playlist)
     return bd_select_playlist(priv->bd, playlist);
 }
 
+// The titles are selected by their playlist, because libbluray's own title
+// numbers are unavailable if the title list was loaded from the cache.
 inline static int play_title(struct bluray_priv_s *priv, int title)
 {
-    return bd_select_title(priv->bd, title);
+    return bd_select_playlist(priv->bd, priv->titles[title].playlist);
+}
+
+static int find_title(struct bluray_priv_s *priv, uint32_t playlist)
+{
+    for (int n = 0; n < priv->num_titles; n++) {
+        if (priv->titles[n].playlist == playlist)
+            return n;
+    }
+    return -1;
 }
 
 static void bluray_stream_close(stream_t *s)
@@ -124,7 +154,7 @@ static void handle_event(stream_t *s, const BD_EVENT *ev)
         break;
     case BD_EVENT_PLAYLIST:
         b->current_playlist = ev->param;
-        b->current_title = bd_get_current_title(b->bd);
+        b->current_title = find_title(b, b->current_playlist);
         if (b->title_info)
             bd_free_title_info(b->title_info);
         b->title_info = bd_get_playlist_info(b->bd, b->current_playlist,
@@ -351,7 +381,7 @@ static void select_initial_title(stream_t *s, int title_guess) {
     if (b->cfg_title == BLURAY_PLAYLIST_TITLE) {
         if (!play_playlist(b, b->cfg_playlist))
             MP_WARN(s, "Couldn't start playlist '%05d'.\n", b->cfg_playlist);
-        b->current_title = bd_get_current_title(b->bd);
+        b->current_title = find_title(b, b->cfg_playlist);
     } else {
         int title = -1;
         if (b->cfg_title != BLURAY_DEFAULT_TITLE )
@@ -361,13 +391,165 @@ static void select_initial_title(stream_t *s, int title_guess) {
         if (title < 0)
             return;
 
-        if (play_title(b, title))
+        if (title < b->num_titles && play_title(b, title))
             b->current_title = title;
-        else {
+        else
             MP_WARN(s, "Couldn't start title '%d'.\n", title);
-            b->current_title = bd_get_current_title(b->bd);
+    }
+}
+
+// The cache is keyed by the MD5 of the disc's index and movie object tables,
+// so that the same disc hits the cache regardless of the drive or image path.
+static char *get_title_cache_filename(stream_t *s)
+{
+#if BLURAY_VERSION >= BLURAY_VERSION_CODE(1, 0, 0)
+    struct bluray_priv_s *b = s->priv;
+    static const char *const files[] = {
+        "BDMV/index.bdmv", "BDMV/MovieObject.bdmv",
+    };
+
+    struct AVMD5 *md5 = av_md5_alloc();
+    if (!md5)
+        return NULL;
+    av_md5_init(md5);
+    for (int n = 0; n < MP_ARRAY_SIZE(files); n++) {
+        void *data = NULL;
+        int64_t size = 0;
+        if (!bd_read_file(b->bd, files[n], &data, &size)) {
+            av_free(md5);
+            return NULL;
         }
+        av_md5_update(md5, data, size);
+        free(data);
     }
+    uint8_t sum[16];
+    av_md5_final(md5, sum);
+    av_free(md5);
+
+    void *tmp = talloc_new(NULL);
+    char *name = talloc_strdup(tmp, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", sum[i]);
+
+    char *res = NULL;
+    char *dir = mp_find_user_config_file(tmp, s->global, TITLE_CACHE_DIR);
+    if (dir)
+        res = mp_path_join(NULL, dir, name);
+    talloc_free(tmp);
+    return res;
+#else
+    return NULL;
+#endif
+}
+
+static bool load_title_cache(stream_t *s, const char *filename)
+{
+    struct bluray_priv_s *b = s->priv;
+
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return false;
+
+    uint8_t *data = NULL;
+    uint8_t hdr[TITLE_CACHE_HEADER_SIZE];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr, TITLE_CACHE_MAGIC, 8) != 0)
+        goto error;
+    uint32_t num = AV_RL32(hdr + 8);
+    if (!num || num > INT_MAX / TITLE_CACHE_ENTRY_SIZE)
+        goto error;
+
+    data = talloc_size(NULL, (size_t)num * TITLE_CACHE_ENTRY_SIZE);
+    if (fread(data, num * TITLE_CACHE_ENTRY_SIZE, 1, f) != 1)
+        goto error;
+
+    b->titles = talloc_array(b, struct bluray_title, num);
+    b->num_titles = num;
+    for (uint32_t n = 0; n < num; n++) {
+        uint8_t *e = data + n * TITLE_CACHE_ENTRY_SIZE;
+        b->titles[n] = (struct bluray_title){
+            .playlist = AV_RL32(e),
+            .duration = AV_RL64(e + 4),
+        };
+    }
+
+    MP_VERBOSE(s, "Loaded %d titles from %s\n", b->num_titles, filename);
+    talloc_free(data);
+    fclose(f);
+    return true;
+
+error:
+    MP_WARN(s, "Ignoring invalid title cache file %s\n", filename);
+    talloc_free(data);
+    fclose(f);
+    return false;
+}
+
+static void save_title_cache(stream_t *s, const char *filename)
+{
+    struct bluray_priv_s *b = s->priv;
+
+    mp_mk_config_dir(s->global, TITLE_CACHE_DIR);
+
+    size_t size = TITLE_CACHE_HEADER_SIZE +
+                  b->num_titles * TITLE_CACHE_ENTRY_SIZE;
+    uint8_t *data = talloc_size(NULL, size);
+    memcpy(data, TITLE_CACHE_MAGIC, 8);
+    AV_WL32(data + 8, b->num_titles);
+    for (int n = 0; n < b->num_titles; n++) {
+        uint8_t *e = data + TITLE_CACHE_HEADER_SIZE + n * TITLE_CACHE_ENTRY_SIZE;
+        AV_WL32(e, b->titles[n].playlist);
+        AV_WL64(e + 4, b->titles[n].duration);
+    }
+
+    // Write to a temporary file first, so that concurrent readers never see
+    // a partially written file.
+    char *tmpname = talloc_asprintf(data, "%s.tmp", filename);
+    FILE *f = fopen(tmpname, "wb");
+    if (f) {
+        bool ok = fwrite(data, size, 1, f) == 1;
+        ok &= fclose(f) == 0;
+        if (ok && rename(tmpname, filename) == 0) {
+            MP_VERBOSE(s, "Wrote %d titles to %s\n", b->num_titles, filename);
+        } else {
+            unlink(tmpname);
+        }
+    }
+    talloc_free(data);
+}
+
+// Enumerating the titles makes libbluray parse every playlist on the disc,
+// which can take very long on discs with hundreds of (obfuscation) playlists.
+// Only the playlist and duration of each title are kept; the details of the
+// playing title are loaded on demand (see BD_EVENT_PLAYLIST).
+static bool scan_titles(stream_t *s)
+{
+    struct bluray_priv_s *b = s->priv;
+
+    char *cache_file = get_title_cache_filename(s);
+    if (cache_file && load_title_cache(s, cache_file)) {
+        talloc_free(cache_file);
+        return true;
+    }
+
+    int num_titles = bd_get_titles(b->bd, TITLES_RELEVANT, 0);
+    b->titles = talloc_array(b, struct bluray_title, num_titles);
+    b->num_titles = 0;
+    for (int i = 0; i < num_titles; i++) {
+        BLURAY_TITLE_INFO *ti = bd_get_title_info(b->bd, i, 0);
+        if (!ti)
+            continue;
+        b->titles[b->num_titles++] = (struct bluray_title){
+            .playlist = ti->playlist,
+            .duration = ti->duration,
+        };
+        bd_free_title_info(ti);
+    }
+
+    if (cache_file && b->num_titles)
+        save_title_cache(s, cache_file);
+    talloc_free(cache_file);
+    return b->num_titles > 0;
 }
 
 static int bluray_stream_open_internal(stream_t *s)
@@ -407,8 +589,7 @@ static int bluray_stream_open_internal(stream_t *s)
         return STREAM_ERROR;
     } else {
         /* check for available titles on disc */
-        b->num_titles = bd_get_titles(bd, TITLES_RELEVANT, 0);
-        if (!b->num_titles) {
+        if (!scan_titles(s)) {
             MP_ERR(s, "Can't find any Blu-ray-compatible title here.\n");
             destruct(b);
             return STREAM_UNSUPPORTED;
@@ -416,25 +597,20 @@ static int bluray_stream_open_internal(stream_t *s)
 
         MP_VERBOSE(s, "List of available titles:\n");
 
-        /* parse titles information */
         uint64_t max_duration = 0;
         for (int i = 0; i < b->num_titles; i++) {
-            BLURAY_TITLE_INFO *ti = bd_get_title_info(bd, i, 0);
-            if (!ti)
-                continue;
+            struct bluray_title *t = &b->titles[i];
 
-            char *time = mp_format_time(ti->duration / 90000, false);
+            char *time = mp_format_time(t->duration / 90000, false);
             MP_VERBOSE(s, "idx: %3d duration: %s (playlist: %05d.mpls)\n",
-                       i, time, ti->playlist);
+                       i, time, (int)t->playlist);
             talloc_free(time);
 
             /* try to guess which title may contain the main movie */
-            if (ti->duration > max_duration) {
-                max_duration = ti->duration;
+            if (t->duration > max_duration) {
+                max_duration = t->duration;
                 title_guess = i;
             }
-
-            bd_free_title_info(ti);
         }
     }
 
@@ -6,6 +6,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 
 #include "osdep/io.h"
 
@@ -20,17 +21,51 @@
 
 struct priv {
     mpv_stream_cb_info info;
+    // Data lent with lend_fn
+    const char *lent;
+    int64_t lent_pos, lent_len;
+    void *lent_ctx;
+    bool has_lent;
 };
 
+static void release_lent(struct priv *p)
+{
+    if (p->has_lent)
+        p->info.release_fn(p->info.cookie, p->lent_ctx);
+    p->has_lent = false;
+    p->lent = NULL;
+    p->lent_pos = p->lent_len = 0;
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
-    return (int)p->info.read_fn(p->info.cookie, buffer, (size_t)max_len);
+    if (!p->info.lend_fn)
+        return (int)p->info.read_fn(p->info.cookie, buffer, (size_t)max_len);
+
+    if (p->lent_pos >= p->lent_len) {
+        release_lent(p);
+        const char *data = NULL;
+        void *ctx = NULL;
+        int64_t r = p->info.lend_fn(p->info.cookie, max_len, &data, &ctx);
+        if (r <= 0)
+            return (int)r;
+        p->lent = data;
+        p->lent_len = r;
+        p->lent_ctx = ctx;
+        p->has_lent = true;
+    }
+    int len = MPMIN(max_len, p->lent_len - p->lent_pos);
+    memcpy(buffer, p->lent + p->lent_pos, len);
+    p->lent_pos += len;
+    return len;
 }
 
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    if (p->info.lend_fn)
+        release_lent(p);
     return p->info.seek_fn(p->info.cookie, newpos) >= 0;
 }
 
@@ -55,6 +90,8 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    if (p->info.lend_fn)
+        release_lent(p);
     p->info.close_fn(p->info.cookie);
 }
 
@@ -81,12 +118,17 @@ static int open_cb(stream_t *stream)
         return STREAM_ERROR;
     }
 
-    if (!info.read_fn || !info.close_fn) {
+    if (!info.lend_fn != !info.release_fn) {
+        MP_FATAL(stream, "lend_fn and release_fn must be set together.\n");
+        return STREAM_ERROR;
+    }
+
+    if ((!info.read_fn && !info.lend_fn) || !info.close_fn) {
         MP_FATAL(stream, "required read_fn or close_fn callbacks not set.\n");
         return STREAM_ERROR;
     }
 
-    p->info = info;
+    *p = (struct priv){ .info = info };
 
     if (p->info.seek_fn && p->info.seek_fn(p->info.cookie, 0) >= 0) {
         stream->seek = seek;
@@ -635,12 +635,27 @@ static int dvb_streaming_read(stream_t *stream, char *buffer, int size)
 
 static void dvbin_close(stream_t *stream);
 
+// Whether tuning to b would select the same multiplex as a.
+static bool same_transponder(dvb_channel_t *a, dvb_channel_t *b)
+{
+    return a->freq == b->freq && a->pol == b->pol && a->srate == b->srate &&
+           a->diseqc == b->diseqc && a->is_dvb_s2 == b->is_dvb_s2 &&
+           a->stream_id == b->stream_id;
+}
+
+// Discard the data already buffered by the driver. The DVR device is
+// non-blocking, so this returns as soon as it is empty.
+static void dvb_drain_dvr(dvb_state_t *state)
+{
+    char buf[4096];
+    while (read(state->dvr_fd, buf, sizeof(buf)) > 0) {}
+}
+
 int dvb_set_channel(stream_t *stream, int card, int n)
 {
     dvb_channels_list *new_list;
     dvb_channel_t *channel;
     dvb_priv_t *priv = stream->priv;
-    char buf[4096];
     dvb_state_t *state = (dvb_state_t *) priv->state;
     int devno;
     int i;
@@ -665,8 +680,8 @@ int dvb_set_channel(stream_t *stream, int card, int n)
             dvb_demux_stop(state->demux_fds[i]);
 
         state->retry = 0;
-        //empty both the stream's and driver's buffer
-        while (dvb_streaming_read(stream, buf, 4096) > 0) {}
+        //empty the driver's buffer (the stream's is dropped below)
+        dvb_drain_dvr(state);
         if (state->card != card) {
             dvbin_close(stream);
             if (!dvb_open_devices(priv, devno, channel->pids_cnt)) {
@@ -674,6 +689,7 @@ int dvb_set_channel(stream_t *stream, int card, int n)
                        "CARD: %d, EXIT\n", card);
                 return 0;
             }
+            state->tuned = NULL;
         } else {
             // close all demux_fds with pos > pids required for the new channel
             // or open other demux_fds if we have too few
@@ -686,6 +702,7 @@ int dvb_set_channel(stream_t *stream, int card, int n)
                    "CARD: %d, EXIT\n", card);
             return 0;
         }
+        state->tuned = NULL;
     }
 
     state->card = card;
@@ -697,7 +714,13 @@ int dvb_set_channel(stream_t *stream, int card, int n)
 
     stream_drop_buffers(stream);
 
-    if (channel->freq != state->last_freq) {
+    // If the new channel is on the same multiplex, the frontend stays locked,
+    // and only the PID filters need to be changed.
+    if (!state->tuned || state->card_tuned != card ||
+        !same_transponder(state->tuned, channel))
+    {
+        state->tuned = NULL;
+        state->pat_valid = false;
         if (!dvb_tune(priv, channel->freq, channel->pol, channel->srate,
                       channel->diseqc, channel->tone,
                       channel->is_dvb_s2, channel->stream_id, channel->inv,
@@ -705,9 +728,12 @@ int dvb_set_channel(stream_t *stream, int card, int n)
                       channel->trans, channel->bw, channel->cr, channel->cr_lp,
                       channel->hier, priv->cfg_timeout))
             return 0;
+    } else {
+        MP_VERBOSE(stream, "DVB_SET_CHANNEL: same transponder, not retuning\n");
     }
 
-    state->last_freq = channel->freq;
+    state->tuned = channel;
+    state->card_tuned = card;
     state->is_on = 1;
 
     if (channel->service_id != -1) {
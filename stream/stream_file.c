@@ -25,18 +25,27 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #ifndef __MINGW32__
 #include <poll.h>
 #endif
 
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
+#include <libavutil/buffer.h>
+
 #include "osdep/io.h"
 
 #include "common/common.h"
 #include "common/msg.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
+#include "osdep/threads.h"
 
 #if HAVE_BSD_FSTATFS
 #include <sys/param.h>
@@ -57,12 +66,200 @@
 #endif
 #endif
 
+struct stream_file_opts {
+    int readahead;
+    int readahead_requests;
+    int mmap;
+};
+
+#define OPT_BASE_STRUCT struct stream_file_opts
+const struct m_sub_options stream_file_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_INTRANGE("stream-file-readahead", readahead, 0, 0, 1024 * 1024),
+        OPT_INTRANGE("stream-file-readahead-requests", readahead_requests,
+                     0, 1, 64),
+        OPT_FLAG("stream-file-mmap", mmap, 0),
+        {0}
+    },
+    .size = sizeof(struct stream_file_opts),
+    .defaults = &(const struct stream_file_opts){
+        .readahead_requests = 4,
+    },
+};
+#undef OPT_BASE_STRUCT
+
+// Background readahead (--stream-file-readahead). A thread keeps the OS page
+// cache filled ahead of the read position, so that the reads done by the
+// demuxer don't block on a slow disk or network filesystem.
+struct readahead {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int fd;
+    unsigned char *map;     // file mapping, or NULL
+    int64_t map_size;
+    int64_t chunk;          // size of a single readahead request
+    int requests;           // number of requests ahead of pos
+    // Protected by lock
+    int64_t pos;            // current read position of the stream
+    int64_t next;           // start of the next readahead request
+    bool quit;
+};
+
 struct priv {
     int fd;
     bool close;
     bool use_poll;
+    struct readahead *ra;
+    struct stream_mapping map;  // --stream-file-mmap (map.buf is NULL if off)
 };
 
+static void readahead_request(struct readahead *ra, int64_t pos, char *buf)
+{
+#if HAVE_POSIX
+    if (ra->map) {
+        // Fault in the mapped pages, instead of only filling the page cache.
+        long page = sysconf(_SC_PAGESIZE);
+        int64_t start = pos / page * page;
+        int64_t end = MPMIN(pos + ra->chunk, ra->map_size);
+        if (start < end)
+            madvise(ra->map + start, end - start, MADV_WILLNEED);
+        return;
+    }
+#endif
+#if HAVE_POSIX_FADVISE
+    posix_fadvise(ra->fd, pos, ra->chunk, POSIX_FADV_WILLNEED);
+#elif !defined(__MINGW32__)
+    // Read the data into a dummy buffer to make the OS cache it.
+    pread(ra->fd, buf, ra->chunk, pos);
+#endif
+}
+
+static void *readahead_thread(void *arg)
+{
+    struct readahead *ra = arg;
+    mpthread_set_name("file-readahead");
+    char *buf = HAVE_POSIX_FADVISE || ra->map ? NULL : malloc(ra->chunk);
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->quit) {
+        int64_t end = ra->pos + ra->chunk * ra->requests;
+        // Restart from the read position after seeks.
+        if (ra->next < ra->pos || ra->next > end)
+            ra->next = ra->pos;
+        if (ra->next >= end) {
+            pthread_cond_wait(&ra->wakeup, &ra->lock);
+            continue;
+        }
+        int64_t pos = ra->next;
+        ra->next += ra->chunk;
+        pthread_mutex_unlock(&ra->lock);
+        if (HAVE_POSIX_FADVISE || ra->map || buf)
+            readahead_request(ra, pos, buf);
+        pthread_mutex_lock(&ra->lock);
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    free(buf);
+    return NULL;
+}
+
+static void readahead_update(struct readahead *ra, int64_t pos)
+{
+    if (!ra)
+        return;
+    pthread_mutex_lock(&ra->lock);
+    ra->pos = pos;
+    pthread_cond_signal(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+static void readahead_destroy(struct readahead *ra)
+{
+    if (!ra)
+        return;
+    pthread_mutex_lock(&ra->lock);
+    ra->quit = true;
+    pthread_cond_signal(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+    pthread_cond_destroy(&ra->wakeup);
+    pthread_mutex_destroy(&ra->lock);
+    talloc_free(ra);
+}
+
+static struct readahead *readahead_create(stream_t *s, int fd,
+                                          struct stream_mapping *map)
+{
+#if !HAVE_POSIX_FADVISE && defined(__MINGW32__)
+    return NULL;
+#endif
+    struct stream_file_opts *opts =
+        mp_get_config_group(NULL, s->global, &stream_file_conf);
+    struct readahead *ra = NULL;
+    if (opts->readahead < 1)
+        goto done;
+
+    ra = talloc_ptrtype(NULL, ra);
+    *ra = (struct readahead){
+        .fd = fd,
+        .map = map->data,
+        .map_size = map->size,
+        .chunk = opts->readahead * 1024LL,
+        .requests = opts->readahead_requests,
+    };
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->wakeup, NULL);
+#if HAVE_POSIX_FADVISE
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (pthread_create(&ra->thread, NULL, readahead_thread, ra)) {
+        pthread_cond_destroy(&ra->wakeup);
+        pthread_mutex_destroy(&ra->lock);
+        TA_FREEP(&ra);
+    }
+done:
+    talloc_free(opts);
+    return ra;
+}
+
+#if HAVE_POSIX
+static void unmap_file(void *opaque, uint8_t *data)
+{
+    struct stream_mapping *map = opaque;
+    munmap(map->data, map->size);
+    talloc_free(map);
+}
+
+// Map the whole file, so that demuxers can reference the file data directly
+// from packets (see STREAM_CTRL_GET_MAPPING). The mapping is private and
+// writable, so that writes to packet data (which shouldn't happen) can't
+// change the file. It lives until the last packet referencing it is freed.
+static void map_file(stream_t *s, struct priv *p, int64_t size)
+{
+    if (size <= 0 || size > SIZE_MAX || s->streaming)
+        return;
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, p->fd, 0);
+    if (data == MAP_FAILED) {
+        MP_VERBOSE(s, "mmap() failed: %s\n", mp_strerror(errno));
+        return;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    struct stream_mapping *map = talloc_ptrtype(NULL, map);
+    *map = (struct stream_mapping){.data = data, .size = size};
+    p->map = *map;
+    p->map.buf = av_buffer_create(data, size, unmap_file, map,
+                                  AV_BUFFER_FLAG_READONLY);
+    if (!p->map.buf) {
+        munmap(data, size);
+        talloc_free(map);
+        p->map = (struct stream_mapping){0};
+        return;
+    }
+    MP_VERBOSE(s, "Mapped %"PRId64" bytes.\n", size);
+}
+#endif
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
@@ -79,6 +276,8 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     }
 #endif
     int r = read(p->fd, buffer, max_len);
+    if (r > 0)
+        readahead_update(p->ra, s->pos + r);
     return (r <= 0) ? -1 : r;
 }
 
@@ -100,7 +299,10 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
-    return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
+    if (lseek(p->fd, newpos, SEEK_SET) == (off_t)-1)
+        return 0;
+    readahead_update(p->ra, newpos);
+    return 1;
 }
 
 static int control(stream_t *s, int cmd, void *arg)
@@ -116,6 +318,11 @@ static int control(stream_t *s, int cmd, void *arg)
         }
         break;
     }
+    case STREAM_CTRL_GET_MAPPING:
+        if (!p->map.buf)
+            break;
+        *(struct stream_mapping *)arg = p->map;
+        return STREAM_OK;
     }
     return STREAM_UNSUPPORTED;
 }
@@ -123,6 +330,8 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    readahead_destroy(p->ra);
+    av_buffer_unref(&p->map.buf);
     if (p->close && p->fd >= 0)
         close(p->fd);
 }
@@ -293,6 +502,16 @@ static int open_f(stream_t *stream)
                 fcntl(p->fd, F_SETFL, val);
             }
 #endif
+            if (S_ISREG(st.st_mode) && !write) {
+#if HAVE_POSIX
+                struct stream_file_opts *opts =
+                    mp_get_config_group(NULL, stream->global, &stream_file_conf);
+                if (opts->mmap && !check_stream_network(p->fd))
+                    map_file(stream, p, st.st_size);
+                talloc_free(opts);
+#endif
+                p->ra = readahead_create(stream, p->fd, &p->map);
+            }
         }
         p->close = true;
     }
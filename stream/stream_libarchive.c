@@ -303,11 +303,31 @@ bool mp_archive_next_entry(struct mp_archive *mpa)
     return false;
 }
 
+// libarchive can seek within the data of only a few formats. Otherwise,
+// seeking backwards requires decompressing the entry from the start again.
+// To make this cheaper, archive readers that were already positioned further
+// into the entry are kept open on seeks as checkpoints, and a seek continues
+// from the nearest checkpoint before the target.
+#define MAX_CHECKPOINTS 3
+// Readers not further into the entry than this are not kept.
+#define MIN_CHECKPOINT_POS (1024 * 1024)
+
+struct checkpoint {
+    struct mp_archive *mpa;
+    struct stream *src;
+    int64_t pos;            // position within the entry
+    int64_t last_use;
+};
+
 struct priv {
     struct mp_archive *mpa;
     struct stream *src;
     int64_t entry_size;
     char *entry_name;
+    char *base;             // URL of the archive
+    struct checkpoint checkpoints[MAX_CHECKPOINTS];
+    int num_checkpoints;
+    int64_t use_counter;
 };
 
 static int reopen_archive(stream_t *s)
@@ -346,6 +366,69 @@ static int archive_entry_fill_buffer(stream_t *s, char *buffer, int max_len)
     return r;
 }
 
+static void free_checkpoint(struct checkpoint *cp)
+{
+    mp_archive_free(cp->mpa);
+    free_stream(cp->src);
+    *cp = (struct checkpoint){0};
+}
+
+// Keep the current reader as checkpoint, replacing the least recently used
+// one if necessary.
+static void park_reader(stream_t *s)
+{
+    struct priv *p = s->priv;
+    if (s->pos < MIN_CHECKPOINT_POS) {
+        mp_archive_free(p->mpa);
+        free_stream(p->src);
+    } else {
+        struct checkpoint *cp = NULL;
+        if (p->num_checkpoints < MAX_CHECKPOINTS) {
+            cp = &p->checkpoints[p->num_checkpoints++];
+        } else {
+            cp = &p->checkpoints[0];
+            for (int n = 1; n < p->num_checkpoints; n++) {
+                if (p->checkpoints[n].last_use < cp->last_use)
+                    cp = &p->checkpoints[n];
+            }
+            free_checkpoint(cp);
+        }
+        *cp = (struct checkpoint){
+            .mpa = p->mpa,
+            .src = p->src,
+            .pos = s->pos,
+            .last_use = ++p->use_counter,
+        };
+    }
+    p->mpa = NULL;
+    p->src = NULL;
+}
+
+// Make the checkpoint with the highest position <= newpos the current reader,
+// unless the current reader is closer.
+static void use_checkpoint(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    int best = -1;
+    int64_t best_pos = newpos >= s->pos ? s->pos : -1;
+    for (int n = 0; n < p->num_checkpoints; n++) {
+        struct checkpoint *cp = &p->checkpoints[n];
+        if (cp->pos <= newpos && cp->pos > best_pos) {
+            best = n;
+            best_pos = cp->pos;
+        }
+    }
+    if (best < 0)
+        return;
+    struct checkpoint cp = p->checkpoints[best];
+    MP_TARRAY_REMOVE_AT(p->checkpoints, p->num_checkpoints, best);
+    MP_VERBOSE(s, "continuing from checkpoint at %lld\n", (long long)cp.pos);
+    park_reader(s);
+    p->mpa = cp.mpa;
+    p->src = cp.src;
+    s->pos = cp.pos;
+}
+
 static int archive_entry_seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
@@ -354,11 +437,15 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
     if (archive_seek_data(p->mpa->arch, newpos, SEEK_SET) >= 0)
         return 1;
     // libarchive can't seek in most formats.
+    use_checkpoint(s, newpos);
     if (newpos < s->pos) {
         // Hack seeking backwards into working by reopening the archive and
-        // starting over.
+        // starting over. The old reader might be useful for later seeks.
         MP_VERBOSE(s, "trying to reopen archive for performing seek\n");
-        if (reopen_archive(s) < STREAM_OK)
+        park_reader(s);
+        p->src = stream_create(p->base, STREAM_READ | STREAM_SAFE_ONLY,
+                               s->cancel, s->global);
+        if (!p->src || reopen_archive(s) < STREAM_OK)
             return -1;
         s->pos = 0;
     }
@@ -385,6 +472,8 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
 static void archive_entry_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    for (int n = 0; n < p->num_checkpoints; n++)
+        free_checkpoint(&p->checkpoints[n]);
     mp_archive_free(p->mpa);
     free_stream(p->src);
 }
@@ -394,7 +483,7 @@ static int archive_entry_control(stream_t *s, int cmd, void *arg)
     struct priv *p = s->priv;
     switch (cmd) {
     case STREAM_CTRL_GET_BASE_FILENAME:
-        *(char **)arg = talloc_strdup(NULL, p->src->url);
+        *(char **)arg = talloc_strdup(NULL, p->base);
         return STREAM_OK;
     case STREAM_CTRL_GET_SIZE:
         if (p->entry_size < 0)
@@ -418,6 +507,7 @@ static int archive_entry_open(stream_t *stream)
     *name++ = '\0';
     p->entry_name = name;
     mp_url_unescape_inplace(base);
+    p->base = base;
 
     p->src = stream_create(base, STREAM_READ | STREAM_SAFE_ONLY,
                            stream->cancel, stream->global);
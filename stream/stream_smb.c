@@ -21,13 +21,72 @@
 
 #include <libsmbclient.h>
 #include <unistd.h>
+#include <pthread.h>
 
+#include "common/common.h"
 #include "common/msg.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 
+#define RA_BLOCK_SIZE (128 * 1024)
+#define RA_MAX_REQUESTS 32
+
+struct stream_smb_opts {
+  int readahead;
+};
+
+#define OPT_BASE_STRUCT struct stream_smb_opts
+const struct m_sub_options stream_smb_conf = {
+  .opts = (const m_option_t[]) {
+    OPT_INTRANGE("stream-smb-readahead", readahead, 0, 0, RA_MAX_REQUESTS),
+    {0}
+  },
+  .size = sizeof(struct stream_smb_opts),
+  .defaults = &(const struct stream_smb_opts){
+    .readahead = 4,
+  },
+};
+#undef OPT_BASE_STRUCT
+
+// Each request costs a network round trip, so a single blocking read per
+// fill_buffer() call can't saturate the link. The readahead keeps several
+// block sized requests in flight, using one worker thread (with its own
+// libsmbclient context and file handle) per request.
+struct ra_block {
+  int64_t pos;          // -1 if unused
+  int len;              // valid data once done (0 on EOF, -1 on error)
+  bool busy;            // being read by a worker
+  bool done;
+  char *data;
+};
+
+struct readahead {
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;    // signals workers
+  pthread_cond_t done;      // signals the reader
+  char *url;
+  int64_t size;
+  pthread_t threads[RA_MAX_REQUESTS];
+  int num_threads;
+  struct ra_block blocks[RA_MAX_REQUESTS + 1];
+  int num_blocks;
+  // Protected by lock
+  int starting;         // number of workers still opening the file
+  int alive;            // number of workers with an open file
+  int64_t pos;          // read position of the stream
+  int depth;            // number of blocks to keep requested ahead of pos
+  double req_time;      // average duration of a request (seconds)
+  double rate;          // average consumption rate (bytes per second)
+  int64_t last_read;    // mp_time_us() of the last fill_buffer() call
+  bool quit;
+};
+
 struct priv {
-    int fd;
+  int fd;
+  struct readahead *ra;
 };
 
 static void smb_auth_fn(const char *server, const char *share,
@@ -37,6 +96,106 @@ static void smb_auth_fn(const char *server, const char *share,
   strncpy(workgroup, "LAN", wgmaxlen - 1);
 }
 
+static struct ra_block *ra_find_block(struct readahead *ra, int64_t pos)
+{
+  for (int n = 0; n < ra->num_blocks; n++) {
+    if (ra->blocks[n].pos == pos)
+      return &ra->blocks[n];
+  }
+  return NULL;
+}
+
+// Pick the next block to read, and claim a slot for it. Blocks before the
+// current read position, or after the wanted range (after seeks), are reused.
+static struct ra_block *ra_next_request(struct readahead *ra)
+{
+  int64_t start = ra->pos - ra->pos % RA_BLOCK_SIZE;
+  int64_t end = MPMIN(start + ra->depth * (int64_t)RA_BLOCK_SIZE, ra->size);
+  for (int64_t pos = start; pos < end; pos += RA_BLOCK_SIZE) {
+    if (ra_find_block(ra, pos))
+      continue;
+    for (int n = 0; n < ra->num_blocks; n++) {
+      struct ra_block *b = &ra->blocks[n];
+      if (b->busy)
+        continue;
+      if (b->pos < 0 || b->pos < start || b->pos >= end) {
+        *b = (struct ra_block){.pos = pos, .busy = true, .data = b->data};
+        return b;
+      }
+    }
+    break; // all slots are in use
+  }
+  return NULL;
+}
+
+static void *ra_worker(void *arg)
+{
+  struct readahead *ra = arg;
+  mpthread_set_name("smb-readahead");
+
+  SMBCCTX *ctx = smbc_new_context();
+  SMBCFILE *f = NULL;
+  if (ctx) {
+    smbc_setFunctionAuthData(ctx, smb_auth_fn);
+    if (smbc_init_context(ctx)) {
+      f = smbc_getFunctionOpen(ctx)(ctx, ra->url, O_RDONLY, 0);
+    } else {
+      smbc_free_context(ctx, 1);
+      ctx = NULL;
+    }
+  }
+
+  pthread_mutex_lock(&ra->lock);
+  ra->starting--;
+  if (f)
+    ra->alive++;
+  pthread_cond_broadcast(&ra->done);
+  while (f && !ra->quit) {
+    struct ra_block *b = ra_next_request(ra);
+    if (!b) {
+      pthread_cond_wait(&ra->wakeup, &ra->lock);
+      continue;
+    }
+    int64_t pos = b->pos;
+    pthread_mutex_unlock(&ra->lock);
+
+    int64_t t = mp_time_us();
+    int len = 0;
+    if (smbc_getFunctionLseek(ctx)(ctx, f, pos, SEEK_SET) < 0) {
+      len = -1;
+    } else {
+      while (len < RA_BLOCK_SIZE) {
+        ssize_t r = smbc_getFunctionRead(ctx)(ctx, f, b->data + len,
+                                             RA_BLOCK_SIZE - len);
+        if (r <= 0) {
+          if (r < 0 && !len)
+            len = -1;
+          break;
+        }
+        len += r;
+      }
+    }
+    double time = (mp_time_us() - t) / 1e6;
+
+    pthread_mutex_lock(&ra->lock);
+    b->len = len;
+    b->busy = false;
+    b->done = true;
+    ra->req_time = ra->req_time ? ra->req_time * 0.8 + time * 0.2 : time;
+    pthread_cond_broadcast(&ra->done);
+  }
+  if (f)
+    ra->alive--;
+  pthread_cond_broadcast(&ra->done);
+  pthread_mutex_unlock(&ra->lock);
+
+  if (f)
+    smbc_getFunctionClose(ctx)(ctx, f);
+  if (ctx)
+    smbc_free_context(ctx, 1);
+  return NULL;
+}
+
 static int control(stream_t *s, int cmd, void *arg) {
   struct priv *p = s->priv;
   switch(cmd) {
@@ -53,16 +212,80 @@ static int control(stream_t *s, int cmd, void *arg) {
   return STREAM_UNSUPPORTED;
 }
 
+static void ra_set_pos(struct readahead *ra, int64_t pos)
+{
+  if (!ra)
+    return;
+  pthread_mutex_lock(&ra->lock);
+  ra->pos = pos;
+  pthread_cond_broadcast(&ra->wakeup);
+  pthread_mutex_unlock(&ra->lock);
+}
+
+// Copy data at pos from the readahead blocks. Returns -1 if the caller should
+// read synchronously instead.
+static int ra_read(stream_t *s, int64_t pos, char *buffer, int max_len)
+{
+  struct readahead *ra = ((struct priv *)s->priv)->ra;
+  int64_t bpos = pos - pos % RA_BLOCK_SIZE;
+  int res = -1;
+
+  pthread_mutex_lock(&ra->lock);
+
+  // Enough requests in flight to cover the data consumed during one request.
+  int64_t now = mp_time_us();
+  if (ra->last_read && now > ra->last_read) {
+    double rate = max_len / ((now - ra->last_read) / 1e6);
+    ra->rate = ra->rate ? ra->rate * 0.9 + rate * 0.1 : rate;
+  }
+  ra->last_read = now;
+  int depth = ra->req_time * ra->rate / RA_BLOCK_SIZE + 2;
+  ra->depth = MPCLAMP(depth, 1, ra->num_threads);
+  ra->pos = pos;
+  pthread_cond_broadcast(&ra->wakeup);
+
+  while (1) {
+    struct ra_block *b = ra_find_block(ra, bpos);
+    if (b && b->done) {
+      if (b->len < 0) {
+        b->pos = -1; // retry synchronously
+      } else if (pos - bpos < b->len) {
+        res = MPMIN(max_len, b->len - (pos - bpos));
+        memcpy(buffer, b->data + (pos - bpos), res);
+      } else {
+        res = 0; // EOF
+      }
+      break;
+    }
+    if ((!ra->alive && !ra->starting) || mp_cancel_test(s->cancel))
+      break;
+    struct timespec ts = mp_rel_time_to_timespec(0.1);
+    pthread_cond_timedwait(&ra->done, &ra->lock, &ts);
+  }
+
+  pthread_mutex_unlock(&ra->lock);
+  return res;
+}
+
 static int seek(stream_t *s,int64_t newpos) {
   struct priv *p = s->priv;
   if(smbc_lseek(p->fd,newpos,SEEK_SET)<0) {
     return 0;
   }
+  ra_set_pos(p->ra, newpos);
   return 1;
 }
 
 static int fill_buffer(stream_t *s, char* buffer, int max_len){
   struct priv *p = s->priv;
+  if (p->ra && s->pos < p->ra->size) {
+    int r = ra_read(s, s->pos, buffer, max_len);
+    if (r >= 0)
+      return r ? r : -1;
+    if (mp_cancel_test(s->cancel))
+      return -1;
+    smbc_lseek(p->fd, s->pos, SEEK_SET);
+  }
   int r = smbc_read(p->fd,buffer,max_len);
   return (r <= 0) ? -1 : r;
 }
@@ -81,8 +304,68 @@ static int write_buffer(stream_t *s, char* buffer, int len) {
   return len;
 }
 
+static void ra_destroy(struct readahead *ra)
+{
+  if (!ra)
+    return;
+  pthread_mutex_lock(&ra->lock);
+  ra->quit = true;
+  pthread_cond_broadcast(&ra->wakeup);
+  pthread_mutex_unlock(&ra->lock);
+  for (int n = 0; n < ra->num_threads; n++)
+    pthread_join(ra->threads[n], NULL);
+  pthread_cond_destroy(&ra->done);
+  pthread_cond_destroy(&ra->wakeup);
+  pthread_mutex_destroy(&ra->lock);
+  talloc_free(ra);
+}
+
+static struct readahead *ra_create(stream_t *s, int64_t size)
+{
+  struct stream_smb_opts *opts =
+      mp_get_config_group(NULL, s->global, &stream_smb_conf);
+  int requests = opts->readahead;
+  talloc_free(opts);
+  if (requests < 1 || size <= 0)
+    return NULL;
+
+  struct readahead *ra = talloc_ptrtype(NULL, ra);
+  *ra = (struct readahead){
+    .url = talloc_strdup(ra, s->url),
+    .size = size,
+    .depth = 1,
+    .num_blocks = requests + 1, // one extra for the block being consumed
+  };
+  for (int n = 0; n < ra->num_blocks; n++) {
+    ra->blocks[n] = (struct ra_block){
+      .pos = -1,
+      .data = talloc_size(ra, RA_BLOCK_SIZE),
+    };
+  }
+  pthread_mutex_init(&ra->lock, NULL);
+  pthread_cond_init(&ra->wakeup, NULL);
+  pthread_cond_init(&ra->done, NULL);
+
+  pthread_mutex_lock(&ra->lock);
+  for (int n = 0; n < requests; n++) {
+    if (pthread_create(&ra->threads[ra->num_threads], NULL, ra_worker, ra))
+      break;
+    ra->num_threads++;
+    ra->starting++;
+  }
+  pthread_mutex_unlock(&ra->lock);
+
+  if (!ra->num_threads) {
+    ra_destroy(ra);
+    return NULL;
+  }
+  MP_VERBOSE(s, "Using %d readahead requests.\n", ra->num_threads);
+  return ra;
+}
+
 static void close_f(stream_t *s){
   struct priv *p = s->priv;
+  ra_destroy(p->ra);
   smbc_close(p->fd);
 }
 
@@ -105,6 +388,8 @@ static int open_f (stream_t *stream)
     return STREAM_ERROR;
   }
 
+  // The readahead uses a separate context in each worker thread.
+  smbc_thread_posix();
   err = smbc_init(smb_auth_fn, 1);
   if (err < 0) {
     MP_ERR(stream, "Cannot init the libsmbclient library: %d\n",err);
@@ -127,6 +412,8 @@ static int open_f (stream_t *stream)
     stream->seek = seek;
   }
   priv->fd = fd;
+  if (!write)
+    priv->ra = ra_create(stream, len);
   stream->fill_buffer = fill_buffer;
   stream->write_buffer = write_buffer;
   stream->close = close_f;
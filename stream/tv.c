@@ -102,6 +102,7 @@ const struct m_sub_options tv_params_conf = {
         OPT_INTRANGE("forcechan", forcechan, 0, 1, 2),
         OPT_FLAG("forceaudio", force_audio, 0),
         OPT_INTRANGE("buffersize", buffer_size, 0, 16, 1024),
+        OPT_FLAG("zerocopy", zerocopy, 0),
         OPT_FLAG("mjpeg", mjpeg, 0),
         OPT_INTRANGE("decimation", decimation, 0, 1, 4),
         OPT_INTRANGE("quality", quality, 0, 0, 100),
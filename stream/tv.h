@@ -53,6 +53,7 @@ typedef struct tv_params {
     int forcechan;
     int force_audio;
     int buffer_size;
+    int zerocopy;
     int mjpeg;
     int decimation;
     int quality;
@@ -83,6 +84,7 @@ typedef struct tvi_info_s
 
 
 struct priv;
+struct demux_packet;
 
 typedef struct tvi_functions_s
 {
@@ -94,6 +96,10 @@ typedef struct tvi_functions_s
     int (*get_video_framesize)(struct priv *priv);
     double (*grab_audio_frame)(struct priv *priv, char *buffer, int len);
     int (*get_audio_framesize)(struct priv *priv);
+    // Return the next video frame as packet in *out without copying it (*out
+    // is NULL on timeout). Returns -1 if unsupported, in which case
+    // grab_video_frame() is used.
+    int (*grab_video_packet)(struct priv *priv, struct demux_packet **out);
 } tvi_functions_t;
 
 typedef struct tvi_handle_s {
@@ -31,6 +31,7 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len);
 static int get_video_framesize(priv_t *priv);
 static double grab_audio_frame(priv_t *priv, char *buffer, int len);
 static int get_audio_framesize(priv_t *priv);
+static int grab_video_packet(priv_t *priv, struct demux_packet **out);
 
 static const tvi_functions_t functions =
 {
@@ -41,7 +42,8 @@ static const tvi_functions_t functions =
     grab_video_frame,
     get_video_framesize,
     grab_audio_frame,
-    get_audio_framesize
+    get_audio_framesize,
+    grab_video_packet,
 };
 
 /**
@@ -109,6 +109,11 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len)
     return MP_NOPTS_VALUE;
 }
 
+static int grab_video_packet(priv_t *priv, struct demux_packet **out)
+{
+    return -1;
+}
+
 static int get_video_framesize(priv_t *priv)
 {
     /* YV12 */
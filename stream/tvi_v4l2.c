@@ -45,6 +45,7 @@ known issues:
 #include <sys/types.h>
 #include <unistd.h>
 #include <math.h>
+#include <stdbool.h>
 #if HAVE_SYS_VIDEOIO_H
 #include <sys/videoio.h>
 #else
@@ -53,8 +54,12 @@ known issues:
 #if HAVE_LIBV4L2
 #include <libv4l2.h>
 #endif
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+
 #include "common/msg.h"
 #include "common/common.h"
+#include "demux/packet.h"
 #include "video/img_fourcc.h"
 #include "audio/format.h"
 #include "tv.h"
@@ -91,14 +96,32 @@ struct map {
 };
 
 #define BUFFER_COUNT 6
+// With --tv-zerocopy, frames are queued in the capture buffers themselves
+#define ZEROCOPY_BUFFER_COUNT 16
 
 /** video ringbuffer entry */
 typedef struct {
     unsigned char               *data;     ///< frame contents
     long long                   timestamp; ///< frame timestamp
     int                         framesize; ///< actual frame size
+    int                         index;     ///< capture buffer (zero-copy only)
 } video_buffer_entry;
 
+/**
+ Capture buffers lent to demuxer packets in zero-copy mode. Each packet
+ referencing a buffer queues it back to the driver when it's freed. If the
+ device is closed while packets are still alive, the buffer mappings and the
+ device are handed over to this struct, and released with the last packet.
+*/
+struct lent_buffers {
+    pthread_mutex_t             lock;
+    int                         num_lent;
+    bool                        closed;
+    int                         fd;
+    struct map                  *map;
+    int                         mapcount;
+};
+
 /* private data */
 typedef struct priv {
     /* video */
@@ -135,6 +158,8 @@ typedef struct priv {
     volatile int                video_cnt;
     pthread_t                   video_grabber_thread;
     pthread_mutex_t             video_buffer_mutex;
+    int                         zerocopy;
+    struct lent_buffers         *lent;
 
     /* audio */
     char                        *audio_dev;
@@ -958,6 +983,40 @@ static tvi_handle_t *tvi_init_v4l2(struct mp_log *log, tv_param_t* tv_param)
 #undef PRIV
 
 
+static void free_lent_buffers(struct lent_buffers *lent)
+{
+    for (int i = 0; i < lent->mapcount; i++)
+        v4l2_munmap(lent->map[i].addr, lent->map[i].len);
+    free(lent->map);
+    if (lent->fd != -1)
+        v4l2_close(lent->fd);
+    pthread_mutex_destroy(&lent->lock);
+    free(lent);
+}
+
+// Give the capture buffer back to the driver. Called locked.
+static void requeue_buffer(struct lent_buffers *lent, int index)
+{
+    if (!lent->closed)
+        v4l2_ioctl(lent->fd, VIDIOC_QBUF, &lent->map[index].buf);
+}
+
+// AVBuffer free callback of packets referencing capture buffers.
+static void release_capture_buffer(void *opaque, uint8_t *data)
+{
+    struct lent_buffers *lent = opaque;
+    pthread_mutex_lock(&lent->lock);
+    for (int i = 0; i < lent->mapcount; i++) {
+        if (lent->map[i].addr == data)
+            requeue_buffer(lent, i);
+    }
+    lent->num_lent--;
+    bool destroy = lent->closed && !lent->num_lent;
+    pthread_mutex_unlock(&lent->lock);
+    if (destroy)
+        free_lent_buffers(lent);
+}
+
 static int uninit(priv_t *priv)
 {
     int i, frames, dropped = 0;
@@ -986,6 +1045,27 @@ static int uninit(priv_t *priv)
         }
     }
 
+    if (priv->lent) {
+        struct lent_buffers *lent = priv->lent;
+        pthread_mutex_lock(&lent->lock);
+        lent->closed = true;
+        bool in_use = lent->num_lent > 0;
+        if (in_use) {
+            MP_VERBOSE(priv, "%d capture buffers still in use.\n", lent->num_lent);
+            priv->map = NULL;
+            priv->mapcount = 0;
+            priv->video_fd = -1;
+        } else {
+            lent->map = NULL;
+            lent->mapcount = 0;
+            lent->fd = -1;
+        }
+        pthread_mutex_unlock(&lent->lock);
+        if (!in_use)
+            free_lent_buffers(lent);
+        priv->lent = NULL;
+    }
+
     /* unmap all buffers */
     for (i = 0; i < priv->mapcount; i++) {
         if (v4l2_munmap(priv->map[i].addr, priv->map[i].len) < 0) {
@@ -1015,7 +1095,8 @@ static int uninit(priv_t *priv)
 
     if (priv->video_ringbuffer) {
         for (int n = 0; n < priv->video_buffer_size_current; n++) {
-            free(priv->video_ringbuffer[n].data);
+            if (!priv->zerocopy)
+                free(priv->video_ringbuffer[n].data);
         }
         free(priv->video_ringbuffer);
     }
@@ -1246,6 +1327,12 @@ static int start(priv_t *priv)
     if (priv->tv_param->audio && !priv->audio_initialized) return 0;
 
     priv->video_buffer_size_max = get_capture_buffer_size(priv);
+    priv->zerocopy = priv->tv_param->zerocopy;
+    if (priv->zerocopy) {
+        // No frames are copied into the ring buffer, so it never needs more
+        // entries than there are capture buffers.
+        priv->video_buffer_size_max = ZEROCOPY_BUFFER_COUNT;
+    }
 
     if (priv->tv_param->audio) {
         setup_audio_buffer_sizes(priv);
@@ -1316,7 +1403,7 @@ static int start(priv_t *priv)
     priv->video_cnt = 0;
 
     /* request buffers */
-    request.count = BUFFER_COUNT;
+    request.count = priv->zerocopy ? ZEROCOPY_BUFFER_COUNT : BUFFER_COUNT;
 
     request.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     request.memory = V4L2_MEMORY_MMAP;
@@ -1366,6 +1453,24 @@ static int start(priv_t *priv)
         }
     }
 
+    if (priv->zerocopy) {
+        priv->lent = calloc(1, sizeof(*priv->lent));
+        if (!priv->lent) {
+            MP_ERR(priv, "cannot allocate buffer state: %s\n", mp_strerror(errno));
+            return 0;
+        }
+        pthread_mutex_init(&priv->lent->lock, NULL);
+        priv->lent->fd = priv->video_fd;
+        priv->lent->map = priv->map;
+        priv->lent->mapcount = priv->mapcount;
+        // The driver can return fewer buffers than requested. The ring
+        // buffer never grows in this mode.
+        priv->video_buffer_size_max = MPMIN(priv->video_buffer_size_max,
+                                            priv->mapcount);
+        priv->video_buffer_size_current = priv->video_buffer_size_max;
+        MP_VERBOSE(priv, "Zero-copy capture with %d buffers.\n", priv->mapcount);
+    }
+
     /* start audio thread */
     priv->shutdown = 0;
     priv->audio_skew_measure_time = 0;
@@ -1379,9 +1484,13 @@ static int start(priv_t *priv)
 }
 
 // copies a video frame
+// In zero-copy mode, the frame stays in the capture buffer, and only the
+// blank frame for automute is written into it.
 static inline void copy_frame(priv_t *priv, video_buffer_entry *dest, unsigned char *source,int len)
 {
     dest->framesize=len;
+    if (priv->zerocopy)
+        dest->data = source;
     if(priv->tv_param->automute>0){
         if (v4l2_ioctl(priv->video_fd, VIDIOC_G_TUNER, &priv->tuner) >= 0) {
             if(priv->tv_param->automute<<8>priv->tuner.signal){
@@ -1392,7 +1501,8 @@ static inline void copy_frame(priv_t *priv, video_buffer_entry *dest, unsigned c
         }
         set_mute(priv,0);
     }
-    memcpy(dest->data, source, len);
+    if (!priv->zerocopy)
+        memcpy(dest->data, source, len);
 }
 
 // maximum skew change, in frames
@@ -1541,6 +1651,7 @@ static void *video_grabber(void *data)
         }
         pthread_mutex_unlock(&priv->video_buffer_mutex);
 
+        bool keep = false;
         if (priv->video_cnt == priv->video_buffer_size_current) {
             MP_ERR(priv, "\nvideo buffer full - dropping frame\n");
             if (!priv->immediate_mode || priv->audio_insert_null_samples) {
@@ -1566,10 +1677,13 @@ static void *video_grabber(void *data)
                 }
             }
             copy_frame(priv, priv->video_ringbuffer+priv->video_tail, priv->map[buf.index].addr,buf.bytesused);
+            priv->video_ringbuffer[priv->video_tail].index = buf.index;
             priv->video_tail = (priv->video_tail+1)%priv->video_buffer_size_current;
             priv->video_cnt++;
+            // queued again when the packet referencing it is freed
+            keep = priv->zerocopy;
         }
-        if (v4l2_ioctl(priv->video_fd, VIDIOC_QBUF, &buf) < 0) {
+        if (!keep && v4l2_ioctl(priv->video_fd, VIDIOC_QBUF, &buf) < 0) {
             MP_ERR(priv, "ioctl queue buffer failed: %s\n", mp_strerror(errno));
             return 0;
         }
@@ -1602,6 +1716,60 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len)
     return interval == -1 ? MP_NOPTS_VALUE : interval*1e-6;
 }
 
+// Return the next frame as packet referencing the capture buffer, which is
+// queued to the driver again when the packet is freed. The decoder can use the
+// data directly (e.g. for raw video, the decoded image references it).
+static int grab_video_packet(priv_t *priv, struct demux_packet **out)
+{
+    int loop_cnt = 0;
+
+    *out = NULL;
+    if (!priv->zerocopy)
+        return -1;
+
+    if (priv->first) {
+        pthread_create(&priv->video_grabber_thread, NULL, video_grabber, priv);
+        priv->first = 0;
+    }
+
+    while (priv->video_cnt == 0) {
+        usleep(1000);
+        if (loop_cnt++ > MAX_LOOP) return 0;
+    }
+
+    pthread_mutex_lock(&priv->video_buffer_mutex);
+    video_buffer_entry e = priv->video_ringbuffer[priv->video_head];
+    priv->video_cnt--;
+    priv->video_head = (priv->video_head+1)%priv->video_buffer_size_current;
+    pthread_mutex_unlock(&priv->video_buffer_mutex);
+
+    struct lent_buffers *lent = priv->lent;
+    struct map *m = &priv->map[e.index];
+    struct demux_packet *dp = NULL;
+    // libavcodec requires padding after the packet data.
+    if (m->len >= e.framesize + AV_INPUT_BUFFER_PADDING_SIZE) {
+        AVBufferRef *buf = av_buffer_create(m->addr, m->len,
+                                            release_capture_buffer, lent, 0);
+        if (buf) {
+            pthread_mutex_lock(&lent->lock);
+            lent->num_lent++;
+            pthread_mutex_unlock(&lent->lock);
+            dp = new_demux_packet_from_buf(buf, m->addr, e.framesize);
+            av_buffer_unref(&buf);
+        }
+    }
+    if (!dp) {
+        dp = new_demux_packet_from(m->addr, e.framesize);
+        pthread_mutex_lock(&lent->lock);
+        requeue_buffer(lent, e.index);
+        pthread_mutex_unlock(&lent->lock);
+    }
+    if (dp)
+        dp->pts = e.timestamp == -1 ? MP_NOPTS_VALUE : e.timestamp*1e-6;
+    *out = dp;
+    return 0;
+}
+
 static int get_video_framesize(priv_t *priv)
 {
     /*
@@ -0,0 +1,250 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The events are kept sorted by start and by end time. Over the start-sorted
+// list there is a segment tree of maximum end times, which allows finding all
+// events overlapping a time range in O(k log n). Events are normally added in
+// order, which appends to both lists and updates the tree in O(log n).
+
+#include <stdlib.h>
+#include <limits.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "ass_index.h"
+
+#define END(ev) ((ev)->Start + (ev)->Duration)
+
+struct entry {
+    long long t;
+    int ev;         // index into track->events
+};
+
+struct mp_ass_index {
+    int num;                    // track->events[0..num-1] are indexed
+    struct entry *starts;       // sorted by (t, ev)
+    struct entry *ends;         // sorted by (t, ev)
+    int alloc;
+
+    // Implicit binary tree over starts[]: leaves at tree[size + n] contain
+    // the end time of starts[n], inner nodes the maximum of their children.
+    long long *tree;
+    int size;
+    bool tree_valid;
+
+    int *res;
+    int num_res;
+};
+
+struct mp_ass_index *mp_ass_index_alloc(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct mp_ass_index);
+}
+
+void mp_ass_index_invalidate(struct mp_ass_index *ix)
+{
+    ix->num = 0;
+    ix->tree_valid = false;
+}
+
+static int cmp_entry(const void *pa, const void *pb)
+{
+    const struct entry *a = pa, *b = pb;
+    if (a->t != b->t)
+        return a->t < b->t ? -1 : 1;
+    return a->ev - b->ev;
+}
+
+static int cmp_int(const void *pa, const void *pb)
+{
+    return *(const int *)pa - *(const int *)pb;
+}
+
+// Index of the first entry with e->t >= t (or > t if after is set).
+static int bound(struct entry *list, int num, long long t, bool after)
+{
+    int a = 0, b = num;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (list[mid].t < t || (after && list[mid].t == t)) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    return a;
+}
+
+static void build_tree(struct mp_ass_index *ix, ASS_Track *track)
+{
+    int size = 1;
+    while (size < ix->num)
+        size *= 2;
+    if (size != ix->size || !ix->tree) {
+        talloc_free(ix->tree);
+        ix->tree = talloc_array(ix, long long, size * 2);
+        ix->size = size;
+    }
+    for (int n = 0; n < size; n++) {
+        ix->tree[size + n] = n < ix->num ?
+            END(&track->events[ix->starts[n].ev]) : LLONG_MIN;
+    }
+    for (int n = size - 1; n >= 1; n--)
+        ix->tree[n] = MPMAX(ix->tree[n * 2], ix->tree[n * 2 + 1]);
+    ix->tree_valid = true;
+}
+
+// Add events appended to the track since the last call.
+static void update(struct mp_ass_index *ix, ASS_Track *track)
+{
+    if (track->n_events < ix->num)
+        mp_ass_index_invalidate(ix);
+    if (track->n_events == ix->num && ix->tree_valid)
+        return;
+
+    int old_num = ix->num;
+    if (track->n_events > ix->alloc) {
+        ix->alloc = MPMAX(track->n_events, ix->alloc * 2);
+        ix->starts = talloc_realloc(ix, ix->starts, struct entry, ix->alloc);
+        ix->ends = talloc_realloc(ix, ix->ends, struct entry, ix->alloc);
+    }
+
+    bool starts_sorted = true, ends_sorted = true;
+    for (int n = old_num; n < track->n_events; n++) {
+        ASS_Event *event = &track->events[n];
+        ix->starts[n] = (struct entry){event->Start, n};
+        ix->ends[n] = (struct entry){END(event), n};
+        if (n > 0) {
+            starts_sorted &= cmp_entry(&ix->starts[n - 1], &ix->starts[n]) < 0;
+            ends_sorted &= cmp_entry(&ix->ends[n - 1], &ix->ends[n]) < 0;
+        }
+    }
+    ix->num = track->n_events;
+
+    if (!starts_sorted) {
+        qsort(ix->starts, ix->num, sizeof(ix->starts[0]), cmp_entry);
+        ix->tree_valid = false;
+    }
+    if (!ends_sorted)
+        qsort(ix->ends, ix->num, sizeof(ix->ends[0]), cmp_entry);
+
+    if (!ix->tree_valid || ix->num > ix->size) {
+        build_tree(ix, track);
+        return;
+    }
+
+    // Appended in order: only the paths from the new leaves need updating.
+    for (int n = old_num; n < ix->num; n++) {
+        int i = ix->size + n;
+        ix->tree[i] = END(&track->events[ix->starts[n].ev]);
+        for (i /= 2; i >= 1; i /= 2)
+            ix->tree[i] = MPMAX(ix->tree[i * 2], ix->tree[i * 2 + 1]);
+    }
+}
+
+static bool collect(struct mp_ass_index *ix, int node, int l, int r,
+                    int limit, long long lo, int max)
+{
+    if (l >= limit || ix->tree[node] < lo)
+        return true;
+    if (r - l == 1) {
+        MP_TARRAY_APPEND(ix, ix->res, ix->num_res, ix->starts[l].ev);
+        return max < 0 || ix->num_res <= max;
+    }
+    int mid = l + (r - l) / 2;
+    return collect(ix, node * 2, l, mid, limit, lo, max) &&
+           collect(ix, node * 2 + 1, mid, r, limit, lo, max);
+}
+
+int mp_ass_index_find(struct mp_ass_index *ix, ASS_Track *track,
+                      long long lo, long long hi, int max, int **out)
+{
+    update(ix, track);
+    ix->num_res = 0;
+    if (ix->num) {
+        int limit = bound(ix->starts, ix->num, hi, true);
+        collect(ix, 1, 0, ix->size, limit, lo, max);
+        qsort(ix->res, ix->num_res, sizeof(ix->res[0]), cmp_int);
+    }
+    *out = ix->res;
+    return ix->num_res;
+}
+
+static bool has_value_in(struct entry *list, int num, long long a, long long b)
+{
+    int n = bound(list, num, a, true);
+    return n < num && list[n].t <= b;
+}
+
+bool mp_ass_index_has_boundary(struct mp_ass_index *ix, ASS_Track *track,
+                               long long a, long long b)
+{
+    update(ix, track);
+    if (a > b)
+        MPSWAP(long long, a, b);
+    return has_value_in(ix->starts, ix->num, a, b) ||
+           has_value_in(ix->ends, ix->num, a, b);
+}
+
+long long mp_ass_index_step_sub(struct mp_ass_index *ix, ASS_Track *track,
+                                long long now, int movement)
+{
+    update(ix, track);
+    int best = -1;
+    long long target = now;
+    int direction = (movement > 0 ? 1 : -1) * !!movement;
+
+    if (!ix->num)
+        return 0;
+
+    // On equal times, ass_step_sub() picks the first event in track order,
+    // except for direction==0, where it picks the last one.
+    do {
+        int closest = -1;
+        long long closest_time = now;
+        if (direction < 0) {
+            // Latest end before target.
+            int n = bound(ix->ends, ix->num, target, false) - 1;
+            if (n >= 0) {
+                while (n > 0 && ix->ends[n - 1].t == ix->ends[n].t)
+                    n--;
+                closest = ix->ends[n].ev;
+                closest_time = ix->ends[n].t;
+            }
+        } else if (direction > 0) {
+            // Earliest start after target.
+            int n = bound(ix->starts, ix->num, target, true);
+            if (n < ix->num) {
+                closest = ix->starts[n].ev;
+                closest_time = ix->starts[n].t;
+            }
+        } else {
+            // Latest start before target.
+            int n = bound(ix->starts, ix->num, target, false) - 1;
+            if (n >= 0) {
+                closest = ix->starts[n].ev;
+                closest_time = ix->starts[n].t;
+            }
+        }
+        target = closest_time + direction;
+        movement -= direction;
+        if (closest >= 0)
+            best = closest;
+    } while (movement);
+
+    return best >= 0 ? track->events[best].Start - now : 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_ASS_INDEX_H
+#define MPLAYER_ASS_INDEX_H
+
+#include <stdbool.h>
+
+#include <ass/ass_types.h>
+
+// Time index over the events of an ASS_Track, for lookups which don't scan
+// all events. Events appended to the track are picked up by every query. If
+// existing events are changed or removed, mp_ass_index_invalidate() must be
+// called. Times are in ms, as in ASS_Event.
+struct mp_ass_index;
+
+struct mp_ass_index *mp_ass_index_alloc(void *ta_parent);
+void mp_ass_index_invalidate(struct mp_ass_index *ix);
+
+// Find the events with Start <= hi and Start + Duration >= lo. Returns the
+// number of events found, and sets *out to their indexes into track->events,
+// in ascending order. The array is valid until the next call. The search stops
+// as soon as more than max events are found (max < 0 => no limit).
+int mp_ass_index_find(struct mp_ass_index *ix, ASS_Track *track,
+                      long long lo, long long hi, int max, int **out);
+
+// Whether an event starts or ends in the range (a, b] (or (b, a]).
+bool mp_ass_index_has_boundary(struct mp_ass_index *ix, ASS_Track *track,
+                               long long a, long long b);
+
+// Same semantics as ass_step_sub().
+long long mp_ass_index_step_sub(struct mp_ass_index *ix, ASS_Track *track,
+                                long long now, int movement);
+
+#endif
@@ -23,10 +23,14 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <ass/ass.h>
 #include <ass/ass_types.h>
 
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
@@ -86,19 +90,108 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
     style->Italic = opts->italic;
 }
 
+// Font setup (mostly fontconfig loading or building its cache) can take
+// seconds on a cold start. mp_ass_preload_fonts() does it once on a background
+// thread, and mp_ass_configure_fonts() waits for running preloads instead of
+// doing the same work concurrently. This is process-wide, as is the fontconfig
+// cache.
+static pthread_mutex_t preload_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t preload_wakeup = PTHREAD_COND_INITIALIZER;
+static int preload_running;
+
+struct mp_ass_font_preload {
+    struct mp_log *log;
+    ASS_Library *library;
+    ASS_Renderer *renderer;
+    char *default_font, *family, *config;
+    pthread_t thread;
+};
+
+static void find_font_files(void *ta_parent, struct mpv_global *global,
+                            char **default_font, char **config)
+{
+    *default_font = mp_find_config_file(ta_parent, global, "subfont.ttf");
+    *config       = mp_find_config_file(ta_parent, global, "fonts.conf");
+
+    if (*default_font && !mp_path_exists(*default_font))
+        *default_font = NULL;
+}
+
+static void *preload_thread(void *arg)
+{
+    struct mp_ass_font_preload *p = arg;
+    mpthread_set_name("font preload");
+
+    double start = mp_time_sec();
+    ass_set_fonts(p->renderer, p->default_font, p->family, 1, p->config, 1);
+    MP_VERBOSE(p, "Font setup took %.3f seconds.\n", mp_time_sec() - start);
+
+    pthread_mutex_lock(&preload_lock);
+    preload_running--;
+    pthread_cond_broadcast(&preload_wakeup);
+    pthread_mutex_unlock(&preload_lock);
+    return NULL;
+}
+
+struct mp_ass_font_preload *mp_ass_preload_fonts(struct osd_style_opts *opts,
+                                                 struct mpv_global *global,
+                                                 struct mp_log *log)
+{
+    struct mp_ass_font_preload *p = talloc_zero(NULL, struct mp_ass_font_preload);
+    p->log = mp_log_new(p, log, "fonts");
+    p->library = mp_ass_init(global, p->log);
+    p->renderer = ass_renderer_init(p->library);
+    p->family = talloc_strdup(p, opts->font);
+    find_font_files(p, global, &p->default_font, &p->config);
+
+    pthread_mutex_lock(&preload_lock);
+    preload_running++;
+    pthread_mutex_unlock(&preload_lock);
+
+    if (!p->renderer || pthread_create(&p->thread, NULL, preload_thread, p)) {
+        pthread_mutex_lock(&preload_lock);
+        preload_running--;
+        pthread_mutex_unlock(&preload_lock);
+        if (p->renderer)
+            ass_renderer_done(p->renderer);
+        ass_library_done(p->library);
+        talloc_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void mp_ass_preload_fonts_destroy(struct mp_ass_font_preload *p)
+{
+    if (!p)
+        return;
+    pthread_join(p->thread, NULL);
+    ass_renderer_done(p->renderer);
+    ass_library_done(p->library);
+    talloc_free(p);
+}
+
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log)
 {
     void *tmp = talloc_new(NULL);
-    char *default_font = mp_find_config_file(tmp, global, "subfont.ttf");
-    char *config       = mp_find_config_file(tmp, global, "fonts.conf");
-
-    if (default_font && !mp_path_exists(default_font))
-        default_font = NULL;
+    char *default_font, *config;
+    find_font_files(tmp, global, &default_font, &config);
+
+    pthread_mutex_lock(&preload_lock);
+    if (preload_running) {
+        double start = mp_time_sec();
+        mp_verbose(log, "Waiting for font preloading...\n");
+        while (preload_running)
+            pthread_cond_wait(&preload_wakeup, &preload_lock);
+        mp_verbose(log, "Waited %.3f seconds.\n", mp_time_sec() - start);
+    }
+    pthread_mutex_unlock(&preload_lock);
 
+    double start = mp_time_sec();
     mp_verbose(log, "Setting up fonts...\n");
     ass_set_fonts(priv, default_font, opts->font, 1, config, 1);
-    mp_verbose(log, "Done.\n");
+    mp_verbose(log, "Done (%.3f seconds).\n", mp_time_sec() - start);
 
     talloc_free(tmp);
 }
@@ -193,6 +286,18 @@ struct mp_ass_packer {
     bool cached_subs_valid;
     struct sub_bitmap rgba_imgs[MP_SUB_BB_LIST_MAX];
     struct bitmap_packer *packer;
+
+    // for pack_libass_incremental()
+    bool slots_valid;
+    struct pack_slot *slots;
+    int num_slots;
+    int bottom;             // everything below is unused in cached_img
+    int *hash;              // slot index by pack_slot.src
+    int *part_slots;        // slot index for each sub_bitmap
+    struct bitmap_packer *inc_packer;
+    uint64_t packed_id;
+    struct mp_rect *dirty;
+    int num_dirty;
 };
 
 // Free with talloc_free().
@@ -200,10 +305,13 @@ struct mp_ass_packer *mp_ass_packer_alloc(void *ta_parent)
 {
     struct mp_ass_packer *p = talloc_zero(ta_parent, struct mp_ass_packer);
     p->packer = talloc_zero(p, struct bitmap_packer);
+    p->inc_packer = talloc_zero(p, struct bitmap_packer);
     return p;
 }
 
-static bool pack(struct mp_ass_packer *p, struct sub_bitmaps *res, int imgfmt)
+// height_mul > 1 allocates the image taller than needed.
+static bool pack(struct mp_ass_packer *p, struct sub_bitmaps *res, int imgfmt,
+                 int height_mul)
 {
     packer_set_size(p->packer, res->num_parts);
 
@@ -219,11 +327,13 @@ static bool pack(struct mp_ass_packer *p, struct sub_bitmaps *res, int imgfmt)
     res->packed_w = bb[1].x;
     res->packed_h = bb[1].y;
 
-    if (!p->cached_img || p->cached_img->w < res->packed_w ||
+    if (!p->cached_img || p->cached_img->imgfmt != imgfmt ||
+                          p->cached_img->w < res->packed_w ||
                           p->cached_img->h < res->packed_h)
     {
         talloc_free(p->cached_img);
-        p->cached_img = mp_image_alloc(imgfmt, p->packer->w, p->packer->h);
+        p->cached_img = mp_image_alloc(imgfmt, p->packer->w,
+                                       p->packer->h * height_mul);
         if (!p->cached_img)
             return false;
         talloc_steal(p, p->cached_img);
@@ -242,9 +352,203 @@ static bool pack(struct mp_ass_packer *p, struct sub_bitmaps *res, int imgfmt)
     return true;
 }
 
+// Incremental packing for SUBBITMAP_LIBASS: bitmaps unchanged since the last
+// pack keep their position in the packed image, new ones are put into holes
+// left by removed bitmaps, or below everything else. Only if that fails, the
+// whole image is repacked.
+
+#define MAX_DIRTY_RECTS 16
+
+struct pack_slot {
+    int x, y, w, h;         // area in cached_img
+    const void *src;        // ASS_Image.bitmap copied into it, or NULL if free
+    int src_w, src_h;
+    bool used;              // referenced by the current pack
+    int hash_next;
+};
+
+static atomic_ullong packed_id_counter = ATOMIC_VAR_INIT(1);
+
+static uint64_t new_packed_id(void)
+{
+    return atomic_fetch_add(&packed_id_counter, 1);
+}
+
+static unsigned hash_ptr(const void *ptr)
+{
+    uint64_t v = (uintptr_t)ptr;
+    return (unsigned)(v ^ (v >> 16) ^ (v >> 32)) * 2654435761u;
+}
+
+static void copy_to_slot(struct mp_ass_packer *p, struct pack_slot *s,
+                         struct sub_bitmap *b)
+{
+    int stride = p->cached_img->stride[0];
+    uint8_t *pdata = p->cached_img->planes[0] + s->y * stride + s->x;
+    memcpy_pic(pdata, b->bitmap, b->w, b->h, stride, b->stride);
+    s->src = b->bitmap;
+    s->src_w = b->w;
+    s->src_h = b->h;
+    s->used = true;
+
+    struct mp_rect rc = {s->x, s->y, s->x + b->w, s->y + b->h};
+    if (p->num_dirty < MAX_DIRTY_RECTS) {
+        MP_TARRAY_APPEND(p, p->dirty, p->num_dirty, rc);
+    } else {
+        mp_rect_union(&p->dirty[MAX_DIRTY_RECTS - 1], &rc);
+    }
+}
+
+static bool slot_contents_equal(struct mp_ass_packer *p, struct pack_slot *s,
+                                struct sub_bitmap *b)
+{
+    if (s->src != b->bitmap || s->src_w != b->w || s->src_h != b->h)
+        return false;
+    int stride = p->cached_img->stride[0];
+    uint8_t *pdata = p->cached_img->planes[0] + s->y * stride + s->x;
+    for (int y = 0; y < b->h; y++) {
+        if (memcmp(pdata + y * stride, (uint8_t *)b->bitmap + y * b->stride,
+                   b->w) != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool pack_libass_incremental(struct mp_ass_packer *p,
+                                    struct sub_bitmaps *res)
+{
+    if (!p->slots_valid || !p->cached_img || p->cached_img->imgfmt != IMGFMT_Y8)
+        return false;
+
+    int img_w = p->cached_img->w, img_h = p->cached_img->h;
+
+    // Look up bitmaps from the previous pack by their source pointer.
+    int hash_size = 16;
+    while (hash_size < p->num_slots * 2)
+        hash_size *= 2;
+    MP_TARRAY_GROW(p, p->hash, hash_size - 1);
+    for (int n = 0; n < hash_size; n++)
+        p->hash[n] = -1;
+    for (int n = 0; n < p->num_slots; n++) {
+        struct pack_slot *s = &p->slots[n];
+        s->used = false;
+        if (s->src) {
+            int *head = &p->hash[hash_ptr(s->src) & (hash_size - 1)];
+            s->hash_next = *head;
+            *head = n;
+        }
+    }
+
+    MP_TARRAY_GROW(p, p->part_slots, res->num_parts);
+    int num_new = 0;
+    for (int n = 0; n < res->num_parts; n++) {
+        struct sub_bitmap *b = &res->parts[n];
+        p->part_slots[n] = -1;
+        int i = p->hash[hash_ptr(b->bitmap) & (hash_size - 1)];
+        for (; i >= 0; i = p->slots[i].hash_next) {
+            if (slot_contents_equal(p, &p->slots[i], b)) {
+                p->slots[i].used = true;
+                p->part_slots[n] = i;
+                break;
+            }
+        }
+        if (b->w > img_w || b->h > img_h)
+            return false;
+        num_new += p->part_slots[n] < 0;
+    }
+
+    // When most of it changes anyway, a repack is better.
+    if (num_new > res->num_parts / 2 + 1)
+        return false;
+
+    for (int n = 0; n < p->num_slots; n++) {
+        if (!p->slots[n].used)
+            p->slots[n].src = NULL;
+    }
+
+    p->num_dirty = 0;
+
+    // Put new bitmaps into holes, or queue them for the area at the bottom.
+    struct bitmap_packer *inc = p->inc_packer;
+    inc->count = 0;
+    for (int n = 0; n < res->num_parts; n++) {
+        if (p->part_slots[n] >= 0)
+            continue;
+        struct sub_bitmap *b = &res->parts[n];
+        for (int i = 0; i < p->num_slots; i++) {
+            struct pack_slot *s = &p->slots[i];
+            if (!s->src && s->w >= b->w && s->h >= b->h) {
+                copy_to_slot(p, s, b);
+                p->part_slots[n] = i;
+                break;
+            }
+        }
+        if (p->part_slots[n] < 0) {
+            packer_set_size(inc, inc->count + 1);
+            inc->in[inc->count - 1] = (struct pos){b->w, b->h};
+        }
+    }
+
+    if (inc->count) {
+        inc->w = img_w;
+        inc->h = 0;
+        inc->w_max = img_w;
+        if (packer_pack(inc) < 0 || p->bottom + inc->used_height > img_h)
+            return false;
+        int num = 0;
+        for (int n = 0; n < res->num_parts; n++) {
+            if (p->part_slots[n] >= 0)
+                continue;
+            struct sub_bitmap *b = &res->parts[n];
+            struct pos pos = inc->result[num++];
+            struct pack_slot s = {
+                .x = pos.x,
+                .y = p->bottom + pos.y,
+                .w = b->w,
+                .h = b->h,
+            };
+            p->part_slots[n] = p->num_slots;
+            MP_TARRAY_APPEND(p, p->slots, p->num_slots, s);
+            copy_to_slot(p, &p->slots[p->num_slots - 1], b);
+        }
+        p->bottom += inc->used_height;
+    }
+
+    res->packed = p->cached_img;
+    res->packed_w = res->packed_h = 0;
+    for (int n = 0; n < p->num_slots; n++) {
+        res->packed_w = MPMAX(res->packed_w, p->slots[n].x + p->slots[n].w);
+        res->packed_h = MPMAX(res->packed_h, p->slots[n].y + p->slots[n].h);
+    }
+
+    for (int n = 0; n < res->num_parts; n++) {
+        struct sub_bitmap *b = &res->parts[n];
+        struct pack_slot *s = &p->slots[p->part_slots[n]];
+        b->src_x = s->x;
+        b->src_y = s->y;
+        b->stride = p->cached_img->stride[0];
+        b->bitmap = p->cached_img->planes[0] + s->y * b->stride + s->x;
+    }
+
+    res->packed_base_id = p->packed_id;
+    if (p->num_dirty)
+        p->packed_id = new_packed_id();
+    res->packed_id = p->packed_id;
+    res->dirty = p->dirty;
+    res->num_dirty = p->num_dirty;
+    return true;
+}
+
 static bool pack_libass(struct mp_ass_packer *p, struct sub_bitmaps *res)
 {
-    if (!pack(p, res, IMGFMT_Y8))
+    if (pack_libass_incremental(p, res))
+        return true;
+
+    p->slots_valid = false;
+    p->num_slots = 0;
+
+    // Leave room below the packed bitmaps for later incremental packs.
+    if (!pack(p, res, IMGFMT_Y8, 2))
         return false;
 
     for (int n = 0; n < res->num_parts; n++) {
@@ -255,10 +559,27 @@ static bool pack_libass(struct mp_ass_packer *p, struct sub_bitmaps *res)
             (uint8_t *)res->packed->planes[0] + b->src_y * stride + b->src_x;
         memcpy_pic(pdata, b->bitmap, b->w, b->h, stride, b->stride);
 
+        struct pack_slot s = {
+            .x = b->src_x,
+            .y = b->src_y,
+            .w = b->w,
+            .h = b->h,
+            .src = b->bitmap,
+            .src_w = b->w,
+            .src_h = b->h,
+        };
+        MP_TARRAY_APPEND(p, p->slots, p->num_slots, s);
+
         b->bitmap = pdata;
         b->stride = stride;
     }
 
+    p->slots_valid = true;
+    p->bottom = res->packed_h;
+    p->packed_id = new_packed_id();
+    res->packed_id = p->packed_id;
+    res->packed_base_id = 0;
+
     return true;
 }
 
@@ -279,7 +600,8 @@ static bool pack_rgba(struct mp_ass_packer *p, struct sub_bitmaps *res)
         imgs.parts[n].h = bb_list[n].y1 - bb_list[n].y0;
     }
 
-    if (!pack(p, &imgs, IMGFMT_BGRA))
+    p->slots_valid = false;
+    if (!pack(p, &imgs, IMGFMT_BGRA, 1))
         return false;
 
     for (int n = 0; n < num_bb; n++) {
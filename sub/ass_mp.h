@@ -47,6 +47,16 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
 
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log);
+
+// Run the font setup once on a background thread, so that the fontconfig cache
+// is ready when the first renderer needs it. mp_ass_configure_fonts() waits
+// until it's done. Returns NULL on failure.
+struct mp_ass_font_preload;
+struct mp_ass_font_preload *mp_ass_preload_fonts(struct osd_style_opts *opts,
+                                                 struct mpv_global *global,
+                                                 struct mp_log *log);
+// Waits for the thread to finish. p==NULL is allowed.
+void mp_ass_preload_fonts_destroy(struct mp_ass_font_preload *p);
 ASS_Library *mp_ass_init(struct mpv_global *global, struct mp_log *log);
 
 struct sub_bitmaps;
@@ -20,7 +20,9 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "config.h"
 #include "demux/demux.h"
@@ -43,6 +45,12 @@ static const struct sd_functions *const sd_list[] = {
     NULL
 };
 
+// Number of packets decoded by the preload thread per lock acquisition.
+#define PRELOAD_CHUNK 50
+// How far ahead of the current time the preloaded packets must be decoded
+// when rendering. (Packets of fully read files are sorted by time.)
+#define PRELOAD_AHEAD_SECS 5.0
+
 struct dec_sub {
     pthread_mutex_t lock;
 
@@ -58,6 +66,15 @@ struct dec_sub {
     double last_pkt_pts;
     bool preload_attempted;
 
+    // Packets read by sub_preload() that have not been decoded yet. They are
+    // consumed in order, by the preload thread, or when rendering needs them.
+    struct demux_packet **preload_pkts;
+    int num_preload_pkts;
+    int preload_pos;
+    bool preload_abort;
+    bool preload_thread_active;
+    pthread_t preload_thread;
+
     struct mp_codec_params *codec;
     double start, end;
 
@@ -77,10 +94,24 @@ void sub_unlock(struct dec_sub *sub)
     pthread_mutex_unlock(&sub->lock);
 }
 
+static void drop_preload_pkts(struct dec_sub *sub)
+{
+    for (int n = sub->preload_pos; n < sub->num_preload_pkts; n++)
+        talloc_free(sub->preload_pkts[n]);
+    TA_FREEP(&sub->preload_pkts);
+    sub->num_preload_pkts = sub->preload_pos = 0;
+}
+
 void sub_destroy(struct dec_sub *sub)
 {
     if (!sub)
         return;
+    pthread_mutex_lock(&sub->lock);
+    sub->preload_abort = true;
+    pthread_mutex_unlock(&sub->lock);
+    if (sub->preload_thread_active)
+        pthread_join(sub->preload_thread, NULL);
+    drop_preload_pkts(sub);
     sub_reset(sub);
     sub->sd->driver->uninit(sub->sd);
     talloc_free(sub->sd);
@@ -184,6 +215,46 @@ bool sub_can_preload(struct dec_sub *sub)
     return r;
 }
 
+// Decode preloaded packets, either the given number of packets, or all
+// packets up to the given time (if max_pts is not MP_NOPTS_VALUE).
+// Called locked.
+static void decode_preloaded(struct dec_sub *sub, int num, double max_pts)
+{
+    while (sub->preload_pos < sub->num_preload_pkts) {
+        struct demux_packet *pkt = sub->preload_pkts[sub->preload_pos];
+        if (max_pts != MP_NOPTS_VALUE) {
+            if (pkt->pts != MP_NOPTS_VALUE && pkt->pts > max_pts)
+                break;
+        } else if (num-- <= 0) {
+            break;
+        }
+        sub->sd->driver->decode(sub->sd, pkt);
+        talloc_free(pkt);
+        sub->preload_pos++;
+    }
+    if (sub->preload_pos >= sub->num_preload_pkts)
+        drop_preload_pkts(sub);
+}
+
+static void *preload_thread(void *p)
+{
+    struct dec_sub *sub = p;
+    mpthread_set_name("sub-preload");
+
+    pthread_mutex_lock(&sub->lock);
+    while (!sub->preload_abort && sub->preload_pkts) {
+        decode_preloaded(sub, PRELOAD_CHUNK, MP_NOPTS_VALUE);
+        // Let the renderer get the lock.
+        pthread_mutex_unlock(&sub->lock);
+        sched_yield();
+        pthread_mutex_lock(&sub->lock);
+    }
+    pthread_mutex_unlock(&sub->lock);
+    return NULL;
+}
+
+// Read all packets, and decode them on a separate thread. Until that is done,
+// packets needed for rendering are decoded on demand.
 void sub_preload(struct dec_sub *sub)
 {
     pthread_mutex_lock(&sub->lock);
@@ -194,10 +265,18 @@ void sub_preload(struct dec_sub *sub)
         struct demux_packet *pkt = demux_read_packet(sub->sh);
         if (!pkt)
             break;
-        sub->sd->driver->decode(sub->sd, pkt);
-        talloc_free(pkt);
+        MP_TARRAY_APPEND(sub, sub->preload_pkts, sub->num_preload_pkts, pkt);
     }
 
+    if (sub->preload_pkts && !sub->preload_thread_active) {
+        MP_VERBOSE(sub, "Decoding %d preloaded packets in the background.\n",
+                   sub->num_preload_pkts);
+        sub->preload_thread_active =
+            !pthread_create(&sub->preload_thread, NULL, preload_thread, sub);
+    }
+    if (!sub->preload_thread_active)
+        decode_preloaded(sub, INT_MAX, MP_NOPTS_VALUE);
+
     pthread_mutex_unlock(&sub->lock);
 }
 
@@ -275,6 +354,9 @@ void sub_get_bitmaps(struct dec_sub *sub, struct mp_osd_res dim, int format,
     sub->last_vo_pts = pts;
     update_segment(sub);
 
+    if (sub->preload_pkts && pts != MP_NOPTS_VALUE)
+        decode_preloaded(sub, 0, pts + PRELOAD_AHEAD_SECS);
+
     if (sub->end != MP_NOPTS_VALUE && pts >= sub->end)
         return;
 
@@ -294,6 +376,9 @@ char *sub_get_text(struct dec_sub *sub, double pts)
     sub->last_vo_pts = pts;
     update_segment(sub);
 
+    if (sub->preload_pkts && pts != MP_NOPTS_VALUE)
+        decode_preloaded(sub, 0, pts + PRELOAD_AHEAD_SECS);
+
     if (opts->sub_visibility && sub->sd->driver->get_text)
         text = sub->sd->driver->get_text(sub->sd, pts);
     pthread_mutex_unlock(&sub->lock);
@@ -305,6 +390,10 @@ void sub_reset(struct dec_sub *sub)
     pthread_mutex_lock(&sub->lock);
     if (sub->sd->driver->reset)
         sub->sd->driver->reset(sub->sd);
+    // If the decoder discarded the preloaded events, the packets will be
+    // read from the demuxer again.
+    if (!sub->sd->preload_ok)
+        drop_preload_pkts(sub);
     sub->last_pkt_pts = MP_NOPTS_VALUE;
     sub->last_vo_pts = MP_NOPTS_VALUE;
     talloc_free(sub->new_segment);
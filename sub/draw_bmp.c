@@ -23,8 +23,11 @@
 
 #include <libswscale/swscale.h>
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 
+#include "config.h"
 #include "common/common.h"
+#include "misc/thread_pool.h"
 #include "draw_bmp.h"
 #include "img_convert.h"
 #include "video/mp_image.h"
@@ -50,11 +53,19 @@ struct part {
     struct sub_cache *imgs;
 };
 
+// Blending of large regions is split into horizontal bands of at least this
+// many pixels, which are processed in parallel.
+#define MIN_BAND_PIXELS (256 * 1024)
+#define MAX_THREADS 8
+
 struct mp_draw_sub_cache
 {
     struct part *parts[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
+    bool pool_init;
+    struct mp_thread_pool *pool;
+    int threads;            // including the calling thread
 };
 
 
@@ -64,11 +75,139 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
                          struct sub_bitmap *sb, struct mp_image *out_area,
                          int *out_src_x, int *out_src_y);
 
+#if HAVE_SSE4_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+// The kernels process 8 pixels per step, and give the same results as the C
+// code (all divisions are exact). They return the number of pixels done.
+
+// floor(x / 255) for any uint32_t
+static inline __m128i div255_epu32(__m128i x)
+{
+    const __m128i magic = _mm_set1_epi32(0x80808081);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(x, magic), 39);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), magic), 39);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+// floor(x / 255) for x <= 65152 (16 bit lanes)
+static inline __m128i div255_epu16(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_add_epi16(_mm_srli_epi16(x, 8), _mm_set1_epi16(1)));
+    return _mm_srli_epi16(x, 8);
+}
+
+// Full 32 bit products of unsigned 16 bit lanes.
+static inline void mul_epu16(__m128i a, __m128i b, __m128i *lo, __m128i *hi)
+{
+    __m128i l = _mm_mullo_epi16(a, b), h = _mm_mulhi_epu16(a, b);
+    *lo = _mm_unpacklo_epi16(l, h);
+    *hi = _mm_unpackhi_epi16(l, h);
+}
+
+// Pack unsigned 32 bit lanes <= 65535 to 16 bit lanes.
+static inline __m128i pack_epu32(__m128i lo, __m128i hi)
+{
+    const __m128i bias = _mm_set1_epi32(32768);
+    __m128i r = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+    return _mm_add_epi16(r, _mm_set1_epi16(-32768));
+}
+
+static inline __m128i load_u8(const uint8_t *p)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p),
+                             _mm_setzero_si128());
+}
+
+static inline __m128i load_px(const void *p, int bytes)
+{
+    return bytes == 2 ? _mm_loadu_si128((const __m128i *)p) : load_u8(p);
+}
+
+static inline void store_px(void *p, __m128i v, int bytes)
+{
+    if (bytes == 2) {
+        _mm_storeu_si128((__m128i *)p, v);
+    } else {
+        _mm_storel_epi64((__m128i *)p, _mm_packus_epi16(v, v));
+    }
+}
+
+// Whether all 8 alpha values at p are 0.
+static inline bool alpha_zero(const uint8_t *p)
+{
+    __m128i a = _mm_loadl_epi64((const __m128i *)p);
+    return (_mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_setzero_si128())) & 0xFF)
+           == 0xFF;
+}
+
+// dst = (c * wt + dst * (65025 - wt) + 32512) / 65025, wt = srca * srcamul
+static int blend_weight_sse2(void *dst, const uint8_t *srca, int c,
+                             int srcamul, int w, int bytes)
+{
+    const __m128i cv = _mm_set1_epi16(c), mulv = _mm_set1_epi16(srcamul);
+    const __m128i maxw = _mm_set1_epi16(65025), round = _mm_set1_epi32(32512);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        if (alpha_zero(srca + x))
+            continue;
+        void *dp = (uint8_t *)dst + x * bytes;
+        __m128i d = load_px(dp, bytes);
+        __m128i wt = _mm_mullo_epi16(load_u8(srca + x), mulv);
+        __m128i p0, p1, q0, q1;
+        mul_epu16(cv, wt, &p0, &p1);
+        mul_epu16(d, _mm_sub_epi16(maxw, wt), &q0, &q1);
+        p0 = _mm_add_epi32(_mm_add_epi32(p0, q0), round);
+        p1 = _mm_add_epi32(_mm_add_epi32(p1, q1), round);
+        p0 = div255_epu32(div255_epu32(p0));
+        p1 = div255_epu32(div255_epu32(p1));
+        store_px(dp, pack_epu32(p0, p1), bytes);
+    }
+    return x;
+}
+
+// dst = (src * srca + dst * (255 - srca) + 127) / 255
+static int blend_src_alpha_sse2(void *dst, const void *src, const uint8_t *srca,
+                                int w, int bytes)
+{
+    const __m128i maxa = _mm_set1_epi16(255);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        if (alpha_zero(srca + x))
+            continue;
+        void *dp = (uint8_t *)dst + x * bytes;
+        __m128i d = load_px(dp, bytes);
+        __m128i s = load_px((const uint8_t *)src + x * bytes, bytes);
+        __m128i a = load_u8(srca + x);
+        __m128i ia = _mm_sub_epi16(maxa, a);
+        __m128i r;
+        if (bytes == 2) {
+            __m128i p0, p1, q0, q1;
+            mul_epu16(s, a, &p0, &p1);
+            mul_epu16(d, ia, &q0, &q1);
+            const __m128i round = _mm_set1_epi32(127);
+            p0 = div255_epu32(_mm_add_epi32(_mm_add_epi32(p0, q0), round));
+            p1 = div255_epu32(_mm_add_epi32(_mm_add_epi32(p1, q1), round));
+            r = pack_epu32(p0, p1);
+        } else {
+            r = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia));
+            r = div255_epu16(_mm_add_epi16(r, _mm_set1_epi16(127)));
+        }
+        store_px(dp, r, bytes);
+    }
+    return x;
+}
+
+#pragma GCC pop_options
+#endif
+
 #define CONDITIONAL 1
 
 #define BLEND_CONST_ALPHA(TYPE)                                                 \
     TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
+    for (; x < w; x++) {                                                        \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         srcap *= srcamul; /* now 0..65025 */                                    \
@@ -82,9 +221,17 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
 {
     if (!srcamul)
         return;
+#if HAVE_SSE4_INTRINSICS
+    bool simd = av_get_cpu_flags() & AV_CPU_FLAG_SSE2;
+#endif
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+#if HAVE_SSE4_INTRINSICS
+        if (simd)
+            x = blend_weight_sse2(dst_rp, srca_r, srcp, srcamul, w, bytes);
+#endif
         if (bytes == 2) {
             BLEND_CONST_ALPHA(uint16_t)
         } else if (bytes == 1) {
@@ -95,7 +242,7 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
 
 #define BLEND_SRC_ALPHA(TYPE)                                                   \
     TYPE *dst_r = dst_rp, *src_r = src_rp;                                      \
-    for (int x = 0; x < w; x++) {                                               \
+    for (; x < w; x++) {                                                        \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
@@ -106,10 +253,18 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
                             int src_stride, uint8_t *srca, int srca_stride,
                             int w, int h, int bytes)
 {
+#if HAVE_SSE4_INTRINSICS
+    bool simd = av_get_cpu_flags() & AV_CPU_FLAG_SSE2;
+#endif
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         void *src_rp = (uint8_t *)src + src_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+#if HAVE_SSE4_INTRINSICS
+        if (simd)
+            x = blend_src_alpha_sse2(dst_rp, src_rp, srca_r, w, bytes);
+#endif
         if (bytes == 2) {
             BLEND_SRC_ALPHA(uint16_t)
         } else if (bytes == 1) {
@@ -120,8 +275,8 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
 
 #define BLEND_SRC_DST_MUL(TYPE, MAX)                                            \
     TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
-        uint16_t srcp = src_r[x] * srcmul; /* now 0..65025 */                   \
+    for (; x < w; x++) {                                                        \
+        uint32_t srcp = src_r[x] * srcmul; /* now 0..65025 */                   \
         dst_r[x] = (srcp * (MAX) + dst_r[x] * (65025 - srcp) + 32512) / 65025;  \
     }
 
@@ -130,11 +285,21 @@ static void blend_src_dst_mul(void *dst, int dst_stride,
                               uint8_t *src, int src_stride, uint8_t srcmul,
                               int w, int h, int dst_bytes)
 {
+#if HAVE_SSE4_INTRINSICS
+    bool simd = av_get_cpu_flags() & AV_CPU_FLAG_SSE2;
+#endif
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        int x = 0;
+#if HAVE_SSE4_INTRINSICS
+        if (simd) {
+            x = blend_weight_sse2(dst_rp, src_r, dst_bytes == 2 ? 65025 : 255,
+                                  srcmul, w, dst_bytes);
+        }
+#endif
         if (dst_bytes == 2) {
-            BLEND_SRC_DST_MUL(uint16_t, 65025)
+            BLEND_SRC_DST_MUL(uint16_t, 65025u)
         } else if (dst_bytes == 1) {
             BLEND_SRC_DST_MUL(uint8_t, 255)
         }
@@ -202,13 +367,42 @@ static void scale_sb_rgba(struct sub_bitmap *sb, struct mp_image *dst_format,
     *out_sba = sba;
 }
 
-static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                      struct mp_image *temp, int bits,
-                      struct sub_bitmaps *sbs)
+// Scale the RGBA bitmaps visible in bb, if they're not cached yet.
+static struct part *prepare_rgba(struct mp_draw_sub_cache *cache,
+                                 struct mp_rect bb, struct mp_image *temp,
+                                 struct sub_bitmaps *sbs)
 {
     struct part *part = get_cache(cache, sbs, temp);
     assert(part);
 
+    for (int i = 0; i < sbs->num_parts; ++i) {
+        struct sub_bitmap *sb = &sbs->parts[i];
+
+        if (sb->w < 1 || sb->h < 1)
+            continue;
+
+        struct mp_image dst;
+        int src_x, src_y;
+        if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
+            continue;
+
+        if (part->imgs[i].i && part->imgs[i].a)
+            continue;
+
+        struct mp_image *sbi = NULL, *sba = NULL;
+        scale_sb_rgba(sb, temp, &sbi, &sba);
+        part->imgs[i].i = talloc_steal(part, sbi);
+        part->imgs[i].a = talloc_steal(part, sba);
+    }
+
+    return part;
+}
+
+// Must not modify the cache; this can run on multiple threads at once.
+static void draw_rgba(struct part *part, struct mp_rect bb,
+                      struct mp_image *temp, int bits,
+                      struct sub_bitmaps *sbs)
+{
     for (int i = 0; i < sbs->num_parts; ++i) {
         struct sub_bitmap *sb = &sbs->parts[i];
 
@@ -223,8 +417,6 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         struct mp_image *sbi = part->imgs[i].i;
         struct mp_image *sba = part->imgs[i].a;
 
-        if (!(sbi && sba))
-            scale_sb_rgba(sb, temp, &sbi, &sba);
         // on OOM, skip drawing
         if (!(sbi && sba))
             continue;
@@ -240,14 +432,11 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
             blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
                               sba->stride[0], 255, dst.w, dst.h, bytes);
         }
-
-        part->imgs[i].i = talloc_steal(part, sbi);
-        part->imgs[i].a = talloc_steal(part, sba);
     }
 }
 
-static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
+static void draw_ass(struct mp_rect bb, struct mp_image *temp, int bits,
+                     struct sub_bitmaps *sbs)
 {
     struct mp_csp_params cspar = MP_CSP_PARAMS_DEFAULTS;
     mp_csp_set_image_params(&cspar, &temp->params);
@@ -412,6 +601,58 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
     return true;
 }
 
+struct band {
+    struct part *part;
+    struct mp_rect bb;
+    struct mp_image temp;
+    int bits;
+    struct sub_bitmaps *sbs;
+};
+
+static void draw_band(void *ctx)
+{
+    struct band *b = ctx;
+    if (b->sbs->format == SUBBITMAP_RGBA) {
+        draw_rgba(b->part, b->bb, &b->temp, b->bits, b->sbs);
+    } else if (b->sbs->format == SUBBITMAP_LIBASS) {
+        draw_ass(b->bb, &b->temp, b->bits, b->sbs);
+    }
+}
+
+// Blend sbs onto temp (which is the area bb of the target image). temp is a
+// 444 format, so it can be split at any row.
+static void draw_region(struct mp_draw_sub_cache *cache, struct part *part,
+                        struct mp_rect bb, struct mp_image *temp, int bits,
+                        struct sub_bitmaps *sbs)
+{
+    int num_bands = 1;
+    if (cache->pool) {
+        int64_t pixels = temp->w * (int64_t)temp->h;
+        num_bands = MPCLAMP(pixels / MIN_BAND_PIXELS, 1, cache->threads);
+    }
+
+    struct band bands[MAX_THREADS];
+    for (int n = 0; n < num_bands; n++) {
+        int y0 = temp->h * n / num_bands;
+        int y1 = temp->h * (n + 1) / num_bands;
+        struct band *b = &bands[n];
+        *b = (struct band){
+            .part = part,
+            .bb = {bb.x0, bb.y0 + y0, bb.x1, bb.y0 + y1},
+            .temp = *temp,
+            .bits = bits,
+            .sbs = sbs,
+        };
+        mp_image_crop(&b->temp, 0, y0, temp->w, y1);
+        if (n < num_bands - 1)
+            mp_thread_pool_queue(cache->pool, draw_band, b);
+    }
+    // The last band is drawn on the calling thread.
+    draw_band(&bands[num_bands - 1]);
+    if (num_bands > 1)
+        mp_thread_pool_wait(cache->pool);
+}
+
 // Convert the src image to imgfmt (which should be a 444 format)
 static struct mp_image *chroma_up(struct mp_draw_sub_cache *cache, int imgfmt,
                                   struct mp_image *src)
@@ -504,6 +745,18 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
     if (!cache_)
         cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
 
+    // Worker threads only for persistent caches, i.e. repeated drawing.
+    if (cache && !cache_->pool_init) {
+        cache_->pool_init = true;
+        cache_->threads = 1;
+        int threads = MPCLAMP(av_cpu_count(), 1, MAX_THREADS);
+        if (threads > 1) {
+            cache_->pool = mp_thread_pool_create(cache_, threads - 1);
+            if (cache_->pool)
+                cache_->threads = threads;
+        }
+    }
+
     int format, bits;
     get_closest_y444_format(dst->imgfmt, &format, &bits);
 
@@ -522,11 +775,10 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
         if (!temp)
             continue; // on OOM, skip region
 
-        if (sbs->format == SUBBITMAP_RGBA) {
-            draw_rgba(cache_, bb, temp, bits, sbs);
-        } else if (sbs->format == SUBBITMAP_LIBASS) {
-            draw_ass(cache_, bb, temp, bits, sbs);
-        }
+        struct part *part = NULL;
+        if (sbs->format == SUBBITMAP_RGBA)
+            part = prepare_rgba(cache_, bb, temp, sbs);
+        draw_region(cache_, part, bb, temp, bits, sbs);
 
         chroma_down(&dst_region, temp);
     }
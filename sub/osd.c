@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include <libavutil/common.h>
 
@@ -105,7 +106,7 @@ const struct m_sub_options sub_style_conf = {
     .change_flags = UPDATE_OSD,
 };
 
-static bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b)
+bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b)
 {
     return a.w == b.w && a.h == b.h && a.ml == b.ml && a.mt == b.mt
         && a.mr == b.mr && a.mb == b.mb
@@ -131,6 +132,7 @@ struct osd_state *osd_create(struct mpv_global *global)
             .type = n,
             .text = talloc_strdup(obj, ""),
             .progbar_state = {.type = -1},
+            .sub_scale = 1,
         };
         osd->objs[n] = obj;
     }
@@ -258,8 +260,69 @@ void osd_resize(struct osd_state *osd, struct mp_osd_res res)
     pthread_mutex_unlock(&osd->lock);
 }
 
+// With --sub-render-height=auto, subtitles are rendered at half resolution if
+// getting them takes longer than this (seconds, on average), and at full
+// resolution again if that is expected to take less than SUB_FAST_TIME.
+#define SUB_SLOW_TIME 0.010
+#define SUB_FAST_TIME 0.004
+
+// Factor by which to reduce the subtitle render resolution.
+static double get_sub_scale(struct osd_state *osd, struct osd_object *obj,
+                            int draw_flags)
+{
+    int height = osd->opts->sub_render_height;
+    if (!(draw_flags & OSD_DRAW_ALLOW_SCALE) || !height || obj->vo_res.h < 1)
+        return 1;
+    if (height > 0)
+        return MPMIN(1, height / (double)obj->vo_res.h);
+
+    // The cost of rendering is roughly proportional to the number of pixels.
+    double full_time = obj->sub_render_time / (obj->sub_scale * obj->sub_scale);
+    if (obj->sub_scale == 1 && obj->sub_render_time > SUB_SLOW_TIME) {
+        MP_VERBOSE(osd, "Rendering subtitles at reduced resolution.\n");
+        obj->sub_scale = 0.5;
+    } else if (obj->sub_scale < 1 && full_time < SUB_FAST_TIME) {
+        MP_VERBOSE(osd, "Rendering subtitles at full resolution.\n");
+        obj->sub_scale = 1;
+    }
+    return obj->sub_scale;
+}
+
+static struct mp_osd_res scale_res(struct mp_osd_res res, double f)
+{
+    return (struct mp_osd_res){
+        .w = MPMAX(lrint(res.w * f), 1),
+        .h = MPMAX(lrint(res.h * f), 1),
+        .mt = lrint(res.mt * f),
+        .mb = lrint(res.mb * f),
+        .ml = lrint(res.ml * f),
+        .mr = lrint(res.mr * f),
+        .display_par = res.display_par,
+    };
+}
+
+// Map bitmaps rendered for src to the dst resolution. The parts are copied,
+// because they're owned by the subtitle decoder.
+static void scale_bitmaps(struct osd_object *obj, struct sub_bitmaps *imgs,
+                          struct mp_osd_res src, struct mp_osd_res dst)
+{
+    double fx = dst.w / (double)src.w, fy = dst.h / (double)src.h;
+    MP_TARRAY_GROW(obj, obj->scaled_parts, imgs->num_parts);
+    for (int n = 0; n < imgs->num_parts; n++) {
+        struct sub_bitmap b = imgs->parts[n];
+        int x1 = lrint((b.x + b.dw) * fx), y1 = lrint((b.y + b.dh) * fy);
+        b.x = lrint(b.x * fx);
+        b.y = lrint(b.y * fy);
+        b.dw = x1 - b.x;
+        b.dh = y1 - b.y;
+        obj->scaled_parts[n] = b;
+    }
+    imgs->parts = obj->scaled_parts;
+}
+
 static void render_object(struct osd_state *osd, struct osd_object *obj,
                           struct mp_osd_res res, double video_pts,
+                          int draw_flags,
                           const bool sub_formats[SUBBITMAP_COUNT],
                           struct sub_bitmaps *out_imgs)
 {
@@ -278,7 +341,20 @@ static void render_object(struct osd_state *osd, struct osd_object *obj,
             double sub_pts = video_pts;
             if (sub_pts != MP_NOPTS_VALUE)
                 sub_pts -= opts->sub_delay;
-            sub_get_bitmaps(obj->sub, obj->vo_res, format, sub_pts, out_imgs);
+            double scale = get_sub_scale(osd, obj, draw_flags);
+            struct mp_osd_res sub_res = obj->vo_res;
+            if (scale < 1)
+                sub_res = scale_res(obj->vo_res, scale);
+            int64_t start = mp_time_us();
+            sub_get_bitmaps(obj->sub, sub_res, format, sub_pts, out_imgs);
+            // Only new bitmaps are rendered; others are just returned again.
+            if (out_imgs->change_id) {
+                double t = (mp_time_us() - start) / 1e6;
+                obj->sub_render_time = obj->sub_render_time > 0
+                    ? obj->sub_render_time * 0.9 + t * 0.1 : t;
+            }
+            if (scale < 1 && out_imgs->num_parts)
+                scale_bitmaps(obj, out_imgs, sub_res, obj->vo_res);
         }
     } else if (obj->type == OSDTYPE_EXTERNAL2) {
         if (obj->external2 && obj->external2->format) {
@@ -328,7 +404,7 @@ void osd_draw(struct osd_state *osd, struct mp_osd_res res,
             sub_lock(obj->sub);
 
         struct sub_bitmaps imgs;
-        render_object(osd, obj, res, video_pts, formats, &imgs);
+        render_object(osd, obj, res, video_pts, draw_flags, formats, &imgs);
         if (imgs.num_parts > 0) {
             if (formats[imgs.format]) {
                 cb(cb_ctx, &imgs);
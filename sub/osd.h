@@ -73,6 +73,15 @@ struct sub_bitmaps {
     // box. (The origin of the box is at (0,0).)
     int packed_w, packed_h;
 
+    // Optional, for updating copies of the packed image incrementally.
+    // packed_id identifies the current contents of the packed image, and is
+    // unique across all producers (0 means unknown). If the consumer has a
+    // copy of the contents identified by packed_base_id, only the dirty
+    // rectangles need to be updated; otherwise the whole bounding box.
+    uint64_t packed_id, packed_base_id;
+    struct mp_rect *dirty;
+    int num_dirty;
+
     int change_id;  // Incremented on each change
 };
 
@@ -173,6 +182,9 @@ enum mp_osd_draw_flags {
     OSD_DRAW_SUB_FILTER = (1 << 0),
     OSD_DRAW_SUB_ONLY   = (1 << 1),
     OSD_DRAW_OSD_ONLY   = (1 << 2),
+    // The caller can draw bitmaps of all formats scaled (sub_bitmap.dw/dh
+    // different from w/h), so subtitles may be rendered at a lower resolution.
+    OSD_DRAW_ALLOW_SCALE = (1 << 3),
 };
 
 void osd_draw(struct osd_state *osd, struct mp_osd_res res,
@@ -193,6 +205,7 @@ void osd_resize(struct osd_state *osd, struct mp_osd_res res);
 
 struct mp_image_params;
 struct mp_osd_res osd_res_from_image_params(const struct mp_image_params *p);
+bool osd_res_equals(struct mp_osd_res a, struct mp_osd_res b);
 
 struct mp_osd_res osd_get_vo_res(struct osd_state *osd);
 
@@ -200,8 +213,10 @@ void osd_rescale_bitmaps(struct sub_bitmaps *imgs, int frame_w, int frame_h,
                          struct mp_osd_res res, double compensate_par);
 
 // defined in osd_libass.c and osd_dummy.c
-void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
-                      char *text);
+// Each (id, layer) pair is rendered and cached separately; higher layers are
+// drawn on top. text==NULL removes all layers of the given id.
+void osd_set_external(struct osd_state *osd, void *id, int layer,
+                      int res_x, int res_y, char *text);
 void osd_get_text_size(struct osd_state *osd, int *out_screen_h, int *out_font_h);
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function);
 
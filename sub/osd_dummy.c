@@ -24,8 +24,8 @@ void osd_object_get_bitmaps(struct osd_state *osd, struct osd_object *obj,
     *out_imgs = (struct sub_bitmaps) {0};
 }
 
-void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
-                      char *text)
+void osd_set_external(struct osd_state *osd, void *id, int layer,
+                      int res_x, int res_y, char *text)
 {
 }
 
@@ -77,6 +77,8 @@ static void destroy_ass_renderer(struct ass_state *ass)
     ass->library = NULL;
     talloc_free(ass->log);
     ass->log = NULL;
+    ass->imgs_valid = false;
+    ass->imgs = NULL;
 }
 
 static void destroy_external(struct osd_external *ext)
@@ -175,6 +177,77 @@ static void clear_ass(struct ass_state *ass)
         ass_flush_events(ass->track);
 }
 
+static uint64_t hash_data(uint64_t h, const void *data, size_t size)
+{
+    // FNV-1a
+    const unsigned char *p = data;
+    for (size_t n = 0; n < size; n++)
+        h = (h ^ p[n]) * 0x100000001b3ULL;
+    return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s)
+{
+    return hash_data(h, s ? s : "", s ? strlen(s) + 1 : 0);
+}
+
+#define HASH_VAL(h, v) hash_data(h, &(v), sizeof(v))
+
+// Hash everything in the track that affects rendering.
+static uint64_t hash_track(ASS_Track *track)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = HASH_VAL(h, track->PlayResX);
+    h = HASH_VAL(h, track->PlayResY);
+    for (int n = 0; n < track->n_styles; n++) {
+        ASS_Style *st = &track->styles[n];
+        h = hash_str(h, st->Name);
+        h = hash_str(h, st->FontName);
+        h = HASH_VAL(h, st->FontSize);
+        h = HASH_VAL(h, st->PrimaryColour);
+        h = HASH_VAL(h, st->SecondaryColour);
+        h = HASH_VAL(h, st->OutlineColour);
+        h = HASH_VAL(h, st->BackColour);
+        h = HASH_VAL(h, st->Bold);
+        h = HASH_VAL(h, st->Italic);
+        h = HASH_VAL(h, st->ScaleX);
+        h = HASH_VAL(h, st->ScaleY);
+        h = HASH_VAL(h, st->Spacing);
+        h = HASH_VAL(h, st->BorderStyle);
+        h = HASH_VAL(h, st->Outline);
+        h = HASH_VAL(h, st->Shadow);
+        h = HASH_VAL(h, st->Alignment);
+        h = HASH_VAL(h, st->MarginL);
+        h = HASH_VAL(h, st->MarginR);
+        h = HASH_VAL(h, st->MarginV);
+        h = HASH_VAL(h, st->Blur);
+#ifdef ASS_JUSTIFY_LEFT
+        h = HASH_VAL(h, st->Justify);
+#endif
+    }
+    for (int n = 0; n < track->n_events; n++) {
+        ASS_Event *ev = &track->events[n];
+        h = HASH_VAL(h, ev->Start);
+        h = HASH_VAL(h, ev->Duration);
+        h = HASH_VAL(h, ev->Layer);
+        h = HASH_VAL(h, ev->Style);
+        h = hash_str(h, ev->Text);
+    }
+    return h;
+}
+
+// Call after the track was rebuilt. If the new contents are the same as the
+// old, the cached images are kept.
+static void check_track_changed(struct ass_state *ass)
+{
+    if (!ass->track)
+        return;
+    uint64_t h = hash_track(ass->track);
+    if (h != ass->hash)
+        ass->imgs_valid = false;
+    ass->hash = h;
+}
+
 void osd_get_function_sym(char *buffer, size_t buffer_size, int osd_function)
 {
     // 0xFF is never valid UTF-8, so we can use it to escape OSD symbols.
@@ -453,6 +526,7 @@ static void update_osd(struct osd_state *osd, struct osd_object *obj)
     clear_ass(&obj->ass);
     update_osd_text(osd, obj);
     update_progbar(osd, obj);
+    check_track_changed(&obj->ass);
 }
 
 static void update_external(struct osd_state *osd, struct osd_object *obj,
@@ -481,36 +555,48 @@ static void update_external(struct osd_state *osd, struct osd_object *obj,
             talloc_free(tmp);
         }
     }
+
+    check_track_changed(&ext->ass);
 }
 
-void osd_set_external(struct osd_state *osd, void *id, int res_x, int res_y,
-                      char *text)
+void osd_set_external(struct osd_state *osd, void *id, int layer,
+                      int res_x, int res_y, char *text)
 {
     pthread_mutex_lock(&osd->lock);
     struct osd_object *obj = osd->objs[OSDTYPE_EXTERNAL];
+
+    if (!text) {
+        for (int n = obj->num_externals - 1; n >= 0; n--) {
+            if (obj->externals[n].id == id) {
+                destroy_external(&obj->externals[n]);
+                MP_TARRAY_REMOVE_AT(obj->externals, obj->num_externals, n);
+                obj->changed = true;
+                osd->want_redraw_notification = true;
+            }
+        }
+        goto done;
+    }
+
     struct osd_external *entry = 0;
     for (int n = 0; n < obj->num_externals; n++) {
-        if (obj->externals[n].id == id) {
+        if (obj->externals[n].id == id && obj->externals[n].layer == layer) {
             entry = &obj->externals[n];
             break;
         }
     }
-    if (!entry && !text)
-        goto done;
 
     if (!entry) {
-        struct osd_external new = { .id = id };
-        MP_TARRAY_APPEND(obj, obj->externals, obj->num_externals, new);
-        entry = &obj->externals[obj->num_externals - 1];
-    }
-
-    if (!text) {
-        int index = entry - &obj->externals[0];
-        destroy_external(entry);
-        MP_TARRAY_REMOVE_AT(obj->externals, obj->num_externals, index);
-        obj->changed = true;
-        osd->want_redraw_notification = true;
-        goto done;
+        // Keep the list sorted by layer; equal layers in creation order.
+        int index = obj->num_externals;
+        for (int n = 0; n < obj->num_externals; n++) {
+            if (obj->externals[n].layer > layer) {
+                index = n;
+                break;
+            }
+        }
+        struct osd_external new = { .id = id, .layer = layer };
+        MP_TARRAY_INSERT_AT(obj, obj->externals, obj->num_externals, index, new);
+        entry = &obj->externals[index];
     }
 
     if (!entry->text || strcmp(entry->text, text) != 0 ||
@@ -537,12 +623,23 @@ static void append_ass(struct ass_state *ass, struct mp_osd_res *res,
         return;
     }
 
+    // The images returned by libass stay valid until the next render call on
+    // the same renderer, so unchanged tracks need no re-rendering.
+    if (ass->imgs_valid && osd_res_equals(ass->imgs_res, *res)) {
+        *img_list = ass->imgs;
+        return;
+    }
+
     ass_set_frame_size(ass->render, res->w, res->h);
     ass_set_aspect_ratio(ass->render, res->display_par, 1.0);
 
     int ass_changed;
     *img_list = ass_render_frame(ass->render, ass->track, 0, &ass_changed);
     *changed |= ass_changed;
+
+    ass->imgs = *img_list;
+    ass->imgs_res = *res;
+    ass->imgs_valid = true;
 }
 
 void osd_object_get_bitmaps(struct osd_state *osd, struct osd_object *obj,
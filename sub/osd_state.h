@@ -22,6 +22,13 @@ struct ass_state {
     struct ass_track *track;
     struct ass_renderer *render;
     struct ass_library *library;
+
+    // Result of the last ass_render_frame() call, reused as long as the
+    // content hash and the target resolution are unchanged.
+    uint64_t hash;
+    bool imgs_valid;
+    struct mp_osd_res imgs_res;
+    struct ass_image *imgs;
 };
 
 struct osd_object {
@@ -35,6 +42,9 @@ struct osd_object {
 
     // OSDTYPE_SUB/OSDTYPE_SUB2
     struct dec_sub *sub;
+    double sub_scale;           // render resolution factor (--sub-render-height)
+    double sub_render_time;     // average time spent on getting the bitmaps
+    struct sub_bitmap *scaled_parts;
 
     // OSDTYPE_EXTERNAL
     struct osd_external *externals;
@@ -56,6 +66,7 @@ struct osd_object {
 
 struct osd_external {
     void *id;
+    int layer;
     char *text;
     int res_x, res_y;
     struct ass_state ass;
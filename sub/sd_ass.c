@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <ass/ass.h>
@@ -30,17 +31,37 @@
 #include "common/common.h"
 #include "common/msg.h"
 #include "demux/demux.h"
+#include "osdep/threads.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
 #include "dec_sub.h"
 #include "ass_mp.h"
+#include "ass_index.h"
 #include "sd.h"
 
+// Renderer configuration the render-ahead slots are valid for.
+struct ahead_key {
+    struct mp_osd_res dim;
+    int format;
+    double scale;
+    int storage_w, storage_h;
+};
+
+struct ahead_slot {
+    struct mp_ass_packer *packer;   // owns the bitmap data of imgs
+    struct sub_bitmaps imgs;
+    bool valid;
+    long long ts;
+    int64_t seq;                    // render_seq of the contents
+    int changed;                    // ass_render_frame() result
+};
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
     struct ass_renderer *ass_renderer;
     struct ass_track *ass_track;
     struct ass_track *shadow_track; // for --sub-ass=no rendering
+    struct mp_ass_index *index;     // over ass_track's events
     bool is_converted;
     struct lavc_conv *converter;
     bool on_top;
@@ -53,10 +74,34 @@ struct sd_ass_priv {
     int64_t *seen_packets;
     int num_seen_packets;
     bool duration_unknown;
+
+    // Protects all libass state if the render-ahead thread exists. Recursive,
+    // because some entry points call each other.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t ahead_thread;
+    bool ahead_running, ahead_terminate;
+    struct ahead_slot *slots;
+    int num_slots;
+    int served_slot;        // slot returned by the last get_bitmaps(), or -1
+    struct ahead_key key;
+    bool key_valid;
+    double ahead_pts;       // last pts passed to get_bitmaps()
+    long long ahead_ts;
+    double frame_duration;  // estimated pts distance between get_bitmaps()
+    int64_t render_seq;     // incremented by each ass_render_frame()
+    int64_t served_seq;     // render_seq of the last returned bitmaps
+    int64_t packer_seq;     // render_seq of ctx->packer's contents
 };
 
+// A prerendered frame is used if its timestamp is this close (in ms) to the
+// requested one, and no event starts or ends in between. Predicted timestamps
+// are off by rounding with typical container timebases.
+#define AHEAD_MAX_TS_DIFF 2
+
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
 static void fill_plaintext(struct sd *sd, double pts);
+static void flush_ahead(struct sd *sd, long long start, long long end);
 
 // Add default styles, if the track does not have any styles yet.
 // Apply style overrides if the user provides any.
@@ -94,7 +139,7 @@ static const char *const font_exts[] = {".ttf", ".ttc", ".otf", NULL};
 
 static bool attachment_is_font(struct mp_log *log, struct demux_attachment *f)
 {
-    if (!f->name || !f->type || !f->data || !f->data_size)
+    if (!f->name || !f->type || !(f->data || f->data_file) || !f->data_size)
         return false;
     for (int n = 0; font_mimetypes[n]; n++) {
         if (strcmp(font_mimetypes[n], f->type) == 0)
@@ -122,25 +167,38 @@ static void add_subtitle_fonts(struct sd *sd)
         return;
     for (int i = 0; i < sd->attachments->num_entries; i++) {
         struct demux_attachment *f = &sd->attachments->entries[i];
-        if (attachment_is_font(sd->log, f))
-            ass_add_font(ctx->ass_library, f->name, f->data, f->data_size);
+        if (!attachment_is_font(sd->log, f))
+            continue;
+        // libass copies the font data, so a mapping can be released at once.
+        void *tmp = talloc_new(NULL);
+        void *data = demux_attachment_get_data(tmp, f);
+        if (data) {
+            ass_add_font(ctx->ass_library, f->name, data, f->data_size);
+        } else {
+            MP_WARN(sd, "Could not read font attachment '%s'.\n", f->name);
+        }
+        talloc_free(tmp);
     }
 }
 
 static void enable_output(struct sd *sd, bool enable)
 {
     struct sd_ass_priv *ctx = sd->priv;
-    if (enable == !!ctx->ass_renderer)
-        return;
-    if (ctx->ass_renderer) {
-        ass_renderer_done(ctx->ass_renderer);
-        ctx->ass_renderer = NULL;
-    } else {
-        ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
+    pthread_mutex_lock(&ctx->lock);
+    if (enable != !!ctx->ass_renderer) {
+        flush_ahead(sd, LLONG_MIN, LLONG_MAX);
+        ctx->key_valid = false;
+        if (ctx->ass_renderer) {
+            ass_renderer_done(ctx->ass_renderer);
+            ctx->ass_renderer = NULL;
+        } else {
+            ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
 
-        mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
-                               sd->global, sd->log);
+            mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
+                                   sd->global, sd->log);
+        }
     }
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 static void update_subtitle_speed(struct sd *sd)
@@ -167,6 +225,11 @@ static int init(struct sd *sd)
     struct sd_ass_priv *ctx = talloc_zero(sd, struct sd_ass_priv);
     sd->priv = ctx;
 
+    mpthread_mutex_init_recursive(&ctx->lock);
+    pthread_cond_init(&ctx->wakeup, NULL);
+    ctx->served_slot = -1;
+    ctx->ahead_pts = MP_NOPTS_VALUE;
+
     char *extradata = sd->codec->extradata;
     int extradata_size = sd->codec->extradata_size;
 
@@ -191,6 +254,7 @@ static int init(struct sd *sd)
         ass_set_style_overrides(ctx->ass_library, opts->ass_force_style_list);
 
     ctx->ass_track = ass_new_track(ctx->ass_library);
+    ctx->index = mp_ass_index_alloc(ctx);
     if (!ctx->is_converted)
         ctx->ass_track->track_type = TRACK_TYPE_ASS;
 
@@ -243,7 +307,7 @@ static bool check_packet_seen(struct sd *sd, int64_t pos)
 
 #define UNKNOWN_DURATION (INT_MAX / 1000)
 
-static void decode(struct sd *sd, struct demux_packet *packet)
+static void decode_locked(struct sd *sd, struct demux_packet *packet)
 {
     struct sd_ass_priv *ctx = sd->priv;
     ASS_Track *track = ctx->ass_track;
@@ -268,16 +332,29 @@ static void decode(struct sd *sd, struct demux_packet *packet)
                                                 track->events[n].Start;
                 }
             }
+            mp_ass_index_invalidate(ctx->index);
         }
     } else {
         // Note that for this packet format, libass has an internal mechanism
         // for discarding duplicate (already seen) packets.
-        ass_process_chunk(track, packet->buffer, packet->len,
-                          llrint(packet->pts * 1000),
-                          llrint(packet->duration * 1000));
+        long long start = llrint(packet->pts * 1000);
+        long long duration = llrint(packet->duration * 1000);
+        ass_process_chunk(track, packet->buffer, packet->len, start, duration);
+        // Prerendered frames the new event could show up in (including the
+        // --sub-fix-timing adjustments) are stale now.
+        int threshold = SUB_GAP_THRESHOLD * 1000;
+        flush_ahead(sd, start - threshold, start + duration + threshold);
     }
 }
 
+static void decode(struct sd *sd, struct demux_packet *packet)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    decode_locked(sd, packet);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 static void configure_ass(struct sd *sd, struct mp_osd_res *dim,
                           bool converted, ASS_Track *track)
 {
@@ -379,20 +456,14 @@ static long long find_timestamp(struct sd *sd, double pts)
     int threshold = SUB_GAP_THRESHOLD * 1000;
     int keep = SUB_GAP_KEEP * 1000;
 
-    // Find the "current" event.
-    ASS_Event *ev[2] = {0};
-    int n_ev = 0;
-    for (int n = 0; n < track->n_events; n++) {
-        ASS_Event *event = &track->events[n];
-        if (ts >= event->Start - threshold && ts <= END(event) + threshold) {
-            if (n_ev >= MP_ARRAY_SIZE(ev))
-                return ts; // multiple overlaps - give up (probably complex subs)
-            ev[n_ev++] = event;
-        }
-    }
-
+    // Find the "current" event. More than 2 means multiple overlaps - give up
+    // (probably complex subs).
+    int *found;
+    int n_ev = mp_ass_index_find(priv->index, track, ts - threshold,
+                                 ts + threshold, 2, &found);
     if (n_ev != 2)
         return ts;
+    ASS_Event *ev[2] = {&track->events[found[0]], &track->events[found[1]]};
 
     // Simple/minor heuristic against destroying typesetting.
     if (ev[0]->Style != ev[1]->Style || has_overrides(ev[0]->Text) ||
@@ -428,8 +499,175 @@ static long long find_timestamp(struct sd *sd, double pts)
 
 #undef END
 
-static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
-                        double pts, struct sub_bitmaps *res)
+// Invalidate the prerendered frames with start <= ts <= end.
+static void flush_ahead(struct sd *sd, long long start, long long end)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    for (int n = 0; n < ctx->num_slots; n++) {
+        struct ahead_slot *s = &ctx->slots[n];
+        if (s->valid && s->ts >= start && s->ts <= end)
+            s->valid = false;
+    }
+    pthread_cond_signal(&ctx->wakeup);
+}
+
+static int find_ahead_slot(struct sd *sd, long long ts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    for (int n = 0; n < ctx->num_slots; n++) {
+        struct ahead_slot *s = &ctx->slots[n];
+        if (s->valid && llabs(s->ts - ts) <= AHEAD_MAX_TS_DIFF &&
+            (s->ts == ts ||
+             !mp_ass_index_has_boundary(ctx->index, ctx->ass_track, s->ts, ts)))
+            return n;
+    }
+    return -1;
+}
+
+static long long ahead_ts_limit(struct sd_ass_priv *ctx)
+{
+    return ctx->ahead_ts + AHEAD_MAX_TS_DIFF +
+           llrint(ctx->num_slots * ctx->frame_duration / ctx->sub_speed * 1000);
+}
+
+// A slot the render-ahead thread can (re)use: not the one currently returned
+// to the caller, and not holding a frame that can still be requested.
+static int get_free_slot(struct sd_ass_priv *ctx)
+{
+    for (int n = 0; n < ctx->num_slots; n++) {
+        struct ahead_slot *s = &ctx->slots[n];
+        if (n == ctx->served_slot)
+            continue;
+        if (!s->valid || s->ts < ctx->ahead_ts - AHEAD_MAX_TS_DIFF ||
+            s->ts > ahead_ts_limit(ctx))
+            return n;
+    }
+    return -1;
+}
+
+// Render one of the frames following the last requested one. The renderer is
+// left configured as by the last get_bitmaps() call. Returns false if there is
+// nothing to do.
+static bool render_ahead(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    if (!ctx->key_valid || !ctx->ass_renderer ||
+        ctx->ahead_pts == MP_NOPTS_VALUE || !(ctx->frame_duration > 0))
+        return false;
+
+    for (int k = 1; k < ctx->num_slots; k++) {
+        double pts = ctx->ahead_pts + k * ctx->frame_duration;
+        long long ts = find_timestamp(sd, pts);
+        if (find_ahead_slot(sd, ts) >= 0)
+            continue;
+        int slot = get_free_slot(ctx);
+        if (slot < 0)
+            return false;
+        struct ahead_slot *s = &ctx->slots[slot];
+        int changed;
+        ASS_Image *imgs = ass_render_frame(ctx->ass_renderer, ctx->ass_track,
+                                           ts, &changed);
+        // The packer's previous contents have nothing to do with the previous
+        // render, so always make it repack.
+        mp_ass_packer_pack(s->packer, &imgs, 1, 2, ctx->key.format, &s->imgs);
+        s->ts = ts;
+        s->seq = ++ctx->render_seq;
+        s->changed = changed;
+        s->valid = true;
+        return true;
+    }
+    return false;
+}
+
+static void *render_ahead_thread(void *p)
+{
+    struct sd *sd = p;
+    struct sd_ass_priv *ctx = sd->priv;
+    mpthread_set_name("sub-render");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->ahead_terminate) {
+        if (render_ahead(sd)) {
+            // Let get_bitmaps() get the lock.
+            pthread_mutex_unlock(&ctx->lock);
+            pthread_mutex_lock(&ctx->lock);
+        } else {
+            pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+static void start_render_ahead(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    if (ctx->ahead_running || ctx->ahead_terminate ||
+        sd->opts->ass_render_ahead < 1)
+        return;
+
+    // One more slot than frames rendered ahead for the current frame.
+    ctx->num_slots = sd->opts->ass_render_ahead + 1;
+    ctx->slots = talloc_zero_array(ctx, struct ahead_slot, ctx->num_slots);
+    for (int n = 0; n < ctx->num_slots; n++)
+        ctx->slots[n].packer = mp_ass_packer_alloc(ctx);
+
+    ctx->ahead_running =
+        !pthread_create(&ctx->ahead_thread, NULL, render_ahead_thread, sd);
+    if (!ctx->ahead_running) {
+        MP_ERR(sd, "Could not create render-ahead thread.\n");
+        ctx->num_slots = 0;
+        ctx->ahead_terminate = true; // don't retry
+    }
+}
+
+static void stop_render_ahead(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    if (!ctx->ahead_running)
+        return;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->ahead_terminate = true;
+    pthread_cond_signal(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+    pthread_join(ctx->ahead_thread, NULL);
+    ctx->ahead_running = false;
+}
+
+// Update the prediction of the following get_bitmaps() calls.
+static void update_ahead_pts(struct sd *sd, double pts, long long ts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    double diff = pts - ctx->ahead_pts;
+    if (ctx->ahead_pts != MP_NOPTS_VALUE && diff > 0 && diff < 1.0) {
+        // Smoothed, because timestamps are often rounded to ms.
+        ctx->frame_duration = ctx->frame_duration > 0
+                            ? ctx->frame_duration * 0.9 + diff * 0.1 : diff;
+    } else if (!(ctx->frame_duration > 0) && ctx->video_fps > 0) {
+        ctx->frame_duration = 1.0 / ctx->video_fps;
+    }
+    ctx->ahead_pts = pts;
+    ctx->ahead_ts = ts;
+    pthread_cond_signal(&ctx->wakeup);
+}
+
+// Set change_id relative to the bitmaps returned by the previous call.
+static void update_change_id(struct sd_ass_priv *ctx, struct sub_bitmaps *res,
+                             int64_t seq, int changed)
+{
+    // libass change detection is relative to the previous render.
+    bool same = seq == ctx->served_seq ||
+                (seq == ctx->served_seq + 1 && !changed);
+    if (same) {
+        res->change_id = 0;
+    } else if (!res->change_id) {
+        res->change_id = 1;
+    }
+    ctx->served_seq = seq;
+}
+
+static void get_bitmaps_locked(struct sd *sd, struct mp_osd_res dim, int format,
+                               double pts, struct sub_bitmaps *res)
 {
     struct sd_ass_priv *ctx = sd->priv;
     struct MPOpts *opts = sd->opts;
@@ -453,16 +691,22 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     }
     configure_ass(sd, &dim, converted, track);
     ass_set_pixel_aspect(renderer, scale);
+    struct ahead_key key = {
+        .dim = dim,
+        .format = format == SUBBITMAP_RGBA ? SUBBITMAP_RGBA : SUBBITMAP_LIBASS,
+        .scale = scale,
+    };
     if (!converted && (!opts->ass_style_override ||
                        opts->ass_vsfilter_blur_compat))
     {
-        ass_set_storage_size(renderer, ctx->video_params.w, ctx->video_params.h);
-    } else {
-        ass_set_storage_size(renderer, 0, 0);
+        key.storage_w = ctx->video_params.w;
+        key.storage_h = ctx->video_params.h;
     }
+    ass_set_storage_size(renderer, key.storage_w, key.storage_h);
     long long ts = find_timestamp(sd, pts);
     if (ctx->duration_unknown && pts != MP_NOPTS_VALUE) {
         mp_ass_flush_old_events(track, ts);
+        mp_ass_index_invalidate(ctx->index);
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
@@ -470,10 +714,45 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     if (no_ass)
         fill_plaintext(sd, pts);
 
+    // The previously returned slot may be reused now.
+    ctx->served_slot = -1;
+
+    // Only native ASS is rendered ahead; converted text subtitles are cheap.
+    if (!converted && !ctx->duration_unknown)
+        start_render_ahead(sd);
+    if (ctx->num_slots) {
+        bool key_ok = ctx->key_valid && !converted &&
+            osd_res_equals(key.dim, ctx->key.dim) &&
+            key.format == ctx->key.format && key.scale == ctx->key.scale &&
+            key.storage_w == ctx->key.storage_w &&
+            key.storage_h == ctx->key.storage_h;
+        if (!key_ok) {
+            flush_ahead(sd, LLONG_MIN, LLONG_MAX);
+            ctx->key = key;
+            ctx->key_valid = !converted;
+        }
+        int slot = find_ahead_slot(sd, ts);
+        update_ahead_pts(sd, pts, ts);
+        if (slot >= 0) {
+            struct ahead_slot *s = &ctx->slots[slot];
+            *res = s->imgs;
+            update_change_id(ctx, res, s->seq, s->changed);
+            ctx->served_slot = slot;
+            goto done;
+        }
+    }
+
     int changed;
     ASS_Image *imgs = ass_render_frame(renderer, track, ts, &changed);
-    mp_ass_packer_pack(ctx->packer, &imgs, 1, changed, format, res);
-
+    int64_t seq = ++ctx->render_seq;
+    // ctx->packer can reuse its contents only if they're from the previous
+    // render (the render-ahead thread may have rendered in between).
+    int pack_changed = ctx->packer_seq == seq - 1 ? changed : 2;
+    ctx->packer_seq = seq;
+    mp_ass_packer_pack(ctx->packer, &imgs, 1, pack_changed, format, res);
+    update_change_id(ctx, res, seq, changed);
+
+done:
     if (!converted && res->num_parts > 0) {
         // mangle_colors() modifies the color field, so copy the thing.
         MP_TARRAY_GROW(ctx, ctx->bs, res->num_parts);
@@ -484,6 +763,15 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     }
 }
 
+static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
+                        double pts, struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    get_bitmaps_locked(sd, dim, format, pts, res);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 struct buf {
     char *start;
     int size;
@@ -556,7 +844,7 @@ static bool is_whitespace_only(char *s, int len)
     return true;
 }
 
-static char *get_text(struct sd *sd, double pts)
+static char *get_text_locked(struct sd *sd, double pts)
 {
     struct sd_ass_priv *ctx = sd->priv;
     ASS_Track *track = ctx->ass_track;
@@ -567,17 +855,17 @@ static char *get_text(struct sd *sd, double pts)
 
     struct buf b = {ctx->last_text, sizeof(ctx->last_text) - 1};
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            if (event->Text) {
-                int start = b.len;
-                ass_to_plaintext(&b, event->Text);
-                if (is_whitespace_only(&b.start[start], b.len - start)) {
-                    b.len = start;
-                } else {
-                    append(&b, '\n');
-                }
+    int *found;
+    int num = mp_ass_index_find(ctx->index, track, ipts + 1, ipts, -1, &found);
+    for (int i = 0; i < num; ++i) {
+        ASS_Event *event = track->events + found[i];
+        if (event->Text) {
+            int start = b.len;
+            ass_to_plaintext(&b, event->Text);
+            if (is_whitespace_only(&b.start[start], b.len - start)) {
+                b.len = start;
+            } else {
+                append(&b, '\n');
             }
         }
     }
@@ -590,6 +878,15 @@ static char *get_text(struct sd *sd, double pts)
     return ctx->last_text;
 }
 
+static char *get_text(struct sd *sd, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    char *text = get_text_locked(sd, pts);
+    pthread_mutex_unlock(&ctx->lock);
+    return text;
+}
+
 static void fill_plaintext(struct sd *sd, double pts)
 {
     struct sd_ass_priv *ctx = sd->priv;
@@ -632,35 +929,44 @@ static void fill_plaintext(struct sd *sd, double pts)
 static void reset(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
     if (sd->opts->sub_clear_on_seek || ctx->duration_unknown) {
         ass_flush_events(ctx->ass_track);
+        mp_ass_index_invalidate(ctx->index);
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
     }
     if (ctx->converter)
         lavc_conv_reset(ctx->converter);
+    flush_ahead(sd, LLONG_MIN, LLONG_MAX);
+    ctx->ahead_pts = MP_NOPTS_VALUE;
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 static void uninit(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
 
+    stop_render_ahead(sd);
     if (ctx->converter)
         lavc_conv_uninit(ctx->converter);
     ass_free_track(ctx->ass_track);
     ass_free_track(ctx->shadow_track);
     enable_output(sd, false);
     ass_library_done(ctx->ass_library);
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
 }
 
-static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
+static int control_locked(struct sd *sd, enum sd_ctrl cmd, void *arg)
 {
     struct sd_ass_priv *ctx = sd->priv;
     switch (cmd) {
     case SD_CTRL_SUB_STEP: {
         double *a = arg;
         long long ts = llrint(a[0] * (1000.0 / ctx->sub_speed));
-        long long res = ass_step_sub(ctx->ass_track, ts, a[1]);
+        long long res = mp_ass_index_step_sub(ctx->index, ctx->ass_track, ts,
+                                              a[1]);
         if (!res)
             return false;
         a[0] = res / (1000.0 / ctx->sub_speed);
@@ -668,22 +974,39 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     }
     case SD_CTRL_SET_VIDEO_PARAMS:
         ctx->video_params = *(struct mp_image_params *)arg;
+        flush_ahead(sd, LLONG_MIN, LLONG_MAX);
         return CONTROL_OK;
     case SD_CTRL_SET_TOP:
         ctx->on_top = *(bool *)arg;
+        flush_ahead(sd, LLONG_MIN, LLONG_MAX);
         return CONTROL_OK;
     case SD_CTRL_SET_VIDEO_DEF_FPS:
         ctx->video_fps = *(double *)arg;
         update_subtitle_speed(sd);
+        flush_ahead(sd, LLONG_MIN, LLONG_MAX);
         return CONTROL_OK;
     case SD_CTRL_UPDATE_SPEED:
         update_subtitle_speed(sd);
+        flush_ahead(sd, LLONG_MIN, LLONG_MAX);
+        return CONTROL_OK;
+    case SD_CTRL_UPDATE_OPTS:
+        // Style options are applied by get_bitmaps() on the next render.
+        flush_ahead(sd, LLONG_MIN, LLONG_MAX);
         return CONTROL_OK;
     default:
         return CONTROL_UNKNOWN;
     }
 }
 
+static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    int r = control_locked(sd, cmd, arg);
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
 const struct sd_functions sd_ass = {
     .name = "ass",
     .accept_packets_in_advance = true,
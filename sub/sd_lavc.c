@@ -69,6 +69,11 @@ struct sd_lavc_priv {
     struct seekpoint *seekpoints;
     int num_seekpoints;
     struct bitmap_packer *packer;
+    // Scaled output of the displayed sub, valid for the given parameters.
+    struct sub_bitmaps cached;
+    struct mp_osd_res cached_res;
+    int cached_w, cached_h;
+    double cached_par;
 };
 
 static int init(struct sd *sd)
@@ -410,20 +415,6 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res d, int format,
     if (!current)
         return;
 
-    MP_TARRAY_GROW(priv, priv->outbitmaps, current->count);
-    for (int n = 0; n < current->count; n++)
-        priv->outbitmaps[n] = current->inbitmaps[n];
-
-    res->parts = priv->outbitmaps;
-    res->num_parts = current->count;
-    if (priv->displayed_id != current->id)
-        res->change_id++;
-    priv->displayed_id = current->id;
-    res->packed = current->data;
-    res->packed_w = current->bound_w;
-    res->packed_h = current->bound_h;
-    res->format = SUBBITMAP_RGBA;
-
     double video_par = 0;
     if (priv->avctx->codec_id == AV_CODEC_ID_DVD_SUBTITLE &&
         opts->stretch_dvd_subs)
@@ -447,7 +438,39 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res d, int format,
         w = priv->video_params.w;
         h = priv->video_params.h;
     }
+
+    // The bitmaps are converted to RGBA on decoding already; only the layout
+    // depends on the output size. Reuse it while the sub is shown unchanged.
+    if (priv->displayed_id == current->id && priv->cached.parts &&
+        osd_res_equals(priv->cached_res, d) && priv->cached_w == w &&
+        priv->cached_h == h && priv->cached_par == video_par)
+    {
+        *res = priv->cached;
+        return;
+    }
+
+    MP_TARRAY_GROW(priv, priv->outbitmaps, current->count);
+    for (int n = 0; n < current->count; n++)
+        priv->outbitmaps[n] = current->inbitmaps[n];
+
+    // Also signal layout changes (not only new subs) to the consumer.
+    res->change_id++;
+    priv->displayed_id = current->id;
+    res->parts = priv->outbitmaps;
+    res->num_parts = current->count;
+    res->packed = current->data;
+    res->packed_w = current->bound_w;
+    res->packed_h = current->bound_h;
+    res->format = SUBBITMAP_RGBA;
+
     osd_rescale_bitmaps(res, w, h, d, video_par);
+
+    priv->cached = *res;
+    priv->cached.change_id = 0;
+    priv->cached_res = d;
+    priv->cached_w = w;
+    priv->cached_h = h;
+    priv->cached_par = video_par;
 }
 
 static bool accepts_packet(struct sd *sd, double min_pts)
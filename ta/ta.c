@@ -55,13 +55,38 @@ union aligned_header {
 #define PTR_TO_HEADER(ptr) (&((union aligned_header *)(ptr) - 1)->ta)
 #define PTR_FROM_HEADER(h) ((void *)((union aligned_header *)(h) + 1))
 
-#define MAX_ALLOC (((size_t)-1) - sizeof(union aligned_header))
+// Set in ta_header.size for allocations carved from an arena.
+#define ARENA_BIT ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+#define MAX_ALLOC ((ARENA_BIT - 1) - sizeof(union aligned_header))
 
 // Needed for non-leaf allocations, or extended features such as destructors.
 struct ta_ext_header {
     struct ta_header *header;  // points back to normal header
     struct ta_header children; // list of children, with this as sentinel
     void (*destructor)(void *);
+    struct ta_arena *arena;    // set if this is a ta_new_arena() context
+};
+
+// Allocations carved from an arena are preceded by a pointer to it, padded
+// so that the ta_header has the same alignment as with malloc().
+union arena_prefix {
+    struct ta_arena *arena;
+    char align_min[MIN_ALIGN];
+};
+
+union arena_block {
+    struct arena_block_h {
+        union arena_block *next;
+    } h;
+    char align_min[(sizeof(struct arena_block_h) + MIN_ALIGN - 1) & ~(MIN_ALIGN - 1)];
+};
+
+struct ta_arena {
+    size_t block_size;
+    union arena_block *blocks;  // first entry is the block used for allocating
+    char *pos, *end;            // free part of the first block
+    union arena_block *large;   // separate blocks for single large allocations
 };
 
 // ta_ext_header.children.size is set to this
@@ -78,6 +103,100 @@ static struct ta_header *get_header(void *ptr)
     return h;
 }
 
+static size_t get_size(struct ta_header *h)
+{
+    return h->size & ~ARENA_BIT;
+}
+
+// Arena new children of h are allocated from, or NULL for malloc().
+static struct ta_arena *get_arena(struct ta_header *h)
+{
+    if (!h)
+        return NULL;
+    if (h->ext && h->ext->arena)
+        return h->ext->arena;
+    if (h->size & ARENA_BIT)
+        return ((union arena_prefix *)h - 1)->arena;
+    return NULL;
+}
+
+// Return space for a ta_header and size bytes, or NULL on OOM.
+static struct ta_header *arena_alloc(struct ta_arena *a, size_t size)
+{
+    size_t need = sizeof(union arena_prefix) + sizeof(union aligned_header) +
+                  ((size + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1));
+    char *p;
+    if (need > a->block_size / 4) {
+        // Too large to waste the rest of a block; use a separate one.
+        union arena_block *b = malloc(sizeof(*b) + need);
+        if (!b)
+            return NULL;
+        b->h.next = a->large;
+        a->large = b;
+        p = (char *)(b + 1);
+    } else {
+        if (!a->blocks || a->end - a->pos < need) {
+            union arena_block *b = malloc(sizeof(*b) + a->block_size);
+            if (!b)
+                return NULL;
+            b->h.next = a->blocks;
+            a->blocks = b;
+            a->pos = (char *)(b + 1);
+            a->end = a->pos + a->block_size;
+        }
+        p = a->pos;
+        a->pos += need;
+    }
+    ((union arena_prefix *)p)->arena = a;
+    return (struct ta_header *)((union arena_prefix *)p + 1);
+}
+
+static void free_blocks(union arena_block *b)
+{
+    while (b) {
+        union arena_block *next = b->h.next;
+        free(b);
+        b = next;
+    }
+}
+
+// Free all blocks, except the first one if keep_one is set.
+static void arena_reset(struct ta_arena *a, bool keep_one)
+{
+    free_blocks(a->large);
+    a->large = NULL;
+    if (keep_one && a->blocks) {
+        free_blocks(a->blocks->h.next);
+        a->blocks->h.next = NULL;
+        a->pos = (char *)(a->blocks + 1);
+        a->end = a->pos + a->block_size;
+    } else {
+        free_blocks(a->blocks);
+        a->blocks = NULL;
+        a->pos = a->end = NULL;
+    }
+}
+
+// Allocate a ta_header plus size bytes, from malloc() or the parent's arena.
+static struct ta_header *alloc_header(struct ta_header *parent, size_t size,
+                                      bool zero)
+{
+    struct ta_arena *arena = get_arena(parent);
+    struct ta_header *h;
+    if (arena) {
+        h = arena_alloc(arena, size);
+        if (h && zero)
+            memset(PTR_FROM_HEADER(h), 0, size);
+    } else if (zero) {
+        h = calloc(1, sizeof(union aligned_header) + size);
+    } else {
+        h = malloc(sizeof(union aligned_header) + size);
+    }
+    if (h)
+        *h = (struct ta_header) {.size = size | (arena ? ARENA_BIT : 0)};
+    return h;
+}
+
 static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
@@ -115,6 +234,9 @@ bool ta_set_parent(void *ptr, void *ta_parent)
     struct ta_header *ch = get_header(ptr);
     if (!ch)
         return true;
+    // Arena memory is released with the arena, so it can't be moved elsewhere.
+    assert(!(ch->size & ARENA_BIT) ||
+           get_arena(get_header(ta_parent)) == ((union arena_prefix *)ch - 1)->arena);
     struct ta_ext_header *parent_eh = get_or_alloc_ext_header(ta_parent);
     if (ta_parent && !parent_eh) // do nothing on OOM
         return false;
@@ -144,10 +266,9 @@ void *ta_alloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
-    struct ta_header *h = malloc(sizeof(union aligned_header) + size);
+    struct ta_header *h = alloc_header(get_header(ta_parent), size, false);
     if (!h)
         return NULL;
-    *h = (struct ta_header) {.size = size};
     ta_dbg_add(h);
     void *ptr = PTR_FROM_HEADER(h);
     if (!ta_set_parent(ptr, ta_parent)) {
@@ -164,10 +285,9 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
-    struct ta_header *h = calloc(1, sizeof(union aligned_header) + size);
+    struct ta_header *h = alloc_header(get_header(ta_parent), size, true);
     if (!h)
         return NULL;
-    *h = (struct ta_header) {.size = size};
     ta_dbg_add(h);
     void *ptr = PTR_FROM_HEADER(h);
     if (!ta_set_parent(ptr, ta_parent)) {
@@ -201,13 +321,28 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
         return ta_alloc_size(ta_parent, size);
     struct ta_header *h = get_header(ptr);
     struct ta_header *old_h = h;
-    if (h->size == size)
+    if (get_size(h) == size)
         return ptr;
-    ta_dbg_remove(h);
-    h = realloc(h, sizeof(union aligned_header) + size);
-    ta_dbg_add(h ? h : old_h);
-    if (!h)
-        return NULL;
+    if (h->size & ARENA_BIT) {
+        // Shrink in place, or copy to a new part of the arena.
+        if (size < get_size(h)) {
+            h->size = size | ARENA_BIT;
+            return ptr;
+        }
+        h = arena_alloc(((union arena_prefix *)h - 1)->arena, size);
+        if (!h)
+            return NULL;
+        ta_dbg_remove(old_h);
+        memcpy(h, old_h, sizeof(union aligned_header) + get_size(old_h));
+        ta_dbg_add(h);
+        size |= ARENA_BIT;
+    } else {
+        ta_dbg_remove(h);
+        h = realloc(h, sizeof(union aligned_header) + size);
+        ta_dbg_add(h ? h : old_h);
+        if (!h)
+            return NULL;
+    }
     h->size = size;
     if (h != old_h) {
         if (h->next) {
@@ -232,11 +367,12 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
 size_t ta_get_size(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
-    return h ? h->size : 0;
+    return h ? get_size(h) : 0;
 }
 
 /* Free all allocations that (recursively) have ptr as parent allocation, but
  * do not free ptr itself.
+ * If ptr is an arena, its memory is reused for new allocations.
  */
 void ta_free_children(void *ptr)
 {
@@ -246,6 +382,8 @@ void ta_free_children(void *ptr)
         return;
     while (eh->children.next != &eh->children)
         ta_free(PTR_FROM_HEADER(eh->children.next));
+    if (eh->arena)
+        arena_reset(eh->arena, true);
 }
 
 /* Free the given allocation, and all of its direct and indirect children.
@@ -264,8 +402,11 @@ void ta_free(void *ptr)
         h->prev->next = h->next;
     }
     ta_dbg_remove(h);
+    if (h->ext && h->ext->arena)
+        arena_reset(h->ext->arena, false);
     free(h->ext);
-    free(h);
+    if (!(h->size & ARENA_BIT))
+        free(h);
 }
 
 /* Set a destructor that is to be called when the given allocation is freed.
@@ -289,6 +430,30 @@ bool ta_set_destructor(void *ptr, void (*destructor)(void *))
     return true;
 }
 
+/* Create an empty allocation, whose children (and their children etc.) are
+ * allocated from large blocks of memory, instead of using malloc() for each.
+ * Freeing the arena or ta_free_children() on it releases the memory. Other
+ * than that, children behave like normal allocations (destructors are run,
+ * they can be reallocated or freed individually), but individually freed
+ * memory is not reused, and they can't be moved out of the arena with
+ * ta_set_parent().
+ * This is for short-lived temporary contexts with many small allocations.
+ * block_size==0 picks a default.
+ * Returns NULL on OOM.
+ */
+void *ta_new_arena(void *ta_parent, size_t block_size)
+{
+    struct ta_arena *a = ta_alloc_size(ta_parent, sizeof(*a));
+    struct ta_ext_header *eh = get_or_alloc_ext_header(a);
+    if (!eh) {
+        ta_free(a);
+        return NULL;
+    }
+    *a = (struct ta_arena){ .block_size = block_size ? block_size : 16 * 1024 };
+    eh->arena = a;
+    return a;
+}
+
 /* Return the ptr's parent allocation, or NULL if there isn't any.
  *
  * Warning: this has O(N) runtime complexity with N sibling allocations!
@@ -352,7 +517,7 @@ static size_t get_children_size(struct ta_header *h)
     if (h->ext) {
         struct ta_header *s;
         for (s = h->ext->children.next; s != &h->ext->children; s = s->next)
-            size += s->size + get_children_size(s);
+            size += get_size(s) + get_children_size(s);
     }
     return size;
 }
@@ -376,16 +541,16 @@ static void print_leak_report(void)
                     snprintf(name, sizeof(name), "%s", cur->name);
                 if (cur->name == &allocation_is_string) {
                     snprintf(name, sizeof(name), "'%.*s'",
-                             (int)cur->size, (char *)PTR_FROM_HEADER(cur));
+                             (int)get_size(cur), (char *)PTR_FROM_HEADER(cur));
                 }
                 for (int n = 0; n < sizeof(name); n++) {
                     if (name[n] && name[n] < 0x20)
                         name[n] = '.';
                 }
                 fprintf(stderr, "  %-20p %10zu %10zu  %s\n",
-                        cur, cur->size, c_size, name);
+                        cur, get_size(cur), c_size, name);
             }
-            size += cur->size;
+            size += get_size(cur);
             num_blocks += 1;
             // Unlink, and don't confuse valgrind by leaving live pointers.
             cur->leak_next->leak_prev = cur->leak_prev;
@@ -0,0 +1,140 @@
+// Microbenchmarks of hot code paths. Usage:
+//
+//   bench [--json] [--list] [filter...]
+//
+// Only benchmarks whose name contains one of the filter strings are run. Each
+// benchmark is warmed up, and then timed in 11 samples of about 20 ms each.
+// The median is reported, which is stable enough to compare builds on the
+// same machine (keep it otherwise idle, and CPU frequency scaling disabled).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "bench.h"
+#include "common/common.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "osdep/timer.h"
+
+#define NUM_SAMPLES 11
+#define SAMPLE_US 20000
+#define WARMUP_US 50000
+
+volatile int bench_sink;
+
+static const struct bench_case *const all_lists[] = {
+    bench_audio,
+    bench_demux,
+    bench_misc,
+    bench_video,
+};
+
+static int cmp_double(const void *pa, const void *pb)
+{
+    double a = *(const double *)pa, b = *(const double *)pb;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static void run_iterations(const struct bench_case *c, void *ctx, int64_t num)
+{
+    for (int64_t n = 0; n < num; n++)
+        c->run(ctx);
+}
+
+static void run_case(const struct bench_case *c, bool json)
+{
+    void *ctx = c->setup ? c->setup() : NULL;
+
+    // Warm up, and find the number of iterations per sample.
+    int64_t iters = 1, done = 0, elapsed;
+    int64_t start = mp_time_us();
+    while (1) {
+        run_iterations(c, ctx, iters);
+        done += iters;
+        elapsed = mp_time_us() - start;
+        if (elapsed >= WARMUP_US)
+            break;
+        iters *= 2;
+    }
+    iters = MPMAX(1, done * SAMPLE_US / MPMAX(elapsed, 1));
+
+    double ns[NUM_SAMPLES];
+    for (int s = 0; s < NUM_SAMPLES; s++) {
+        int64_t t = mp_time_us();
+        run_iterations(c, ctx, iters);
+        ns[s] = (mp_time_us() - t) * 1000.0 / iters;
+    }
+    qsort(ns, NUM_SAMPLES, sizeof(ns[0]), cmp_double);
+    double median = ns[NUM_SAMPLES / 2];
+    double mbps = c->bytes && median > 0 ? c->bytes / median * 1e3 : 0;
+
+    if (json) {
+        void *tmp = talloc_new(NULL);
+        struct mpv_node root;
+        node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+        talloc_steal(tmp, root.u.list);
+        node_map_add_string(&root, "name", c->name);
+        node_map_add(&root, "median_ns", MPV_FORMAT_DOUBLE)->u.double_ = median;
+        node_map_add(&root, "min_ns", MPV_FORMAT_DOUBLE)->u.double_ = ns[0];
+        node_map_add(&root, "max_ns", MPV_FORMAT_DOUBLE)->u.double_ =
+            ns[NUM_SAMPLES - 1];
+        if (mbps)
+            node_map_add(&root, "mb_per_s", MPV_FORMAT_DOUBLE)->u.double_ = mbps;
+        char *s = talloc_strdup(tmp, "");
+        json_write(&s, &root);
+        printf("%s\n", s);
+        talloc_free(tmp);
+    } else {
+        printf("%-32s %12.1f ns  (min %12.1f)", c->name, median, ns[0]);
+        if (mbps)
+            printf("  %10.1f MB/s", mbps);
+        printf("\n");
+    }
+    fflush(stdout);
+
+    talloc_free(ctx);
+}
+
+static bool matches(const char *name, char **filters, int num_filters)
+{
+    for (int n = 0; n < num_filters; n++) {
+        if (strstr(name, filters[n]))
+            return true;
+    }
+    return !num_filters;
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false, list = false;
+    char **filters = talloc_array(NULL, char *, argc);
+    int num_filters = 0;
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[n], "--list") == 0) {
+            list = true;
+        } else {
+            filters[num_filters++] = argv[n];
+        }
+    }
+
+    mp_time_init();
+
+    for (int l = 0; l < MP_ARRAY_SIZE(all_lists); l++) {
+        for (const struct bench_case *c = all_lists[l]; c->name; c++) {
+            if (!matches(c->name, filters, num_filters))
+                continue;
+            if (list) {
+                printf("%s\n", c->name);
+            } else {
+                run_case(c, json);
+            }
+        }
+    }
+
+    talloc_free(filters);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef MP_BENCH_H
+#define MP_BENCH_H
+
+#include <stdint.h>
+
+// A microbenchmark. setup() creates the input data (as talloc context, which
+// is freed after the benchmark), and run() performs one iteration on it.
+struct bench_case {
+    const char *name;
+    void *(*setup)(void);
+    void (*run)(void *ctx);
+    // Bytes processed per iteration, for reporting throughput (0 if none).
+    int64_t bytes;
+};
+
+// {0} terminated lists, one for each file.
+extern const struct bench_case bench_audio[];
+extern const struct bench_case bench_demux[];
+extern const struct bench_case bench_misc[];
+extern const struct bench_case bench_video[];
+
+// Store results here, so that the compiler can't optimize the work away.
+extern volatile int bench_sink;
+
+// Simple deterministic PRNG, so that every run uses the same data.
+static inline uint32_t bench_rand(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+#endif
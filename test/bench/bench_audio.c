@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "bench.h"
+#include "common/common.h"
+#include "audio/filter/af.h"
+#include "audio/filter/biquad.h"
+
+#define SAMPLES (4096 * 2) // stereo
+
+struct volume_ctx {
+    int16_t s16[SAMPLES];
+    float f[SAMPLES];
+};
+
+static void *setup_volume(void)
+{
+    struct volume_ctx *ctx = talloc_zero(NULL, struct volume_ctx);
+    uint32_t r = 1;
+    for (int n = 0; n < SAMPLES; n++) {
+        ctx->s16[n] = bench_rand(&r) & 0xFFFF;
+        ctx->f[n] = (int16_t)(bench_rand(&r) & 0xFFFF) / 32768.0f;
+    }
+    return ctx;
+}
+
+// The gain is 1.0, so that the data doesn't change between iterations.
+static void run_volume_s16(void *p)
+{
+    struct volume_ctx *ctx = p;
+    af_volume_s16(ctx->s16, SAMPLES, 256);
+}
+
+static void run_volume_float(void *p)
+{
+    struct volume_ctx *ctx = p;
+    af_volume_clip_float(ctx->f, SAMPLES, 1.0f);
+}
+
+static void run_sum_squares_s16(void *p)
+{
+    struct volume_ctx *ctx = p;
+    bench_sink = af_sum_squares_s16(ctx->s16, SAMPLES);
+}
+
+static void run_sum_squares_float(void *p)
+{
+    struct volume_ctx *ctx = p;
+    bench_sink = af_sum_squares_float(ctx->f, SAMPLES) * 1000;
+}
+
+#define BQ_CHANNELS 8
+#define BQ_STAGES 10 // like af_equalizer
+#define BQ_FRAMES 4096
+
+struct biquad_ctx {
+    struct af_biquad *bq;
+    float in[BQ_FRAMES * BQ_CHANNELS];
+    float buf[BQ_FRAMES * BQ_CHANNELS];
+};
+
+static void *setup_biquad(void)
+{
+    struct biquad_ctx *ctx = talloc_zero(NULL, struct biquad_ctx);
+    ctx->bq = af_biquad_create(ctx, BQ_CHANNELS, BQ_STAGES);
+    for (int s = 0; s < BQ_STAGES; s++) {
+        for (int c = 0; c < BQ_CHANNELS; c++) {
+            af_biquad_set(ctx->bq, s, c, (struct af_biquad_coeffs){
+                .b0 = 1.0f, .b1 = 0.2f, .b2 = 0.1f, .a1 = -0.3f, .a2 = 0.2f});
+        }
+    }
+    uint32_t r = 1;
+    for (int n = 0; n < BQ_FRAMES * BQ_CHANNELS; n++)
+        ctx->in[n] = (int16_t)(bench_rand(&r) & 0xFFFF) / 32768.0f;
+    return ctx;
+}
+
+// Filtering is in place, so restore the input every time (the filter is
+// stable, but repeated filtering would drift towards denormals).
+static void run_biquad(void *p)
+{
+    struct biquad_ctx *ctx = p;
+    memcpy(ctx->buf, ctx->in, sizeof(ctx->buf));
+    af_biquad_process(ctx->bq, ctx->buf, BQ_FRAMES);
+}
+
+const struct bench_case bench_audio[] = {
+    {"volume-s16", setup_volume, run_volume_s16, SAMPLES * 2},
+    {"volume-float", setup_volume, run_volume_float, SAMPLES * 4},
+    {"sum-squares-s16", setup_volume, run_sum_squares_s16, SAMPLES * 2},
+    {"sum-squares-float", setup_volume, run_sum_squares_float, SAMPLES * 4},
+    {"biquad-8ch-10", setup_biquad, run_biquad, BQ_FRAMES * BQ_CHANNELS * 4},
+    {0}
+};
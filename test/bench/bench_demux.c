@@ -0,0 +1,66 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "common/common.h"
+#include "demux/ebml.h"
+
+#define NUM_VALUES 4096
+
+// Encode v as EBML variable length number with len bytes.
+static void put_vlen(bstr *dst, void *ta, uint64_t v, int len)
+{
+    unsigned char buf[8];
+    v |= 1ULL << (7 * len);
+    for (int n = len - 1; n >= 0; n--) {
+        buf[n] = v & 0xFF;
+        v >>= 8;
+    }
+    bstr_xappend(ta, dst, (bstr){buf, len});
+}
+
+// Sizes as used by EBML lacing and element headers in Matroska blocks: mostly
+// 1-2 bytes, a few longer ones.
+static void *setup_vlen(void)
+{
+    void *ctx = talloc_new(NULL);
+    bstr *data = talloc_zero(ctx, bstr);
+    uint32_t r = 1;
+    for (int n = 0; n < NUM_VALUES; n++) {
+        uint32_t x = bench_rand(&r);
+        int len = x % 16 < 10 ? 1 : (x % 16 < 15 ? 2 : 4);
+        put_vlen(data, ctx, (x >> 4) & ((1u << (7 * len - 1)) - 1), len);
+    }
+    return data;
+}
+
+static void run_vlen_uint(void *p)
+{
+    bstr buf = *(bstr *)p;
+    uint64_t sum = 0;
+    while (buf.len) {
+        uint64_t v = ebml_read_vlen_uint(&buf);
+        if (v == EBML_UINT_INVALID)
+            abort();
+        sum += v;
+    }
+    bench_sink = sum;
+}
+
+static void run_vlen_int(void *p)
+{
+    bstr buf = *(bstr *)p;
+    int64_t sum = 0;
+    while (buf.len) {
+        int64_t v = ebml_read_vlen_int(&buf);
+        if (v == EBML_INT_INVALID)
+            abort();
+        sum += v;
+    }
+    bench_sink = sum;
+}
+
+const struct bench_case bench_demux[] = {
+    {"ebml-vlen-uint", setup_vlen, run_vlen_uint},
+    {"ebml-vlen-int", setup_vlen, run_vlen_int},
+    {0}
+};
@@ -0,0 +1,219 @@
+#include "bench.h"
+#include "common/common.h"
+#include "misc/bstr.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "misc/ring.h"
+#include "options/m_property.h"
+
+#define PLAYLIST_ENTRIES 1000
+
+struct json_ctx {
+    char *json;
+    struct mpv_node node;
+};
+
+// Playlist-like structure, as sent over the JSON IPC.
+static void *setup_json(void)
+{
+    struct json_ctx *ctx = talloc_zero(NULL, struct json_ctx);
+    node_init(&ctx->node, MPV_FORMAT_NODE_ARRAY, NULL);
+    talloc_steal(ctx, ctx->node.u.list);
+    for (int n = 0; n < PLAYLIST_ENTRIES; n++) {
+        struct mpv_node *e = node_array_add(&ctx->node, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "filename", talloc_asprintf(ctx,
+            "/home/user/Music/Some Artist/Album (2016)/%02d - \"Title\".flac", n));
+        node_map_add(e, "current", MPV_FORMAT_FLAG)->u.flag = n == 0;
+        node_map_add(e, "id", MPV_FORMAT_INT64)->u.int64 = n + 1;
+        node_map_add(e, "duration", MPV_FORMAT_DOUBLE)->u.double_ = n * 1.5;
+    }
+    ctx->json = talloc_strdup(ctx, "");
+    json_write(&ctx->json, &ctx->node);
+    return ctx;
+}
+
+static void run_json_parse(void *p)
+{
+    struct json_ctx *ctx = p;
+    void *tmp = talloc_new(NULL);
+    char *s = talloc_strdup(tmp, ctx->json);
+    struct mpv_node node;
+    json_parse(tmp, &node, &s, 10);
+    talloc_free(tmp);
+}
+
+static void run_json_write(void *p)
+{
+    struct json_ctx *ctx = p;
+    char *s = talloc_strdup(NULL, "");
+    json_write(&s, &ctx->node);
+    talloc_free(s);
+}
+
+// A config file-like text, with options as key=value lines.
+static void *setup_bstr(void)
+{
+    bstr text = {0};
+    void *ctx = talloc_new(NULL);
+    uint32_t r = 1;
+    for (int n = 0; n < 500; n++) {
+        bstr_xappend_asprintf(ctx, &text, "Option-Name-%u=value %u, with some "
+                              "more text\n", bench_rand(&r) % 1000,
+                              bench_rand(&r));
+    }
+    bstr *res = talloc_ptrtype(ctx, res);
+    *res = text;
+    return res;
+}
+
+static void run_bstr_split(void *p)
+{
+    bstr rest = *(bstr *)p;
+    int found = 0;
+    while (rest.len) {
+        bstr line = bstr_strip_linebreaks(bstr_getline(rest, &rest));
+        bstr key, value;
+        if (bstr_split_tok(line, "=", &key, &value) &&
+            bstrcasecmp(key, bstr0("option-name-500")) == 0)
+            found++;
+    }
+    bench_sink = found;
+}
+
+static void run_bstr_find(void *p)
+{
+    bstr *text = p;
+    bench_sink = bstr_find(*text, bstr0("Option-Name-1000"));
+}
+
+static void run_bstrchr(void *p)
+{
+    bstr *text = p;
+    bench_sink = bstrchr(*text, '#');
+}
+
+static void run_bstrcspn(void *p)
+{
+    bstr rest = *(bstr *)p;
+    int n = 0;
+    while (rest.len) {
+        int pos = bstrcspn(rest, ",=");
+        rest = bstr_cut(rest, pos + 1);
+        n++;
+    }
+    bench_sink = n;
+}
+
+static void run_bstr_split_tok(void *p)
+{
+    bstr rest = *(bstr *)p;
+    bstr left;
+    int n = 0;
+    while (bstr_split_tok(rest, ", ", &left, &rest))
+        n++;
+    bench_sink = n;
+}
+
+static void run_bstr_splitlines(void *p)
+{
+    bstr *lines = bstr_splitlines(NULL, *(bstr *)p);
+    talloc_free(lines);
+}
+
+static void run_utf8_validate(void *p)
+{
+    bench_sink = bstr_validate_utf8(*(bstr *)p);
+}
+
+static void run_bstr_append(void *p)
+{
+    bstr s = {0};
+    for (int n = 0; n < 100; n++)
+        bstr_xappend_asprintf(NULL, &s, "%d: %s\n", n, "some text");
+    talloc_free(s.start);
+}
+
+#define RING_SIZE (64 * 1024)
+#define RING_CHUNK 4096
+
+struct ring_ctx {
+    struct mp_ring *ring;
+    unsigned char buf[RING_CHUNK];
+};
+
+static void *setup_ring(void)
+{
+    struct ring_ctx *ctx = talloc_zero(NULL, struct ring_ctx);
+    ctx->ring = mp_ring_new(ctx, RING_SIZE);
+    // Not aligned with the ring size, so that wraparound is included.
+    mp_ring_write(ctx->ring, ctx->buf, 1000);
+    return ctx;
+}
+
+static void run_ring(void *p)
+{
+    struct ring_ctx *ctx = p;
+    mp_ring_write(ctx->ring, ctx->buf, RING_CHUNK);
+    mp_ring_read(ctx->ring, ctx->buf, RING_CHUNK);
+}
+
+#define NUM_PROPS 300
+
+struct prop_ctx {
+    struct m_property *list;
+    struct m_property_index *index;
+    char **names;
+    int pos;
+};
+
+static int prop_call(void *ctx, struct m_property *prop, int action, void *arg)
+{
+    return m_property_double_ro(action, arg, 1.0);
+}
+
+// Roughly the size of the player's property list.
+static void *setup_props(void)
+{
+    struct prop_ctx *ctx = talloc_zero(NULL, struct prop_ctx);
+    ctx->list = talloc_zero_array(ctx, struct m_property, NUM_PROPS + 1);
+    ctx->names = talloc_array(ctx, char *, NUM_PROPS);
+    for (int n = 0; n < NUM_PROPS; n++) {
+        ctx->names[n] = talloc_asprintf(ctx, "property-name-%d", n);
+        ctx->list[n] = (struct m_property){ctx->names[n], prop_call};
+    }
+    ctx->index = m_property_index_create(ctx, ctx->list);
+    return ctx;
+}
+
+static void run_prop_list_find(void *p)
+{
+    struct prop_ctx *ctx = p;
+    ctx->pos = (ctx->pos + 7) % NUM_PROPS;
+    m_property_list_find(ctx->list, ctx->names[ctx->pos]);
+}
+
+static void run_prop_do(void *p)
+{
+    struct prop_ctx *ctx = p;
+    ctx->pos = (ctx->pos + 7) % NUM_PROPS;
+    double val;
+    m_property_do(NULL, ctx->index, ctx->names[ctx->pos], M_PROPERTY_GET,
+                  &val, NULL);
+}
+
+const struct bench_case bench_misc[] = {
+    {"json-parse", setup_json, run_json_parse},
+    {"json-write", setup_json, run_json_write},
+    {"bstr-split-lines", setup_bstr, run_bstr_split},
+    {"bstr-find", setup_bstr, run_bstr_find},
+    {"bstrchr", setup_bstr, run_bstrchr},
+    {"bstrcspn", setup_bstr, run_bstrcspn},
+    {"bstr-split-tok", setup_bstr, run_bstr_split_tok},
+    {"bstr-splitlines", setup_bstr, run_bstr_splitlines},
+    {"bstr-append", NULL, run_bstr_append},
+    {"utf8-validate", setup_bstr, run_utf8_validate},
+    {"ring-write-read", setup_ring, run_ring, 2 * RING_CHUNK},
+    {"property-list-find", setup_props, run_prop_list_find},
+    {"property-get", setup_props, run_prop_do},
+    {0}
+};
@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "bench.h"
+#include "common/common.h"
+#include "sub/draw_bmp.h"
+#include "sub/osd.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+
+#define W 1920
+#define H 1080
+
+#define GLYPHS 40
+#define GLYPH_W 28
+#define GLYPH_H 40
+
+struct draw_ctx {
+    struct mp_image *img;
+    struct mp_draw_sub_cache *cache;
+    struct sub_bitmaps sbs;
+    struct sub_bitmap parts[GLYPHS];
+    unsigned char alpha[GLYPH_W * GLYPH_H];
+};
+
+static void destroy_draw_ctx(void *p)
+{
+    struct draw_ctx *ctx = p;
+    talloc_free(ctx->cache);
+    talloc_free(ctx->img);
+}
+
+// One line of libass style glyphs at the bottom of a 1080p video.
+static void *setup_draw_bmp(void)
+{
+    struct draw_ctx *ctx = talloc_zero(NULL, struct draw_ctx);
+    talloc_set_destructor(ctx, destroy_draw_ctx);
+    ctx->img = mp_image_alloc(IMGFMT_420P, W, H);
+    for (int p = 0; p < ctx->img->num_planes; p++) {
+        memset_pic(ctx->img->planes[p], 0x80, mp_image_plane_w(ctx->img, p),
+                   mp_image_plane_h(ctx->img, p), ctx->img->stride[p]);
+    }
+    uint32_t r = 1;
+    for (int n = 0; n < GLYPH_W * GLYPH_H; n++)
+        ctx->alpha[n] = bench_rand(&r) % 3 ? 0xFF : bench_rand(&r) & 0xFF;
+    for (int n = 0; n < GLYPHS; n++) {
+        ctx->parts[n] = (struct sub_bitmap){
+            .bitmap = ctx->alpha,
+            .stride = GLYPH_W,
+            .w = GLYPH_W, .h = GLYPH_H,
+            .dw = GLYPH_W, .dh = GLYPH_H,
+            .x = 400 + n * (GLYPH_W + 2),
+            .y = H - 100,
+            .libass.color = 0xFFFFFF00,
+        };
+    }
+    ctx->sbs = (struct sub_bitmaps){
+        .format = SUBBITMAP_LIBASS,
+        .parts = ctx->parts,
+        .num_parts = GLYPHS,
+    };
+    return ctx;
+}
+
+static void run_draw_bmp(void *p)
+{
+    struct draw_ctx *ctx = p;
+    ctx->sbs.change_id++;
+    mp_draw_sub_bitmaps(&ctx->cache, ctx->img, &ctx->sbs);
+}
+
+struct copy_ctx {
+    struct mp_image *src, *dst;
+};
+
+static void destroy_copy_ctx(void *p)
+{
+    struct copy_ctx *ctx = p;
+    talloc_free(ctx->src);
+    talloc_free(ctx->dst);
+}
+
+static void *setup_copy(void)
+{
+    struct copy_ctx *ctx = talloc_zero(NULL, struct copy_ctx);
+    talloc_set_destructor(ctx, destroy_copy_ctx);
+    ctx->src = mp_image_alloc(IMGFMT_420P, W, H);
+    ctx->dst = mp_image_alloc(IMGFMT_420P, W, H);
+    for (int p = 0; p < ctx->src->num_planes; p++) {
+        memset_pic(ctx->src->planes[p], 0x40, mp_image_plane_w(ctx->src, p),
+                   mp_image_plane_h(ctx->src, p), ctx->src->stride[p]);
+    }
+    return ctx;
+}
+
+static void run_image_copy(void *p)
+{
+    struct copy_ctx *ctx = p;
+    mp_image_copy(ctx->dst, ctx->src);
+}
+
+// Copy from (possibly uncached) hwdec surfaces; gpu_memcpy() if available.
+static void run_image_copy_gpu(void *p)
+{
+    struct copy_ctx *ctx = p;
+    mp_image_copy_gpu(ctx->dst, ctx->src);
+}
+
+static void run_memcpy_pic(void *p)
+{
+    struct copy_ctx *ctx = p;
+    memcpy_pic(ctx->dst->planes[0], ctx->src->planes[0], W, H,
+               ctx->dst->stride[0], ctx->src->stride[0]);
+}
+
+const struct bench_case bench_video[] = {
+    {"draw-bmp-libass-420p", setup_draw_bmp, run_draw_bmp},
+    {"image-copy-420p", setup_copy, run_image_copy, W * H * 3 / 2},
+    {"image-copy-gpu-420p", setup_copy, run_image_copy_gpu, W * H * 3 / 2},
+    {"memcpy-pic", setup_copy, run_memcpy_pic, W * H},
+    {0}
+};
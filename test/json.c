@@ -0,0 +1,133 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "osdep/timer.h"
+
+#define BENCH_ENTRIES 20000
+#define BENCH_RUNS 20
+
+static char *write_node(void *ta_parent, struct mpv_node *node)
+{
+    char *s = talloc_strdup(ta_parent, "");
+    assert_int_equal(json_write(&s, node), 0);
+    return s;
+}
+
+// Parse src, and write it back.
+static char *reformat(void *ta_parent, const char *src)
+{
+    char *s = talloc_strdup(ta_parent, src);
+    struct mpv_node node;
+    if (json_parse(ta_parent, &node, &s, 10) < 0)
+        return NULL;
+    json_skip_whitespace(&s);
+    if (s[0])
+        return NULL;
+    return write_node(ta_parent, &node);
+}
+
+static void test_json_parse(void **state) {
+    void *tmp = talloc_new(NULL);
+    static const char *const tests[][2] = {
+        {"0", "0"},
+        {"-0", "0"},
+        {"123456789012345678", "123456789012345678"},
+        {"-9223372036854775808", "-9223372036854775808"},
+        {"0x10", "16"},
+        {"010", "8"},
+        {"1.5", "1.500000"},
+        {"1e3", "1000.000000"},
+        {"99999999999999999999", "100000000000000000000.000000"},
+        {" [ 1 , true , null ] ", "[1,true,null]"},
+        {"{\"a\":{\"b\":\"\"}}", "{\"a\":{\"b\":\"\"}}"},
+        {"\"a\\\"b\\\\\"", "\"a\\u0022b\\u005c\""},
+        {"\"\\\\\\\\\"", "\"\\u005c\\u005c\""},
+        {"\"\\n\\u00e9x\"", "\"\\u000a\xc3\xa9x\""},
+        {"\"abc", NULL},
+        {"\"abc\\", NULL},
+        {"\"abc\\\"", NULL},
+        {"[1,]", NULL},
+        {"-", NULL},
+    };
+    for (int n = 0; n < MP_ARRAY_SIZE(tests); n++) {
+        char *res = reformat(tmp, tests[n][0]);
+        if (tests[n][1]) {
+            assert_non_null(res);
+            assert_string_equal(res, tests[n][1]);
+        } else {
+            assert_null(res);
+        }
+    }
+    talloc_free(tmp);
+}
+
+static void test_json_write(void **state) {
+    void *tmp = talloc_new(NULL);
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(tmp, root.u.list);
+    // Long enough to exercise the 8 byte scanning, escapes at every offset.
+    node_map_add_string(&root, "s", "0123456789abcdef\"0123456\x01\\");
+    node_map_add(&root, "i", MPV_FORMAT_INT64)->u.int64 = INT64_MIN;
+    node_map_add(&root, "d", MPV_FORMAT_DOUBLE)->u.double_ = 1e300;
+    node_map_add(&root, "f", MPV_FORMAT_FLAG)->u.flag = 1;
+
+    char *s = talloc_strdup(tmp, "prefix");
+    assert_int_equal(json_write(&s, &root), 0);
+    char *d = talloc_asprintf(tmp, "%f", 1e300);
+    assert_string_equal(s, talloc_asprintf(tmp,
+        "prefix{\"s\":\"0123456789abcdef\\u00220123456\\u0001\\u005c\","
+        "\"i\":-9223372036854775808,\"d\":%s,\"f\":true}", d));
+    talloc_free(tmp);
+}
+
+// Throughput on a playlist-like structure. Not a pass/fail test; the
+// numbers are printed for comparing changes.
+static void test_json_bench(void **state) {
+    void *tmp = talloc_new(NULL);
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_ARRAY, NULL);
+    talloc_steal(tmp, root.u.list);
+    for (int n = 0; n < BENCH_ENTRIES; n++) {
+        struct mpv_node *e = node_array_add(&root, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "filename", talloc_asprintf(tmp,
+            "/home/user/Music/Some Artist/Album (2016)/%02d - \"Title\".flac", n));
+        node_map_add(e, "current", MPV_FORMAT_FLAG)->u.flag = 0;
+        node_map_add(e, "id", MPV_FORMAT_INT64)->u.int64 = n + 1;
+    }
+
+    mp_time_init();
+    char *json = NULL;
+    int64_t start = mp_time_us();
+    for (int n = 0; n < BENCH_RUNS; n++) {
+        talloc_free(json);
+        json = write_node(tmp, &root);
+    }
+    int64_t write_time = mp_time_us() - start;
+
+    size_t len = strlen(json);
+    start = mp_time_us();
+    for (int n = 0; n < BENCH_RUNS; n++) {
+        void *ctx = talloc_new(NULL);
+        char *s = talloc_strdup(ctx, json);
+        struct mpv_node node;
+        assert_int_equal(json_parse(ctx, &node, &s, 10), 0);
+        assert_int_equal(node.u.list->num, BENCH_ENTRIES);
+        talloc_free(ctx);
+    }
+    int64_t parse_time = mp_time_us() - start;
+
+    printf("json_write: %.1f MB/s\n", len * BENCH_RUNS / (double)MPMAX(write_time, 1));
+    printf("json_parse: %.1f MB/s\n", len * BENCH_RUNS / (double)MPMAX(parse_time, 1));
+    talloc_free(tmp);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_json_parse),
+        cmocka_unit_test(test_json_write),
+        cmocka_unit_test(test_json_bench),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
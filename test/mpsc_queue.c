@@ -0,0 +1,94 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/mpsc_queue.h"
+
+#define QUEUE_SIZE 64
+#define NUM_PRODUCERS 4
+#define ITEMS_PER_PRODUCER 100000
+
+struct item {
+    int producer;
+    int seq;
+};
+
+static void test_mpsc_queue_wraparound(void **state) {
+    struct mp_mpsc_queue *queue = mp_mpsc_queue_new(NULL, sizeof(int), 60);
+    assert_int_equal(mp_mpsc_queue_size(queue), QUEUE_SIZE);
+
+    int v;
+    assert_false(mp_mpsc_queue_pop(queue, &v));
+    for (int round = 0; round < 3; round++) {
+        for (int n = 0; n < QUEUE_SIZE; n++)
+            assert_true(mp_mpsc_queue_push(queue, &n));
+        assert_false(mp_mpsc_queue_push(queue, &v));
+        for (int n = 0; n < QUEUE_SIZE; n++) {
+            assert_true(mp_mpsc_queue_pop(queue, &v));
+            assert_int_equal(v, n);
+        }
+        assert_false(mp_mpsc_queue_pop(queue, &v));
+    }
+
+    talloc_free(queue);
+}
+
+struct producer_ctx {
+    struct mp_mpsc_queue *queue;
+    int id;
+};
+
+static void *producer(void *arg) {
+    struct producer_ctx *p = arg;
+    for (int n = 0; n < ITEMS_PER_PRODUCER; n++) {
+        struct item it = {p->id, n};
+        while (!mp_mpsc_queue_push(p->queue, &it))
+            sched_yield();
+    }
+    return NULL;
+}
+
+// Several producers push concurrently to one consumer. Every item must arrive
+// exactly once, and in order per producer.
+static void test_mpsc_queue_concurrent(void **state) {
+    struct mp_mpsc_queue *queue =
+        mp_mpsc_queue_new(NULL, sizeof(struct item), QUEUE_SIZE);
+    pthread_t threads[NUM_PRODUCERS];
+    struct producer_ctx ctx[NUM_PRODUCERS];
+    for (int n = 0; n < NUM_PRODUCERS; n++) {
+        ctx[n] = (struct producer_ctx){queue, n};
+        assert_int_equal(pthread_create(&threads[n], NULL, producer, &ctx[n]), 0);
+    }
+
+    int next[NUM_PRODUCERS] = {0};
+    int total = 0;
+    bool ok = true;
+    while (total < NUM_PRODUCERS * ITEMS_PER_PRODUCER) {
+        struct item it;
+        if (!mp_mpsc_queue_pop(queue, &it)) {
+            sched_yield();
+            continue;
+        }
+        ok &= it.producer >= 0 && it.producer < NUM_PRODUCERS &&
+              it.seq == next[it.producer];
+        if (it.producer >= 0 && it.producer < NUM_PRODUCERS)
+            next[it.producer]++;
+        total++;
+    }
+    assert_true(ok);
+
+    for (int n = 0; n < NUM_PRODUCERS; n++)
+        pthread_join(threads[n], NULL);
+    struct item it;
+    assert_false(mp_mpsc_queue_pop(queue, &it));
+    talloc_free(queue);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_mpsc_queue_wraparound),
+        cmocka_unit_test(test_mpsc_queue_concurrent),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,92 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/ring.h"
+
+#define RING_SIZE 1000
+#define TOTAL_BYTES (1000 * 1000)
+
+static void test_ring_wraparound(void **state) {
+    struct mp_ring *ring = mp_ring_new(NULL, RING_SIZE);
+    unsigned char buf[RING_SIZE], out[RING_SIZE];
+    for (int n = 0; n < RING_SIZE; n++)
+        buf[n] = n;
+
+    assert_int_equal(mp_ring_size(ring), RING_SIZE);
+    assert_int_equal(mp_ring_available(ring), RING_SIZE);
+
+    assert_int_equal(mp_ring_write(ring, buf, 700), 700);
+    assert_int_equal(mp_ring_read(ring, out, 600), 600);
+    assert_memory_equal(out, buf, 600);
+
+    // Crosses the end of the internal buffer.
+    assert_int_equal(mp_ring_write(ring, buf, RING_SIZE), 900);
+    assert_int_equal(mp_ring_buffered(ring), RING_SIZE);
+    assert_int_equal(mp_ring_available(ring), 0);
+    assert_int_equal(mp_ring_read(ring, out, 100), 100);
+    assert_memory_equal(out, buf + 600, 100);
+    assert_int_equal(mp_ring_read(ring, out, RING_SIZE), 900);
+    assert_memory_equal(out, buf, 900);
+    assert_int_equal(mp_ring_buffered(ring), 0);
+
+    talloc_free(ring);
+}
+
+static void *producer(void *arg) {
+    struct mp_ring *ring = arg;
+    unsigned char buf[RING_SIZE];
+    unsigned int seed = 1;
+    int pos = 0;
+    while (pos < TOTAL_BYTES) {
+        int len = rand_r(&seed) % RING_SIZE + 1;
+        len = MPMIN(len, TOTAL_BYTES - pos);
+        for (int n = 0; n < len; n++)
+            buf[n] = (pos + n) % 251;
+        int done = 0;
+        while (done < len) {
+            int r = mp_ring_write(ring, buf + done, len - done);
+            if (!r)
+                sched_yield();
+            done += r;
+        }
+        pos += len;
+    }
+    return NULL;
+}
+
+// One producer and one consumer thread hammer the ring concurrently. Every
+// byte must arrive exactly once and in order.
+static void test_ring_spsc(void **state) {
+    struct mp_ring *ring = mp_ring_new(NULL, RING_SIZE);
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, producer, ring), 0);
+
+    unsigned char buf[RING_SIZE];
+    unsigned int seed = 2;
+    int pos = 0;
+    bool ok = true;
+    while (pos < TOTAL_BYTES) {
+        int r = mp_ring_read(ring, buf, rand_r(&seed) % RING_SIZE + 1);
+        if (!r)
+            sched_yield();
+        for (int n = 0; n < r; n++)
+            ok &= buf[n] == (pos + n) % 251;
+        pos += r;
+    }
+    assert_true(ok);
+    assert_int_equal(pos, TOTAL_BYTES);
+
+    pthread_join(thread, NULL);
+    assert_int_equal(mp_ring_buffered(ring), 0);
+    talloc_free(ring);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_ring_wraparound),
+        cmocka_unit_test(test_ring_spsc),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -255,8 +255,10 @@ BOOL is_clearvideo(const GUID *mode_guid)
     return IsEqualGUID(mode_guid, &DXVA_Intel_H264_NoFGT_ClearVideo);
 }
 
+// copy_pool can be NULL (see mp_image_copy_gpu_mt()).
 void copy_nv12(struct mp_image *dest, uint8_t *src_bits,
-               unsigned src_pitch, unsigned surf_height)
+               unsigned src_pitch, unsigned surf_height,
+               struct mp_thread_pool *copy_pool, int copy_threads)
 {
     struct mp_image buf = {0};
     mp_image_setfmt(&buf, dest->imgfmt);
@@ -266,7 +268,7 @@ void copy_nv12(struct mp_image *dest, uint8_t *src_bits,
     buf.stride[0] = src_pitch;
     buf.planes[1] = src_bits + src_pitch * surf_height;
     buf.stride[1] = src_pitch;
-    mp_image_copy_gpu(dest, &buf);
+    mp_image_copy_gpu_mt(dest, &buf, copy_pool, copy_threads);
 }
 
 // Test if Direct3D11 can be used by us. Basically, this prevents trying to use
@@ -346,7 +348,7 @@ struct mp_image *d3d11_download_image(struct mp_hwdec_ctx *ctx,
                                  0, D3D11_MAP_READ, 0, &lock);
     if (FAILED(hr))
         goto done;
-    copy_nv12(sw_img, lock.pData, lock.RowPitch, tex_desc.Height);
+    copy_nv12(sw_img, lock.pData, lock.RowPitch, tex_desc.Height, NULL, 1);
     ID3D11DeviceContext_Unmap(device_ctx, (ID3D11Resource *)staging, 0);
 
     mp_image_set_size(sw_img, mpi->w, mpi->h);
@@ -62,8 +62,10 @@ unsigned d3d_decoder_config_score(struct lavc_ctx *s,
                                   GUID *guidConfigBitstreamEncryption,
                                   UINT ConfigBitstreamRaw);
 BOOL is_clearvideo(const GUID *mode_guid);
+struct mp_thread_pool;
 void copy_nv12(struct mp_image *dest, uint8_t *src_bits,
-               unsigned src_pitch, unsigned surf_height);
+               unsigned src_pitch, unsigned surf_height,
+               struct mp_thread_pool *copy_pool, int copy_threads);
 
 bool d3d11_check_decoding(ID3D11Device *dev);
 
@@ -24,8 +24,10 @@
 
 #include "config.h"
 #include "options/options.h"
+#include "common/common.h"
 #include "common/msg.h"
 
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "stream/stream.h"
@@ -57,11 +59,36 @@ const vd_functions_t * const mpcodecs_vd_drivers[] = {
     NULL
 };
 
-void video_reset(struct dec_video *d_video)
+static void lock_queue(struct dec_video *d_video)
 {
-    video_vd_control(d_video, VDCTRL_RESET, NULL);
-    d_video->first_packet_pdts = MP_NOPTS_VALUE;
+    if (d_video->threaded)
+        pthread_mutex_lock(&d_video->lock);
+}
+
+static void unlock_queue(struct dec_video *d_video)
+{
+    if (d_video->threaded)
+        pthread_mutex_unlock(&d_video->lock);
+}
+
+// Must be called with d_video->lock held.
+static void flush_queue(struct dec_video *d_video)
+{
+    for (int n = 0; n < d_video->num_queue; n++)
+        talloc_free(d_video->queue[n]);
+    d_video->num_queue = 0;
+    d_video->queue_hwaccel = false;
+}
+
+// Reset the decoder state. If threaded, the caller must hold dec_lock.
+static void reset_decoder(struct dec_video *d_video)
+{
+    if (d_video->vd_driver)
+        d_video->vd_driver->control(d_video, VDCTRL_RESET, NULL);
+    lock_queue(d_video);
     d_video->start_pts = MP_NOPTS_VALUE;
+    unlock_queue(d_video);
+    d_video->first_packet_pdts = MP_NOPTS_VALUE;
     d_video->decoded_pts = MP_NOPTS_VALUE;
     d_video->codec_pts = MP_NOPTS_VALUE;
     d_video->codec_dts = MP_NOPTS_VALUE;
@@ -77,18 +104,71 @@ void video_reset(struct dec_video *d_video)
     d_video->start = d_video->end = MP_NOPTS_VALUE;
 }
 
+void video_reset(struct dec_video *d_video)
+{
+    if (!d_video->threaded) {
+        reset_decoder(d_video);
+        return;
+    }
+    pthread_mutex_lock(&d_video->dec_lock);
+    pthread_mutex_lock(&d_video->lock);
+    flush_queue(d_video);
+    d_video->thread_run = false;
+    d_video->thread_eof = false;
+    d_video->underrun = true;
+    pthread_mutex_unlock(&d_video->lock);
+    reset_decoder(d_video);
+    pthread_mutex_unlock(&d_video->dec_lock);
+}
+
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
+    if (d_video->threaded)
+        pthread_mutex_lock(&d_video->dec_lock);
+    int r = CONTROL_UNKNOWN;
     const struct vd_functions *vd = d_video->vd_driver;
     if (vd)
-        return vd->control(d_video, cmd, arg);
-    return CONTROL_UNKNOWN;
+        r = vd->control(d_video, cmd, arg);
+    if (d_video->threaded) {
+        // Queued frames were decoded with the old decoder setup, and are
+        // probably what made the caller switch it.
+        if (r == CONTROL_OK && (cmd == VDCTRL_FORCE_HWDEC_FALLBACK ||
+                                cmd == VDCTRL_REINIT))
+        {
+            pthread_mutex_lock(&d_video->lock);
+            flush_queue(d_video);
+            pthread_mutex_unlock(&d_video->lock);
+        }
+        pthread_mutex_unlock(&d_video->dec_lock);
+    }
+    return r;
+}
+
+static void stop_thread(struct dec_video *d_video)
+{
+    pthread_mutex_lock(&d_video->lock);
+    d_video->thread_exit = true;
+    pthread_cond_signal(&d_video->wakeup);
+    pthread_mutex_unlock(&d_video->lock);
+    pthread_join(d_video->thread, NULL);
+
+    MP_VERBOSE(d_video, "Decoder queue: peak %d/%d frames, %d underruns.\n",
+               d_video->queue_peak, d_video->queue_limit,
+               d_video->queue_underruns);
+
+    flush_queue(d_video);
+    d_video->threaded = false;
+    pthread_cond_destroy(&d_video->wakeup);
+    pthread_mutex_destroy(&d_video->lock);
+    pthread_mutex_destroy(&d_video->dec_lock);
 }
 
 void video_uninit(struct dec_video *d_video)
 {
     if (!d_video)
         return;
+    if (d_video->threaded)
+        stop_thread(d_video);
     mp_image_unrefp(&d_video->current_mpi);
     if (d_video->vd_driver) {
         MP_VERBOSE(d_video, "Uninit video.\n");
@@ -140,7 +220,7 @@ bool video_init_best_codec(struct dec_video *d_video)
     struct MPOpts *opts = d_video->opts;
 
     assert(!d_video->vd_driver);
-    video_reset(d_video);
+    reset_decoder(d_video);
     d_video->has_broken_packet_pts = -10; // needs 10 packets to reach decision
 
     struct mp_decoder_entry *decoder = NULL;
@@ -270,11 +350,11 @@ static bool send_packet(struct dec_video *d_video, struct demux_packet *packet)
     if (pkt_pdts != MP_NOPTS_VALUE && d_video->first_packet_pdts == MP_NOPTS_VALUE)
         d_video->first_packet_pdts = pkt_pdts;
 
-    MP_STATS(d_video, "start decode video");
+    MP_STATS_START(d_video, "decode video");
 
     bool res = d_video->vd_driver->send_packet(d_video, packet);
 
-    MP_STATS(d_video, "end decode video");
+    MP_STATS_END(d_video, "decode video");
 
     // Stream recording can't deal with almost surely wrong fake DTS.
     if (dts_replaced)
@@ -290,11 +370,11 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
 
     assert(!*out_image);
 
-    MP_STATS(d_video, "start decode video");
+    MP_STATS_START(d_video, "decode video");
 
     bool progress = d_video->vd_driver->receive_frame(d_video, &mpi);
 
-    MP_STATS(d_video, "end decode video");
+    MP_STATS_END(d_video, "decode video");
 
     // Error, EOF, discarded frame, dropped frame, or initial codec delay.
     if (!mpi)
@@ -366,7 +446,7 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
         mpi->pts != MP_NOPTS_VALUE && d_video->fps > 0)
     {
         int delay = -1;
-        video_vd_control(d_video, VDCTRL_GET_BFRAMES, &delay);
+        d_video->vd_driver->control(d_video, VDCTRL_GET_BFRAMES, &delay);
         mpi->pts -= MPMAX(delay, 0) / d_video->fps;
     }
 
@@ -376,26 +456,86 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
 
 void video_reset_params(struct dec_video *d_video)
 {
+    if (d_video->threaded)
+        pthread_mutex_lock(&d_video->dec_lock);
     d_video->last_format = (struct mp_image_params){0};
+    if (d_video->threaded)
+        pthread_mutex_unlock(&d_video->dec_lock);
 }
 
 void video_get_dec_params(struct dec_video *d_video, struct mp_image_params *p)
 {
+    if (d_video->threaded)
+        pthread_mutex_lock(&d_video->dec_lock);
     *p = d_video->dec_format;
+    if (d_video->threaded)
+        pthread_mutex_unlock(&d_video->dec_lock);
+}
+
+void video_set_recorder_sink(struct dec_video *d_video,
+                             struct mp_recorder_sink *sink)
+{
+    if (d_video->threaded)
+        pthread_mutex_lock(&d_video->dec_lock);
+    d_video->recorder_sink = sink;
+    if (d_video->threaded)
+        pthread_mutex_unlock(&d_video->dec_lock);
 }
 
-void video_set_framedrop(struct dec_video *d_video, bool enabled)
+// mode is as with VDCTRL_SET_FRAMEDROP: 0 (off), 1 (drop frames as selected
+// with --vd-lavc-framedrop), 3 (only drop non-reference frames), or 4 (decode
+// keyframes only; these drops are not counted).
+void video_set_framedrop(struct dec_video *d_video, int mode)
 {
-    d_video->framedrop_enabled = enabled;
+    lock_queue(d_video);
+    d_video->framedrop_mode = mode;
+    unlock_queue(d_video);
 }
 
 // Frames before the start timestamp can be dropped. (Used for hr-seek.)
 void video_set_start(struct dec_video *d_video, double start_pts)
 {
+    lock_queue(d_video);
     d_video->start_pts = start_pts;
+    unlock_queue(d_video);
 }
 
-void video_work(struct dec_video *d_video)
+// Returns false if there is no decoder thread.
+bool video_get_queue_state(struct dec_video *d_video,
+                           struct video_queue_state *st)
+{
+    if (!d_video->threaded)
+        return false;
+    pthread_mutex_lock(&d_video->lock);
+    *st = (struct video_queue_state){
+        .frames = d_video->num_queue,
+        .limit = d_video->queue_limit,
+        .peak = d_video->queue_peak,
+        .underruns = d_video->queue_underruns,
+    };
+    pthread_mutex_unlock(&d_video->lock);
+    return true;
+}
+
+static void update_avg(double *avg, double v)
+{
+    *avg = *avg > 0 ? *avg + (v - *avg) / 16 : v;
+}
+
+// Called with the queue lock held.
+static void update_decode_cost(struct dec_video *d_video, int pict_type,
+                               int64_t us)
+{
+    struct video_decode_cost *c = &d_video->decode_cost;
+    if (pict_type < 0 || pict_type >= MP_ARRAY_SIZE(c->type))
+        pict_type = 0;
+    update_avg(&c->frame, us / 1e6);
+    update_avg(&c->type[pict_type], us / 1e6);
+}
+
+// Decode until a frame is output, or the decoder needs more input.
+// If threaded, the caller must hold dec_lock.
+static void decode_step(struct dec_video *d_video)
 {
     if (d_video->current_mpi || !d_video->vd_driver)
         return;
@@ -413,12 +553,15 @@ void video_work(struct dec_video *d_video)
         d_video->packet = NULL;
     }
 
+    lock_queue(d_video);
     double start_pts = d_video->start_pts;
+    int framedrop_type = d_video->framedrop_mode;
+    unlock_queue(d_video);
+
     if (d_video->start != MP_NOPTS_VALUE && (start_pts == MP_NOPTS_VALUE ||
                                              d_video->start > start_pts))
         start_pts = d_video->start;
 
-    int framedrop_type = d_video->framedrop_enabled ? 1 : 0;
     if (start_pts != MP_NOPTS_VALUE && d_video->packet &&
         d_video->packet->pts < start_pts - .005 &&
         !d_video->has_broken_packet_pts)
@@ -428,6 +571,16 @@ void video_work(struct dec_video *d_video)
 
     d_video->vd_driver->control(d_video, VDCTRL_SET_FRAMEDROP, &framedrop_type);
 
+    // With --hr-seek-framedrop=fast, don't even output frames before the
+    // target. The decoder's PTS must be trustworthy for this.
+    double preroll_pts = MP_NOPTS_VALUE;
+    if (d_video->opts->hr_seek_framedrop == 2 && start_pts != MP_NOPTS_VALUE &&
+        !d_video->has_broken_packet_pts && !d_video->codec->avi_dts)
+        preroll_pts = start_pts;
+    d_video->vd_driver->control(d_video, VDCTRL_SET_PREROLL, &preroll_pts);
+
+    int64_t decode_start = mp_time_us();
+
     if (send_packet(d_video, d_video->packet)) {
         if (d_video->recorder_sink)
             mp_recorder_feed_packet(d_video->recorder_sink, d_video->packet);
@@ -438,11 +591,18 @@ void video_work(struct dec_video *d_video)
 
     bool progress = receive_frame(d_video, &d_video->current_mpi);
 
+    int64_t decode_us = mp_time_us() - decode_start;
+    lock_queue(d_video);
+    d_video->decode_time += decode_us;
+    if (d_video->current_mpi)
+        update_decode_cost(d_video, d_video->current_mpi->pict_type, decode_us);
+    unlock_queue(d_video);
+
     d_video->current_state = DATA_OK;
     if (!progress) {
         d_video->current_state = DATA_EOF;
     } else if (!d_video->current_mpi) {
-        if (framedrop_type == 1)
+        if (framedrop_type == 1 || framedrop_type == 3)
             d_video->dropped_frames += 1;
         d_video->current_state = DATA_AGAIN;
     }
@@ -466,7 +626,7 @@ void video_work(struct dec_video *d_video)
         d_video->new_segment = NULL;
 
         if (d_video->codec == new_segment->codec) {
-            video_reset(d_video);
+            reset_decoder(d_video);
         } else {
             d_video->codec = new_segment->codec;
             if (d_video->vd_driver)
@@ -485,14 +645,155 @@ void video_work(struct dec_video *d_video)
     }
 }
 
+static bool queue_full(struct dec_video *d_video)
+{
+    // Hardware decoders allocate from fixed size surface pools, which don't
+    // account for frames held by the queue.
+    int limit = d_video->queue_hwaccel ? 1 : d_video->queue_limit;
+    return d_video->num_queue >= limit;
+}
+
+static void *decode_thread(void *p)
+{
+    struct dec_video *d_video = p;
+
+    mpthread_set_name("vd");
+    mpthread_set_role(d_video->global, "decoder");
+
+    pthread_mutex_lock(&d_video->lock);
+    while (!d_video->thread_exit) {
+        if (!d_video->thread_run || d_video->thread_eof || queue_full(d_video)) {
+            pthread_cond_wait(&d_video->wakeup, &d_video->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&d_video->lock);
+
+        pthread_mutex_lock(&d_video->dec_lock);
+        decode_step(d_video);
+        int state = d_video->vd_driver ? d_video->current_state : DATA_EOF;
+        struct mp_image *mpi = d_video->current_mpi;
+        d_video->current_mpi = NULL;
+
+        // Take the queue lock before releasing dec_lock, so that a concurrent
+        // video_reset() can't be overtaken by a frame from before the reset.
+        pthread_mutex_lock(&d_video->lock);
+        pthread_mutex_unlock(&d_video->dec_lock);
+
+        bool wakeup = false;
+        if (mpi) {
+            d_video->queue_hwaccel = mpi->fmt.flags & MP_IMGFLAG_HWACCEL;
+            MP_TARRAY_APPEND(d_video, d_video->queue, d_video->num_queue, mpi);
+            d_video->queue_peak = MPMAX(d_video->queue_peak, d_video->num_queue);
+            wakeup = true;
+        } else if (state == DATA_WAIT) {
+            // Sleep until video_work() is called again. The demuxer wakes up
+            // the player when new packets are available.
+            d_video->thread_run = false;
+        } else if (state == DATA_EOF) {
+            d_video->thread_eof = true;
+            wakeup = true;
+        }
+
+        if (wakeup && d_video->wakeup_cb) {
+            pthread_mutex_unlock(&d_video->lock);
+            d_video->wakeup_cb(d_video->wakeup_cb_ctx);
+            pthread_mutex_lock(&d_video->lock);
+        }
+    }
+    pthread_mutex_unlock(&d_video->lock);
+
+    return NULL;
+}
+
+static void start_thread(struct dec_video *d_video)
+{
+    d_video->queue_limit = d_video->opts->vd_queue_frames;
+    d_video->underrun = true;
+
+    pthread_mutex_init(&d_video->dec_lock, NULL);
+    pthread_mutex_init(&d_video->lock, NULL);
+    pthread_cond_init(&d_video->wakeup, NULL);
+
+    if (pthread_create(&d_video->thread, NULL, decode_thread, d_video)) {
+        MP_ERR(d_video, "Could not create decoder thread.\n");
+        pthread_cond_destroy(&d_video->wakeup);
+        pthread_mutex_destroy(&d_video->lock);
+        pthread_mutex_destroy(&d_video->dec_lock);
+        return;
+    }
+
+    d_video->threaded = true;
+    MP_VERBOSE(d_video, "Decoding in a separate thread, up to %d frames "
+               "ahead.\n", d_video->queue_limit);
+}
+
+void video_work(struct dec_video *d_video)
+{
+    // Users without wakeup callback expect synchronous decoding.
+    if (!d_video->threaded && !d_video->queue_limit && d_video->wakeup_cb &&
+        d_video->opts->vd_queue_frames > 0 && d_video->vd_driver)
+        start_thread(d_video);
+
+    if (!d_video->threaded) {
+        decode_step(d_video);
+        return;
+    }
+
+    pthread_mutex_lock(&d_video->lock);
+    if (!d_video->thread_run) {
+        d_video->thread_run = true;
+        pthread_cond_signal(&d_video->wakeup);
+    }
+    pthread_mutex_unlock(&d_video->lock);
+}
+
+// Total time spent in the decoder (in microseconds), including frames which
+// are still queued or were dropped.
+int64_t video_get_decode_time(struct dec_video *d_video)
+{
+    lock_queue(d_video);
+    int64_t res = d_video->decode_time;
+    unlock_queue(d_video);
+    return res;
+}
+
+// With frame threading, the cost of a frame is the time spent in the decoder
+// between two output frames, rather than the actual work on it.
+void video_get_decode_cost(struct dec_video *d_video,
+                           struct video_decode_cost *cost)
+{
+    lock_queue(d_video);
+    *cost = d_video->decode_cost;
+    unlock_queue(d_video);
+}
+
 // Fetch an image decoded with video_work(). Returns one of:
 //  DATA_OK:    *out_mpi is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
+//  DATA_WAIT:  waiting for demuxer or decoder thread; will receive a wakeup
 //  DATA_EOF:   end of file, no more frames to be expected
 //  DATA_AGAIN: dropped frame or something similar
 int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
 {
     *out_mpi = NULL;
+    if (d_video->threaded) {
+        int res = DATA_WAIT;
+        pthread_mutex_lock(&d_video->lock);
+        if (d_video->num_queue) {
+            *out_mpi = d_video->queue[0];
+            MP_TARRAY_REMOVE_AT(d_video->queue, d_video->num_queue, 0);
+            d_video->underrun = false;
+            pthread_cond_signal(&d_video->wakeup);
+            res = DATA_OK;
+        } else if (d_video->thread_eof) {
+            res = DATA_EOF;
+        } else if (d_video->thread_run && !d_video->underrun) {
+            // Only count once per stall, and not right after seeks.
+            d_video->underrun = true;
+            d_video->queue_underruns++;
+        }
+        pthread_mutex_unlock(&d_video->lock);
+        return res;
+    }
     if (d_video->current_mpi) {
         *out_mpi = d_video->current_mpi;
         d_video->current_mpi = NULL;
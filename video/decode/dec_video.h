@@ -19,6 +19,7 @@
 #define MPLAYER_DEC_VIDEO_H
 
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "demux/stheader.h"
 #include "video/hwdec.h"
@@ -27,12 +28,26 @@
 struct mp_decoder_list;
 struct vo;
 
+struct video_queue_state {
+    int frames;         // number of decoded frames currently queued
+    int limit;          // maximum queue size (0 if no decoder thread)
+    int peak;           // highest queue depth reached
+    int underruns;      // the player had to wait for the decoder thread
+};
+
+// Running averages of the time (in seconds) needed to decode a frame.
+struct video_decode_cost {
+    double frame;       // all output frames
+    double type[4];     // by mp_image.pict_type (0: unknown, 1: I, 2: P, 3: B)
+};
+
 struct dec_video {
     struct mp_log *log;
     struct mpv_global *global;
     struct MPOpts *opts;
     const struct vd_functions *vd_driver;
     struct mp_hwdec_devices *hwdec_devs; // video output hwdec handles
+    struct vo *vo; // for direct rendering (can be NULL)
     struct sh_stream *header;
     struct mp_codec_params *codec;
 
@@ -44,6 +59,10 @@ struct dec_video {
 
     struct mp_recorder_sink *recorder_sink;
 
+    // Called from the decoder thread when a new frame or EOF is available.
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+
     // Internal (shared with vd_lavc.c).
 
     void *priv; // for free use by vd_driver
@@ -76,9 +95,31 @@ struct dec_video {
     double start, end;
     struct demux_packet *new_segment;
     struct demux_packet *packet;
-    bool framedrop_enabled;
+    int framedrop_mode;
     struct mp_image *current_mpi;
     int current_state;
+
+    // Decoder thread (only with --vd-queue-frames > 0). While it's running,
+    // all decoder state above is owned by the thread, and dec_lock must be
+    // held to touch it from outside. start_pts and framedrop_mode are
+    // protected by lock instead.
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t dec_lock;   // held by the thread while decoding
+    pthread_mutex_t lock;       // protects the fields below
+    pthread_cond_t wakeup;
+    bool thread_exit;
+    bool thread_run;            // decode ahead until queue full/wait/EOF
+    bool thread_eof;
+    struct mp_image **queue;
+    int num_queue;
+    int queue_limit;
+    bool queue_hwaccel;         // last queued frame was a hw surface
+    bool underrun;
+    int queue_peak;
+    int queue_underruns;
+    int64_t decode_time;
+    struct video_decode_cost decode_cost;
 };
 
 struct mp_decoder_list *video_decoder_list(void);
@@ -88,13 +129,20 @@ void video_uninit(struct dec_video *d_video);
 
 void video_work(struct dec_video *d_video);
 int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi);
+int64_t video_get_decode_time(struct dec_video *d_video);
+void video_get_decode_cost(struct dec_video *d_video,
+                           struct video_decode_cost *cost);
 
-void video_set_framedrop(struct dec_video *d_video, bool enabled);
+void video_set_framedrop(struct dec_video *d_video, int mode);
 void video_set_start(struct dec_video *d_video, double start_pts);
 
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg);
 void video_reset(struct dec_video *d_video);
 void video_reset_params(struct dec_video *d_video);
 void video_get_dec_params(struct dec_video *d_video, struct mp_image_params *p);
+void video_set_recorder_sink(struct dec_video *d_video,
+                             struct mp_recorder_sink *sink);
+bool video_get_queue_state(struct dec_video *d_video,
+                           struct video_queue_state *st);
 
 #endif /* MPLAYER_DEC_VIDEO_H */
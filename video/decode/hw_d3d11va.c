@@ -155,7 +155,8 @@ static struct mp_image *d3d11va_retrieve_image(struct lavc_ctx *s,
         talloc_free(sw_img);
         return img;
     }
-    copy_nv12(sw_img, lock.pData, lock.RowPitch, texture_desc.Height);
+    copy_nv12(sw_img, lock.pData, lock.RowPitch, texture_desc.Height,
+              s->copy_pool, s->copy_threads);
     ID3D11DeviceContext_Unmap(p->device_ctx, (ID3D11Resource *)staging, 0);
 
     mp_image_set_size(sw_img, img->w, img->h);
@@ -137,7 +137,8 @@ static struct mp_image *dxva2_retrieve_image(struct lavc_ctx *s,
         talloc_free(sw_img);
         return img;
     }
-    copy_nv12(sw_img, lock.pBits, lock.Pitch, surface_desc.Height);
+    copy_nv12(sw_img, lock.pBits, lock.Pitch, surface_desc.Height,
+              s->copy_pool, s->copy_threads);
     IDirect3DSurface9_UnlockRect(surface);
 
     mp_image_set_size(sw_img, img->w, img->h);
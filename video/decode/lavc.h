@@ -2,6 +2,7 @@
 #define MPV_LAVC_H
 
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 
@@ -34,6 +35,22 @@ typedef struct lavc_ctx {
     bool hwdec_notified;
 
     int framedrop_flags;
+    double preroll_pts;
+
+    // Threading mode as "<none|frame|slice>:<count>".
+    char threading[32];
+
+    // For direct rendering (get_buffer2_direct), and get_buffer2_hugepages
+    pthread_mutex_t dr_lock;
+    bool dr_failed;
+    struct mp_image_pool *frame_pool;
+    int frame_pool_align;
+
+    // For copying back frames from *-copy hwdecs (copy_pool can be NULL)
+    struct mp_thread_pool *copy_pool;
+    int copy_threads;
+    double copy_time_avg, copy_time_peak; // in seconds
+    int64_t copy_frames;
 
     // For HDR side-data caching
     double cached_hdr_peak;
@@ -65,6 +82,11 @@ typedef struct lavc_ctx {
 
     struct mp_image_pool *hwdec_swpool;
 
+    // Formats accepted by an encoding VO (indexed by imgfmt - IMGFMT_START),
+    // or NULL. Copy modes pass hardware frames in these formats through
+    // without downloading them.
+    uint8_t *vo_formats;
+
     AVBufferRef *cached_hw_frames_ctx;
 } vd_ffmpeg_ctx;
 
@@ -49,8 +49,15 @@ enum vd_ctrl {
     VDCTRL_GET_HWDEC,
     VDCTRL_REINIT,
     VDCTRL_GET_BFRAMES,
-    // framedrop mode: 0=none, 1=standard, 2=hrseek
+    // framedrop mode: 0=none, 1=standard, 2=hrseek, 3=non-reference frames,
+    // 4=all but keyframes
     VDCTRL_SET_FRAMEDROP,
+    // threading mode as "<none|frame|slice>:<count>" (char **)
+    VDCTRL_GET_THREADING,
+    // average time to copy back a frame with *-copy hwdecs (double *)
+    VDCTRL_GET_COPY_TIME,
+    // discard decoded frames before this PTS, MP_NOPTS_VALUE=off (double *)
+    VDCTRL_SET_PREROLL,
 };
 
 #endif /* MPLAYER_VD_H */
@@ -17,12 +17,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
 #include <time.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 #include <libavutil/opt.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/intreadwrite.h>
@@ -33,6 +37,8 @@
 #include "common/msg.h"
 #include "options/options.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
+#include "osdep/timer.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
 
@@ -42,6 +48,7 @@
 #include "video/img_format.h"
 #include "video/filter/vf.h"
 #include "video/decode/dec_video.h"
+#include "video/out/vo.h"
 #include "demux/demux.h"
 #include "demux/stheader.h"
 #include "demux/packet.h"
@@ -65,6 +72,9 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
 static void uninit_avctx(struct dec_video *vd);
 
 static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags);
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags);
+static int get_buffer2_hugepages(AVCodecContext *avctx, AVFrame *pic, int flags);
+static struct mp_image *alloc_hugepage_frame(void *p, int fmt, int w, int h);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
                                            const enum AVPixelFormat *pix_fmt);
 
@@ -78,6 +88,9 @@ struct vd_lavc_params {
     int skip_frame;
     int framedrop;
     int threads;
+    int thread_type;
+    int copy_threads;
+    int dr;
     int bitexact;
     int check_hw_profile;
     int software_fallback;
@@ -106,6 +119,12 @@ const struct m_sub_options vd_lavc_conf = {
         OPT_DISCARD("skipframe", skip_frame, 0),
         OPT_DISCARD("framedrop", framedrop, 0),
         OPT_INT("threads", threads, M_OPT_MIN, .min = 0),
+        OPT_CHOICE("thread-type", thread_type, 0,
+                   ({"auto", 0},
+                    {"frame", FF_THREAD_FRAME},
+                    {"slice", FF_THREAD_SLICE})),
+        OPT_INTRANGE("copy-threads", copy_threads, 0, 0, MP_MAX_COPY_THREADS),
+        OPT_FLAG("dr", dr, 0),
         OPT_FLAG("bitexact", bitexact, 0),
         OPT_FLAG("check-hw-profile", check_hw_profile, 0),
         OPT_CHOICE_OR_INT("software-fallback", software_fallback, 0, 1, INT_MAX,
@@ -366,7 +385,10 @@ static struct vd_lavc_hwdec *probe_hwdec(struct dec_video *vd, bool autoprobe,
 
 static void uninit(struct dec_video *vd)
 {
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
     uninit_avctx(vd);
+    pthread_mutex_destroy(&ctx->dr_lock);
     talloc_free(vd->priv);
 }
 
@@ -457,6 +479,24 @@ static int init(struct dec_video *vd, const char *decoder)
     ctx->decoder = talloc_strdup(ctx, decoder);
     ctx->hwdec_devs = vd->hwdec_devs;
     ctx->hwdec_swpool = talloc_steal(ctx, mp_image_pool_new(17));
+    mp_image_pool_set_name(ctx->hwdec_swpool, "hwdec-download");
+    mp_image_pool_set_max_bytes(ctx->hwdec_swpool,
+                                ctx->opts->video_pool_max_size * 1024 * 1024ULL);
+    mp_image_pool_set_hugepages(ctx->hwdec_swpool,
+                                ctx->opts->video_pool_hugepages);
+    ctx->preroll_pts = MP_NOPTS_VALUE;
+    pthread_mutex_init(&ctx->dr_lock, NULL);
+    ctx->frame_pool = talloc_steal(ctx, mp_image_pool_new(64));
+    mp_image_pool_set_name(ctx->frame_pool, "decoder");
+    mp_image_pool_set_max_bytes(ctx->frame_pool,
+                                ctx->opts->video_pool_max_size * 1024 * 1024ULL);
+    mp_image_pool_set_allocator(ctx->frame_pool, alloc_hugepage_frame, ctx);
+
+    if (vd->vo && vd->vo->driver->encode) {
+        ctx->vo_formats = talloc_zero_array(ctx, uint8_t,
+                                            IMGFMT_END - IMGFMT_START);
+        vo_query_formats(vd->vo, ctx->vo_formats);
+    }
 
     reinit(vd);
 
@@ -467,6 +507,118 @@ static int init(struct dec_video *vd, const char *decoder)
     return 1;
 }
 
+// Rough relative decoding cost per pixel of some codecs, compared to h264 8
+// bit. Only used to scale the automatically selected thread count.
+static double codec_cost(struct mp_codec_params *c)
+{
+    double cost = 1.0;
+    if (c->codec) {
+        if (!strcmp(c->codec, "hevc") || !strcmp(c->codec, "vp9") ||
+            !strcmp(c->codec, "av1"))
+            cost = 2.0;
+        if (!strcmp(c->codec, "mpeg2video") || !strcmp(c->codec, "mpeg4") ||
+            !strcmp(c->codec, "mjpeg"))
+            cost = 0.5;
+    }
+    AVCodecParameters *par = c->lav_codecpar;
+    if (par) {
+        const AVPixFmtDescriptor *d = av_pix_fmt_desc_get(par->format);
+        if ((d && d->comp[0].depth > 8) || par->bits_per_raw_sample > 8 ||
+            par->profile == FF_PROFILE_H264_HIGH_10 ||
+            par->profile == FF_PROFILE_HEVC_MAIN_10)
+            cost *= 1.5;
+        if (par->profile == FF_PROFILE_H264_HIGH_444_PREDICTIVE)
+            cost *= 2.0;
+    }
+    return cost;
+}
+
+// Choose frame or slice threading and a thread count for software decoding,
+// if the user did not set the thread count explicitly.
+static void select_threading(struct dec_video *vd, AVCodecContext *avctx,
+                             AVCodec *codec)
+{
+    struct vd_lavc_params *lavc_param = vd->opts->vd_lavc_params;
+    struct mp_codec_params *c = vd->codec;
+
+    if (lavc_param->thread_type)
+        avctx->thread_type = lavc_param->thread_type;
+
+    if (lavc_param->threads) {
+        mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        return;
+    }
+
+    // Cover art is decoded exactly once.
+    if (vd->header && vd->header->attached_picture) {
+        avctx->thread_count = 1;
+        return;
+    }
+
+    int cores = av_cpu_count();
+    if (cores < 1) {
+        MP_WARN(vd, "Could not determine thread count to use, defaulting to 1.\n");
+        cores = 1;
+    }
+
+    int w = c->disp_w, h = c->disp_h;
+    if (c->lav_codecpar && c->lav_codecpar->width > 0) {
+        w = c->lav_codecpar->width;
+        h = c->lav_codecpar->height;
+    }
+    if (w <= 0 || h <= 0) {
+        w = 1920;
+        h = 1080;
+    }
+
+    // Roughly 2 threads per 720p worth of h264 8 bit decoding, never more
+    // than the machine has cores (+1 for load balancing).
+    double load = (double)w * h / (1280 * 720) * codec_cost(c);
+    int threads = MPCLAMP((int)ceil(load * 2), 1, cores > 1 ? cores + 1 : 1);
+    threads = MPMIN(threads, 16);
+
+    // Slice threading adds no latency and needs no extra frame buffers, but
+    // scales badly with more threads. Prefer it for small resolutions.
+    if (!lavc_param->thread_type) {
+        bool slice = codec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+        bool frame = codec->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+        if (slice && (!frame || w * h <= 1280 * 720))
+            avctx->thread_type = FF_THREAD_SLICE;
+        else if (frame)
+            avctx->thread_type = FF_THREAD_FRAME;
+    }
+
+    MP_VERBOSE(vd, "Detected %d logical cores, %dx%d video, requesting %d %s "
+               "threads.\n", cores, w, h, threads,
+               avctx->thread_type == FF_THREAD_SLICE ? "slice" : "frame");
+    avctx->thread_count = threads;
+}
+
+// Create the worker threads used to copy back frames with *-copy hwdecs.
+static void init_copy_pool(struct dec_video *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct vd_lavc_params *lavc_param = vd->opts->vd_lavc_params;
+
+    ctx->copy_time_avg = ctx->copy_time_peak = 0;
+    ctx->copy_frames = 0;
+
+    if (ctx->copy_pool)
+        return;
+
+    // Copying is limited by memory bandwidth, which a few threads saturate.
+    int threads = lavc_param->copy_threads;
+    if (!threads)
+        threads = MPCLAMP(av_cpu_count(), 1, 4);
+    ctx->copy_threads = 1;
+    if (threads > 1) {
+        ctx->copy_pool = mp_thread_pool_create(ctx, threads - 1);
+        if (ctx->copy_pool)
+            ctx->copy_threads = threads;
+    }
+    MP_VERBOSE(vd, "Using %d threads for copy-back.\n", ctx->copy_threads);
+}
+
 static void init_avctx(struct dec_video *vd, const char *decoder,
                        struct vd_lavc_hwdec *hwdec)
 {
@@ -510,6 +662,8 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
 
     if (ctx->hwdec) {
         avctx->thread_count = 1;
+        if (ctx->hwdec->copying)
+            init_copy_pool(vd);
         if (ctx->hwdec->image_format)
             avctx->get_format = get_format_hwdec;
         if (ctx->hwdec->allocate_image)
@@ -519,7 +673,20 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
         ctx->max_delay_queue = ctx->hwdec->delay_queue;
         ctx->hw_probing = true;
     } else {
-        mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        select_threading(vd, avctx, lavc_codec);
+
+        ctx->dr_failed = false;
+        if (lavc_param->dr && vd->vo &&
+            (lavc_codec->capabilities & AV_CODEC_CAP_DR1))
+        {
+            avctx->get_buffer2 = get_buffer2_direct;
+            avctx->thread_safe_callbacks = 1;
+        } else if (ctx->opts->video_pool_hugepages &&
+                   (lavc_codec->capabilities & AV_CODEC_CAP_DR1))
+        {
+            avctx->get_buffer2 = get_buffer2_hugepages;
+            avctx->thread_safe_callbacks = 1;
+        }
     }
 
     avctx->flags |= lavc_param->bitexact ? AV_CODEC_FLAG_BITEXACT : 0;
@@ -546,6 +713,14 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     if (avcodec_open2(avctx, lavc_codec, NULL) < 0)
         goto error;
 
+    const char *type = "none";
+    if (avctx->active_thread_type & FF_THREAD_FRAME)
+        type = "frame";
+    if (avctx->active_thread_type & FF_THREAD_SLICE)
+        type = "slice";
+    snprintf(ctx->threading, sizeof(ctx->threading), "%s:%d", type,
+             avctx->active_thread_type ? avctx->thread_count : 1);
+
     return;
 
 error:
@@ -587,6 +762,13 @@ static void uninit_avctx(struct dec_video *vd)
 
     flush_all(vd);
     av_frame_free(&ctx->pic);
+
+    if (ctx->copy_frames) {
+        MP_VERBOSE(vd, "Copied back %"PRId64" frames, average %.2f ms, "
+                   "peak %.2f ms.\n", ctx->copy_frames,
+                   ctx->copy_time_avg * 1e3, ctx->copy_time_peak * 1e3);
+        ctx->copy_frames = 0;
+    }
     av_buffer_unref(&ctx->cached_hw_frames_ctx);
 
     if (ctx->avctx) {
@@ -786,6 +968,109 @@ static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags)
     return 0;
 }
 
+// Padding and alignment required by the decoder. Returns the stride alignment,
+// and aligns *w and *h.
+static int get_frame_alignment(AVCodecContext *avctx, AVFrame *pic,
+                               int *w, int *h)
+{
+    *w = pic->width;
+    *h = pic->height;
+    int linesize_align[AV_NUM_DATA_POINTERS] = {0};
+    avcodec_align_dimensions2(avctx, w, h, linesize_align);
+    int stride_align = 64;
+    for (int n = 0; n < AV_NUM_DATA_POINTERS; n++)
+        stride_align = MPMAX(stride_align, linesize_align[n]);
+    return stride_align;
+}
+
+// Move the image data references to pic, and free img.
+static void set_frame_image(AVFrame *pic, struct mp_image *img)
+{
+    for (int n = 0; n < 4; n++) {
+        pic->data[n] = img->planes[n];
+        pic->linesize[n] = img->stride[n];
+        pic->buf[n] = img->bufs[n];
+        img->bufs[n] = NULL;
+    }
+    talloc_free(img);
+}
+
+// Allocate frames from VO memory (see vo_get_image()), so that the VO can
+// display them without copying. Falls back to normal allocation if the VO
+// can't provide such frames.
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    struct dec_video *vd = avctx->opaque;
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    // This can be called from libavcodec's frame threads.
+    pthread_mutex_lock(&ctx->dr_lock);
+
+    int imgfmt = pixfmt2imgfmt(pic->format);
+    if (!imgfmt || ctx->dr_failed)
+        goto fallback;
+
+    int w, h;
+    int stride_align = get_frame_alignment(avctx, pic, &w, &h);
+
+    struct mp_image *img = vo_get_image(vd->vo, imgfmt, w, h, stride_align);
+    if (!img) {
+        MP_VERBOSE(vd, "Direct rendering not supported, disabling.\n");
+        ctx->dr_failed = true;
+        goto fallback;
+    }
+
+    set_frame_image(pic, img);
+
+    pthread_mutex_unlock(&ctx->dr_lock);
+    return 0;
+
+fallback:
+    pthread_mutex_unlock(&ctx->dr_lock);
+    return avcodec_default_get_buffer2(avctx, pic, flags);
+}
+
+static struct mp_image *alloc_hugepage_frame(void *p, int fmt, int w, int h)
+{
+    vd_ffmpeg_ctx *ctx = p;
+    return mp_image_alloc_hugepages(fmt, w, h, ctx->frame_pool_align);
+}
+
+// Allocate frames backed by huge pages (--video-pool-hugepages). The
+// allocations are recycled through frame_pool.
+static int get_buffer2_hugepages(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    struct dec_video *vd = avctx->opaque;
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    // This can be called from libavcodec's frame threads.
+    pthread_mutex_lock(&ctx->dr_lock);
+
+    int imgfmt = pixfmt2imgfmt(pic->format);
+    if (!imgfmt)
+        goto fallback;
+
+    int w, h;
+    int stride_align = get_frame_alignment(avctx, pic, &w, &h);
+    if (stride_align != ctx->frame_pool_align) {
+        mp_image_pool_clear(ctx->frame_pool);
+        ctx->frame_pool_align = stride_align;
+    }
+
+    struct mp_image *img = mp_image_pool_get(ctx->frame_pool, imgfmt, w, h);
+    if (!img)
+        goto fallback;
+
+    set_frame_image(pic, img);
+
+    pthread_mutex_unlock(&ctx->dr_lock);
+    return 0;
+
+fallback:
+    pthread_mutex_unlock(&ctx->dr_lock);
+    return avcodec_default_get_buffer2(avctx, pic, flags);
+}
+
 static bool prepare_decoding(struct dec_video *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -797,13 +1082,20 @@ static bool prepare_decoding(struct dec_video *vd)
 
     int drop = ctx->framedrop_flags;
     if (drop) {
-        // hr-seek framedrop vs. normal framedrop
-        avctx->skip_frame = drop == 2 ? AVDISCARD_NONREF : opts->framedrop;
+        // normal framedrop vs. hr-seek/predictive framedrop vs. scrubbing
+        avctx->skip_frame = drop == 1 ? opts->framedrop :
+                            drop == 4 ? AVDISCARD_NONKEY : AVDISCARD_NONREF;
     } else {
         // normal playback
         avctx->skip_frame = ctx->skip_frame;
     }
 
+    // Skipping the loop filter on reference frames would corrupt the hr-seek
+    // target, so this only affects decoders which don't honor skip_frame.
+    avctx->skip_loop_filter = opts->skip_loop_filter;
+    if (drop == 2 && ctx->preroll_pts != MP_NOPTS_VALUE)
+        avctx->skip_loop_filter = MPMAX(avctx->skip_loop_filter, AVDISCARD_NONREF);
+
     if (ctx->hwdec_request_reinit)
         reset_avctx(vd);
 
@@ -927,6 +1219,17 @@ static bool decode_frame(struct dec_video *vd)
     return true;
 }
 
+// Whether a hardware frame can be returned as is in a copy mode, because the
+// encoder can take the surfaces directly (encoding mode only).
+static bool hw_passthrough(vd_ffmpeg_ctx *ctx, struct mp_image *img)
+{
+    int fmt = img->imgfmt;
+    return ctx->vo_formats && img->hwctx &&
+           (img->fmt.flags & MP_IMGFLAG_HWACCEL) &&
+           fmt >= IMGFMT_START && fmt < IMGFMT_END &&
+           ctx->vo_formats[fmt - IMGFMT_START];
+}
+
 static bool receive_frame(struct dec_video *vd, struct mp_image **out_image)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -957,6 +1260,19 @@ static bool receive_frame(struct dec_video *vd, struct mp_image **out_image)
     struct mp_image *res = ctx->delay_queue[0];
     MP_TARRAY_REMOVE_AT(ctx->delay_queue, ctx->num_delay_queue, 0);
 
+    // Frames before the hr-seek target are only needed as references. Skip
+    // the copy-back and everything the player would do with them.
+    if (ctx->preroll_pts != MP_NOPTS_VALUE && res->pts != MP_NOPTS_VALUE &&
+        res->pts < ctx->preroll_pts - .005)
+    {
+        talloc_free(res);
+        return true;
+    }
+
+    bool copying = ctx->hwdec && ctx->hwdec->copying &&
+                   !hw_passthrough(ctx, res);
+    int64_t copy_start = copying ? mp_time_us() : 0;
+
     if (ctx->hwdec && ctx->hwdec->process_image)
         res = ctx->hwdec->process_image(ctx, res);
 
@@ -964,9 +1280,10 @@ static bool receive_frame(struct dec_video *vd, struct mp_image **out_image)
     if (!res)
         return progress;
 
-    if (ctx->hwdec && ctx->hwdec->copying && (res->fmt.flags & MP_IMGFLAG_HWACCEL))
-    {
-        struct mp_image *sw = mp_image_hw_download(res, ctx->hwdec_swpool);
+    if (copying && (res->fmt.flags & MP_IMGFLAG_HWACCEL)) {
+        struct mp_image *sw = mp_image_hw_download_mt(res, ctx->hwdec_swpool,
+                                                      ctx->copy_pool,
+                                                      ctx->copy_threads);
         mp_image_unrefp(&res);
         res = sw;
         if (!res) {
@@ -977,6 +1294,15 @@ static bool receive_frame(struct dec_video *vd, struct mp_image **out_image)
         }
     }
 
+    if (copying) {
+        // Exponential moving average, about the last 16 frames.
+        double t = (mp_time_us() - copy_start) / 1e6;
+        ctx->copy_time_avg = ctx->copy_frames ?
+            ctx->copy_time_avg + (t - ctx->copy_time_avg) / 16 : t;
+        ctx->copy_time_peak = MPMAX(ctx->copy_time_peak, t);
+        ctx->copy_frames++;
+    }
+
     if (!ctx->hwdec_notified && vd->opts->hwdec_api != HWDEC_NONE) {
         if (ctx->hwdec) {
             MP_INFO(vd, "Using hardware decoding (%s).\n",
@@ -1008,6 +1334,9 @@ static int control(struct dec_video *vd, int cmd, void *arg)
     case VDCTRL_SET_FRAMEDROP:
         ctx->framedrop_flags = *(int *)arg;
         return CONTROL_TRUE;
+    case VDCTRL_SET_PREROLL:
+        ctx->preroll_pts = *(double *)arg;
+        return CONTROL_TRUE;
     case VDCTRL_GET_BFRAMES: {
         AVCodecContext *avctx = ctx->avctx;
         if (!avctx)
@@ -1021,6 +1350,16 @@ static int control(struct dec_video *vd, int cmd, void *arg)
         *(int *)arg = ctx->hwdec ? ctx->hwdec->type : 0;
         return CONTROL_TRUE;
     }
+    case VDCTRL_GET_COPY_TIME:
+        if (!ctx->copy_frames)
+            break;
+        *(double *)arg = ctx->copy_time_avg;
+        return CONTROL_TRUE;
+    case VDCTRL_GET_THREADING:
+        if (!ctx->avctx)
+            break;
+        *(char **)arg = ctx->threading;
+        return CONTROL_TRUE;
     case VDCTRL_FORCE_HWDEC_FALLBACK:
         if (ctx->hwdec) {
             force_fallback(vd);
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <libavutil/buffer.h>
 #include <libavutil/common.h>
@@ -33,6 +34,7 @@
 #include "options/m_config.h"
 
 #include "options/options.h"
+#include "osdep/threads.h"
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
@@ -53,6 +55,7 @@ extern const vf_info_t vf_info_dsize;
 extern const vf_info_t vf_info_pullup;
 extern const vf_info_t vf_info_sub;
 extern const vf_info_t vf_info_yadif;
+extern const vf_info_t vf_info_mtdeint;
 extern const vf_info_t vf_info_stereo3d;
 extern const vf_info_t vf_info_dlopen;
 extern const vf_info_t vf_info_lavfi;
@@ -78,6 +81,7 @@ static const vf_info_t *const filter_list[] = {
     &vf_info_gradfun,
     &vf_info_pullup,
     &vf_info_yadif,
+    &vf_info_mtdeint,
     &vf_info_stereo3d,
 
     &vf_info_eq,
@@ -106,6 +110,7 @@ static const vf_info_t *const filter_list[] = {
 };
 
 static void vf_uninit_filter(vf_instance_t *vf);
+static void pipeline_destroy(struct vf_chain *c);
 
 static bool get_desc(struct m_obj_desc *dst, int index)
 {
@@ -130,13 +135,57 @@ const struct m_obj_list vf_obj_list = {
     .description = "video filters",
 };
 
+// Pipelined execution (--vf-pipeline-frames): every filter runs on its own
+// thread, and passes its output to the next filter through a bounded queue.
+// The "in" pseudo-filter has a queue only (filled by vf_filter_frame()), and
+// the "out" pseudo-filter is fed on the caller's thread by vf_output_frame().
+// No thread holds vf_worker.filter_lock and vf_pipeline.lock at the same time.
+struct vf_worker {
+    struct vf_instance *vf;
+    struct vf_worker *prev;         // NULL for the "in" pseudo-filter
+    pthread_mutex_t filter_lock;    // held while calling filter callbacks
+    pthread_t thread;
+    bool has_thread;
+
+    // Protected by vf_pipeline.lock
+    struct mp_image **queue;        // filtered frames for the next filter
+    int num_queue;
+    bool pending;                   // filter may have more output
+    bool flushed;                   // filter was called with mpi==NULL
+    bool eof;                       // no more frames after the queued ones
+};
+
+struct vf_pipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int max_frames;
+    bool terminate;
+    bool running;
+
+    // All filters, starting with "in", excluding "out".
+    struct vf_worker **workers;
+    int num_workers;
+};
+
+// Call vf->control. With pipelined execution, this waits until the filter's
+// thread is not inside a filter callback.
+static int vf_call_control(struct vf_instance *vf, int cmd, void *arg)
+{
+    if (!vf->worker)
+        return vf->control(vf, cmd, arg);
+    pthread_mutex_lock(&vf->worker->filter_lock);
+    int r = vf->control(vf, cmd, arg);
+    pthread_mutex_unlock(&vf->worker->filter_lock);
+    return r;
+}
+
 // Try the cmd on each filter (starting with the first), and stop at the first
 // filter which does not return CONTROL_UNKNOWN for it.
 int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
+            int r = vf_call_control(cur, cmd, arg);
             if (r != CONTROL_UNKNOWN)
                 return r;
         }
@@ -150,7 +199,7 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
     if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        return cur->control ? vf_call_control(cur, cmd, arg) : CONTROL_NA;
     } else {
         return CONTROL_UNKNOWN;
     }
@@ -160,7 +209,7 @@ static void vf_control_all(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control)
-            cur->control(cur, cmd, arg);
+            vf_call_control(cur, cmd, arg);
     }
 }
 
@@ -260,6 +309,10 @@ static struct vf_instance *vf_open(struct vf_chain *c, const char *name,
     if (!config)
         goto error;
     vf->priv = config->optstruct;
+    mp_image_pool_set_name(vf->out_pool, name);
+    mp_image_pool_set_max_bytes(vf->out_pool,
+                                c->opts->video_pool_max_size * 1024 * 1024ULL);
+    mp_image_pool_set_hugepages(vf->out_pool, c->opts->video_pool_hugepages);
     int retcode = vf->info->open(vf);
     if (retcode < 1)
         goto error;
@@ -297,6 +350,7 @@ void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf)
     while (prev && prev->next != vf)
         prev = prev->next;
     assert(prev); // not inserted
+    pipeline_destroy(c);
     prev->next = vf->next;
     vf_uninit_filter(vf);
     c->initialized = 0;
@@ -307,6 +361,7 @@ struct vf_instance *vf_append_filter(struct vf_chain *c, const char *name,
 {
     struct vf_instance *vf = vf_open_filter(c, name, args);
     if (vf) {
+        pipeline_destroy(c);
         // Insert it before the last filter, which is the "out" pseudo-filter
         // (But after the "in" pseudo-filter)
         struct vf_instance **pprev = &c->first->next;
@@ -393,6 +448,236 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
     }
 }
 
+static void pipeline_wakeup_core(struct vf_chain *c)
+{
+    if (c->wakeup_callback)
+        c->wakeup_callback(c->wakeup_callback_ctx);
+}
+
+static bool worker_can_work(struct vf_pipeline *p, struct vf_worker *w)
+{
+    if (w->eof || w->num_queue >= p->max_frames)
+        return false;
+    return w->pending || w->prev->num_queue || w->prev->eof;
+}
+
+static void *worker_thread(void *ptr)
+{
+    struct vf_worker *w = ptr;
+    struct vf_instance *vf = w->vf;
+    struct vf_chain *c = vf->chain;
+    struct vf_pipeline *p = c->pipe;
+    bool is_last = vf->next == c->last;
+
+    mpthread_set_name("vf");
+
+    while (1) {
+        pthread_mutex_lock(&p->lock);
+        while (!p->terminate && !worker_can_work(p, w))
+            pthread_cond_wait(&p->wakeup, &p->lock);
+        if (p->terminate) {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        struct mp_image *in = NULL;
+        bool feed = false;
+        if (!w->pending) {
+            if (w->prev->num_queue) {
+                in = w->prev->queue[0];
+                MP_TARRAY_REMOVE_AT(w->prev->queue, w->prev->num_queue, 0);
+                feed = true;
+            } else if (!w->flushed) {
+                w->flushed = feed = true;
+            } else {
+                // Input EOF, and everything was output.
+                w->eof = true;
+                pthread_cond_broadcast(&p->wakeup);
+                pthread_mutex_unlock(&p->lock);
+                if (is_last)
+                    pipeline_wakeup_core(c);
+                continue;
+            }
+        }
+        bool input_freed = in && !w->prev->prev;
+        pthread_mutex_unlock(&p->lock);
+
+        pthread_mutex_lock(&w->filter_lock);
+        if (feed)
+            vf_do_filter(vf, in);
+        struct mp_image *out = vf_dequeue_output_frame(vf);
+        pthread_mutex_unlock(&w->filter_lock);
+
+        pthread_mutex_lock(&p->lock);
+        // If there was output, try again without new input.
+        w->pending = !!out;
+        if (out)
+            MP_TARRAY_APPEND(w, w->queue, w->num_queue, out);
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+
+        if ((out && is_last) || input_freed)
+            pipeline_wakeup_core(c);
+    }
+    return NULL;
+}
+
+static void pipeline_stop(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipe;
+    if (!p || !p->running)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->terminate = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    for (int n = 0; n < p->num_workers; n++) {
+        struct vf_worker *w = p->workers[n];
+        if (w->has_thread)
+            pthread_join(w->thread, NULL);
+        w->has_thread = false;
+    }
+    p->terminate = false;
+    p->running = false;
+}
+
+static bool pipeline_start(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipe;
+    if (p->running)
+        return true;
+    p->running = true;
+    for (int n = 1; n < p->num_workers; n++) {
+        struct vf_worker *w = p->workers[n];
+        if (pthread_create(&w->thread, NULL, worker_thread, w)) {
+            MP_ERR(c, "Could not create filter thread.\n");
+            pipeline_stop(c);
+            return false;
+        }
+        w->has_thread = true;
+    }
+    return true;
+}
+
+// Stop the threads and drop all frames in the queues.
+static void pipeline_reset(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipe;
+    if (!p)
+        return;
+    pipeline_stop(c);
+    for (int n = 0; n < p->num_workers; n++) {
+        struct vf_worker *w = p->workers[n];
+        for (int i = 0; i < w->num_queue; i++)
+            talloc_free(w->queue[i]);
+        w->num_queue = 0;
+        w->pending = w->flushed = w->eof = false;
+    }
+}
+
+static void pipeline_destroy(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipe;
+    if (!p)
+        return;
+    pipeline_reset(c);
+    for (int n = 0; n < p->num_workers; n++) {
+        struct vf_worker *w = p->workers[n];
+        pthread_mutex_destroy(&w->filter_lock);
+        w->vf->worker = NULL;
+    }
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    talloc_free(p);
+    c->pipe = NULL;
+}
+
+static void pipeline_create(struct vf_chain *c)
+{
+    int frames = c->opts->vf_pipeline_frames;
+    if (frames < 1 || c->first->next == c->last)
+        return;
+
+    struct vf_pipeline *p = talloc_zero(NULL, struct vf_pipeline);
+    p->max_frames = frames;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    struct vf_worker *prev = NULL;
+    for (struct vf_instance *vf = c->first; vf != c->last; vf = vf->next) {
+        struct vf_worker *w = talloc_zero(p, struct vf_worker);
+        w->vf = vf;
+        w->prev = prev;
+        pthread_mutex_init(&w->filter_lock, NULL);
+        vf->worker = w;
+        MP_TARRAY_APPEND(p, p->workers, p->num_workers, w);
+        prev = w;
+    }
+    c->pipe = p;
+    MP_VERBOSE(c, "Running %d filters on separate threads.\n",
+               p->num_workers - 1);
+}
+
+static int pipeline_filter_frame(struct vf_chain *c, struct mp_image *img)
+{
+    struct vf_pipeline *p = c->pipe;
+    if (!pipeline_start(c)) {
+        talloc_free(img);
+        return -1;
+    }
+    struct vf_worker *in = p->workers[0];
+    struct vf_worker *last = p->workers[p->num_workers - 1];
+    pthread_mutex_lock(&p->lock);
+    // Throttle the caller while the pipeline is full. Don't wait if there is
+    // output, which the caller has to read first to make progress.
+    while (in->num_queue >= p->max_frames && !last->num_queue)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    MP_TARRAY_APPEND(in, in->queue, in->num_queue, img);
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+static int pipeline_output_frame(struct vf_chain *c, bool eof)
+{
+    struct vf_pipeline *p = c->pipe;
+    if (!pipeline_start(c))
+        return -1;
+    struct vf_worker *in = p->workers[0];
+    struct vf_worker *last = p->workers[p->num_workers - 1];
+    struct mp_image *img = NULL;
+    pthread_mutex_lock(&p->lock);
+    if (eof && !in->eof) {
+        in->eof = true;
+        pthread_cond_broadcast(&p->wakeup);
+    }
+    while (1) {
+        if (last->num_queue) {
+            img = last->queue[0];
+            MP_TARRAY_REMOVE_AT(last->queue, last->num_queue, 0);
+            pthread_cond_broadcast(&p->wakeup);
+            break;
+        }
+        // On EOF, wait until the pipeline is drained.
+        if (!eof || last->eof)
+            break;
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (!img)
+        return 0;
+    vf_add_output_frame(c->last, img);
+    return 1;
+}
+
+static int pipeline_needs_input(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipe;
+    struct vf_worker *in = p->workers[0];
+    pthread_mutex_lock(&p->lock);
+    bool r = !in->eof && in->num_queue < p->max_frames;
+    pthread_mutex_unlock(&p->lock);
+    return r ? 1 : 0;
+}
+
 // Input a frame into the filter chain. Ownership of img is transferred.
 // Return >= 0 on success, < 0 on failure (even if output frames were produced)
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
@@ -403,6 +688,8 @@ int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
         return -1;
     }
     assert(mp_image_params_equal(&img->params, &c->input_params));
+    if (c->pipe)
+        return pipeline_filter_frame(c, img);
     return vf_do_filter(c->first, img);
 }
 
@@ -447,6 +734,8 @@ static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
 //  returns: -1: error, 0: no output, 1: output available
 int vf_output_frame(struct vf_chain *c, bool eof)
 {
+    if (c->pipe && c->initialized > 0 && !c->last->num_out_queued)
+        return pipeline_output_frame(c, eof);
     return vf_output_frame_until(c, c->last, eof);
 }
 
@@ -475,6 +764,8 @@ void vf_unread_output_frame(struct vf_chain *c, struct mp_image *img)
 // returns -1: error, 0: nothing needed, 1: add new frame with vf_filter_frame()
 int vf_needs_input(struct vf_chain *c)
 {
+    if (c->pipe)
+        return c->initialized > 0 ? pipeline_needs_input(c) : 0;
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         while (cur->needs_input && cur->needs_input(cur)) {
@@ -507,6 +798,7 @@ static void vf_chain_forget_frames(struct vf_chain *c)
 
 void vf_seek_reset(struct vf_chain *c)
 {
+    pipeline_reset(c);
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
 }
@@ -633,6 +925,7 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
 {
     int r = 0;
     vf_seek_reset(c);
+    pipeline_destroy(c);
     for (struct vf_instance *vf = c->first; vf; ) {
         struct vf_instance *next = vf->next;
         if (vf->autoinserted)
@@ -662,6 +955,8 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
     }
     c->output_params = cur;
     c->initialized = r < 0 ? -1 : 1;
+    if (r >= 0)
+        pipeline_create(c);
     int loglevel = r < 0 ? MSGL_WARN : MSGL_V;
     if (r == -2)
         MP_ERR(c, "Image formats incompatible or invalid.\n");
@@ -745,6 +1040,7 @@ void vf_destroy(struct vf_chain *c)
 {
     if (!c)
         return;
+    pipeline_destroy(c);
     av_buffer_unref(&c->in_hwframes_ref);
     while (c->first) {
         vf_instance_t *vf = c->first;
@@ -106,6 +106,9 @@ typedef struct vf_instance {
 
     struct vf_chain *chain;
     struct vf_instance *next;
+
+    // Pipelined execution state (private to vf.c)
+    struct vf_worker *worker;
 } vf_instance_t;
 
 // A chain of video filters
@@ -134,6 +137,10 @@ struct vf_chain {
     // since they are supposed to call it from foreign threads.
     void (*wakeup_callback)(void *ctx);
     void *wakeup_callback_ctx;
+
+    // If opts->vf_pipeline_frames is set, each filter runs on its own thread
+    // (private to vf.c).
+    struct vf_pipeline *pipe;
 };
 
 typedef struct vf_seteq {
@@ -20,9 +20,12 @@
 #include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
+#include "common/common.h"
 #include "common/msg.h"
+#include "osdep/threads.h"
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
@@ -44,6 +47,20 @@
 # define DLLSymbol(handle, name) dlsym(handle, name)
 #endif
 
+#define MAX_THREADS 64
+
+#define FLAGS_NO_OUTPIC (VF_DLOPEN_FLAG_INPLACE | VF_DLOPEN_FLAG_PASSTHROUGH)
+
+struct dl_job {
+    struct vf_dlopen_job pub;
+    struct vf_instance *vf;
+    struct mp_image *in;
+    struct mp_image *out[FILTER_MAX_OUTCNT];
+    bool started;               // passed to the filter
+    bool done;                  // job_done() was called
+    int count;
+};
+
 struct vf_priv_s {
     char *cfg_dllname;
     int cfg_argc;
@@ -65,6 +82,19 @@ struct vf_priv_s {
     unsigned int outfmt;
 
     int argc;
+
+    // put_image_async
+    bool async;
+    pthread_t *threads;
+    int num_threads;
+    int max_jobs;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- the following members are protected by lock
+    struct dl_job **jobs;       // oldest (first to output) first
+    int num_jobs;
+    bool eof;
+    bool terminate;
 };
 
 struct fmtname {
@@ -90,9 +120,14 @@ static void set_imgprop(struct vf_dlopen_picdata *out, const mp_image_t *mpi)
     }
 }
 
+static void flush_jobs(struct vf_instance *vf);
+
 static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
                     struct mp_image_params *out)
 {
+    if (vf->priv->async)
+        flush_jobs(vf);
+
     mp_image_params_get_dsize(in, &vf->priv->filter.in_d_width,
                                   &vf->priv->filter.in_d_height);
 
@@ -151,7 +186,19 @@ static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
         return -1;
     }
 
+    if (vf->priv->filter.flags & FLAGS_NO_OUTPIC) {
+        if (vf->priv->out_cnt != 1 || vf->priv->outfmt != in->imgfmt ||
+            vf->priv->out_width != in->w || vf->priv->out_height != in->h)
+        {
+            MP_ERR(vf, "filter config wants in-place processing, but changes "
+                   "the image format\n");
+            return -1;
+        }
+    }
+
     for (int i = 0; i < vf->priv->out_cnt; ++i) {
+        if (vf->priv->filter.flags & FLAGS_NO_OUTPIC)
+            break;
         talloc_free(vf->priv->outpic[i]);
         vf->priv->outpic[i] =
             mp_image_alloc(vf->priv->outfmt,
@@ -171,8 +218,189 @@ static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
     return 0;
 }
 
+// Fill inpic/outpic for filtering mpi. out[] receives the allocated output
+// images (none with FLAGS_NO_OUTPIC). On failure, the caller still needs to
+// free mpi and out[] (e.g. with output_pics()).
+static int setup_pics(struct vf_instance *vf, struct mp_image *mpi,
+                      struct vf_dlopen_picdata *inpic,
+                      struct vf_dlopen_picdata *outpic, struct mp_image **out)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    if ((p->filter.flags & VF_DLOPEN_FLAG_INPLACE) &&
+        !vf_make_out_image_writeable(vf, mpi))
+        return -1;
+
+    set_imgprop(inpic, mpi);
+    inpic->pts = mpi->pts;
+
+    if (p->filter.flags & FLAGS_NO_OUTPIC) {
+        outpic[0] = *inpic;
+        return 0;
+    }
+
+    for (int n = 0; n < p->out_cnt; n++) {
+        out[n] = vf_alloc_out_image(vf);
+        if (!out[n])
+            return -1;
+        mp_image_copy_attributes(out[n], mpi);
+        set_imgprop(&outpic[n], out[n]);
+    }
+    return 0;
+}
+
+// Queue the first count output images, and free everything else.
+static void output_pics(struct vf_instance *vf, struct mp_image *mpi,
+                        struct vf_dlopen_picdata *outpic, struct mp_image **out,
+                        int count)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    count = MPCLAMP(count, 0, (int)p->out_cnt);
+
+    if (p->filter.flags & FLAGS_NO_OUTPIC) {
+        if (count) {
+            if (p->filter.flags & VF_DLOPEN_FLAG_INPLACE)
+                mpi->pts = outpic[0].pts;
+            vf_add_output_frame(vf, mpi);
+            mpi = NULL;
+        }
+    } else {
+        for (int n = 0; n < count; n++) {
+            out[n]->pts = outpic[n].pts;
+            vf_add_output_frame(vf, out[n]);
+            out[n] = NULL;
+        }
+    }
+
+    for (int n = 0; n < FILTER_MAX_OUTCNT; n++)
+        talloc_free(out[n]);
+    talloc_free(mpi);
+}
+
+static void job_done(struct vf_dlopen_context *ctx, struct vf_dlopen_job *pub,
+                     int count)
+{
+    struct dl_job *job = pub->host_priv;
+    struct vf_instance *vf = job->vf;
+    struct vf_priv_s *p = vf->priv;
+
+    // Wake up the filter chain with the lock held, as vf might be destroyed
+    // as soon as we unlock.
+    pthread_mutex_lock(&p->lock);
+    job->done = true;
+    job->count = count;
+    pthread_cond_broadcast(&p->wakeup);
+    if (vf->chain->wakeup_callback)
+        vf->chain->wakeup_callback(vf->chain->wakeup_callback_ctx);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void run_job(struct vf_priv_s *p, struct dl_job *job)
+{
+    if (p->filter.put_image_async(&p->filter, &job->pub) < 0)
+        job_done(&p->filter, &job->pub, 0);
+}
+
+static void *worker_thread(void *arg)
+{
+    struct vf_instance *vf = arg;
+    struct vf_priv_s *p = vf->priv;
+
+    mpthread_set_name("vf_dlopen");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->terminate) {
+        struct dl_job *job = NULL;
+        for (int n = 0; n < p->num_jobs; n++) {
+            if (!p->jobs[n]->started) {
+                job = p->jobs[n];
+                break;
+            }
+        }
+        if (!job) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+        job->started = true;
+        pthread_mutex_unlock(&p->lock);
+        run_job(p, job);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Move finished jobs to the vf output queue, in submission order.
+// Return true if progress was made.
+static bool locked_read_output(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+    bool r = false;
+
+    while (p->num_jobs && p->jobs[0]->done) {
+        struct dl_job *job = p->jobs[0];
+        output_pics(vf, job->in, job->pub.outpic, job->out, job->count);
+        talloc_free(job);
+        MP_TARRAY_REMOVE_AT(p->jobs, p->num_jobs, 0);
+        r = true;
+    }
+    return r;
+}
+
+// Wait for all jobs the filter has accepted, and discard their output.
+static void flush_jobs(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        bool busy = false;
+        for (int n = 0; n < p->num_jobs; n++) {
+            struct dl_job *job = p->jobs[n];
+            if (!job->started) {
+                // Never passed to the filter.
+                job->started = job->done = true;
+                job->count = 0;
+            }
+            busy |= !job->done;
+        }
+        if (!busy)
+            break;
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    }
+    for (int n = 0; n < p->num_jobs; n++) {
+        struct dl_job *job = p->jobs[n];
+        output_pics(vf, job->in, job->pub.outpic, job->out, 0);
+        talloc_free(job);
+    }
+    p->num_jobs = 0;
+    p->eof = false;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void stop_threads(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    pthread_mutex_lock(&p->lock);
+    p->terminate = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    for (int n = 0; n < p->num_threads; n++)
+        pthread_join(p->threads[n], NULL);
+    p->num_threads = 0;
+}
+
 static void uninit(struct vf_instance *vf)
 {
+    if (vf->priv->async) {
+        flush_jobs(vf);
+        stop_threads(vf);
+        pthread_cond_destroy(&vf->priv->wakeup);
+        pthread_mutex_destroy(&vf->priv->lock);
+        vf->priv->async = false;
+    }
     if (vf->priv->filter.uninit)
         vf->priv->filter.uninit(&vf->priv->filter);
     memset(&vf->priv->filter, 0, sizeof(vf->priv->filter));
@@ -182,45 +410,138 @@ static void uninit(struct vf_instance *vf)
     }
 }
 
+static int filter_async(struct vf_instance *vf, struct mp_image *mpi)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    pthread_mutex_lock(&p->lock);
+    if (!mpi) {
+        p->eof = true;
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
+    p->eof = false;
+    while (1) {
+        locked_read_output(vf);
+        if (p->num_jobs < p->max_jobs)
+            break;
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    struct dl_job *job = talloc_zero(NULL, struct dl_job);
+    job->vf = vf;
+    job->in = mpi;
+    job->pub.host_priv = job;
+    if (setup_pics(vf, mpi, &job->pub.inpic, job->pub.outpic, job->out) < 0) {
+        output_pics(vf, mpi, job->pub.outpic, job->out, 0);
+        talloc_free(job);
+        return -1;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    MP_TARRAY_APPEND(p, p->jobs, p->num_jobs, job);
+    // Let a worker thread pick it up, or pass it to the filter directly.
+    job->started = !p->num_threads;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    if (!p->num_threads)
+        run_job(p, job);
+    return 0;
+}
+
 static int filter(struct vf_instance *vf, struct mp_image *mpi)
 {
+    if (vf->priv->async)
+        return filter_async(vf, mpi);
+
     if (!mpi)
         return 0;
 
-    set_imgprop(&vf->priv->filter.inpic, mpi);
-    vf->priv->filter.inpic_qscale = NULL;
-    vf->priv->filter.inpic_qscalestride = 0;
-    vf->priv->filter.inpic_qscaleshift = 0;
-    vf->priv->filter.inpic.pts = mpi->pts;
+    struct vf_dlopen_context *ctx = &vf->priv->filter;
+    ctx->inpic_qscale = NULL;
+    ctx->inpic_qscalestride = 0;
+    ctx->inpic_qscaleshift = 0;
 
     struct mp_image *out[FILTER_MAX_OUTCNT] = {0};
 
-    for (int n = 0; n < vf->priv->out_cnt; n++) {
-        out[n] = vf_alloc_out_image(vf);
-        if (!out[n]) {
-            talloc_free(mpi);
-            return -1;
-        }
-        mp_image_copy_attributes(out[n], mpi);
-        set_imgprop(&vf->priv->filter.outpic[n], out[n]);
+    if (setup_pics(vf, mpi, &ctx->inpic, ctx->outpic, out) < 0) {
+        output_pics(vf, mpi, ctx->outpic, out, 0);
+        return -1;
     }
 
     // more than one out pic
-    int ret = vf->priv->filter.put_image(&vf->priv->filter);
-    if (ret < 0)
-        ret = 0;
-    assert(ret <= vf->priv->out_cnt);
-
-    for (int n = 0; n < ret; n++) {
-        out[n]->pts = vf->priv->filter.outpic[n].pts;
-        vf_add_output_frame(vf, out[n]);
+    int ret = ctx->put_image(ctx);
+    assert(ret <= (int)vf->priv->out_cnt);
+    output_pics(vf, mpi, ctx->outpic, out, ret);
+    return 0;
+}
+
+// Fetch finished output frames, or return 0 if we need new input.
+static int filter_out(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        if (locked_read_output(vf))
+            break;
+        // Block only if new input can't be accepted or won't come anymore.
+        if (!p->num_jobs || (!p->eof && p->num_jobs < p->max_jobs))
+            break;
+        pthread_cond_wait(&p->wakeup, &p->lock);
     }
-    for (int n = ret; n < FILTER_MAX_OUTCNT; n++) {
-        talloc_free(out[n]);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+static bool needs_input(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    pthread_mutex_lock(&p->lock);
+    locked_read_output(vf);
+    bool r = vf->num_out_queued < p->max_jobs && p->num_jobs < p->max_jobs;
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
+static int control(struct vf_instance *vf, int request, void *data)
+{
+    switch (request) {
+    case VFCTRL_SEEK_RESET:
+        flush_jobs(vf);
+        return CONTROL_OK;
     }
+    return CONTROL_UNKNOWN;
+}
 
-    talloc_free(mpi);
-    return 0;
+static bool start_async(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    p->async = true;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
+    int threads = MPMIN(p->filter.threads, MAX_THREADS);
+    p->max_jobs = p->filter.max_jobs ? p->filter.max_jobs : MPMAX(threads, 1);
+
+    p->threads = talloc_array(p, pthread_t, threads);
+    for (int n = 0; n < threads; n++) {
+        if (pthread_create(&p->threads[n], NULL, worker_thread, vf)) {
+            MP_ERR(vf, "could not create worker threads\n");
+            stop_threads(vf);
+            return false;
+        }
+        p->num_threads++;
+    }
+
+    vf->filter_out = filter_out;
+    vf->needs_input = needs_input;
+    vf->control = control;
+    return true;
 }
 
 //===========================================================================//
@@ -281,6 +602,7 @@ static int vf_open(vf_instance_t *vf)
     memset(&vf->priv->filter, 0, sizeof(vf->priv->filter));
     vf->priv->filter.major_version = VF_DLOPEN_MAJOR_VERSION;
     vf->priv->filter.minor_version = VF_DLOPEN_MINOR_VERSION;
+    vf->priv->filter.job_done = job_done;
 
     // count arguments
     for (vf->priv->cfg_argc = sizeof(vf->priv->cfg_argv) / sizeof(vf->priv->cfg_argv[0]);
@@ -301,7 +623,7 @@ static int vf_open(vf_instance_t *vf)
         return 0;
     }
 
-    if (!vf->priv->filter.put_image) {
+    if (!vf->priv->filter.put_image && !vf->priv->filter.put_image_async) {
         MP_ERR(vf, "function did not create a filter that can put images: %s\n",
                vf->priv->cfg_dllname);
         return 0;
@@ -312,6 +634,9 @@ static int vf_open(vf_instance_t *vf)
     vf->reconfig = reconfig;
     vf->uninit = uninit;
 
+    if (vf->priv->filter.put_image_async && !start_async(vf))
+        return 0;
+
     return 1;
 }
 
@@ -9,7 +9,7 @@
 // when doing a backwards compatible change, bump minor version
 // when doing an incompatible change, bump major version and zero minor version
 #define VF_DLOPEN_MAJOR_VERSION 1
-#define VF_DLOPEN_MINOR_VERSION 0
+#define VF_DLOPEN_MINOR_VERSION 1
 
 #if VF_DLOPEN_MINOR_VERSION > 0
 # define VF_DLOPEN_CHECK_VERSION(ctx) \
@@ -49,6 +49,23 @@ struct vf_dlopen_picdata {
     double pts;
 };
 
+// Flags for vf_dlopen_context.flags (since 1.1).
+// The filter modifies inpic in place, and outputs it as the only frame. No
+// separate output image is allocated, and outpic[0] is the same as inpic.
+// Requires out_cnt == 1, and output size/format identical to the input.
+#define VF_DLOPEN_FLAG_INPLACE      (1 << 0)
+// The filter only reads inpic (e.g. for analysis) and never writes any
+// output. The input image is passed on unchanged if put_image returns 1, and
+// dropped if it returns 0. outpic[] is not used. Same requirements as above.
+#define VF_DLOPEN_FLAG_PASSTHROUGH  (1 << 1)
+
+// A frame in flight with put_image_async (since 1.1).
+struct vf_dlopen_job {
+    struct vf_dlopen_picdata inpic;
+    struct vf_dlopen_picdata outpic[FILTER_MAX_OUTCNT];
+    void *host_priv; // private to mpv
+};
+
 struct vf_dlopen_context {
     unsigned short major_version;
     unsigned short minor_version;
@@ -86,6 +103,34 @@ struct vf_dlopen_context {
     unsigned int inpic_qscaleshift;
 
     struct vf_dlopen_picdata outpic[FILTER_MAX_OUTCNT];
+
+    // --- since minor version 1 (all zero-initialized by mpv)
+
+    unsigned int flags; // VF_DLOPEN_FLAG_* bits
+
+    int (*put_image_async)(struct vf_dlopen_context *ctx,
+                           struct vf_dlopen_job *job);
+    // if set, this is used instead of put_image; the frame is described by
+    // job instead of the inpic/outpic members
+    // the filter must call job_done() exactly once for each job it accepted,
+    // from any thread (also from within this call); returns negative on error,
+    // in which case job_done() must not be called
+    // output frames are passed on in the order the jobs were submitted
+
+    void (*job_done)(struct vf_dlopen_context *ctx, struct vf_dlopen_job *job,
+                     int count);
+    // set by mpv before config is called; count is the number of images
+    // written, like the return value of put_image
+
+    unsigned int threads;
+    // if > 0, mpv calls put_image_async from this many worker threads, which
+    // means it is called concurrently for different jobs
+    // if 0, put_image_async is called on the filter thread, and the filter
+    // can complete jobs from its own threads
+
+    unsigned int max_jobs;
+    // number of jobs that can be in flight at once (0: threads, or 1 if
+    // threads is 0)
 };
 typedef int (vf_dlopen_getcontext_func)(struct vf_dlopen_context *ctx, int argc, const char **argv); // negative on error
 vf_dlopen_getcontext_func vf_dlopen_getcontext;
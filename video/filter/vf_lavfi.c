@@ -174,12 +174,21 @@ static bool recreate_graph(struct vf_instance *vf, struct mp_image_params *fmt)
     if (graph_parse(graph, p->cfg_graph, inputs, outputs, NULL) < 0)
         goto error;
 
-    if (vf->hwdec_devs) {
+    // Prefer the device the input surfaces belong to, so that hwaccel filters
+    // can work on them directly.
+    AVBufferRef *device_ref = NULL;
+    if (vf->in_hwframes_ref) {
+        AVHWFramesContext *fctx = (void *)vf->in_hwframes_ref->data;
+        device_ref = fctx->device_ref;
+    } else if (vf->hwdec_devs) {
         struct mp_hwdec_ctx *hwdec = hwdec_devices_get_first(vf->hwdec_devs);
+        if (hwdec)
+            device_ref = hwdec->av_device_ref;
+    }
+    if (device_ref) {
         for (int n = 0; n < graph->nb_filters; n++) {
             AVFilterContext *filter = graph->filters[n];
-            if (hwdec && hwdec->av_device_ref)
-                filter->hw_device_ctx = av_buffer_ref(hwdec->av_device_ref);
+            filter->hw_device_ctx = av_buffer_ref(device_ref);
         }
     }
 
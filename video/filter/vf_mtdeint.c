@@ -0,0 +1,348 @@
+/*
+ * This file is part of mpv.
+ *
+ * Filter algorithm based on yadif:
+ * Copyright (C) 2006 Michael Niedermayer <michaelni@gmx.at>
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Native yadif-style deinterlacer. Each output field is split into bands of
+// rows, which are interpolated in parallel on a thread pool.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/m_option.h"
+#include "misc/thread_pool.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+
+#include "vf.h"
+#include "refqueue.h"
+
+#define MAX_THREADS 16
+
+struct vf_priv_s {
+    int mode;
+    int interlaced_only;
+    int threads;
+
+    struct mp_refqueue *queue;
+    struct mp_thread_pool *pool;
+    int num_threads;
+};
+
+// Rows around the destination row y. "a" is the row above, "b" the row
+// below, "aa"/"bb" 2 rows above/below. prev2/next2 are the frames which
+// contain the missing field at the times before/after the current field.
+struct deint_lines {
+    const void *cur_a, *cur_b;
+    const void *prev_a, *prev_b;
+    const void *next_a, *next_b;
+    const void *prev2, *next2;
+    const void *prev2_aa, *prev2_bb;
+    const void *next2_aa, *next2_bb;
+};
+
+#define MAX3(a, b, c) MPMAX(MPMAX(a, b), c)
+#define MIN3(a, b, c) MPMIN(MPMIN(a, b), c)
+
+// Edge directed interpolation: pick the direction j with the lowest
+// difference between the lines above and below.
+#define CHECK(j)                                                            \
+    {   int score = abs(ca[x - 1 + (j)] - cb[x - 1 - (j)]) +               \
+                    abs(ca[x + (j)] - cb[x - (j)]) +                       \
+                    abs(ca[x + 1 + (j)] - cb[x + 1 - (j)]);                \
+        if (score < spatial_score) {                                        \
+            spatial_score = score;                                          \
+            spatial_pred = (ca[x + (j)] + cb[x - (j)]) >> 1;
+
+// Plain loops over a single row, kept simple enough for the compiler to
+// vectorize the temporal part.
+#define DEF_FILTER_LINE(name, pixel_t)                                      \
+static void name(void *dst_p, const struct deint_lines *l, int w,          \
+                 bool spatial)                                              \
+{                                                                           \
+    pixel_t *dst = dst_p;                                                   \
+    const pixel_t *ca = l->cur_a, *cb = l->cur_b;                           \
+    const pixel_t *pa = l->prev_a, *pb = l->prev_b;                         \
+    const pixel_t *na = l->next_a, *nb = l->next_b;                         \
+    const pixel_t *p2 = l->prev2, *n2 = l->next2;                           \
+    const pixel_t *p2aa = l->prev2_aa, *p2bb = l->prev2_bb;                 \
+    const pixel_t *n2aa = l->next2_aa, *n2bb = l->next2_bb;                 \
+    for (int x = 0; x < w; x++) {                                           \
+        int c = ca[x], e = cb[x];                                           \
+        int d = (p2[x] + n2[x]) >> 1;                                       \
+        int td0 = abs(p2[x] - n2[x]);                                       \
+        int td1 = (abs(pa[x] - c) + abs(pb[x] - e)) >> 1;                   \
+        int td2 = (abs(na[x] - c) + abs(nb[x] - e)) >> 1;                   \
+        int diff = MAX3(td0 >> 1, td1, td2);                                \
+        int spatial_pred = (c + e) >> 1;                                    \
+                                                                            \
+        if (x >= 3 && x < w - 3) {                                          \
+            int spatial_score = abs(ca[x - 1] - cb[x - 1]) + abs(c - e) +   \
+                                abs(ca[x + 1] - cb[x + 1]) - 1;             \
+            CHECK(-1) CHECK(-2) }} }}                                       \
+            CHECK( 1) CHECK( 2) }} }}                                       \
+        }                                                                   \
+                                                                            \
+        if (spatial) {                                                      \
+            int b = (p2aa[x] + n2aa[x]) >> 1;                               \
+            int f = (p2bb[x] + n2bb[x]) >> 1;                               \
+            int max = MAX3(d - e, d - c, MPMIN(b - c, f - e));              \
+            int min = MIN3(d - e, d - c, MPMAX(b - c, f - e));              \
+            diff = MAX3(diff, min, -max);                                   \
+        }                                                                   \
+                                                                            \
+        if (spatial_pred > d + diff) {                                      \
+            spatial_pred = d + diff;                                        \
+        } else if (spatial_pred < d - diff) {                               \
+            spatial_pred = d - diff;                                        \
+        }                                                                   \
+        dst[x] = spatial_pred;                                              \
+    }                                                                       \
+}
+
+DEF_FILTER_LINE(filter_line_8, uint8_t)
+DEF_FILTER_LINE(filter_line_16, uint16_t)
+
+struct deint_job {
+    struct mp_image *dst, *prev, *cur, *next;
+    int band, num_bands;
+    bool top;           // keep the top field (interpolate odd rows)
+    bool first;         // current field is the first field of cur
+    bool spatial;
+};
+
+static const void *row(struct mp_image *img, int p, int y)
+{
+    return img->planes[p] + img->stride[p] * (ptrdiff_t)y;
+}
+
+static void deint_band(void *ptr)
+{
+    struct deint_job *job = ptr;
+    struct mp_image *dst = job->dst, *cur = job->cur;
+    struct mp_image *prev2 = job->first ? job->prev : cur;
+    struct mp_image *next2 = job->first ? cur : job->next;
+    bool wide = dst->fmt.bytes[0] > 1;
+
+    for (int p = 0; p < dst->num_planes; p++) {
+        int w = mp_image_plane_w(dst, p);
+        int h = mp_image_plane_h(dst, p);
+        int y0 = h * job->band / job->num_bands;
+        int y1 = h * (job->band + 1) / job->num_bands;
+        size_t line = w * (size_t)dst->fmt.bytes[p];
+        for (int y = y0; y < y1; y++) {
+            uint8_t *d = dst->planes[p] + dst->stride[p] * (ptrdiff_t)y;
+            if ((y & 1) == !job->top || h < 2) {
+                memcpy(d, row(cur, p, y), line);
+                continue;
+            }
+            int ya = y > 0 ? y - 1 : y + 1;
+            int yb = y < h - 1 ? y + 1 : y - 1;
+            int yaa = y > 1 ? y - 2 : y;
+            int ybb = y < h - 2 ? y + 2 : y;
+            struct deint_lines l = {
+                .cur_a = row(cur, p, ya),
+                .cur_b = row(cur, p, yb),
+                .prev_a = row(job->prev, p, ya),
+                .prev_b = row(job->prev, p, yb),
+                .next_a = row(job->next, p, ya),
+                .next_b = row(job->next, p, yb),
+                .prev2 = row(prev2, p, y),
+                .next2 = row(next2, p, y),
+                .prev2_aa = row(prev2, p, yaa),
+                .prev2_bb = row(prev2, p, ybb),
+                .next2_aa = row(next2, p, yaa),
+                .next2_bb = row(next2, p, ybb),
+            };
+            if (wide) {
+                filter_line_16(d, &l, w, job->spatial);
+            } else {
+                filter_line_8(d, &l, w, job->spatial);
+            }
+        }
+    }
+}
+
+static struct mp_image *render(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+    struct mp_refqueue *q = p->queue;
+
+    struct mp_image *cur = mp_refqueue_get(q, 0);
+    struct mp_image *prev = mp_refqueue_get(q, -1);
+    struct mp_image *next = mp_refqueue_get(q, 1);
+
+    struct mp_image *dst = vf_alloc_out_image(vf);
+    if (!dst)
+        return NULL;
+    mp_image_copy_attributes(dst, cur);
+    dst->fields &= ~MP_IMGFIELD_INTERLACED;
+
+    struct deint_job jobs[MAX_THREADS];
+    for (int n = 0; n < p->num_threads; n++) {
+        jobs[n] = (struct deint_job){
+            .dst = dst,
+            .cur = cur,
+            .prev = prev ? prev : cur,
+            .next = next ? next : cur,
+            .band = n,
+            .num_bands = p->num_threads,
+            .top = mp_refqueue_is_top_field(q),
+            .first = mp_refqueue_is_top_field(q) ==
+                     mp_refqueue_top_field_first(q),
+            .spatial = p->mode < 2,
+        };
+    }
+
+    if (p->pool) {
+        for (int n = 0; n < p->num_threads; n++)
+            mp_thread_pool_queue(p->pool, deint_band, &jobs[n]);
+        mp_thread_pool_wait(p->pool);
+    } else {
+        deint_band(&jobs[0]);
+    }
+    return dst;
+}
+
+static int filter_ext(struct vf_instance *vf, struct mp_image *mpi)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    mp_refqueue_add_input(p->queue, mpi);
+    return 0;
+}
+
+static int filter_out(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    if (!mp_refqueue_has_output(p->queue))
+        return 0;
+
+    if (!mp_refqueue_should_deint(p->queue)) {
+        struct mp_image *in = mp_refqueue_get(p->queue, 0);
+        vf_add_output_frame(vf, mp_image_new_ref(in));
+        mp_refqueue_next(p->queue);
+        return 0;
+    }
+
+    struct mp_image *out = render(vf);
+    mp_refqueue_next_field(p->queue);
+    if (!out)
+        return -1;
+    vf_add_output_frame(vf, out);
+    return 0;
+}
+
+static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
+                    struct mp_image_params *out)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    mp_refqueue_flush(p->queue);
+
+    // At least 2 output rows of every plane per band.
+    int threads = p->threads ? p->threads : av_cpu_count();
+    threads = MPCLAMP(threads, 1, MPMAX(1, MPMIN(MAX_THREADS, in->h / 16)));
+    if (threads != p->num_threads) {
+        talloc_free(p->pool);
+        p->pool = NULL;
+        p->num_threads = 1;
+        if (threads > 1) {
+            p->pool = mp_thread_pool_create(vf, threads);
+            if (p->pool)
+                p->num_threads = threads;
+        }
+    }
+    MP_VERBOSE(vf, "Using %d threads.\n", p->num_threads);
+
+    *out = *in;
+    return 0;
+}
+
+static int query_format(struct vf_instance *vf, unsigned int imgfmt)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+    if ((desc.flags & MP_IMGFLAG_YUV_P) && (desc.flags & MP_IMGFLAG_NE))
+        return vf_next_query_format(vf, imgfmt);
+    return 0;
+}
+
+static int control(struct vf_instance *vf, int request, void *data)
+{
+    struct vf_priv_s *p = vf->priv;
+    switch (request) {
+    case VFCTRL_SEEK_RESET:
+        mp_refqueue_flush(p->queue);
+        return CONTROL_OK;
+    }
+    return CONTROL_UNKNOWN;
+}
+
+static void uninit(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+    mp_refqueue_free(p->queue);
+}
+
+static int vf_open(vf_instance_t *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    vf->reconfig = reconfig;
+    vf->filter_ext = filter_ext;
+    vf->filter_out = filter_out;
+    vf->query_format = query_format;
+    vf->control = control;
+    vf->uninit = uninit;
+
+    p->queue = mp_refqueue_alloc();
+    mp_refqueue_set_refs(p->queue, 1, 1);
+    mp_refqueue_set_mode(p->queue, MP_MODE_DEINT |
+        ((p->mode & 1) ? MP_MODE_OUTPUT_FIELDS : 0) |
+        (p->interlaced_only ? MP_MODE_INTERLACED_ONLY : 0));
+    return 1;
+}
+
+#define OPT_BASE_STRUCT struct vf_priv_s
+static const m_option_t vf_opts_fields[] = {
+    OPT_CHOICE("mode", mode, 0,
+               ({"frame", 0},
+                {"field", 1},
+                {"frame-nospatial", 2},
+                {"field-nospatial", 3})),
+    OPT_FLAG("interlaced-only", interlaced_only, 0),
+    OPT_INTRANGE("threads", threads, 0, 0, MAX_THREADS),
+    {0}
+};
+
+const vf_info_t vf_info_mtdeint = {
+    .description = "multithreaded yadif-style deinterlacer",
+    .name = "mtdeint",
+    .open = vf_open,
+    .priv_size = sizeof(struct vf_priv_s),
+    .priv_defaults = &(const struct vf_priv_s){
+        .mode = 1,
+        .interlaced_only = 1,
+    },
+    .options = vf_opts_fields,
+};
@@ -40,11 +40,37 @@
 #include "video/sws_utils.h"
 #include "vf.h"
 
+// Filtered frames are returned as mp_images pointing directly into VS frame
+// memory. Since VS frames must not outlive the core, each of them references
+// the vs_owner, which frees the core (and the script) only after the filter
+// has let go of it and the last referenced frame was released.
+struct vs_owner {
+    int refs;                   // protected by vs_ref_lock
+    const VSAPI *vsapi;
+    void (*destroy)(struct vs_owner *o);
+    void *priv;                 // VSScript or VSCore, for destroy()
+};
+
+struct vs_frame_ref {
+    struct vs_owner *owner;
+    const VSFrameRef *f;
+};
+
+// Instance data of our input filter. If the owner defers unloading the
+// script, the input node can be freed after the vf_instance was destroyed.
+struct vs_input {
+    struct vf_instance *vf;     // protected by vs_ref_lock; NULL if detached
+};
+
+static pthread_mutex_t vs_ref_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct vf_priv_s {
     VSCore *vscore;
     const VSAPI *vsapi;
     VSNodeRef *out_node;
     VSNodeRef *in_node;
+    struct vs_owner *owner;     // set by drv->init or drv->load_core
+    struct vs_input *input;     // protected by vs_ref_lock
 
     const struct script_driver *drv;
     // drv_vss
@@ -209,6 +235,51 @@ static struct mp_image map_vs_frame(struct vf_priv_s *p, const VSFrameRef *ref,
     return img;
 }
 
+static struct vs_owner *vs_owner_create(const VSAPI *vsapi, void *priv,
+                                        void (*destroy)(struct vs_owner *o))
+{
+    struct vs_owner *o = talloc_ptrtype(NULL, o);
+    *o = (struct vs_owner){.refs = 1, .vsapi = vsapi, .destroy = destroy,
+                           .priv = priv};
+    return o;
+}
+
+static void vs_owner_unref(struct vs_owner *o)
+{
+    if (!o)
+        return;
+    pthread_mutex_lock(&vs_ref_lock);
+    bool last = --o->refs == 0;
+    pthread_mutex_unlock(&vs_ref_lock);
+    if (last) {
+        o->destroy(o);
+        talloc_free(o);
+    }
+}
+
+static void free_vs_frame(void *arg)
+{
+    struct vs_frame_ref *ref = arg;
+    ref->owner->vsapi->freeFrame(ref->f);
+    vs_owner_unref(ref->owner);
+    talloc_free(ref);
+}
+
+// Return an image referencing f (takes ownership of f).
+static struct mp_image *wrap_vs_frame(struct vf_priv_s *p, struct mp_image *img,
+                                      const VSFrameRef *f)
+{
+    struct vs_frame_ref *ref = talloc_ptrtype(NULL, ref);
+    *ref = (struct vs_frame_ref){p->owner, f};
+    pthread_mutex_lock(&vs_ref_lock);
+    p->owner->refs++;
+    pthread_mutex_unlock(&vs_ref_lock);
+    struct mp_image *res = mp_image_new_custom_ref(img, ref, free_vs_frame);
+    if (!res)
+        free_vs_frame(ref);
+    return res;
+}
+
 static void drain_oldest_buffered_frame(struct vf_priv_s *p)
 {
     if (!p->num_buffered)
@@ -248,8 +319,7 @@ static void VS_CC vs_frame_done(void *userData, const VSFrameRef *f, int n,
         }
         if (img.pts == MP_NOPTS_VALUE)
             MP_ERR(vf, "No PTS after filter at frame %d!\n", n);
-        res = mp_image_new_copy(&img);
-        p->vsapi->freeFrame(f);
+        res = wrap_vs_frame(p, &img, f);
     }
     if (!res) {
         p->failed = true;
@@ -400,7 +470,8 @@ static bool needs_input(struct vf_instance *vf)
 static void VS_CC infiltInit(VSMap *in, VSMap *out, void **instanceData,
                              VSNode *node, VSCore *core, const VSAPI *vsapi)
 {
-    struct vf_instance *vf = *instanceData;
+    struct vs_input *input = *instanceData;
+    struct vf_instance *vf = input->vf;
     struct vf_priv_s *p = vf->priv;
     // The number of frames of our input node is obviously unknown. The user
     // could for example seek any time, randomly "ending" the clip.
@@ -429,7 +500,9 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
     VSFrameContext *frameCtx, VSCore *core,
     const VSAPI *vsapi)
 {
-    struct vf_instance *vf = *instanceData;
+    // Can't be detached yet, as we request frames only before destroy_vs().
+    struct vs_input *input = *instanceData;
+    struct vf_instance *vf = input->vf;
     struct vf_priv_s *p = vf->priv;
     VSFrameRef *ret = NULL;
 
@@ -508,13 +581,36 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
 
 static void VS_CC infiltFree(void *instanceData, VSCore *core, const VSAPI *vsapi)
 {
-    struct vf_instance *vf = instanceData;
+    struct vs_input *input = instanceData;
+
+    pthread_mutex_lock(&vs_ref_lock);
+    if (input->vf) {
+        struct vf_priv_s *p = input->vf->priv;
+        pthread_mutex_lock(&p->lock);
+        p->in_node_active = false;
+        p->input = NULL;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+    }
+    pthread_mutex_unlock(&vs_ref_lock);
+    talloc_free(input);
+}
+
+// Make sure the input node doesn't access vf anymore, even if the script is
+// kept alive by frames which are still referenced downstream.
+static void detach_input(struct vf_instance *vf)
+{
     struct vf_priv_s *p = vf->priv;
 
-    pthread_mutex_lock(&p->lock);
-    p->in_node_active = false;
-    pthread_cond_broadcast(&p->wakeup);
-    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_lock(&vs_ref_lock);
+    if (p->input) {
+        p->input->vf = NULL;
+        p->input = NULL;
+        pthread_mutex_lock(&p->lock);
+        p->in_node_active = false;
+        pthread_mutex_unlock(&p->lock);
+    }
+    pthread_mutex_unlock(&vs_ref_lock);
 }
 
 // number of getAsyncFrame calls in progress
@@ -550,6 +646,7 @@ static void destroy_vs(struct vf_instance *vf)
         p->vsapi->freeNode(p->out_node);
     p->in_node = p->out_node = NULL;
 
+    detach_input(vf);
     p->drv->unload(vf);
 
     assert(!p->in_node_active);
@@ -596,8 +693,13 @@ static int reinit_vs(struct vf_instance *vf)
     if (!in || !out || !vars)
         goto error;
 
+    struct vs_input *input = talloc_ptrtype(NULL, input);
+    *input = (struct vs_input){vf};
+    pthread_mutex_lock(&vs_ref_lock);
+    p->input = input;
+    pthread_mutex_unlock(&vs_ref_lock);
     p->vsapi->createFilter(in, out, "Input", infiltInit, infiltGetFrame,
-                           infiltFree, fmSerial, 0, vf, p->vscore);
+                           infiltFree, fmSerial, 0, input, p->vscore);
     int vserr;
     p->in_node = p->vsapi->propGetNode(out, "clip", 0, &vserr);
     if (!p->in_node) {
@@ -761,6 +863,12 @@ static void drv_vss_uninit(struct vf_instance *vf)
     vsscript_finalize();
 }
 
+static void vss_owner_destroy(struct vs_owner *o)
+{
+    vsscript_freeScript(o->priv);
+    vsscript_finalize();
+}
+
 static int drv_vss_load_core(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
@@ -771,6 +879,9 @@ static int drv_vss_load_core(struct vf_instance *vf)
         return -1;
     p->vsapi = vsscript_getVSApi();
     p->vscore = vsscript_getCore(p->se);
+    // The script might outlive the filter, so keep the library initialized.
+    vsscript_init();
+    p->owner = vs_owner_create(p->vsapi, p->se, vss_owner_destroy);
     return 0;
 }
 
@@ -792,8 +903,12 @@ static void drv_vss_unload(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
 
-    if (p->se)
+    if (p->owner) {
+        vs_owner_unref(p->owner);
+    } else if (p->se) {
         vsscript_freeScript(p->se);
+    }
+    p->owner = NULL;
     p->se = NULL;
     p->vsapi = NULL;
     p->vscore = NULL;
@@ -846,6 +961,11 @@ static int mp_cpcall (lua_State *L, lua_CFunction func, void *ud)
 #define FUCKYOUOHGODWHY lua_pushglobaltable
 #endif
 
+static void lazy_owner_destroy(struct vs_owner *o)
+{
+    o->vsapi->freeCore(o->priv);
+}
+
 static int drv_lazy_init(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
@@ -860,6 +980,7 @@ static int drv_lazy_init(struct vf_instance *vf)
         lua_close(p->ls);
         return -1;
     }
+    p->owner = vs_owner_create(p->vsapi, p->vscore, lazy_owner_destroy);
     return 0;
 }
 
@@ -867,7 +988,8 @@ static void drv_lazy_uninit(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
     lua_close(p->ls);
-    p->vsapi->freeCore(p->vscore);
+    vs_owner_unref(p->owner);
+    p->owner = NULL;
 }
 
 static int drv_lazy_load_core(struct vf_instance *vf)
@@ -53,6 +53,7 @@ struct pipeline {
 struct vf_priv_s {
     int deint_type; // 0: none, 1: discard, 2: double fps
     int interlaced_only;
+    int batch;
     bool do_deint;
     VABufferID buffers[VAProcFilterCount];
     int num_buffers;
@@ -66,6 +67,10 @@ struct vf_priv_s {
     int current_rt_format;
 
     struct mp_refqueue *queue;
+
+    // Input frames held back until a whole batch can be rendered.
+    struct mp_image **batch_queue;
+    int num_batch_queue;
 };
 
 static const struct vf_priv_s vf_priv_default = {
@@ -73,6 +78,7 @@ static const struct vf_priv_s vf_priv_default = {
     .context = VA_INVALID_ID,
     .deint_type = 2,
     .interlaced_only = 1,
+    .batch = 1,
 };
 
 static void add_surfaces(struct vf_priv_s *p, struct surface_refs *refs, int dir)
@@ -101,6 +107,9 @@ static void flush_frames(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
     mp_refqueue_flush(p->queue);
+    for (int n = 0; n < p->num_batch_queue; n++)
+        talloc_free(p->batch_queue[n]);
+    p->num_batch_queue = 0;
 }
 
 static void update_pipeline(struct vf_instance *vf)
@@ -271,17 +280,29 @@ static int filter_ext(struct vf_instance *vf, struct mp_image *in)
             return -1;
     }
 
-    mp_refqueue_add_input(p->queue, in);
+    // Collect a batch of frames, and then submit all of them at once in
+    // filter_out(), instead of interleaving GPU work with the rest of the
+    // playback pipeline.
+    bool eof = !in;
+    if (p->batch > 1 && p->pipe.num_filters && in) {
+        MP_TARRAY_APPEND(p, p->batch_queue, p->num_batch_queue, in);
+        in = NULL;
+        if (p->num_batch_queue < p->batch)
+            return 0;
+    }
+    for (int n = 0; n < p->num_batch_queue; n++)
+        mp_refqueue_add_input(p->queue, p->batch_queue[n]);
+    p->num_batch_queue = 0;
+
+    if (in || eof)
+        mp_refqueue_add_input(p->queue, in);
     return 0;
 }
 
-static int filter_out(struct vf_instance *vf)
+static int output_field(struct vf_instance *vf)
 {
     struct vf_priv_s *p = vf->priv;
 
-    if (!mp_refqueue_has_output(p->queue))
-        return 0;
-
     // no filtering
     if (!p->pipe.num_filters || !mp_refqueue_should_deint(p->queue)) {
         struct mp_image *in = mp_refqueue_get(p->queue, 0);
@@ -298,6 +319,24 @@ static int filter_out(struct vf_instance *vf)
     return 0;
 }
 
+static int filter_out(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+
+    if (!mp_refqueue_has_output(p->queue))
+        return 0;
+
+    if (p->batch < 2)
+        return output_field(vf);
+
+    // Render everything the queued input allows in one go.
+    while (mp_refqueue_has_output(p->queue)) {
+        if (output_field(vf) < 0)
+            return -1;
+    }
+    return 0;
+}
+
 static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
                     struct mp_image_params *out)
 {
@@ -477,6 +516,7 @@ static const m_option_t vf_opts_fields[] = {
                 {"motion-adaptive", 4},
                 {"motion-compensated", 5})),
     OPT_FLAG("interlaced-only", interlaced_only, 0),
+    OPT_INTRANGE("batch", batch, 0, 1, 8),
     {0}
 };
 
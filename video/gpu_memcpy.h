@@ -4,5 +4,6 @@
 #include <stddef.h>
 
 void *gpu_memcpy(void *restrict d, const void *restrict s, size_t size);
+void *gpu_memcpy_avx2(void *restrict d, const void *restrict s, size_t size);
 
 #endif
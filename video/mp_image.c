@@ -24,15 +24,22 @@
 #include <pthread.h>
 #include <assert.h>
 
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
 #include <libavutil/mem.h>
 #include <libavutil/common.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/rational.h>
 #include <libavcodec/avcodec.h>
 
 #include "mpv_talloc.h"
 
+#include "config.h"
+#include "misc/thread_pool.h"
 #include "img_format.h"
 #include "mp_image.h"
 #include "sws_utils.h"
@@ -44,13 +51,14 @@
 #define HAVE_OPAQUE_REF (LIBAVUTIL_VERSION_MICRO >= 100 && \
                          LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 47, 100))
 
-static bool mp_image_alloc_planes(struct mp_image *mpi)
+// Set the strides of mpi (with the given stride alignment), and the offsets
+// of each plane within a single buffer (-1 for unused planes).
+// Returns the total buffer size, or -1 on error.
+static int mp_image_layout(struct mp_image *mpi, int stride_align,
+                           int out_plane_offset[MP_MAX_PLANES])
 {
-    assert(!mpi->planes[0]);
-    assert(!mpi->bufs[0]);
-
     if (!mp_image_params_valid(&mpi->params) || mpi->fmt.flags & MP_IMGFLAG_HWACCEL)
-        return false;
+        return -1;
 
     // Note: for non-mod-2 4:2:0 YUV frames, we have to allocate an additional
     //       top/right border. This is needed for correct handling of such
@@ -60,29 +68,100 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     for (int n = 0; n < MP_MAX_PLANES; n++) {
         int alloc_h = MP_ALIGN_UP(mpi->h, 32) >> mpi->fmt.ys[n];
         int line_bytes = (mp_image_plane_w(mpi, n) * mpi->fmt.bpp[n] + 7) / 8;
-        mpi->stride[n] = FFALIGN(line_bytes, SWS_MIN_BYTE_ALIGN);
+        mpi->stride[n] = FFALIGN(line_bytes, stride_align);
         plane_size[n] = mpi->stride[n] * alloc_h;
     }
     if (mpi->fmt.flags & MP_IMGFLAG_PAL)
         plane_size[1] = MP_PALETTE_SIZE;
 
     size_t sum = 0;
-    for (int n = 0; n < MP_MAX_PLANES; n++)
+    for (int n = 0; n < MP_MAX_PLANES; n++) {
+        out_plane_offset[n] = plane_size[n] ? sum : -1;
         sum += plane_size[n];
+    }
+
+    return sum < INT_MAX ? sum : -1;
+}
+
+static bool mp_image_alloc_planes(struct mp_image *mpi)
+{
+    assert(!mpi->planes[0]);
+    assert(!mpi->bufs[0]);
+
+    int plane_offset[MP_MAX_PLANES];
+    int size = mp_image_layout(mpi, SWS_MIN_BYTE_ALIGN, plane_offset);
+    if (size < 0)
+        return false;
 
     // Note: mp_image_pool assumes this creates only 1 AVBufferRef.
-    mpi->bufs[0] = av_buffer_alloc(FFMAX(sum, 1));
+    mpi->bufs[0] = av_buffer_alloc(FFMAX(size, 1));
     if (!mpi->bufs[0])
         return false;
 
-    uint8_t *data = mpi->bufs[0]->data;
     for (int n = 0; n < MP_MAX_PLANES; n++) {
-        mpi->planes[n] = plane_size[n] ? data : NULL;
-        data += plane_size[n];
+        mpi->planes[n] = plane_offset[n] >= 0 ?
+                         mpi->bufs[0]->data + plane_offset[n] : NULL;
     }
     return true;
 }
 
+// Return the buffer size needed by mp_image_from_buffer() for an image with
+// the given parameters, or -1 if they are invalid. stride_align must be a
+// power of 2.
+int mp_image_get_alloc_size(int imgfmt, int w, int h, int stride_align)
+{
+    struct mp_image img = {0};
+    mp_image_set_size(&img, w, h);
+    mp_image_setfmt(&img, imgfmt);
+
+    int plane_offset[MP_MAX_PLANES];
+    int size = mp_image_layout(&img, stride_align, plane_offset);
+    if (size < 0)
+        return -1;
+
+    // Space for aligning the start of the buffer.
+    return size + stride_align - 1;
+}
+
+// Create an image, whose planes point into the given buffer, laid out with
+// the given stride alignment. buffer_size must be at least the size returned
+// by mp_image_get_alloc_size(). The buffer is owned by the returned image:
+// free_fn(free_opaque, buffer) is called when the last reference to it goes
+// away (this can happen on any thread). If this fails, free_fn() is called
+// immediately, and NULL is returned.
+struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align,
+                                      uint8_t *buffer, int buffer_size,
+                                      void *free_opaque,
+                                      void (*free_fn)(void *opaque,
+                                                      uint8_t *data))
+{
+    struct mp_image *mpi = mp_image_new_dummy_ref(NULL);
+    mp_image_set_size(mpi, w, h);
+    mp_image_setfmt(mpi, imgfmt);
+
+    int plane_offset[MP_MAX_PLANES];
+    int size = mp_image_layout(mpi, stride_align, plane_offset);
+    uintptr_t start = MP_ALIGN_UP((uintptr_t)buffer, stride_align);
+    size_t skip = start - (uintptr_t)buffer;
+    if (size < 0 || skip + size > buffer_size)
+        goto fail;
+
+    mpi->bufs[0] = av_buffer_create(buffer, buffer_size, free_fn, free_opaque, 0);
+    if (!mpi->bufs[0])
+        goto fail;
+
+    for (int n = 0; n < MP_MAX_PLANES; n++) {
+        mpi->planes[n] = plane_offset[n] >= 0 ?
+                         buffer + skip + plane_offset[n] : NULL;
+    }
+    return mpi;
+
+fail:
+    talloc_free(mpi);
+    free_fn(free_opaque, buffer);
+    return NULL;
+}
+
 void mp_image_setfmt(struct mp_image *mpi, int out_fmt)
 {
     struct mp_image_params params = mpi->params;
@@ -94,6 +173,83 @@ void mp_image_setfmt(struct mp_image *mpi, int out_fmt)
     mpi->params = params;
 }
 
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+static void free_av_buffer(void *opaque, uint8_t *data)
+{
+    av_free(data);
+}
+
+#if HAVE_POSIX && defined(MAP_ANONYMOUS)
+static void free_mapping(void *opaque, uint8_t *data)
+{
+    munmap(data, (uintptr_t)opaque);
+}
+
+// Map size bytes (a multiple of HUGEPAGE_SIZE), backed by huge pages if
+// possible. Returns NULL on failure.
+static uint8_t *map_hugepages(size_t size)
+{
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages; fails unless the admin reserved some.
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+        return p;
+#endif
+    // Transparent huge pages can only be used for parts of the mapping which
+    // are aligned to the huge page size, so map more and cut off the rest.
+    size_t map_size = size + HUGEPAGE_SIZE;
+    p = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    uint8_t *start = (uint8_t *)MP_ALIGN_UP((uintptr_t)p, HUGEPAGE_SIZE);
+    size_t head = start - (uint8_t *)p;
+    if (head)
+        munmap(p, head);
+    if (map_size - head - size)
+        munmap(start + size, map_size - head - size);
+#ifdef MADV_HUGEPAGE
+    madvise(start, size, MADV_HUGEPAGE);
+#endif
+    return start;
+}
+#endif
+
+// Like mp_image_alloc(), but try to back the image data with huge pages, which
+// reduces TLB misses when processing large frames. Images smaller than a huge
+// page, and systems without support, get normal memory. The stride alignment
+// is as with mp_image_from_buffer(). Since setting up the mapping is much more
+// expensive than malloc(), this should be used with mp_image_pool, which
+// recycles the allocations.
+struct mp_image *mp_image_alloc_hugepages(int imgfmt, int w, int h,
+                                          int stride_align)
+{
+    int size = mp_image_get_alloc_size(imgfmt, w, h, stride_align);
+    if (size < 0)
+        return NULL;
+
+#if HAVE_POSIX && defined(MAP_ANONYMOUS)
+    if (size >= HUGEPAGE_SIZE) {
+        size_t map_size = MP_ALIGN_UP((size_t)size, HUGEPAGE_SIZE);
+        uint8_t *data = map_hugepages(map_size);
+        if (data) {
+            return mp_image_from_buffer(imgfmt, w, h, stride_align, data, size,
+                                        (void *)(uintptr_t)map_size,
+                                        free_mapping);
+        }
+    }
+#endif
+
+    uint8_t *data = av_malloc(MPMAX(size, 1));
+    if (!data)
+        return NULL;
+    return mp_image_from_buffer(imgfmt, w, h, stride_align, data, size, NULL,
+                                free_av_buffer);
+}
+
 static void mp_image_destructor(void *ptr)
 {
     mp_image_t *mpi = ptr;
@@ -353,15 +509,89 @@ void mp_image_copy(struct mp_image *dst, struct mp_image *src)
     mp_image_copy_cb(dst, src, memcpy);
 }
 
-void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+// Pick the fastest available memcpy for reading from GPU memory. *name is
+// set to NULL if it's plain memcpy.
+static memcpy_fn get_gpu_memcpy(const char **name)
 {
 #if HAVE_SSE4_INTRINSICS
-    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE4) {
-        mp_image_copy_cb(dst, src, gpu_memcpy);
-        return;
+    int flags = av_get_cpu_flags();
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2) {
+        *name = "AVX2";
+        return gpu_memcpy_avx2;
+    }
+#endif
+    if (flags & AV_CPU_FLAG_SSE4) {
+        *name = "SSE4";
+        return gpu_memcpy;
     }
 #endif
-    mp_image_copy(dst, src);
+    *name = NULL;
+    return memcpy;
+}
+
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+{
+    mp_image_copy_gpu_mt(dst, src, NULL, 1);
+}
+
+struct copy_slice {
+    struct mp_image *dst, *src;
+    int slice, num_slices;
+    memcpy_fn cpy;
+};
+
+// Copy the rows of each plane belonging to the given slice.
+static void copy_slice_fn(void *ctx)
+{
+    struct copy_slice *s = ctx;
+    struct mp_image *dst = s->dst, *src = s->src;
+    for (int n = 0; n < dst->num_planes; n++) {
+        int line_bytes = (mp_image_plane_w(dst, n) * dst->fmt.bpp[n] + 7) / 8;
+        int plane_h = mp_image_plane_h(dst, n);
+        int y0 = (int64_t)plane_h * s->slice / s->num_slices;
+        int y1 = (int64_t)plane_h * (s->slice + 1) / s->num_slices;
+        memcpy_pic_cb(dst->planes[n] + (ptrdiff_t)y0 * dst->stride[n],
+                      src->planes[n] + (ptrdiff_t)y0 * src->stride[n],
+                      line_bytes, y1 - y0, dst->stride[n], src->stride[n],
+                      s->cpy);
+    }
+}
+
+// Like mp_image_copy_gpu(), but split the planes into horizontal slices, and
+// copy them in parallel on the given pool of worker threads. threads is the
+// number of slices (one of them is copied by the calling thread), and should
+// be at most the number of pool threads+1. pool can be NULL for a single
+// threaded copy.
+void mp_image_copy_gpu_mt(struct mp_image *dst, struct mp_image *src,
+                          struct mp_thread_pool *pool, int threads)
+{
+    assert(dst->imgfmt == src->imgfmt);
+    assert(dst->w == src->w && dst->h == src->h);
+    assert(mp_image_is_writeable(dst));
+
+    const char *name;
+    memcpy_fn cpy = get_gpu_memcpy(&name);
+
+    // Below this, waking up the workers probably costs more than it gains.
+    if (!pool || dst->w * dst->h < 320 * 240)
+        threads = 1;
+    threads = MPCLAMP(threads, 1, MP_MAX_COPY_THREADS);
+
+    struct copy_slice slices[MP_MAX_COPY_THREADS];
+    for (int n = 0; n < threads; n++) {
+        slices[n] = (struct copy_slice){
+            .dst = dst, .src = src, .slice = n, .num_slices = threads, .cpy = cpy,
+        };
+    }
+    for (int n = 1; n < threads; n++)
+        mp_thread_pool_queue(pool, copy_slice_fn, &slices[n]);
+    copy_slice_fn(&slices[0]);
+    if (threads > 1)
+        mp_thread_pool_wait(pool);
+
+    if ((dst->fmt.flags & MP_IMGFLAG_PAL) && dst->planes[1] && src->planes[1])
+        memcpy(dst->planes[1], src->planes[1], MP_PALETTE_SIZE);
 }
 
 // Helper, only for outputting some log info.
@@ -373,12 +603,10 @@ void mp_check_gpu_memcpy(struct mp_log *log, bool *once)
         *once = true;
     }
 
-    bool have_sse = false;
-#if HAVE_SSE4_INTRINSICS
-    have_sse = av_get_cpu_flags() & AV_CPU_FLAG_SSE4;
-#endif
-    if (have_sse) {
-        mp_verbose(log, "Using SSE4 memcpy\n");
+    const char *name;
+    get_gpu_memcpy(&name);
+    if (name) {
+        mp_verbose(log, "Using %s memcpy\n", name);
     } else {
         mp_warn(log, "Using fallback memcpy (slow)\n");
     }
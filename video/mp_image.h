@@ -103,8 +103,20 @@ typedef struct mp_image {
 int mp_chroma_div_up(int size, int shift);
 
 struct mp_image *mp_image_alloc(int fmt, int w, int h);
+struct mp_image *mp_image_alloc_hugepages(int imgfmt, int w, int h,
+                                          int stride_align);
+int mp_image_get_alloc_size(int imgfmt, int w, int h, int stride_align);
+struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align,
+                                      uint8_t *buffer, int buffer_size,
+                                      void *free_opaque,
+                                      void (*free_fn)(void *opaque,
+                                                      uint8_t *data));
 void mp_image_copy(struct mp_image *dmpi, struct mp_image *mpi);
 void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src);
+struct mp_thread_pool;
+#define MP_MAX_COPY_THREADS 16
+void mp_image_copy_gpu_mt(struct mp_image *dst, struct mp_image *src,
+                          struct mp_thread_pool *pool, int threads);
 void mp_image_copy_attributes(struct mp_image *dmpi, struct mp_image *mpi);
 struct mp_image *mp_image_new_copy(struct mp_image *img);
 struct mp_image *mp_image_new_ref(struct mp_image *img);
@@ -19,6 +19,8 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 #include <assert.h>
 
@@ -29,10 +31,12 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "common/mem_usage.h"
 
 #include "fmt-conversion.h"
 #include "mp_image.h"
 #include "mp_image_pool.h"
+#include "sws_utils.h"
 
 static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define pool_lock() pthread_mutex_lock(&pool_mutex)
@@ -44,6 +48,7 @@ static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct mp_image_pool {
     int max_count;
+    size_t max_bytes;           // 0 for no limit
 
     struct mp_image **images;
     int num_images;
@@ -52,9 +57,21 @@ struct mp_image_pool {
     void *allocator_ctx;
 
     bool use_lru;
+    bool use_hugepages;
     unsigned int lru_counter;
+
+    // Statistics; protected by pool_mutex, since they're read by
+    // mp_image_pool_get_all_stats() from arbitrary threads.
+    char name[32];
+    uint64_t hits, misses;
+    size_t bytes, peak_bytes;
+
+    struct mp_image_pool *reg_prev, *reg_next; // registry list (pool_mutex)
 };
 
+// All existing pools, for mp_image_pool_get_all_stats().
+static struct mp_image_pool *registry;
+
 // Used to gracefully handle the case when the pool is freed while image
 // references allocated from the image pool are still held by someone.
 struct image_flags {
@@ -68,6 +85,15 @@ static void image_pool_destructor(void *ptr)
 {
     struct mp_image_pool *pool = ptr;
     mp_image_pool_clear(pool);
+    pool_lock();
+    if (pool->reg_prev) {
+        pool->reg_prev->reg_next = pool->reg_next;
+    } else {
+        registry = pool->reg_next;
+    }
+    if (pool->reg_next)
+        pool->reg_next->reg_prev = pool->reg_prev;
+    pool_unlock();
 }
 
 struct mp_image_pool *mp_image_pool_new(int max_count)
@@ -77,26 +103,80 @@ struct mp_image_pool *mp_image_pool_new(int max_count)
     *pool = (struct mp_image_pool) {
         .max_count = max_count,
     };
+    pool_lock();
+    pool->reg_next = registry;
+    if (registry)
+        registry->reg_prev = pool;
+    registry = pool;
+    pool_unlock();
     return pool;
 }
 
+static size_t image_bytes(struct mp_image *img)
+{
+    return img->bufs[0] ? img->bufs[0]->size : 0;
+}
+
+// Drop the pool's reference to images[n], and return the image if it must be
+// freed by the caller (after unlocking). Call with pool_mutex held.
+static struct mp_image *release_image(struct mp_image_pool *pool, int n)
+{
+    struct mp_image *img = pool->images[n];
+    struct image_flags *it = img->priv;
+    assert(it->pool_alive);
+    it->pool_alive = false;
+    pool->bytes -= image_bytes(img);
+    mp_mem_usage_add(MP_MEM_IMAGE_POOLS, -(int64_t)image_bytes(img));
+    return it->referenced ? NULL : img;
+}
+
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
     for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
-        struct image_flags *it = img->priv;
-        bool referenced;
         pool_lock();
-        assert(it->pool_alive);
-        it->pool_alive = false;
-        referenced = it->referenced;
+        struct mp_image *img = release_image(pool, n);
         pool_unlock();
-        if (!referenced)
-            talloc_free(img);
+        talloc_free(img);
     }
     pool->num_images = 0;
 }
 
+// Free unreferenced images, least recently used first, until an image of
+// new_bytes size fits into the count and byte limits. If that is not enough,
+// the pool gives up all images (referenced images are freed on unref).
+static void trim_pool(struct mp_image_pool *pool, size_t new_bytes)
+{
+    while (pool->num_images >= pool->max_count ||
+           (pool->max_bytes && pool->num_images &&
+            pool->bytes + new_bytes > pool->max_bytes) ||
+           (pool->num_images &&
+            mp_mem_usage_over_limit(MP_MEM_IMAGE_POOLS, new_bytes)))
+    {
+        pool_lock();
+        int oldest = -1;
+        for (int n = 0; n < pool->num_images; n++) {
+            struct image_flags *it = pool->images[n]->priv;
+            if (it->referenced)
+                continue;
+            struct image_flags *old_it =
+                oldest >= 0 ? pool->images[oldest]->priv : NULL;
+            if (!old_it || it->order < old_it->order)
+                oldest = n;
+        }
+        struct mp_image *img = NULL;
+        if (oldest >= 0) {
+            img = release_image(pool, oldest);
+            MP_TARRAY_REMOVE_AT(pool->images, pool->num_images, oldest);
+        }
+        pool_unlock();
+        talloc_free(img);
+        if (oldest < 0) {
+            mp_image_pool_clear(pool);
+            break;
+        }
+    }
+}
+
 // This is the only function that is allowed to run in a different thread.
 // (Consider passing an image to another thread, which frees it.)
 static void unref_image(void *opaque, uint8_t *data)
@@ -172,7 +252,12 @@ void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
     struct image_flags *it = talloc_ptrtype(new, it);
     *it = (struct image_flags) { .pool_alive = true };
     new->priv = it;
+    pool_lock();
     MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
+    pool->bytes += image_bytes(new);
+    mp_mem_usage_add(MP_MEM_IMAGE_POOLS, image_bytes(new));
+    pool->peak_bytes = MPMAX(pool->peak_bytes, pool->bytes);
+    pool_unlock();
 }
 
 // Return a new image of given format/size. The only difference to
@@ -187,11 +272,20 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
     if (!pool)
         return mp_image_alloc(fmt, w, h);
     struct mp_image *new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
+    pool_lock();
+    if (new) {
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    pool_unlock();
     if (!new) {
-        if (pool->num_images >= pool->max_count)
-            mp_image_pool_clear(pool);
+        trim_pool(pool, MPMAX(mp_image_get_alloc_size(fmt, w, h,
+                                                     SWS_MIN_BYTE_ALIGN), 0));
         if (pool->allocator) {
             new = pool->allocator(pool->allocator_ctx, fmt, w, h);
+        } else if (pool->use_hugepages) {
+            new = mp_image_alloc_hugepages(fmt, w, h, SWS_MIN_BYTE_ALIGN);
         } else {
             new = mp_image_alloc(fmt, w, h);
         }
@@ -251,6 +345,100 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
     pool->use_lru = true;
 }
 
+// Allocate images with mp_image_alloc_hugepages() (unless a custom allocator is
+// set). The pool keeps the allocations, so that the huge pages are reused.
+void mp_image_pool_set_hugepages(struct mp_image_pool *pool, bool enable)
+{
+    pool->use_hugepages = enable;
+}
+
+// Limit the total allocation size of the images owned by the pool (0 means
+// no limit). Unused images are freed LRU-first to stay below the limit. The
+// limit can be exceeded if all images are in use.
+void mp_image_pool_set_max_bytes(struct mp_image_pool *pool, size_t max_bytes)
+{
+    pool->max_bytes = max_bytes;
+    if (max_bytes)
+        trim_pool(pool, 0);
+}
+
+// Set the name under which the pool is listed by mp_image_pool_get_all_stats().
+void mp_image_pool_set_name(struct mp_image_pool *pool, const char *name)
+{
+    pool_lock();
+    snprintf(pool->name, sizeof(pool->name), "%s", name);
+    pool_unlock();
+}
+
+// Return a copy of the statistics of all named pools. Can be called from any
+// thread. *out is allocated with ta_parent.
+int mp_image_pool_get_all_stats(void *ta_parent, struct mp_image_pool_stats **out)
+{
+    int num = 0;
+    *out = NULL;
+    pool_lock();
+    for (struct mp_image_pool *pool = registry; pool; pool = pool->reg_next) {
+        if (!pool->name[0])
+            continue;
+        struct mp_image_pool_stats st = {
+            .name = talloc_strdup(ta_parent, pool->name),
+            .count = pool->num_images,
+            .max_count = pool->max_count,
+            .bytes = pool->bytes,
+            .peak_bytes = pool->peak_bytes,
+            .max_bytes = pool->max_bytes,
+            .hits = pool->hits,
+            .misses = pool->misses,
+        };
+        MP_TARRAY_APPEND(ta_parent, *out, num, st);
+    }
+    pool_unlock();
+    return num;
+}
+
+
+#if HAVE_AVUTIL_HWFRAME_MAP
+// Map the HW surface to system memory, and copy it with mp_image_copy_gpu_mt().
+// Not all APIs support mapping; returns NULL on failure.
+static struct mp_image *hw_map_download(struct mp_image *src, int imgfmt,
+                                        struct mp_image_pool *swpool,
+                                        struct mp_thread_pool *copy_pool,
+                                        int copy_threads)
+{
+    AVHWFramesContext *fctx = (void *)src->hwctx->data;
+    struct mp_image *dst = NULL;
+
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    AVFrame *mapped = av_frame_alloc();
+    if (!srcav || !mapped)
+        goto done;
+    mapped->format = imgfmt2pixfmt(imgfmt);
+    if (av_hwframe_map(mapped, srcav, AV_HWFRAME_MAP_READ) < 0)
+        goto done;
+
+    struct mp_image *mapped_img = mp_image_from_av_frame(mapped);
+    if (!mapped_img || mapped_img->imgfmt != imgfmt ||
+        mapped_img->w < src->w || mapped_img->h < src->h)
+    {
+        talloc_free(mapped_img);
+        goto done;
+    }
+    mp_image_set_size(mapped_img, src->w, src->h);
+
+    dst = mp_image_pool_get(swpool, imgfmt, fctx->width, fctx->height);
+    if (dst) {
+        mp_image_set_size(dst, src->w, src->h);
+        mp_image_copy_gpu_mt(dst, mapped_img, copy_pool, copy_threads);
+        mp_image_copy_attributes(dst, src);
+    }
+    talloc_free(mapped_img);
+
+done:
+    av_frame_free(&srcav);
+    av_frame_free(&mapped);
+    return dst;
+}
+#endif
 
 // Copies the contents of the HW surface img to system memory and retuns it.
 // If swpool is not NULL, it's used to allocate the target image.
@@ -260,6 +448,16 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
 // Returns NULL on failure.
 struct mp_image *mp_image_hw_download(struct mp_image *src,
                                       struct mp_image_pool *swpool)
+{
+    return mp_image_hw_download_mt(src, swpool, NULL, 1);
+}
+
+// Like mp_image_hw_download(), but if the surface can be mapped, copy it with
+// copy_threads threads from copy_pool (see mp_image_copy_gpu_mt()).
+struct mp_image *mp_image_hw_download_mt(struct mp_image *src,
+                                         struct mp_image_pool *swpool,
+                                         struct mp_thread_pool *copy_pool,
+                                         int copy_threads)
 {
     if (!src->hwctx)
         return NULL;
@@ -281,6 +479,15 @@ struct mp_image *mp_image_hw_download(struct mp_image *src,
     if (!imgfmt)
         return NULL;
 
+#if HAVE_AVUTIL_HWFRAME_MAP
+    if (copy_pool) {
+        struct mp_image *mapped =
+            hw_map_download(src, imgfmt, swpool, copy_pool, copy_threads);
+        if (mapped)
+            return mapped;
+    }
+#endif
+
     struct mp_image *dst =
         mp_image_pool_get(swpool, imgfmt, fctx->width, fctx->height);
     if (!dst)
@@ -2,9 +2,20 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
+struct mp_image_pool_stats {
+    char *name;
+    int count, max_count;       // images owned by the pool
+    size_t bytes;               // allocation size of these images
+    size_t peak_bytes;
+    size_t max_bytes;           // 0 if unlimited
+    uint64_t hits, misses;      // reused/newly allocated images
+};
+
 struct mp_image_pool *mp_image_pool_new(int max_count);
 struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
                                    int w, int h);
@@ -13,6 +24,10 @@ void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new);
 void mp_image_pool_clear(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
+void mp_image_pool_set_hugepages(struct mp_image_pool *pool, bool enable);
+void mp_image_pool_set_max_bytes(struct mp_image_pool *pool, size_t max_bytes);
+void mp_image_pool_set_name(struct mp_image_pool *pool, const char *name);
+int mp_image_pool_get_all_stats(void *ta_parent, struct mp_image_pool_stats **out);
 
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
@@ -28,5 +43,10 @@ bool mp_image_pool_make_writeable(struct mp_image_pool *pool,
 
 struct mp_image *mp_image_hw_download(struct mp_image *img,
                                       struct mp_image_pool *swpool);
+struct mp_thread_pool;
+struct mp_image *mp_image_hw_download_mt(struct mp_image *img,
+                                         struct mp_image_pool *swpool,
+                                         struct mp_thread_pool *copy_pool,
+                                         int copy_threads);
 
 #endif
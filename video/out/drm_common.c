@@ -169,6 +169,7 @@ static bool setup_crtc(struct kms *kms, const drmModeRes *res)
 
             kms->encoder = encoder;
             kms->crtc_id = res->crtcs[j];
+            kms->crtc_index = j;
             return true;
         }
 
@@ -236,6 +237,7 @@ struct kms *kms_create(struct mp_log *log, const char *connector_spec,
         .encoder = NULL,
         .mode = { 0 },
         .crtc_id = -1,
+        .crtc_index = -1,
         .card_no = card_no,
     };
 
@@ -353,6 +355,142 @@ double kms_get_display_fps(const struct kms *kms)
     return kms->mode.clock * 1000.0 / kms->mode.htotal / kms->mode.vtotal;
 }
 
+static const char *const plane_prop_names[KMS_PLANE_PROP_COUNT] = {
+    [KMS_PLANE_FB_ID]   = "FB_ID",
+    [KMS_PLANE_CRTC_ID] = "CRTC_ID",
+    [KMS_PLANE_SRC_X]   = "SRC_X",
+    [KMS_PLANE_SRC_Y]   = "SRC_Y",
+    [KMS_PLANE_SRC_W]   = "SRC_W",
+    [KMS_PLANE_SRC_H]   = "SRC_H",
+    [KMS_PLANE_CRTC_X]  = "CRTC_X",
+    [KMS_PLANE_CRTC_Y]  = "CRTC_Y",
+    [KMS_PLANE_CRTC_W]  = "CRTC_W",
+    [KMS_PLANE_CRTC_H]  = "CRTC_H",
+};
+
+// Enable atomic modesetting (which implies universal planes). Legacy calls
+// like drmModeSetCrtc() continue to work.
+bool kms_enable_atomic(struct kms *kms)
+{
+    if (drmSetClientCap(kms->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+        drmSetClientCap(kms->fd, DRM_CLIENT_CAP_ATOMIC, 1))
+    {
+        MP_VERBOSE(kms, "Atomic modesetting not supported: %s\n",
+                   mp_strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Look up the property IDs of the plane. Returns the value of the plane's
+// "type" property (DRM_PLANE_TYPE_*), or -1 if a property is missing.
+static int get_plane_props(struct kms *kms, struct kms_plane *plane)
+{
+    drmModeObjectProperties *props =
+        drmModeObjectGetProperties(kms->fd, plane->id, DRM_MODE_OBJECT_PLANE);
+    if (!props)
+        return -1;
+
+    int type = -1;
+    for (unsigned int i = 0; i < props->count_props; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(kms->fd, props->props[i]);
+        if (!prop)
+            continue;
+        if (strcmp(prop->name, "type") == 0)
+            type = props->prop_values[i];
+        for (int n = 0; n < KMS_PLANE_PROP_COUNT; n++) {
+            if (strcmp(prop->name, plane_prop_names[n]) == 0)
+                plane->props[n] = prop->prop_id;
+        }
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+
+    for (int n = 0; n < KMS_PLANE_PROP_COUNT; n++) {
+        if (!plane->props[n])
+            return -1;
+    }
+    return type;
+}
+
+bool kms_plane_has_format(const struct kms_plane *plane, uint32_t format)
+{
+    for (int n = 0; n < plane->num_formats; n++) {
+        if (plane->formats[n] == format)
+            return true;
+    }
+    return false;
+}
+
+// Return the first plane of the given type (DRM_PLANE_TYPE_*) that can be
+// used with the kms CRTC and supports at least one of the formats. The plane
+// exclude_id is skipped. Requires kms_enable_atomic(). Returns NULL if none.
+struct kms_plane *kms_find_plane(struct kms *kms, void *ta_parent, int type,
+                                 const uint32_t *formats, int num_formats,
+                                 uint32_t exclude_id)
+{
+    drmModePlaneRes *res = drmModeGetPlaneResources(kms->fd);
+    if (!res) {
+        MP_ERR(kms, "Cannot retrieve plane resources: %s\n",
+               mp_strerror(errno));
+        return NULL;
+    }
+
+    struct kms_plane *found = NULL;
+    for (unsigned int i = 0; i < res->count_planes && !found; i++) {
+        if (res->planes[i] == exclude_id)
+            continue;
+        drmModePlane *p = drmModeGetPlane(kms->fd, res->planes[i]);
+        if (!p)
+            continue;
+        if (p->possible_crtcs & (1 << kms->crtc_index)) {
+            struct kms_plane *plane = talloc_zero(ta_parent, struct kms_plane);
+            plane->id = p->plane_id;
+            plane->num_formats = p->count_formats;
+            plane->formats = talloc_memdup(plane, p->formats,
+                                    p->count_formats * sizeof(p->formats[0]));
+            if (get_plane_props(kms, plane) == type) {
+                for (int n = 0; n < num_formats; n++) {
+                    if (kms_plane_has_format(plane, formats[n]))
+                        found = plane;
+                }
+            }
+            if (!found)
+                talloc_free(plane);
+        }
+        drmModeFreePlane(p);
+    }
+
+    drmModeFreePlaneResources(res);
+    return found;
+}
+
+// Add the properties to show the src rectangle of the framebuffer at dst on
+// the CRTC to the request. If fb_id is 0, the plane is disabled instead.
+void kms_plane_atomic_add(const struct kms *kms, drmModeAtomicReq *req,
+                          const struct kms_plane *plane, uint32_t fb_id,
+                          const struct mp_rect *src, const struct mp_rect *dst)
+{
+    uint64_t values[KMS_PLANE_PROP_COUNT] = {0};
+    int num_values = 2; // FB_ID and CRTC_ID only
+    if (fb_id) {
+        values[KMS_PLANE_FB_ID]   = fb_id;
+        values[KMS_PLANE_CRTC_ID] = kms->crtc_id;
+        // source coordinates are 16.16 fixed point
+        values[KMS_PLANE_SRC_X]   = (uint64_t)src->x0 << 16;
+        values[KMS_PLANE_SRC_Y]   = (uint64_t)src->y0 << 16;
+        values[KMS_PLANE_SRC_W]   = (uint64_t)(src->x1 - src->x0) << 16;
+        values[KMS_PLANE_SRC_H]   = (uint64_t)(src->y1 - src->y0) << 16;
+        values[KMS_PLANE_CRTC_X]  = dst->x0;
+        values[KMS_PLANE_CRTC_Y]  = dst->y0;
+        values[KMS_PLANE_CRTC_W]  = dst->x1 - dst->x0;
+        values[KMS_PLANE_CRTC_H]  = dst->y1 - dst->y0;
+        num_values = KMS_PLANE_PROP_COUNT;
+    }
+    for (int n = 0; n < num_values; n++)
+        drmModeAtomicAddProperty(req, plane->id, plane->props[n], values[n]);
+}
+
 int drm_validate_connector_opt(struct mp_log *log, const struct m_option *opt,
                                struct bstr name, struct bstr param)
 {
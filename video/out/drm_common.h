@@ -30,9 +30,32 @@ struct kms {
     drmModeEncoder *encoder;
     drmModeModeInfo mode;
     uint32_t crtc_id;
+    int crtc_index;
     int card_no;
 };
 
+enum kms_plane_prop {
+    KMS_PLANE_FB_ID,
+    KMS_PLANE_CRTC_ID,
+    KMS_PLANE_SRC_X,
+    KMS_PLANE_SRC_Y,
+    KMS_PLANE_SRC_W,
+    KMS_PLANE_SRC_H,
+    KMS_PLANE_CRTC_X,
+    KMS_PLANE_CRTC_Y,
+    KMS_PLANE_CRTC_W,
+    KMS_PLANE_CRTC_H,
+    KMS_PLANE_PROP_COUNT
+};
+
+// A plane usable with atomic modesetting on the kms CRTC.
+struct kms_plane {
+    uint32_t id;
+    uint32_t *formats;      // DRM_FORMAT_* supported by the plane
+    int num_formats;
+    uint32_t props[KMS_PLANE_PROP_COUNT]; // property IDs
+};
+
 struct vt_switcher {
     int tty_fd;
     struct mp_log *log;
@@ -55,6 +78,16 @@ struct kms *kms_create(struct mp_log *log, const char *connector_spec,
 void kms_destroy(struct kms *kms);
 double kms_get_display_fps(const struct kms *kms);
 
+bool kms_enable_atomic(struct kms *kms);
+struct kms_plane *kms_find_plane(struct kms *kms, void *ta_parent, int type,
+                                 const uint32_t *formats, int num_formats,
+                                 uint32_t exclude_id);
+bool kms_plane_has_format(const struct kms_plane *plane, uint32_t format);
+struct mp_rect;
+void kms_plane_atomic_add(const struct kms *kms, drmModeAtomicReq *req,
+                          const struct kms_plane *plane, uint32_t fb_id,
+                          const struct mp_rect *src, const struct mp_rect *dst);
+
 void kms_show_available_connectors(struct mp_log *log, int card_no);
 void kms_show_available_modes(struct mp_log *log,
                               const drmModeConnector *connector);
@@ -95,6 +95,7 @@ static const struct gl_functions gl_functions[] = {
             DEF_FN(BindTexture),
             DEF_FN(BlendFuncSeparate),
             DEF_FN(BufferData),
+            DEF_FN(BufferSubData),
             DEF_FN(Clear),
             DEF_FN(ClearColor),
             DEF_FN(CompileShader),
@@ -275,6 +276,22 @@ static const struct gl_functions gl_functions[] = {
             {0}
         },
     },
+    {
+        .ver_core = 440,
+        .extension = "GL_ARB_buffer_storage",
+        .functions = (const struct gl_function[]) {
+            DEF_FN(BufferStorage),
+            {0}
+        },
+    },
+    {
+        .extension = "GL_EXT_buffer_storage",
+        .ver_exclude = 1, // never in desktop GL
+        .functions = (const struct gl_function[]) {
+            DEF_FN_NAME(BufferStorage, "glBufferStorageEXT"),
+            {0}
+        },
+    },
     {
         .ver_core = 330,
         .extension = "GL_ARB_timer_query",
@@ -316,6 +333,50 @@ static const struct gl_functions gl_functions[] = {
             {0}
         },
     },
+    // Per-instance vertex attributes. (The ARB extensions are not used, as
+    // gl_VertexID is needed too.)
+    {
+        .ver_core = 330,
+        .ver_es_core = 300,
+        .provides = MPGL_CAP_INSTANCING,
+        .functions = (const struct gl_function[]) {
+            DEF_FN(DrawArraysInstanced),
+            DEF_FN(VertexAttribDivisor),
+            {0}
+        },
+    },
+    // Compute shaders. GLES 3.1 has them too, but requires immutable textures
+    // for image stores, which we don't use.
+    {
+        .ver_core = 430,
+        .provides = MPGL_CAP_COMPUTE_SHADER,
+        .functions = (const struct gl_function[]) {
+            DEF_FN(DispatchCompute),
+            DEF_FN(BindImageTexture),
+            DEF_FN(MemoryBarrier),
+            {0}
+        },
+    },
+    {
+        .ver_core = 310,
+        .ver_es_core = 300,
+        .extension = "GL_ARB_uniform_buffer_object",
+        .functions = (const struct gl_function[]) {
+            DEF_FN(GetUniformBlockIndex),
+            DEF_FN(UniformBlockBinding),
+            {0}
+        },
+    },
+    {
+        .ver_core = 410,
+        .ver_es_core = 300,
+        .extension = "GL_ARB_get_program_binary",
+        .functions = (const struct gl_function[]) {
+            DEF_FN(GetProgramBinary),
+            DEF_FN(ProgramBinary),
+            {0}
+        },
+    },
     // Swap control, always an OS specific extension
     // The OSX code loads this manually.
     {
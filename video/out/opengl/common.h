@@ -66,6 +66,8 @@ enum {
     MPGL_CAP_EXT16              = (1 << 18),    // GL_EXT_texture_norm16
     MPGL_CAP_ARB_FLOAT          = (1 << 19),    // GL_ARB_texture_float
     MPGL_CAP_EXT_CR_HFLOAT      = (1 << 20),    // GL_EXT_color_buffer_half_float
+    MPGL_CAP_COMPUTE_SHADER     = (1 << 21),    // GL_ARB_compute_shader & co.
+    MPGL_CAP_INSTANCING         = (1 << 22),    // instanced arrays (GL 3.3)
 
     MPGL_CAP_SW                 = (1 << 30),    // indirect or sw renderer
 };
@@ -133,6 +135,9 @@ struct GL {
                                           GLbitfield);
     GLboolean (GLAPIENTRY *UnmapBuffer)(GLenum);
     void (GLAPIENTRY *BufferData)(GLenum, intptr_t, const GLvoid *, GLenum);
+    void (GLAPIENTRY *BufferSubData)(GLenum, intptr_t, intptr_t,
+                                     const GLvoid *);
+    void (GLAPIENTRY *BufferStorage)(GLenum, intptr_t, const GLvoid *, GLenum);
     void (GLAPIENTRY *ActiveTexture)(GLenum);
     void (GLAPIENTRY *BindTexture)(GLenum, GLuint);
     int (GLAPIENTRY *SwapInterval)(int);
@@ -188,6 +193,21 @@ struct GL {
 
     void (GLAPIENTRY *InvalidateFramebuffer)(GLenum, GLsizei, const GLenum *);
 
+    GLuint (GLAPIENTRY *GetUniformBlockIndex)(GLuint, const GLchar *);
+    void (GLAPIENTRY *UniformBlockBinding)(GLuint, GLuint, GLuint);
+
+    void (GLAPIENTRY *GetProgramBinary)(GLuint, GLsizei, GLsizei *, GLenum *,
+                                        GLvoid *);
+    void (GLAPIENTRY *ProgramBinary)(GLuint, GLenum, const GLvoid *, GLint);
+
+    void (GLAPIENTRY *DrawArraysInstanced)(GLenum, GLint, GLsizei, GLsizei);
+    void (GLAPIENTRY *VertexAttribDivisor)(GLuint, GLuint);
+
+    void (GLAPIENTRY *DispatchCompute)(GLuint, GLuint, GLuint);
+    void (GLAPIENTRY *BindImageTexture)(GLuint, GLuint, GLint, GLboolean,
+                                        GLint, GLenum, GLenum);
+    void (GLAPIENTRY *MemoryBarrier)(GLbitfield);
+
     GLsync (GLAPIENTRY *FenceSync)(GLenum, GLbitfield);
     GLenum (GLAPIENTRY *ClientWaitSync)(GLsync, GLbitfield, GLuint64);
     void (GLAPIENTRY *DeleteSync)(GLsync sync);
@@ -240,6 +240,12 @@ void mpgl_swap_buffers(struct MPGLContext *ctx)
     ctx->driver->swap_buffers(ctx);
 }
 
+void mpgl_get_vsync(struct MPGLContext *ctx, struct vo_vsync_info *info)
+{
+    if (ctx->driver->get_vsync)
+        ctx->driver->get_vsync(ctx, info);
+}
+
 void mpgl_uninit(MPGLContext *ctx)
 {
     set_current_context(NULL);
@@ -26,6 +26,8 @@
 
 #include "common.h"
 
+struct vo_vsync_info;
+
 enum {
     VOFLAG_GLES         = 1 << 0,       // Hint to create a GLES2 context
     VOFLAG_NO_GLES      = 1 << 1,       // Hint to create a desktop GL context
@@ -61,6 +63,9 @@ struct mpgl_driver {
     // Present the frame.
     void (*swap_buffers)(struct MPGLContext *ctx);
 
+    // Optional. Behaves like vo_driver.get_vsync().
+    void (*get_vsync)(struct MPGLContext *ctx, struct vo_vsync_info *info);
+
     // This behaves exactly like vo_driver.control().
     int (*control)(struct MPGLContext *ctx, int *events, int request, void *arg);
 
@@ -95,6 +100,7 @@ void mpgl_uninit(MPGLContext *ctx);
 int mpgl_reconfig_window(struct MPGLContext *ctx);
 int mpgl_control(struct MPGLContext *ctx, int *events, int request, void *arg);
 void mpgl_swap_buffers(struct MPGLContext *ctx);
+void mpgl_get_vsync(struct MPGLContext *ctx, struct vo_vsync_info *info);
 
 int mpgl_find_backend(const char *name);
 
@@ -20,6 +20,7 @@
 #include <EGL/eglext.h>
 #include <d3d11.h>
 #include <dxgi1_2.h>
+#include <dxgi1_3.h>
 #include <dwmapi.h>
 
 #include "angle_dynamic.h"
@@ -28,6 +29,7 @@
 #include "common/common.h"
 #include "options/m_config.h"
 #include "video/out/w32_common.h"
+#include "osdep/timer.h"
 #include "osdep/windows_utils.h"
 #include "context.h"
 
@@ -56,6 +58,7 @@ struct angle_opts {
     int egl_windowing;
     int swapchain_length; // Currently only works with DXGI 1.2+
     int max_frame_latency;
+    int waitable_swapchain;
 };
 
 #define OPT_BASE_STRUCT struct angle_opts
@@ -80,6 +83,7 @@ const struct m_sub_options angle_conf = {
                     {"yes", 1})),
         OPT_INTRANGE("angle-swapchain-length", swapchain_length, 0, 2, 16),
         OPT_INTRANGE("angle-max-frame-latency", max_frame_latency, 0, 1, 16),
+        OPT_FLAG("angle-waitable-swapchain", waitable_swapchain, 0),
         {0}
     },
     .defaults = &(const struct angle_opts) {
@@ -100,6 +104,10 @@ struct priv {
     IDXGIDevice1 *dxgi_device;
     IDXGISwapChain *dxgi_swapchain;
     IDXGISwapChain1 *dxgi_swapchain1;
+    IDXGISwapChain2 *dxgi_swapchain2;
+    UINT sc_flags; // DXGI_SWAP_CHAIN_FLAG_* the swap chain was created with
+    // Signaled when the swap chain can take another frame. NULL if unused.
+    HANDLE frame_latency_waitable;
 
     ID3D11Device *d3d11_device;
     ID3D11DeviceContext *d3d11_context;
@@ -196,7 +204,7 @@ static void d3d11_backbuffer_resize(MPGLContext *ctx)
     // The DirectX runtime may report errors related to the device like
     // DXGI_ERROR_DEVICE_REMOVED at this point
     hr = IDXGISwapChain_ResizeBuffers(p->dxgi_swapchain, 0, p->sc_width,
-        p->sc_height, DXGI_FORMAT_UNKNOWN, 0);
+        p->sc_height, DXGI_FORMAT_UNKNOWN, p->sc_flags);
     if (FAILED(hr))
         MP_FATAL(vo, "Couldn't resize swapchain: %s\n", mp_HRESULT_to_str(hr));
 
@@ -364,6 +372,10 @@ static bool d3d11_device_create(MPGLContext *ctx, int flags)
 static void d3d11_swapchain_surface_destroy(MPGLContext *ctx)
 {
     struct priv *p = ctx->priv;
+    if (p->frame_latency_waitable)
+        CloseHandle(p->frame_latency_waitable);
+    p->frame_latency_waitable = NULL;
+    SAFE_RELEASE(p->dxgi_swapchain2);
     SAFE_RELEASE(p->dxgi_swapchain);
     SAFE_RELEASE(p->dxgi_swapchain1);
     d3d11_backbuffer_release(ctx);
@@ -387,9 +399,24 @@ static bool d3d11_swapchain_create_1_2(MPGLContext *ctx, int flags)
         .SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL,
     };
 
-    hr = IDXGIFactory2_CreateSwapChainForHwnd(p->dxgi_factory2,
-        (IUnknown*)p->d3d11_device, vo_w32_hwnd(vo), &desc1, NULL, NULL,
-        &p->dxgi_swapchain1);
+    if (p->opts->waitable_swapchain) {
+        // Needs DXGI 1.3 (Windows 8.1+), so fall back if it fails
+        desc1.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+        hr = IDXGIFactory2_CreateSwapChainForHwnd(p->dxgi_factory2,
+            (IUnknown*)p->d3d11_device, vo_w32_hwnd(vo), &desc1, NULL, NULL,
+            &p->dxgi_swapchain1);
+        if (FAILED(hr)) {
+            MP_WARN(vo, "Couldn't create waitable swap chain: %s\n",
+                    mp_HRESULT_to_str(hr));
+            desc1.Flags = 0;
+        }
+    }
+
+    if (!p->dxgi_swapchain1) {
+        hr = IDXGIFactory2_CreateSwapChainForHwnd(p->dxgi_factory2,
+            (IUnknown*)p->d3d11_device, vo_w32_hwnd(vo), &desc1, NULL, NULL,
+            &p->dxgi_swapchain1);
+    }
     if (FAILED(hr)) {
         MP_FATAL(vo, "Couldn't create DXGI 1.2+ swap chain: %s\n",
                  mp_HRESULT_to_str(hr));
@@ -402,6 +429,23 @@ static bool d3d11_swapchain_create_1_2(MPGLContext *ctx, int flags)
         MP_FATAL(vo, "Couldn't create DXGI 1.2+ swap chain\n");
         return false;
     }
+    p->sc_flags = desc1.Flags;
+
+    if (desc1.Flags & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) {
+        hr = IDXGISwapChain1_QueryInterface(p->dxgi_swapchain1,
+            &IID_IDXGISwapChain2, (void**)&p->dxgi_swapchain2);
+        if (FAILED(hr)) {
+            MP_FATAL(vo, "Couldn't get DXGI 1.3 swap chain\n");
+            return false;
+        }
+        // With a waitable swap chain, the frame latency is set here instead
+        // of IDXGIDevice1_SetMaximumFrameLatency()
+        IDXGISwapChain2_SetMaximumFrameLatency(p->dxgi_swapchain2,
+                                               p->opts->max_frame_latency);
+        p->frame_latency_waitable =
+            IDXGISwapChain2_GetFrameLatencyWaitableObject(p->dxgi_swapchain2);
+        MP_VERBOSE(vo, "Using a waitable swap chain.\n");
+    }
 
     return true;
 }
@@ -825,6 +869,39 @@ static void d3d11_swap_buffers(MPGLContext *ctx)
     for (int i = 0; i < 8; i++)
         SAFE_RELEASE(rtvs[i]);
     SAFE_RELEASE(dsv);
+
+    // Block until the swap chain can take the next frame, so that it is
+    // rendered as late as possible (instead of blocking in Present() with a
+    // full queue).
+    if (p->frame_latency_waitable)
+        WaitForSingleObjectEx(p->frame_latency_waitable, 1000, TRUE);
+}
+
+static void angle_get_vsync(MPGLContext *ctx, struct vo_vsync_info *info)
+{
+    struct priv *p = ctx->priv;
+    HRESULT hr;
+
+    if (!p->dxgi_swapchain)
+        return;
+
+    // Works with flip model swap chains (also in windowed mode)
+    DXGI_FRAME_STATISTICS stats;
+    hr = IDXGISwapChain_GetFrameStatistics(p->dxgi_swapchain, &stats);
+    if (FAILED(hr) || !stats.SyncQPCTime.QuadPart)
+        return;
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    int64_t qpc = stats.SyncQPCTime.QuadPart;
+    int64_t us = qpc / freq.QuadPart * 1000000 +
+                 qpc % freq.QuadPart * 1000000 / freq.QuadPart;
+
+    // mp_raw_time_us() uses the QPC as well
+    *info = (struct vo_vsync_info){
+        .last_vsync_time = mp_time_from_raw_us(us),
+        .vsync_count = stats.SyncRefreshCount,
+    };
 }
 
 static void egl_swap_buffers(MPGLContext *ctx)
@@ -848,6 +925,7 @@ const struct mpgl_driver mpgl_driver_angle = {
     .init           = angle_init,
     .reconfig       = angle_reconfig,
     .swap_buffers   = angle_swap_buffers,
+    .get_vsync      = angle_get_vsync,
     .control        = angle_control,
     .uninit         = angle_uninit,
 };
@@ -19,7 +19,9 @@
 #include <versionhelpers.h>
 #include <d3d9.h>
 #include <dwmapi.h>
+#include "osdep/timer.h"
 #include "osdep/windows_utils.h"
+#include "video/out/vo.h"
 #include "video/out/w32_common.h"
 #include "context.h"
 
@@ -33,6 +35,9 @@ EXTERN_C IMAGE_DOS_HEADER __ImageBase;
 #ifndef IDirect3DSwapChain9Ex_GetBackBuffer
 #define IDirect3DSwapChain9Ex_GetBackBuffer IDirect3DSwapChain9EX_GetBackBuffer
 #endif
+#ifndef IDirect3DSwapChain9Ex_GetPresentStats
+#define IDirect3DSwapChain9Ex_GetPresentStats IDirect3DSwapChain9EX_GetPresentStats
+#endif
 
 struct priv {
     HMODULE d3d9_dll;
@@ -585,6 +590,33 @@ static void dxinterop_swap_buffers(MPGLContext *ctx)
     }
 }
 
+static void dxinterop_get_vsync(MPGLContext *ctx, struct vo_vsync_info *info)
+{
+    struct priv *p = ctx->priv;
+    HRESULT hr;
+
+    if (p->lost_device || !p->swapchain)
+        return;
+
+    // Works with the FLIPEX swap effect (also in windowed mode)
+    D3DPRESENTSTATS stats;
+    hr = IDirect3DSwapChain9Ex_GetPresentStats(p->swapchain, &stats);
+    if (FAILED(hr) || !stats.SyncQPCTime.QuadPart)
+        return;
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    int64_t qpc = stats.SyncQPCTime.QuadPart;
+    int64_t us = qpc / freq.QuadPart * 1000000 +
+                 qpc % freq.QuadPart * 1000000 / freq.QuadPart;
+
+    // mp_raw_time_us() uses the QPC as well
+    *info = (struct vo_vsync_info){
+        .last_vsync_time = mp_time_from_raw_us(us),
+        .vsync_count = stats.SyncRefreshCount,
+    };
+}
+
 static int dxinterop_control(MPGLContext *ctx, int *events, int request,
                              void *arg)
 {
@@ -600,6 +632,7 @@ const struct mpgl_driver mpgl_driver_dxinterop = {
     .init         = dxinterop_init,
     .reconfig     = dxinterop_reconfig,
     .swap_buffers = dxinterop_swap_buffers,
+    .get_vsync    = dxinterop_get_vsync,
     .control      = dxinterop_control,
     .uninit       = dxinterop_uninit,
 };
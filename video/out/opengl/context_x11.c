@@ -21,6 +21,8 @@
 #define MP_GET_GLX_WORKAROUNDS
 #include "header_fixes.h"
 
+#include "osdep/timer.h"
+#include "video/out/vo.h"
 #include "video/out/x11_common.h"
 #include "context.h"
 
@@ -28,6 +30,10 @@ struct glx_context {
     XVisualInfo *vinfo;
     GLXContext context;
     GLXFBConfig fbc;
+
+    // GLX_OML_sync_control
+    Bool (*GetSyncValues)(Display *, GLXDrawable, int64_t *, int64_t *,
+                          int64_t *);
 };
 
 static void glx_uninit(MPGLContext *ctx)
@@ -270,6 +276,13 @@ static int glx_init(struct MPGLContext *ctx, int flags)
     if (!success)
         goto uninit;
 
+    const char *glxstr = glXQueryExtensionsString(vo->x11->display,
+                                                  vo->x11->screen);
+    if (glxstr && strstr(glxstr, "GLX_OML_sync_control")) {
+        glx_ctx->GetSyncValues = (void *)
+            glXGetProcAddressARB((const GLubyte *)"glXGetSyncValuesOML");
+    }
+
     return 0;
 
 uninit:
@@ -307,6 +320,24 @@ static void glx_swap_buffers(struct MPGLContext *ctx)
     glXSwapBuffers(ctx->vo->x11->display, ctx->vo->x11->window);
 }
 
+static void glx_get_vsync(struct MPGLContext *ctx, struct vo_vsync_info *info)
+{
+    struct glx_context *glx_ctx = ctx->priv;
+    int64_t ust, msc, sbc;
+
+    if (!glx_ctx->GetSyncValues ||
+        !glx_ctx->GetSyncValues(ctx->vo->x11->display, ctx->vo->x11->window,
+                                &ust, &msc, &sbc))
+        return;
+
+    // UST uses CLOCK_MONOTONIC in microseconds with Mesa, which is also what
+    // mp_raw_time_us() uses. (The VO rejects timestamps that are way off.)
+    *info = (struct vo_vsync_info){
+        .last_vsync_time = mp_time_from_raw_us(ust),
+        .vsync_count = msc,
+    };
+}
+
 static void glx_wakeup(struct MPGLContext *ctx)
 {
     vo_x11_wakeup(ctx->vo);
@@ -323,6 +354,7 @@ const struct mpgl_driver mpgl_driver_x11 = {
     .init           = glx_init,
     .reconfig       = glx_reconfig,
     .swap_buffers   = glx_swap_buffers,
+    .get_vsync      = glx_get_vsync,
     .control        = glx_control,
     .wakeup         = glx_wakeup,
     .wait_events    = glx_wait_events,
@@ -335,6 +367,7 @@ const struct mpgl_driver mpgl_driver_x11_probe = {
     .init           = glx_init_probe,
     .reconfig       = glx_reconfig,
     .swap_buffers   = glx_swap_buffers,
+    .get_vsync      = glx_get_vsync,
     .control        = glx_control,
     .wakeup         = glx_wakeup,
     .wait_events    = glx_wait_events,
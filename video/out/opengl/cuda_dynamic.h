@@ -90,12 +90,17 @@ typedef unsigned int    GLuint;
 
 #define CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD 2
 
+#define CU_STREAM_DEFAULT 0
+
 typedef CUresult CUDAAPI tcuInit(unsigned int Flags);
 typedef CUresult CUDAAPI tcuCtxCreate_v2(CUcontext *pctx, unsigned int flags, CUdevice dev);
 typedef CUresult CUDAAPI tcuCtxPushCurrent_v2(CUcontext *pctx);
 typedef CUresult CUDAAPI tcuCtxPopCurrent_v2(CUcontext *pctx);
 typedef CUresult CUDAAPI tcuCtxDestroy_v2(CUcontext ctx);
 typedef CUresult CUDAAPI tcuMemcpy2D_v2(const CUDA_MEMCPY2D *pcopy);
+typedef CUresult CUDAAPI tcuMemcpy2DAsync_v2(const CUDA_MEMCPY2D *pcopy, CUstream hStream);
+typedef CUresult CUDAAPI tcuStreamCreate(CUstream *phStream, unsigned int Flags);
+typedef CUresult CUDAAPI tcuStreamDestroy_v2(CUstream hStream);
 typedef CUresult CUDAAPI tcuGetErrorName(CUresult error, const char** pstr);
 typedef CUresult CUDAAPI tcuGetErrorString(CUresult error, const char** pstr);
 typedef CUresult CUDAAPI tcuGLGetDevices_v2(unsigned int* pCudaDeviceCount, CUdevice* pCudaDevices, unsigned int cudaDeviceCount, CUGLDeviceList deviceList);
@@ -112,6 +117,9 @@ typedef CUresult CUDAAPI tcuGraphicsSubResourceGetMappedArray(CUarray* pArray, C
     FN(cuCtxPopCurrent_v2, tcuCtxPopCurrent_v2) \
     FN(cuCtxDestroy_v2, tcuCtxDestroy_v2) \
     FN(cuMemcpy2D_v2, tcuMemcpy2D_v2) \
+    FN(cuMemcpy2DAsync_v2, tcuMemcpy2DAsync_v2) \
+    FN(cuStreamCreate, tcuStreamCreate) \
+    FN(cuStreamDestroy_v2, tcuStreamDestroy_v2) \
     FN(cuGetErrorName, tcuGetErrorName) \
     FN(cuGetErrorString, tcuGetErrorString) \
     FN(cuGLGetDevices_v2, tcuGLGetDevices_v2) \
@@ -132,6 +140,9 @@ CUDA_FNS(CUDA_EXT_DECL)
 #define cuCtxPopCurrent mpv_cuCtxPopCurrent_v2
 #define cuCtxDestroy mpv_cuCtxDestroy_v2
 #define cuMemcpy2D mpv_cuMemcpy2D_v2
+#define cuMemcpy2DAsync mpv_cuMemcpy2DAsync_v2
+#define cuStreamCreate mpv_cuStreamCreate
+#define cuStreamDestroy mpv_cuStreamDestroy_v2
 #define cuGetErrorName mpv_cuGetErrorName
 #define cuGetErrorString mpv_cuGetErrorString
 #define cuGLGetDevices mpv_cuGLGetDevices_v2
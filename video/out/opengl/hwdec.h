@@ -29,6 +29,8 @@ struct gl_hwdec_plane {
 
 struct gl_hwdec_frame {
     struct gl_hwdec_plane planes[4];
+    // If set, planes[] contains the top and bottom field textures of each
+    // plane (in this order), i.e. planes[n * 2] and planes[n * 2 + 1].
     bool vdpau_fields;
 };
 
@@ -36,16 +36,25 @@
 #include "hwdec.h"
 #include "video.h"
 
+// Number of texture sets used in turn, so that copying a new frame doesn't
+// have to wait until GL is done rendering the previous one.
+#define NUM_BUFFERS 2
+
 struct priv {
     struct mp_hwdec_ctx hwctx;
     struct mp_image layout;
-    GLuint gl_textures[4];
-    CUgraphicsResource cu_res[4];
-    CUarray cu_array[4];
+    GLuint gl_textures[NUM_BUFFERS][4];
+    CUgraphicsResource cu_res[NUM_BUFFERS][4];
+    int num_planes;
     int sample_count[4];
     int sample_width;
+    int next_buffer;
 
     CUcontext cuda_ctx;
+    // All copies are queued on this stream. The CPU never waits for them:
+    // unmapping the resources on the stream makes GL work issued afterwards
+    // (i.e. rendering with the textures) wait for the copies to finish.
+    CUstream stream;
 };
 
 static int check_cu(struct gl_hwdec *hw, CUresult err, const char *func)
@@ -109,6 +118,12 @@ static int cuda_create(struct gl_hwdec *hw)
 
     p->cuda_ctx = cuda_ctx;
 
+    // A blocking (not CU_STREAM_NON_BLOCKING) stream synchronizes with the
+    // legacy default stream, which the decoder uses to write the frames.
+    ret = CHECK_CU(cuStreamCreate(&p->stream, CU_STREAM_DEFAULT));
+    if (ret < 0)
+        goto error;
+
     hw_device_ctx = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_CUDA);
     if (!hw_device_ctx)
         goto error;
@@ -139,15 +154,68 @@ static int cuda_create(struct gl_hwdec *hw)
 
  error:
     av_buffer_unref(&hw_device_ctx);
+    if (p->stream)
+        CHECK_CU(cuStreamDestroy(p->stream));
     CHECK_CU(cuCtxPopCurrent(&dummy));
 
     return -1;
 }
 
-static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
+// Must be called with the CUDA context pushed.
+static void destroy_textures(struct gl_hwdec *hw)
 {
     struct priv *p = hw->priv;
     GL *gl = hw->gl;
+
+    for (int b = 0; b < NUM_BUFFERS; b++) {
+        for (int n = 0; n < 4; n++) {
+            if (p->cu_res[b][n])
+                CHECK_CU(cuGraphicsUnregisterResource(p->cu_res[b][n]));
+            p->cu_res[b][n] = 0;
+        }
+        gl->DeleteTextures(4, p->gl_textures[b]);
+        for (int n = 0; n < 4; n++)
+            p->gl_textures[b][n] = 0;
+    }
+    p->num_planes = 0;
+}
+
+// Must be called with the CUDA context pushed.
+static int create_textures(struct gl_hwdec *hw, int b)
+{
+    struct priv *p = hw->priv;
+    GL *gl = hw->gl;
+
+    gl->GenTextures(4, p->gl_textures[b]);
+    for (int n = 0; n < p->num_planes; n++) {
+        const struct gl_format *fmt =
+            gl_find_unorm_format(gl, p->sample_width, p->sample_count[n]);
+
+        gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[b][n]);
+        GLenum filter = GL_NEAREST;
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format,
+                       mp_image_plane_w(&p->layout, n),
+                       mp_image_plane_h(&p->layout, n),
+                       0, fmt->format, fmt->type, NULL);
+        gl->BindTexture(GL_TEXTURE_2D, 0);
+
+        int ret = CHECK_CU(cuGraphicsGLRegisterImage(&p->cu_res[b][n],
+                                                     p->gl_textures[b][n],
+                                                     GL_TEXTURE_2D,
+                                                     CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD));
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
+{
+    struct priv *p = hw->priv;
     CUcontext dummy;
     int ret = 0, eret = 0;
 
@@ -186,47 +254,19 @@ static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
     if (ret < 0)
         return ret;
 
-    gl->GenTextures(4, p->gl_textures);
-    for (int n = 0; n < 4; n++) {
-        if (!p->sample_count[n])
-            break;
-
-        const struct gl_format *fmt =
-            gl_find_unorm_format(gl, p->sample_width, p->sample_count[n]);
+    destroy_textures(hw);
 
-        gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[n]);
-        GLenum filter = GL_NEAREST;
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format,
-                       mp_image_plane_w(&p->layout, n),
-                       mp_image_plane_h(&p->layout, n),
-                       0, fmt->format, fmt->type, NULL);
-        gl->BindTexture(GL_TEXTURE_2D, 0);
-
-        ret = CHECK_CU(cuGraphicsGLRegisterImage(&p->cu_res[n], p->gl_textures[n],
-                                                 GL_TEXTURE_2D,
-                                                 CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD));
-        if (ret < 0)
-            goto error;
-
-        ret = CHECK_CU(cuGraphicsMapResources(1, &p->cu_res[n], 0));
-        if (ret < 0)
-            goto error;
-
-        ret = CHECK_CU(cuGraphicsSubResourceGetMappedArray(&p->cu_array[n], p->cu_res[n],
-                                                           0, 0));
-        if (ret < 0)
-            goto error;
+    for (int n = 0; n < 4; n++) {
+        if (p->sample_count[n])
+            p->num_planes = n + 1;
+    }
 
-        ret = CHECK_CU(cuGraphicsUnmapResources(1, &p->cu_res[n], 0));
+    for (int b = 0; b < NUM_BUFFERS; b++) {
+        ret = create_textures(hw, b);
         if (ret < 0)
-            goto error;
+            break;
     }
 
- error:
     eret = CHECK_CU(cuCtxPopCurrent(&dummy));
     if (eret < 0)
         return eret;
@@ -237,22 +277,18 @@ static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
 static void destroy(struct gl_hwdec *hw)
 {
     struct priv *p = hw->priv;
-    GL *gl = hw->gl;
     CUcontext dummy;
 
     // Don't bail if any CUDA calls fail. This is all best effort.
     CHECK_CU(cuCtxPushCurrent(p->cuda_ctx));
-    for (int n = 0; n < 4; n++) {
-        if (p->cu_res[n] > 0)
-            CHECK_CU(cuGraphicsUnregisterResource(p->cu_res[n]));
-        p->cu_res[n] = 0;
-    }
+    destroy_textures(hw);
+    if (p->stream)
+        CHECK_CU(cuStreamDestroy(p->stream));
+    p->stream = 0;
     CHECK_CU(cuCtxPopCurrent(&dummy));
 
     CHECK_CU(cuCtxDestroy(p->cuda_ctx));
 
-    gl->DeleteTextures(4, p->gl_textures);
-
     hwdec_devices_remove(hw->devs, &p->hwctx);
     av_buffer_unref(&p->hwctx.av_device_ref);
 }
@@ -270,8 +306,21 @@ static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
 
     *out_frame = (struct gl_hwdec_frame) { 0, };
 
-    for (int n = 0; n < 4; n++) {
-        if (!p->sample_count[n])
+    int b = p->next_buffer;
+    p->next_buffer = (p->next_buffer + 1) % NUM_BUFFERS;
+
+    // Waits (on the stream) for GL work still using the textures.
+    ret = CHECK_CU(cuGraphicsMapResources(p->num_planes, p->cu_res[b],
+                                          p->stream));
+    if (ret < 0)
+        goto error;
+
+    for (int n = 0; n < p->num_planes; n++) {
+        CUarray array;
+        ret = CHECK_CU(cuGraphicsSubResourceGetMappedArray(&array,
+                                                           p->cu_res[b][n],
+                                                           0, 0));
+        if (ret < 0)
             break;
 
         // widthInBytes must account for the chroma plane
@@ -282,23 +331,27 @@ static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
             .srcDevice     = (CUdeviceptr)hw_image->planes[n],
             .srcPitch      = hw_image->stride[n],
             .srcY          = 0,
-            .dstArray      = p->cu_array[n],
+            .dstArray      = array,
             .WidthInBytes  = mp_image_plane_w(&p->layout, n) *
                              p->sample_count[n] * p->sample_width,
             .Height        = mp_image_plane_h(&p->layout, n),
         };
-        ret = CHECK_CU(cuMemcpy2D(&cpy));
+        ret = CHECK_CU(cuMemcpy2DAsync(&cpy, p->stream));
         if (ret < 0)
-            goto error;
+            break;
 
         out_frame->planes[n] = (struct gl_hwdec_plane){
-            .gl_texture = p->gl_textures[n],
+            .gl_texture = p->gl_textures[b][n],
             .gl_target = GL_TEXTURE_2D,
             .tex_w = mp_image_plane_w(&p->layout, n),
             .tex_h = mp_image_plane_h(&p->layout, n),
         };
     }
 
+    eret = CHECK_CU(cuGraphicsUnmapResources(p->num_planes, p->cu_res[b],
+                                             p->stream));
+    if (eret < 0)
+        ret = eret;
 
  error:
    eret = CHECK_CU(cuCtxPopCurrent(&dummy));
@@ -39,8 +39,14 @@ struct priv {
     struct mp_hwdec_ctx hwctx;
 
     ID3D11Device *d3d11_device;
+    ID3D11DeviceContext *device_ctx;
     EGLDisplay egl_display;
 
+    // Used only if the decoder's texture array slice can't be posted to the
+    // EGLStream directly: each frame is copied to this texture first.
+    ID3D11Texture2D *copy_tex;
+    bool need_copy;
+
     EGLStreamKHR egl_stream;
     GLuint gl_textures[3];
 
@@ -77,6 +83,11 @@ static void destroy_objects(struct gl_hwdec *hw)
         p->DestroyStreamKHR(p->egl_display, p->egl_stream);
     p->egl_stream = 0;
 
+    if (p->copy_tex)
+        ID3D11Texture2D_Release(p->copy_tex);
+    p->copy_tex = NULL;
+    p->need_copy = false;
+
     for (int n = 0; n < 3; n++) {
         gl->DeleteTextures(1, &p->gl_textures[n]);
         p->gl_textures[n] = 0;
@@ -91,6 +102,10 @@ static void destroy(struct gl_hwdec *hw)
 
     hwdec_devices_remove(hw->devs, &p->hwctx);
 
+    if (p->device_ctx)
+        ID3D11DeviceContext_Release(p->device_ctx);
+    p->device_ctx = NULL;
+
     if (p->d3d11_device)
         ID3D11Device_Release(p->d3d11_device);
     p->d3d11_device = NULL;
@@ -173,6 +188,7 @@ static int create(struct gl_hwdec *hw)
     if (!p->d3d11_device)
         goto fail;
     ID3D11Device_AddRef(p->d3d11_device);
+    ID3D11Device_GetImmediateContext(p->d3d11_device, &p->device_ctx);
 
     if (!d3d11_check_decoding(p->d3d11_device)) {
         MP_VERBOSE(hw, "D3D11 video decoding not supported on this system.\n");
@@ -271,6 +287,61 @@ fail:
     return -1;
 }
 
+static bool post_texture(struct priv *p, ID3D11Texture2D *tex, int subindex)
+{
+    EGLAttrib attrs[] = {
+        EGL_D3D_TEXTURE_SUBRESOURCE_ID_ANGLE, subindex,
+        EGL_NONE,
+    };
+    return p->StreamPostD3DTextureNV12ANGLE(p->egl_display, p->egl_stream,
+                                            (void *)tex, attrs);
+}
+
+// Copy the given array slice to the single-slice copy_tex, and post that.
+static bool post_copy(struct gl_hwdec *hw, ID3D11Texture2D *tex, int subindex,
+                      D3D11_TEXTURE2D_DESC *texdesc)
+{
+    struct priv *p = hw->priv;
+
+    if (p->copy_tex) {
+        D3D11_TEXTURE2D_DESC copydesc;
+        ID3D11Texture2D_GetDesc(p->copy_tex, &copydesc);
+        if (copydesc.Width != texdesc->Width ||
+            copydesc.Height != texdesc->Height ||
+            copydesc.Format != texdesc->Format)
+        {
+            ID3D11Texture2D_Release(p->copy_tex);
+            p->copy_tex = NULL;
+        }
+    }
+
+    if (!p->copy_tex) {
+        D3D11_TEXTURE2D_DESC copydesc = {
+            .Width            = texdesc->Width,
+            .Height           = texdesc->Height,
+            .MipLevels        = 1,
+            .ArraySize        = 1,
+            .Format           = texdesc->Format,
+            .SampleDesc.Count = 1,
+            .Usage            = D3D11_USAGE_DEFAULT,
+            .BindFlags        = D3D11_BIND_SHADER_RESOURCE,
+        };
+        HRESULT hr = ID3D11Device_CreateTexture2D(p->d3d11_device, &copydesc,
+                                                  NULL, &p->copy_tex);
+        if (FAILED(hr)) {
+            MP_ERR(hw, "Failed to create texture: %s\n", mp_HRESULT_to_str(hr));
+            p->copy_tex = NULL;
+            return false;
+        }
+    }
+
+    ID3D11DeviceContext_CopySubresourceRegion(p->device_ctx,
+        (ID3D11Resource *)p->copy_tex, 0, 0, 0, 0,
+        (ID3D11Resource *)tex, subindex, NULL);
+
+    return post_texture(p, p->copy_tex, 0);
+}
+
 static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
                      struct gl_hwdec_frame *out_frame)
 {
@@ -284,20 +355,27 @@ static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
     if (!d3d_tex)
         return -1;
 
-    EGLAttrib attrs[] = {
-        EGL_D3D_TEXTURE_SUBRESOURCE_ID_ANGLE, d3d_subindex,
-        EGL_NONE,
-    };
-    if (!p->StreamPostD3DTextureNV12ANGLE(p->egl_display, p->egl_stream,
-                                          (void *)d3d_tex, attrs))
+    D3D11_TEXTURE2D_DESC texdesc;
+    ID3D11Texture2D_GetDesc(d3d_tex, &texdesc);
+
+    // ANGLE can sample the decoder's texture array slice directly, but only
+    // if the texture is bindable as shader resource, and only if its version
+    // supports the subresource attribute at all.
+    bool posted = false;
+    if (!p->need_copy) {
+        if (texdesc.BindFlags & D3D11_BIND_SHADER_RESOURCE)
+            posted = post_texture(p, d3d_tex, d3d_subindex);
+        if (!posted) {
+            MP_VERBOSE(hw, "Can't bind texture array slice, copying frames.\n");
+            p->need_copy = true;
+        }
+    }
+    if (!posted && !post_copy(hw, d3d_tex, d3d_subindex, &texdesc))
         return -1;
 
     if (!p->StreamConsumerAcquireKHR(p->egl_display, p->egl_stream))
         return -1;
 
-    D3D11_TEXTURE2D_DESC texdesc;
-    ID3D11Texture2D_GetDesc(d3d_tex, &texdesc);
-
     *out_frame = (struct gl_hwdec_frame){
         .planes = {
             {
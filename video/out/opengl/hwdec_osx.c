@@ -43,12 +43,30 @@ struct vt_format {
     struct vt_gl_plane_format gl[MP_MAX_PLANES];
 };
 
+// VideoToolbox recycles the surfaces of its pool, so usually only a few dozen
+// distinct surfaces are ever seen during playback.
+#define MAX_CACHED_SURFACES 32
+
+// Textures bound to an IOSurface with CGLTexImageIOSurface2D. The binding
+// refers to the surface memory, so it stays valid as long as the surface is
+// alive (which is guaranteed by retaining it).
+struct cached_surface {
+    IOSurfaceRef surface;
+    IOSurfaceID id;
+    uint32_t cvpixfmt;
+    GLuint gl_planes[MP_MAX_PLANES];
+    uint64_t last_used;
+};
+
 struct priv {
     struct mp_hwdec_ctx hwctx;
     struct mp_vt_ctx vtctx;
 
     CVPixelBufferRef pbuf;
-    GLuint gl_planes[MP_MAX_PLANES];
+
+    struct cached_surface cache[MAX_CACHED_SURFACES];
+    int num_cache;
+    uint64_t frame_count;
 };
 
 static struct vt_format vt_formats[] = {
@@ -176,8 +194,6 @@ static int create(struct gl_hwdec *hw)
     struct priv *p = talloc_zero(hw, struct priv);
     hw->priv = p;
 
-    hw->gl->GenTextures(MP_MAX_PLANES, p->gl_planes);
-
     p->vtctx = (struct mp_vt_ctx){
         .priv = hw,
         .get_vt_fmt = get_vt_fmt,
@@ -192,6 +208,83 @@ static int create(struct gl_hwdec *hw)
     return 0;
 }
 
+static void uncache_surface(struct gl_hwdec *hw, int index)
+{
+    struct priv *p = hw->priv;
+    struct cached_surface *c = &p->cache[index];
+
+    hw->gl->DeleteTextures(MP_MAX_PLANES, c->gl_planes);
+    CFRelease(c->surface);
+    MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, index);
+}
+
+static void clear_cache(struct gl_hwdec *hw)
+{
+    struct priv *p = hw->priv;
+
+    while (p->num_cache)
+        uncache_surface(hw, p->num_cache - 1);
+}
+
+// Return the textures bound to the surface, binding them on first use.
+static struct cached_surface *get_cached_surface(struct gl_hwdec *hw,
+                                                  IOSurfaceRef surface,
+                                                  struct vt_format *f)
+{
+    struct priv *p = hw->priv;
+    GL *gl = hw->gl;
+
+    IOSurfaceID id = IOSurfaceGetID(surface);
+    for (int n = 0; n < p->num_cache; n++) {
+        struct cached_surface *c = &p->cache[n];
+        if (c->id == id && c->surface == surface &&
+            c->cvpixfmt == f->cvpixfmt)
+        {
+            c->last_used = p->frame_count;
+            return c;
+        }
+    }
+
+    if (p->num_cache == MAX_CACHED_SURFACES) {
+        int oldest = 0;
+        for (int n = 1; n < p->num_cache; n++) {
+            if (p->cache[n].last_used < p->cache[oldest].last_used)
+                oldest = n;
+        }
+        uncache_surface(hw, oldest);
+    }
+
+    struct cached_surface *c = &p->cache[p->num_cache++];
+    *c = (struct cached_surface){
+        .surface = (IOSurfaceRef)CFRetain(surface),
+        .id = id,
+        .cvpixfmt = f->cvpixfmt,
+        .last_used = p->frame_count,
+    };
+    gl->GenTextures(MP_MAX_PLANES, c->gl_planes);
+
+    GLenum gl_target = GL_TEXTURE_RECTANGLE;
+
+    for (int i = 0; i < f->planes; i++) {
+        gl->BindTexture(gl_target, c->gl_planes[i]);
+
+        CGLError err = CGLTexImageIOSurface2D(
+            CGLGetCurrentContext(), gl_target,
+            f->gl[i].gl_internal_format,
+            IOSurfaceGetWidthOfPlane(surface, i),
+            IOSurfaceGetHeightOfPlane(surface, i),
+            f->gl[i].gl_format, f->gl[i].gl_type, surface, i);
+
+        if (err != kCGLNoError)
+            MP_ERR(hw, "error creating IOSurface texture for plane %d: %s (%x)\n",
+                   i, CGLErrorString(err), gl->GetError());
+
+        gl->BindTexture(gl_target, 0);
+    }
+
+    return c;
+}
+
 static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
 {
     assert(params->imgfmt == hw->driver->imgfmt);
@@ -202,6 +295,8 @@ static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
         return -1;
     }
 
+    clear_cache(hw);
+
     params->imgfmt = f->imgfmt;
     params->hw_subfmt = 0;
     return 0;
@@ -211,7 +306,6 @@ static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
                      struct gl_hwdec_frame *out_frame)
 {
     struct priv *p = hw->priv;
-    GL *gl = hw->gl;
 
     CVPixelBufferRelease(p->pbuf);
     p->pbuf = (CVPixelBufferRef)hw_image->planes[3];
@@ -233,27 +327,13 @@ static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
     const int planes  = CVPixelBufferGetPlaneCount(p->pbuf);
     assert(planar && planes == f->planes || f->planes == 1);
 
-    GLenum gl_target = GL_TEXTURE_RECTANGLE;
+    p->frame_count++;
+    struct cached_surface *c = get_cached_surface(hw, surface, f);
 
     for (int i = 0; i < f->planes; i++) {
-        gl->BindTexture(gl_target, p->gl_planes[i]);
-
-        CGLError err = CGLTexImageIOSurface2D(
-            CGLGetCurrentContext(), gl_target,
-            f->gl[i].gl_internal_format,
-            IOSurfaceGetWidthOfPlane(surface, i),
-            IOSurfaceGetHeightOfPlane(surface, i),
-            f->gl[i].gl_format, f->gl[i].gl_type, surface, i);
-
-        if (err != kCGLNoError)
-            MP_ERR(hw, "error creating IOSurface texture for plane %d: %s (%x)\n",
-                   i, CGLErrorString(err), gl->GetError());
-
-        gl->BindTexture(gl_target, 0);
-
         out_frame->planes[i] = (struct gl_hwdec_plane){
-            .gl_texture = p->gl_planes[i],
-            .gl_target = gl_target,
+            .gl_texture = c->gl_planes[i],
+            .gl_target = GL_TEXTURE_RECTANGLE,
             .tex_w = IOSurfaceGetWidthOfPlane(surface, i),
             .tex_h = IOSurfaceGetHeightOfPlane(surface, i),
         };
@@ -267,10 +347,9 @@ static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
 static void destroy(struct gl_hwdec *hw)
 {
     struct priv *p = hw->priv;
-    GL *gl = hw->gl;
 
     CVPixelBufferRelease(p->pbuf);
-    gl->DeleteTextures(MP_MAX_PLANES, p->gl_planes);
+    clear_cache(hw);
 
     hwdec_devices_remove(hw->devs, &p->hwctx);
 }
@@ -117,7 +117,8 @@ static void disable_renderer(struct gl_hwdec *hw)
 
         mmal_component_disable(p->renderer);
     }
-    mmal_pool_destroy(p->swpool);
+    if (p->swpool)
+        mmal_port_pool_destroy(p->renderer->input[0], p->swpool);
     p->swpool = NULL;
     p->renderer_enabled = false;
 }
@@ -209,6 +210,13 @@ static int enable_renderer(struct gl_hwdec *hw)
     input->format->es->video.par = (MMAL_RATIONAL_T){params->p_w, params->p_h};
     input->format->es->video.color_space = map_csp(params->color.space);
 
+    // Allocate the software frame buffers in memory shared with the
+    // VideoCore, so that they are not copied again when passed to it.
+    if (!opaque &&
+        mmal_port_parameter_set_boolean(input, MMAL_PARAMETER_ZERO_COPY,
+                                        MMAL_TRUE))
+        MP_WARN(hw, "Could not enable zero-copy buffers.\n");
+
     if (mmal_port_format_commit(input))
         return -1;
 
@@ -224,7 +232,8 @@ static int enable_renderer(struct gl_hwdec *hw)
             return -1;
         }
 
-        p->swpool = mmal_pool_create(input->buffer_num, input->buffer_size);
+        p->swpool = mmal_port_pool_create(input, input->buffer_num,
+                                          input->buffer_size);
         if (!p->swpool) {
             MP_FATAL(hw, "Could not allocate buffer pool.\n");
             return -1;
@@ -18,6 +18,7 @@
 #include <stddef.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -50,6 +51,20 @@ typedef void *EGLImageKHR;
 #define EGL_DMA_BUF_PLANE0_PITCH_EXT      0x3274
 #endif
 
+#ifndef EGL_EXT_image_dma_buf_import_modifiers
+#define EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT 0x3443
+#define EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT 0x3444
+#endif
+
+// vaExportSurfaceHandle() (libva 2.1)
+#define HAS_EXPORT_SURFACE VA_CHECK_VERSION(1, 1, 0)
+
+#define DRM_MOD_LINEAR 0
+#define DRM_MOD_INVALID ((1ULL << 56) - 1)
+
+// Should be larger than the surface pools used by decoders.
+#define MAX_CACHED_SURFACES 64
+
 #if HAVE_VAAPI_X11
 #include <va/va_x11.h>
 
@@ -114,6 +129,14 @@ static VADisplay *create_native_va_display(GL *gl, struct mp_log *log)
     return NULL;
 }
 
+// EGLImages of a surface exported with vaExportSurfaceHandle().
+struct cached_surface {
+    VASurfaceID id;
+    uint32_t fourcc;
+    EGLImageKHR images[4];
+    uint64_t last_use;
+};
+
 struct priv {
     struct mp_log *log;
     struct mp_vaapi_ctx *ctx;
@@ -126,6 +149,15 @@ struct priv {
     int *formats;
     bool probing_formats; // temporary during init
 
+    bool use_export;
+    bool has_modifiers;
+    // The cache references the frames context the surfaces are from, so the
+    // surface IDs can't be reused for other surfaces while they're cached.
+    struct AVBufferRef *cache_frames;
+    struct cached_surface *cache;
+    int num_cache;
+    uint64_t cache_counter;
+
     EGLImageKHR (EGLAPIENTRY *CreateImageKHR)(EGLDisplay, EGLContext,
                                               EGLenum, EGLClientBuffer,
                                               const EGLint *);
@@ -158,6 +190,27 @@ static void unmap_frame(struct gl_hwdec *hw)
     }
 }
 
+static void destroy_cached_surface(struct gl_hwdec *hw, struct cached_surface *s)
+{
+    struct priv *p = hw->priv;
+
+    for (int n = 0; n < 4; n++) {
+        if (s->images[n])
+            p->DestroyImageKHR(eglGetCurrentDisplay(), s->images[n]);
+        s->images[n] = 0;
+    }
+}
+
+static void flush_surface_cache(struct gl_hwdec *hw)
+{
+    struct priv *p = hw->priv;
+
+    for (int n = 0; n < p->num_cache; n++)
+        destroy_cached_surface(hw, &p->cache[n]);
+    p->num_cache = 0;
+    av_buffer_unref(&p->cache_frames);
+}
+
 static void destroy_textures(struct gl_hwdec *hw)
 {
     struct priv *p = hw->priv;
@@ -172,6 +225,7 @@ static void destroy(struct gl_hwdec *hw)
 {
     struct priv *p = hw->priv;
     unmap_frame(hw);
+    flush_surface_cache(hw);
     destroy_textures(hw);
     if (p->ctx)
         hwdec_devices_remove(hw->devs, &p->ctx->hwctx);
@@ -211,6 +265,9 @@ static int create(struct gl_hwdec *hw)
         !p->EGLImageTargetTexture2DOES)
         return -1;
 
+    p->use_export = HAS_EXPORT_SURFACE;
+    p->has_modifiers = strstr(exts, "EXT_image_dma_buf_import_modifiers");
+
     p->display = create_native_va_display(gl, hw->log);
     if (!p->display) {
         MP_VERBOSE(hw, "Could not create a VA display.\n");
@@ -262,6 +319,7 @@ static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
     GL *gl = hw->gl;
 
     // Recreate them to get rid of all previous image data (possibly).
+    flush_surface_cache(hw);
     destroy_textures(hw);
 
     gl->GenTextures(4, p->gl_textures);
@@ -296,6 +354,147 @@ static int reinit(struct gl_hwdec *hw, struct mp_image_params *params)
     attribs[num_attribs] = EGL_NONE;                    \
     } while(0)
 
+#if HAS_EXPORT_SURFACE
+static bool export_surface(struct gl_hwdec *hw, struct mp_image *hw_image,
+                           struct cached_surface *s)
+{
+    struct priv *p = hw->priv;
+    bool ok = false;
+
+    VADRMPRIMESurfaceDescriptor desc = {0};
+    VAStatus status = vaExportSurfaceHandle(p->display, s->id,
+                            VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+                            VA_EXPORT_SURFACE_READ_ONLY |
+                            VA_EXPORT_SURFACE_SEPARATE_LAYERS, &desc);
+    if (status != VA_STATUS_SUCCESS) {
+        MP_VERBOSE(p, "vaExportSurfaceHandle() failed: %s\n",
+                   vaErrorStr(status));
+        return false;
+    }
+    s->fourcc = desc.fourcc;
+
+    struct mp_image layout = {0};
+    mp_image_set_params(&layout, &hw_image->params);
+    mp_image_setfmt(&layout, p->current_mpfmt);
+
+    if (desc.num_layers != layout.num_planes)
+        goto done;
+
+    for (int n = 0; n < layout.num_planes; n++) {
+        int attribs[20] = {EGL_NONE};
+        int num_attribs = 0;
+
+        if (desc.layers[n].num_planes != 1)
+            goto done;
+        int obj = desc.layers[n].object_index[0];
+        uint64_t modifier = desc.objects[obj].drm_format_modifier;
+
+        ADD_ATTRIB(EGL_LINUX_DRM_FOURCC_EXT, desc.layers[n].drm_format);
+        ADD_ATTRIB(EGL_WIDTH, mp_image_plane_w(&layout, n));
+        ADD_ATTRIB(EGL_HEIGHT, mp_image_plane_h(&layout, n));
+        ADD_ATTRIB(EGL_DMA_BUF_PLANE0_FD_EXT, desc.objects[obj].fd);
+        ADD_ATTRIB(EGL_DMA_BUF_PLANE0_OFFSET_EXT, desc.layers[n].offset[0]);
+        ADD_ATTRIB(EGL_DMA_BUF_PLANE0_PITCH_EXT, desc.layers[n].pitch[0]);
+        if (modifier != DRM_MOD_INVALID) {
+            if (p->has_modifiers) {
+                ADD_ATTRIB(EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT,
+                           modifier & 0xFFFFFFFF);
+                ADD_ATTRIB(EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, modifier >> 32);
+            } else if (modifier != DRM_MOD_LINEAR) {
+                MP_VERBOSE(p, "Surface layout requires EGL modifier support.\n");
+                goto done;
+            }
+        }
+
+        s->images[n] = p->CreateImageKHR(eglGetCurrentDisplay(),
+            EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+        if (!s->images[n])
+            goto done;
+    }
+    ok = true;
+
+done:
+    // The EGLImages hold their own references to the buffers.
+    for (int n = 0; n < desc.num_objects; n++)
+        close(desc.objects[n].fd);
+    if (!ok)
+        destroy_cached_surface(hw, s);
+    return ok;
+}
+
+// Map the surface with EGLImages created when it was first seen. Returns -1
+// if this is not possible, in which case the slow path should be tried.
+static int map_exported_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
+                              struct gl_hwdec_frame *out_frame)
+{
+    struct priv *p = hw->priv;
+    GL *gl = hw->gl;
+    VAStatus status;
+
+    if (!hw_image->hwctx)
+        return -1;
+
+    if (!p->cache_frames || p->cache_frames->data != hw_image->hwctx->data) {
+        flush_surface_cache(hw);
+        p->cache_frames = av_buffer_ref(hw_image->hwctx);
+        if (!p->cache_frames)
+            return -1;
+    }
+
+    VASurfaceID id = va_surface_id(hw_image);
+    struct cached_surface *s = NULL;
+    for (int n = 0; n < p->num_cache; n++) {
+        if (p->cache[n].id == id)
+            s = &p->cache[n];
+    }
+
+    if (!s) {
+        if (p->num_cache == MAX_CACHED_SURFACES) {
+            int oldest = 0;
+            for (int n = 1; n < p->num_cache; n++) {
+                if (p->cache[n].last_use < p->cache[oldest].last_use)
+                    oldest = n;
+            }
+            destroy_cached_surface(hw, &p->cache[oldest]);
+            MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, oldest);
+        }
+        struct cached_surface new = {.id = id};
+        if (!export_surface(hw, hw_image, &new))
+            return -1;
+        MP_TARRAY_APPEND(p, p->cache, p->num_cache, new);
+        s = &p->cache[p->num_cache - 1];
+    }
+    s->last_use = ++p->cache_counter;
+
+    // vaDeriveImage() implicitly waits for decoding; here it's explicit.
+    status = vaSyncSurface(p->display, id);
+    if (!CHECK_VA_STATUS(p, "vaSyncSurface()"))
+        return -1;
+
+    struct mp_image layout = {0};
+    mp_image_set_params(&layout, &hw_image->params);
+    mp_image_setfmt(&layout, p->current_mpfmt);
+
+    for (int n = 0; n < layout.num_planes; n++) {
+        gl->BindTexture(GL_TEXTURE_2D, p->gl_textures[n]);
+        p->EGLImageTargetTexture2DOES(GL_TEXTURE_2D, s->images[n]);
+
+        out_frame->planes[n] = (struct gl_hwdec_plane){
+            .gl_texture = p->gl_textures[n],
+            .gl_target = GL_TEXTURE_2D,
+            .tex_w = mp_image_plane_w(&layout, n),
+            .tex_h = mp_image_plane_h(&layout, n),
+        };
+    }
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+
+    if (s->fourcc == VA_FOURCC_YV12)
+        MPSWAP(struct gl_hwdec_plane, out_frame->planes[1], out_frame->planes[2]);
+
+    return 0;
+}
+#endif
+
 static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
                      struct gl_hwdec_frame *out_frame)
 {
@@ -306,6 +505,19 @@ static int map_frame(struct gl_hwdec *hw, struct mp_image *hw_image,
 
     unmap_frame(hw);
 
+#if HAS_EXPORT_SURFACE
+    if (p->use_export) {
+        if (map_exported_frame(hw, hw_image, out_frame) >= 0)
+            return 0;
+        // Formats are probed with both paths, so failures there are normal.
+        if (!p->probing_formats) {
+            MP_VERBOSE(p, "Falling back to vaDeriveImage().\n");
+            p->use_export = false;
+            flush_surface_cache(hw);
+        }
+    }
+#endif
+
     status = vaDeriveImage(p->display, va_surface_id(hw_image), va_image);
     if (!CHECK_VA_STATUS(p, "vaDeriveImage()"))
         goto err;
@@ -462,6 +674,7 @@ done:
     MP_TARRAY_APPEND(p, formats, num_formats, 0); // terminate it
     p->formats = formats;
     p->probing_formats = false;
+    flush_surface_cache(hw); // drop references to the test surfaces
 
     MP_VERBOSE(hw, "Supported formats:\n");
     for (int n = 0; formats[n]; n++)
@@ -17,6 +17,7 @@
 
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "mpv_talloc.h"
 
@@ -28,6 +29,7 @@
 #include "common/msg.h"
 #include "options/m_option.h"
 #include "options/path.h"
+#include "misc/thread_pool.h"
 #include "video/csputils.h"
 #include "lcms.h"
 
@@ -38,10 +40,34 @@
 #include <lcms2.h>
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
+#include <libavutil/cpu.h>
+
+// A 3D LUT being generated on the worker thread. All inputs are copied, so
+// the profile and options can change while it's running.
+struct lut_job {
+    struct gl_lcms *owner;
+    struct mp_log *log;
+    struct mpv_global *global;
+    void *icc_data;
+    size_t icc_size;
+    uint64_t profile_id;
+    char *cache_dir;
+    int intent;
+    int contrast;
+    int size[3];
+    enum mp_csp_prim prim;
+    enum mp_csp_trc trc;
+
+    // --- the following fields are protected by gl_lcms.lock
+    bool done;
+    bool cancel;            // nobody waits for the result; worker frees it
+    struct lut3d *lut;      // result (allocated as child), or NULL on error
+};
 
 struct gl_lcms {
     void *icc_data;
     size_t icc_size;
+    uint64_t profile_id;    // incremented on every change of icc_data
     char *current_profile;
     bool using_memory_profile;
     bool changed;
@@ -51,6 +77,12 @@ struct gl_lcms {
     struct mp_log *log;
     struct mpv_global *global;
     struct mp_icc_opts *opts;
+
+    pthread_mutex_t lock;
+    struct mp_thread_pool *pool;    // runs lut_job_run(), created on demand
+    struct lut_job *job;            // pending job, or NULL
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
 };
 
 static bool parse_3dlut_size(const char *arg, int *p1, int *p2, int *p3)
@@ -98,8 +130,8 @@ const struct m_sub_options mp_icc_conf = {
 static void lcms2_error_handler(cmsContext ctx, cmsUInt32Number code,
                                 const char *msg)
 {
-    struct gl_lcms *p = cmsGetContextUserData(ctx);
-    MP_ERR(p, "lcms2: %s\n", msg);
+    struct lut_job *job = cmsGetContextUserData(ctx);
+    MP_ERR(job, "lcms2: %s\n", msg);
 }
 
 static void load_profile(struct gl_lcms *p)
@@ -108,6 +140,7 @@ static void load_profile(struct gl_lcms *p)
     p->icc_data = NULL;
     p->icc_size = 0;
     p->using_memory_profile = false;
+    p->profile_id++;
     talloc_free(p->current_profile);
     p->current_profile = NULL;
 
@@ -129,6 +162,16 @@ static void load_profile(struct gl_lcms *p)
     p->current_profile = talloc_strdup(p, p->opts->profile);
 }
 
+static void gl_lcms_destroy(void *ptr)
+{
+    struct gl_lcms *p = ptr;
+
+    // Waits for the worker, after which nothing else accesses the job.
+    talloc_free(p->pool);
+    talloc_free(p->job);
+    pthread_mutex_destroy(&p->lock);
+}
+
 struct gl_lcms *gl_lcms_init(void *talloc_ctx, struct mp_log *log,
                              struct mpv_global *global,
                              struct mp_icc_opts *opts)
@@ -139,10 +182,22 @@ struct gl_lcms *gl_lcms_init(void *talloc_ctx, struct mp_log *log,
         .log = log,
         .opts = opts,
     };
+    pthread_mutex_init(&p->lock, NULL);
+    talloc_set_destructor(p, gl_lcms_destroy);
     gl_lcms_update_options(p);
     return p;
 }
 
+// cb is called from the worker thread when a 3D LUT has finished generating.
+// The caller should then redraw, which makes gl_lcms_get_lut3d() return it.
+void gl_lcms_set_wakeup_cb(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx)
+{
+    pthread_mutex_lock(&p->lock);
+    p->wakeup_cb = cb;
+    p->wakeup_ctx = ctx;
+    pthread_mutex_unlock(&p->lock);
+}
+
 void gl_lcms_update_options(struct gl_lcms *p)
 {
     if ((p->using_memory_profile && !p->opts->profile_auto) ||
@@ -175,6 +230,7 @@ bool gl_lcms_set_memory_profile(struct gl_lcms *p, bstr profile)
 
     p->changed = true;
     p->using_memory_profile = true;
+    p->profile_id++;
 
     talloc_free(p->icc_data);
 
@@ -199,7 +255,7 @@ bool gl_lcms_has_profile(struct gl_lcms *p)
     return p->icc_size > 0;
 }
 
-static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
+static cmsHPROFILE get_vid_profile(struct lut_job *job, cmsContext cms,
                                    cmsHPROFILE disp_profile,
                                    enum mp_csp_prim prim, enum mp_csp_trc trc)
 {
@@ -261,15 +317,15 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
         cmsDeleteTransform(xyz2src);
 
         // Contrast limiting
-        if (p->opts->contrast > 0) {
+        if (job->contrast > 0) {
             for (int i = 0; i < 3; i++)
-                src_black[i] = MPMAX(src_black[i], 1.0 / p->opts->contrast);
+                src_black[i] = MPMAX(src_black[i], 1.0 / job->contrast);
         }
 
         // Built-in contrast failsafe
         double contrast = 3.0 / (src_black[0] + src_black[1] + src_black[2]);
         if (contrast > 100000) {
-            MP_WARN(p, "ICC profile detected contrast very high (>100000),"
+            MP_WARN(job, "ICC profile detected contrast very high (>100000),"
                     " falling back to contrast 1000 for sanity. Set the"
                     " icc-contrast option to silence this warning.\n");
             src_black[0] = src_black[1] = src_black[2] = 1.0 / 1000;
@@ -305,21 +361,36 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
     return vid_profile;
 }
 
-bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
-                       enum mp_csp_prim prim, enum mp_csp_trc trc)
-{
-    int s_r, s_g, s_b;
-    bool result = false;
-
-    p->changed = false;
-    p->current_prim = prim;
-    p->current_trc = trc;
+struct lut_slice {
+    cmsHTRANSFORM trafo;
+    uint16_t *output;
+    int size[3];
+    int b;
+};
 
-    if (!parse_3dlut_size(p->opts->size_str, &s_r, &s_g, &s_b))
-        return false;
+// Transform one (s_r)x(s_g) plane of the cube.
+static void lut_slice_run(void *ctx)
+{
+    struct lut_slice *slice = ctx;
+    int s_r = slice->size[0], s_g = slice->size[1], s_b = slice->size[2];
+    int b = slice->b;
+
+    uint16_t input[512 * 3];
+    for (int g = 0; g < s_g; g++) {
+        for (int r = 0; r < s_r; r++) {
+            input[r * 3 + 0] = r * 65535 / (s_r - 1);
+            input[r * 3 + 1] = g * 65535 / (s_g - 1);
+            input[r * 3 + 2] = b * 65535 / (s_b - 1);
+        }
+        size_t base = (b * s_r * s_g + g * s_r) * 3;
+        cmsDoTransform(slice->trafo, input, slice->output + base, s_r);
+    }
+}
 
-    if (!gl_lcms_has_profile(p))
-        return false;
+// Runs on the worker thread. Returns NULL on error.
+static struct lut3d *create_lut3d(struct lut_job *job)
+{
+    int s_r = job->size[0], s_g = job->size[1], s_b = job->size[2];
 
     void *tmp = talloc_new(NULL);
     uint16_t *output = talloc_array(tmp, uint16_t, s_r * s_g * s_b * 3);
@@ -327,14 +398,14 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     cmsContext cms = NULL;
 
     char *cache_file = NULL;
-    if (p->opts->cache_dir && p->opts->cache_dir[0]) {
+    if (job->cache_dir && job->cache_dir[0]) {
         // Gamma is included in the header to help uniquely identify it,
         // because we may change the parameter in the future or make it
         // customizable, same for the primaries.
         char *cache_info = talloc_asprintf(tmp,
                 "ver=1.3, intent=%d, size=%dx%dx%d, prim=%d, trc=%d, "
                 "contrast=%d\n",
-                p->opts->intent, s_r, s_g, s_b, prim, trc, p->opts->contrast);
+                job->intent, s_r, s_g, s_b, job->prim, job->trc, job->contrast);
 
         uint8_t hash[32];
         struct AVSHA *sha = av_sha_alloc();
@@ -342,11 +413,11 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
             abort();
         av_sha_init(sha, 256);
         av_sha_update(sha, cache_info, strlen(cache_info));
-        av_sha_update(sha, p->icc_data, p->icc_size);
+        av_sha_update(sha, job->icc_data, job->icc_size);
         av_sha_final(sha, hash);
         av_free(sha);
 
-        char *cache_dir = mp_get_user_path(tmp, p->global, p->opts->cache_dir);
+        char *cache_dir = mp_get_user_path(tmp, job->global, job->cache_dir);
         cache_file = talloc_strdup(tmp, "");
         for (int i = 0; i < sizeof(hash); i++)
             cache_file = talloc_asprintf_append(cache_file, "%02X", hash[i]);
@@ -357,57 +428,66 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
 
     // check cache
     if (cache_file && stat(cache_file, &(struct stat){0}) == 0) {
-        MP_VERBOSE(p, "Opening 3D LUT cache in file '%s'.\n", cache_file);
-        struct bstr cachedata = stream_read_file(cache_file, tmp, p->global,
+        MP_VERBOSE(job, "Opening 3D LUT cache in file '%s'.\n", cache_file);
+        struct bstr cachedata = stream_read_file(cache_file, tmp, job->global,
                                                  1000000000); // 1 GB
         if (cachedata.len == talloc_get_size(output)) {
             memcpy(output, cachedata.start, cachedata.len);
             goto done;
         } else {
-            MP_WARN(p, "3D LUT cache invalid!\n");
+            MP_WARN(job, "3D LUT cache invalid!\n");
         }
     }
 
-    cms = cmsCreateContext(NULL, p);
+    cms = cmsCreateContext(NULL, job);
     if (!cms)
         goto error_exit;
     cmsSetLogErrorHandlerTHR(cms, lcms2_error_handler);
 
     cmsHPROFILE profile =
-        cmsOpenProfileFromMemTHR(cms, p->icc_data, p->icc_size);
+        cmsOpenProfileFromMemTHR(cms, job->icc_data, job->icc_size);
     if (!profile)
         goto error_exit;
 
-    cmsHPROFILE vid_profile = get_vid_profile(p, cms, profile, prim, trc);
+    cmsHPROFILE vid_profile = get_vid_profile(job, cms, profile, job->prim,
+                                              job->trc);
     if (!vid_profile) {
         cmsCloseProfile(profile);
         goto error_exit;
     }
 
+    // NOCACHE makes cmsDoTransform() safe to call from multiple threads.
     cmsHTRANSFORM trafo = cmsCreateTransformTHR(cms, vid_profile, TYPE_RGB_16,
                                                 profile, TYPE_RGB_16,
-                                                p->opts->intent,
+                                                job->intent,
                                                 cmsFLAGS_HIGHRESPRECALC |
-                                                cmsFLAGS_BLACKPOINTCOMPENSATION);
+                                                cmsFLAGS_BLACKPOINTCOMPENSATION |
+                                                cmsFLAGS_NOCACHE);
     cmsCloseProfile(profile);
     cmsCloseProfile(vid_profile);
 
     if (!trafo)
         goto error_exit;
 
-    // transform a (s_r)x(s_g)x(s_b) cube, with 3 components per channel
-    uint16_t *input = talloc_array(tmp, uint16_t, s_r * 3);
+    // transform a (s_r)x(s_g)x(s_b) cube, with 3 components per channel,
+    // one blue plane per work item
+    struct lut_slice *slices = talloc_array(tmp, struct lut_slice, s_b);
+    int threads = MPCLAMP(av_cpu_count(), 1, s_b);
+    struct mp_thread_pool *pool = mp_thread_pool_create(tmp, threads);
     for (int b = 0; b < s_b; b++) {
-        for (int g = 0; g < s_g; g++) {
-            for (int r = 0; r < s_r; r++) {
-                input[r * 3 + 0] = r * 65535 / (s_r - 1);
-                input[r * 3 + 1] = g * 65535 / (s_g - 1);
-                input[r * 3 + 2] = b * 65535 / (s_b - 1);
-            }
-            size_t base = (b * s_r * s_g + g * s_r) * 3;
-            cmsDoTransform(trafo, input, output + base, s_r);
+        slices[b] = (struct lut_slice){
+            .trafo = trafo,
+            .output = output,
+            .size = {s_r, s_g, s_b},
+            .b = b,
+        };
+        if (pool) {
+            mp_thread_pool_queue(pool, lut_slice_run, &slices[b]);
+        } else {
+            lut_slice_run(&slices[b]);
         }
     }
+    talloc_free(pool);
 
     cmsDeleteTransform(trafo);
 
@@ -421,24 +501,148 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
 
 done: ;
 
-    lut = talloc_ptrtype(NULL, lut);
+    lut = talloc_ptrtype(job, lut);
     *lut = (struct lut3d) {
         .data = talloc_steal(lut, output),
         .size = {s_r, s_g, s_b},
     };
 
-    *result_lut3d = lut;
-    result = true;
-
 error_exit:
 
     if (cms)
         cmsDeleteContext(cms);
 
-    if (!lut)
-        MP_FATAL(p, "Error loading ICC profile.\n");
-
     talloc_free(tmp);
+    return lut;
+}
+
+static void lut_job_run(void *ctx)
+{
+    struct lut_job *job = ctx;
+    struct gl_lcms *p = job->owner;
+
+    pthread_mutex_lock(&p->lock);
+    bool cancel = job->cancel;
+    pthread_mutex_unlock(&p->lock);
+
+    struct lut3d *lut = cancel ? NULL : create_lut3d(job);
+
+    pthread_mutex_lock(&p->lock);
+    job->lut = lut;
+    job->done = true;
+    cancel = job->cancel;
+    if (cancel) {
+        talloc_free(job);
+    } else if (p->wakeup_cb) {
+        p->wakeup_cb(p->wakeup_ctx);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Drop the pending job. If it's still running, the worker frees it.
+static void cancel_job(struct gl_lcms *p)
+{
+    if (!p->job)
+        return;
+    pthread_mutex_lock(&p->lock);
+    if (p->job->done) {
+        talloc_free(p->job);
+    } else {
+        p->job->cancel = true;
+    }
+    pthread_mutex_unlock(&p->lock);
+    p->job = NULL;
+}
+
+static bool job_matches(struct gl_lcms *p, struct lut_job *job, int size[3],
+                        enum mp_csp_prim prim, enum mp_csp_trc trc)
+{
+    return job->profile_id == p->profile_id &&
+           job->prim == prim && job->trc == trc &&
+           job->intent == p->opts->intent &&
+           job->contrast == p->opts->contrast &&
+           memcmp(job->size, size, sizeof(job->size)) == 0 &&
+           bstr_equals(bstr0(job->cache_dir), bstr0(p->opts->cache_dir));
+}
+
+// Whether a 3D LUT has finished generating, and is waiting to be retrieved
+// with gl_lcms_get_lut3d().
+bool gl_lcms_lut3d_ready(struct gl_lcms *p)
+{
+    if (!p->job)
+        return false;
+    pthread_mutex_lock(&p->lock);
+    bool done = p->job->done;
+    pthread_mutex_unlock(&p->lock);
+    return done;
+}
+
+// The 3D LUT is generated asynchronously. Returns false on errors. If it's
+// still being generated, true is returned and *result_lut3d is left as NULL;
+// gl_lcms_has_changed() keeps returning true until the LUT was returned.
+bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
+                       enum mp_csp_prim prim, enum mp_csp_trc trc)
+{
+    int size[3];
+
+    p->current_prim = prim;
+    p->current_trc = trc;
+
+    if (!parse_3dlut_size(p->opts->size_str, &size[0], &size[1], &size[2]) ||
+        !gl_lcms_has_profile(p))
+    {
+        cancel_job(p);
+        p->changed = false;
+        return false;
+    }
+
+    if (p->job && !job_matches(p, p->job, size, prim, trc))
+        cancel_job(p);
+
+    if (!p->job) {
+        if (!p->pool)
+            p->pool = mp_thread_pool_create(p, 1);
+        if (!p->pool) {
+            p->changed = false;
+            return false;
+        }
+
+        struct lut_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct lut_job) {
+            .owner = p,
+            .log = p->log,
+            .global = p->global,
+            .icc_data = talloc_memdup(job, p->icc_data, p->icc_size),
+            .icc_size = p->icc_size,
+            .profile_id = p->profile_id,
+            .cache_dir = talloc_strdup(job, p->opts->cache_dir),
+            .intent = p->opts->intent,
+            .contrast = p->opts->contrast,
+            .size = {size[0], size[1], size[2]},
+            .prim = prim,
+            .trc = trc,
+        };
+        p->job = job;
+        // Keep polling until the result has been picked up.
+        p->changed = true;
+        MP_VERBOSE(p, "Generating 3D LUT in the background.\n");
+        mp_thread_pool_queue(p->pool, lut_job_run, job);
+    }
+
+    if (!gl_lcms_lut3d_ready(p))
+        return true;
+
+    struct lut_job *job = p->job;
+    p->job = NULL;
+    p->changed = false;
+
+    bool result = !!job->lut;
+    if (result) {
+        *result_lut3d = talloc_steal(NULL, job->lut);
+    } else {
+        MP_FATAL(p, "Error loading ICC profile.\n");
+    }
+    talloc_free(job);
     return result;
 }
 
@@ -477,4 +681,13 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     return false;
 }
 
+void gl_lcms_set_wakeup_cb(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx)
+{
+}
+
+bool gl_lcms_lut3d_ready(struct gl_lcms *p)
+{
+    return false;
+}
+
 #endif
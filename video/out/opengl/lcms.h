@@ -35,5 +35,7 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **,
                        enum mp_csp_prim prim, enum mp_csp_trc trc);
 bool gl_lcms_has_changed(struct gl_lcms *p, enum mp_csp_prim prim,
                          enum mp_csp_trc trc);
+void gl_lcms_set_wakeup_cb(struct gl_lcms *p, void (*cb)(void *ctx), void *ctx);
+bool gl_lcms_lut3d_ready(struct gl_lcms *p);
 
 #endif
@@ -21,6 +21,7 @@
 
 #include <libavutil/common.h>
 
+#include "common/mem_usage.h"
 #include "formats.h"
 #include "utils.h"
 #include "osd.h"
@@ -46,16 +47,53 @@ static const struct gl_vao_entry vertex_vao[] = {
     {0}
 };
 
+// Instanced drawing: one record per bitmap, expanded to a quad (drawn as
+// GL_TRIANGLE_STRIP) in the vertex shader.
+struct osd_instance {
+    float rect[4];          // x0, y0, x1, y1 (transformed)
+    float texrect[4];       // s0, t0, s1, t1
+    uint8_t ass_color[4];
+};
+
+static const struct gl_vao_entry instance_vao[] = {
+    {"rect",        4, GL_FLOAT,         false, offsetof(struct osd_instance, rect)},
+    {"texrect",     4, GL_FLOAT,         false, offsetof(struct osd_instance, texrect)},
+    {"ass_color",   4, GL_UNSIGNED_BYTE, true,  offsetof(struct osd_instance, ass_color)},
+    {0}
+};
+
+// The same as what the fragment shader gets with vertex_vao.
+static const struct gl_vao_entry instance_outputs[] = {
+    {"texcoord",    2},
+    {"ass_color",   4},
+    {0}
+};
+
+static const char instance_vertex_shader[] =
+    "vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+    "gl_Position = vec4(mix(vertex_rect.xy, vertex_rect.zw, corner), 1.0, 1.0);\n"
+    "texcoord = mix(vertex_texrect.xy, vertex_texrect.zw, corner);\n"
+    "ass_color = vertex_ass_color;\n";
+
 struct mpgl_osd_part {
     enum sub_bitmap_format format;
     int change_id;
+    uint64_t packed_id;     // sub_bitmaps.packed_id of the texture contents
     GLuint texture;
     int w, h;
+    size_t bytes;           // estimated video memory used by texture
     struct gl_pbo_upload pbo;
     int num_subparts;
     int prev_num_subparts;
     struct sub_bitmap *subparts;
     struct vertex *vertices;
+    // Instance data uploaded to inst_vao, for inst_count subparts drawn with
+    // inst_t. Stays valid as long as the bitmaps and the transform don't change.
+    struct gl_vao inst_vao;
+    struct osd_instance *instances;
+    bool inst_valid;
+    int inst_count;
+    struct gl_transform inst_t;
 };
 
 struct mpgl_osd {
@@ -67,6 +105,8 @@ struct mpgl_osd {
     const struct gl_format *fmt_table[SUBBITMAP_COUNT];
     bool formats[SUBBITMAP_COUNT];
     struct gl_vao vao;
+    bool instancing;        // MPGL_CAP_INSTANCING available
+    bool draw_instanced;    // use it for the current OSD
     int64_t change_counter;
     // temporary
     int stereo_mode;
@@ -95,6 +135,13 @@ struct mpgl_osd *mpgl_osd_init(GL *gl, struct mp_log *log, struct osd_state *osd
 
     gl_vao_init(&ctx->vao, gl, sizeof(struct vertex), vertex_vao);
 
+    ctx->instancing = (gl->mpgl_caps & MPGL_CAP_INSTANCING) &&
+                      gl->glsl_version >= 130;
+    for (int n = 0; ctx->instancing && n < MAX_OSD_PARTS; n++) {
+        gl_vao_init_instanced(&ctx->parts[n]->inst_vao, gl,
+                              sizeof(struct osd_instance), instance_vao);
+    }
+
     return ctx;
 }
 
@@ -111,6 +158,8 @@ void mpgl_osd_destroy(struct mpgl_osd *ctx)
         struct mpgl_osd_part *p = ctx->parts[n];
         gl->DeleteTextures(1, &p->texture);
         gl_pbo_upload_uninit(&p->pbo);
+        gl_vao_uninit(&p->inst_vao);
+        mp_mem_usage_add(MP_MEM_GPU_TEXTURES, -(int64_t)p->bytes);
     }
     talloc_free(ctx);
 }
@@ -148,7 +197,11 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
 
     gl->BindTexture(GL_TEXTURE_2D, osd->texture);
 
+    bool full = !imgs->packed_id || imgs->packed_base_id != osd->packed_id;
+    osd->packed_id = 0;
+
     if (req_w > osd->w || req_h > osd->h || osd->format != imgs->format) {
+        full = true;
         osd->format = imgs->format;
         osd->w = FFMAX(32, req_w);
         osd->h = FFMAX(32, req_h);
@@ -166,6 +219,10 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
 
         gl->TexImage2D(GL_TEXTURE_2D, 0, fmt->internal_format, osd->w, osd->h,
                        0, fmt->format, fmt->type, NULL);
+        mp_mem_usage_add(MP_MEM_GPU_TEXTURES, -(int64_t)osd->bytes);
+        osd->bytes = (size_t)osd->w * osd->h *
+                     gl_bytes_per_pixel(fmt->format, fmt->type);
+        mp_mem_usage_add(MP_MEM_GPU_TEXTURES, osd->bytes);
 
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -173,10 +230,25 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
         gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
 
-    gl_pbo_upload_tex(&osd->pbo, gl, ctx->use_pbo, GL_TEXTURE_2D, fmt->format,
-                      fmt->type, osd->w, osd->h, imgs->packed->planes[0],
-                      imgs->packed->stride[0], 0, 0,
-                      imgs->packed_w, imgs->packed_h);
+    if (full) {
+        gl_pbo_upload_tex(&osd->pbo, gl, ctx->use_pbo, GL_TEXTURE_2D,
+                          fmt->format, fmt->type, osd->w, osd->h,
+                          imgs->packed->planes[0], imgs->packed->stride[0],
+                          0, 0, imgs->packed_w, imgs->packed_h);
+    } else {
+        // Only what changed since the contents already in the texture.
+        struct mp_image *img = imgs->packed;
+        for (int n = 0; n < imgs->num_dirty; n++) {
+            struct mp_rect rc = imgs->dirty[n];
+            void *src = img->planes[0] + rc.y0 * img->stride[0] +
+                        rc.x0 * img->fmt.bytes[0];
+            gl_pbo_upload_tex(&osd->pbo, gl, ctx->use_pbo, GL_TEXTURE_2D,
+                              fmt->format, fmt->type, osd->w, osd->h,
+                              src, img->stride[0], rc.x0, rc.y0,
+                              rc.x1 - rc.x0, rc.y1 - rc.y0);
+        }
+    }
+    osd->packed_id = imgs->packed_id;
     ok = true;
 
 done:
@@ -199,6 +271,7 @@ static void gen_osd_cb(void *pctx, struct sub_bitmaps *imgs)
             ok = false;
 
         osd->change_id = imgs->change_id;
+        osd->inst_valid = false;
         ctx->change_counter += 1;
     }
     osd->num_subparts = ok ? imgs->num_parts : 0;
@@ -250,13 +323,40 @@ static int generate_verts(struct mpgl_osd_part *part, struct gl_transform t)
     return num_vertices;
 }
 
+static void generate_instances(struct mpgl_osd_part *part, struct gl_transform t)
+{
+    MP_TARRAY_GROW(part, part->instances, part->num_subparts);
+
+    for (int n = 0; n < part->num_subparts; n++) {
+        struct sub_bitmap *b = &part->subparts[n];
+        struct osd_instance *in = &part->instances[n];
+
+        float x0 = b->x, y0 = b->y, x1 = b->x + b->dw, y1 = b->y + b->dh;
+        gl_transform_vec(t, &x0, &y0);
+        gl_transform_vec(t, &x1, &y1);
+
+        uint32_t c = b->libass.color;
+        *in = (struct osd_instance){
+            .rect = {x0, y0, x1, y1},
+            .texrect = {b->src_x / (float)part->w, b->src_y / (float)part->h,
+                        (b->src_x + b->w) / (float)part->w,
+                        (b->src_y + b->h) / (float)part->h},
+            .ass_color = {c >> 24, (c >> 16) & 0xff, (c >> 8) & 0xff,
+                          255 - (c & 0xff)},
+        };
+    }
+
+    part->inst_valid = true;
+    part->inst_count = part->num_subparts;
+    part->inst_t = t;
+}
+
 static void draw_part(struct mpgl_osd *ctx, int index, struct gl_transform t)
 {
     GL *gl = ctx->gl;
     struct mpgl_osd_part *part = ctx->parts[index];
 
-    int num_vertices = generate_verts(part, t);
-    if (!num_vertices)
+    if (!part->num_subparts)
         return;
 
     gl->Enable(GL_BLEND);
@@ -265,7 +365,21 @@ static void draw_part(struct mpgl_osd *ctx, int index, struct gl_transform t)
     const int *factors = &blend_factors[part->format][0];
     gl->BlendFuncSeparate(factors[0], factors[1], factors[2], factors[3]);
 
-    gl_vao_draw_data(&ctx->vao, GL_TRIANGLES, part->vertices, num_vertices);
+    if (ctx->draw_instanced) {
+        // Upload only if something changed; typically, a subtitle stays the
+        // same for many frames.
+        bool upload = !part->inst_valid ||
+                      part->inst_count != part->num_subparts ||
+                      !gl_transform_eq(part->inst_t, t);
+        if (upload)
+            generate_instances(part, t);
+        gl_vao_draw_instanced(&part->inst_vao, GL_TRIANGLE_STRIP, 4,
+                              upload ? part->instances : NULL,
+                              part->num_subparts);
+    } else {
+        int num_vertices = generate_verts(part, t);
+        gl_vao_draw_data(&ctx->vao, GL_TRIANGLES, part->vertices, num_vertices);
+    }
 
     gl->BindTexture(GL_TEXTURE_2D, 0);
     gl->Disable(GL_BLEND);
@@ -311,9 +425,19 @@ enum sub_bitmap_format mpgl_osd_get_part_format(struct mpgl_osd *ctx, int index)
     return ctx->parts[index]->format;
 }
 
-struct gl_vao *mpgl_osd_get_vao(struct mpgl_osd *ctx)
+// Set the vertex data layout (and vertex shader, if needed) for drawing the
+// given part with mpgl_osd_draw_part(). The fragment shader gets the texcoord
+// and ass_color inputs either way.
+void mpgl_osd_set_shader(struct mpgl_osd *ctx, struct gl_shader_cache *sc,
+                         int index)
 {
-    return &ctx->vao;
+    assert(index >= 0 && index < MAX_OSD_PARTS);
+    if (ctx->draw_instanced) {
+        gl_sc_set_vao(sc, &ctx->parts[index]->inst_vao);
+        gl_sc_set_vertex_shader(sc, instance_vertex_shader, instance_outputs);
+    } else {
+        gl_sc_set_vao(sc, &ctx->vao);
+    }
 }
 
 static void set_res(struct mpgl_osd *ctx, struct mp_osd_res res, int stereo_mode)
@@ -334,9 +458,17 @@ void mpgl_osd_generate(struct mpgl_osd *ctx, struct mp_osd_res res, double pts,
 
     set_res(ctx, res, stereo_mode);
 
+    // Bitmaps are always drawn with their dw/dh size.
+    draw_flags |= OSD_DRAW_ALLOW_SCALE;
     osd_draw(ctx->osd, ctx->osd_res, pts, draw_flags, ctx->formats, gen_osd_cb, ctx);
     ctx->stereo_mode = stereo_mode;
 
+    // With 3D side-by-side output, every part is drawn multiple times with
+    // different transforms, so the instance data couldn't be kept around.
+    int div[2];
+    get_3d_side_by_side(stereo_mode, div);
+    ctx->draw_instanced = ctx->instancing && div[0] == 1 && div[1] == 1;
+
     // Parts going away does not necessarily result in gen_osd_cb() being called
     // (not even with num_parts==0), so check this separately.
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
@@ -17,6 +17,7 @@
 
 #include <ctype.h>
 #include <assert.h>
+#include <string.h>
 
 #include "user_shaders.h"
 
@@ -158,6 +159,43 @@ done:
     return true;
 }
 
+static bool is_hooked_size(struct szexp expr[MAX_SZEXP_SIZE], enum szexp_tag tag)
+{
+    return expr[0].tag == tag && bstr_equals0(expr[0].val.varname, "HOOKED") &&
+           expr[1].tag == SZEXP_END;
+}
+
+// This is a conservative textual check: every texture access in the body must
+// be exactly HOOKED_tex(HOOKED_pos), which also excludes _texOff() and _raw.
+bool user_shader_is_pointwise(struct gl_user_shader *shader)
+{
+    if (shader->save_tex.len || shader->components ||
+        !gl_transform_eq(shader->offset, identity_trans) ||
+        !is_hooked_size(shader->width, SZEXP_VAR_W) ||
+        !is_hooked_size(shader->height, SZEXP_VAR_H))
+        return false;
+
+    if (!bstr_equals0(shader->bind_tex[0], "HOOKED"))
+        return false;
+    for (int n = 1; n < SHADER_MAX_BINDS; n++) {
+        if (shader->bind_tex[n].len)
+            return false;
+    }
+
+    struct bstr body = shader->pass_body;
+    if (bstr_find0(body, "_raw") >= 0)
+        return false;
+    const char *access = "HOOKED_tex(HOOKED_pos)";
+    int prefix = strlen("HOOKED");
+    int pos;
+    while ((pos = bstr_find0(body, "_tex")) >= 0) {
+        if (pos < prefix || !bstr_startswith0(bstr_cut(body, pos - prefix), access))
+            return false;
+        body = bstr_cut(body, pos - prefix + strlen(access));
+    }
+    return true;
+}
+
 // Returns false if no more shaders could be parsed
 bool parse_user_shader_pass(struct mp_log *log, struct bstr *body,
                             struct gl_user_shader *out)
@@ -71,6 +71,11 @@ struct gl_user_shader {
 bool parse_user_shader_pass(struct mp_log *log, struct bstr *body,
                             struct gl_user_shader *out);
 
+// Whether the pass only samples HOOKED at the position of the output pixel,
+// and doesn't change the texture size, so that it can be run in the same
+// shader as the pass it processes the output of.
+bool user_shader_is_pointwise(struct gl_user_shader *shader);
+
 // Evaluate a szexp, given a lookup function for named textures
 bool eval_szexpr(struct mp_log *log, void *priv,
                  bool (*lookup)(void *priv, struct bstr var, float size[2]),
@@ -22,8 +22,17 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <libavutil/sha.h>
+#include <libavutil/mem.h>
 
 #include "common/common.h"
+#include "common/mem_usage.h"
+#include "options/path.h"
+#include "stream/stream.h"
+#include "osdep/io.h"
 #include "formats.h"
 #include "utils.h"
 
@@ -111,11 +120,15 @@ mp_image_t *gl_read_window_contents(GL *gl, int w, int h)
     GLenum obj = gl->main_fb ? GL_COLOR_ATTACHMENT0 : GL_FRONT;
     gl->PixelStorei(GL_PACK_ALIGNMENT, 1);
     gl->ReadBuffer(obj);
-    //flip image while reading (and also avoid stride-related trouble)
-    for (int y = 0; y < h; y++) {
-        gl->ReadPixels(0, h - y - 1, w, 1, GL_RGB, GL_UNSIGNED_BYTE,
-                       image->planes[0] + y * image->stride[0]);
-    }
+    // Read everything with a single call (each ReadPixels call is a full GPU
+    // sync), then flip the image while copying it (and also avoid
+    // stride-related trouble).
+    size_t line = w * 3;
+    uint8_t *buf = talloc_size(NULL, line * h);
+    gl->ReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, buf);
+    for (int y = 0; y < h; y++)
+        memcpy(image->planes[0] + y * image->stride[0], buf + (h - y - 1) * line, line);
+    talloc_free(buf);
     gl->PixelStorei(GL_PACK_ALIGNMENT, 4);
     gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
     return image;
@@ -147,11 +160,13 @@ static void gl_vao_enable_attribs(struct gl_vao *vao)
         gl->EnableVertexAttribArray(n);
         gl->VertexAttribPointer(n, e->num_elems, e->type, e->normalized,
                                 vao->stride, (void *)(intptr_t)e->offset);
+        if (vao->instanced)
+            gl->VertexAttribDivisor(n, 1);
     }
 }
 
-void gl_vao_init(struct gl_vao *vao, GL *gl, int stride,
-                 const struct gl_vao_entry *entries)
+static void vao_init(struct gl_vao *vao, GL *gl, int stride,
+                     const struct gl_vao_entry *entries, bool instanced)
 {
     assert(!vao->vao);
     assert(!vao->buffer);
@@ -160,6 +175,7 @@ void gl_vao_init(struct gl_vao *vao, GL *gl, int stride,
         .gl = gl,
         .stride = stride,
         .entries = entries,
+        .instanced = instanced,
     };
 
     gl->GenBuffers(1, &vao->buffer);
@@ -176,6 +192,21 @@ void gl_vao_init(struct gl_vao *vao, GL *gl, int stride,
     }
 }
 
+void gl_vao_init(struct gl_vao *vao, GL *gl, int stride,
+                 const struct gl_vao_entry *entries)
+{
+    vao_init(vao, gl, stride, entries, false);
+}
+
+// Like gl_vao_init(), but each element of the vertex data is used for all
+// vertexes of an instance. Requires MPGL_CAP_INSTANCING.
+void gl_vao_init_instanced(struct gl_vao *vao, GL *gl, int stride,
+                           const struct gl_vao_entry *entries)
+{
+    assert(gl->mpgl_caps & MPGL_CAP_INSTANCING);
+    vao_init(vao, gl, stride, entries, true);
+}
+
 void gl_vao_uninit(struct gl_vao *vao)
 {
     GL *gl = vao->gl;
@@ -209,8 +240,11 @@ void gl_vao_unbind(struct gl_vao *vao)
     if (gl->BindVertexArray) {
         gl->BindVertexArray(0);
     } else {
-        for (int n = 0; vao->entries[n].name; n++)
+        for (int n = 0; vao->entries[n].name; n++) {
+            if (vao->instanced)
+                gl->VertexAttribDivisor(n, 0);
             gl->DisableVertexAttribArray(n);
+        }
     }
 }
 
@@ -235,6 +269,146 @@ void gl_vao_draw_data(struct gl_vao *vao, GLenum prim, void *ptr, size_t num)
     gl_vao_unbind(vao);
 }
 
+// Draw num_instances instances of num_vertices vertexes each, with the
+// per-instance data in ptr (for a vao created with gl_vao_init_instanced()).
+// As with gl_vao_draw_data(), ptr==NULL reuses the previously uploaded data.
+void gl_vao_draw_instanced(struct gl_vao *vao, GLenum prim, int num_vertices,
+                           void *ptr, size_t num_instances)
+{
+    GL *gl = vao->gl;
+    assert(vao->instanced);
+
+    if (ptr) {
+        gl->BindBuffer(GL_ARRAY_BUFFER, vao->buffer);
+        gl->BufferData(GL_ARRAY_BUFFER, num_instances * vao->stride, ptr,
+                       GL_DYNAMIC_DRAW);
+        gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    gl_vao_bind(vao);
+
+    gl->DrawArraysInstanced(prim, 0, num_vertices, num_instances);
+
+    gl_vao_unbind(vao);
+}
+
+// Keeps FBOs released by fbotex_uninit() around, so that they can be reused
+// by later fbo_pool_change() calls requesting the same size and format, e.g.
+// when the window is resized back and forth, or if a different pass needs an
+// FBO that was just freed. It also accounts for the memory used by FBOs, and
+// can enforce an upper limit.
+struct fbo_pool {
+    GL *gl;
+    struct mp_log *log;
+    size_t budget;          // 0 means unlimited
+    size_t live_bytes;      // FBOs currently in use
+    size_t cached_bytes;    // FBOs in entries[]
+    // released FBOs, least recently released first
+    struct fbotex *entries;
+    int num_entries;
+};
+
+static bool fbotex_realloc(struct fbotex *fbo, GL *gl, struct mp_log *log,
+                           struct fbo_pool *pool, int w, int h, GLenum iformat,
+                           int flags);
+
+struct fbo_pool *fbo_pool_create(GL *gl, struct mp_log *log)
+{
+    struct fbo_pool *pool = talloc_ptrtype(NULL, pool);
+    *pool = (struct fbo_pool){
+        .gl = gl,
+        .log = log,
+    };
+    return pool;
+}
+
+static void pool_drop_oldest(struct fbo_pool *pool)
+{
+    struct fbotex *e = &pool->entries[0];
+    pool->cached_bytes -= e->bytes;
+    e->pool = NULL;
+    fbotex_uninit(e);
+    MP_TARRAY_REMOVE_AT(pool->entries, pool->num_entries, 0);
+}
+
+// All FBOs allocated from the pool must have been uninitialized before.
+void fbo_pool_destroy(struct fbo_pool *pool)
+{
+    if (!pool)
+        return;
+    while (pool->num_entries)
+        pool_drop_oldest(pool);
+    talloc_free(pool);
+}
+
+void fbo_pool_set_budget(struct fbo_pool *pool, size_t budget)
+{
+    pool->budget = budget;
+    // (The FBOs in use are not affected until they get reallocated.)
+    while (pool->num_entries && budget &&
+           pool->live_bytes + pool->cached_bytes > budget)
+        pool_drop_oldest(pool);
+}
+
+// Return the (estimated) memory used by FBOs in use, and by recycled FBOs.
+void fbo_pool_get_usage(struct fbo_pool *pool, size_t *live, size_t *cached)
+{
+    *live = pool->live_bytes;
+    *cached = pool->cached_bytes;
+}
+
+// Make room for a new FBO with the given size. Returns false if the FBOs in
+// use would exceed the budget.
+static bool pool_reserve(struct fbo_pool *pool, size_t bytes)
+{
+    if (!pool->budget)
+        return true;
+    while (pool->num_entries &&
+           pool->live_bytes + pool->cached_bytes + bytes > pool->budget)
+        pool_drop_oldest(pool);
+    return pool->live_bytes + bytes <= pool->budget;
+}
+
+static void pool_release(struct fbo_pool *pool, struct fbotex *fbo)
+{
+    pool->live_bytes -= fbo->bytes;
+    MP_TARRAY_APPEND(pool, pool->entries, pool->num_entries, *fbo);
+    pool->cached_bytes += fbo->bytes;
+    // Don't keep more memory for reuse than is actually used (or anything at
+    // all if nothing is used anymore), and respect the budgets.
+    while (pool->num_entries && (pool->cached_bytes > pool->live_bytes ||
+           (pool->budget && pool->live_bytes + pool->cached_bytes > pool->budget) ||
+           mp_mem_usage_over_limit(MP_MEM_GPU_TEXTURES, 0)))
+        pool_drop_oldest(pool);
+}
+
+// Replace the newly set up fbo by a cached FBO of the same size and format.
+static bool pool_take(struct fbo_pool *pool, struct fbotex *fbo)
+{
+    for (int n = pool->num_entries - 1; n >= 0; n--) {
+        struct fbotex *e = &pool->entries[n];
+        if (e->rw == fbo->rw && e->rh == fbo->rh && e->iformat == fbo->iformat) {
+            fbo->fbo = e->fbo;
+            fbo->texture = e->texture;
+            fbo->tex_filter = e->tex_filter;
+            pool->cached_bytes -= e->bytes;
+            pool->live_bytes += e->bytes;
+            MP_TARRAY_REMOVE_AT(pool->entries, pool->num_entries, n);
+            fbotex_invalidate(fbo);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Like fbotex_change(), but recycle FBOs through the pool. fbo must not be
+// used with fbotex_change() as well.
+bool fbo_pool_change(struct fbo_pool *pool, struct fbotex *fbo, int w, int h,
+                     GLenum iformat, int flags)
+{
+    return fbotex_realloc(fbo, pool->gl, pool->log, pool, w, h, iformat, flags);
+}
+
 // Create a texture and a FBO using the texture as color attachments.
 //  iformat: texture internal format
 // Returns success.
@@ -252,6 +426,13 @@ bool fbotex_init(struct fbotex *fbo, GL *gl, struct mp_log *log, int w, int h,
 // Enabling FUZZY for W or H means the w or h does not need to be exact.
 bool fbotex_change(struct fbotex *fbo, GL *gl, struct mp_log *log, int w, int h,
                    GLenum iformat, int flags)
+{
+    return fbotex_realloc(fbo, gl, log, NULL, w, h, iformat, flags);
+}
+
+static bool fbotex_realloc(struct fbotex *fbo, GL *gl, struct mp_log *log,
+                           struct fbo_pool *pool, int w, int h, GLenum iformat,
+                           int flags)
 {
     bool res = true;
 
@@ -276,8 +457,6 @@ bool fbotex_change(struct fbotex *fbo, GL *gl, struct mp_log *log, int w, int h,
     if (flags & FBOTEX_FUZZY_H)
         h = MP_ALIGN_UP(h, 256);
 
-    mp_verbose(log, "Create FBO: %dx%d (%dx%d)\n", lw, lh, w, h);
-
     const struct gl_format *format = gl_find_internal_format(gl, iformat);
     if (!format || (format->flags & F_CF) != F_CF) {
         mp_verbose(log, "Format 0x%x not supported.\n", (unsigned)iformat);
@@ -296,13 +475,32 @@ bool fbotex_change(struct fbotex *fbo, GL *gl, struct mp_log *log, int w, int h,
         .lw = lw,
         .lh = lh,
         .iformat = iformat,
+        .pool = pool,
+        .bytes = (size_t)w * h * gl_bytes_per_pixel(format->format, format->type),
     };
 
+    if (pool) {
+        if (pool_take(pool, fbo)) {
+            fbotex_set_filter(fbo, filter ? filter : GL_LINEAR);
+            return true;
+        }
+        if (!pool_reserve(pool, fbo->bytes)) {
+            mp_err(log, "Can't create %dx%d FBO: video memory budget of %zu "
+                   "bytes exceeded.\n", w, h, pool->budget);
+            *fbo = (struct fbotex) {0};
+            return false;
+        }
+        pool->live_bytes += fbo->bytes;
+    }
+
+    mp_verbose(log, "Create FBO: %dx%d (%dx%d)\n", lw, lh, w, h);
+
     gl->GenFramebuffers(1, &fbo->fbo);
     gl->GenTextures(1, &fbo->texture);
     gl->BindTexture(GL_TEXTURE_2D, fbo->texture);
     gl->TexImage2D(GL_TEXTURE_2D, 0, format->internal_format, fbo->rw, fbo->rh, 0,
                    format->format, format->type, NULL);
+    mp_mem_usage_add(MP_MEM_GPU_TEXTURES, fbo->bytes);
     gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     gl->BindTexture(GL_TEXTURE_2D, 0);
@@ -346,7 +544,12 @@ void fbotex_uninit(struct fbotex *fbo)
 {
     GL *gl = fbo->gl;
 
-    if (gl && (gl->mpgl_caps & MPGL_CAP_FB)) {
+    if (fbo->pool && fbo->texture) {
+        pool_release(fbo->pool, fbo);
+        *fbo = (struct fbotex) {0};
+    } else if (gl && (gl->mpgl_caps & MPGL_CAP_FB)) {
+        if (fbo->texture)
+            mp_mem_usage_add(MP_MEM_GPU_TEXTURES, -(int64_t)fbo->bytes);
         gl->DeleteFramebuffers(1, &fbo->fbo);
         gl->DeleteTextures(1, &fbo->texture);
         *fbo = (struct fbotex) {0};
@@ -420,7 +623,8 @@ void gl_set_debug_logger(GL *gl, struct mp_log *log)
         gl->DebugMessageCallback(log ? gl_debug_cb : NULL, log);
 }
 
-// Force cache flush if more than this number of shaders is created.
+// Default maximum number of cached shader programs. If more are needed, the
+// least recently used one is deleted.
 #define SC_MAX_ENTRIES 48
 
 enum uniform_type {
@@ -442,6 +646,7 @@ struct sc_uniform {
     int size;
     GLint loc;
     union uniform_val v;
+    int ubo_offset;     // byte offset in the uniform block, or -1 if unused
     // Set for sampler uniforms.
     GLenum tex_target;
     GLuint tex_handle;
@@ -450,6 +655,7 @@ struct sc_uniform {
 struct sc_cached_uniform {
     GLint loc;
     union uniform_val v;
+    int ubo_offset;
 };
 
 struct sc_entry {
@@ -459,6 +665,11 @@ struct sc_entry {
     bstr frag;
     bstr vert;
     struct gl_vao *vao;
+    uint64_t last_use;  // value of gl_shader_cache.use_counter on last use
+    // Uniform buffer (if ubo_size > 0), and its current contents.
+    GLuint ubo;
+    int ubo_size;
+    uint8_t *ubo_data;
 };
 
 struct gl_shader_cache {
@@ -469,15 +680,36 @@ struct gl_shader_cache {
     char **exts;
     int num_exts;
 
+    // for the on-disk program binary cache (cache_dir==NULL if disabled)
+    struct mpv_global *global;
+    char *cache_dir;
+
     // this is modified during use (gl_sc_add() etc.) and reset for each shader
     bstr prelude_text;
     bstr header_text;
     bstr text;
     int next_texture_unit;
     struct gl_vao *vao;
+    const char *vertex_code;
+    const struct gl_vao_entry *vertex_outputs;
+
+    // compute shader work group size (compute_w==0 if it's a fragment shader)
+    int compute_w, compute_h;
+    GLuint compute_tex;
+    GLenum compute_format;
+
+    // shader storage buffers, bound to the binding point of the same index
+    GLuint ssbos[4];
+    int num_ssbos;
 
     struct sc_entry *entries;
     int num_entries;
+    int max_entries;
+    uint64_t use_counter;
+
+    // statistics
+    uint64_t num_compiles;
+    uint64_t num_evictions;
 
     struct sc_uniform *uniforms;
     int num_uniforms;
@@ -489,6 +721,7 @@ struct gl_shader_cache {
 
     // temporary buffers (avoids frequent reallocations)
     bstr tmp[5];
+    uint8_t *ubo_tmp;
 };
 
 struct gl_shader_cache *gl_sc_create(GL *gl, struct mp_log *log)
@@ -497,6 +730,7 @@ struct gl_shader_cache *gl_sc_create(GL *gl, struct mp_log *log)
     *sc = (struct gl_shader_cache){
         .gl = gl,
         .log = log,
+        .max_entries = SC_MAX_ENTRIES,
     };
     gl_sc_reset(sc);
     return sc;
@@ -519,6 +753,14 @@ void gl_sc_reset(struct gl_shader_cache *sc)
             }
         }
         gl->ActiveTexture(GL_TEXTURE0);
+
+        if (sc->compute_w) {
+            gl->BindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                                 sc->compute_format);
+        }
+
+        for (int n = 0; n < sc->num_ssbos; n++)
+            gl->BindBufferBase(GL_SHADER_STORAGE_BUFFER, n, 0);
     }
 
     sc->prelude_text.len = 0;
@@ -528,32 +770,86 @@ void gl_sc_reset(struct gl_shader_cache *sc)
         talloc_free(sc->uniforms[n].name);
     sc->num_uniforms = 0;
     sc->next_texture_unit = 1; // not 0, as 0 is "free for use"
+    sc->vertex_code = NULL;
+    sc->vertex_outputs = NULL;
+    sc->compute_w = sc->compute_h = 0;
+    sc->num_ssbos = 0;
     sc->needs_reset = false;
 }
 
+static void sc_free_entry(struct gl_shader_cache *sc, struct sc_entry *e)
+{
+    sc->gl->DeleteProgram(e->gl_shader);
+    if (e->ubo)
+        sc->gl->DeleteBuffers(1, &e->ubo);
+    talloc_free(e->vert.start);
+    talloc_free(e->frag.start);
+    talloc_free(e->uniforms);
+    talloc_free(e->ubo_data);
+}
+
 static void sc_flush_cache(struct gl_shader_cache *sc)
 {
     MP_VERBOSE(sc, "flushing shader cache\n");
 
-    for (int n = 0; n < sc->num_entries; n++) {
-        struct sc_entry *e = &sc->entries[n];
-        sc->gl->DeleteProgram(e->gl_shader);
-        talloc_free(e->vert.start);
-        talloc_free(e->frag.start);
-        talloc_free(e->uniforms);
-    }
+    for (int n = 0; n < sc->num_entries; n++)
+        sc_free_entry(sc, &sc->entries[n]);
     sc->num_entries = 0;
 }
 
+// Delete the least recently used programs until at most max entries are left.
+static void sc_evict(struct gl_shader_cache *sc, int max)
+{
+    while (sc->num_entries > max) {
+        int lru = 0;
+        for (int n = 1; n < sc->num_entries; n++) {
+            if (sc->entries[n].last_use < sc->entries[lru].last_use)
+                lru = n;
+        }
+        MP_DBG(sc, "evicting shader program %d\n", lru);
+        sc_free_entry(sc, &sc->entries[lru]);
+        MP_TARRAY_REMOVE_AT(sc->entries, sc->num_entries, lru);
+        sc->num_evictions++;
+    }
+}
+
 void gl_sc_destroy(struct gl_shader_cache *sc)
 {
     if (!sc)
         return;
     gl_sc_reset(sc);
     sc_flush_cache(sc);
+    talloc_free(sc->ubo_tmp);
     talloc_free(sc);
 }
 
+// Set the maximum number of cached programs (at least 1).
+void gl_sc_set_max_entries(struct gl_shader_cache *sc, int max)
+{
+    sc->max_entries = MPMAX(max, 1);
+    sc_evict(sc, sc->max_entries);
+}
+
+void gl_sc_get_stats(struct gl_shader_cache *sc, uint64_t *compiles,
+                     uint64_t *evictions)
+{
+    *compiles = sc->num_compiles;
+    *evictions = sc->num_evictions;
+}
+
+// Store linked program binaries in dir, and load them from there instead of
+// compiling shaders if possible. dir==NULL or "" disables it.
+void gl_sc_set_cache_dir(struct gl_shader_cache *sc, struct mpv_global *global,
+                         const char *dir)
+{
+    talloc_free(sc->cache_dir);
+    sc->cache_dir = NULL;
+    if (dir && dir[0] && sc->gl->ProgramBinary) {
+        sc->global = global;
+        sc->cache_dir = mp_get_user_path(sc, global, dir);
+    }
+}
+
 bool gl_sc_error_state(struct gl_shader_cache *sc)
 {
     return sc->error_state;
@@ -758,6 +1054,68 @@ void gl_sc_set_vao(struct gl_shader_cache *sc, struct gl_vao *vao)
     sc->vao = vao;
 }
 
+// Use code as body of the vertex shader, instead of passing through the vao
+// elements. The vao elements are available as "vertex_<name>" inputs. The code
+// must set gl_Position, and all variables in the {0} terminated outputs list
+// (only name and num_elems are used), which are made available to the
+// fragment shader under the same names. Requires GLSL 1.30. Reset with
+// gl_sc_reset(); code and outputs are not copied.
+void gl_sc_set_vertex_shader(struct gl_shader_cache *sc, const char *code,
+                             const struct gl_vao_entry *outputs)
+{
+    assert(sc->gl->glsl_version >= 130);
+    sc->vertex_code = code;
+    sc->vertex_outputs = outputs;
+}
+
+// Return the GLSL image format layout qualifier for the given internal format,
+// or NULL if it can't be used with image stores.
+const char *gl_sc_image_format(GL *gl, GLenum iformat)
+{
+    switch (iformat) {
+    case GL_RGBA8:      return "rgba8";
+    case GL_RGBA16F:    return "rgba16f";
+    case GL_RGBA32F:    return "rgba32f";
+    case GL_RGBA16:     return gl->es ? NULL : "rgba16";
+    case GL_RGB10_A2:   return gl->es ? NULL : "rgb10_a2";
+    }
+    return NULL;
+}
+
+// Make the current shader a compute shader with a bw*bh work group size. Each
+// invocation writes its final color to out_tex at gl_GlobalInvocationID.xy;
+// the caller is responsible for calling DispatchCompute() after
+// gl_sc_generate(). out_format must be supported by gl_sc_image_format().
+void gl_sc_set_compute(struct gl_shader_cache *sc, int bw, int bh,
+                       GLuint out_tex, GLenum out_format)
+{
+    assert(gl_sc_image_format(sc->gl, out_format));
+    sc->compute_w = bw;
+    sc->compute_h = bh;
+    sc->compute_tex = out_tex;
+    sc->compute_format = out_format;
+}
+
+// Declare a std430 shader storage block with the given name, backed by the
+// buffer object ssbo. format is the list of block members (as GLSL source).
+// The block is coherent, so it can be used for atomics across work groups.
+// Requires GLSL 4.30 (i.e. is for compute shaders only).
+void gl_sc_ssbo(struct gl_shader_cache *sc, char *name, GLuint ssbo,
+                char *format, ...)
+{
+    assert(sc->num_ssbos < MP_ARRAY_SIZE(sc->ssbos));
+    int binding = sc->num_ssbos;
+    sc->ssbos[sc->num_ssbos++] = ssbo;
+
+    gl_sc_haddf(sc, "layout(std430, binding = %d) coherent buffer %s {\n",
+                binding, name);
+    va_list ap;
+    va_start(ap, format);
+    bstr_xappend_vasprintf(sc, &sc->header_text, format, ap);
+    va_end(ap);
+    gl_sc_hadd(sc, "};\n");
+}
+
 static const char *vao_glsl_type(const struct gl_vao_entry *e)
 {
     // pretty dumb... too dumb, but works for us
@@ -818,6 +1176,82 @@ static void update_uniform(GL *gl, struct sc_entry *e, struct sc_uniform *u, int
     }
 }
 
+// Whether non-sampler uniforms can be put into a uniform block.
+static bool sc_use_ubo(struct gl_shader_cache *sc)
+{
+    GL *gl = sc->gl;
+    if (!gl->UniformBlockBinding || !gl->BindBufferBase)
+        return false;
+    return gl->es ? gl->glsl_version >= 300 : gl->glsl_version >= 140;
+}
+
+// Assign std140 offsets to all uniforms that go into the uniform block, and
+// return the size of the block (0 if the block is unused).
+static int sc_layout_ubo(struct gl_shader_cache *sc)
+{
+    bool use_ubo = sc_use_ubo(sc);
+    int size = 0;
+    for (int n = 0; n < sc->num_uniforms; n++) {
+        struct sc_uniform *u = &sc->uniforms[n];
+        u->ubo_offset = -1;
+        if (!use_ubo || (u->type != UT_f && u->type != UT_m))
+            continue;
+        // std140: scalars and vec2 are aligned to their size, vec3/vec4 to
+        // 16 bytes. Matrices are arrays of vec4-aligned column vectors.
+        int align, elem_size;
+        if (u->type == UT_m) {
+            align = 16;
+            elem_size = 16 * u->size;
+        } else {
+            align = u->size == 3 ? 16 : 4 * u->size;
+            elem_size = 4 * u->size;
+        }
+        size = MP_ALIGN_UP(size, align);
+        u->ubo_offset = size;
+        size += elem_size;
+    }
+    return MP_ALIGN_UP(size, 16);
+}
+
+static void write_ubo_uniform(uint8_t *data, struct sc_uniform *u, int offset)
+{
+    if (u->type == UT_m) {
+        for (int c = 0; c < u->size; c++) {
+            memcpy(data + offset + 16 * c, &u->v.f[c * u->size],
+                   sizeof(GLfloat) * u->size);
+        }
+    } else {
+        memcpy(data + offset, &u->v.f[0], sizeof(GLfloat) * u->size);
+    }
+}
+
+// Upload the uniform block of the current program if any value changed, and
+// bind it. Assumes program is current.
+static void update_ubo(struct gl_shader_cache *sc, struct sc_entry *e)
+{
+    GL *gl = sc->gl;
+
+    sc->ubo_tmp = talloc_realloc_size(NULL, sc->ubo_tmp, e->ubo_size);
+    memset(sc->ubo_tmp, 0, e->ubo_size);
+    for (int n = 0; n < sc->num_uniforms; n++) {
+        int offset = e->uniforms[n].ubo_offset;
+        if (offset >= 0)
+            write_ubo_uniform(sc->ubo_tmp, &sc->uniforms[n], offset);
+    }
+
+    if (!e->ubo_data || memcmp(e->ubo_data, sc->ubo_tmp, e->ubo_size) != 0) {
+        if (!e->ubo_data)
+            e->ubo_data = talloc_size(NULL, e->ubo_size);
+        memcpy(e->ubo_data, sc->ubo_tmp, e->ubo_size);
+        gl->BindBuffer(GL_UNIFORM_BUFFER, e->ubo);
+        gl->BufferSubData(GL_UNIFORM_BUFFER, 0, e->ubo_size, e->ubo_data);
+        gl->BindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // All programs use binding point 0.
+    gl->BindBufferBase(GL_UNIFORM_BUFFER, 0, e->ubo);
+}
+
 static void compile_attach_shader(struct gl_shader_cache *sc, GLuint program,
                                   GLenum type, const char *source)
 {
@@ -832,7 +1266,8 @@ static void compile_attach_shader(struct gl_shader_cache *sc, GLuint program,
     gl->GetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
 
     int pri = status ? (log_length > 1 ? MSGL_V : MSGL_DEBUG) : MSGL_ERR;
-    const char *typestr = type == GL_VERTEX_SHADER ? "vertex" : "fragment";
+    const char *typestr = type == GL_VERTEX_SHADER ? "vertex" :
+                          type == GL_COMPUTE_SHADER ? "compute" : "fragment";
     if (mp_msg_test(sc->log, pri)) {
         MP_MSG(sc, pri, "%s shader source:\n", typestr);
         mp_log_source(sc->log, pri, source);
@@ -883,10 +1318,120 @@ static void link_shader(struct gl_shader_cache *sc, GLuint program)
         sc->error_state = true;
 }
 
+// Program binaries are only valid for the exact driver they were created with,
+// so the driver identity is part of the file name.
+static char *get_cache_file(void *ta_ctx, struct gl_shader_cache *sc,
+                            const char *vertex, const char *frag)
+{
+    GL *gl = sc->gl;
+    const char *ids[] = {
+        (const char *)gl->GetString(GL_VENDOR),
+        (const char *)gl->GetString(GL_RENDERER),
+        (const char *)gl->GetString(GL_VERSION),
+        vertex,
+        frag,
+    };
+
+    uint8_t hash[32];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    for (int n = 0; n < MP_ARRAY_SIZE(ids); n++) {
+        const char *s = ids[n] ? ids[n] : "";
+        av_sha_update(sha, s, strlen(s) + 1); // include \0 as separator
+    }
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char *name = talloc_strdup(ta_ctx, "");
+    for (int i = 0; i < sizeof(hash); i++)
+        name = talloc_asprintf_append(name, "%02X", hash[i]);
+    return mp_path_join(ta_ctx, sc->cache_dir, name);
+}
+
+// The cache file contains the GLenum binary format, followed by the binary.
+static GLuint load_cached_program(struct gl_shader_cache *sc,
+                                  const char *cache_file)
+{
+    GL *gl = sc->gl;
+    GLuint prog = 0;
+
+    if (stat(cache_file, &(struct stat){0}) != 0)
+        return 0;
+
+    void *tmp = talloc_new(NULL);
+    struct bstr data = stream_read_file(cache_file, tmp, sc->global,
+                                        64 * 1024 * 1024);
+    if (data.len <= sizeof(GLenum))
+        goto done;
+
+    GLenum format;
+    memcpy(&format, data.start, sizeof(format));
+    prog = gl->CreateProgram();
+    gl->ProgramBinary(prog, format, data.start + sizeof(format),
+                      data.len - sizeof(format));
+    GLint status = 0;
+    gl->GetProgramiv(prog, GL_LINK_STATUS, &status);
+    if (!status) {
+        // E.g. the driver was updated without changing its version string.
+        MP_VERBOSE(sc, "Cached program binary '%s' rejected.\n", cache_file);
+        gl->DeleteProgram(prog);
+        prog = 0;
+    } else {
+        MP_VERBOSE(sc, "Loaded cached program binary '%s'.\n", cache_file);
+    }
+
+done:
+    talloc_free(tmp);
+    return prog;
+}
+
+static void store_cached_program(struct gl_shader_cache *sc, GLuint prog,
+                                 const char *cache_file)
+{
+    GL *gl = sc->gl;
+
+    GLint size = 0;
+    gl->GetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+
+    void *data = talloc_size(NULL, size);
+    GLenum format = 0;
+    GLsizei len = 0;
+    gl->GetProgramBinary(prog, size, &len, &format, data);
+    if (len > 0) {
+        mp_mkdirp(sc->cache_dir);
+        FILE *out = fopen(cache_file, "wb");
+        if (out) {
+            bool ok = fwrite(&format, sizeof(format), 1, out) == 1 &&
+                      fwrite(data, len, 1, out) == 1;
+            // Don't leave truncated files around.
+            if (fclose(out) != 0 || !ok)
+                unlink(cache_file);
+        }
+    }
+    talloc_free(data);
+}
+
 static GLuint create_program(struct gl_shader_cache *sc, const char *vertex,
                              const char *frag)
 {
     GL *gl = sc->gl;
+
+    void *tmp = talloc_new(NULL);
+    char *cache_file = NULL;
+    if (sc->cache_dir) {
+        cache_file = get_cache_file(tmp, sc, vertex, frag);
+        GLuint prog = load_cached_program(sc, cache_file);
+        if (prog) {
+            talloc_free(tmp);
+            return prog;
+        }
+    }
+
+    sc->num_compiles++;
     MP_VERBOSE(sc, "recompiling a shader program:\n");
     if (sc->header_text.len) {
         MP_VERBOSE(sc, "header:\n");
@@ -896,14 +1441,26 @@ static GLuint create_program(struct gl_shader_cache *sc, const char *vertex,
     if (sc->text.len)
         mp_log_source(sc->log, MSGL_V, sc->text.start);
     GLuint prog = gl->CreateProgram();
-    compile_attach_shader(sc, prog, GL_VERTEX_SHADER, vertex);
-    compile_attach_shader(sc, prog, GL_FRAGMENT_SHADER, frag);
-    for (int n = 0; sc->vao->entries[n].name; n++) {
-        char vname[80];
-        snprintf(vname, sizeof(vname), "vertex_%s", sc->vao->entries[n].name);
-        gl->BindAttribLocation(prog, n, vname);
+    if (sc->compute_w) {
+        // frag is the compute shader in this case
+        compile_attach_shader(sc, prog, GL_COMPUTE_SHADER, frag);
+    } else {
+        compile_attach_shader(sc, prog, GL_VERTEX_SHADER, vertex);
+        compile_attach_shader(sc, prog, GL_FRAGMENT_SHADER, frag);
+        for (int n = 0; sc->vao->entries[n].name; n++) {
+            char vname[80];
+            snprintf(vname, sizeof(vname), "vertex_%s", sc->vao->entries[n].name);
+            gl->BindAttribLocation(prog, n, vname);
+        }
     }
     link_shader(sc, prog);
+
+    GLint status = 0;
+    gl->GetProgramiv(prog, GL_LINK_STATUS, &status);
+    if (cache_file && status)
+        store_cached_program(sc, prog, cache_file);
+
+    talloc_free(tmp);
     return prog;
 }
 
@@ -927,14 +1484,18 @@ void gl_sc_generate(struct gl_shader_cache *sc)
     // and before starting a new one.
     assert(!sc->needs_reset);
 
-    assert(sc->vao);
+    bool compute = sc->compute_w > 0;
+    assert(sc->vao || compute);
 
     for (int n = 0; n < MP_ARRAY_SIZE(sc->tmp); n++)
         sc->tmp[n].len = 0;
 
     // set up shader text (header + uniforms + body)
     bstr *header = &sc->tmp[0];
-    ADD(header, "#version %d%s\n", gl->glsl_version, gl->es >= 300 ? " es" : "");
+    int glsl_version = gl->glsl_version;
+    if (compute)
+        glsl_version = MPMAX(glsl_version, gl->es ? 310 : 430);
+    ADD(header, "#version %d%s\n", glsl_version, gl->es >= 300 ? " es" : "");
     for (int n = 0; n < sc->num_exts; n++)
         ADD(header, "#extension %s : enable\n", sc->exts[n]);
     if (gl->es) {
@@ -955,7 +1516,19 @@ void gl_sc_generate(struct gl_shader_cache *sc)
     bstr *vert_body = &sc->tmp[2];
     ADD(vert_body, "void main() {\n");
     bstr *frag_vaos = &sc->tmp[3];
-    for (int n = 0; sc->vao->entries[n].name; n++) {
+    for (int n = 0; !compute && sc->vertex_code && sc->vao->entries[n].name; n++) {
+        const struct gl_vao_entry *e = &sc->vao->entries[n];
+        ADD(vert_head, "%s %s vertex_%s;\n", vert_in, vao_glsl_type(e), e->name);
+    }
+    for (int n = 0; !compute && sc->vertex_code && sc->vertex_outputs[n].name; n++) {
+        const struct gl_vao_entry *e = &sc->vertex_outputs[n];
+        const char *glsl_type = vao_glsl_type(e);
+        ADD(vert_head, "%s %s %s;\n", vert_out, glsl_type, e->name);
+        ADD(frag_vaos, "%s %s %s;\n", frag_in, glsl_type, e->name);
+    }
+    if (sc->vertex_code)
+        ADD(vert_body, "%s", sc->vertex_code);
+    for (int n = 0; !compute && !sc->vertex_code && sc->vao->entries[n].name; n++) {
         const struct gl_vao_entry *e = &sc->vao->entries[n];
         const char *glsl_type = vao_glsl_type(e);
         if (strcmp(e->name, "position") == 0) {
@@ -973,11 +1546,23 @@ void gl_sc_generate(struct gl_shader_cache *sc)
     ADD(vert_body, "}\n");
     bstr *vert = vert_head;
     ADD_BSTR(vert, *vert_body);
+    if (compute) {
+        // unused
+        vert->len = 0;
+        vert->start[0] = '\0';
+    }
 
     // fragment shader; still requires adding used uniforms and VAO elements
     bstr *frag = &sc->tmp[4];
     ADD_BSTR(frag, *header);
-    if (gl->glsl_version >= 130) {
+    if (compute) {
+        ADD(frag, "#define texture1D texture\n");
+        ADD(frag, "#define texture3D texture\n");
+        ADD(frag, "layout(local_size_x = %d, local_size_y = %d) in;\n",
+            sc->compute_w, sc->compute_h);
+        ADD(frag, "layout(%s, binding = 0) writeonly uniform highp image2D"
+            " out_image;\n", gl_sc_image_format(gl, sc->compute_format));
+    } else if (gl->glsl_version >= 130) {
         ADD(frag, "#define texture1D texture\n");
         ADD(frag, "#define texture3D texture\n");
         ADD(frag, "out vec4 out_color;\n");
@@ -985,9 +1570,21 @@ void gl_sc_generate(struct gl_shader_cache *sc)
         ADD(frag, "#define texture texture2D\n");
     }
     ADD_BSTR(frag, *frag_vaos);
+    int ubo_size = sc_layout_ubo(sc);
     for (int n = 0; n < sc->num_uniforms; n++) {
         struct sc_uniform *u = &sc->uniforms[n];
-        ADD(frag, "uniform %s %s;\n", u->glsl_type, u->name);
+        if (u->ubo_offset < 0)
+            ADD(frag, "uniform %s %s;\n", u->glsl_type, u->name);
+    }
+    if (ubo_size) {
+        // Members of an unnamed block are accessed like normal uniforms.
+        ADD(frag, "layout(std140) uniform UBO {\n");
+        for (int n = 0; n < sc->num_uniforms; n++) {
+            struct sc_uniform *u = &sc->uniforms[n];
+            if (u->ubo_offset >= 0)
+                ADD(frag, "    %s %s;\n", u->glsl_type, u->name);
+        }
+        ADD(frag, "};\n");
     }
 
     // Additional helpers.
@@ -1004,7 +1601,10 @@ void gl_sc_generate(struct gl_shader_cache *sc)
     // we require _all_ frag shaders to write to a "vec4 color"
     ADD(frag, "vec4 color = vec4(0.0, 0.0, 0.0, 1.0);\n");
     ADD_BSTR(frag, sc->text);
-    if (gl->glsl_version >= 130) {
+    if (compute) {
+        // Stores outside of the image are ignored.
+        ADD(frag, "imageStore(out_image, ivec2(gl_GlobalInvocationID), color);\n");
+    } else if (gl->glsl_version >= 130) {
         ADD(frag, "out_color = color;\n");
     } else {
         ADD(frag, "gl_FragColor = color;\n");
@@ -1020,8 +1620,7 @@ void gl_sc_generate(struct gl_shader_cache *sc)
         }
     }
     if (!entry) {
-        if (sc->num_entries == SC_MAX_ENTRIES)
-            sc_flush_cache(sc);
+        sc_evict(sc, sc->max_entries - 1);
         MP_TARRAY_GROW(sc, sc->entries, sc->num_entries);
         entry = &sc->entries[sc->num_entries++];
         *entry = (struct sc_entry){
@@ -1034,23 +1633,53 @@ void gl_sc_generate(struct gl_shader_cache *sc)
         entry->gl_shader = create_program(sc, vert->start, frag->start);
         entry->num_uniforms = 0;
         for (int n = 0; n < sc->num_uniforms; n++) {
+            struct sc_uniform *u = &sc->uniforms[n];
             struct sc_cached_uniform un = {
-                .loc = gl->GetUniformLocation(entry->gl_shader,
-                                              sc->uniforms[n].name),
+                .loc = -1,
+                .ubo_offset = u->ubo_offset,
             };
+            if (un.ubo_offset < 0)
+                un.loc = gl->GetUniformLocation(entry->gl_shader, u->name);
             MP_TARRAY_APPEND(sc, entry->uniforms, entry->num_uniforms, un);
         }
+        if (ubo_size) {
+            GLuint index = gl->GetUniformBlockIndex(entry->gl_shader, "UBO");
+            // The block can be optimized away if no member is used.
+            if (index != GL_INVALID_INDEX) {
+                gl->UniformBlockBinding(entry->gl_shader, index, 0);
+                gl->GenBuffers(1, &entry->ubo);
+                gl->BindBuffer(GL_UNIFORM_BUFFER, entry->ubo);
+                gl->BufferData(GL_UNIFORM_BUFFER, ubo_size, NULL,
+                               GL_DYNAMIC_DRAW);
+                gl->BindBuffer(GL_UNIFORM_BUFFER, 0);
+                entry->ubo_size = ubo_size;
+            }
+        }
     }
 
+    entry->last_use = ++sc->use_counter;
+
     gl->UseProgram(entry->gl_shader);
 
     assert(sc->num_uniforms == entry->num_uniforms);
 
-    for (int n = 0; n < sc->num_uniforms; n++)
-        update_uniform(gl, entry, &sc->uniforms[n], n);
+    for (int n = 0; n < sc->num_uniforms; n++) {
+        if (entry->uniforms[n].ubo_offset < 0)
+            update_uniform(gl, entry, &sc->uniforms[n], n);
+    }
+    if (entry->ubo_size)
+        update_ubo(sc, entry);
 
     gl->ActiveTexture(GL_TEXTURE0);
 
+    if (compute) {
+        gl->BindImageTexture(0, sc->compute_tex, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                             sc->compute_format);
+    }
+
+    for (int n = 0; n < sc->num_ssbos; n++)
+        gl->BindBufferBase(GL_SHADER_STORAGE_BUFFER, n, sc->ssbos[n]);
+
     sc->needs_reset = true;
 }
 
@@ -1068,6 +1697,11 @@ struct gl_timer {
     GLuint query[QUERY_OBJECT_NUM];
     int query_idx;
 
+    // If true, query[] and query_end[] are GL_TIMESTAMP queries issued on
+    // start and stop, instead of GL_TIME_ELAPSED queries in query[].
+    bool timestamps;
+    GLuint query_end[QUERY_OBJECT_NUM];
+
     GLuint64 samples[QUERY_SAMPLE_SIZE];
     int sample_idx;
     int sample_count;
@@ -1110,6 +1744,20 @@ struct gl_timer *gl_timer_create(GL *gl)
     return timer;
 }
 
+// Like gl_timer_create(), but the timer uses timestamp queries. Unlike normal
+// timers, it can be active at the same time as other timers (for example to
+// time a single pass while the render timer is running).
+struct gl_timer *gl_timer_create_ts(GL *gl)
+{
+    struct gl_timer *timer = gl_timer_create(gl);
+    timer->timestamps = true;
+
+    if (gl->GenQueries)
+        gl->GenQueries(QUERY_OBJECT_NUM, timer->query_end);
+
+    return timer;
+}
+
 void gl_timer_free(struct gl_timer *timer)
 {
     if (!timer)
@@ -1119,6 +1767,8 @@ void gl_timer_free(struct gl_timer *timer)
     if (gl && gl->DeleteQueries) {
         // this is a no-op on already uninitialized queries
         gl->DeleteQueries(QUERY_OBJECT_NUM, timer->query);
+        if (timer->timestamps)
+            gl->DeleteQueries(QUERY_OBJECT_NUM, timer->query_end);
     }
 
     talloc_free(timer);
@@ -1155,6 +1805,24 @@ static void gl_timer_record(struct gl_timer *timer, GLuint64 new)
 void gl_timer_start(struct gl_timer *timer)
 {
     GL *gl = timer->gl;
+    if (timer->timestamps) {
+        if (!gl->QueryCounter)
+            return;
+
+        int idx = timer->query_idx++;
+        timer->query_idx %= QUERY_OBJECT_NUM;
+
+        if (gl->IsQuery(timer->query_end[idx])) {
+            GLuint64 t0, t1;
+            gl->GetQueryObjectui64v(timer->query[idx], GL_QUERY_RESULT, &t0);
+            gl->GetQueryObjectui64v(timer->query_end[idx], GL_QUERY_RESULT, &t1);
+            gl_timer_record(timer, t1 > t0 ? t1 - t0 : 0);
+        }
+
+        gl->QueryCounter(timer->query[idx], GL_TIMESTAMP);
+        return;
+    }
+
     if (!gl->BeginQuery)
         return;
 
@@ -1176,6 +1844,13 @@ void gl_timer_start(struct gl_timer *timer)
 void gl_timer_stop(struct gl_timer *timer)
 {
     GL *gl = timer->gl;
+    if (timer->timestamps) {
+        if (gl->QueryCounter) {
+            int idx = (timer->query_idx + QUERY_OBJECT_NUM - 1) % QUERY_OBJECT_NUM;
+            gl->QueryCounter(timer->query_end[idx], GL_TIMESTAMP);
+        }
+        return;
+    }
     if (gl->EndQuery)
         gl->EndQuery(GL_TIME_ELAPSED);
 }
@@ -1211,15 +1886,52 @@ void gl_pbo_upload_tex(struct gl_pbo_upload *pbo, GL *gl, bool use_pbo,
         pbo->gl = gl;
         pbo->buffer_size = buffer_size;
         gl->GenBuffers(NUM_PBO_BUFFERS, &pbo->buffers[0]);
+        pbo->persistent = gl->BufferStorage && gl->FenceSync;
         for (int n = 0; n < NUM_PBO_BUFFERS; n++) {
             gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffers[n]);
-            gl->BufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, NULL,
-                           GL_DYNAMIC_COPY);
+            if (pbo->persistent) {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                                   GL_MAP_COHERENT_BIT;
+                gl->BufferStorage(GL_PIXEL_UNPACK_BUFFER, buffer_size, NULL,
+                                  flags);
+                pbo->mapped[n] = gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                                    buffer_size, flags);
+                if (!pbo->mapped[n]) {
+                    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    gl_pbo_upload_uninit(pbo);
+                    goto no_pbo;
+                }
+            } else {
+                gl->BufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, NULL,
+                               GL_DYNAMIC_COPY);
+            }
         }
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     }
 
     pbo->index = (pbo->index + 1) % NUM_PBO_BUFFERS;
 
+    if (pbo->persistent) {
+        // The buffers stay mapped; only wait until the GPU has finished the
+        // upload that last used this buffer (normally NUM_PBO_BUFFERS-1
+        // uploads ago, so this rarely blocks).
+        GLsync *fence = &pbo->fences[pbo->index];
+        if (*fence) {
+            gl->ClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            gl->DeleteSync(*fence);
+            *fence = NULL;
+        }
+
+        memcpy_pic(pbo->mapped[pbo->index], dataptr, pix_stride * w, h,
+                   pix_stride * w, stride);
+
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffers[pbo->index]);
+        gl_upload_tex(gl, target, format, type, NULL, pix_stride * w, x, y, w, h);
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        *fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return;
+    }
+
     gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffers[pbo->index]);
     void *data = gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, needed_size,
                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
@@ -1245,7 +1957,18 @@ no_pbo:
 
 void gl_pbo_upload_uninit(struct gl_pbo_upload *pbo)
 {
-    if (pbo->gl)
-        pbo->gl->DeleteBuffers(NUM_PBO_BUFFERS, &pbo->buffers[0]);
+    GL *gl = pbo->gl;
+    if (gl) {
+        for (int n = 0; n < NUM_PBO_BUFFERS; n++) {
+            if (pbo->fences[n])
+                gl->DeleteSync(pbo->fences[n]);
+            if (pbo->mapped[n]) {
+                gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffers[n]);
+                gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+        }
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        gl->DeleteBuffers(NUM_PBO_BUFFERS, &pbo->buffers[0]);
+    }
     *pbo = (struct gl_pbo_upload){0};
 }
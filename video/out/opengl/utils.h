@@ -23,6 +23,7 @@
 #include "math.h"
 
 struct mp_log;
+struct mpv_global;
 
 void gl_check_error(GL *gl, struct mp_log *log, const char *info);
 
@@ -54,14 +55,21 @@ struct gl_vao {
     GLuint buffer;  // GL_ARRAY_BUFFER used for the data
     int stride;     // size of each element (interleaved elements are assumed)
     const struct gl_vao_entry *entries;
+    bool instanced; // attributes advance per instance, not per vertex
 };
 
 void gl_vao_init(struct gl_vao *vao, GL *gl, int stride,
                  const struct gl_vao_entry *entries);
+void gl_vao_init_instanced(struct gl_vao *vao, GL *gl, int stride,
+                           const struct gl_vao_entry *entries);
 void gl_vao_uninit(struct gl_vao *vao);
 void gl_vao_bind(struct gl_vao *vao);
 void gl_vao_unbind(struct gl_vao *vao);
 void gl_vao_draw_data(struct gl_vao *vao, GLenum prim, void *ptr, size_t num);
+void gl_vao_draw_instanced(struct gl_vao *vao, GLenum prim, int num_vertices,
+                           void *ptr, size_t num_instances);
+
+struct fbo_pool;
 
 struct fbotex {
     GL *gl;
@@ -71,6 +79,8 @@ struct fbotex {
     GLenum tex_filter;
     int rw, rh; // real (texture) size
     int lw, lh; // logical (configured) size
+    struct fbo_pool *pool; // if allocated with fbo_pool_change()
+    size_t bytes;   // estimated video memory used
 };
 
 bool fbotex_init(struct fbotex *fbo, GL *gl, struct mp_log *log, int w, int h,
@@ -84,6 +94,13 @@ bool fbotex_change(struct fbotex *fbo, GL *gl, struct mp_log *log, int w, int h,
 void fbotex_set_filter(struct fbotex *fbo, GLenum gl_filter);
 void fbotex_invalidate(struct fbotex *fbo);
 
+struct fbo_pool *fbo_pool_create(GL *gl, struct mp_log *log);
+void fbo_pool_destroy(struct fbo_pool *pool);
+void fbo_pool_set_budget(struct fbo_pool *pool, size_t budget);
+void fbo_pool_get_usage(struct fbo_pool *pool, size_t *live, size_t *cached);
+bool fbo_pool_change(struct fbo_pool *pool, struct fbotex *fbo, int w, int h,
+                     GLenum iformat, int flags);
+
 // A 3x2 matrix, with the translation part separate.
 struct gl_transform {
     // row-major, e.g. in mathematical notation:
@@ -147,6 +164,11 @@ struct gl_shader_cache;
 
 struct gl_shader_cache *gl_sc_create(GL *gl, struct mp_log *log);
 void gl_sc_destroy(struct gl_shader_cache *sc);
+void gl_sc_set_max_entries(struct gl_shader_cache *sc, int max);
+void gl_sc_get_stats(struct gl_shader_cache *sc, uint64_t *compiles,
+                     uint64_t *evictions);
+void gl_sc_set_cache_dir(struct gl_shader_cache *sc, struct mpv_global *global,
+                         const char *dir);
 bool gl_sc_error_state(struct gl_shader_cache *sc);
 void gl_sc_reset_error(struct gl_shader_cache *sc);
 void gl_sc_add(struct gl_shader_cache *sc, const char *text);
@@ -168,6 +190,13 @@ void gl_sc_uniform_mat2(struct gl_shader_cache *sc, char *name,
 void gl_sc_uniform_mat3(struct gl_shader_cache *sc, char *name,
                         bool transpose, GLfloat *v);
 void gl_sc_set_vao(struct gl_shader_cache *sc, struct gl_vao *vao);
+void gl_sc_set_vertex_shader(struct gl_shader_cache *sc, const char *code,
+                             const struct gl_vao_entry *outputs);
+const char *gl_sc_image_format(GL *gl, GLenum iformat);
+void gl_sc_set_compute(struct gl_shader_cache *sc, int bw, int bh,
+                       GLuint out_tex, GLenum out_format);
+void gl_sc_ssbo(struct gl_shader_cache *sc, char *name, GLuint ssbo,
+                char *format, ...);
 void gl_sc_enable_extension(struct gl_shader_cache *sc, char *name);
 void gl_sc_generate(struct gl_shader_cache *sc);
 void gl_sc_reset(struct gl_shader_cache *sc);
@@ -176,6 +205,7 @@ void gl_sc_unbind(struct gl_shader_cache *sc);
 struct gl_timer;
 
 struct gl_timer *gl_timer_create(GL *gl);
+struct gl_timer *gl_timer_create_ts(GL *gl);
 void gl_timer_free(struct gl_timer *timer);
 void gl_timer_start(struct gl_timer *timer);
 void gl_timer_stop(struct gl_timer *timer);
@@ -192,6 +222,11 @@ struct gl_pbo_upload {
     int index;
     GLuint buffers[NUM_PBO_BUFFERS];
     size_t buffer_size;
+    // Persistently mapped buffers (if persistent is set), and fences for
+    // the last upload from each buffer.
+    bool persistent;
+    void *mapped[NUM_PBO_BUFFERS];
+    GLsync fences[NUM_PBO_BUFFERS];
 };
 
 void gl_pbo_upload_tex(struct gl_pbo_upload *pbo, GL *gl, bool use_pbo,
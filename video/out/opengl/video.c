@@ -17,10 +17,13 @@
 
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lfg.h>
@@ -30,7 +33,10 @@
 #include "misc/bstr.h"
 #include "options/m_config.h"
 #include "common/global.h"
+#include "common/mem_usage.h"
 #include "options/options.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "common.h"
 #include "formats.h"
 #include "utils.h"
@@ -96,11 +102,23 @@ struct texplane {
     GLenum gl_format;
     GLenum gl_type;
     GLuint gl_texture;
+    GLuint gl_texture_field; // if set, see img_tex.gl_tex_field
+    size_t gl_bytes;    // estimated video memory used by gl_texture
     char swizzle[5];
     bool flipped;
     struct gl_pbo_upload pbo;
 };
 
+// Persistently mapped buffer, which the decoder renders into directly.
+struct dr_buffer {
+    struct gl_video *p;
+    GLuint pbo;
+    uint8_t *ptr;
+    size_t size;
+    GLsync fence;       // set after the last upload from this buffer
+    bool in_use;        // referenced by a mp_image (protected by dr_lock)
+};
+
 struct video_image {
     struct texplane planes[4];
     struct mp_image *mpi;       // original input image
@@ -124,6 +142,10 @@ struct img_tex {
     int components; // number of relevant coordinates
     float multiplier; // multiplier to be used when sampling
     GLuint gl_tex;
+    // If set, gl_tex contains only the even lines (top field), and this the
+    // odd lines (bottom field), each with half of tex_h lines. Only
+    // copy_img_tex() can sample such planes; see pass_convert_plane().
+    GLuint gl_tex_field;
     GLenum gl_target;
     bool use_integer;
     int tex_w, tex_h; // source texture size
@@ -145,6 +167,7 @@ struct tex_hook {
     char *save_tex;
     char *bind_tex[TEXUNIT_VIDEO_NUM];
     int components; // how many components are relevant (0 = same as input)
+    bool pointwise; // user shader which can be fused with the previous hook
     void *priv; // this can be set to whatever the hook wants
     void (*hook)(struct gl_video *p, struct img_tex tex, // generates GLSL
                  struct gl_transform *trans, void *priv);
@@ -152,6 +175,22 @@ struct tex_hook {
     bool (*cond)(struct gl_video *p, struct img_tex tex, void *priv);
 };
 
+static const char *const scaler_unit_names[] = {
+    [SCALER_SCALE] = "scale",
+    [SCALER_DSCALE] = "dscale",
+    [SCALER_CSCALE] = "cscale",
+    [SCALER_TSCALE] = "tscale",
+};
+
+// Maximum number of distinct passes timed separately.
+#define PASS_INFO_MAX 64
+
+struct pass_info {
+    char desc[64];
+    struct gl_timer *timer;
+    uint64_t last_frame;    // value of gl_video.pass_frame when last used
+};
+
 struct fbosurface {
     struct fbotex fbotex;
     uint64_t id;
@@ -165,6 +204,42 @@ struct cached_file {
     struct bstr body;
 };
 
+// Identifies the result of rendering a frame, so that it can be presented
+// again on the following vsyncs if nothing changed.
+struct output_key {
+    uint64_t ids[TEXUNIT_VIDEO_NUM];    // displayed or blended frames
+    double mix;                         // interpolation coefficient, or -1
+    int64_t osd_changes;                // mpgl_get_change_counter()
+};
+
+// Weights LUT texture for a scaler kernel. These are shared by all scalers,
+// and kept across reinit_scaler() calls, so that switching back to a recently
+// used kernel or scale factor (e.g. --scaler-resizes-only toggling between
+// bilinear and the real scaler, or interactive resizing) is free.
+#define SCALER_LUT_CACHE_SIZE 16
+
+struct scaler_lut {
+    struct filter_kernel kernel;    // key: state after mp_init_filter()
+    int lut_size;                   // key
+    GLenum gl_target;
+    GLuint gl_lut;
+    struct fbotex fbo;              // owns gl_lut if it was rendered
+    uint64_t last_use;
+};
+
+// Downscaling scale factors are rounded up to steps of 2^(1/N), so that slow
+// resizes don't create a new LUT for every single output size.
+#define SCALE_FACTOR_BUCKETS 64
+
+// A frame rendered (including the OSD) before it's due for display, see
+// gl_video_render_ahead().
+struct ahead_surface {
+    struct fbotex fbotex;
+    uint64_t id;            // vo_frame.frame_id, 0 if unused
+    double osd_pts;
+    int64_t osd_changes;    // mpgl_get_change_counter() after rendering
+};
+
 struct gl_video {
     GL *gl;
 
@@ -179,6 +254,7 @@ struct gl_video {
     int fb_depth;               // actual bits available in GL main framebuffer
 
     struct gl_shader_cache *sc;
+    struct fbo_pool *fbo_pool;
 
     struct gl_vao vao;
 
@@ -197,6 +273,17 @@ struct gl_video {
     struct gl_timer *render_timer;
     struct gl_timer *present_timer;
 
+    // Per-pass timers. frame_passes/last_passes index pass_info[], and list
+    // the passes of the frame being rendered and the previous frame.
+    struct pass_info pass_info[PASS_INFO_MAX];
+    int num_pass_info;
+    uint64_t pass_frame;
+    char pass_desc[64];     // description of the pass being generated
+    int frame_passes[PASS_INFO_MAX];
+    int num_frame_passes;
+    int last_passes[PASS_INFO_MAX];
+    int num_last_passes;
+
     struct mp_image_params real_image_params;   // configured format
     struct mp_image_params image_params;        // texture format (mind hwdec case)
     struct mp_imgfmt_desc image_desc;
@@ -211,21 +298,35 @@ struct gl_video {
 
     bool dumb_mode;
     bool forced_dumb_mode;
+    bool compute_ok;            // compute shaders can be used for scaling
+    int max_shmem;              // GL_MAX_COMPUTE_SHARED_MEMORY_SIZE
+    GLuint hdr_peak_ssbo;       // state of the HDR peak detection
+    bool lut_gpu_ok;            // --scaler-lut-gpu is enabled and works
+
+    struct scaler_lut scaler_luts[SCALER_LUT_CACHE_SIZE];
+    int num_scaler_luts;
+    uint64_t scaler_lut_uses;
+    struct gl_shader_cache *lut_sc; // for rendering scaler LUTs
 
     struct fbotex merge_fbo[4];
     struct fbotex scale_fbo[4];
-    struct fbotex integer_fbo[4];
+    struct fbotex convert_fbo[4];
     struct fbotex indirect_fbo;
     struct fbotex blend_subs_fbo;
     struct fbotex output_fbo;
+    struct fbotex hdr_peak_fbo;
     struct fbosurface surfaces[FBOSURFACES_MAX];
-    struct fbotex vdpau_deinterleave_fbo[2];
 
     int surface_idx;
     int surface_now;
     int frames_drawn;
     bool is_interpolated;
     bool output_fbo_valid;
+    struct output_key output_key;   // contents of output_fbo
+    struct fbotex pre_osd_fbo;      // last still frame, without OSD
+    bool pre_osd_valid;
+    uint64_t pre_osd_id;
+    struct ahead_surface ahead[VO_MAX_RENDER_AHEAD];
 
     // state for configured scalers
     struct scaler scaler[SCALER_COUNT];
@@ -270,6 +371,12 @@ struct gl_video {
 
     bool dsi_warned;
     bool broken_frame; // temporary error state
+
+    // Direct rendering buffers. The array is only accessed by the GL thread,
+    // but dr_buffer.in_use is cleared by whatever thread frees the image.
+    pthread_mutex_t dr_lock;
+    struct dr_buffer **dr_buffers;
+    int num_dr_buffers;
 };
 
 struct packed_fmt_entry {
@@ -325,6 +432,9 @@ static const struct gl_video_opts gl_video_opts_def = {
     .hdr_tone_mapping = TONE_MAPPING_HABLE,
     .tone_mapping_param = NAN,
     .early_flush = -1,
+    .shader_cache_entries = 48,
+    .fuse_hooks = 1,
+    .compute_hdr_peak = 1,
 };
 
 static int validate_scaler_opt(struct mp_log *log, const m_option_t *opt,
@@ -364,12 +474,14 @@ const struct m_sub_options gl_video_conf = {
                     {"gamma",    TONE_MAPPING_GAMMA},
                     {"linear",   TONE_MAPPING_LINEAR})),
         OPT_FLOAT("tone-mapping-param", tone_mapping_param, 0),
+        OPT_FLAG("hdr-compute-peak", compute_hdr_peak, 0),
         OPT_FLAG("opengl-pbo", pbo, 0),
         SCALER_OPTS("scale",  SCALER_SCALE),
         SCALER_OPTS("dscale", SCALER_DSCALE),
         SCALER_OPTS("cscale", SCALER_CSCALE),
         SCALER_OPTS("tscale", SCALER_TSCALE),
         OPT_INTRANGE("scaler-lut-size", scaler_lut_size, 0, 4, 10),
+        OPT_FLAG("scaler-lut-gpu", scaler_lut_gpu, 0),
         OPT_FLAG("scaler-resizes-only", scaler_resizes_only, 0),
         OPT_FLAG("linear-scaling", linear_scaling, 0),
         OPT_FLAG("correct-downscaling", correct_downscaling, 0),
@@ -412,6 +524,11 @@ const struct m_sub_options gl_video_conf = {
                     {"yes", BLEND_SUBS_YES},
                     {"video", BLEND_SUBS_VIDEO})),
         OPT_STRINGLIST("opengl-shaders", user_shaders, 0),
+        OPT_FLAG("opengl-shaders-fuse", fuse_hooks, 0),
+        OPT_STRING("opengl-shader-cache-dir", shader_cache_dir, 0),
+        OPT_INTRANGE("opengl-shader-cache-entries", shader_cache_entries, 0,
+                     1, 10000),
+        OPT_INTRANGE("opengl-fbo-budget", fbo_budget, 0, 0, 1024 * 1024),
         OPT_FLAG("deband", deband, 0),
         OPT_SUBSTRUCT("deband", deband_opts, deband_conf, 0),
         OPT_FLOAT("sharpen", unsharp, 0),
@@ -439,6 +556,7 @@ static const char *handle_scaler_opt(const char *name, bool tscale);
 static void reinit_from_options(struct gl_video *p);
 static void get_scale_factors(struct gl_video *p, bool transpose_rot, double xy[2]);
 static void gl_video_setup_hooks(struct gl_video *p);
+static void load_shader(struct gl_video *p, struct bstr body);
 
 #define GLSL(x) gl_sc_add(p->sc, #x "\n");
 #define GLSLF(...) gl_sc_addf(p->sc, __VA_ARGS__)
@@ -490,6 +608,9 @@ static void gl_video_reset_surfaces(struct gl_video *p)
     p->surface_now = 0;
     p->frames_drawn = 0;
     p->output_fbo_valid = false;
+    p->pre_osd_valid = false;
+    for (int i = 0; i < VO_MAX_RENDER_AHEAD; i++)
+        p->ahead[i].id = 0;
 }
 
 static void gl_video_reset_hooks(struct gl_video *p)
@@ -518,6 +639,16 @@ static void reinit_osd(struct gl_video *p)
     }
 }
 
+static void uninit_scaler_lut(struct gl_video *p, struct scaler_lut *lut)
+{
+    if (lut->fbo.fbo) {
+        fbotex_uninit(&lut->fbo);
+    } else {
+        p->gl->DeleteTextures(1, &lut->gl_lut);
+    }
+    *lut = (struct scaler_lut){0};
+}
+
 static void uninit_rendering(struct gl_video *p)
 {
     GL *gl = p->gl;
@@ -525,17 +656,30 @@ static void uninit_rendering(struct gl_video *p)
     for (int n = 0; n < SCALER_COUNT; n++)
         uninit_scaler(p, &p->scaler[n]);
 
+    for (int n = 0; n < p->num_scaler_luts; n++)
+        uninit_scaler_lut(p, &p->scaler_luts[n]);
+    p->num_scaler_luts = 0;
+
     gl->DeleteTextures(1, &p->dither_texture);
     p->dither_texture = 0;
 
     for (int n = 0; n < 4; n++) {
         fbotex_uninit(&p->merge_fbo[n]);
         fbotex_uninit(&p->scale_fbo[n]);
-        fbotex_uninit(&p->integer_fbo[n]);
+        fbotex_uninit(&p->convert_fbo[n]);
     }
 
     fbotex_uninit(&p->indirect_fbo);
     fbotex_uninit(&p->blend_subs_fbo);
+    fbotex_uninit(&p->output_fbo);
+    fbotex_uninit(&p->hdr_peak_fbo);
+    fbotex_uninit(&p->pre_osd_fbo);
+
+    gl->DeleteBuffers(1, &p->hdr_peak_ssbo);
+    p->hdr_peak_ssbo = 0;
+
+    for (int n = 0; n < VO_MAX_RENDER_AHEAD; n++)
+        fbotex_uninit(&p->ahead[n].fbotex);
 
     for (int n = 0; n < FBOSURFACES_MAX; n++)
         fbotex_uninit(&p->surfaces[n].fbotex);
@@ -543,9 +687,6 @@ static void uninit_rendering(struct gl_video *p)
     for (int n = 0; n < MAX_SAVED_TEXTURES; n++)
         fbotex_uninit(&p->hook_fbos[n]);
 
-    for (int n = 0; n < 2; n++)
-        fbotex_uninit(&p->vdpau_deinterleave_fbo[n]);
-
     gl_video_reset_surfaces(p);
     gl_video_reset_hooks(p);
 
@@ -590,11 +731,15 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
         return true;
 
     struct lut3d *lut3d = NULL;
-    if (!gl_lcms_get_lut3d(p->cms, &lut3d, prim, trc) || !lut3d) {
+    if (!gl_lcms_get_lut3d(p->cms, &lut3d, prim, trc)) {
         p->use_lut_3d = false;
         return false;
     }
 
+    // Still being generated; render without it until it's done.
+    if (!lut3d)
+        return false;
+
     if (!p->lut_3d_texture)
         gl->GenTextures(1, &p->lut_3d_texture);
 
@@ -736,6 +881,7 @@ static void pass_get_img_tex(struct gl_video *p, struct video_image *vimg,
         tex[n] = (struct img_tex){
             .type = type,
             .gl_tex = t->gl_texture,
+            .gl_tex_field = t->gl_texture_field,
             .gl_target = t->gl_target,
             .multiplier = tex_mul,
             .use_integer = t->use_integer,
@@ -842,6 +988,9 @@ static void init_video(struct gl_video *p)
             gl->TexImage2D(gl_target, 0, plane->gl_internal_format,
                            plane->tex_w, plane->tex_h, 0,
                            plane->gl_format, plane->gl_type, NULL);
+            plane->gl_bytes = (size_t)plane->tex_w * plane->tex_h *
+                gl_bytes_per_pixel(plane->gl_format, plane->gl_type);
+            mp_mem_usage_add(MP_MEM_GPU_TEXTURES, plane->gl_bytes);
 
             int filter = plane->use_integer ? GL_NEAREST : GL_LINEAR;
             gl->TexParameteri(gl_target, GL_TEXTURE_MIN_FILTER, filter);
@@ -898,6 +1047,7 @@ static void uninit_video(struct gl_video *p)
 
         gl->DeleteTextures(1, &plane->gl_texture);
         gl_pbo_upload_uninit(&plane->pbo);
+        mp_mem_usage_add(MP_MEM_GPU_TEXTURES, -(int64_t)plane->gl_bytes);
     }
     *vimg = (struct video_image){0};
 
@@ -940,6 +1090,64 @@ static void pass_prepare_src_tex(struct gl_video *p)
         gl_sc_uniform_mat2(sc, texture_rot, true, (float *)s->transform.m);
         gl_sc_uniform_vec2(sc, pixel_size, (GLfloat[]){1.0f / f[0],
                                                        1.0f / f[1]});
+
+        if (s->gl_tex_field) {
+            assert(s->gl_target == GL_TEXTURE_2D);
+            char texture_field[32];
+            snprintf(texture_field, sizeof(texture_field), "texture_field%d", n);
+            gl_sc_uniform_tex(sc, texture_field, s->gl_target, s->gl_tex_field);
+            // Sample the interleaved frame at pos. The two frame lines around
+            // pos are always in different fields, so bilinear filtering is
+            // done by sampling both fields at a line center (horizontal
+            // filtering only), and mixing the results.
+            gl_sc_haddf(sc,
+                "vec4 texture_fields%d(vec2 pos) {\n"
+                "    float h = texture_size%d.y;\n"
+                "    float y = clamp(pos.y * h - 0.5, 0.0, h - 1.0);\n"
+                "    float line = floor(y);\n"
+                "    float odd = mod(line, 2.0);\n"
+                "    vec4 top = texture(texture%d, vec2(pos.x,\n"
+                "                       (line + odd + 1.0) / h));\n"
+                "    vec4 bottom = texture(texture_field%d, vec2(pos.x,\n"
+                "                          (line - odd + 1.0) / h));\n"
+                "    return mix(top, bottom, abs(odd - (y - line)));\n"
+                "}\n", n, n, n, n);
+        }
+    }
+}
+
+// Compute shaders have no interpolated texcoordN, so define them as function
+// of gl_GlobalInvocationID instead, following the mapping render_pass_quad()
+// uses for a w*h target rectangle at 0/0. texmapN() maps any invocation ID.
+static void pass_prepare_compute_tex(struct gl_video *p, int w, int h)
+{
+    struct gl_shader_cache *sc = p->sc;
+
+    for (int n = 0; n < p->pass_tex_num; n++) {
+        struct img_tex *s = &p->pass_tex[n];
+        if (!s->gl_tex)
+            continue;
+
+        char texcoord_base[32];
+        char texcoord_mat[32];
+        snprintf(texcoord_base, sizeof(texcoord_base), "texcoord_base%d", n);
+        snprintf(texcoord_mat, sizeof(texcoord_mat), "texcoord_mat%d", n);
+
+        bool rect = s->gl_target == GL_TEXTURE_RECTANGLE;
+        float tw = rect ? 1 : s->tex_w, th = rect ? 1 : s->tex_h;
+        float sx = s->w / (float)w, sy = s->h / (float)h;
+        const struct gl_transform *t = &s->transform;
+        float m[2][2] = {
+            {t->m[0][0] * sx / tw, t->m[0][1] * sy / tw},
+            {t->m[1][0] * sx / th, t->m[1][1] * sy / th},
+        };
+        gl_sc_uniform_vec2(sc, texcoord_base, (GLfloat[]){t->t[0] / tw,
+                                                          t->t[1] / th});
+        gl_sc_uniform_mat2(sc, texcoord_mat, true, &m[0][0]);
+        gl_sc_haddf(sc, "#define texmap%d(id) (texcoord_base%d + "
+                    "texcoord_mat%d * (vec2(id) + vec2(0.5)))\n", n, n, n);
+        gl_sc_haddf(sc, "#define texcoord%d texmap%d(gl_GlobalInvocationID.xy)\n",
+                    n, n);
     }
 }
 
@@ -980,18 +1188,122 @@ static void render_pass_quad(struct gl_video *p, int vp_w, int vp_h,
     debug_check_gl(p, "after rendering");
 }
 
+// Set the description of the pass currently being generated, which is used
+// to report per-pass timings. If several parts of the shader set one, the
+// first wins (mostly, this is the operation that started the pass).
+PRINTF_ATTRIBUTE(2, 3)
+static void pass_describe(struct gl_video *p, const char *textf, ...)
+{
+    if (p->pass_desc[0])
+        return;
+    va_list ap;
+    va_start(ap, textf);
+    vsnprintf(p->pass_desc, sizeof(p->pass_desc), textf, ap);
+    va_end(ap);
+}
+
+static void pass_info_new_frame(struct gl_video *p)
+{
+    if (p->num_frame_passes) {
+        memcpy(p->last_passes, p->frame_passes,
+               p->num_frame_passes * sizeof(p->frame_passes[0]));
+        p->num_last_passes = p->num_frame_passes;
+    }
+    p->num_frame_passes = 0;
+    p->pass_frame++;
+}
+
+// Return the timer for the current pass (matched by description), or NULL if
+// too many passes are in use.
+static struct pass_info *pass_info_get(struct gl_video *p)
+{
+    const char *desc = p->pass_desc[0] ? p->pass_desc : "(unnamed)";
+    if (p->num_frame_passes == PASS_INFO_MAX)
+        return NULL;
+
+    // A description can occur multiple times per frame; each occurrence is
+    // timed separately.
+    int found = -1, oldest = -1;
+    for (int n = 0; n < p->num_pass_info; n++) {
+        struct pass_info *pass = &p->pass_info[n];
+        if (pass->last_frame == p->pass_frame)
+            continue;
+        if (strcmp(pass->desc, desc) == 0) {
+            found = n;
+            break;
+        }
+        if (oldest < 0 || pass->last_frame < p->pass_info[oldest].last_frame)
+            oldest = n;
+    }
+
+    if (found < 0) {
+        if (p->num_pass_info < PASS_INFO_MAX) {
+            found = p->num_pass_info++;
+            p->pass_info[found].timer = gl_timer_create_ts(p->gl);
+        } else if (oldest >= 0) {
+            // Reuse the timer of a pass that hasn't been seen in a while.
+            found = oldest;
+            gl_timer_free(p->pass_info[found].timer);
+            p->pass_info[found].timer = gl_timer_create_ts(p->gl);
+        } else {
+            return NULL;
+        }
+        snprintf(p->pass_info[found].desc, sizeof(p->pass_info[found].desc),
+                 "%s", desc);
+    }
+
+    struct pass_info *pass = &p->pass_info[found];
+    pass->last_frame = p->pass_frame;
+    p->frame_passes[p->num_frame_passes++] = found;
+    return pass;
+}
+
 static void finish_pass_direct(struct gl_video *p, GLint fbo, int vp_w, int vp_h,
                                const struct mp_rect *dst)
 {
     GL *gl = p->gl;
+    struct pass_info *pass = pass_info_get(p);
+    if (pass)
+        gl_timer_start(pass->timer);
     pass_prepare_src_tex(p);
     gl_sc_generate(p->sc);
     gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
     render_pass_quad(p, vp_w, vp_h, dst);
     gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
     gl_sc_reset(p->sc);
+    if (pass)
+        gl_timer_stop(pass->timer);
+    memset(&p->pass_tex, 0, sizeof(p->pass_tex));
+    p->pass_tex_num = 0;
+    p->pass_desc[0] = '\0';
+}
+
+// Like finish_pass_fbo(), but run the pass as compute shader with a bw*bh
+// work group size. The pass must not use anything that requires a fragment
+// shader (like gl_FragCoord).
+static void finish_pass_compute(struct gl_video *p, struct fbotex *dst_fbo,
+                                int w, int h, int bw, int bh)
+{
+    GL *gl = p->gl;
+
+    fbo_pool_change(p->fbo_pool, dst_fbo, w, h, p->opts.fbo_format, 0);
+
+    struct pass_info *pass = pass_info_get(p);
+    if (pass)
+        gl_timer_start(pass->timer);
+    pass_prepare_src_tex(p);
+    pass_prepare_compute_tex(p, w, h);
+    gl_sc_set_compute(p->sc, bw, bh, dst_fbo->texture, dst_fbo->iformat);
+    gl_sc_generate(p->sc);
+    gl->DispatchCompute((w + bw - 1) / bw, (h + bh - 1) / bh, 1);
+    // The result is read by the following passes with texture fetches.
+    gl->MemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    gl_sc_reset(p->sc);
+    if (pass)
+        gl_timer_stop(pass->timer);
     memset(&p->pass_tex, 0, sizeof(p->pass_tex));
     p->pass_tex_num = 0;
+    p->pass_desc[0] = '\0';
 }
 
 // dst_fbo: this will be used for rendering; possibly reallocating the whole
@@ -1003,7 +1315,7 @@ static void finish_pass_direct(struct gl_video *p, GLint fbo, int vp_w, int vp_h
 static void finish_pass_fbo(struct gl_video *p, struct fbotex *dst_fbo,
                             int w, int h, int flags)
 {
-    fbotex_change(dst_fbo, p->gl, p->log, w, h, p->opts.fbo_format, flags);
+    fbo_pool_change(p->fbo_pool, dst_fbo, w, h, p->opts.fbo_format, flags);
 
     finish_pass_direct(p, dst_fbo->fbo, dst_fbo->rw, dst_fbo->rh,
                        &(struct mp_rect){0, 0, w, h});
@@ -1031,8 +1343,13 @@ static void copy_img_tex(struct gl_video *p, int *offset, struct img_tex img)
         img.multiplier *= 1.0 / (tex_max - 1);
     }
 
-    GLSLF("color.%s = %f * vec4(texture(texture%d, texcoord%d)).%s;\n",
-          dst, img.multiplier, id, id, src);
+    if (img.gl_tex_field) {
+        GLSLF("color.%s = %f * vec4(texture_fields%d(texcoord%d)).%s;\n",
+              dst, img.multiplier, id, id, src);
+    } else {
+        GLSLF("color.%s = %f * vec4(texture(texture%d, texcoord%d)).%s;\n",
+              dst, img.multiplier, id, id, src);
+    }
 
     *offset += count;
 }
@@ -1045,10 +1362,8 @@ static void skip_unused(struct gl_video *p, int num_components)
 
 static void uninit_scaler(struct gl_video *p, struct scaler *scaler)
 {
-    GL *gl = p->gl;
     fbotex_uninit(&scaler->sep_fbo);
-    gl->DeleteTextures(1, &scaler->gl_lut);
-    scaler->gl_lut = 0;
+    scaler->gl_lut = 0; // owned by p->scaler_luts
     scaler->kernel = NULL;
     scaler->initialized = false;
 }
@@ -1113,6 +1428,54 @@ static void saved_tex_store(struct gl_video *p, const char *name,
     };
 }
 
+// Find the hooks following tex_hooks[first] on the same texture, which can be
+// run in the same shader, and store their indexes (including first) in out[].
+// Returns the number of hooks found.
+static int find_fused_hooks(struct gl_video *p, int first, const char *name,
+                            struct img_tex tex, int out[MAX_TEXTURE_HOOKS])
+{
+    int num = 0;
+    out[num++] = first;
+    if (!p->opts.fuse_hooks || !p->tex_hooks[first].pointwise)
+        return num;
+
+    for (int i = first + 1; i < p->tex_hook_num; i++) {
+        struct tex_hook *hook = &p->tex_hooks[i];
+        if (strcmp(hook->hook_tex, name) != 0)
+            continue;
+        if (hook->cond && !hook->cond(p, tex, hook->priv))
+            continue;
+        if (!hook->pointwise)
+            break;
+        out[num++] = i;
+    }
+    return num;
+}
+
+// Generate a single shader for the given pointwise user hooks (see
+// user_shader_is_pointwise()). HOOKED must be bound already. Each pass body
+// is renamed to hookN(), and after the first pass, HOOKED_tex() returns the
+// output of the previous pass instead of sampling the texture.
+static void fused_user_hooks(struct gl_video *p, struct img_tex tex,
+                             int *hooks, int num)
+{
+    GLSLHF("vec4 hook_color;\n");
+    for (int n = 0; n < num; n++) {
+        struct gl_user_shader *shader = p->tex_hooks[hooks[n]].priv;
+        if (n > 0) {
+            GLSLHF("#undef HOOKED_tex\n");
+            GLSLHF("#define HOOKED_tex(pos) hook_color\n");
+            GLSLF("hook_color = color;\n");
+        }
+        GLSLHF("#define hook hook%d\n", n);
+        load_shader(p, shader->pass_body);
+        GLSLHF("#undef hook\n");
+        GLSLF("// custom hook %d\n", n);
+        GLSLF("color = hook%d();\n", n);
+        skip_unused(p, tex.components);
+    }
+}
+
 // Process hooks for a plane, saving the result and returning a new img_tex
 // If 'trans' is NULL, the shader is forbidden from transforming tex
 static struct img_tex pass_hook(struct gl_video *p, const char *name,
@@ -1163,10 +1526,21 @@ static struct img_tex pass_hook(struct gl_video *p, const char *name,
             hook_prelude(p, bind_name, pass_bind(p, bind_tex), bind_tex);
         }
 
+        const char *store_name = hook->save_tex ? hook->save_tex : name;
+
         // Run the actual hook. This generates a series of GLSL shader
         // instructions sufficient for drawing the hook's output
         struct gl_transform hook_off = identity_trans;
-        hook->hook(p, tex, &hook_off, hook->priv);
+        int fused[MAX_TEXTURE_HOOKS];
+        int num_fused = find_fused_hooks(p, i, name, tex, fused);
+        if (num_fused > 1) {
+            pass_describe(p, "hook %s (%d passes fused)", name, num_fused);
+            fused_user_hooks(p, tex, fused, num_fused);
+            i = fused[num_fused - 1];
+        } else {
+            pass_describe(p, "hook %s -> %s", name, store_name);
+            hook->hook(p, tex, &hook_off, hook->priv);
+        }
 
         int comps = hook->components ? hook->components : tex.components;
         skip_unused(p, comps);
@@ -1181,7 +1555,6 @@ static struct img_tex pass_hook(struct gl_video *p, const char *name,
         struct fbotex *fbo = &p->hook_fbos[p->hook_fbo_num++];
         finish_pass_fbo(p, fbo, w, h, 0);
 
-        const char *store_name = hook->save_tex ? hook->save_tex : name;
         struct img_tex saved_tex = img_tex_fbo(fbo, tex.type, comps);
 
         // If the texture we're saving overwrites the "current" texture, also
@@ -1236,6 +1609,7 @@ static void pass_opt_hook_point(struct gl_video *p, const char *name,
 found:
     assert(p->hook_fbo_num < MAX_SAVED_TEXTURES);
     struct fbotex *fbo = &p->hook_fbos[p->hook_fbo_num++];
+    pass_describe(p, "before hook point %s", name);
     finish_pass_fbo(p, fbo, p->texture_w, p->texture_h, 0);
 
     struct img_tex img = img_tex_fbo(fbo, PLANE_RGB, p->components);
@@ -1286,12 +1660,183 @@ static bool scaler_conf_eq(struct scaler_config a, struct scaler_config b)
            a.clamp == b.clamp;
 }
 
+static bool double_eq(double a, double b)
+{
+    return a == b || (isnan(a) && isnan(b));
+}
+
+static bool filter_window_eq(const struct filter_window *a,
+                             const struct filter_window *b)
+{
+    return a->weight == b->weight &&
+           double_eq(a->radius, b->radius) &&
+           double_eq(a->params[0], b->params[0]) &&
+           double_eq(a->params[1], b->params[1]) &&
+           double_eq(a->blur, b->blur) &&
+           double_eq(a->taper, b->taper);
+}
+
+static bool scaler_lut_eq(const struct scaler_lut *lut,
+                          const struct filter_kernel *k, int lut_size)
+{
+    const struct filter_kernel *a = &lut->kernel;
+    return lut->lut_size == lut_size &&
+           filter_window_eq(&a->f, &k->f) &&
+           filter_window_eq(&a->w, &k->w) &&
+           a->clamp == k->clamp &&
+           a->polar == k->polar &&
+           a->size == k->size &&
+           double_eq(a->inv_scale, k->inv_scale);
+}
+
+// Render the LUT with pass_gen_scaler_lut(). Returns false if the kernel is
+// not supported, or on errors.
+static bool render_scaler_lut(struct gl_video *p, struct scaler_lut *lut,
+                              int width, int elems)
+{
+    GL *gl = p->gl;
+
+    if (!p->lut_sc)
+        p->lut_sc = gl_sc_create(gl, p->log);
+
+    if (!pass_gen_scaler_lut(p->lut_sc, &lut->kernel, lut->lut_size, elems)) {
+        gl_sc_reset(p->lut_sc);
+        return false;
+    }
+
+    if (!fbotex_init(&lut->fbo, gl, p->log, width, lut->lut_size, GL_RGBA16F)) {
+        gl_sc_reset(p->lut_sc);
+        return false;
+    }
+
+    struct vertex va[4] = {0};
+    for (int n = 0; n < 4; n++) {
+        va[n].position.x = n / 2 ? 1.0 : -1.0;
+        va[n].position.y = n % 2 ? 1.0 : -1.0;
+    }
+
+    gl_sc_set_vao(p->lut_sc, &p->vao);
+    gl_sc_generate(p->lut_sc);
+    gl->BindFramebuffer(GL_FRAMEBUFFER, lut->fbo.fbo);
+    gl->Viewport(0, 0, width, lut->lut_size);
+    gl_vao_draw_data(&p->vao, GL_TRIANGLE_STRIP, va, 4);
+    gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_sc_reset(p->lut_sc);
+
+    lut->gl_lut = lut->fbo.texture;
+    lut->gl_target = GL_TEXTURE_2D;
+    return true;
+}
+
+static void upload_scaler_lut(struct gl_video *p, struct scaler_lut *lut,
+                              int width, int elems)
+{
+    GL *gl = p->gl;
+
+    if (lut->kernel.polar && (gl->mpgl_caps & MPGL_CAP_1D_TEX)) {
+        lut->gl_target = GL_TEXTURE_1D;
+    } else {
+        lut->gl_target = GL_TEXTURE_2D;
+    }
+
+    const struct gl_format *fmt = gl_find_float16_format(gl, elems);
+    GLenum target = lut->gl_target;
+
+    gl->GenTextures(1, &lut->gl_lut);
+    gl->BindTexture(target, lut->gl_lut);
+
+    float *weights = talloc_array(NULL, float, lut->lut_size * lut->kernel.size);
+    mp_compute_lut(&lut->kernel, lut->lut_size, weights);
+
+    if (target == GL_TEXTURE_1D) {
+        gl->TexImage1D(target, 0, fmt->internal_format, lut->lut_size,
+                       0, fmt->format, GL_FLOAT, weights);
+    } else {
+        gl->TexImage2D(target, 0, fmt->internal_format, width, lut->lut_size,
+                       0, fmt->format, GL_FLOAT, weights);
+    }
+
+    talloc_free(weights);
+
+    gl->TexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    gl->TexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    gl->TexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    if (target != GL_TEXTURE_1D)
+        gl->TexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    gl->BindTexture(target, 0);
+}
+
+// Return a free cache slot, evicting the least recently used LUT that is not
+// referenced by any scaler if necessary.
+static struct scaler_lut *alloc_scaler_lut(struct gl_video *p)
+{
+    if (p->num_scaler_luts < SCALER_LUT_CACHE_SIZE)
+        return &p->scaler_luts[p->num_scaler_luts++];
+
+    struct scaler_lut *oldest = NULL;
+    for (int n = 0; n < p->num_scaler_luts; n++) {
+        struct scaler_lut *lut = &p->scaler_luts[n];
+        bool in_use = false;
+        for (int i = 0; i < SCALER_COUNT; i++)
+            in_use |= p->scaler[i].gl_lut == lut->gl_lut;
+        if (!in_use && (!oldest || lut->last_use < oldest->last_use))
+            oldest = lut;
+    }
+    assert(oldest); // there are more slots than scalers
+    uninit_scaler_lut(p, oldest);
+    return oldest;
+}
+
+static struct scaler_lut *get_scaler_lut(struct gl_video *p,
+                                         struct filter_kernel *kernel,
+                                         int lut_size)
+{
+    for (int n = 0; n < p->num_scaler_luts; n++) {
+        struct scaler_lut *lut = &p->scaler_luts[n];
+        if (scaler_lut_eq(lut, kernel, lut_size)) {
+            lut->last_use = ++p->scaler_lut_uses;
+            return lut;
+        }
+    }
+
+    struct scaler_lut *lut = alloc_scaler_lut(p);
+    *lut = (struct scaler_lut){
+        .kernel = *kernel,
+        .lut_size = lut_size,
+        .last_use = ++p->scaler_lut_uses,
+    };
+
+    int size = kernel->size;
+    int elems_per_pixel = 4;
+    if (size == 1) {
+        elems_per_pixel = 1;
+    } else if (size == 2) {
+        elems_per_pixel = 2;
+    } else if (size == 6) {
+        elems_per_pixel = 3;
+    }
+    int width = size / elems_per_pixel;
+    assert(size == width * elems_per_pixel);
+
+    if (!p->lut_gpu_ok || !render_scaler_lut(p, lut, width, elems_per_pixel))
+        upload_scaler_lut(p, lut, width, elems_per_pixel);
+
+    return lut;
+}
+
 static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
                           const struct scaler_config *conf,
                           double scale_factor,
                           int sizes[])
 {
-    GL *gl = p->gl;
+    // Values <= 1.0 are all equivalent for mp_init_filter().
+    if (scale_factor <= 1.0) {
+        scale_factor = 1.0;
+    } else {
+        scale_factor = exp2(ceil(log2(scale_factor) * SCALE_FACTOR_BUCKETS)
+                            / SCALE_FACTOR_BUCKETS);
+    }
 
     if (scaler_conf_eq(scaler->conf, *conf) &&
         scaler->scale_factor == scale_factor &&
@@ -1346,53 +1891,11 @@ static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
 
     scaler->insufficient = !mp_init_filter(scaler->kernel, sizes, scale_factor);
 
-    if (scaler->kernel->polar && (gl->mpgl_caps & MPGL_CAP_1D_TEX)) {
-        scaler->gl_target = GL_TEXTURE_1D;
-    } else {
-        scaler->gl_target = GL_TEXTURE_2D;
-    }
-
-    int size = scaler->kernel->size;
-    int elems_per_pixel = 4;
-    if (size == 1) {
-        elems_per_pixel = 1;
-    } else if (size == 2) {
-        elems_per_pixel = 2;
-    } else if (size == 6) {
-        elems_per_pixel = 3;
-    }
-    int width = size / elems_per_pixel;
-    assert(size == width * elems_per_pixel);
-    const struct gl_format *fmt = gl_find_float16_format(gl, elems_per_pixel);
-    GLenum target = scaler->gl_target;
-
-    if (!scaler->gl_lut)
-        gl->GenTextures(1, &scaler->gl_lut);
-
-    gl->BindTexture(target, scaler->gl_lut);
-
     scaler->lut_size = 1 << p->opts.scaler_lut_size;
 
-    float *weights = talloc_array(NULL, float, scaler->lut_size * size);
-    mp_compute_lut(scaler->kernel, scaler->lut_size, weights);
-
-    if (target == GL_TEXTURE_1D) {
-        gl->TexImage1D(target, 0, fmt->internal_format, scaler->lut_size,
-                       0, fmt->format, GL_FLOAT, weights);
-    } else {
-        gl->TexImage2D(target, 0, fmt->internal_format, width, scaler->lut_size,
-                       0, fmt->format, GL_FLOAT, weights);
-    }
-
-    talloc_free(weights);
-
-    gl->TexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    gl->TexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    gl->TexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    if (target != GL_TEXTURE_1D)
-        gl->TexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    gl->BindTexture(target, 0);
+    struct scaler_lut *lut = get_scaler_lut(p, scaler->kernel, scaler->lut_size);
+    scaler->gl_lut = lut->gl_lut;
+    scaler->gl_target = lut->gl_target;
 
     debug_check_gl(p, "after initializing scaler");
 }
@@ -1417,7 +1920,11 @@ static void pass_sample_separated(struct gl_video *p, struct img_tex src,
     GLSLF("// pass 1\n");
     pass_sample_separated_gen(p->sc, scaler, 0, 1);
     GLSLF("color *= %f;\n", src.multiplier);
+    pass_describe(p, "%s=%s (vertical)", scaler_unit_names[scaler->index],
+                  scaler->conf.kernel.name);
     finish_pass_fbo(p, &scaler->sep_fbo, src.w, h, FBOTEX_FUZZY_H);
+    pass_describe(p, "%s=%s (horizontal)", scaler_unit_names[scaler->index],
+                  scaler->conf.kernel.name);
 
     // Second pass (scale only in the x dir)
     src = img_tex_fbo(&scaler->sep_fbo, src.type, src.components);
@@ -1433,6 +1940,45 @@ static void pass_sample_separated(struct gl_video *p, struct img_tex src,
 // This will write the scaled contents to the vec4 "color".
 // The scaler unit is initialized by this function; in order to avoid cache
 // thrashing, the scaler unit should usually use the same parameters.
+// Work group size used for compute shader scaling.
+#define COMPUTE_BW 32
+#define COMPUTE_BH 8
+
+// Run a polar scaler as compute shader, which renders into scaler->sep_fbo,
+// and then read back the result into the current (fragment shader) pass.
+// tex must be bound as texture id with sampler_prelude() already. Returns
+// false if it's not possible (the caller has to use pass_sample_polar()).
+static bool pass_sample_polar_compute(struct gl_video *p, struct scaler *scaler,
+                                      struct img_tex tex, int id, int w, int h)
+{
+    if (!p->compute_ok)
+        return false;
+
+    // The shared memory block is assumed to be an axis aligned rectangle,
+    // growing in the same direction as the output.
+    const struct gl_transform *t = &tex.transform;
+    if (t->m[0][1] != 0 || t->m[1][0] != 0 || t->m[0][0] <= 0 || t->m[1][1] <= 0)
+        return false;
+
+    // source texels per output pixel
+    double ratio_x = t->m[0][0] * tex.w / w;
+    double ratio_y = t->m[1][1] * tex.h / h;
+    int bound = (int)ceil(scaler->kernel->f.radius);
+    int iw = (int)ceil(COMPUTE_BW * ratio_x) + 2 * bound + 1;
+    int ih = (int)ceil(COMPUTE_BH * ratio_y) + 2 * bound + 1;
+    if (iw * ih * tex.components * (int)sizeof(float) > p->max_shmem)
+        return false;
+
+    GLSLF("vec2 wpos = texmap%d(gl_WorkGroupID.xy * gl_WorkGroupSize.xy);\n", id);
+    pass_compute_polar(p->sc, scaler, tex.components, COMPUTE_BW, COMPUTE_BH,
+                       iw, ih);
+    finish_pass_compute(p, &scaler->sep_fbo, w, h, COMPUTE_BW, COMPUTE_BH);
+
+    copy_img_tex(p, &(int){0},
+                 img_tex_fbo(&scaler->sep_fbo, tex.type, tex.components));
+    return true;
+}
+
 static void pass_sample(struct gl_video *p, struct img_tex tex,
                         struct scaler *scaler, const struct scaler_config *conf,
                         double scale_factor, int w, int h)
@@ -1443,11 +1989,16 @@ static void pass_sample(struct gl_video *p, struct img_tex tex,
 
     // Set up the transformation+prelude and bind the texture, for everything
     // other than separated scaling (which does this in the subfunction)
-    if (!is_separated)
-        sampler_prelude(p->sc, pass_bind(p, tex));
+    int id = -1;
+    if (!is_separated) {
+        id = pass_bind(p, tex);
+        sampler_prelude(p->sc, id);
+    }
 
     // Dispatch the scaler. They're all wildly different.
     const char *name = scaler->conf.kernel.name;
+    if (!is_separated)
+        pass_describe(p, "%s=%s", scaler_unit_names[scaler->index], name);
     if (strcmp(name, "bilinear") == 0) {
         GLSL(color = texture(tex, pos);)
     } else if (strcmp(name, "bicubic_fast") == 0) {
@@ -1455,7 +2006,8 @@ static void pass_sample(struct gl_video *p, struct img_tex tex,
     } else if (strcmp(name, "oversample") == 0) {
         pass_sample_oversample(p->sc, scaler, w, h);
     } else if (scaler->kernel && scaler->kernel->polar) {
-        pass_sample_polar(p->sc, scaler);
+        if (!pass_sample_polar_compute(p, scaler, tex, id, w, h))
+            pass_sample_polar(p->sc, scaler);
     } else if (scaler->kernel) {
         pass_sample_separated(p, tex, scaler, w, h);
     } else {
@@ -1472,6 +2024,16 @@ static void pass_sample(struct gl_video *p, struct img_tex tex,
     skip_unused(p, tex.components);
 }
 
+// Copy a plane to a normal texture, for planes that can't be sampled directly
+// by hooks and scalers (integer textures and separate field textures).
+static struct img_tex pass_convert_plane(struct gl_video *p, struct img_tex tex,
+                                         int n)
+{
+    copy_img_tex(p, &(int){0}, tex);
+    finish_pass_fbo(p, &p->convert_fbo[n], tex.w, tex.h, 0);
+    return img_tex_fbo(&p->convert_fbo[n], tex.type, tex.components);
+}
+
 // Returns true if two img_texs are semantically equivalent (same metadata)
 static bool img_tex_equiv(struct img_tex a, struct img_tex b)
 {
@@ -1627,6 +2189,7 @@ static void pass_hook_user_shaders(struct gl_video *p, char **shaders)
                 struct gl_user_shader *out_copy = talloc_ptrtype(p, out_copy);
                 *out_copy = out;
                 hook.priv = out_copy;
+                hook.pointwise = user_shader_is_pointwise(&out);
                 for (int o = 0; o < SHADER_MAX_BINDS; o++)
                     hook.bind_tex[o] = bstrdup0(p, out.bind_tex[o]);
                 hook.save_tex = bstrdup0(p, out.save_tex),
@@ -1691,6 +2254,7 @@ static void pass_read_video(struct gl_video *p)
 
         if (num > 0) {
             GLSLF("// merging plane %d ... into %d\n", n, first);
+            pass_describe(p, "merging planes into %d", first);
             copy_img_tex(p, &num, tex[n]);
             finish_pass_fbo(p, &p->merge_fbo[n], tex[n].w, tex[n].h, 0);
             tex[first] = img_tex_fbo(&p->merge_fbo[n], tex[n].type, num);
@@ -1699,15 +2263,17 @@ static void pass_read_video(struct gl_video *p)
     }
 
     // If any textures are still in integer format by this point, we need
-    // to introduce an explicit conversion pass to avoid breaking hooks/scaling
+    // to introduce an explicit conversion pass to avoid breaking hooks/scaling.
+    // The same goes for separate field textures if any hooks are active.
     for (int n = 0; n < 4; n++) {
         if (tex[n].use_integer) {
             GLSLF("// use_integer fix for plane %d\n", n);
-
-            copy_img_tex(p, &(int){0}, tex[n]);
-            finish_pass_fbo(p, &p->integer_fbo[n], tex[n].w, tex[n].h, 0);
-            tex[n] = img_tex_fbo(&p->integer_fbo[n], tex[n].type,
-                                 tex[n].components);
+            pass_describe(p, "integer conversion of plane %d", n);
+            tex[n] = pass_convert_plane(p, tex[n], n);
+        } else if (tex[n].gl_tex_field && p->tex_hook_num) {
+            GLSLF("// field interleaving for plane %d\n", n);
+            pass_describe(p, "field interleaving of plane %d", n);
+            tex[n] = pass_convert_plane(p, tex[n], n);
         }
     }
 
@@ -1767,6 +2333,17 @@ static void pass_read_video(struct gl_video *p)
         if (mp_rect_f_seq(ref, rect))
             continue;
 
+        // Field textures are sampled with bilinear filtering by
+        // copy_img_tex(), but any other scaler needs an interleaved copy.
+        if (tex[n].gl_tex_field && tex[n].type != PLANE_ALPHA) {
+            int id = tex[n].type == PLANE_CHROMA ? SCALER_CSCALE : SCALER_SCALE;
+            if (strcmp(p->opts.scaler[id].kernel.name, "bilinear") != 0) {
+                GLSLF("// field interleaving for plane %d\n", n);
+                pass_describe(p, "field interleaving of plane %d", n);
+                tex[n] = pass_convert_plane(p, tex[n], n);
+            }
+        }
+
         // If the rectangles differ, then our planes have a different
         // alignment and/or size. First of all, we have to compute the
         // corrections required to meet the target rectangle
@@ -1874,6 +2451,7 @@ static void pass_convert_yuv(struct gl_video *p)
     p->user_gamma = 1.0 / (cparams.gamma * p->opts.gamma);
 
     GLSLF("// color conversion\n");
+    pass_describe(p, "color conversion");
 
     if (p->color_swizzle[0])
         GLSLF("color = color.%s;\n", p->color_swizzle);
@@ -2050,6 +2628,38 @@ static void pass_scale_main(struct gl_video *p)
     }
 }
 
+// Work group size used for the HDR peak detection.
+#define HDR_PEAK_BW 16
+#define HDR_PEAK_BH 16
+
+// Return whether the HDR peak detection can be used, and if so, declare its
+// state buffer for the current pass (which must become a compute shader).
+static bool hdr_peak_init(struct gl_video *p)
+{
+    GL *gl = p->gl;
+
+    if (!p->opts.compute_hdr_peak || !p->compute_ok)
+        return false;
+
+    if (!p->hdr_peak_ssbo) {
+        // All fields start out as 0, which means "no previous frames".
+        uint32_t state[5] = {0};
+        gl->GenBuffers(1, &p->hdr_peak_ssbo);
+        gl->BindBuffer(GL_SHADER_STORAGE_BUFFER, p->hdr_peak_ssbo);
+        gl->BufferData(GL_SHADER_STORAGE_BUFFER, sizeof(state), state,
+                       GL_DYNAMIC_COPY);
+        gl->BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    gl_sc_ssbo(p->sc, "hdr_peak", p->hdr_peak_ssbo,
+               "uint counter;\n"
+               "uint frame_max;\n"
+               "int frame_sum;\n"
+               "float peak;\n"
+               "float avg;\n");
+    return true;
+}
+
 // Adapts the colors to the right output color space. (Final pass during
 // rendering)
 // If OSD is true, ignore any changes that may have been made to the video
@@ -2069,6 +2679,7 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         .nom_peak = mp_csp_trc_nom_peak(p->opts.target_trc, p->opts.target_brightness),
     };
 
+    bool use_lut_3d = false;
     if (p->use_lut_3d) {
         // The 3DLUT is always generated against the video's original source
         // space, *not* the reference space. (To avoid having to regenerate
@@ -2090,6 +2701,7 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         if (gl_video_get_lut3d(p, prim_orig, trc_orig)) {
             dst.primaries = prim_orig;
             dst.gamma = trc_orig;
+            use_lut_3d = true;
         }
     }
 
@@ -2145,11 +2757,25 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
     MP_DBG(p, "HDR src nom: %f sig: %f, dst: %f\n",
            src.nom_peak, src.sig_peak, dst.nom_peak);
 
+    // Measuring the signal peak requires running the color mapping as compute
+    // shader, which renders to an intermediate FBO. The rest of the pass is
+    // continued as usual by reading it back.
+    bool detect_peak = !osd && src.sig_peak > dst.nom_peak && hdr_peak_init(p);
+
     // Adapt from src to dst as necessary
     pass_color_map(p->sc, src, dst, p->opts.hdr_tone_mapping,
-                   p->opts.tone_mapping_param);
+                   p->opts.tone_mapping_param, detect_peak);
+
+    if (detect_peak) {
+        int w = p->dst_rect.x1 - p->dst_rect.x0,
+            h = p->dst_rect.y1 - p->dst_rect.y0;
+        finish_pass_compute(p, &p->hdr_peak_fbo, w, h, HDR_PEAK_BW, HDR_PEAK_BH);
+        // The next frame's peak detection reads the updated state.
+        p->gl->MemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        copy_img_tex(p, &(int){0}, img_tex_fbo(&p->hdr_peak_fbo, PLANE_RGB, 4));
+    }
 
-    if (p->use_lut_3d) {
+    if (use_lut_3d) {
         gl_sc_uniform_tex(p->sc, "lut_3d", GL_TEXTURE_3D, p->lut_3d_texture);
         GLSL(vec3 cpos;)
         for (int i = 0; i < 3; i++)
@@ -2158,6 +2784,59 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
     }
 }
 
+// Set p->last_dither_matrix to the fruit dither matrix of size 2^sizeb. It's
+// always the same for a given size, so with --opengl-shader-cache-dir, it's
+// stored there to avoid generating it again.
+static void make_fruit_dither_matrix(struct gl_video *p, int sizeb)
+{
+    int size = 1 << sizeb;
+    size_t bytes = size * sizeof(float) * size;
+
+    p->last_dither_matrix = talloc_realloc(p, p->last_dither_matrix,
+                                           float, size * size);
+    p->last_dither_matrix_size = size;
+
+    void *tmp = talloc_new(NULL);
+    char *cache_file = NULL;
+    if (p->opts.shader_cache_dir && p->opts.shader_cache_dir[0]) {
+        char *dir = mp_get_user_path(tmp, p->global, p->opts.shader_cache_dir);
+        char *name = talloc_asprintf(tmp, "dither-fruit-%d", sizeb);
+        cache_file = mp_path_join(tmp, dir, name);
+
+        struct bstr data = {0};
+        if (stat(cache_file, &(struct stat){0}) == 0)
+            data = stream_read_file(cache_file, tmp, p->global, bytes + 1);
+        if (data.len == bytes) {
+            memcpy(p->last_dither_matrix, data.start, bytes);
+            bool ok = true;
+            for (int n = 0; n < size * size; n++) {
+                float v = p->last_dither_matrix[n];
+                ok &= v >= 0 && v <= 1;
+            }
+            if (ok) {
+                MP_VERBOSE(p, "Loaded dither matrix from '%s'.\n", cache_file);
+                goto done;
+            }
+        }
+    }
+
+    mp_make_fruit_dither_matrix(p->last_dither_matrix, sizeb);
+
+    if (cache_file) {
+        mp_mkdirp(mp_get_user_path(tmp, p->global, p->opts.shader_cache_dir));
+        FILE *out = fopen(cache_file, "wb");
+        if (out) {
+            bool ok = fwrite(p->last_dither_matrix, bytes, 1, out) == 1;
+            // Don't leave truncated files around.
+            if (fclose(out) != 0 || !ok)
+                unlink(cache_file);
+        }
+    }
+
+done:
+    talloc_free(tmp);
+}
+
 static void pass_dither(struct gl_video *p)
 {
     GL *gl = p->gl;
@@ -2184,12 +2863,8 @@ static void pass_dither(struct gl_video *p)
             int sizeb = p->opts.dither_size;
             int size = 1 << sizeb;
 
-            if (p->last_dither_matrix_size != size) {
-                p->last_dither_matrix = talloc_realloc(p, p->last_dither_matrix,
-                                                       float, size * size);
-                mp_make_fruit_dither_matrix(p->last_dither_matrix, sizeb);
-                p->last_dither_matrix_size = size;
-            }
+            if (p->last_dither_matrix_size != size)
+                make_fruit_dither_matrix(p, sizeb);
 
             // Prefer R16 texture since they provide higher precision.
             const struct gl_format *fmt = gl_find_unorm_format(gl, 2, 1);
@@ -2300,7 +2975,7 @@ static void pass_draw_osd(struct gl_video *p, int draw_flags, double pts,
 
             pass_colormanage(p, csp_srgb, true);
         }
-        gl_sc_set_vao(p->sc, mpgl_osd_get_vao(p->osd));
+        mpgl_osd_set_shader(p->osd, p->sc, n);
         gl_sc_generate(p->sc);
         mpgl_osd_draw_part(p->osd, vp_w, vp_h, n);
         gl_sc_reset(p->sc);
@@ -2439,6 +3114,8 @@ static void pass_draw_to_screen(struct gl_video *p, int fbo)
 {
     gl_timer_start(p->present_timer);
 
+    pass_describe(p, "output to screen");
+
     if (p->dumb_mode)
         pass_render_frame_dumb(p, fbo);
 
@@ -2475,9 +3152,65 @@ static void pass_draw_to_screen(struct gl_video *p, int fbo)
     gl_timer_stop(p->present_timer);
 }
 
-// Draws an interpolate frame to fbo, based on the frame timing in t
-static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
-                                       int fbo)
+static int osd_draw_flags(struct gl_video *p)
+{
+    return p->opts.blend_subs ? OSD_DRAW_OSD_ONLY : 0;
+}
+
+// Return whether output_fbo still contains the result of rendering the frames
+// in key, and remember key for the next call. This also updates the OSD, to
+// check whether it changed since it was rendered.
+static bool output_cache_hit(struct gl_video *p, struct output_key *key)
+{
+    struct output_key *old = &p->output_key;
+    bool hit = p->output_fbo_valid && key->mix == old->mix &&
+               memcmp(key->ids, old->ids, sizeof(key->ids)) == 0;
+    if (hit && p->osd) {
+        mpgl_osd_generate(p->osd, p->osd_rect, p->osd_pts,
+                          p->image_params.stereo_out, osd_draw_flags(p));
+        hit = mpgl_get_change_counter(p->osd) == old->osd_changes;
+    }
+    if (!hit)
+        p->output_fbo_valid = false;
+    old->mix = key->mix;
+    memcpy(old->ids, key->ids, sizeof(old->ids));
+    return hit;
+}
+
+// Copy the whole viewport from src_fbo to dst_fbo.
+static void blit_viewport(struct gl_video *p, int dst_fbo, int src_fbo)
+{
+    GL *gl = p->gl;
+    int h = abs(p->vp_h);
+
+    gl->BindFramebuffer(GL_READ_FRAMEBUFFER, src_fbo);
+    gl->BindFramebuffer(GL_DRAW_FRAMEBUFFER, dst_fbo);
+    gl->BlitFramebuffer(0, 0, p->vp_w, h, 0, 0, p->vp_w, h,
+                        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    gl->BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    gl->BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+// Clear the parts of fbo not covered by the video.
+static void clear_background(struct gl_video *p, int fbo, bool has_frame)
+{
+    GL *gl = p->gl;
+
+    if (!has_frame || p->dst_rect.x0 > 0 || p->dst_rect.y0 > 0 ||
+        p->dst_rect.x1 < p->vp_w || p->dst_rect.y1 < abs(p->vp_h))
+    {
+        struct m_color c = p->opts.background;
+        gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
+        gl->ClearColor(c.r / 255.0, c.g / 255.0, c.b / 255.0, c.a / 255.0);
+        gl->Clear(GL_COLOR_BUFFER_BIT);
+    }
+}
+
+// Draws an interpolate frame to fbo, based on the frame timing in t. If
+// use_cache is set, fbo is output_fbo, and is left untouched if it already
+// contains the same result (then true is returned).
+static bool gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
+                                       int fbo, bool use_cache)
 {
     int vp_w = p->dst_rect.x1 - p->dst_rect.x0,
         vp_h = p->dst_rect.y1 - p->dst_rect.y0;
@@ -2492,7 +3225,7 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     // it manually + reset the queue if not
     if (p->surfaces[p->surface_now].id == 0) {
         if (!gl_video_upload_image(p, t->current, t->frame_id))
-            return;
+            return false;
         pass_render_frame(p);
         finish_pass_fbo(p, &p->surfaces[p->surface_now].fbotex,
                         vp_w, vp_h, FBOTEX_FUZZY);
@@ -2554,7 +3287,7 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
 
         if (f_id > p->surfaces[p->surface_idx].id) {
             if (!gl_video_upload_image(p, f, f_id))
-                return;
+                return false;
             pass_render_frame(p);
             finish_pass_fbo(p, &p->surfaces[surface_dst].fbotex,
                             vp_w, vp_h, FBOTEX_FUZZY);
@@ -2585,7 +3318,11 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     p->osd_pts = p->surfaces[surface_now].pts;
 
     // Finally, draw the right mix of frames to the screen.
+    struct output_key key = {.mix = -1};
     if (!valid || t->still) {
+        key.ids[0] = p->surfaces[surface_now].id;
+        if (use_cache && output_cache_hit(p, &key))
+            goto reused;
         // surface_now is guaranteed to be valid, so we can safely use it.
         pass_read_fbo(p, &p->surfaces[surface_now].fbotex);
         p->is_interpolated = false;
@@ -2619,7 +3356,14 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
             mix = 1 - mix;
         }
 
+        key.mix = mix;
+        for (int i = 0; i < size; i++)
+            key.ids[i] = p->surfaces[fbosurface_wrap(surface_bse + i)].id;
+        if (use_cache && output_cache_hit(p, &key))
+            goto reused;
+
         // Blend the frames together
+        pass_describe(p, "frame interpolation");
         if (oversample || linear) {
             gl_sc_uniform_f(p->sc, "inter_coeff", mix);
             GLSL(color = mix(texture(texture0, texcoord0),
@@ -2646,9 +3390,17 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
                t->ideal_frame_duration, t->vsync_interval, mix);
         p->is_interpolated = true;
     }
+    if (use_cache)
+        clear_background(p, fbo, true);
     pass_draw_to_screen(p, fbo);
+    p->output_fbo_valid = use_cache;
 
     p->frames_drawn += 1;
+    return false;
+
+reused:
+    p->frames_drawn += 1;
+    return true;
 }
 
 static void timer_dbg(struct gl_video *p, const char *name, struct gl_timer *t)
@@ -2662,6 +3414,87 @@ static void timer_dbg(struct gl_video *p, const char *name, struct gl_timer *t)
 }
 
 // (fbo==0 makes BindFramebuffer select the screen backbuffer)
+// Return the surface frame was rendered to by gl_video_render_ahead(), if the
+// OSD didn't change since then. Surfaces of this and earlier frames are freed
+// for reuse.
+static struct ahead_surface *get_ahead_surface(struct gl_video *p,
+                                               struct vo_frame *frame)
+{
+    struct ahead_surface *res = NULL;
+    for (int n = 0; n < VO_MAX_RENDER_AHEAD; n++) {
+        struct ahead_surface *s = &p->ahead[n];
+        if (s->id && s->id == frame->frame_id)
+            res = s;
+        if (s->id <= frame->frame_id)
+            s->id = 0;
+    }
+    if (res && p->osd) {
+        mpgl_osd_generate(p->osd, p->osd_rect, res->osd_pts,
+                          p->image_params.stereo_out, osd_draw_flags(p));
+        if (mpgl_get_change_counter(p->osd) != res->osd_changes)
+            res = NULL;
+    }
+    return res;
+}
+
+// Render a display-synced frame, which will be passed to
+// gl_video_render_frame() after the frames before it are done, to an offscreen
+// surface. gl_video_render_frame() then only needs to copy it to the screen.
+// Returns false if this is not possible.
+bool gl_video_render_ahead(struct gl_video *p, struct vo_frame *frame)
+{
+    GL *gl = p->gl;
+
+    // Interpolated output depends on the vsync the frame ends up on.
+    if (!frame->current || !frame->display_synced || p->opts.interpolation ||
+        (p->hwdec_active && p->hwdec->driver->overlay_frame) ||
+        p->dumb_mode || !gl->BlitFramebuffer)
+        return false;
+
+    // Frames are displayed in order, so the oldest surface is free.
+    struct ahead_surface *s = &p->ahead[0];
+    for (int n = 1; n < VO_MAX_RENDER_AHEAD; n++) {
+        if (p->ahead[n].id < s->id)
+            s = &p->ahead[n];
+    }
+    s->id = 0;
+    if (!fbo_pool_change(p->fbo_pool, &s->fbotex, p->vp_w, abs(p->vp_h),
+                         p->opts.fbo_format, FBOTEX_FUZZY))
+        return false;
+
+    pass_info_new_frame(p);
+    p->broken_frame = false;
+
+    clear_background(p, s->fbotex.fbo, true);
+    gl_sc_set_vao(p->sc, &p->vao);
+    bool ok = gl_video_upload_image(p, frame->current, frame->frame_id);
+    if (ok) {
+        pass_render_frame(p);
+        pass_draw_to_screen(p, s->fbotex.fbo);
+    }
+    unmap_current_image(p);
+
+    if (ok && p->osd) {
+        gl->BindFramebuffer(GL_FRAMEBUFFER, s->fbotex.fbo);
+        pass_draw_osd(p, osd_draw_flags(p), p->osd_pts, p->osd_rect,
+                      p->vp_w, p->vp_h, s->fbotex.fbo, true);
+        s->osd_changes = mpgl_get_change_counter(p->osd);
+    }
+    gl->UseProgram(0);
+    gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (ok && !gl_sc_error_state(p->sc) && !p->broken_frame) {
+        s->id = frame->frame_id;
+        s->osd_pts = p->osd_pts;
+    }
+
+    // Let the GPU work on it while the current frame is still displayed.
+    gl->Flush();
+
+    debug_check_gl(p, "after rendering ahead");
+    return s->id != 0;
+}
+
 void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo)
 {
     GL *gl = p->gl;
@@ -2671,21 +3504,34 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo)
         return;
     }
 
+    pass_info_new_frame(p);
+
     p->broken_frame = false;
 
     gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
 
     bool has_frame = !!frame->current;
-
-    if (!has_frame || p->dst_rect.x0 > 0 || p->dst_rect.y0 > 0 ||
-        p->dst_rect.x1 < p->vp_w || p->dst_rect.y1 < abs(p->vp_h))
-    {
-        struct m_color c = p->opts.background;
-        gl->ClearColor(c.r / 255.0, c.g / 255.0, c.b / 255.0, c.a / 255.0);
-        gl->Clear(GL_COLOR_BUFFER_BIT);
+    bool overlay = p->hwdec_active && p->hwdec->driver->overlay_frame;
+
+    // Render to output_fbo if the frame is going to be displayed for several
+    // vsyncs, so that the result can be presented again if nothing changed.
+    // (If it's valid, it has the right size, and must not be invalidated.)
+    bool use_cache = has_frame && !overlay && frame->display_synced &&
+                     (frame->num_vsyncs > 1 || frame->repeat) &&
+                     !p->dumb_mode && gl->BlitFramebuffer;
+    if (use_cache && !p->output_fbo_valid) {
+        use_cache = fbo_pool_change(p->fbo_pool, &p->output_fbo,
+                                    p->vp_w, abs(p->vp_h),
+                                    p->opts.fbo_format, FBOTEX_FUZZY);
+    }
+    int target = use_cache ? p->output_fbo.fbo : fbo;
+    bool reused = false;
+    if (!use_cache) {
+        p->output_fbo_valid = false;
+        clear_background(p, fbo, has_frame);
     }
 
-    if (p->hwdec_active && p->hwdec->driver->overlay_frame) {
+    if (overlay) {
         if (has_frame) {
             float *c = p->hwdec->overlay_colorkey;
             gl->Scissor(p->dst_rect.x0, p->dst_rect.y0,
@@ -2718,51 +3564,60 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo)
                 interpolate = false;
         }
 
-        if (interpolate) {
-            gl_video_interpolate_frame(p, frame, fbo);
+        // When paused, keep the image without OSD, so that OSD changes don't
+        // require rendering the video again.
+        bool keep_video = frame->still && p->osd && !p->opts.blend_subs &&
+                          !p->dumb_mode && gl->BlitFramebuffer;
+
+        struct ahead_surface *ahead = NULL;
+        if (frame->display_synced && !frame->repeat && !frame->redraw)
+            ahead = get_ahead_surface(p, frame);
+
+        if (ahead) {
+            blit_viewport(p, target, ahead->fbotex.fbo);
+            p->osd_pts = ahead->osd_pts;
+            p->output_key = (struct output_key){
+                .ids = {frame->frame_id},
+                .mix = -1,
+                .osd_changes = ahead->osd_changes,
+            };
+            p->output_fbo_valid = use_cache;
+            reused = true;
+        } else if (keep_video && frame->redraw && p->pre_osd_valid &&
+            p->pre_osd_id == frame->frame_id)
+        {
+            blit_viewport(p, target, p->pre_osd_fbo.fbo);
+            p->output_fbo_valid = false;
         } else {
-            bool is_new = frame->frame_id != p->image.id;
-
-            // Redrawing a frame might update subtitles.
-            if (frame->still && p->opts.blend_subs)
-                is_new = true;
-
-            if (is_new || !p->output_fbo_valid) {
-                p->output_fbo_valid = false;
-
-                if (!gl_video_upload_image(p, frame->current, frame->frame_id))
-                    goto done;
-                pass_render_frame(p);
-
-                // For the non-interpolation case, we draw to a single "cache"
-                // FBO to speed up subsequent re-draws (if any exist)
-                int dest_fbo = fbo;
-                if (frame->num_vsyncs > 1 && frame->display_synced &&
-                    !p->dumb_mode && gl->BlitFramebuffer)
-                {
-                    fbotex_change(&p->output_fbo, p->gl, p->log,
-                                  p->vp_w, abs(p->vp_h),
-                                  p->opts.fbo_format, FBOTEX_FUZZY);
-                    dest_fbo = p->output_fbo.fbo;
-                    p->output_fbo_valid = true;
+            if (interpolate) {
+                reused = gl_video_interpolate_frame(p, frame, target,
+                                                    use_cache);
+            } else {
+                // Redrawing a frame might update subtitles.
+                if (frame->still && p->opts.blend_subs)
+                    p->output_fbo_valid = false;
+
+                struct output_key key = {.ids = {frame->frame_id}};
+                reused = use_cache && output_cache_hit(p, &key);
+                if (!reused) {
+                    if (use_cache)
+                        clear_background(p, target, true);
+                    if (!gl_video_upload_image(p, frame->current,
+                                               frame->frame_id))
+                        goto done;
+                    pass_render_frame(p);
+                    pass_draw_to_screen(p, target);
+                    p->output_fbo_valid = use_cache;
                 }
-                pass_draw_to_screen(p, dest_fbo);
             }
 
-            // "output fbo valid" and "output fbo needed" are equivalent
-            if (p->output_fbo_valid) {
-                gl->BindFramebuffer(GL_READ_FRAMEBUFFER, p->output_fbo.fbo);
-                gl->BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
-                struct mp_rect rc = p->dst_rect;
-                if (p->vp_h < 0) {
-                    rc.y1 = -p->vp_h - p->dst_rect.y0;
-                    rc.y0 = -p->vp_h - p->dst_rect.y1;
-                }
-                gl->BlitFramebuffer(rc.x0, rc.y0, rc.x1, rc.y1,
-                                    rc.x0, rc.y0, rc.x1, rc.y1,
-                                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
-                gl->BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-                gl->BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            if (keep_video && !reused &&
+                fbo_pool_change(p->fbo_pool, &p->pre_osd_fbo, p->vp_w,
+                                abs(p->vp_h), p->opts.fbo_format, FBOTEX_FUZZY))
+            {
+                blit_viewport(p, p->pre_osd_fbo.fbo, target);
+                p->pre_osd_valid = true;
+                p->pre_osd_id = frame->frame_id;
             }
         }
     }
@@ -2773,22 +3628,29 @@ done:
 
     debug_check_gl(p, "after video rendering");
 
-    gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    if (!reused) {
+        gl->BindFramebuffer(GL_FRAMEBUFFER, target);
 
-    if (p->osd) {
-        pass_draw_osd(p, p->opts.blend_subs ? OSD_DRAW_OSD_ONLY : 0,
-                      p->osd_pts, p->osd_rect, p->vp_w, p->vp_h, fbo, true);
-        debug_check_gl(p, "after OSD rendering");
-    }
-    gl->UseProgram(0);
+        if (p->osd) {
+            pass_draw_osd(p, osd_draw_flags(p), p->osd_pts, p->osd_rect,
+                          p->vp_w, p->vp_h, target, true);
+            p->output_key.osd_changes = mpgl_get_change_counter(p->osd);
+            debug_check_gl(p, "after OSD rendering");
+        }
+        gl->UseProgram(0);
 
-    if (gl_sc_error_state(p->sc) || p->broken_frame) {
-        // Make the screen solid blue to make it visually clear that an
-        // error has occurred
-        gl->ClearColor(0.0, 0.05, 0.5, 1.0);
-        gl->Clear(GL_COLOR_BUFFER_BIT);
+        if (gl_sc_error_state(p->sc) || p->broken_frame) {
+            // Make the screen solid blue to make it visually clear that an
+            // error has occurred
+            gl->ClearColor(0.0, 0.05, 0.5, 1.0);
+            gl->Clear(GL_COLOR_BUFFER_BIT);
+            p->output_fbo_valid = false;
+        }
     }
 
+    if (target != fbo)
+        blit_viewport(p, fbo, target);
+
     gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // The playloop calls this last before waiting some time until it decides
@@ -2841,57 +3703,138 @@ static struct voctrl_performance_entry gl_video_perfentry(struct gl_timer *t)
 
 struct voctrl_performance_data gl_video_perfdata(struct gl_video *p)
 {
-    return (struct voctrl_performance_data) {
+    struct voctrl_performance_data data = {
         .upload = gl_video_perfentry(p->upload_timer),
         .render = gl_video_perfentry(p->render_timer),
         .present = gl_video_perfentry(p->present_timer),
     };
+    gl_sc_get_stats(p->sc, &data.shader_compiles, &data.shader_evictions);
+    size_t fbo_live, fbo_cached;
+    fbo_pool_get_usage(p->fbo_pool, &fbo_live, &fbo_cached);
+    data.fbo_bytes = fbo_live;
+    data.fbo_cached_bytes = fbo_cached;
+    for (int n = 0; n < p->num_last_passes; n++) {
+        struct pass_info *pass = &p->pass_info[p->last_passes[n]];
+        struct voctrl_pass_perf *out = &data.passes[data.num_passes++];
+        snprintf(out->desc, sizeof(out->desc), "%s", pass->desc);
+        out->perf = gl_video_perfentry(pass->timer);
+    }
+    return data;
 }
 
-// This assumes nv12, with textures set to GL_NEAREST filtering.
-static void reinterleave_vdpau(struct gl_video *p, struct gl_hwdec_frame *frame)
+// Returns false on failure.
+// Return the DR buffer containing ptr, or NULL.
+static struct dr_buffer *gl_find_dr_buffer(struct gl_video *p, uint8_t *ptr)
 {
-    struct gl_hwdec_frame res = {0};
-    for (int n = 0; n < 2; n++) {
-        struct fbotex *fbo = &p->vdpau_deinterleave_fbo[n];
-        // This is an array of the 2 to-merge planes.
-        struct gl_hwdec_plane *src = &frame->planes[n * 2];
-        int w = src[0].tex_w;
-        int h = src[0].tex_h;
-        int ids[2];
-        for (int t = 0; t < 2; t++) {
-            ids[t] = pass_bind(p, (struct img_tex){
-                .gl_tex = src[t].gl_texture,
-                .gl_target = src[t].gl_target,
-                .multiplier = 1.0,
-                .transform = identity_trans,
-                .tex_w = w,
-                .tex_h = h,
-                .w = w,
-                .h = h,
-            });
-        }
-
-        GLSLF("color = fract(gl_FragCoord.y / 2) < 0.5\n");
-        GLSLF("      ? texture(texture%d, texcoord%d)\n", ids[0], ids[0]);
-        GLSLF("      : texture(texture%d, texcoord%d);", ids[1], ids[1]);
-
-        fbotex_change(fbo, p->gl, p->log, w, h * 2, n == 0 ? GL_R8 : GL_RG8, 0);
-
-        finish_pass_direct(p, fbo->fbo, fbo->rw, fbo->rh,
-                           &(struct mp_rect){0, 0, w, h * 2});
-
-        res.planes[n] = (struct gl_hwdec_plane){
-            .gl_texture = fbo->texture,
-            .gl_target = GL_TEXTURE_2D,
-            .tex_w = w,
-            .tex_h = h * 2,
+    for (int n = 0; n < p->num_dr_buffers; n++) {
+        struct dr_buffer *buf = p->dr_buffers[n];
+        if (ptr >= buf->ptr && ptr < buf->ptr + buf->size)
+            return buf;
+    }
+    return NULL;
+}
+
+static void gl_video_dr_free_buffer(void *opaque, uint8_t *data)
+{
+    struct dr_buffer *buf = opaque;
+    struct gl_video *p = buf->p;
+
+    pthread_mutex_lock(&p->dr_lock);
+    buf->in_use = false;
+    pthread_mutex_unlock(&p->dr_lock);
+}
+
+static void destroy_dr_buffer(struct gl_video *p, struct dr_buffer *buf)
+{
+    GL *gl = p->gl;
+
+    if (buf->fence)
+        gl->DeleteSync(buf->fence);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buf->pbo);
+    gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    gl->DeleteBuffers(1, &buf->pbo);
+    talloc_free(buf);
+}
+
+// Allocate an image backed by a persistently mapped pixel buffer, so that
+// uploading it to a texture avoids copying the image data. Returns NULL if
+// this is unsupported. Buffers are recycled once the image is freed, and the
+// GPU has finished reading from them.
+struct mp_image *gl_video_get_image(struct gl_video *p, int imgfmt, int w, int h,
+                                    int stride_align)
+{
+    GL *gl = p->gl;
+
+    if (!gl->BufferStorage || !gl->FenceSync || !gl->MapBufferRange ||
+        !gl->UnmapBuffer || !init_format(p, imgfmt, true))
+        return NULL;
+
+    int size = mp_image_get_alloc_size(imgfmt, w, h, stride_align);
+    if (size < 0)
+        return NULL;
+
+    struct dr_buffer *buf = NULL;
+
+    // Reuse an unused buffer of the same size, and drop the others (they are
+    // probably left over from a previous video size).
+    pthread_mutex_lock(&p->dr_lock);
+    for (int n = p->num_dr_buffers - 1; n >= 0; n--) {
+        struct dr_buffer *cur = p->dr_buffers[n];
+        if (cur->in_use)
+            continue;
+        if (!buf && cur->size == size) {
+            buf = cur;
+            buf->in_use = true;
+            continue;
+        }
+        destroy_dr_buffer(p, cur);
+        MP_TARRAY_REMOVE_AT(p->dr_buffers, p->num_dr_buffers, n);
+    }
+    pthread_mutex_unlock(&p->dr_lock);
+
+    if (buf && buf->fence) {
+        // The GPU might still be reading the previous frame from it.
+        gl->ClientWaitSync(buf->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        gl->DeleteSync(buf->fence);
+        buf->fence = NULL;
+    }
+
+    if (!buf) {
+        // Decoders read back reference frames, so this must be readable too.
+        // GL_CLIENT_STORAGE_BIT hints that it should be in system memory.
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT |
+                           GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLuint pbo = 0;
+        gl->GenBuffers(1, &pbo);
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        gl->BufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL,
+                          flags | GL_CLIENT_STORAGE_BIT);
+        void *ptr = gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!ptr) {
+            gl->DeleteBuffers(1, &pbo);
+            gl_check_error(gl, p->log, "allocating DR buffer");
+            return NULL;
+        }
+
+        buf = talloc_ptrtype(NULL, buf);
+        *buf = (struct dr_buffer){
+            .p = p,
+            .pbo = pbo,
+            .ptr = ptr,
+            .size = size,
+            .in_use = true,
         };
+        pthread_mutex_lock(&p->dr_lock);
+        MP_TARRAY_APPEND(p, p->dr_buffers, p->num_dr_buffers, buf);
+        pthread_mutex_unlock(&p->dr_lock);
     }
-    *frame = res;
+
+    return mp_image_from_buffer(imgfmt, w, h, stride_align, buf->ptr, buf->size,
+                                buf, gl_video_dr_free_buffer);
 }
 
-// Returns false on failure.
 static bool gl_video_upload_image(struct gl_video *p, struct mp_image *mpi,
                                   uint64_t id)
 {
@@ -2922,17 +3865,23 @@ static bool gl_video_upload_image(struct gl_video *p, struct mp_image *mpi,
         if (ok) {
             struct mp_image layout = {0};
             mp_image_set_params(&layout, &p->image_params);
-            if (gl_frame.vdpau_fields)
-                reinterleave_vdpau(p, &gl_frame);
             for (int n = 0; n < p->plane_count; n++) {
                 struct gl_hwdec_plane *plane = &gl_frame.planes[n];
+                GLuint field = 0;
+                int tex_h = plane->tex_h;
+                if (gl_frame.vdpau_fields) {
+                    plane = &gl_frame.planes[n * 2];
+                    field = gl_frame.planes[n * 2 + 1].gl_texture;
+                    tex_h = plane->tex_h * 2;
+                }
                 vimg->planes[n] = (struct texplane){
                     .w = mp_image_plane_w(&layout, n),
                     .h = mp_image_plane_h(&layout, n),
                     .tex_w = plane->tex_w,
-                    .tex_h = plane->tex_h,
+                    .tex_h = tex_h,
                     .gl_target = plane->gl_target,
                     .gl_texture = plane->gl_texture,
+                    .gl_texture_field = field,
                 };
                 snprintf(vimg->planes[n].swizzle, sizeof(vimg->planes[n].swizzle),
                          "%s", plane->swizzle);
@@ -2956,10 +3905,24 @@ static bool gl_video_upload_image(struct gl_video *p, struct mp_image *mpi,
         plane->flipped = mpi->stride[0] < 0;
 
         gl->BindTexture(plane->gl_target, plane->gl_texture);
-        gl_pbo_upload_tex(&plane->pbo, gl, p->opts.pbo, plane->gl_target,
-                          plane->gl_format, plane->gl_type, plane->w, plane->h,
-                          mpi->planes[n], mpi->stride[n],
+        struct dr_buffer *dr = gl_find_dr_buffer(p, mpi->planes[n]);
+        if (dr) {
+            // Decoded directly into a mapped buffer, so upload from it.
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, dr->pbo);
+            gl_upload_tex(gl, plane->gl_target, plane->gl_format,
+                          plane->gl_type,
+                          (void *)(mpi->planes[n] - dr->ptr), mpi->stride[n],
                           0, 0, plane->w, plane->h);
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (dr->fence)
+                gl->DeleteSync(dr->fence);
+            dr->fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        } else {
+            gl_pbo_upload_tex(&plane->pbo, gl, p->opts.pbo, plane->gl_target,
+                              plane->gl_format, plane->gl_type, plane->w,
+                              plane->h, mpi->planes[n], mpi->stride[n],
+                              0, 0, plane->w, plane->h);
+        }
         gl->BindTexture(plane->gl_target, 0);
     }
 
@@ -3059,6 +4022,8 @@ static void check_gl_features(struct gl_video *p)
         }
         p->dumb_mode = true;
         p->use_lut_3d = false;
+        p->compute_ok = false;
+        p->lut_gpu_ok = false;
         // Most things don't work, so whitelist all options that still work.
         p->opts = (struct gl_video_opts){
             .gamma = p->opts.gamma,
@@ -3080,6 +4045,18 @@ static void check_gl_features(struct gl_video *p)
     }
     p->dumb_mode = false;
 
+    GLint max_shmem = 0;
+    if (gl->mpgl_caps & MPGL_CAP_COMPUTE_SHADER)
+        gl->GetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &max_shmem);
+    p->compute_ok = max_shmem > 0 && gl_sc_image_format(gl, p->opts.fbo_format);
+    p->max_shmem = max_shmem;
+    if (p->compute_ok)
+        MP_VERBOSE(p, "Using compute shaders for polar scalers.\n");
+
+    p->lut_gpu_ok = p->opts.scaler_lut_gpu && test_fbo(p, GL_RGBA16F);
+    if (p->opts.scaler_lut_gpu && !p->lut_gpu_ok)
+        MP_WARN(p, "Disabling --scaler-lut-gpu (no float FBOs).\n");
+
     // Normally, we want to disable them by default if FBOs are unavailable,
     // because they will be slow (not critically slow, but still slower).
     // Without FP textures, we must always disable them.
@@ -3213,6 +4190,8 @@ void gl_video_uninit(struct gl_video *p)
     uninit_video(p);
 
     gl_sc_destroy(p->sc);
+    gl_sc_destroy(p->lut_sc);
+    fbo_pool_destroy(p->fbo_pool);
 
     gl_vao_uninit(&p->vao);
 
@@ -3221,9 +4200,19 @@ void gl_video_uninit(struct gl_video *p)
     gl_timer_free(p->upload_timer);
     gl_timer_free(p->render_timer);
     gl_timer_free(p->present_timer);
+    for (int n = 0; n < p->num_pass_info; n++)
+        gl_timer_free(p->pass_info[n].timer);
+    p->num_pass_info = p->num_frame_passes = p->num_last_passes = 0;
 
     mpgl_osd_destroy(p->osd);
 
+    // All images should have been unreferenced at this point.
+    for (int n = 0; n < p->num_dr_buffers; n++) {
+        assert(!p->dr_buffers[n]->in_use);
+        destroy_dr_buffer(p, p->dr_buffers[n]);
+    }
+    pthread_mutex_destroy(&p->dr_lock);
+
     gl_set_debug_logger(gl, NULL);
 
     talloc_free(p);
@@ -3413,6 +4402,60 @@ bool gl_video_check_format(struct gl_video *p, int mp_format)
     return false;
 }
 
+// Render a black image of the configured format offscreen, so that the
+// shaders needed for the current options and video size are compiled (or
+// loaded from the shader cache) now, instead of while rendering the first
+// frames. With interpolation, enough frames to fill the queue are rendered,
+// so that the blending shader is built too. The OSD is not covered.
+static void warmup_shaders(struct gl_video *p)
+{
+    if (p->hwdec_active || !p->vp_w || !p->vp_h ||
+        p->dst_rect.x1 <= p->dst_rect.x0 || p->dst_rect.y1 <= p->dst_rect.y0)
+        return;
+
+    struct mp_image_params *params = &p->real_image_params;
+    struct mp_image *mpi = mp_image_alloc(params->imgfmt, params->w, params->h);
+    struct fbotex fbo = {0};
+    if (!mpi || !fbo_pool_change(p->fbo_pool, &fbo, p->vp_w, abs(p->vp_h),
+                                 p->opts.fbo_format, FBOTEX_FUZZY))
+        goto done;
+    mp_image_set_params(mpi, params);
+    mp_image_clear(mpi, 0, 0, mpi->w, mpi->h);
+    mpi->pts = 0;
+
+    MP_VERBOSE(p, "Building shaders for the new video format.\n");
+    gl_sc_set_vao(p->sc, &p->vao);
+
+    if (p->opts.interpolation) {
+        struct vo_frame frame = {
+            .vsync_interval = 1e6 / 60,
+            .ideal_frame_duration = 1e6 / 24,
+            .vsync_offset = 1e6 / 48,
+            .display_synced = true,
+            .current = mpi,
+            .num_frames = TEXUNIT_VIDEO_NUM,
+        };
+        for (int n = 0; n < frame.num_frames; n++)
+            frame.frames[n] = mpi;
+        // The queue is valid only after some frames were shown.
+        for (int n = 1; n <= TEXUNIT_VIDEO_NUM / 2 + 1; n++) {
+            frame.frame_id = n;
+            gl_video_interpolate_frame(p, &frame, fbo.fbo, false);
+        }
+    } else if (gl_video_upload_image(p, mpi, 1)) {
+        pass_render_frame(p);
+        pass_draw_to_screen(p, fbo.fbo);
+    }
+
+    p->gl->UseProgram(0);
+    debug_check_gl(p, "after shader warmup");
+
+done:
+    unref_current_image(p);
+    fbotex_uninit(&fbo);
+    talloc_free(mpi);
+}
+
 void gl_video_config(struct gl_video *p, struct mp_image_params *params)
 {
     unref_current_image(p);
@@ -3421,8 +4464,10 @@ void gl_video_config(struct gl_video *p, struct mp_image_params *params)
         uninit_video(p);
         p->real_image_params = *params;
         p->image_params = *params;
-        if (params->imgfmt)
+        if (params->imgfmt) {
             init_video(p);
+            warmup_shaders(p);
+        }
     }
 
     gl_video_reset_surfaces(p);
@@ -3450,8 +4495,10 @@ struct gl_video *gl_video_init(GL *gl, struct mp_log *log, struct mpv_global *g)
         .log = log,
         .texture_16bit_depth = 16,
         .sc = gl_sc_create(gl, log),
+        .fbo_pool = fbo_pool_create(gl, log),
         .opts_cache = m_config_cache_alloc(p, g, &gl_video_conf),
     };
+    pthread_mutex_init(&p->dr_lock, NULL);
     struct gl_video_opts *opts = p->opts_cache->opts;
     p->cms = gl_lcms_init(p, log, g, opts->icc_opts),
     p->opts = *opts;
@@ -3501,6 +4548,9 @@ static void reinit_from_options(struct gl_video *p)
 
     check_gl_features(p);
     uninit_rendering(p);
+    gl_sc_set_cache_dir(p->sc, p->global, p->opts.shader_cache_dir);
+    gl_sc_set_max_entries(p->sc, p->opts.shader_cache_entries);
+    fbo_pool_set_budget(p->fbo_pool, p->opts.fbo_budget * (size_t)(1024 * 1024));
     gl_video_setup_hooks(p);
     reinit_osd(p);
 
@@ -3533,6 +4583,20 @@ void gl_video_configure_queue(struct gl_video *p, struct vo *vo)
     vo_set_queue_params(vo, 0, queue_size);
 }
 
+// cb is called from another thread when an ICC 3D LUT generated in the
+// background becomes available, after which the frame should be redrawn.
+void gl_video_set_lut3d_wakeup_cb(struct gl_video *p, void (*cb)(void *ctx),
+                                  void *ctx)
+{
+    gl_lcms_set_wakeup_cb(p->cms, cb, ctx);
+}
+
+// Whether a redraw would pick up a newly generated 3D LUT.
+bool gl_video_lut3d_ready(struct gl_video *p)
+{
+    return p->use_lut_3d && gl_lcms_lut3d_ready(p->cms);
+}
+
 struct mp_csp_equalizer *gl_video_eq_ptr(struct gl_video *p)
 {
     return &p->video_eq;
@@ -3541,6 +4605,8 @@ struct mp_csp_equalizer *gl_video_eq_ptr(struct gl_video *p)
 // Call when the mp_csp_equalizer returned by gl_video_eq_ptr() was changed.
 void gl_video_eq_update(struct gl_video *p)
 {
+    p->output_fbo_valid = false;
+    p->pre_osd_valid = false;
 }
 
 static int validate_scaler_opt(struct mp_log *log, const m_option_t *opt,
@@ -101,6 +101,7 @@ struct gl_video_opts {
     int dumb_mode;
     struct scaler_config scaler[4];
     int scaler_lut_size;
+    int scaler_lut_gpu;
     float gamma;
     int gamma_auto;
     int target_prim;
@@ -108,6 +109,7 @@ struct gl_video_opts {
     int target_brightness;
     int hdr_tone_mapping;
     float tone_mapping_param;
+    int compute_hdr_peak;
     int linear_scaling;
     int correct_downscaling;
     int sigmoid_upscaling;
@@ -128,6 +130,10 @@ struct gl_video_opts {
     float interpolation_threshold;
     int blend_subs;
     char **user_shaders;
+    int fuse_hooks;
+    char *shader_cache_dir;
+    int shader_cache_entries;
+    int fbo_budget;
     int deband;
     struct deband_opts *deband_opts;
     float unsharp;
@@ -149,6 +155,7 @@ bool gl_video_check_format(struct gl_video *p, int mp_format);
 void gl_video_config(struct gl_video *p, struct mp_image_params *params);
 void gl_video_set_output_depth(struct gl_video *p, int r, int g, int b);
 void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame, int fbo);
+bool gl_video_render_ahead(struct gl_video *p, struct vo_frame *frame);
 void gl_video_resize(struct gl_video *p, int vp_w, int vp_h,
                      struct mp_rect *src, struct mp_rect *dst,
                      struct mp_osd_res *osd);
@@ -177,5 +184,11 @@ void gl_video_set_hwdec(struct gl_video *p, struct gl_hwdec *hwdec);
 
 struct vo;
 void gl_video_configure_queue(struct gl_video *p, struct vo *vo);
+void gl_video_set_lut3d_wakeup_cb(struct gl_video *p, void (*cb)(void *ctx),
+                                  void *ctx);
+bool gl_video_lut3d_ready(struct gl_video *p);
+
+struct mp_image *gl_video_get_image(struct gl_video *p, int imgfmt, int w, int h,
+                                    int stride_align);
 
 #endif
@@ -16,6 +16,7 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include "video_shaders.h"
 #include "video.h"
@@ -105,16 +106,16 @@ void pass_sample_separated_gen(struct gl_shader_cache *sc, struct scaler *scaler
     GLSLF("}\n");
 }
 
-void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler)
+// Add the samples of a polar kernel to color. If iw is not 0, the texels are
+// read from the shared memory arrays set up by pass_compute_polar() instead of
+// fetching them from tex.
+static void polar_samples(struct gl_shader_cache *sc, struct scaler *scaler,
+                          int components, int iw)
 {
     double radius = scaler->kernel->f.radius;
     int bound = (int)ceil(radius);
     bool use_ar = scaler->conf.antiring > 0;
-    GLSL(color = vec4(0.0);)
-    GLSLF("{\n");
-    GLSL(vec2 fcoord = fract(pos * size - vec2(0.5));)
-    GLSL(vec2 base = pos - fcoord * pt;)
-    GLSL(vec4 c;)
+    GLSL(vec4 c = vec4(0.0);)
     GLSLF("float w, d, wsum = 0.0;\n");
     if (use_ar) {
         GLSL(vec4 lo = vec4(1.0);)
@@ -144,7 +145,13 @@ void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler)
                       scaler->lut_size);
             }
             GLSL(wsum += w;)
-            GLSLF("c = texture(tex, base + pt * vec2(%d.0, %d.0));\n", x, y);
+            if (iw) {
+                int offset = (y + bound - 1) * iw + x + bound - 1;
+                for (int n = 0; n < components; n++)
+                    GLSLF("c[%d] = in%d[idx + %d];\n", n, n, offset);
+            } else {
+                GLSLF("c = texture(tex, base + pt * vec2(%d.0, %d.0));\n", x, y);
+            }
             GLSL(color += vec4(w) * c;)
             if (use_ar && x >= 0 && y >= 0 && x <= 1 && y <= 1) {
                 GLSL(lo = min(lo, c);)
@@ -158,9 +165,187 @@ void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler)
     if (use_ar)
         GLSLF("color = mix(color, clamp(color, lo, hi), %f);\n",
               scaler->conf.antiring);
+}
+
+void pass_sample_polar(struct gl_shader_cache *sc, struct scaler *scaler)
+{
+    GLSL(color = vec4(0.0);)
+    GLSLF("{\n");
+    GLSL(vec2 fcoord = fract(pos * size - vec2(0.5));)
+    GLSL(vec2 base = pos - fcoord * pt;)
+    polar_samples(sc, scaler, 4, 0);
+    GLSLF("}\n");
+}
+
+// Compute shader version of pass_sample_polar(), for a bw*bh work group. All
+// source texels needed by the work group (an iw*ih block) are fetched once
+// into shared memory, instead of each invocation fetching all texels in the
+// kernel radius. Besides pos/size/pt, this needs wpos, the source position of
+// the first invocation in the work group. The caller must make sure the block
+// is large enough and fits into shared memory.
+void pass_compute_polar(struct gl_shader_cache *sc, struct scaler *scaler,
+                        int components, int bw, int bh, int iw, int ih)
+{
+    int bound = (int)ceil(scaler->kernel->f.radius);
+    for (int n = 0; n < components; n++)
+        GLSLHF("shared float in%d[%d];\n", n, iw * ih);
+
+    GLSL(color = vec4(0.0);)
+    GLSLF("{\n");
+    GLSL(vec2 wbase = wpos - pt * fract(wpos * size - vec2(0.5));)
+    GLSL(vec2 fcoord = fract(pos * size - vec2(0.5));)
+    GLSL(vec2 base = pos - fcoord * pt;)
+    GLSL(ivec2 rel = ivec2(round((base - wbase) * size));)
+    GLSLF("int idx = %d * rel.y + rel.x;\n", iw);
+
+    // load the block cooperatively
+    GLSLF("for (int y = int(gl_LocalInvocationID.y); y < %d; y += %d) {\n", ih, bh);
+    GLSLF("for (int x = int(gl_LocalInvocationID.x); x < %d; x += %d) {\n", iw, bw);
+    GLSLF("vec4 c = texture(tex, wbase + pt * vec2(x - %d, y - %d));\n",
+          bound - 1, bound - 1);
+    for (int n = 0; n < components; n++)
+        GLSLF("in%d[%d * y + x] = c[%d];\n", n, iw, n);
+    GLSLF("}\n");
+    GLSLF("}\n");
+    GLSL(groupMemoryBarrier();)
+    GLSL(barrier();)
+
+    polar_samples(sc, scaler, components, iw);
     GLSLF("}\n");
 }
 
+// GLSL versions of the weight functions in filter_kernels.c, as expressions
+// of x, the window's radius R and its parameters P0 and P1.
+static const struct {
+    const char *name;
+    const char *expr;
+} glsl_weights[] = {
+    {"box",         "1.0"},
+    {"nearest",     "1.0"},
+    {"triangle",    "max(0.0, 1.0 - abs(x / R))"},
+    {"bartlett",    "max(0.0, 1.0 - abs(x / R))"},
+    {"hanning",     "0.5 + 0.5 * cos(M_PI * x)"},
+    {"tukey",       "0.5 + 0.5 * cos(M_PI * x)"},
+    {"hamming",     "0.54 + 0.46 * cos(M_PI * x)"},
+    {"quadric",     "x < 0.75 ? 0.75 - x * x : "
+                    "(x < 1.5 ? 0.5 * (x - 1.5) * (x - 1.5) : 0.0)"},
+    {"welch",       "1.0 - x * x"},
+    {"blackman",    "(1.0 - P0) / 2.0 + 0.5 * cos(M_PI * x) "
+                    "+ P0 / 2.0 * cos(2.0 * M_PI * x)"},
+    {"gaussian",    "exp(-2.0 * x * x / P0)"},
+    {"sinc",        "x < 1e-8 ? 1.0 : sin(M_PI * x) / (M_PI * x)"},
+    {"lanczos",     "x < 1e-8 ? 1.0 : sin(M_PI * x) / (M_PI * x)"},
+    {"bicubic",     "(pow3(x + 2.0) - 4.0 * pow3(x + 1.0) + 6.0 * pow3(x) "
+                    "- 4.0 * pow3(x - 1.0)) / 6.0"},
+#define CUBIC_BC \
+    "x < 1.0 ? ((6.0 - 2.0 * P0) + x * x * ((-18.0 + 12.0 * P0 + 6.0 * P1) " \
+    "+ x * (12.0 - 9.0 * P0 - 6.0 * P1))) / 6.0 : (x < 2.0 ? " \
+    "((8.0 * P0 + 24.0 * P1) + x * ((-12.0 * P0 - 48.0 * P1) " \
+    "+ x * ((6.0 * P0 + 30.0 * P1) + x * (-P0 - 6.0 * P1)))) / 6.0 : 0.0)"
+    {"bcspline",            CUBIC_BC},
+    {"catmull_rom",         CUBIC_BC},
+    {"mitchell",            CUBIC_BC},
+    {"robidoux",            CUBIC_BC},
+    {"robidouxsharp",       CUBIC_BC},
+    {"ewa_robidoux",        CUBIC_BC},
+    {"ewa_robidouxsharp",   CUBIC_BC},
+#undef CUBIC_BC
+    {"spline16",    "x < 1.0 ? ((x - 9.0/5.0) * x - 1.0/5.0) * x + 1.0 : "
+                    "((-1.0/3.0 * (x-1.0) + 4.0/5.0) * (x-1.0) - 7.0/15.0) "
+                    "* (x-1.0)"},
+    {"spline36",    "x < 1.0 ? ((13.0/11.0 * x - 453.0/209.0) * x - 3.0/209.0) "
+                    "* x + 1.0 : (x < 2.0 ? ((-6.0/11.0 * (x-1.0) + 270.0/209.0) "
+                    "* (x-1.0) - 156.0/209.0) * (x-1.0) : ((1.0/11.0 * (x-2.0) "
+                    "- 45.0/209.0) * (x-2.0) + 26.0/209.0) * (x-2.0))"},
+    {"spline64",    "x < 1.0 ? ((49.0/41.0 * x - 6387.0/2911.0) * x - 3.0/911.0) "
+                    "* x + 1.0 : (x < 2.0 ? ((-24.0/42.0 * (x-1.0) "
+                    "+ 4032.0/2911.0) * (x-1.0) - 2328.0/2911.0) * (x-1.0) : "
+                    "(x < 3.0 ? ((6.0/41.0 * (x-2.0) - 1008.0/2911.0) * (x-2.0) "
+                    "+ 582.0/2911.0) * (x-2.0) : ((-1.0/41.0 * (x-3.0) "
+                    "- 168.0/2911.0) * (x-3.0) + 97.0/2911.0) * (x-3.0)))"},
+    {0}
+};
+
+static double glsl_param(double v)
+{
+    return isnan(v) ? 0.0 : v;
+}
+
+// Equivalent of sample_window() in filter_kernels.c.
+static bool add_weight_fn(struct gl_shader_cache *sc, const char *fn,
+                          struct filter_window *k)
+{
+    const char *expr = NULL;
+    for (int n = 0; k->weight && glsl_weights[n].name; n++) {
+        if (strcmp(glsl_weights[n].name, k->name) == 0)
+            expr = glsl_weights[n].expr;
+    }
+    if (k->weight && !expr)
+        return false;
+
+    GLSLHF("float %s(float x) {\n", fn);
+    if (k->weight) {
+        GLSLHF("const float R = %.10f, P0 = %.10f, P1 = %.10f;\n", k->radius,
+               glsl_param(k->params[0]), glsl_param(k->params[1]));
+        GLSLH(x = abs(x);)
+        GLSLHF("if (x >= R) return 0.0;\n");
+        if (k->blur > 0.0)
+            GLSLHF("x = x / %.10f;\n", k->blur);
+        GLSLHF("x = x <= %.10f ? 0.0 : (x - %.10f) / %.10f;\n",
+               k->taper, k->taper, 1.0 - k->taper);
+        GLSLHF("return %s;\n", expr);
+    } else {
+        GLSLH(return 1.0;)
+    }
+    GLSLHF("}\n");
+    return true;
+}
+
+// Render the weights of the kernel into an FBO, with the same layout as
+// mp_compute_lut() and GL_TEXTURE_2D in reinit_scaler(): one row per subpixel
+// position (count rows), with elems weights per texel (or a single column for
+// polar kernels). Returns false if a weight function has no GLSL version.
+bool pass_gen_scaler_lut(struct gl_shader_cache *sc, struct filter_kernel *k,
+                         int count, int elems)
+{
+    GLSLHF("#define M_PI 3.14159265358979323846\n");
+    GLSLHF("float pow3(float x) { return x <= 0.0 ? 0.0 : x * x * x; }\n");
+    if (!add_weight_fn(sc, "weight_kernel", &k->f) ||
+        !add_weight_fn(sc, "weight_window", &k->w))
+        return false;
+
+    // Equivalent of sample_filter()
+    GLSLHF("float sample_filter(float x) {\n");
+    GLSLHF("float w = weight_window(x / %.10f * %.10f);\n",
+           k->f.radius, k->w.radius);
+    GLSLHF("float k = weight_kernel(x / %.10f);\n", k->inv_scale);
+    if (k->clamp) {
+        GLSLH(return clamp(w * k, 0.0, 1.0);)
+    } else {
+        GLSLH(return w * k;)
+    }
+    GLSLHF("}\n");
+
+    GLSLF("float fpos = floor(gl_FragCoord.y) / %d.0;\n", count - 1);
+    if (k->polar) {
+        GLSLF("color = vec4(sample_filter(fpos * %.10f), 0.0, 0.0, 1.0);\n",
+              k->f.radius);
+        return true;
+    }
+
+    // Equivalent of mp_compute_weights()
+    GLSL(float col = floor(gl_FragCoord.x);)
+    GLSLF("float w, wsum = 0.0;\n");
+    GLSL(color = vec4(0.0);)
+    for (int n = 0; n < k->size; n++) {
+        GLSLF("w = sample_filter(fpos - (%d.0));\n", n - k->size / 2 + 1);
+        GLSL(wsum += w;)
+        GLSLF("if (col == %d.0) color.%c = w;\n", n / elems, "rgba"[n % elems]);
+    }
+    GLSL(color /= vec4(wsum);)
+    return true;
+}
+
 static void bicubic_calcweights(struct gl_shader_cache *sc, const char *t, const char *s)
 {
     // Explanation of how bicubic scaling with only 4 texel fetches is done:
@@ -366,11 +551,77 @@ void pass_delinearize(struct gl_shader_cache *sc, enum mp_csp_trc trc)
     }
 }
 
-// Tone map from a known peak brightness to the range [0,1]
+// Number of frames the measured HDR peak is averaged over
+#define HDR_PEAK_FRAMES 64
+// A change of the average brightness by this factor (in log space) is
+// considered a scene change, which discards the history
+#define HDR_SCENE_THRESHOLD 1.0
+
+// Measure the peak and (logarithmic) average brightness of the frame, and
+// update ref_peak from the result of the previous frames. Must be run as
+// compute shader, with the hdr_peak SSBO (see gl_video) declared as:
+//   uint counter; uint frame_max; int frame_sum; float peak; float avg;
+// Pixels outside of the image (in partial work groups at the right and bottom
+// edges) are clamped to the image edge, and thus count twice, which doesn't
+// affect the peak and only marginally skews the average.
+static void hdr_detect_peak(struct gl_shader_cache *sc)
+{
+    // Fixed point scale factors for the atomics. Chosen to avoid overflows on
+    // an 8K image with 16x16 work groups.
+    const float sig_scale = 10000.0, log_min = 1e-3, log_scale = 400.0;
+
+    GLSL(if (peak > 0.0))
+    GLSL(    ref_peak = max(peak, 1.0);)
+
+    // Reduce within the work group in shared memory first, so that only one
+    // global atomic per work group is needed.
+    GLSLH(shared int wg_sum;)
+    GLSLH(shared uint wg_max;)
+    GLSL(if (gl_LocalInvocationIndex == 0u) {)
+    GLSL(    wg_sum = 0;)
+    GLSL(    wg_max = 0u;)
+    GLSL(})
+    GLSL(barrier();)
+    GLSL(float sig = max(max(color.r, color.g), color.b);)
+    GLSLF("atomicAdd(wg_sum, int(log(max(sig, %f)) * %f));\n", log_min, log_scale);
+    GLSLF("atomicMax(wg_max, uint(max(sig, 0.0) * %f));\n", sig_scale);
+    GLSL(memoryBarrierShared();)
+    GLSL(barrier();)
+
+    GLSL(if (gl_LocalInvocationIndex == 0u) {)
+    GLSL(    int wg_size = int(gl_WorkGroupSize.x * gl_WorkGroupSize.y);)
+    GLSL(    atomicAdd(frame_sum, wg_sum / wg_size);)
+    GLSL(    atomicMax(frame_max, wg_max);)
+    GLSL(    memoryBarrierBuffer();)
+    // The last work group to finish folds the frame into the smoothed values,
+    // and resets the per-frame state for the next frame.
+    GLSL(    uint num_wg = gl_NumWorkGroups.x * gl_NumWorkGroups.y;)
+    GLSL(    if (atomicAdd(counter, 1u) == num_wg - 1u) {)
+    GLSLF("        float cur_peak = float(frame_max) / %f;\n", sig_scale);
+    GLSLF("        float cur_avg = exp(float(frame_sum) / (float(num_wg) * %f));\n",
+          log_scale);
+    GLSLF("        float a = 1.0 / %d.0;\n", HDR_PEAK_FRAMES);
+    GLSLF("        if (peak <= 0.0 || abs(log(cur_avg / avg)) > %f)\n",
+          HDR_SCENE_THRESHOLD);
+    GLSL(            a = 1.0;)
+    GLSL(        peak = mix(peak, cur_peak, a);)
+    GLSL(        avg = mix(avg, cur_avg, a);)
+    GLSL(        frame_max = 0u;)
+    GLSL(        frame_sum = 0;)
+    GLSL(        counter = 0u;)
+    GLSL(    })
+    GLSL(})
+}
+
+// Tone map from a known peak brightness to the range [0,1]. If detect_peak is
+// set, the peak measured by hdr_detect_peak() is used instead of ref_peak.
 static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
-                          enum tone_mapping algo, float param)
+                          enum tone_mapping algo, float param, bool detect_peak)
 {
     GLSLF("// HDR tone mapping\n");
+    GLSLF("float ref_peak = %f;\n", ref_peak);
+    if (detect_peak)
+        hdr_detect_peak(sc);
 
     switch (algo) {
     case TONE_MAPPING_CLIP:
@@ -381,7 +632,7 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
         float contrast = isnan(param) ? 0.5 : param,
               offset = (1.0 - contrast) / contrast;
         GLSLF("color.rgb = color.rgb / (color.rgb + vec3(%f));\n", offset);
-        GLSLF("color.rgb *= vec3(%f);\n", (ref_peak + offset) / ref_peak);
+        GLSLF("color.rgb *= vec3((ref_peak + %f) / ref_peak);\n", offset);
         break;
     }
 
@@ -392,20 +643,20 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
                A, C*B, D*E, A, B, D*F, E/F);
         GLSLHF("}\n");
 
-        GLSLF("color.rgb = hable(color.rgb) / hable(vec3(%f));\n", ref_peak);
+        GLSL(color.rgb = hable(color.rgb) / hable(vec3(ref_peak));)
         break;
     }
 
     case TONE_MAPPING_GAMMA: {
         float gamma = isnan(param) ? 1.8 : param;
-        GLSLF("color.rgb = pow(color.rgb / vec3(%f), vec3(%f));\n",
-              ref_peak, 1.0/gamma);
+        GLSLF("color.rgb = pow(color.rgb / vec3(ref_peak), vec3(%f));\n",
+              1.0/gamma);
         break;
     }
 
     case TONE_MAPPING_LINEAR: {
         float coeff = isnan(param) ? 1.0 : param;
-        GLSLF("color.rgb = vec3(%f) * color.rgb;\n", coeff / ref_peak);
+        GLSLF("color.rgb = vec3(%f / ref_peak) * color.rgb;\n", coeff);
         break;
     }
 
@@ -416,10 +667,12 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
 
 // Map colors from one source space to another. These source spaces
 // must be known (i.e. not MP_CSP_*_AUTO), as this function won't perform
-// any auto-guessing.
+// any auto-guessing. If detect_peak is set, the tone mapping measures the
+// signal peak (see hdr_detect_peak()), which requires a compute shader.
 void pass_color_map(struct gl_shader_cache *sc,
                     struct mp_colorspace src, struct mp_colorspace dst,
-                    enum tone_mapping algo, float tone_mapping_param)
+                    enum tone_mapping algo, float tone_mapping_param,
+                    bool detect_peak)
 {
     GLSLF("// color mapping\n");
 
@@ -453,7 +706,8 @@ void pass_color_map(struct gl_shader_cache *sc,
     // Tone map to prevent clipping when the source signal peak exceeds the
     // encodable range.
     if (src.sig_peak > dst.nom_peak)
-        pass_tone_map(sc, src.sig_peak / dst.nom_peak, algo, tone_mapping_param);
+        pass_tone_map(sc, src.sig_peak / dst.nom_peak, algo, tone_mapping_param,
+                      detect_peak);
 
     // Adapt to the right colorspace if necessary
     if (src.primaries != dst.primaries) {
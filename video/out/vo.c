@@ -49,6 +49,7 @@ extern const struct vo_driver video_out_vdpau;
 extern const struct vo_driver video_out_xv;
 extern const struct vo_driver video_out_opengl;
 extern const struct vo_driver video_out_opengl_cb;
+extern const struct vo_driver video_out_sw_cb;
 extern const struct vo_driver video_out_null;
 extern const struct vo_driver video_out_image;
 extern const struct vo_driver video_out_lavc;
@@ -106,6 +107,7 @@ const struct vo_driver *const video_out_drivers[] =
 #if HAVE_GL
     &video_out_opengl_cb,
 #endif
+    &video_out_sw_cb,
     NULL
 };
 
@@ -143,11 +145,16 @@ struct vo_internal {
     bool expecting_vsync;
     int64_t num_successive_vsyncs;
 
+    // Presentation feedback (driver->get_vsync), valid if feedback_count > 0.
+    int64_t feedback_count;         // vo_vsync_info.vsync_count at prev_vsync
+    int feedback_swaps;             // flips since then
+
     int64_t flip_queue_offset; // queue flip events at most this much in advance
 
     int64_t delayed_count;
     int64_t drop_count;
     bool dropped_frame;             // the previous frame was dropped
+    double render_time;             // running average of draw times (seconds)
 
     struct vo_frame *current_frame; // last frame queued to the VO
 
@@ -158,8 +165,14 @@ struct vo_internal {
     int req_frames;                 // VO's requested value of num_frames
     uint64_t current_frame_id;
 
+    // Frames taken from frame_queued and passed to driver->render_ahead. They
+    // are displayed in order after current_frame.
+    struct vo_frame *ahead_frames[VO_MAX_RENDER_AHEAD];
+    int num_ahead_frames;
+
     double display_fps;
     int opt_framedrop;
+    int opt_render_ahead;
 };
 
 static void forget_frames(struct vo *vo);
@@ -331,6 +344,7 @@ static void reset_vsync_timings(struct vo *vo)
     in->base_vsync = 0;
     in->expecting_vsync = false;
     in->num_successive_vsyncs = 0;
+    in->feedback_count = 0;
 }
 
 static double vsync_stddef(struct vo *vo, int64_t ref_vsync)
@@ -407,20 +421,70 @@ static void vsync_skip_detection(struct vo *vo)
         in->base_vsync = in->prev_vsync;
         in->delayed_count += 1;
         in->drop_point = 0;
-        MP_STATS(vo, "vo-delayed");
+        MP_STATS_SIGNAL(vo, "vo-delayed");
     }
     if (in->drop_point > 10)
         in->base_vsync += desync / 10;  // smooth out drift
 }
 
+// Return the number of vsyncs the display reports since the last call, and set
+// *time to the time of the most recent one. Returns -1 if there's no usable
+// feedback (or if this is the first sample), and 0 if the display didn't
+// advance yet (the flip was queued).
 // Always called locked.
-static void update_vsync_timing_after_swap(struct vo *vo)
+static int64_t get_feedback_vsyncs(struct vo *vo, struct vo_vsync_info *vsync,
+                                   int64_t *time)
+{
+    struct vo_internal *in = vo->in;
+    int64_t now = mp_time_us();
+
+    // Ignore obviously broken timestamps (e.g. from a different clock).
+    if (vsync->last_vsync_time <= now - 1000000 ||
+        vsync->last_vsync_time > now + 1000)
+    {
+        in->feedback_count = 0;
+        return -1;
+    }
+
+    int64_t num = -1;
+    in->feedback_swaps += 1;
+    if (in->feedback_count && vsync->vsync_count == in->feedback_count)
+        return 0;
+    if (in->feedback_count && vsync->vsync_count > in->feedback_count) {
+        num = vsync->vsync_count - in->feedback_count;
+        // Every flip should take one vsync; more means some were skipped.
+        if (num > in->feedback_swaps) {
+            in->delayed_count += num - in->feedback_swaps;
+            MP_STATS_SIGNAL(vo, "vo-delayed");
+        }
+    }
+    in->feedback_count = vsync->vsync_count;
+    in->feedback_swaps = 0;
+    *time = MPMIN(vsync->last_vsync_time, now);
+    return num;
+}
+
+// Always called locked.
+static void update_vsync_timing_after_swap(struct vo *vo,
+                                           struct vo_vsync_info *vsync)
 {
     struct vo_internal *in = vo->in;
 
     int64_t now = mp_time_us();
     int64_t prev_vsync = in->prev_vsync;
 
+    // Prefer the time of the vsync reported by the display system. The time
+    // flip_page returns at is subject to scheduling jitter and compositors.
+    int64_t num_vsyncs = -1;
+    if (in->expecting_vsync)
+        num_vsyncs = get_feedback_vsyncs(vo, vsync, &now);
+    if (num_vsyncs == 0) {
+        // Queued; it will be shown at the next vsync.
+        if (in->base_vsync)
+            in->base_vsync += in->vsync_interval;
+        return;
+    }
+
     in->prev_vsync = now;
 
     if (!in->expecting_vsync) {
@@ -432,13 +496,19 @@ static void update_vsync_timing_after_swap(struct vo *vo)
     if (in->num_successive_vsyncs <= 2)
         return;
 
+    // Unknown for the first feedback sample.
+    if (in->feedback_count && num_vsyncs < 1)
+        return;
+
     if (in->num_vsync_samples >= MAX_VSYNC_SAMPLES)
         in->num_vsync_samples -= 1;
     MP_TARRAY_INSERT_AT(in, in->vsync_samples, in->num_vsync_samples, 0,
-                        now - prev_vsync);
+                        (now - prev_vsync) / MPMAX(num_vsyncs, 1));
     in->drop_point = MPMIN(in->drop_point + 1, in->num_vsync_samples);
     in->num_total_vsync_samples += 1;
-    if (in->base_vsync) {
+    if (in->feedback_count) {
+        in->base_vsync = now;
+    } else if (in->base_vsync) {
         in->base_vsync += in->vsync_interval;
     } else {
         in->base_vsync = now;
@@ -452,10 +522,12 @@ static void update_vsync_timing_after_swap(struct vo *vo)
         vsync_stddef(vo, in->vsync_interval) / in->vsync_interval;
 
     check_estimated_display_fps(vo);
-    vsync_skip_detection(vo);
+    // With feedback, skipped vsyncs are known exactly.
+    if (!in->feedback_count)
+        vsync_skip_detection(vo);
 
-    MP_STATS(vo, "value %f jitter", in->estimated_vsync_jitter);
-    MP_STATS(vo, "value %f vsync-diff", in->vsync_samples[0] / 1e6);
+    MP_STATS_VALUE(vo, "jitter", in->estimated_vsync_jitter);
+    MP_STATS_VALUE(vo, "vsync-diff", in->vsync_samples[0] / 1e6);
 }
 
 // to be called from VO thread only
@@ -471,6 +543,10 @@ static void update_display_fps(struct vo *vo)
         mp_read_option_raw(vo->global, "framedrop", &m_option_type_choice,
                            &in->opt_framedrop);
 
+        int render_ahead;
+        mp_read_option_raw(vo->global, "video-render-ahead", &m_option_type_int,
+                           &render_ahead);
+
         double display_fps;
         mp_read_option_raw(vo->global, "display-fps", &m_option_type_double,
                            &display_fps);
@@ -480,6 +556,8 @@ static void update_display_fps(struct vo *vo)
 
         pthread_mutex_lock(&in->lock);
 
+        in->opt_render_ahead = vo->driver->render_ahead ? render_ahead : 0;
+
         if (in->display_fps != display_fps) {
             in->display_fps = display_fps;
             MP_VERBOSE(vo, "Assuming %f FPS for display sync.\n", display_fps);
@@ -570,6 +648,30 @@ int vo_control(struct vo *vo, int request, void *data)
     return ret;
 }
 
+static void run_get_image(void *p)
+{
+    void **pp = p;
+    struct vo *vo = pp[0];
+    int *args = pp[1];
+    *(struct mp_image **)pp[2] =
+        vo->driver->get_image(vo, args[0], args[1], args[2], args[3]);
+}
+
+// Allocate an image the decoder can render into directly (see
+// vo_driver.get_image). Can be called from any thread. Returns NULL if the VO
+// doesn't support it.
+struct mp_image *vo_get_image(struct vo *vo, int imgfmt, int w, int h,
+                              int stride_align)
+{
+    if (!vo->driver->get_image)
+        return NULL;
+    struct mp_image *res = NULL;
+    int args[] = {imgfmt, w, h, stride_align};
+    void *p[] = {vo, args, &res};
+    mp_dispatch_run(vo->in->dispatch, run_get_image, p);
+    return res;
+}
+
 // Run vo_control() without waiting for a reply.
 // (Only works for some VOCTRLs.)
 void vo_control_async(struct vo *vo, int request, void *data)
@@ -598,6 +700,9 @@ static void forget_frames(struct vo *vo)
     in->delayed_count = 0;
     talloc_free(in->frame_queued);
     in->frame_queued = NULL;
+    for (int n = 0; n < in->num_ahead_frames; n++)
+        talloc_free(in->ahead_frames[n]);
+    in->num_ahead_frames = 0;
     in->current_frame_id += VO_MAX_REQ_FRAMES + 1;
     // don't unref current_frame; we always want to be able to redraw it
     if (in->current_frame) {
@@ -657,6 +762,23 @@ void vo_wakeup(struct vo *vo)
     pthread_mutex_unlock(&in->lock);
 }
 
+// The frame that will be displayed last of all frames passed to the VO.
+static struct vo_frame *last_queued_frame(struct vo_internal *in)
+{
+    if (in->num_ahead_frames)
+        return in->ahead_frames[in->num_ahead_frames - 1];
+    return in->current_frame;
+}
+
+// Whether a frame queued now would be passed to driver->render_ahead, because
+// it's not going to be displayed for at least another vsync.
+static bool can_render_ahead(struct vo_internal *in)
+{
+    struct vo_frame *last = last_queued_frame(in);
+    return in->num_ahead_frames < in->opt_render_ahead && !in->paused &&
+           last && last->display_synced && in->hasframe_rendered;
+}
+
 // Whether vo_queue_frame() can be called. If the VO is not ready yet, the
 // function will return false, and the VO will call the wakeup callback once
 // it's ready.
@@ -669,8 +791,9 @@ bool vo_is_ready_for_frame(struct vo *vo, int64_t next_pts)
 {
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
+    struct vo_frame *last = last_queued_frame(in);
     bool r = vo->config_ok && !in->frame_queued &&
-             (!in->current_frame || in->current_frame->num_vsyncs < 1);
+             (!last || last->num_vsyncs < 1 || can_render_ahead(in));
     if (r && next_pts >= 0) {
         // Don't show the frame too early - it would basically freeze the
         // display by disallowing OSD redrawing or VO interaction.
@@ -698,8 +821,9 @@ void vo_queue_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
+    struct vo_frame *last = last_queued_frame(in);
     assert(vo->config_ok && !in->frame_queued &&
-           (!in->current_frame || in->current_frame->num_vsyncs < 1));
+           (!last || last->num_vsyncs < 1 || can_render_ahead(in)));
     in->hasframe = true;
     frame->frame_id = ++(in->current_frame_id);
     in->frame_queued = frame;
@@ -715,25 +839,68 @@ void vo_wait_frame(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
     pthread_mutex_lock(&in->lock);
-    while (in->frame_queued || in->rendering)
+    while (in->frame_queued || in->num_ahead_frames || in->rendering)
         pthread_cond_wait(&in->wakeup, &in->lock);
     pthread_mutex_unlock(&in->lock);
 }
 
 // Wait until realtime is >= ts
 // called without lock
+// Condition variable waits are interruptible, but can wake up late by up to
+// a few milliseconds. Wait for the last part before the deadline with
+// mp_sleep_until() instead, which uses an absolute deadline.
+#define WAIT_FINE_US 2000
+
 static void wait_until(struct vo *vo, int64_t target)
 {
     struct vo_internal *in = vo->in;
-    struct timespec ts = mp_time_us_to_timespec(target);
+    int64_t coarse = target - WAIT_FINE_US;
+    struct timespec ts = mp_time_us_to_timespec(coarse);
+    bool interrupted = false;
     pthread_mutex_lock(&in->lock);
-    while (target > mp_time_us()) {
-        if (in->queued_events & VO_EVENT_LIVE_RESIZING)
+    while (coarse > mp_time_us()) {
+        if (in->queued_events & VO_EVENT_LIVE_RESIZING) {
+            interrupted = true;
             break;
+        }
         if (pthread_cond_timedwait(&in->wakeup, &in->lock, &ts))
             break;
     }
+    if (in->queued_events & VO_EVENT_LIVE_RESIZING)
+        interrupted = true;
+    pthread_mutex_unlock(&in->lock);
+    if (!interrupted)
+        mp_sleep_until(target, vo->opts->timing_spin);
+}
+
+// Pass the queued frame to driver->render_ahead if it won't be displayed
+// next. Called locked, but unlocks while rendering.
+static void render_ahead(struct vo *vo)
+{
+    struct vo_internal *in = vo->in;
+
+    struct vo_frame *last = last_queued_frame(in);
+    if (!in->frame_queued || !last || last->num_vsyncs < 1 ||
+        !in->frame_queued->display_synced || !can_render_ahead(in))
+        return;
+
+    struct vo_frame *next = in->frame_queued;
+    in->frame_queued = NULL;
+    in->ahead_frames[in->num_ahead_frames++] = next;
+
+    // Same parameters as when render_frame() draws it the first time.
+    struct vo_frame *frame = vo_frame_ref(next);
+    frame->pts = 0;
+    frame->duration = -1;
     pthread_mutex_unlock(&in->lock);
+    wakeup_core(vo); // core can queue new video now
+
+    MP_STATS_START(vo, "video-render-ahead");
+    vo->driver->render_ahead(vo, frame);
+    MP_STATS_END(vo, "video-render-ahead");
+
+    talloc_free(frame);
+    pthread_mutex_lock(&in->lock);
 }
 
 static bool render_frame(struct vo *vo)
@@ -746,7 +913,20 @@ static bool render_frame(struct vo *vo)
 
     pthread_mutex_lock(&in->lock);
 
-    if (in->frame_queued) {
+    render_ahead(vo);
+
+    // Frames rendered ahead are shown once all vsyncs of the current frame
+    // are done (or immediately when paused).
+    bool next_ahead = in->num_ahead_frames &&
+        (in->paused || !in->current_frame ||
+         !in->current_frame->display_synced ||
+         in->current_frame->num_vsyncs < 1);
+
+    if (next_ahead) {
+        talloc_free(in->current_frame);
+        in->current_frame = in->ahead_frames[0];
+        MP_TARRAY_REMOVE_AT(in->ahead_frames, in->num_ahead_frames, 0);
+    } else if (in->frame_queued && !in->num_ahead_frames) {
         talloc_free(in->current_frame);
         in->current_frame = in->frame_queued;
         in->frame_queued = NULL;
@@ -808,33 +988,60 @@ static bool render_frame(struct vo *vo)
         pthread_mutex_unlock(&in->lock);
         wakeup_core(vo); // core can queue new video now
 
-        MP_STATS(vo, "start video-draw");
+        MP_STATS_START(vo, "video-draw");
 
+        int64_t draw_start = mp_time_us();
         if (vo->driver->draw_frame) {
             vo->driver->draw_frame(vo, frame);
         } else {
             vo->driver->draw_image(vo, mp_image_new_ref(frame->current));
         }
+        int64_t draw_end = mp_time_us();
 
-        MP_STATS(vo, "end video-draw");
+        MP_STATS_END(vo, "video-draw");
 
         wait_until(vo, target);
 
-        MP_STATS(vo, "start video-flip");
+        MP_STATS_START(vo, "video-flip");
 
+        int64_t flip_start = mp_time_us();
         vo->driver->flip_page(vo);
-
-        MP_STATS(vo, "end video-flip");
+        int64_t flip_end = mp_time_us();
+
+        struct vo_vsync_info vsync = {0};
+        if (vo->driver->get_vsync)
+            vo->driver->get_vsync(vo, &vsync);
+
+        MP_STATS_END(vo, "video-flip");
+
+        if (vo->extra.frame_timing_cb) {
+            struct vo_frame_timing t = {
+                .draw = draw_end - draw_start,
+                .flip = flip_end - flip_start,
+                .upload = -1, .render = -1, .present = -1,
+            };
+            struct voctrl_performance_data perf = {0};
+            if (vo->driver->control(vo, VOCTRL_PERFORMANCE_DATA, &perf) == VO_TRUE)
+            {
+                t.upload = perf.upload.last;
+                t.render = perf.render.last;
+                t.present = perf.present.last;
+            }
+            vo->extra.frame_timing_cb(vo->extra.frame_timing_ctx, &t);
+        }
 
         pthread_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
         in->rendering = false;
+        double draw_time = (draw_end - draw_start) / 1e6;
+        in->render_time = in->render_time > 0
+            ? in->render_time + (draw_time - in->render_time) / 16 : draw_time;
 
-        update_vsync_timing_after_swap(vo);
+        update_vsync_timing_after_swap(vo, &vsync);
     }
 
     if (in->dropped_frame) {
-        MP_STATS(vo, "drop-vo");
+        MP_STATS_SIGNAL(vo, "drop-vo");
     } else {
         vo->want_redraw = false;
         in->want_redraw = false;
@@ -849,7 +1056,8 @@ static bool render_frame(struct vo *vo)
 done:
     talloc_free(frame);
     pthread_mutex_unlock(&in->lock);
-    return got_frame || (in->frame_queued && in->frame_queued->display_synced);
+    return got_frame || in->num_ahead_frames ||
+           (in->frame_queued && in->frame_queued->display_synced);
 }
 
 static void do_redraw(struct vo *vo)
@@ -900,6 +1108,7 @@ static void *vo_thread(void *ptr)
     struct vo_internal *in = vo->in;
 
     mpthread_set_name("vo");
+    mpthread_set_role(vo->global, "vo");
 
     int r = vo->driver->preinit(vo) ? -1 : 0;
     mp_rendezvous(vo, r); // init barrier
@@ -971,6 +1180,16 @@ int64_t vo_get_drop_count(struct vo *vo)
     return r;
 }
 
+// Average time the VO spends on drawing a frame, in seconds (0 if unknown).
+// Waiting for vsync in flip_page is not included.
+double vo_get_render_time(struct vo *vo)
+{
+    pthread_mutex_lock(&vo->in->lock);
+    double r = vo->in->render_time;
+    pthread_mutex_unlock(&vo->in->lock);
+    return r;
+}
+
 void vo_increment_drop_count(struct vo *vo, int64_t n)
 {
     pthread_mutex_lock(&vo->in->lock);
@@ -1023,7 +1242,8 @@ bool vo_still_displaying(struct vo *vo)
         if (in->current_frame->display_synced)
             frame_end = in->current_frame->num_vsyncs > 0 ? INT64_MAX : 0;
     }
-    bool working = now < frame_end || in->rendering || in->frame_queued;
+    bool working = now < frame_end || in->rendering || in->frame_queued ||
+                   in->num_ahead_frames;
     pthread_mutex_unlock(&vo->in->lock);
     return working && in->hasframe;
 }
@@ -1136,6 +1356,9 @@ double vo_get_delay(struct vo *vo)
         res = in->base_vsync;
         int extra = !!in->rendering;
         res += (in->current_frame->num_vsyncs + extra) * in->vsync_interval;
+        // Frames rendered ahead are displayed before the frame queued next.
+        for (int n = 0; n < in->num_ahead_frames; n++)
+            res += in->ahead_frames[n]->num_vsyncs * in->vsync_interval;
         if (!in->current_frame->display_synced)
             res = 0;
     }
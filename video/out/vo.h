@@ -151,8 +151,22 @@ struct voctrl_performance_entry {
     uint64_t last, avg, peak;
 };
 
+#define VO_PERF_MAX_PASSES 64
+
+struct voctrl_pass_perf {
+    char desc[64];
+    struct voctrl_performance_entry perf;
+};
+
 struct voctrl_performance_data {
     struct voctrl_performance_entry upload, render, present;
+    // Individual render passes of the last frame, in execution order.
+    struct voctrl_pass_perf passes[VO_PERF_MAX_PASSES];
+    int num_passes;
+    // Total number of shader programs compiled/evicted from the shader cache.
+    uint64_t shader_compiles, shader_evictions;
+    // Estimated video memory used by FBOs in use, and kept for reuse.
+    uint64_t fbo_bytes, fbo_cached_bytes;
 };
 
 enum {
@@ -164,18 +178,35 @@ enum {
 
 #define VO_MAX_REQ_FRAMES 10
 
+// Maximum number of frames that can be rendered in advance (for
+// --video-render-ahead).
+#define VO_MAX_RENDER_AHEAD 2
+
 struct vo;
 struct osd_state;
 struct mp_image;
 struct mp_image_params;
 
+// Times (in microseconds) spent on a rendered frame.
+struct vo_frame_timing {
+    int64_t draw;               // vo_driver.draw_frame/draw_image
+    int64_t flip;               // vo_driver.flip_page
+    // GPU times as returned by VOCTRL_PERFORMANCE_DATA (last frame), or -1.
+    int64_t upload, render, present;
+};
+
 struct vo_extra {
     struct input_ctx *input_ctx;
     struct osd_state *osd;
     struct encode_lavc_context *encode_lavc_ctx;
     struct mpv_opengl_cb_context *opengl_cb_context;
+    struct mpv_sw_cb_context *sw_cb_context;
     void (*wakeup_cb)(void *ctx);
     void *wakeup_ctx;
+    // If set, called from the VO thread after each rendered frame. Enables
+    // querying the GPU timers on every frame.
+    void (*frame_timing_cb)(void *ctx, struct vo_frame_timing *t);
+    void *frame_timing_ctx;
 };
 
 struct vo_frame {
@@ -227,6 +258,15 @@ struct vo_frame {
     uint64_t frame_id;
 };
 
+// Presentation feedback from the display system, see vo_driver.get_vsync.
+struct vo_vsync_info {
+    // Time of the most recent vsync in mp_time_us() units, or 0 if unknown.
+    int64_t last_vsync_time;
+    // Vsync counter at last_vsync_time (like the MSC of GLX_OML_sync_control).
+    // Only differences between values are meaningful.
+    int64_t vsync_count;
+};
+
 struct vo_driver {
     // Encoding functionality, which can be invoked via --o only.
     bool encode;
@@ -264,6 +304,18 @@ struct vo_driver {
      */
     int (*control)(struct vo *vo, uint32_t request, void *data);
 
+    /*
+     * Optional. Allocate an image in memory chosen by the VO (e.g. mapped GPU
+     * buffers), so that the decoder can render into it directly, and
+     * draw_frame does not need to copy it. Returns NULL if the VO can't
+     * provide such an image for the given parameters.
+     *   stride_align: minimum alignment of the strides (a power of 2)
+     * The returned image's buffers can be freed from any thread, which the VO
+     * must handle. All images must have been freed before uninit is called.
+     */
+    struct mp_image *(*get_image)(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align);
+
     /*
      * Render the given frame to the VO's backbuffer. This operation will be
      * followed by a draw_osd and a flip_page[_timed] call.
@@ -280,11 +332,30 @@ struct vo_driver {
      */
     void (*draw_frame)(struct vo *vo, struct vo_frame *frame);
 
+    /* Optional. Render the given display-synced frame into an offscreen
+     * surface, before the frames before it are done being displayed. If
+     * draw_frame is later called with a non-repeated frame with the same
+     * frame_id, it should only put the result on the screen. There can be up
+     * to VO_MAX_RENDER_AHEAD such frames, which are drawn in order; some of
+     * them may never be drawn (frame drops, seeks).
+     * Returns false if the frame can't be rendered in advance, in which case
+     * it's rendered by draw_frame as usual.
+     */
+    bool (*render_ahead)(struct vo *vo, struct vo_frame *frame);
+
     /*
      * Blit/Flip buffer to the screen. Must be called after each frame!
      */
     void (*flip_page)(struct vo *vo);
 
+    /*
+     * Optional. Called after flip_page. Fill info with the timing of the last
+     * vsync as reported by the display system (leave it untouched if there is
+     * none). This is used instead of measuring when flip_page returns, which
+     * is not exact.
+     */
+    void (*get_vsync)(struct vo *vo, struct vo_vsync_info *info);
+
     /* These optional callbacks can be provided if the GUI framework used by
      * the VO requires entering a message loop for receiving events and does
      * not call vo_wakeup() from a separate thread when there are new events.
@@ -369,6 +440,8 @@ struct vo *init_best_video_out(struct mpv_global *global, struct vo_extra *ex);
 int vo_reconfig(struct vo *vo, struct mp_image_params *p);
 
 int vo_control(struct vo *vo, int request, void *data);
+struct mp_image *vo_get_image(struct vo *vo, int imgfmt, int w, int h,
+                              int stride_align);
 void vo_control_async(struct vo *vo, int request, void *data);
 bool vo_is_ready_for_frame(struct vo *vo, int64_t next_pts);
 void vo_queue_frame(struct vo *vo, struct vo_frame *frame);
@@ -381,6 +454,7 @@ void vo_seek_reset(struct vo *vo);
 void vo_destroy(struct vo *vo);
 void vo_set_paused(struct vo *vo, bool paused);
 int64_t vo_get_drop_count(struct vo *vo);
+double vo_get_render_time(struct vo *vo);
 void vo_increment_drop_count(struct vo *vo, int64_t n);
 int64_t vo_get_delayed_count(struct vo *vo);
 void vo_query_formats(struct vo *vo, uint8_t *list);
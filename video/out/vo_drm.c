@@ -23,8 +23,18 @@
 #include <poll.h>
 #include <unistd.h>
 
+#include <drm_fourcc.h>
 #include <libswscale/swscale.h>
 
+#include "config.h"
+
+#if HAVE_VAAPI_DRM
+#include <va/va_drm.h>
+#include <va/va_drmcommon.h>
+#include "video/hwdec.h"
+#include "video/vaapi.h"
+#endif
+
 #include "drm_common.h"
 
 #include "common/msg.h"
@@ -49,6 +59,29 @@ struct framebuffer {
     uint32_t handle;
     uint8_t *map;
     uint32_t fb;
+    // If set, a buffer of this format for use with planes (--drm-overlay).
+    // Otherwise, a BYTES_PER_PIXEL RGB buffer for legacy modesetting.
+    int imgfmt;
+    uint32_t drm_format;
+    uint32_t pitches[4];
+    uint32_t offsets[4];
+};
+
+// Imported hardware decoded frame. The image reference keeps the decoder
+// from reusing the surface while it's on screen.
+struct hw_frame {
+    struct mp_image *image;
+    uint32_t fb;
+};
+
+// Software formats the display hardware can read directly.
+static const struct {
+    int imgfmt;
+    uint32_t drm_format;
+} overlay_formats[] = {
+    {IMGFMT_NV12,   DRM_FORMAT_NV12},
+    {IMGFMT_420P,   DRM_FORMAT_YUV420},
+    {IMGFMT_BGR0,   DRM_FORMAT_XRGB8888},
 };
 
 struct priv {
@@ -75,8 +108,32 @@ struct priv {
     struct mp_rect dst;
     struct mp_osd_res osd;
     struct mp_sws_context *sws;
+
+    // --drm-overlay: video and OSD on planes, updated with atomic commits
+    bool overlay;
+    struct kms_plane *video_plane;
+    struct kms_plane *osd_plane;    // NULL if the OSD is drawn on the video
+    struct framebuffer video_bufs[BUF_COUNT];
+    struct framebuffer osd_bufs[BUF_COUNT];
+    bool osd_drawn[BUF_COUNT];
+    uint32_t video_fb, osd_fb;      // to show on the next flip (0: disable)
+    bool overlay_visible;           // last commit enabled a plane
+    // next: drawn, not committed yet; queued: committed, flip pending
+    struct hw_frame hw_next, hw_queued, hw_shown;
+#if HAVE_VAAPI_DRM
+    struct mp_vaapi_ctx *va;
+#endif
 };
 
+static uint32_t find_drm_format(int imgfmt)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(overlay_formats); n++) {
+        if (overlay_formats[n].imgfmt == imgfmt)
+            return overlay_formats[n].drm_format;
+    }
+    return 0;
+}
+
 static void fb_destroy(int fd, struct framebuffer *buf)
 {
     if (buf->map) {
@@ -91,17 +148,35 @@ static void fb_destroy(int fd, struct framebuffer *buf)
         };
         drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
     }
+    buf->map = NULL;
+    buf->fb = 0;
+    buf->handle = 0;
 }
 
 static bool fb_setup_single(struct vo *vo, int fd, struct framebuffer *buf)
 {
     buf->handle = 0;
 
+    // Dumb buffers have a single pitch, so planar formats are allocated as
+    // extra lines, with the chroma planes using a fraction of the pitch.
+    struct mp_imgfmt_desc desc = {0};
+    int bpp = BITS_PER_PIXEL;
+    uint32_t height = buf->height;
+    if (buf->drm_format) {
+        desc = mp_imgfmt_get_desc(buf->imgfmt);
+        bpp = desc.bpp[0];
+        height = 0;
+        for (int n = 0; n < desc.num_planes; n++) {
+            uint32_t plane_h = (buf->height + (1 << desc.ys[n]) - 1) >> desc.ys[n];
+            height += (plane_h * (desc.bpp[n] >> desc.xs[n]) + bpp - 1) / bpp;
+        }
+    }
+
     // create dumb buffer
     struct drm_mode_create_dumb creq = {
         .width = buf->width,
-        .height = buf->height,
-        .bpp = BITS_PER_PIXEL,
+        .height = height,
+        .bpp = bpp,
     };
     if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
         MP_ERR(vo, "Cannot create dumb buffer: %s\n", mp_strerror(errno));
@@ -112,8 +187,23 @@ static bool fb_setup_single(struct vo *vo, int fd, struct framebuffer *buf)
     buf->handle = creq.handle;
 
     // create framebuffer object for the dumb-buffer
-    if (drmModeAddFB(fd, buf->width, buf->height, 24, creq.bpp, buf->stride,
-                     buf->handle, &buf->fb)) {
+    if (buf->drm_format) {
+        uint32_t handles[4] = {0};
+        uint32_t offset = 0;
+        for (int n = 0; n < desc.num_planes; n++) {
+            uint32_t plane_h = (buf->height + (1 << desc.ys[n]) - 1) >> desc.ys[n];
+            handles[n] = buf->handle;
+            buf->pitches[n] = buf->stride * (desc.bpp[n] >> desc.xs[n]) / bpp;
+            buf->offsets[n] = offset;
+            offset += buf->pitches[n] * plane_h;
+        }
+        if (drmModeAddFB2(fd, buf->width, buf->height, buf->drm_format,
+                          handles, buf->pitches, buf->offsets, &buf->fb, 0)) {
+            MP_ERR(vo, "Cannot create framebuffer: %s\n", mp_strerror(errno));
+            goto err;
+        }
+    } else if (drmModeAddFB(fd, buf->width, buf->height, 24, creq.bpp,
+                            buf->stride, buf->handle, &buf->fb)) {
         MP_ERR(vo, "Cannot create framebuffer: %s\n", mp_strerror(errno));
         goto err;
     }
@@ -143,6 +233,19 @@ err:
     return false;
 }
 
+// Return an image referencing the memory of a buffer with buf->imgfmt set.
+static struct mp_image fb_get_image(struct framebuffer *buf)
+{
+    struct mp_image img = {0};
+    mp_image_setfmt(&img, buf->imgfmt);
+    mp_image_set_size(&img, buf->width, buf->height);
+    for (int n = 0; n < img.num_planes; n++) {
+        img.planes[n] = buf->map + buf->offsets[n];
+        img.stride[n] = buf->pitches[n];
+    }
+    return img;
+}
+
 static bool fb_setup_double_buffering(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -166,11 +269,91 @@ static bool fb_setup_double_buffering(struct vo *vo)
     return true;
 }
 
+static void hw_frame_release(struct priv *p, struct hw_frame *frame)
+{
+    // Note that removing a framebuffer disables the planes showing it.
+    if (frame->fb)
+        drmModeRmFB(p->kms->fd, frame->fb);
+    talloc_free(frame->image);
+    *frame = (struct hw_frame){0};
+}
+
+#if HAVE_VAAPI_DRM
+static bool va_import(struct vo *vo, struct mp_image *mpi,
+                      struct hw_frame *frame)
+{
+    struct priv *p = vo->priv;
+    VADisplay display = p->va->display;
+    VAImage va_image = { .image_id = VA_INVALID_ID };
+    bool acquired = false, ok = false;
+    VAStatus status;
+
+    status = vaDeriveImage(display, va_surface_id(mpi), &va_image);
+    if (!CHECK_VA_STATUS(vo, "vaDeriveImage()"))
+        goto done;
+
+    if (va_image.format.fourcc != VA_FOURCC_NV12) {
+        MP_ERR(vo, "Unsupported VAAPI surface format.\n");
+        goto done;
+    }
+
+    VABufferInfo buffer_info = {.mem_type = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME};
+    status = vaAcquireBufferHandle(display, va_image.buf, &buffer_info);
+    if (!CHECK_VA_STATUS(vo, "vaAcquireBufferHandle()"))
+        goto done;
+    acquired = true;
+
+    uint32_t handle;
+    if (drmPrimeFDToHandle(p->kms->fd, buffer_info.handle, &handle)) {
+        MP_ERR(vo, "Cannot import VAAPI surface: %s\n", mp_strerror(errno));
+        goto done;
+    }
+
+    uint32_t handles[4] = {handle, handle};
+    uint32_t pitches[4] = {va_image.pitches[0], va_image.pitches[1]};
+    uint32_t offsets[4] = {va_image.offsets[0], va_image.offsets[1]};
+    int ret = drmModeAddFB2(p->kms->fd, va_image.width, va_image.height,
+                            DRM_FORMAT_NV12, handles, pitches, offsets,
+                            &frame->fb, 0);
+    if (ret)
+        MP_ERR(vo, "Cannot create framebuffer: %s\n", mp_strerror(errno));
+
+    // The framebuffer holds its own reference to the buffer object. Closing
+    // the handle right away also avoids trouble with duplicate handles when
+    // the same surface is imported again (drmPrimeFDToHandle returns the
+    // same handle).
+    struct drm_gem_close creq = { .handle = handle };
+    drmIoctl(p->kms->fd, DRM_IOCTL_GEM_CLOSE, &creq);
+
+    if (ret)
+        goto done;
+
+    frame->image = mp_image_new_ref(mpi);
+    ok = true;
+
+done:
+    if (acquired) {
+        status = vaReleaseBufferHandle(display, va_image.buf);
+        CHECK_VA_STATUS(vo, "vaReleaseBufferHandle()");
+    }
+    if (va_image.image_id != VA_INVALID_ID) {
+        status = vaDestroyImage(display, va_image.image_id);
+        CHECK_VA_STATUS(vo, "vaDestroyImage()");
+    }
+    return ok;
+}
+#endif
+
 static void page_flipped(int fd, unsigned int frame, unsigned int sec,
                          unsigned int usec, void *data)
 {
     struct priv *p = data;
     p->pflip_happening = false;
+
+    // The previously shown hardware frame is not scanned out anymore.
+    hw_frame_release(p, &p->hw_shown);
+    p->hw_shown = p->hw_queued;
+    p->hw_queued = (struct hw_frame){0};
 }
 
 static bool crtc_setup(struct vo *vo)
@@ -204,6 +387,22 @@ static void crtc_release(struct vo *vo)
         }
     }
 
+    if (p->overlay) {
+        drmModeAtomicReq *req = drmModeAtomicAlloc();
+        if (req) {
+            kms_plane_atomic_add(p->kms, req, p->video_plane, 0, NULL, NULL);
+            if (p->osd_plane)
+                kms_plane_atomic_add(p->kms, req, p->osd_plane, 0, NULL, NULL);
+            if (drmModeAtomicCommit(p->kms->fd, req, 0, NULL))
+                MP_WARN(vo, "Cannot disable planes: %s\n", mp_strerror(errno));
+            drmModeAtomicFree(req);
+        }
+        p->overlay_visible = false;
+        hw_frame_release(p, &p->hw_next);
+        hw_frame_release(p, &p->hw_queued);
+        hw_frame_release(p, &p->hw_shown);
+    }
+
     if (p->old_crtc) {
         drmModeSetCrtc(p->kms->fd, p->old_crtc->crtc_id,
                        p->old_crtc->buffer_id,
@@ -260,10 +459,54 @@ static void wakeup(struct vo *vo)
         vt_switcher_interrupt_poll(&p->vt_switcher);
 }
 
+static void destroy_video_bufs(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    hw_frame_release(p, &p->hw_next);
+    for (unsigned int i = 0; i < BUF_COUNT; i++)
+        fb_destroy(p->kms->fd, &p->video_bufs[i]);
+    p->video_fb = 0;
+}
+
+static int reconfig_overlay(struct vo *vo, struct mp_image_params *params)
+{
+    struct priv *p = vo->priv;
+
+    // The plane scales the video, and the OSD plane covers the screen.
+    vo->dwidth = p->screen_w;
+    vo->dheight = p->screen_h;
+    vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
+
+    destroy_video_bufs(vo);
+
+    if (params->imgfmt != IMGFMT_VAAPI) {
+        struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(params->imgfmt);
+        for (unsigned int i = 0; i < BUF_COUNT; i++) {
+            p->video_bufs[i] = (struct framebuffer) {
+                .width = MP_ALIGN_UP(params->w, desc.align_x),
+                .height = MP_ALIGN_UP(params->h, desc.align_y),
+                .imgfmt = params->imgfmt,
+                .drm_format = find_drm_format(params->imgfmt),
+            };
+            if (!fb_setup_single(vo, p->kms->fd, &p->video_bufs[i])) {
+                destroy_video_bufs(vo);
+                return -1;
+            }
+        }
+    }
+
+    vo->want_redraw = true;
+    return 0;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *p = vo->priv;
 
+    if (p->overlay)
+        return reconfig_overlay(vo, params);
+
     vo->dwidth = p->screen_w;
     vo->dheight = p->screen_h;
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
@@ -307,11 +550,51 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     return 0;
 }
 
+static void draw_overlay(struct vo *vo, mp_image_t *mpi)
+{
+    struct priv *p = vo->priv;
+
+    hw_frame_release(p, &p->hw_next);
+    p->video_fb = 0;
+
+    if (mpi && mpi->imgfmt == IMGFMT_VAAPI) {
+#if HAVE_VAAPI_DRM
+        if (va_import(vo, mpi, &p->hw_next))
+            p->video_fb = p->hw_next.fb;
+#endif
+    } else if (mpi) {
+        struct framebuffer *buf = &p->video_bufs[p->front_buf];
+        struct mp_image dst = fb_get_image(buf);
+        mp_image_set_size(&dst, mpi->w, mpi->h);
+        mp_image_copy(&dst, mpi);
+        mp_image_copy_attributes(&dst, mpi);
+        if (!p->osd_plane) {
+            osd_draw_on_image(vo->osd, osd_res_from_image_params(&mpi->params),
+                              mpi->pts, 0, &dst);
+        }
+        p->video_fb = buf->fb;
+    }
+
+    if (p->osd_plane) {
+        // Only clear the buffer if something was drawn on it; if the OSD is
+        // empty, the plane is disabled to save memory bandwidth.
+        struct framebuffer *buf = &p->osd_bufs[p->front_buf];
+        struct mp_image osd = fb_get_image(buf);
+        if (p->osd_drawn[p->front_buf])
+            mp_image_clear(&osd, 0, 0, osd.w, osd.h);
+        p->osd_drawn[p->front_buf] =
+            osd_draw_on_image(vo->osd, p->osd, mpi ? mpi->pts : 0, 0, &osd);
+        p->osd_fb = p->osd_drawn[p->front_buf] ? buf->fb : 0;
+    }
+}
+
 static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
-    if (p->active) {
+    if (p->active && p->overlay) {
+        draw_overlay(vo, mpi);
+    } else if (p->active) {
         if (mpi) {
             struct mp_image src = *mpi;
             struct mp_rect src_rc = p->src;
@@ -342,21 +625,63 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     }
 }
 
+static int commit_overlay(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    // A commit that touches no enabled plane would not generate an event.
+    bool visible = p->video_fb || p->osd_fb;
+    if (!visible && !p->overlay_visible)
+        return -1;
+
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req)
+        return -1;
+
+    struct mp_rect screen = {0, 0, p->screen_w, p->screen_h};
+    kms_plane_atomic_add(p->kms, req, p->video_plane, p->video_fb,
+                         &p->src, &p->dst);
+    if (p->osd_plane) {
+        kms_plane_atomic_add(p->kms, req, p->osd_plane, p->osd_fb,
+                             &screen, &screen);
+    }
+
+    int ret = drmModeAtomicCommit(p->kms->fd, req,
+                    DRM_MODE_PAGE_FLIP_EVENT | DRM_MODE_ATOMIC_NONBLOCK, p);
+    drmModeAtomicFree(req);
+    if (ret) {
+        MP_WARN(vo, "Cannot commit planes: %s\n", mp_strerror(errno));
+        return ret;
+    }
+
+    p->overlay_visible = visible;
+    p->hw_queued = p->hw_next;
+    p->hw_next = (struct hw_frame){0};
+    return 0;
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
     if (!p->active || p->pflip_happening)
         return;
 
-    int ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id,
+    int ret;
+    if (p->overlay) {
+        ret = commit_overlay(vo);
+    } else {
+        ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id,
                               p->bufs[p->front_buf].fb,
                               DRM_MODE_PAGE_FLIP_EVENT, p);
-    if (ret) {
-        MP_WARN(vo, "Cannot flip page for connector\n");
-    } else {
+        if (ret)
+            MP_WARN(vo, "Cannot flip page for connector\n");
+    }
+    if (ret == 0) {
         p->front_buf++;
         p->front_buf %= BUF_COUNT;
         p->pflip_happening = true;
+    } else if (p->overlay) {
+        return;
     }
 
     // poll page flip finish event
@@ -381,8 +706,20 @@ static void uninit(struct vo *vo)
     crtc_release(vo);
 
     if (p->kms) {
-        for (unsigned int i = 0; i < BUF_COUNT; i++)
+        destroy_video_bufs(vo);
+        for (unsigned int i = 0; i < BUF_COUNT; i++) {
             fb_destroy(p->kms->fd, &p->bufs[i]);
+            fb_destroy(p->kms->fd, &p->osd_bufs[i]);
+        }
+#if HAVE_VAAPI_DRM
+        if (vo->hwdec_devs) {
+            hwdec_devices_remove(vo->hwdec_devs, &p->va->hwctx);
+            hwdec_devices_destroy(vo->hwdec_devs);
+            vo->hwdec_devs = NULL;
+        }
+        va_destroy(p->va);
+        p->va = NULL;
+#endif
         kms_destroy(p->kms);
         p->kms = NULL;
     }
@@ -394,6 +731,65 @@ static void uninit(struct vo *vo)
     talloc_free(p->cur_frame);
 }
 
+static void setup_overlay(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    if (!kms_enable_atomic(p->kms))
+        goto fail;
+
+    uint32_t formats[MP_ARRAY_SIZE(overlay_formats)];
+    for (int n = 0; n < MP_ARRAY_SIZE(overlay_formats); n++)
+        formats[n] = overlay_formats[n].drm_format;
+    p->video_plane = kms_find_plane(p->kms, p, DRM_PLANE_TYPE_OVERLAY,
+                                    formats, MP_ARRAY_SIZE(formats), 0);
+    if (!p->video_plane) {
+        MP_WARN(vo, "No usable overlay plane found.\n");
+        goto fail;
+    }
+
+    // Note that the planes' stacking order is up to the driver, unless it
+    // supports the zpos property. Usually higher planes are on top.
+    uint32_t osd_format = DRM_FORMAT_ARGB8888;
+    p->osd_plane = kms_find_plane(p->kms, p, DRM_PLANE_TYPE_OVERLAY,
+                                  &osd_format, 1, p->video_plane->id);
+    for (unsigned int i = 0; p->osd_plane && i < BUF_COUNT; i++) {
+        p->osd_bufs[i] = (struct framebuffer) {
+            .width = p->screen_w,
+            .height = p->screen_h,
+            .imgfmt = IMGFMT_BGRA,
+            .drm_format = osd_format,
+        };
+        if (!fb_setup_single(vo, p->kms->fd, &p->osd_bufs[i])) {
+            for (unsigned int j = 0; j < i; j++)
+                fb_destroy(p->kms->fd, &p->osd_bufs[j]);
+            TA_FREEP(&p->osd_plane);
+        }
+    }
+    if (!p->osd_plane)
+        MP_VERBOSE(vo, "No OSD plane, drawing OSD on the video.\n");
+
+#if HAVE_VAAPI_DRM
+    VADisplay display = vaGetDisplayDRM(p->kms->fd);
+    if (display) {
+        p->va = va_initialize(display, vo->log, true);
+        if (!p->va)
+            vaTerminate(display);
+    }
+    if (p->va) {
+        vo->hwdec_devs = hwdec_devices_create();
+        hwdec_devices_add(vo->hwdec_devs, &p->va->hwctx);
+    }
+#endif
+
+    MP_VERBOSE(vo, "Using overlay plane %u.\n", p->video_plane->id);
+    p->overlay = true;
+    return;
+
+fail:
+    MP_WARN(vo, "Falling back to legacy modesetting.\n");
+}
+
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -436,6 +832,9 @@ static int preinit(struct vo *vo)
         goto err;
     }
 
+    if (vo->opts->drm_overlay)
+        setup_overlay(vo);
+
     return 0;
 
 err:
@@ -445,6 +844,16 @@ err:
 
 static int query_format(struct vo *vo, int format)
 {
+    struct priv *p = vo->priv;
+
+    if (p->overlay) {
+#if HAVE_VAAPI_DRM
+        if (format == IMGFMT_VAAPI)
+            return !!p->va;
+#endif
+        uint32_t drm_format = find_drm_format(format);
+        return drm_format && kms_plane_has_format(p->video_plane, drm_format);
+    }
     return sws_isSupportedInput(imgfmt2pixfmt(format));
 }
 
@@ -453,6 +862,8 @@ static int control(struct vo *vo, uint32_t request, void *arg)
     struct priv *p = vo->priv;
     switch (request) {
     case VOCTRL_SCREENSHOT_WIN:
+        if (!p->cur_frame)
+            break;
         *(struct mp_image**)arg = mp_image_new_copy(p->cur_frame);
         return VO_TRUE;
     case VOCTRL_REDRAW_FRAME:
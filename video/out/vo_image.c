@@ -21,11 +21,14 @@
 #include <math.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
+#include <libavutil/cpu.h>
 
 #include "config.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/m_config.h"
 #include "options/path.h"
@@ -50,6 +53,7 @@ static const struct m_sub_options image_writer_conf = {
 struct vo_image_opts {
     struct image_writer_opts *opts;
     char *outdir;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct vo_image_opts
@@ -58,16 +62,35 @@ static const struct m_sub_options vo_image_conf = {
     .opts = (const struct m_option[]) {
         OPT_SUBSTRUCT("vo-image", opts, image_writer_conf, 0),
         OPT_STRING("vo-image-outdir", outdir, 0),
+        OPT_INTRANGE("vo-image-threads", threads, 0, 0, 64),
         {0},
     },
     .size = sizeof(struct vo_image_opts),
 };
 
+// Frames queued per worker thread before flip_page() blocks.
+#define FRAMES_PER_THREAD 2
+
 struct priv {
     struct vo_image_opts *opts;
 
     struct mp_image *current;
     int frame;
+
+    // Each frame is encoded and written by a worker, since encoding (PNG in
+    // particular) is much slower than anything else this VO does.
+    struct mp_thread_pool *pool;
+    int max_pending;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int num_pending;            // protected by lock
+};
+
+struct write_job {
+    struct vo *vo;
+    struct mp_image *image;
+    char *filename;
 };
 
 static bool checked_mkdir(struct vo *vo, const char *buf)
@@ -104,6 +127,24 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, p->current);
 }
 
+// Runs on a worker thread. Every frame goes to its own file, so the jobs need
+// no ordering among each other.
+static void write_job_run(void *ctx)
+{
+    struct write_job *job = ctx;
+    struct vo *vo = job->vo;
+    struct priv *p = vo->priv;
+
+    write_image(job->image, p->opts->opts, job->filename, vo->log);
+
+    pthread_mutex_lock(&p->lock);
+    p->num_pending--;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    talloc_free(job);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -120,10 +161,28 @@ static void flip_page(struct vo *vo)
         filename = mp_path_join(t, p->opts->outdir, filename);
 
     MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->log);
 
+    struct write_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct write_job){
+        .vo = vo,
+        .image = talloc_steal(job, p->current),
+        .filename = talloc_strdup(job, filename),
+    };
+    p->current = NULL;
     talloc_free(t);
-    mp_image_unrefp(&p->current);
+
+    // Backpressure: don't let encoding fall arbitrarily behind decoding.
+    pthread_mutex_lock(&p->lock);
+    while (p->num_pending >= p->max_pending)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    p->num_pending++;
+    pthread_mutex_unlock(&p->lock);
+
+    if (p->pool) {
+        mp_thread_pool_queue(p->pool, write_job_run, job);
+    } else {
+        write_job_run(job);
+    }
 }
 
 static int query_format(struct vo *vo, int fmt)
@@ -137,7 +196,13 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    // Waits until all queued frames are written.
+    talloc_free(p->pool);
+    p->pool = NULL;
+
     mp_image_unrefp(&p->current);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
 }
 
 static int preinit(struct vo *vo)
@@ -146,6 +211,18 @@ static int preinit(struct vo *vo)
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
     if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
         return -1;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
+    int threads = p->opts->threads ? p->opts->threads : av_cpu_count();
+    threads = MPMAX(threads, 1);
+    p->max_pending = threads * FRAMES_PER_THREAD;
+    if (threads > 1) {
+        p->pool = mp_thread_pool_create(vo, threads);
+        if (!p->pool)
+            MP_WARN(vo, "Could not create worker threads, encoding serially.\n");
+    }
     return 0;
 }
 
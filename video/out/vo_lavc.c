@@ -55,9 +55,17 @@ struct priv {
     AVRational worst_time_base;
     int worst_time_base_is_stream;
 
+    struct encode_worker *worker;
+
+    // For hardware input, the encoder is opened on the first frame, because
+    // it needs the frame's hw_frames_ctx.
+    bool codec_pending;
+
     bool shutdown;
 };
 
+static void on_packet(void *priv, AVPacket *packet, AVFrame *frame);
+
 static int preinit(struct vo *vo)
 {
     struct priv *vc;
@@ -80,16 +88,45 @@ static void uninit(struct vo *vo)
 
     pthread_mutex_lock(&vo->encode_lavc_ctx->lock);
 
-    if (vc->lastipts >= 0 && vc->stream)
+    if (vc->lastipts >= 0 && vc->stream) {
         draw_image_unlocked(vo, NULL);
+        encode_worker_drain(vc->worker);
+    }
 
     mp_image_unrefp(&vc->lastimg);
 
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
 
+    encode_worker_destroy(vc->worker);
+    vc->worker = NULL;
+
     vc->shutdown = true;
 }
 
+// hwimg: first frame, for hardware input; NULL otherwise
+static bool open_codec(struct vo *vo, struct mp_image *hwimg)
+{
+    struct priv *vc = vo->priv;
+
+    if (hwimg) {
+        if (!hwimg->hwctx) {
+            MP_ERR(vo, "hardware frame without frames context.\n");
+            return false;
+        }
+        // The encoder reads the decoder's surfaces directly.
+        vc->codec->hw_frames_ctx = av_buffer_ref(hwimg->hwctx);
+        if (!vc->codec->hw_frames_ctx)
+            return false;
+    }
+
+    if (encode_lavc_open_codec(vo->encode_lavc_ctx, vc->codec) < 0)
+        return false;
+
+    vc->worker = encode_worker_create(vo->encode_lavc_ctx, vo->log, vc->codec,
+                                      on_packet, vo);
+    return !!vc->worker;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *vc = vo->priv;
@@ -158,8 +195,11 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     encode_lavc_set_csp(vo->encode_lavc_ctx, vc->codec, params->color.space);
     encode_lavc_set_csp_levels(vo->encode_lavc_ctx, vc->codec, params->color.levels);
 
-    if (encode_lavc_open_codec(vo->encode_lavc_ctx, vc->codec) < 0)
+    if (IMGFMT_IS_HWACCEL(params->imgfmt)) {
+        vc->codec_pending = true;
+    } else if (!open_codec(vo, NULL)) {
         goto error;
+    }
 
 done:
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
@@ -236,45 +276,10 @@ static void write_packet(struct vo *vo, AVPacket *packet)
     vc->have_first_packet = 1;
 }
 
-static void encode_video_and_write(struct vo *vo, AVFrame *frame)
+// Called on the encoder thread, with the encode_lavc_context lock held.
+static void on_packet(void *priv, AVPacket *packet, AVFrame *frame)
 {
-    struct priv *vc = vo->priv;
-    AVPacket packet = {0};
-
-    int status = avcodec_send_frame(vc->codec, frame);
-    if (status < 0) {
-        MP_ERR(vo, "error encoding at %d %d/%d\n",
-               frame ? (int) frame->pts : -1,
-               vc->codec->time_base.num,
-               vc->codec->time_base.den);
-        return;
-    }
-    for (;;) {
-        av_init_packet(&packet);
-        status = avcodec_receive_packet(vc->codec, &packet);
-        if (status == AVERROR(EAGAIN)) { // No more packets for now.
-            if (frame == NULL) {
-                MP_ERR(vo, "sent flush frame, got EAGAIN");
-            }
-            break;
-        }
-        if (status == AVERROR_EOF) { // No more packets, ever.
-            if (frame != NULL) {
-                MP_ERR(vo, "sent image frame, got EOF");
-            }
-            break;
-        }
-        if (status < 0) {
-            MP_ERR(vo, "error encoding at %d %d/%d\n",
-                   frame ? (int) frame->pts : -1,
-                   vc->codec->time_base.num,
-                   vc->codec->time_base.den);
-            break;
-        }
-        encode_lavc_write_stats(vo->encode_lavc_ctx, vc->codec);
-        write_packet(vo, &packet);
-        av_packet_unref(&packet);
-    }
+    write_packet(priv, packet);
 }
 
 static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
@@ -289,6 +294,13 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 
     if (!vc || vc->shutdown)
         goto done;
+    if (vc->codec_pending && mpi) {
+        vc->codec_pending = false;
+        if (!open_codec(vo, mpi)) {
+            vc->shutdown = true;
+            goto done;
+        }
+    }
     if (!encode_lavc_start(ectx)) {
         MP_WARN(vo, "NOTE: skipped initial video frame (probably because audio is not there yet)\n");
         goto done;
@@ -429,8 +441,7 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
                                           vc->worst_time_base, avc->time_base);
                 frame->pict_type = 0; // keep this at unknown/undefined
                 frame->quality = avc->global_quality;
-                encode_video_and_write(vo, frame);
-                av_frame_free(&frame);
+                encode_worker_queue(vc->worker, frame);
 
                 ++vc->lastdisplaycount;
                 vc->lastencodedipts = vc->lastipts + skipframes;
@@ -442,7 +453,7 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 
     if (!mpi) {
         // finish encoding
-        encode_video_and_write(vo, NULL);
+        encode_worker_queue(vc->worker, NULL);
     } else {
         if (frameipts >= vc->lastframeipts) {
             if (vc->lastframeipts != AV_NOPTS_VALUE && vc->lastdisplaycount != 1)
@@ -466,7 +477,10 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
         }
     }
 
-    if (vc->lastimg && vc->lastimg_wants_osd && vo->params) {
+    // No OSD on hardware surfaces.
+    if (vc->lastimg && vc->lastimg_wants_osd && vo->params &&
+        !(vc->lastimg->fmt.flags & MP_IMGFLAG_HWACCEL))
+    {
         struct mp_osd_res dim = osd_res_from_image_params(vo->params);
 
         osd_draw_on_image(vo->osd, dim, vc->lastimg->pts, OSD_DRAW_SUB_ONLY,
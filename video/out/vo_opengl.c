@@ -134,6 +134,13 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
         gl->Finish();
 }
 
+static bool render_ahead(struct vo *vo, struct vo_frame *frame)
+{
+    struct gl_priv *p = vo->priv;
+
+    return gl_video_render_ahead(p->renderer, frame);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct gl_priv *p = vo->priv;
@@ -172,6 +179,13 @@ static void flip_page(struct vo *vo)
     }
 }
 
+static void get_vsync(struct vo *vo, struct vo_vsync_info *info)
+{
+    struct gl_priv *p = vo->priv;
+
+    mpgl_get_vsync(p->glctx, info);
+}
+
 static int query_format(struct vo *vo, int format)
 {
     struct gl_priv *p = vo->priv;
@@ -194,6 +208,14 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     return 0;
 }
 
+static struct mp_image *get_image(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align)
+{
+    struct gl_priv *p = vo->priv;
+
+    return gl_video_get_image(p->renderer, imgfmt, w, h, stride_align);
+}
+
 static void request_hwdec_api(struct vo *vo, void *api)
 {
     struct gl_priv *p = vo->priv;
@@ -315,6 +337,8 @@ static int control(struct vo *vo, uint32_t request, void *data)
         get_and_update_ambient_lighting(p);
         vo->want_redraw = true;
     }
+    if (gl_video_lut3d_ready(p->renderer))
+        vo->want_redraw = true;
     events |= p->events;
     p->events = 0;
     if (events & VO_EVENT_RESIZE)
@@ -333,6 +357,12 @@ static void wakeup(struct vo *vo)
         p->glctx->driver->wakeup(p->glctx);
 }
 
+static void lut3d_ready_cb(void *ctx)
+{
+    struct vo *vo = ctx;
+    vo_wakeup(vo);
+}
+
 static void wait_events(struct vo *vo, int64_t until_time_us)
 {
     struct gl_priv *p = vo->priv;
@@ -397,6 +427,7 @@ static int preinit(struct vo *vo)
         goto err_out;
     gl_video_set_osd_source(p->renderer, vo->osd);
     gl_video_configure_queue(p->renderer, vo);
+    gl_video_set_lut3d_wakeup_cb(p->renderer, lut3d_ready_cb, vo);
 
     get_and_update_icc_profile(p);
 
@@ -425,8 +456,11 @@ const struct vo_driver video_out_opengl = {
     .query_format = query_format,
     .reconfig = reconfig,
     .control = control,
+    .get_image = get_image,
     .draw_frame = draw_frame,
+    .render_ahead = render_ahead,
     .flip_page = flip_page,
+    .get_vsync = get_vsync,
     .wait_events = wait_events,
     .wakeup = wakeup,
     .uninit = uninit,
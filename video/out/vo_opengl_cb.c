@@ -50,6 +50,13 @@ struct vo_priv {
     struct mpv_opengl_cb_context *ctx;
 };
 
+// A frame passed to draw_frame(), waiting for mpv_opengl_cb_draw().
+struct queued_frame {
+    struct vo_frame *frame;
+    int64_t id;                     // see presented_id
+    int64_t target;                 // mp_time_us() the frame should be shown
+};
+
 struct mpv_opengl_cb_context {
     struct mp_log *log;
     struct mpv_global *global;
@@ -62,11 +69,17 @@ struct mpv_opengl_cb_context {
     bool initialized;
     mpv_opengl_cb_update_fn update_cb;
     void *update_cb_ctx;
-    struct vo_frame *next_frame;    // next frame to draw
-    int64_t present_count;          // incremented when next frame can be shown
-    int64_t expected_flip_count;    // next vsync event for next_frame
-    bool redrawing;                 // next_frame was a redraw request
+    struct queued_frame *queue;     // frames to draw, oldest first
+    int num_queue;
+    int queue_size;                 // --opengl-cb-queue-size
+    int64_t queued_id;              // ID of the last queued frame
+    int64_t presented_id;           // ID of the last frame that can be shown
+    int64_t present_time;           // mp_time_us() of the last flip_page()
+    int64_t expected_flip_count;    // next vsync event for the last frame
+    bool redrawing;                 // last frame was a redraw request
     int64_t flip_count;
+    int64_t drawn_target;           // target time of the last drawn frame
+    struct mpv_opengl_cb_stats stats;
     struct vo_frame *cur_frame;
     struct mp_image_params img_params;
     bool reconfigured, reset;
@@ -97,6 +110,10 @@ static void update(struct vo_priv *p);
 
 static void forget_frames(struct mpv_opengl_cb_context *ctx, bool all)
 {
+    for (int n = 0; n < ctx->num_queue; n++)
+        talloc_free(ctx->queue[n].frame);
+    ctx->num_queue = 0;
+    ctx->presented_id = ctx->queued_id;
     pthread_cond_broadcast(&ctx->wakeup);
     if (all) {
         talloc_free(ctx->cur_frame);
@@ -283,28 +300,47 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
     }
     ctx->eq_changed = false;
 
-    struct vo_frame *frame = ctx->next_frame;
-    int64_t wait_present_count = ctx->present_count;
-    if (frame) {
-        ctx->next_frame = NULL;
+    // Skip frames that are late, i.e. if the following frame is due already.
+    // Display-synced frames are never skipped; they're shown one per vsync.
+    int64_t now = mp_time_us();
+    while (ctx->num_queue > 1) {
+        struct queued_frame *next = &ctx->queue[1];
+        if (next->id > ctx->presented_id || next->frame->display_synced ||
+            next->target > now)
+            break;
+        talloc_free(ctx->queue[0].frame);
+        MP_TARRAY_REMOVE_AT(ctx->queue, ctx->num_queue, 0);
+        ctx->stats.dropped_late += 1;
+        if (vo)
+            vo_increment_drop_count(vo, 1);
+    }
+
+    struct vo_frame *frame = NULL;
+    int64_t wait_id = 0, target = 0;
+    if (ctx->num_queue) {
+        struct queued_frame qf = ctx->queue[0];
+        MP_TARRAY_REMOVE_AT(ctx->queue, ctx->num_queue, 0);
+        frame = qf.frame;
+        target = qf.target;
         if (!(frame->redraw || !frame->current))
-            wait_present_count += 1;
-        pthread_cond_signal(&ctx->wakeup);
+            wait_id = qf.id;
+        pthread_cond_broadcast(&ctx->wakeup);
         talloc_free(ctx->cur_frame);
         ctx->cur_frame = vo_frame_ref(frame);
     } else {
         frame = vo_frame_ref(ctx->cur_frame);
         if (frame)
             frame->redraw = true;
-        MP_STATS(ctx, "glcb-noframe");
+        MP_STATS_SIGNAL(ctx, "glcb-noframe");
     }
     struct vo_frame dummy = {0};
     if (!frame)
         frame = &dummy;
+    ctx->stats.queue_depth = ctx->num_queue;
 
     pthread_mutex_unlock(&ctx->lock);
 
-    MP_STATS(ctx, "glcb-render");
+    MP_STATS_SIGNAL(ctx, "glcb-render");
     gl_video_render_frame(ctx->renderer, frame, fbo);
 
     gl_video_unset_gl_state(ctx->renderer);
@@ -312,9 +348,19 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
     if (frame != &dummy)
         talloc_free(frame);
 
+    int64_t end = mp_time_us();
+
     pthread_mutex_lock(&ctx->lock);
-    while (wait_present_count > ctx->present_count)
+    while (wait_id > ctx->presented_id)
         pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    if (wait_id) {
+        // Display-synced frames are due when flip_page() is called.
+        if (!target)
+            target = ctx->present_time;
+        ctx->drawn_target = target;
+        ctx->stats.draw_latency = end - target;
+        ctx->stats.frames_drawn += 1;
+    }
     pthread_mutex_unlock(&ctx->lock);
 
     return 0;
@@ -322,16 +368,31 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
 
 int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time)
 {
-    MP_STATS(ctx, "glcb-reportflip");
+    MP_STATS_SIGNAL(ctx, "glcb-reportflip");
+
+    if (!time)
+        time = mp_time_us();
 
     pthread_mutex_lock(&ctx->lock);
     ctx->flip_count += 1;
+    if (ctx->drawn_target)
+        ctx->stats.flip_latency = time - ctx->drawn_target;
+    ctx->drawn_target = 0;
     pthread_cond_signal(&ctx->wakeup);
     pthread_mutex_unlock(&ctx->lock);
 
     return 0;
 }
 
+int mpv_opengl_cb_get_stats(mpv_opengl_cb_context *ctx,
+                            mpv_opengl_cb_stats *stats)
+{
+    pthread_mutex_lock(&ctx->lock);
+    *stats = ctx->stats;
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
 // Called locked.
 static void update(struct vo_priv *p)
 {
@@ -342,14 +403,20 @@ static void update(struct vo_priv *p)
 static void draw_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct vo_priv *p = vo->priv;
+    struct mpv_opengl_cb_context *ctx = p->ctx;
 
-    pthread_mutex_lock(&p->ctx->lock);
-    assert(!p->ctx->next_frame);
-    p->ctx->next_frame = vo_frame_ref(frame);
-    p->ctx->expected_flip_count = p->ctx->flip_count + 1;
-    p->ctx->redrawing = frame->redraw || !frame->current;
+    pthread_mutex_lock(&ctx->lock);
+    assert(ctx->num_queue < ctx->queue_size);
+    struct queued_frame qf = {
+        .frame = vo_frame_ref(frame),
+        .id = ++ctx->queued_id,
+        .target = frame->display_synced ? 0 : frame->pts,
+    };
+    MP_TARRAY_APPEND(ctx, ctx->queue, ctx->num_queue, qf);
+    ctx->expected_flip_count = ctx->flip_count + 1;
+    ctx->redrawing = frame->redraw || !frame->current;
     update(p);
-    pthread_mutex_unlock(&p->ctx->lock);
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 static void flip_page(struct vo *vo)
@@ -359,21 +426,29 @@ static void flip_page(struct vo *vo)
 
     pthread_mutex_lock(&p->ctx->lock);
 
-    // Wait until frame was rendered
-    while (p->ctx->next_frame) {
+    // The last queued frame can be shown now. Unblock mpv_opengl_cb_draw().
+    p->ctx->presented_id = p->ctx->queued_id;
+    p->ctx->present_time = mp_time_us();
+    for (int n = 0; n < p->ctx->num_queue; n++) {
+        struct queued_frame *qf = &p->ctx->queue[n];
+        if (!qf->target)
+            qf->target = p->ctx->present_time;
+    }
+    pthread_cond_broadcast(&p->ctx->wakeup);
+
+    // Wait until there is room for the next frame. With the default queue
+    // size of 1, this means until the frame was rendered.
+    while (p->ctx->num_queue >= p->ctx->queue_size) {
         if (pthread_cond_timedwait(&p->ctx->wakeup, &p->ctx->lock, &ts)) {
-            if (p->ctx->next_frame) {
+            if (p->ctx->num_queue >= p->ctx->queue_size) {
                 MP_VERBOSE(vo, "mpv_opengl_cb_draw() not being called or stuck.\n");
                 goto done;
             }
         }
     }
 
-    // Unblock mpv_opengl_cb_draw().
-    p->ctx->present_count += 1;
-    pthread_cond_signal(&p->ctx->wakeup);
-
-    if (p->ctx->redrawing)
+    // With queued frames, vsync blocking is done by the queue being full.
+    if (p->ctx->redrawing || p->ctx->queue_size > 1)
         goto done; // do not block for redrawing
 
     // Wait until frame was presented
@@ -391,12 +466,11 @@ static void flip_page(struct vo *vo)
 done:
 
     // Cleanup after the API user is not reacting, or is being unusually slow.
-    if (p->ctx->next_frame) {
+    while (p->ctx->num_queue >= p->ctx->queue_size) {
         talloc_free(p->ctx->cur_frame);
-        p->ctx->cur_frame = p->ctx->next_frame;
-        p->ctx->next_frame = NULL;
-        p->ctx->present_count += 2;
-        pthread_cond_signal(&p->ctx->wakeup);
+        p->ctx->cur_frame = p->ctx->queue[0].frame;
+        MP_TARRAY_REMOVE_AT(p->ctx->queue, p->ctx->num_queue, 0);
+        p->ctx->stats.dropped_timeout += 1;
         vo_increment_drop_count(vo, 1);
     }
 
@@ -507,6 +581,7 @@ static int preinit(struct vo *vo)
         return -1;
     }
     p->ctx->active = vo;
+    p->ctx->queue_size = vo->opts->opengl_cb_queue_size;
     p->ctx->reconfigured = true;
     p->ctx->update_new_opts = true;
     memset(p->ctx->eq.values, 0, sizeof(p->ctx->eq.values));
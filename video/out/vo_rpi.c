@@ -259,7 +259,7 @@ static void update_osd(struct vo *vo)
     }
     p->osd_change_counter = osd_change_counter;
 
-    MP_STATS(vo, "start rpi_osd");
+    MP_STATS_START(vo, "rpi_osd");
 
     p->egl.gl->ClearColor(0, 0, 0, 0);
     p->egl.gl->Clear(GL_COLOR_BUFFER_BIT);
@@ -284,13 +284,13 @@ static void update_osd(struct vo *vo)
         default:
             abort();
         }
-        gl_sc_set_vao(p->sc, mpgl_osd_get_vao(p->osd));
+        mpgl_osd_set_shader(p->osd, p->sc, n);
         gl_sc_generate(p->sc);
         mpgl_osd_draw_part(p->osd, p->osd_res.w, -p->osd_res.h, n);
         gl_sc_reset(p->sc);
     }
 
-    MP_STATS(vo, "stop rpi_osd");
+    MP_STATS_END(vo, "rpi_osd");
 }
 
 static void resize(struct vo *vo)
@@ -637,7 +637,8 @@ static void disable_renderer(struct vo *vo)
 
         mmal_component_disable(p->renderer);
     }
-    mmal_pool_destroy(p->swpool);
+    if (p->swpool)
+        mmal_port_pool_destroy(p->renderer->input[0], p->swpool);
     p->swpool = NULL;
     p->renderer_enabled = false;
 }
@@ -660,6 +661,13 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     input->format->es->video.par = (MMAL_RATIONAL_T){params->p_w, params->p_h};
     input->format->es->video.color_space = map_csp(params->color.space);
 
+    // Allocate the software frame buffers in memory shared with the
+    // VideoCore, so that they are not copied again when passed to it.
+    if (!opaque &&
+        mmal_port_parameter_set_boolean(input, MMAL_PARAMETER_ZERO_COPY,
+                                        MMAL_TRUE))
+        MP_WARN(vo, "Could not enable zero-copy buffers.\n");
+
     if (mmal_port_format_commit(input))
         return -1;
 
@@ -675,7 +683,8 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
             return -1;
         }
 
-        p->swpool = mmal_pool_create(input->buffer_num, input->buffer_size);
+        p->swpool = mmal_port_pool_create(input, input->buffer_num,
+                                          input->buffer_size);
         if (!p->swpool) {
             MP_FATAL(vo, "Could not allocate buffer pool.\n");
             return -1;
@@ -152,13 +152,20 @@ const struct keymap_entry keys[] = {
     {SDLK_F24, MP_KEY_F + 24}
 };
 
+// Number of video textures used in turn, so that uploading a new frame does not
+// have to wait until the GPU is done with the previously displayed one.
+#define MAX_VIDEO_TEXTURES 3
+
 struct priv {
     bool reinit_renderer;
     SDL_Window *window;
     SDL_Renderer *renderer;
     int renderer_index;
     SDL_RendererInfo renderer_info;
-    SDL_Texture *tex;
+    SDL_Texture *tex;   // the texture with the current frame (one of texs[])
+    SDL_Texture *texs[MAX_VIDEO_TEXTURES];
+    int num_texs;
+    int tex_index;
     int tex_swapped;
     struct mp_image_params params;
     struct mp_rect src_rect;
@@ -188,7 +195,8 @@ struct priv {
     int vsync;
 };
 
-static bool lock_texture(struct vo *vo, struct mp_image *texmpi)
+static bool lock_texture(struct vo *vo, SDL_Texture *tex,
+                         struct mp_image *texmpi)
 {
     struct priv *vc = vo->priv;
     *texmpi = (struct mp_image){0};
@@ -204,7 +212,7 @@ static bool lock_texture(struct vo *vo, struct mp_image *texmpi)
     }
     void *pixels;
     int pitch;
-    if (SDL_LockTexture(vc->tex, NULL, &pixels, &pitch)) {
+    if (SDL_LockTexture(tex, NULL, &pixels, &pitch)) {
         MP_ERR(vo, "SDL_LockTexture failed\n");
         return false;
     }
@@ -230,6 +238,46 @@ static bool lock_texture(struct vo *vo, struct mp_image *texmpi)
     return true;
 }
 
+static void destroy_video_textures(struct vo *vo)
+{
+    struct priv *vc = vo->priv;
+
+    for (int n = 0; n < vc->num_texs; n++)
+        SDL_DestroyTexture(vc->texs[n]);
+    vc->num_texs = 0;
+    vc->tex = NULL;
+}
+
+// Upload the frame to the texture. SDL_Update*Texture() can upload from the
+// frame memory directly, while with SDL_LockTexture() the frame is first copied
+// into a staging buffer for streaming textures, which is uploaded on unlock.
+static bool upload_video(struct vo *vo, SDL_Texture *tex, struct mp_image *mpi)
+{
+    bool direct = true;
+    for (int n = 0; n < mpi->num_planes; n++)
+        direct &= mpi->stride[n] > 0;
+
+    if (direct && mpi->num_planes == 1) {
+        if (SDL_UpdateTexture(tex, NULL, mpi->planes[0], mpi->stride[0]) == 0)
+            return true;
+    }
+#if SDL_VERSION_ATLEAST(2, 0, 1)
+    if (direct && mpi->num_planes == 3) {
+        if (SDL_UpdateYUVTexture(tex, NULL, mpi->planes[0], mpi->stride[0],
+                                 mpi->planes[1], mpi->stride[1],
+                                 mpi->planes[2], mpi->stride[2]) == 0)
+            return true;
+    }
+#endif
+
+    mp_image_t texmpi;
+    if (!lock_texture(vo, tex, &texmpi))
+        return false;
+    mp_image_copy(&texmpi, mpi);
+    SDL_UnlockTexture(tex);
+    return true;
+}
+
 static bool is_good_renderer(SDL_RendererInfo *ri,
                              const char *driver_name_wanted, int allow_sw,
                              struct formatmap_entry *osd_format)
@@ -260,10 +308,7 @@ static void destroy_renderer(struct vo *vo)
     struct priv *vc = vo->priv;
 
     // free ALL the textures
-    if (vc->tex) {
-        SDL_DestroyTexture(vc->tex);
-        vc->tex = NULL;
-    }
+    destroy_video_textures(vo);
 
     int i, j;
     for (i = 0; i < MAX_OSD_PARTS; ++i) {
@@ -472,8 +517,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
             return -1;
     }
 
-    if (vc->tex)
-        SDL_DestroyTexture(vc->tex);
+    destroy_video_textures(vo);
     Uint32 texfmt = SDL_PIXELFORMAT_UNKNOWN;
     int i, j;
     for (i = 0; i < vc->renderer_info.num_texture_formats; ++i)
@@ -487,24 +531,32 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     }
 
     vc->tex_swapped = texfmt == SDL_PIXELFORMAT_YV12;
-    vc->tex = SDL_CreateTexture(vc->renderer, texfmt,
-                                SDL_TEXTUREACCESS_STREAMING,
-                                params->w, params->h);
-    if (!vc->tex) {
-        MP_ERR(vo, "Could not create a texture\n");
-        return -1;
-    }
-
     vc->params = *params;
 
-    struct mp_image tmp;
-    if (!lock_texture(vo, &tmp)) {
-        SDL_DestroyTexture(vc->tex);
-        vc->tex = NULL;
-        return -1;
+    // The software renderer can't stall on textures in use.
+    int num_texs = vc->renderer_info.flags & SDL_RENDERER_SOFTWARE
+                   ? 1 : MAX_VIDEO_TEXTURES;
+    for (int n = 0; n < num_texs; n++) {
+        SDL_Texture *tex = SDL_CreateTexture(vc->renderer, texfmt,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             params->w, params->h);
+        if (!tex) {
+            MP_ERR(vo, "Could not create a texture\n");
+            destroy_video_textures(vo);
+            return -1;
+        }
+        vc->texs[vc->num_texs++] = tex;
+
+        struct mp_image tmp;
+        if (!lock_texture(vo, tex, &tmp)) {
+            destroy_video_textures(vo);
+            return -1;
+        }
+        mp_image_clear(&tmp, 0, 0, tmp.w, tmp.h);
+        SDL_UnlockTexture(tex);
     }
-    mp_image_clear(&tmp, 0, 0, tmp.w, tmp.h);
-    SDL_UnlockTexture(vc->tex);
+    vc->tex_index = 0;
+    vc->tex = vc->texs[0];
 
     resize(vo, win_w, win_h);
 
@@ -877,6 +929,18 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     SDL_SetRenderDrawColor(vc->renderer, color_add, color_add, color_add, 255);
     SDL_RenderClear(vc->renderer);
 
+    if (mpi) {
+        vc->osd_pts = mpi->pts;
+
+        vc->tex_index = (vc->tex_index + 1) % vc->num_texs;
+        SDL_Texture *tex = vc->texs[vc->tex_index];
+        bool ok = upload_video(vo, tex, mpi);
+        talloc_free(mpi);
+        if (!ok)
+            return;
+        vc->tex = tex;
+    }
+
     // use additive blending for the video texture only if the clear color is
     // not black (faster especially for the software renderer)
     if (color_add)
@@ -884,22 +948,6 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     else
         SDL_SetTextureBlendMode(vc->tex, SDL_BLENDMODE_NONE);
 
-    if (mpi) {
-        vc->osd_pts = mpi->pts;
-
-        mp_image_t texmpi;
-        if (!lock_texture(vo, &texmpi)) {
-            talloc_free(mpi);
-            return;
-        }
-
-        mp_image_copy(&texmpi, mpi);
-
-        SDL_UnlockTexture(vc->tex);
-
-        talloc_free(mpi);
-    }
-
     SDL_Rect src, dst;
     src.x = vc->src_rect.x0;
     src.y = vc->src_rect.y0;
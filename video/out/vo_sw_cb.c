@@ -0,0 +1,354 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "options/options.h"
+#include "player/client.h"
+#include "sub/osd.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+#include "vo.h"
+
+#include "libmpv/sw_cb.h"
+
+/*
+ * Like mpv_opengl_cb_context, mpv_sw_cb_context is owned by the host
+ * application, and outlives the VO. The VO renders directly into the
+ * registered buffers, and calls the presentation callback without holding
+ * the lock, so that the callback can release buffers.
+ */
+
+struct sw_buffer {
+    void *data;
+    ptrdiff_t stride;
+    bool busy;                      // owned by the API user
+};
+
+struct mpv_sw_cb_context {
+    struct mp_log *log;
+    struct mp_client_api *client_api;
+
+    pthread_mutex_t lock;
+
+    // --- Protected by lock
+    bool initialized;
+    int imgfmt, w, h;
+    mpv_sw_cb_present_fn present_cb;
+    void *present_ctx;
+    struct sw_buffer *buffers;
+    int num_buffers;
+    struct vo *active;
+};
+
+struct vo_priv {
+    struct mpv_sw_cb_context *ctx;
+    struct mp_sws_context *sws;
+    struct mp_rect src, dst;
+    struct mp_osd_res osd;
+    int drawn;                      // buffer rendered, but not presented yet
+    double drawn_pts;
+};
+
+static void free_ctx(void *ptr)
+{
+    struct mpv_sw_cb_context *ctx = ptr;
+
+    // This can trigger if the client API user doesn't call
+    // mpv_sw_cb_uninit() properly.
+    assert(!ctx->initialized);
+
+    pthread_mutex_destroy(&ctx->lock);
+}
+
+struct mpv_sw_cb_context *mp_sw_cb_create(struct mpv_global *g,
+                                          struct mp_client_api *client_api)
+{
+    struct mpv_sw_cb_context *ctx = talloc_zero(NULL, struct mpv_sw_cb_context);
+    talloc_set_destructor(ctx, free_ctx);
+    pthread_mutex_init(&ctx->lock, NULL);
+    ctx->log = mp_log_new(ctx, g->log, "sw-cb");
+    ctx->client_api = client_api;
+    return ctx;
+}
+
+int mpv_sw_cb_init(struct mpv_sw_cb_context *ctx, const char *format, int w,
+                   int h, mpv_sw_cb_present_fn present, void *present_ctx)
+{
+    if (!format || !present || w < 1 || h < 1)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    int imgfmt = mp_imgfmt_from_name(bstr0(format), false);
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+    if (!imgfmt || desc.num_planes != 1 ||
+        !(desc.flags & MP_IMGFLAG_BYTE_ALIGNED) || !mp_sws_supported_format(imgfmt))
+    {
+        MP_ERR(ctx, "Unsupported format '%s'.\n", format);
+        return MPV_ERROR_UNSUPPORTED;
+    }
+
+    int r = 0;
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->initialized) {
+        r = MPV_ERROR_INVALID_PARAMETER;
+    } else {
+        ctx->imgfmt = imgfmt;
+        ctx->w = w;
+        ctx->h = h;
+        ctx->present_cb = present;
+        ctx->present_ctx = present_ctx;
+        ctx->initialized = true;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
+int mpv_sw_cb_add_buffer(struct mpv_sw_cb_context *ctx, void *data,
+                         size_t stride)
+{
+    int r;
+    pthread_mutex_lock(&ctx->lock);
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(ctx->imgfmt);
+    if (!ctx->initialized || !data || stride > INT_MAX ||
+        stride < (size_t)ctx->w * desc.bytes[0])
+    {
+        r = MPV_ERROR_INVALID_PARAMETER;
+    } else {
+        struct sw_buffer buf = {.data = data, .stride = stride};
+        r = ctx->num_buffers;
+        MP_TARRAY_APPEND(ctx, ctx->buffers, ctx->num_buffers, buf);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
+int mpv_sw_cb_release_buffer(struct mpv_sw_cb_context *ctx, int buffer)
+{
+    int r = 0;
+    pthread_mutex_lock(&ctx->lock);
+    if (buffer < 0 || buffer >= ctx->num_buffers || !ctx->buffers[buffer].busy) {
+        r = MPV_ERROR_INVALID_PARAMETER;
+    } else {
+        ctx->buffers[buffer].busy = false;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
+int mpv_sw_cb_uninit(struct mpv_sw_cb_context *ctx)
+{
+    if (!ctx)
+        return 0;
+
+    // Setting initialized=false guarantees the VO can't come back.
+    pthread_mutex_lock(&ctx->lock);
+    ctx->initialized = false;
+    pthread_mutex_unlock(&ctx->lock);
+
+    kill_video(ctx->client_api);
+
+    pthread_mutex_lock(&ctx->lock);
+    assert(!ctx->active);
+    talloc_free(ctx->buffers);
+    ctx->buffers = NULL;
+    ctx->num_buffers = 0;
+    ctx->present_cb = NULL;
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+static int reconfig(struct vo *vo, struct mp_image_params *params)
+{
+    struct vo_priv *p = vo->priv;
+
+    vo->dwidth = p->ctx->w;
+    vo->dheight = p->ctx->h;
+    vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
+
+    p->sws->src = *params;
+    p->sws->dst = (struct mp_image_params) {
+        .imgfmt = p->ctx->imgfmt,
+        .w = p->dst.x1 - p->dst.x0,
+        .h = p->dst.y1 - p->dst.y0,
+        .p_w = 1,
+        .p_h = 1,
+    };
+    mp_image_params_guess_csp(&p->sws->dst);
+    mp_sws_set_from_cmdline(p->sws, vo->opts->sws_opts);
+    if (mp_sws_reinit(p->sws) < 0)
+        return -1;
+
+    vo->want_redraw = true;
+    return 0;
+}
+
+// Note: REDRAW_FRAME can call this with NULL.
+static void draw_image(struct vo *vo, struct mp_image *mpi)
+{
+    struct vo_priv *p = vo->priv;
+    struct mpv_sw_cb_context *ctx = p->ctx;
+
+    // The buffers are only accessed by the API user while they're busy, and
+    // the array is only reallocated by mpv_sw_cb_add_buffer(), so copy out
+    // the buffer and render without the lock held.
+    struct sw_buffer buf = {0};
+    pthread_mutex_lock(&ctx->lock);
+    if (p->drawn >= 0) {
+        // Frame was never presented (flip_page() wasn't called for it).
+        ctx->buffers[p->drawn].busy = false;
+        p->drawn = -1;
+    }
+    for (int n = 0; n < ctx->num_buffers; n++) {
+        if (!ctx->buffers[n].busy) {
+            p->drawn = n;
+            buf = ctx->buffers[n];
+            ctx->buffers[n].busy = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (p->drawn < 0) {
+        MP_TRACE(vo, "No free buffer, dropping frame.\n");
+        vo_increment_drop_count(vo, 1);
+        talloc_free(mpi);
+        return;
+    }
+
+    struct mp_image img = {0};
+    mp_image_setfmt(&img, ctx->imgfmt);
+    mp_image_set_size(&img, ctx->w, ctx->h);
+    img.params.color = p->sws->dst.color;
+    img.planes[0] = buf.data;
+    img.stride[0] = buf.stride;
+
+    struct mp_rect d = p->dst;
+    if (mpi) {
+        struct mp_image src = *mpi;
+        struct mp_rect src_rc = p->src;
+        src_rc.x0 = MP_ALIGN_DOWN(src_rc.x0, src.fmt.align_x);
+        src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, src.fmt.align_y);
+        mp_image_crop_rc(&src, src_rc);
+
+        struct mp_image dst = img;
+        mp_image_crop_rc(&dst, d);
+        mp_sws_scale(p->sws, &dst, &src);
+
+        // Borders (letterboxing/panscan)
+        mp_image_clear(&img, 0, 0, img.w, d.y0);
+        mp_image_clear(&img, 0, d.y1, img.w, img.h);
+        mp_image_clear(&img, 0, d.y0, d.x0, d.y1);
+        mp_image_clear(&img, d.x1, d.y0, img.w, d.y1);
+    } else {
+        mp_image_clear(&img, 0, 0, img.w, img.h);
+    }
+
+    p->drawn_pts = mpi ? mpi->pts : 0;
+    osd_draw_on_image(vo->osd, p->osd, p->drawn_pts, 0, &img);
+
+    talloc_free(mpi);
+}
+
+static void flip_page(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+    struct mpv_sw_cb_context *ctx = p->ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    int buffer = p->drawn;
+    mpv_sw_cb_present_fn cb = ctx->present_cb;
+    void *cb_ctx = ctx->present_ctx;
+    p->drawn = -1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (buffer >= 0)
+        cb(cb_ctx, buffer, p->drawn_pts);
+}
+
+static int query_format(struct vo *vo, int format)
+{
+    return mp_sws_supported_format(format);
+}
+
+static int control(struct vo *vo, uint32_t request, void *data)
+{
+    switch (request) {
+    case VOCTRL_SET_PANSCAN:
+        if (vo->config_ok)
+            reconfig(vo, vo->params);
+        return VO_TRUE;
+    }
+    return VO_NOTIMPL;
+}
+
+static void uninit(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+
+    pthread_mutex_lock(&p->ctx->lock);
+    if (p->drawn >= 0)
+        p->ctx->buffers[p->drawn].busy = false;
+    p->ctx->active = NULL;
+    pthread_mutex_unlock(&p->ctx->lock);
+}
+
+static int preinit(struct vo *vo)
+{
+    struct vo_priv *p = vo->priv;
+    p->ctx = vo->extra.sw_cb_context;
+    p->drawn = -1;
+    if (!p->ctx) {
+        MP_FATAL(vo, "No context set.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&p->ctx->lock);
+    if (!p->ctx->initialized) {
+        MP_FATAL(vo, "mpv_sw_cb_init() was not called.\n");
+        pthread_mutex_unlock(&p->ctx->lock);
+        return -1;
+    }
+    assert(!p->ctx->active);
+    p->ctx->active = vo;
+    pthread_mutex_unlock(&p->ctx->lock);
+
+    p->sws = mp_sws_alloc(vo);
+    return 0;
+}
+
+const struct vo_driver video_out_sw_cb = {
+    .description = "Software rendering callbacks for libmpv",
+    .name = "sw-cb",
+    .preinit = preinit,
+    .query_format = query_format,
+    .reconfig = reconfig,
+    .control = control,
+    .draw_image = draw_image,
+    .flip_page = flip_page,
+    .uninit = uninit,
+    .priv_size = sizeof(struct vo_priv),
+};
@@ -72,6 +72,12 @@ static const struct m_sub_options vo_tct_conf = {
     .size = sizeof(struct vo_tct_opts),
 };
 
+// Last output to a terminal cell.
+struct cell {
+    uint32_t rgb[2];    // source pixels (packed RGB)
+    int color[2];       // colors written (RGB, or xterm-256 index)
+};
+
 struct priv {
     struct vo_tct_opts *opts;
     size_t buffer_size;
@@ -82,6 +88,8 @@ struct priv {
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_sws_context *sws;
+    struct cell *cells;     // swidth * sheight
+    bool cells_valid;       // if false, all cells are rewritten
 };
 
 // Convert RGB24 to xterm-256 8-bit value
@@ -113,66 +121,72 @@ static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
     return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
 }
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256)
+static void write_color(bool fg, int color, bool term256)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(ESC_GOTOXY, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                printf(ESC_COLOR_BG, r, g, b);
-            }
-            printf(" ");
-        }
-        printf(ESC_CLEAR_COLORS);
+    if (term256) {
+        printf(fg ? ESC_COLOR256_FG : ESC_COLOR256_BG, color);
+    } else {
+        printf(fg ? ESC_COLOR_FG : ESC_COLOR_BG,
+               (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
     }
-    printf("\n");
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256)
+// Output all cells that changed since the last call. With ALGO_PLAIN, a cell
+// is a single pixel shown as background color. With ALGO_HALF_BLOCKS, it's
+// two pixels, the upper one as background, the lower as foreground color.
+static void write_cells(struct vo *vo)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(ESC_GOTOXY, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                printf(ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                printf(ESC_COLOR_BG, r_up, g_up, b_up);
-                printf(ESC_COLOR_FG, r_down, g_down, b_down);
+    struct priv *p = vo->priv;
+    const bool half_blocks = p->opts->algo == ALGO_HALF_BLOCKS;
+    const bool term256 = p->opts->term256;
+    const int num_colors = half_blocks ? 2 : 1;
+    const int stride = p->frame->stride[0];
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+
+    int cur_color[2] = {-1, -1};    // colors set on the terminal (-1: unknown)
+    int cur_x = -1, cur_y = -1;     // cursor position (-1: unknown)
+
+    for (int y = 0; y < p->sheight; y++) {
+        const unsigned char *rows[2];
+        rows[0] = p->frame->planes[0] + y * num_colors * stride;
+        rows[1] = rows[0] + stride;
+        // The terminal status line overwrites the last line.
+        bool force = !p->cells_valid || ty + y == vo->dheight - 1;
+        for (int x = 0; x < p->swidth; x++) {
+            struct cell *cell = &p->cells[y * p->swidth + x];
+            bool changed = force;
+            for (int n = 0; n < num_colors; n++) {
+                const unsigned char *px = rows[n] + x * 3;
+                uint32_t rgb = (px[2] << 16) | (px[1] << 8) | px[0];
+                // Quantization is only done for pixels that changed.
+                if (rgb != cell->rgb[n] || !p->cells_valid) {
+                    int color = term256 ? rgb_to_x256(px[2], px[1], px[0]) : rgb;
+                    changed |= color != cell->color[n];
+                    cell->rgb[n] = rgb;
+                    cell->color[n] = color;
+                }
             }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+            if (!changed)
+                continue;
+
+            if (x != cur_x || y != cur_y)
+                printf(ESC_GOTOXY, ty + y + 1, tx + x + 1);
+            // Runs of cells with the same colors need no escape sequences.
+            for (int n = 0; n < num_colors; n++) {
+                if (cell->color[n] != cur_color[n]) {
+                    write_color(n == 1, cell->color[n], term256);
+                    cur_color[n] = cell->color[n];
+                }
+            }
+            printf(half_blocks ? "\xe2\x96\x84" : " "); // U+2584 (lower half block)
+            cur_x = x + 1;
+            cur_y = y;
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
+    if (cur_y >= 0)
+        printf(ESC_CLEAR_COLORS);
+    p->cells_valid = true;
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -225,6 +239,10 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
 
+    talloc_free(p->cells);
+    p->cells = talloc_zero_array(p, struct cell, p->swidth * p->sheight);
+    p->cells_valid = false;
+
     printf(ESC_HIDE_CURSOR);
     printf(ESC_CLEAR_SCREEN);
     vo->want_redraw = true;
@@ -242,18 +260,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 
 static void flip_page(struct vo *vo)
 {
-    struct priv *p = vo->priv;
-    if (p->opts->algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    }
+    write_cells(vo);
     fflush(stdout);
 }
 
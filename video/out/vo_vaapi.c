@@ -57,12 +57,15 @@ struct vaapi_subpic {
 struct vaapi_osd_part {
     bool active;
     int change_id;
-    struct vaapi_osd_image image;
+    struct vaapi_osd_image *image; // from priv.osd_images, or NULL
     struct vaapi_subpic subpic;
 };
 
 #define MAX_OUTPUT_SURFACES 2
 
+// Number of VAImage/subpicture pairs kept for reuse by the OSD parts.
+#define MAX_OSD_IMAGES (MAX_OSD_PARTS * 2)
+
 struct priv {
     struct mp_log           *log;
     struct vo               *vo;
@@ -84,7 +87,10 @@ struct priv {
 
     VAImageFormat            osd_format; // corresponds to OSD_VA_FORMAT
     struct vaapi_osd_part    osd_parts[MAX_OSD_PARTS];
+    struct vaapi_osd_image   osd_images[MAX_OSD_IMAGES];
     bool                     osd_screen;
+    int                      osd_res_w;
+    struct mp_image         *osd_scaled; // reused for scaling RGBA bitmaps
 
     struct mp_image_pool    *pool;
 
@@ -324,14 +330,43 @@ error:
     return -1;
 }
 
+// Return an unused OSD image of at least the given size, preferring the
+// smallest allocated one. Only if none fits, a new one is created (replacing
+// the largest unused one if the pool is full).
+static struct vaapi_osd_image *get_osd_image(struct priv *p, int w, int h)
+{
+    struct vaapi_osd_image *best = NULL, *slot = NULL;
+    for (int n = 0; n < MAX_OSD_IMAGES; n++) {
+        struct vaapi_osd_image *img = &p->osd_images[n];
+        if (img->is_used)
+            continue;
+        if (img->image.image_id == VA_INVALID_ID) {
+            if (!slot || slot->image.image_id != VA_INVALID_ID)
+                slot = img;
+            continue;
+        }
+        if (img->w >= w && img->h >= h &&
+            (!best || img->w * img->h < best->w * best->h))
+            best = img;
+        if (!slot || (slot->image.image_id != VA_INVALID_ID &&
+                      img->w * img->h > slot->w * slot->h))
+            slot = img;
+    }
+    if (!best) {
+        if (!slot || new_subpicture(p, w, h, slot) < 0)
+            return NULL;
+        best = slot;
+    }
+    best->is_used = true;
+    return best;
+}
+
 static void draw_osd_cb(void *pctx, struct sub_bitmaps *imgs)
 {
     struct priv *p = pctx;
 
     struct vaapi_osd_part *part = &p->osd_parts[imgs->render_index];
-    if (imgs->change_id != part->change_id) {
-        part->change_id = imgs->change_id;
-
+    if (imgs->change_id != part->change_id || !part->image) {
         struct mp_rect bb;
         if (!mp_sub_bitmaps_bb(imgs, &bb))
             goto error;
@@ -341,14 +376,21 @@ static void draw_osd_cb(void *pctx, struct sub_bitmaps *imgs)
 
         int w = bb.x1 - bb.x0;
         int h = bb.y1 - bb.y0;
-        if (part->image.w < w + pad || part->image.h < h + pad) {
-            int sw = MP_ALIGN_UP(w + pad, 64);
+        if (!part->image || part->image->w < w + pad ||
+                            part->image->h < h + pad)
+        {
+            if (part->image)
+                part->image->is_used = false;
+            // Subtitle lines mostly change in width, so don't make the image
+            // narrower than the OSD.
+            int sw = MP_ALIGN_UP(MPMAX(w + pad, p->osd_res_w), 64);
             int sh = MP_ALIGN_UP(h + pad, 64);
-            if (new_subpicture(p, sw, sh, &part->image) < 0)
+            part->image = get_osd_image(p, sw, sh);
+            if (!part->image)
                 goto error;
         }
 
-        struct vaapi_osd_image *img = &part->image;
+        struct vaapi_osd_image *img = part->image;
         struct mp_image vaimg;
         if (!va_image_map(p->mpvaapi, &img->image, &vaimg))
             goto error;
@@ -367,15 +409,23 @@ static void draw_osd_cb(void *pctx, struct sub_bitmaps *imgs)
 
             struct mp_image *bmp = &src;
 
-            struct mp_image *tmp = NULL;
+            struct mp_image tmp;
             if (sub->dw != sub->w || sub->dh != sub->h) {
-                tmp = mp_image_alloc(IMGFMT_BGRA, sub->dw, sub->dh);
-                if (!tmp)
-                    goto error;
+                struct mp_image *s = p->osd_scaled;
+                if (!s || s->w < sub->dw || s->h < sub->dh) {
+                    talloc_free(s);
+                    p->osd_scaled = s = mp_image_alloc(IMGFMT_BGRA,
+                                MPMAX(sub->dw, s ? s->w : 0),
+                                MPMAX(sub->dh, s ? s->h : 0));
+                    if (!s)
+                        goto error_unmap;
+                }
+                tmp = *s;
+                mp_image_set_size(&tmp, sub->dw, sub->dh);
 
-                mp_image_swscale(tmp, &src, mp_sws_fast_flags);
+                mp_image_swscale(&tmp, &src, mp_sws_fast_flags);
 
-                bmp = tmp;
+                bmp = &tmp;
             }
 
             // Note: nothing guarantees that the sub-bitmaps don't overlap.
@@ -388,8 +438,6 @@ static void draw_osd_cb(void *pctx, struct sub_bitmaps *imgs)
 
             memcpy_pic(vaimg.planes[0] + dst, bmp->planes[0], sub->dw * 4,
                        sub->dh, vaimg.stride[0], bmp->stride[0]);
-
-            talloc_free(tmp);
         }
 
         if (!va_image_unmap(p->mpvaapi, &img->image))
@@ -402,10 +450,15 @@ static void draw_osd_cb(void *pctx, struct sub_bitmaps *imgs)
             .dst_x = bb.x0, .dst_y = bb.y0,
             .dst_w = w,     .dst_h = h,
         };
+        // Only now, so that a failed upload is retried on the next frame.
+        part->change_id = imgs->change_id;
     }
 
     part->active = true;
+    return;
 
+error_unmap:
+    va_image_unmap(p->mpvaapi, &part->image->image);
 error:
     ;
 }
@@ -428,6 +481,7 @@ static void draw_osd(struct vo *vo)
     } else {
         res = &vid_res;
     }
+    p->osd_res_w = res->w;
 
     for (int n = 0; n < MAX_OSD_PARTS; n++)
         p->osd_parts[n].active = false;
@@ -557,10 +611,9 @@ static void uninit(struct vo *vo)
     free_video_specific(p);
     talloc_free(p->pool);
 
-    for (int n = 0; n < MAX_OSD_PARTS; n++) {
-        struct vaapi_osd_part *part = &p->osd_parts[n];
-        free_subpicture(p, &part->image);
-    }
+    for (int n = 0; n < MAX_OSD_IMAGES; n++)
+        free_subpicture(p, &p->osd_images[n]);
+    talloc_free(p->osd_scaled);
 
     if (vo->hwdec_devs) {
         hwdec_devices_remove(vo->hwdec_devs, &p->mpvaapi->hwctx);
@@ -633,10 +686,10 @@ static int preinit(struct vo *vo)
     if (!p->osd_format.fourcc)
         MP_ERR(vo, "OSD format not supported. Disabling OSD.\n");
 
-    for (int n = 0; n < MAX_OSD_PARTS; n++) {
-        struct vaapi_osd_part *part = &p->osd_parts[n];
-        part->image.image.image_id = VA_INVALID_ID;
-        part->image.subpic_id = VA_INVALID_ID;
+    for (int n = 0; n < MAX_OSD_IMAGES; n++) {
+        struct vaapi_osd_image *img = &p->osd_images[n];
+        img->image.image_id = VA_INVALID_ID;
+        img->subpic_id = VA_INVALID_ID;
     }
 
     int max_display_attrs = vaMaxNumDisplayAttributes(p->display);
@@ -58,6 +58,21 @@
 /* number of video and output surfaces */
 #define MAX_OUTPUT_SURFACES                15
 
+/* --vo-vdpau-output-surfaces=auto: range and initial number of surfaces */
+#define AUTO_MIN_SURFACES                  2
+#define AUTO_MAX_SURFACES                  8
+#define AUTO_INIT_SURFACES                 3
+
+/* Frames per measurement window for the adaptive queue depth. Add a surface
+ * if this many frames were late or dropped within one window while all
+ * surfaces were in use; remove one after AUTO_SHRINK_WINDOWS windows without
+ * late frames, in which at least 2 surfaces were never needed. */
+#define AUTO_WINDOW                        120
+#define AUTO_GROW_LATE                     2
+#define AUTO_SHRINK_WINDOWS                5
+
+#define PERF_SAMPLES                       64
+
 /* Pixelformat used for output surfaces */
 #define OUTPUT_RGBA_FORMAT VDP_RGBA_FORMAT_B8G8R8A8
 
@@ -65,6 +80,12 @@
  * Global variable declaration - VDPAU specific
  */
 
+// Last measured times (in microseconds) for VOCTRL_PERFORMANCE_DATA.
+struct perf_samples {
+    uint64_t                           samples[PERF_SAMPLES];
+    int                                num, pos;
+};
+
 struct vdpctx {
     struct mp_vdpau_ctx               *mpvdp;
     struct vdp_functions              *vdp;
@@ -78,6 +99,7 @@ struct vdpctx {
 
     VdpOutputSurface                   output_surfaces[MAX_OUTPUT_SURFACES];
     int                                num_output_surfaces;
+    int                                output_surfaces_opt; // 0 means auto
     VdpOutputSurface                   black_pixel;
     VdpOutputSurface                   rotation_surface;
 
@@ -112,6 +134,7 @@ struct vdpctx {
     int                                vsync_interval;
     uint64_t                           last_queue_time;
     uint64_t                           queue_time[MAX_OUTPUT_SURFACES];
+    uint64_t                           submit_time[MAX_OUTPUT_SURFACES];
     uint64_t                           last_ideal_time;
     bool                               dropped_frame;
     uint64_t                           dropped_time;
@@ -120,6 +143,17 @@ struct vdpctx {
     VdpYCbCrFormat                     vdp_pixel_format;
     bool                               rgb_mode;
 
+    // Presentation queue statistics of the current window (auto mode).
+    int                                win_frames;
+    int                                win_late;     // late or dropped
+    int                                win_max_queued;
+    uint64_t                           win_latency;  // sum of submit-to-display
+    int                                win_latency_n;
+    int                                clean_windows;
+
+    int64_t                            mixer_start;
+    struct perf_samples                perf_upload, perf_mixer;
+
     // OSD
     struct osd_bitmap_surface {
         VdpRGBAFormat format;
@@ -159,6 +193,8 @@ static int video_to_output_surface(struct vo *vo, struct mp_image *mpi)
     CHECK_VDP_WARNING(vo, "Error when calling "
                       "vdp_presentation_queue_block_until_surface_idle");
 
+    vc->mixer_start = mp_time_us();
+
     // Clear the borders between video and window (if there are any).
     // For some reason, video_mixer_render doesn't need it for YUV.
     // Also, if there is nothing to render, at least clear the screen.
@@ -234,6 +270,28 @@ static int video_to_output_surface(struct vo *vo, struct mp_image *mpi)
     return 0;
 }
 
+static void perf_add(struct perf_samples *p, int64_t us)
+{
+    p->samples[p->pos] = MPMAX(us, 0);
+    p->pos = (p->pos + 1) % PERF_SAMPLES;
+    p->num = MPMIN(p->num + 1, PERF_SAMPLES);
+}
+
+static struct voctrl_performance_entry perf_get(struct perf_samples *p)
+{
+    struct voctrl_performance_entry res = {0};
+    if (!p->num)
+        return res;
+    uint64_t sum = 0;
+    for (int n = 0; n < p->num; n++) {
+        sum += p->samples[n];
+        res.peak = MPMAX(res.peak, p->samples[n]);
+    }
+    res.avg = sum / p->num;
+    res.last = p->samples[(p->pos + PERF_SAMPLES - 1) % PERF_SAMPLES];
+    return res;
+}
+
 static void forget_frames(struct vo *vo, bool seek_reset)
 {
     struct vdpctx *vc = vo->priv;
@@ -718,8 +776,15 @@ static int update_presentation_queue_status(struct vo *vo)
             MP_TRACE(vo, "Queue time difference: %d ms\n", diff);
             if (vtime < qtime + vc->vsync_interval / 2)
                 MP_VERBOSE(vo, "Frame shown too early (%d ms)\n", diff);
-            if (vtime > qtime + vc->vsync_interval)
+            if (vtime > qtime + vc->vsync_interval) {
                 MP_VERBOSE(vo, "Frame shown late (%d ms)\n", diff);
+                vc->win_late++;
+            }
+        }
+        uint64_t stime = vc->submit_time[vc->query_surface_num];
+        if (stime && vtime > stime) {
+            vc->win_latency += vtime - stime;
+            vc->win_latency_n++;
         }
         vc->query_surface_num = WRAP_ADD(vc->query_surface_num, 1,
                                          vc->num_output_surfaces);
@@ -728,9 +793,120 @@ static int update_presentation_queue_status(struct vo *vo)
     int num_queued = WRAP_ADD(vc->surface_num, -vc->query_surface_num,
                               vc->num_output_surfaces);
     MP_DBG(vo, "Queued surface count (before add): %d\n", num_queued);
+    vc->win_max_queued = MPMAX(vc->win_max_queued, num_queued);
     return num_queued;
 }
 
+// Insert a new output surface into the ring, just before surface_num (so it
+// is the next to be rendered to). Queued surfaces keep their order.
+static bool add_output_surface(struct vo *vo)
+{
+    struct vdpctx *vc = vo->priv;
+    struct vdp_functions *vdp = vc->vdp;
+    VdpStatus vdp_st;
+
+    int n = vc->num_output_surfaces;
+    if (n >= MAX_OUTPUT_SURFACES || !vc->output_surface_w)
+        return false;
+
+    VdpOutputSurface surface;
+    vdp_st = vdp->output_surface_create(vc->vdp_device, OUTPUT_RGBA_FORMAT,
+                                        vc->output_surface_w,
+                                        vc->output_surface_h, &surface);
+    CHECK_VDP_WARNING(vo, "Error when calling vdp_output_surface_create");
+    if (vdp_st != VDP_STATUS_OK)
+        return false;
+
+    int pos = vc->surface_num;
+    for (int i = n; i > pos; i--) {
+        vc->output_surfaces[i] = vc->output_surfaces[i - 1];
+        vc->queue_time[i] = vc->queue_time[i - 1];
+        vc->submit_time[i] = vc->submit_time[i - 1];
+    }
+    vc->output_surfaces[pos] = surface;
+    vc->queue_time[pos] = vc->submit_time[pos] = 0;
+    if (vc->query_surface_num > pos)
+        vc->query_surface_num++;
+    vc->num_output_surfaces = n + 1;
+    return true;
+}
+
+// Remove the surface after surface_num from the ring. This requires at least
+// 2 idle surfaces besides surface_num, so that the removed surface is neither
+// queued nor the one currently on screen (the last one before
+// query_surface_num).
+static bool remove_output_surface(struct vo *vo)
+{
+    struct vdpctx *vc = vo->priv;
+    struct vdp_functions *vdp = vc->vdp;
+    VdpStatus vdp_st;
+
+    int n = vc->num_output_surfaces;
+    int queued = WRAP_ADD(vc->surface_num, -vc->query_surface_num, n);
+    if (n - queued - 1 < 2)
+        return false;
+
+    int pos = WRAP_ADD(vc->surface_num, 1, n);
+    vdp_st = vdp->output_surface_destroy(vc->output_surfaces[pos]);
+    CHECK_VDP_WARNING(vo, "Error when calling vdp_output_surface_destroy");
+    for (int i = pos; i < n - 1; i++) {
+        vc->output_surfaces[i] = vc->output_surfaces[i + 1];
+        vc->queue_time[i] = vc->queue_time[i + 1];
+        vc->submit_time[i] = vc->submit_time[i + 1];
+    }
+    vc->output_surfaces[n - 1] = VDP_INVALID_HANDLE;
+    if (vc->query_surface_num > pos)
+        vc->query_surface_num--;
+    if (vc->surface_num > pos)
+        vc->surface_num--;
+    vc->num_output_surfaces = n - 1;
+    return true;
+}
+
+// With --vo-vdpau-output-surfaces=auto, adapt the number of output surfaces
+// (and thus the maximum presentation queue depth) to late/dropped frames.
+static void adapt_queue_depth(struct vo *vo)
+{
+    struct vdpctx *vc = vo->priv;
+
+    if (vc->output_surfaces_opt || vc->vsync_interval <= 1)
+        return;
+
+    vc->win_frames++;
+    int n = vc->num_output_surfaces;
+    // The queue is the bottleneck only if it ran full.
+    bool full = vc->win_max_queued >= n - 1;
+    int change = 0;
+    if (vc->win_late >= AUTO_GROW_LATE && full && n < AUTO_MAX_SURFACES) {
+        change = 1;
+    } else if (vc->win_frames >= AUTO_WINDOW) {
+        if (!vc->win_late && vc->win_max_queued < n - 2) {
+            vc->clean_windows++;
+        } else {
+            vc->clean_windows = 0;
+        }
+        if (vc->clean_windows >= AUTO_SHRINK_WINDOWS && n > AUTO_MIN_SURFACES)
+            change = -1;
+    } else {
+        return;
+    }
+
+    double latency = vc->win_latency_n ?
+                     vc->win_latency / (double)vc->win_latency_n / 1e6 : 0;
+    bool ok = change > 0 ? add_output_surface(vo) :
+              change < 0 ? remove_output_surface(vo) : false;
+    MP_MSG(vo, ok ? MSGL_V : MSGL_DEBUG,
+           "Presentation queue: %d/%d frames late, max. %d queued, "
+           "latency %.1f ms, %d surfaces%s.\n", vc->win_late, vc->win_frames,
+           vc->win_max_queued, latency, n,
+           ok ? (change > 0 ? " (adding one)" : " (removing one)") : "");
+    if (ok)
+        vc->clean_windows = 0;
+
+    vc->win_frames = vc->win_late = vc->win_max_queued = 0;
+    vc->win_latency = vc->win_latency_n = 0;
+}
+
 // Return the timestamp of the vsync that must have happened before ts.
 static inline uint64_t prev_vsync(struct vdpctx *vc, uint64_t ts)
 {
@@ -859,13 +1035,17 @@ static void flip_page(struct vo *vo)
 
     vc->last_queue_time = pts;
     vc->queue_time[vc->surface_num] = pts;
+    vc->submit_time[vc->surface_num] = now;
     vc->last_ideal_time = ideal_pts;
     vc->dropped_frame = false;
     vc->surface_num = WRAP_ADD(vc->surface_num, 1, vc->num_output_surfaces);
+    adapt_queue_depth(vo);
     return;
 
 drop:
     vo_increment_drop_count(vo, 1);
+    vc->win_late++;
+    adapt_queue_depth(vo);
 }
 
 static void draw_frame(struct vo *vo, struct vo_frame *frame)
@@ -875,10 +1055,12 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     check_preemption(vo);
 
     if (frame->current && !frame->redraw) {
+        int64_t upload_start = mp_time_us();
         struct mp_image *vdp_mpi =
             mp_vdpau_upload_video_surface(vc->mpvdp, frame->current);
         if (!vdp_mpi)
             MP_ERR(vo, "Could not upload image.\n");
+        perf_add(&vc->perf_upload, mp_time_us() - upload_start);
 
         talloc_free(vc->current_image);
         vc->current_image = vdp_mpi;
@@ -889,6 +1071,7 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
 
     if (status_ok(vo)) {
         video_to_output_surface(vo, vc->current_image);
+        perf_add(&vc->perf_mixer, mp_time_us() - vc->mixer_start);
         draw_osd(vo);
     }
 }
@@ -1041,6 +1224,9 @@ static int preinit(struct vo *vo)
     vc->vdp_device = vc->mpvdp->vdp_device;
     vc->vdp = &vc->mpvdp->vdp;
 
+    vc->num_output_surfaces = vc->output_surfaces_opt ? vc->output_surfaces_opt
+                                                      : AUTO_INIT_SURFACES;
+
     vc->vdp->bitmap_surface_query_capabilities(vc->vdp_device, VDP_RGBA_FORMAT_A8,
                             &vc->supports_a8, &(uint32_t){0}, &(uint32_t){0});
 
@@ -1110,6 +1296,12 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_GET_PREF_DEINT:
         *(int *)data = vc->deint;
         return true;
+    case VOCTRL_PERFORMANCE_DATA: {
+        struct voctrl_performance_data *perf = data;
+        perf->upload = perf_get(&vc->perf_upload);
+        perf->render = perf_get(&vc->perf_mixer);
+        return true;
+    }
     }
 
     int events = 0;
@@ -1152,8 +1344,8 @@ const struct vo_driver video_out_vdpau = {
         OPT_FLAG("composite-detect", composite_detect, 0, OPTDEF_INT(1)),
         OPT_INT("queuetime-windowed", flip_offset_window, 0, OPTDEF_INT(50)),
         OPT_INT("queuetime-fs", flip_offset_fs, 0, OPTDEF_INT(50)),
-        OPT_INTRANGE("output-surfaces", num_output_surfaces, 0,
-                     2, MAX_OUTPUT_SURFACES, OPTDEF_INT(3)),
+        OPT_CHOICE_OR_INT("output-surfaces", output_surfaces_opt, 0,
+                          2, MAX_OUTPUT_SURFACES, ({"auto", 0})),
         OPT_COLOR("colorkey", colorkey, 0,
                   .defval = &(const struct m_color) {
                       .r = 2, .g = 5, .b = 7, .a = 255,
@@ -66,14 +66,23 @@ static const format_t format_table[] = {
 
 struct priv;
 
-// We only use double buffering but the creation and usage is still open to
-// triple buffering. Triple buffering is now removed, because double buffering
-// is now pixel-perfect.
+// Started with 2 buffers, and grown on demand if the compositor holds on to
+// buffers for longer (triple buffering).
+#define MIN_VIDEO_BUFFERS 2
+#define MAX_VIDEO_BUFFERS 3
+
+// The VO renders into back (any buffer not in use by the compositor), which
+// becomes pending on flip_page(). The pending buffer is attached on the next
+// frame callback; if a new frame is flipped before that, it replaces the old
+// one, so the VO never has to wait for the compositor.
 struct buffer_pool {
-    shm_buffer_t **buffers;
-    shm_buffer_t *front_buffer; // just pointers to any of the buffers
-    shm_buffer_t *back_buffer;
-    uint32_t buffer_no;
+    shm_buffer_t *buffers[MAX_VIDEO_BUFFERS];
+    int num_buffers;
+    shm_buffer_t *back;     // just pointers to any of the buffers
+    shm_buffer_t *pending;
+    uint32_t width, height;
+    format_t format;
+    struct wl_shm *shm;
 };
 
 struct supported_format {
@@ -111,6 +120,9 @@ struct priv {
     shm_buffer_t *osd_buffers[MAX_OSD_PARTS];
     // this id tells us if the subtitle part has changed or not
     int change_id[MAX_OSD_PARTS];
+    bool osd_attached[MAX_OSD_PARTS];   // a buffer is attached to the surface
+    bool osd_drawn[MAX_OSD_PARTS];      // the part was drawn in this frame
+    bool osd_changed; // OSD surfaces changed since the last video commit
 
     // options
     int enable_alpha;
@@ -166,74 +178,91 @@ static struct mp_image buffer_get_mp_image(struct priv *p,
 
 // buffer pool functions
 
-static void buffer_pool_reinit(struct priv *p,
-                               struct buffer_pool *pool,
-                               uint32_t buffer_no,
+static void buffer_pool_destroy(struct buffer_pool *pool)
+{
+    for (int i = 0; i < pool->num_buffers; ++i)
+        shm_buffer_destroy(pool->buffers[i]);
+
+    pool->num_buffers = 0;
+    pool->back = NULL;
+    pool->pending = NULL;
+}
+
+static bool buffer_pool_add(struct buffer_pool *pool)
+{
+    shm_buffer_t *buf = shm_buffer_create(pool->width, pool->height,
+                                          pool->format, pool->shm,
+                                          &buffer_listener);
+    if (!buf)
+        return false;
+
+    pool->buffers[pool->num_buffers++] = buf;
+    return true;
+}
+
+static void buffer_pool_reinit(struct buffer_pool *pool,
                                uint32_t width, uint32_t height,
                                format_t fmt,
                                struct wl_shm *shm)
 {
-    if (!pool->buffers)
-        pool->buffers = calloc(buffer_no, sizeof(shm_buffer_t*));
-
-    pool->buffer_no = buffer_no;
-
-    for (uint32_t i = 0; i < buffer_no; ++i) {
-        if (pool->buffers[i] == NULL)
-            pool->buffers[i] = shm_buffer_create(width, height, fmt,
-                                                 shm, &buffer_listener);
-        else
-            shm_buffer_resize(pool->buffers[i], width, height);
+    // The format can change, so start over. Buffers still used by the
+    // compositor are freed on release.
+    for (int i = 0; i < pool->num_buffers; ++i) {
+        if (SHM_BUFFER_IS_BUSY(pool->buffers[i])) {
+            SHM_BUFFER_SET_ONESHOT(pool->buffers[i]);
+        } else {
+            shm_buffer_destroy(pool->buffers[i]);
+        }
     }
 
-    pool->back_buffer = pool->buffers[0];
-    pool->front_buffer = pool->buffers[1];
+    pool->num_buffers = 0;
+    pool->back = NULL;
+    pool->pending = NULL;
+    pool->width = width;
+    pool->height = height;
+    pool->format = fmt;
+    pool->shm = shm;
+
+    for (int i = 0; i < MIN_VIDEO_BUFFERS; ++i)
+        buffer_pool_add(pool);
 }
 
-static bool buffer_pool_resize(struct buffer_pool *pool,
+static void buffer_pool_resize(struct buffer_pool *pool,
                                int width,
                                int height)
 {
-    bool ret = true;
+    pool->width = width;
+    pool->height = height;
 
-    for (uint32_t i = 0; ret && i < pool->buffer_no; ++i)
+    // busy buffers are resized on release
+    for (int i = 0; i < pool->num_buffers; ++i)
         shm_buffer_resize(pool->buffers[i], width, height);
 
-    return ret;
+    // contents have the old size, and must be redrawn
+    pool->back = NULL;
+    pool->pending = NULL;
 }
 
-static void buffer_pool_destroy(struct buffer_pool *pool)
-{
-    for (uint32_t i = 0; i < pool->buffer_no; ++i)
-        shm_buffer_destroy(pool->buffers[i]);
-
-    free(pool->buffers);
-    pool->front_buffer = NULL;
-    pool->back_buffer = NULL;
-    pool->buffers = NULL;
-}
-
-static void buffer_pool_swap(struct buffer_pool *pool)
+// returns NULL if all buffers are busy, and no new one can be added
+static shm_buffer_t * buffer_pool_get_back(struct buffer_pool *pool)
 {
-    if (SHM_BUFFER_IS_DIRTY(pool->back_buffer)) {
-        shm_buffer_t *tmp = pool->back_buffer;
-        pool->back_buffer = pool->front_buffer;
-        pool->front_buffer = tmp;
+    for (int i = 0; i < pool->num_buffers; ++i) {
+        shm_buffer_t *buf = pool->buffers[i];
+        if (!SHM_BUFFER_IS_BUSY(buf) && buf != pool->pending)
+            return buf;
     }
-}
 
-// returns NULL if the back buffer is busy
-static shm_buffer_t * buffer_pool_get_back(struct buffer_pool *pool)
-{
-    if (!pool->back_buffer || SHM_BUFFER_IS_BUSY(pool->back_buffer))
-        return NULL;
+    if (pool->num_buffers < MAX_VIDEO_BUFFERS && buffer_pool_add(pool))
+        return pool->buffers[pool->num_buffers - 1];
 
-    return pool->back_buffer;
-}
+    // overwrite the pending frame, which was never shown
+    if (pool->pending && !SHM_BUFFER_IS_BUSY(pool->pending)) {
+        shm_buffer_t *buf = pool->pending;
+        pool->pending = NULL;
+        return buf;
+    }
 
-static shm_buffer_t * buffer_pool_get_front(struct buffer_pool *pool)
-{
-    return pool->front_buffer;
+    return NULL;
 }
 
 static bool redraw_frame(struct priv *p)
@@ -246,8 +275,8 @@ static bool resize(struct priv *p)
 {
     struct vo_wayland_state *wl = p->wl;
 
-    if (!p->video_bufpool.back_buffer || SHM_BUFFER_IS_BUSY(p->video_bufpool.back_buffer))
-        return false; // skip resizing if we can't guarantee pixel perfectness!
+    if (!p->video_bufpool.num_buffers)
+        return false;
 
     int32_t scale = 1;
     int32_t x = wl->window.sh_x;
@@ -294,10 +323,7 @@ static bool resize(struct priv *p)
     if (mp_sws_reinit(p->sws) < 0)
         return false;
 
-    if (!buffer_pool_resize(&p->video_bufpool, p->dst_w, p->dst_h)) {
-        MP_ERR(wl, "failed to resize video buffers\n");
-        return false;
-    }
+    buffer_pool_resize(&p->video_bufpool, p->dst_w, p->dst_h);
 
     wl->window.width = p->dst_w;
     wl->window.height = p->dst_h;
@@ -377,7 +403,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     shm_buffer_t *buf = buffer_pool_get_back(&p->video_bufpool);
 
     if (!buf) {
-        MP_VERBOSE(p->wl, "can't draw, back buffer is busy\n");
+        MP_VERBOSE(p->wl, "can't draw, all buffers are busy\n");
         return;
     }
 
@@ -396,6 +422,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     }
 
     buffer_finalise_back(buf);
+    p->video_bufpool.back = buf;
 
     draw_osd(vo);
 }
@@ -407,7 +434,8 @@ static void draw_osd_cb(void *ctx, struct sub_bitmaps *imgs)
 
     struct wl_surface *s = p->osd_surfaces[id];
 
-    if (imgs->change_id != p->change_id[id]) {
+    // Unchanged parts keep their attached buffer.
+    if (imgs->change_id != p->change_id[id] || !p->osd_attached[id]) {
         p->change_id[id] = imgs->change_id;
 
         struct mp_rect bb;
@@ -449,17 +477,15 @@ static void draw_osd_cb(void *ctx, struct sub_bitmaps *imgs)
                        wlimg.stride[0], sub->stride);
         }
 
-        wl_subsurface_set_position(p->osd_subsurfaces[id], 0, 0);
-        wl_surface_attach(s, buf->buffer, bb.x0, bb.y0);
+        wl_subsurface_set_position(p->osd_subsurfaces[id], bb.x0, bb.y0);
+        wl_surface_attach(s, buf->buffer, 0, 0);
         wl_surface_damage(s, 0, 0, width, height);
         wl_surface_commit(s);
+        p->osd_attached[id] = true;
+        p->osd_changed = true;
     }
-    else {
-        // p->osd_buffer, guaranteed to exist here
-        assert(p->osd_buffers[id]);
-        wl_surface_attach(s, p->osd_buffers[id]->buffer, 0, 0);
-        wl_surface_commit(s);
-    }
+
+    p->osd_drawn[id] = true;
 }
 
 static const bool osd_formats[SUBBITMAP_COUNT] = {
@@ -474,40 +500,65 @@ static void draw_osd(struct vo *vo)
     if (p->wl && p->wl->display.current_output)
         scale = p->wl->display.current_output->scale;
 
-    // detach all buffers and attach all needed buffers in osd_draw
-    // only the most recent attach & commit is applied once the parent surface
-    // is committed
+    for (int i = 0; i < MAX_OSD_PARTS; ++i)
+        p->osd_drawn[i] = false;
+
+    // Changed parts are attached in draw_osd_cb. Only the most recent attach &
+    // commit is applied once the parent surface is committed.
+    double pts = p->original_image ? p->original_image->pts : 0;
+    osd_draw(vo->osd, p->osd, pts, 0, osd_formats, draw_osd_cb, p);
+
+    // detach parts which disappeared
     for (int i = 0; i < MAX_OSD_PARTS; ++i) {
         struct wl_surface *s = p->osd_surfaces[i];
-        wl_surface_attach(s, NULL, 0, 0);
+        if (p->osd_attached[i] && !p->osd_drawn[i]) {
+            wl_surface_attach(s, NULL, 0, 0);
+            wl_surface_commit(s);
+            p->osd_attached[i] = false;
+            p->osd_changed = true;
+        }
         wl_surface_set_buffer_scale(s, scale);
-        wl_surface_damage(s, 0, 0, p->dst_w, p->dst_h);
-        wl_surface_commit(s);
     }
-
-    double pts = p->original_image ? p->original_image->pts : 0;
-    osd_draw(vo->osd, p->osd, pts, 0, osd_formats, draw_osd_cb, p);
 }
 
-static void redraw(void *data, uint32_t time)
+// Frame callback: show the most recent frame, if there is a new one. Returns
+// false if there was nothing to commit, which stops the frame callbacks until
+// the next flip_page().
+static bool redraw(void *data, uint32_t time)
 {
     struct priv *p = data;
+    struct buffer_pool *pool = &p->video_bufpool;
+    shm_buffer_t *buf = pool->pending;
 
-    shm_buffer_t *buf = buffer_pool_get_front(&p->video_bufpool);
-    wl_surface_attach(p->wl->window.video_surface, buf->buffer, p->x, p->y);
-    wl_surface_damage(p->wl->window.video_surface, 0, 0, p->dst_w, p->dst_h);
-    buffer_finalise_front(buf);
+    if (!buf && !p->osd_changed)
+        return false;
+
+    if (buf) {
+        wl_surface_attach(p->wl->window.video_surface, buf->buffer, p->x, p->y);
+        wl_surface_damage(p->wl->window.video_surface, 0, 0, p->dst_w, p->dst_h);
+        buffer_finalise_front(buf);
+        pool->pending = NULL;
+
+        p->x = 0;
+        p->y = 0;
+    }
 
-    p->x = 0;
-    p->y = 0;
+    p->osd_changed = false;
+    return true;
 }
 
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
+    struct buffer_pool *pool = &p->video_bufpool;
 
-    buffer_pool_swap(&p->video_bufpool);
+    if (pool->back) {
+        pool->pending = pool->back;
+        pool->back = NULL;
+    }
 
+    // If no frame callback is outstanding, the compositor is idle, and the
+    // frame can be shown right away.
     if (!p->wl->frame.callback)
         vo_wayland_request_frame(vo, p, redraw);
 
@@ -568,7 +619,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *fmt)
             p->video_format = entry;
     }
 
-    buffer_pool_reinit(p, &p->video_bufpool, 2, p->width, p->height,
+    buffer_pool_reinit(&p->video_bufpool, p->width, p->height,
                        *p->video_format, p->wl->display.shm);
 
     vo_wayland_config(vo);
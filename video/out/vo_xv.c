@@ -23,10 +23,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <assert.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
 #include <libavutil/common.h>
+#include <libavutil/buffer.h>
 
 #include "config.h"
 
@@ -64,6 +67,19 @@
 #define CK_SRC_CUR           2 // use current colorkey (get it from xv)
 
 #define MAX_BUFFERS 10
+#define MAX_DR_BUFFERS 64
+
+#if HAVE_SHM && HAVE_XEXT
+// XvShm image the decoder renders into directly (see get_image()).
+struct dr_buffer {
+    struct xvctx *ctx;
+    XvImage *xvimage;
+    XShmSegmentInfo shminfo;
+    int imgfmt, w, h, stride_align;
+    int64_t last_put;   // xvctx.num_puts after it was last displayed
+    bool in_use;        // referenced by a mp_image (protected by dr_lock)
+};
+#endif
 
 struct xvctx {
     struct xv_ck_info_s {
@@ -83,6 +99,7 @@ struct xvctx {
     int num_buffers;
     XvImage *xvimage[MAX_BUFFERS];
     struct mp_image *original_image;
+    struct mp_draw_sub_cache *osd_cache;
     uint32_t image_width;
     uint32_t image_height;
     uint32_t image_format;
@@ -96,6 +113,13 @@ struct xvctx {
 #if HAVE_SHM && HAVE_XEXT
     XShmSegmentInfo Shminfo[MAX_BUFFERS];
     int Shm_Warned_Slow;
+    int64_t num_puts;               // XvShmPutImage calls so far
+    // Displayed instead of xvimage[current_buf], if set.
+    struct dr_buffer *dr_visible;
+    // DR images can be freed from any thread, which clears dr_buffer.in_use.
+    pthread_mutex_t dr_lock;
+    struct dr_buffer **dr_buffers;
+    int num_dr_buffers;
 #endif
 };
 
@@ -114,6 +138,7 @@ static const struct fmt_entry fmt_table[] = {
 static bool allocate_xvimage(struct vo *, int);
 static void deallocate_xvimage(struct vo *vo, int foo);
 static struct mp_image get_xv_buffer(struct vo *vo, int buf_index);
+static int query_format(struct vo *vo, int format);
 
 static int find_xv_format(int imgfmt)
 {
@@ -465,6 +490,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     int i;
 
     mp_image_unrefp(&ctx->original_image);
+#if HAVE_SHM && HAVE_XEXT
+    ctx->dr_visible = NULL;
+#endif
 
     ctx->image_height = params->h;
     ctx->image_width  = params->w;
@@ -529,6 +557,36 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     return 0;
 }
 
+#if HAVE_SHM && HAVE_XEXT
+static XvImage *create_shm_xvimage(struct vo *vo, int fourcc, int w, int h,
+                                   XShmSegmentInfo *shminfo)
+{
+    struct xvctx *ctx = vo->priv;
+    struct vo_x11_state *x11 = vo->x11;
+
+    XvImage *img = (XvImage *) XvShmCreateImage(x11->display, ctx->xv_port,
+                                                fourcc, NULL, w, h, shminfo);
+    if (!img)
+        return NULL;
+
+    shminfo->shmid = shmget(IPC_PRIVATE, img->data_size, IPC_CREAT | 0777);
+    shminfo->shmaddr = shmat(shminfo->shmid, 0, 0);
+    if (shminfo->shmaddr == (void *)-1) {
+        shmctl(shminfo->shmid, IPC_RMID, 0);
+        XFree(img);
+        *shminfo = (XShmSegmentInfo){0};
+        return NULL;
+    }
+    shminfo->readOnly = False;
+
+    img->data = shminfo->shmaddr;
+    XShmAttach(x11->display, shminfo);
+    XSync(x11->display, False);
+    shmctl(shminfo->shmid, IPC_RMID, 0);
+    return img;
+}
+#endif
+
 static bool allocate_xvimage(struct vo *vo, int foo)
 {
     struct xvctx *ctx = vo->priv;
@@ -538,35 +596,12 @@ static bool allocate_xvimage(struct vo *vo, int foo)
     // round up the height to next chroma boundary too
     int aligned_h = FFALIGN(ctx->image_height, 2);
 #if HAVE_SHM && HAVE_XEXT
-    if (x11->display_is_local && XShmQueryExtension(x11->display)) {
-        ctx->Shmem_Flag = 1;
-        x11->ShmCompletionEvent = XShmGetEventBase(x11->display)
-                                + ShmCompletion;
-    } else {
-        ctx->Shmem_Flag = 0;
-        MP_INFO(vo, "Shared memory not supported\nReverting to normal Xv.\n");
-    }
     if (ctx->Shmem_Flag) {
-        ctx->xvimage[foo] =
-            (XvImage *) XvShmCreateImage(x11->display, ctx->xv_port,
-                                         ctx->xv_format, NULL,
-                                         aligned_w, aligned_h,
-                                         &ctx->Shminfo[foo]);
+        ctx->xvimage[foo] = create_shm_xvimage(vo, ctx->xv_format,
+                                               aligned_w, aligned_h,
+                                               &ctx->Shminfo[foo]);
         if (!ctx->xvimage[foo])
             return false;
-
-        ctx->Shminfo[foo].shmid = shmget(IPC_PRIVATE,
-                                         ctx->xvimage[foo]->data_size,
-                                         IPC_CREAT | 0777);
-        ctx->Shminfo[foo].shmaddr = shmat(ctx->Shminfo[foo].shmid, 0, 0);
-        if (ctx->Shminfo[foo].shmaddr == (void *)-1)
-            return false;
-        ctx->Shminfo[foo].readOnly = False;
-
-        ctx->xvimage[foo]->data = ctx->Shminfo[foo].shmaddr;
-        XShmAttach(x11->display, &ctx->Shminfo[foo]);
-        XSync(x11->display, False);
-        shmctl(ctx->Shminfo[foo].shmid, IPC_RMID, 0);
     } else
 #endif
     {
@@ -635,6 +670,7 @@ static inline void put_xvimage(struct vo *vo, XvImage *xvi)
                       dst->x0, dst->y0, dw, dh,
                       True);
         x11->ShmCompletionWaitCount++;
+        ctx->num_puts++;
     } else
 #endif
     {
@@ -644,6 +680,16 @@ static inline void put_xvimage(struct vo *vo, XvImage *xvi)
     }
 }
 
+static void set_xv_planes(struct mp_image *img, XvImage *xv_image)
+{
+    bool swapuv = xv_image->id == MP_FOURCC_YV12;
+    for (int n = 0; n < img->num_planes; n++) {
+        int sn = n > 0 &&  swapuv ? (n == 1 ? 2 : 1) : n;
+        img->planes[n] = xv_image->data + xv_image->offsets[sn];
+        img->stride[n] = xv_image->pitches[sn];
+    }
+}
+
 static struct mp_image get_xv_buffer(struct vo *vo, int buf_index)
 {
     struct xvctx *ctx = vo->priv;
@@ -652,13 +698,7 @@ static struct mp_image get_xv_buffer(struct vo *vo, int buf_index)
     struct mp_image img = {0};
     mp_image_set_size(&img, ctx->image_width, ctx->image_height);
     mp_image_setfmt(&img, ctx->image_format);
-
-    bool swapuv = ctx->xv_format == MP_FOURCC_YV12;
-    for (int n = 0; n < img.num_planes; n++) {
-        int sn = n > 0 &&  swapuv ? (n == 1 ? 2 : 1) : n;
-        img.planes[n] = xv_image->data + xv_image->offsets[sn];
-        img.stride[n] = xv_image->pitches[sn];
-    }
+    set_xv_planes(&img, xv_image);
 
     if (vo->params) {
         struct mp_image_params params = *vo->params;
@@ -689,9 +729,180 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
 #endif
 }
 
+#if HAVE_SHM && HAVE_XEXT
+// Wait until the X server has finished reading from the buffer. This relies
+// on completion events being sent in the order of the XvShmPutImage calls.
+static void wait_for_dr_buffer(struct vo *vo, struct dr_buffer *buf)
+{
+    struct xvctx *ctx = vo->priv;
+    struct vo_x11_state *x11 = vo->x11;
+    while (buf->last_put > ctx->num_puts - x11->ShmCompletionWaitCount) {
+        mp_sleep_us(1000);
+        vo_x11_check_events(vo);
+    }
+}
+
+// Return the DR buffer containing ptr, or NULL.
+static struct dr_buffer *find_dr_buffer(struct xvctx *ctx, uint8_t *ptr)
+{
+    for (int n = 0; n < ctx->num_dr_buffers; n++) {
+        XvImage *xvi = ctx->dr_buffers[n]->xvimage;
+        uint8_t *data = (uint8_t *)xvi->data;
+        if (ptr >= data && ptr < data + xvi->data_size)
+            return ctx->dr_buffers[n];
+    }
+    return NULL;
+}
+
+static void free_dr_buffer(void *opaque, uint8_t *data)
+{
+    struct dr_buffer *buf = opaque;
+    struct xvctx *ctx = buf->ctx;
+
+    pthread_mutex_lock(&ctx->dr_lock);
+    buf->in_use = false;
+    pthread_mutex_unlock(&ctx->dr_lock);
+}
+
+static void destroy_dr_buffer(struct vo *vo, struct dr_buffer *buf)
+{
+    wait_for_dr_buffer(vo, buf);
+    XShmDetach(vo->x11->display, &buf->shminfo);
+    XSync(vo->x11->display, False);
+    shmdt(buf->shminfo.shmaddr);
+    XFree(buf->xvimage);
+    talloc_free(buf);
+}
+
+static struct dr_buffer *create_dr_buffer(struct vo *vo, int imgfmt, int w,
+                                          int h, int stride_align)
+{
+    struct xvctx *ctx = vo->priv;
+
+    struct dr_buffer *buf = talloc_ptrtype(NULL, buf);
+    *buf = (struct dr_buffer){
+        .ctx = ctx,
+        .imgfmt = imgfmt,
+        .w = w,
+        .h = h,
+        .stride_align = stride_align,
+        .in_use = true,
+    };
+
+    // Xv drivers usually derive the pitches from the width, so pad it such
+    // that the chroma pitches are aligned as well.
+    int aligned_w = FFALIGN(w, stride_align * 2);
+    int aligned_h = FFALIGN(h, 2);
+    buf->xvimage = create_shm_xvimage(vo, find_xv_format(imgfmt),
+                                      aligned_w, aligned_h, &buf->shminfo);
+    if (!buf->xvimage) {
+        talloc_free(buf);
+        return NULL;
+    }
+
+    // The decoder requires aligned planes and strides, which the driver
+    // doesn't guarantee.
+    struct mp_image img = {0};
+    mp_image_setfmt(&img, imgfmt);
+    set_xv_planes(&img, buf->xvimage);
+    bool ok = buf->xvimage->width >= w && buf->xvimage->height >= h &&
+              buf->xvimage->num_planes == img.num_planes;
+    for (int n = 0; n < img.num_planes; n++) {
+        ok &= (uintptr_t)img.planes[n] % stride_align == 0 &&
+              img.stride[n] % stride_align == 0;
+    }
+    if (!ok) {
+        MP_VERBOSE(vo, "XvImage layout unsuitable for direct rendering.\n");
+        destroy_dr_buffer(vo, buf);
+        return NULL;
+    }
+
+    return buf;
+}
+#endif
+
+// Allocate an image backed by a XvShm image, so that draw_image() can display
+// frames decoded into it without copying them. Returns NULL if this is
+// unsupported. Buffers are recycled once the image is freed, and the X server
+// has finished reading from them.
+static struct mp_image *get_image(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align)
+{
+#if HAVE_SHM && HAVE_XEXT
+    struct xvctx *ctx = vo->priv;
+
+    if (!ctx->Shmem_Flag || !query_format(vo, imgfmt))
+        return NULL;
+
+    struct dr_buffer *buf = NULL;
+
+    // Reuse an unused buffer with the same parameters, and drop the others
+    // (they are probably left over from a previous video size).
+    pthread_mutex_lock(&ctx->dr_lock);
+    for (int n = ctx->num_dr_buffers - 1; n >= 0; n--) {
+        struct dr_buffer *cur = ctx->dr_buffers[n];
+        if (cur->in_use)
+            continue;
+        if (!buf && cur->imgfmt == imgfmt && cur->w == w && cur->h == h &&
+            cur->stride_align == stride_align)
+        {
+            buf = cur;
+            buf->in_use = true;
+            continue;
+        }
+        destroy_dr_buffer(vo, cur);
+        MP_TARRAY_REMOVE_AT(ctx->dr_buffers, ctx->num_dr_buffers, n);
+    }
+    int num_dr_buffers = ctx->num_dr_buffers;
+    pthread_mutex_unlock(&ctx->dr_lock);
+
+    if (buf) {
+        // It might still be displayed.
+        wait_for_dr_buffer(vo, buf);
+    } else {
+        if (num_dr_buffers >= MAX_DR_BUFFERS) {
+            MP_WARN(vo, "Too many direct rendering buffers in use.\n");
+            return NULL;
+        }
+        buf = create_dr_buffer(vo, imgfmt, w, h, stride_align);
+        if (!buf)
+            return NULL;
+        pthread_mutex_lock(&ctx->dr_lock);
+        MP_TARRAY_APPEND(ctx, ctx->dr_buffers, ctx->num_dr_buffers, buf);
+        pthread_mutex_unlock(&ctx->dr_lock);
+    }
+
+    struct mp_image *mpi = mp_image_new_dummy_ref(NULL);
+    mp_image_set_size(mpi, w, h);
+    mp_image_setfmt(mpi, imgfmt);
+    set_xv_planes(mpi, buf->xvimage);
+    mpi->bufs[0] = av_buffer_create((uint8_t *)buf->xvimage->data,
+                                    buf->xvimage->data_size,
+                                    free_dr_buffer, buf, 0);
+    if (!mpi->bufs[0]) {
+        talloc_free(mpi);
+        free_dr_buffer(buf, NULL);
+        return NULL;
+    }
+    return mpi;
+#else
+    return NULL;
+#endif
+}
+
 static void flip_page(struct vo *vo)
 {
     struct xvctx *ctx = vo->priv;
+
+#if HAVE_SHM && HAVE_XEXT
+    struct dr_buffer *dr = ctx->dr_visible;
+    if (dr) {
+        put_xvimage(vo, dr->xvimage);
+        dr->last_put = ctx->num_puts;
+        return;
+    }
+#endif
+
     put_xvimage(vo, ctx->xvimage[ctx->current_buf]);
 
     /* remember the currently visible buffer */
@@ -701,6 +912,24 @@ static void flip_page(struct vo *vo)
         XSync(vo->x11->display, False);
 }
 
+struct draw_osd_closure {
+    struct vo *vo;
+    struct mp_image *dst;   // current buffer of the xvimage ring
+    struct mp_image *src;   // if set, copied to dst before drawing any OSD
+};
+
+static void draw_osd_part(void *ctx, struct sub_bitmaps *imgs)
+{
+    struct draw_osd_closure *c = ctx;
+    struct xvctx *xv = c->vo->priv;
+    if (c->src) {
+        mp_image_copy(c->dst, c->src);
+        c->src = NULL;
+    }
+    mp_draw_sub_bitmaps(&xv->osd_cache, c->dst, imgs);
+    talloc_steal(c->vo, xv->osd_cache);
+}
+
 // Note: REDRAW_FRAME can call this with NULL.
 static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
@@ -709,14 +938,31 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     wait_for_completion(vo, ctx->num_buffers - 1);
 
     struct mp_image xv_buffer = get_xv_buffer(vo, ctx->current_buf);
-    if (mpi) {
-        mp_image_copy(&xv_buffer, mpi);
-    } else {
-        mp_image_clear(&xv_buffer, 0, 0, xv_buffer.w, xv_buffer.h);
+    struct draw_osd_closure closure = {vo, &xv_buffer};
+
+#if HAVE_SHM && HAVE_XEXT
+    // A decoded DR image can be displayed as is, unless OSD has to be drawn
+    // on it (it might still be used as reference frame by the decoder).
+    ctx->dr_visible = mpi ? find_dr_buffer(ctx, mpi->planes[0]) : NULL;
+    if (ctx->dr_visible)
+        closure.src = mpi;
+#endif
+    if (!closure.src) {
+        if (mpi) {
+            mp_image_copy(&xv_buffer, mpi);
+        } else {
+            mp_image_clear(&xv_buffer, 0, 0, xv_buffer.w, xv_buffer.h);
+        }
     }
 
     struct mp_osd_res res = osd_res_from_image_params(vo->params);
-    osd_draw_on_image(vo->osd, res, mpi ? mpi->pts : 0, 0, &xv_buffer);
+    osd_draw(vo->osd, res, mpi ? mpi->pts : 0, 0, mp_draw_sub_formats,
+             draw_osd_part, &closure);
+
+#if HAVE_SHM && HAVE_XEXT
+    if (!closure.src)
+        ctx->dr_visible = NULL;
+#endif
 
     if (mpi != ctx->original_image) {
         talloc_free(ctx->original_image);
@@ -746,6 +992,14 @@ static void uninit(struct vo *vo)
 
     talloc_free(ctx->original_image);
 
+#if HAVE_SHM && HAVE_XEXT
+    for (int n = 0; n < ctx->num_dr_buffers; n++) {
+        assert(!ctx->dr_buffers[n]->in_use);
+        destroy_dr_buffer(vo, ctx->dr_buffers[n]);
+    }
+    pthread_mutex_destroy(&ctx->dr_lock);
+#endif
+
     if (ctx->ai)
         XvFreeAdaptorInfo(ctx->ai);
     ctx->ai = NULL;
@@ -774,11 +1028,25 @@ static int preinit(struct vo *vo)
     if (!vo_x11_init(vo))
         return -1;
 
+#if HAVE_SHM && HAVE_XEXT
+    pthread_mutex_init(&ctx->dr_lock, NULL);
+#endif
+
     if (!vo_x11_create_vo_window(vo, NULL, "xv"))
         goto error;
 
     struct vo_x11_state *x11 = vo->x11;
 
+#if HAVE_SHM && HAVE_XEXT
+    if (x11->display_is_local && XShmQueryExtension(x11->display)) {
+        ctx->Shmem_Flag = 1;
+        x11->ShmCompletionEvent = XShmGetEventBase(x11->display)
+                                + ShmCompletion;
+    } else {
+        MP_INFO(vo, "Shared memory not supported\nReverting to normal Xv.\n");
+    }
+#endif
+
     /* check for Xvideo extension */
     unsigned int ver, rel, req, ev, err;
     if (Success != XvQueryExtension(x11->display, &ver, &rel, &req, &ev, &err)) {
@@ -903,6 +1171,7 @@ const struct vo_driver video_out_xv = {
     .query_format = query_format,
     .reconfig = reconfig,
     .control = control,
+    .get_image = get_image,
     .draw_image = draw_image,
     .flip_page = flip_page,
     .wakeup = vo_x11_wakeup,
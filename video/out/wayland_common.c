@@ -718,11 +718,14 @@ static void frame_callback(void *data,
 {
     struct vo_wayland_state *wl = data;
 
-    if (wl->frame.function)
-        wl->frame.function(wl->frame.data, time);
-
     if (callback)
         wl_callback_destroy(callback);
+    wl->frame.callback = NULL;
+
+    // Don't keep the compositor busy with empty commits if there is nothing
+    // new to show.
+    if (!wl->frame.function || !wl->frame.function(wl->frame.data, time))
+        return;
 
     wl->frame.callback = wl_surface_frame(wl->window.video_surface);
 
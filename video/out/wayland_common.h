@@ -48,7 +48,9 @@ struct vo_wayland_output {
     struct wl_list link;
 };
 
-typedef void (*vo_wayland_frame_cb)(void *data, uint32_t time);
+// Called on each frame callback. Return false if nothing was committed, which
+// stops the callbacks until vo_wayland_request_frame() is called again.
+typedef bool (*vo_wayland_frame_cb)(void *data, uint32_t time);
 
 struct vo_wayland_state {
     struct vo *vo;
@@ -16,11 +16,13 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
 #include <libavutil/opt.h>
+#include <libavutil/cpu.h>
 
 #include "config.h"
 
@@ -34,8 +36,26 @@
 #include "csputils.h"
 #include "common/msg.h"
 #include "video/filter/vf.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
+// Upper limit for automatically and manually selected slice threads.
+#define MAX_SLICE_THREADS 16
+
+// Don't make bands smaller than this (in rows of the source image).
+#define MIN_SLICE_H 64
+
+// Band start alignment. Also keeps ordered dither patterns intact.
+#define SLICE_ALIGN 16
+
+// Rows converted additionally above/below a band if vertical chroma
+// resampling is involved, so that rows at the band border see the same
+// neighbours as with a single context.
+#define SLICE_MARGIN 16
+
+// Maximum number of idle contexts kept for mp_image_swscale().
+#define ONESHOT_CACHE_SIZE 4
+
 //global sws_flags from the command line
 struct sws_opts {
     int scaler;
@@ -45,6 +65,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,6 +89,7 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_INTRANGE("threads", threads, 0, 0, MAX_SLICE_THREADS),
         {0}
     },
     .size = sizeof(struct sws_opts),
@@ -88,10 +110,19 @@ const int mp_sws_fast_flags = SWS_BILINEAR;
 void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct sws_opts *opts)
 {
     sws_freeFilter(ctx->src_filter);
-    ctx->src_filter = sws_getDefaultFilter(opts->lum_gblur, opts->chr_gblur,
-                                           opts->lum_sharpen, opts->chr_sharpen,
-                                           opts->chr_hshift, opts->chr_vshift, 0);
+    ctx->src_filter = NULL;
+    // An all-identity filter has no effect, but would disable slicing.
+    if (opts->lum_gblur || opts->chr_gblur || opts->lum_sharpen ||
+        opts->chr_sharpen || opts->chr_hshift || opts->chr_vshift)
+    {
+        ctx->src_filter = sws_getDefaultFilter(opts->lum_gblur, opts->chr_gblur,
+                                               opts->lum_sharpen,
+                                               opts->chr_sharpen,
+                                               opts->chr_hshift,
+                                               opts->chr_vshift, 0);
+    }
     ctx->force_reload = true;
+    ctx->threads = opts->threads;
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
@@ -125,9 +156,33 @@ static bool cache_valid(struct mp_sws_context *ctx)
            ctx->saturation == old->saturation;
 }
 
+struct mp_sws_slice {
+    struct mp_sws_context *sws;
+    struct mp_image src, dst;   // views into the source image and dst/tmp
+    struct mp_image out;        // view into the real dst image (if tmp used)
+    struct mp_image *tmp;       // band with margins (only if needed)
+    int copy_y;                 // first row of tmp that belongs to out
+    int res;
+};
+
+static void free_slices(struct mp_sws_context *ctx)
+{
+    for (int n = 0; n < ctx->num_slices; n++) {
+        talloc_free(ctx->slices[n].sws);
+        talloc_free(ctx->slices[n].tmp);
+    }
+    talloc_free(ctx->slices);
+    ctx->slices = NULL;
+    ctx->num_slices = 0;
+    talloc_free(ctx->pool);
+    ctx->pool = NULL;
+    ctx->pool_threads = 0;
+}
+
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    free_slices(ctx);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -247,6 +302,127 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     return 1;
 }
 
+static int get_slice_threads(struct mp_sws_context *ctx, struct mp_image *dst,
+                             struct mp_image *src)
+{
+    if (ctx->threads == 1 || ctx->src_filter || ctx->dst_filter)
+        return 1;
+    if (src->h != dst->h)
+        return 1;
+    int threads = ctx->threads ? ctx->threads : av_cpu_count();
+    threads = MPMIN(threads, MAX_SLICE_THREADS);
+    threads = MPMIN(threads, src->h / MIN_SLICE_H);
+    return MPMAX(threads, 1);
+}
+
+static void scale_slice(void *p)
+{
+    struct mp_sws_slice *s = p;
+    s->res = mp_sws_scale(s->sws, &s->dst, &s->src);
+    if (s->res >= 0 && s->tmp) {
+        struct mp_image band = s->dst;
+        mp_image_crop(&band, 0, s->copy_y, band.w, s->copy_y + s->out.h);
+        mp_image_copy(&s->out, &band);
+    }
+}
+
+static bool setup_slice(struct mp_sws_context *ctx, struct mp_sws_slice *s,
+                        struct mp_image *dst, struct mp_image *src,
+                        int y0, int y1, bool reload)
+{
+    struct mp_sws_context *c = s->sws;
+    c->log = ctx->log;
+    c->flags = ctx->flags;
+    c->brightness = ctx->brightness;
+    c->contrast = ctx->contrast;
+    c->saturation = ctx->saturation;
+    c->params[0] = ctx->params[0];
+    c->params[1] = ctx->params[1];
+    c->threads = 1;
+    c->force_reload |= reload;
+
+    int m0 = 0, m1 = 0;
+    if (src->fmt.chroma_ys != dst->fmt.chroma_ys) {
+        m0 = MPMIN(SLICE_MARGIN, y0);
+        m1 = MPMIN(SLICE_MARGIN, src->h - y1);
+    }
+
+    s->src = *src;
+    mp_image_crop(&s->src, 0, y0 - m0, src->w, y1 + m1);
+
+    s->out = *dst;
+    mp_image_crop(&s->out, 0, y0, dst->w, y1);
+
+    if (!m0 && !m1) {
+        talloc_free(s->tmp);
+        s->tmp = NULL;
+        s->dst = s->out;
+        return true;
+    }
+
+    int h = y1 - y0 + m0 + m1;
+    if (!s->tmp || s->tmp->imgfmt != dst->imgfmt || s->tmp->w != dst->w ||
+        s->tmp->h != h)
+    {
+        talloc_free(s->tmp);
+        s->tmp = mp_image_alloc(dst->imgfmt, dst->w, h);
+        if (!s->tmp)
+            return false;
+    }
+    s->tmp->params = dst->params;
+    mp_image_set_size(s->tmp, dst->w, h);
+    s->dst = *s->tmp;
+    s->copy_y = m0;
+    return true;
+}
+
+static int scale_sliced(struct mp_sws_context *ctx, struct mp_image *dst,
+                        struct mp_image *src, int threads)
+{
+    bool reload = ctx->force_reload;
+
+    // The parent context is not used for scaling, but still validates the
+    // parameters, and determines supports_csp for the equalizer functions.
+    int r = mp_sws_reinit(ctx);
+    if (r < 0) {
+        MP_ERR(ctx, "libswscale initialization failed.\n");
+        return r;
+    }
+
+    if (ctx->pool_threads != threads) {
+        free_slices(ctx);
+        ctx->pool = mp_thread_pool_create(ctx, threads);
+        if (!ctx->pool)
+            return -1;
+        ctx->pool_threads = threads;
+    }
+    while (ctx->num_slices < threads) {
+        struct mp_sws_slice s = { .sws = mp_sws_alloc(NULL) };
+        MP_TARRAY_APPEND(ctx, ctx->slices, ctx->num_slices, s);
+    }
+
+    int align = MPMAX(SLICE_ALIGN, MPMAX(src->fmt.align_y, dst->fmt.align_y));
+    int y0 = 0;
+    for (int n = 0; n < threads; n++) {
+        int y1 = n == threads - 1 ? src->h
+                                  : (src->h * (n + 1) / threads) & ~(align - 1);
+        struct mp_sws_slice *s = &ctx->slices[n];
+        if (!setup_slice(ctx, s, dst, src, y0, y1, reload)) {
+            mp_thread_pool_wait(ctx->pool);
+            return -1;
+        }
+        mp_thread_pool_queue(ctx->pool, scale_slice, s);
+        y0 = y1;
+    }
+    mp_thread_pool_wait(ctx->pool);
+
+    for (int n = 0; n < threads; n++) {
+        if (ctx->slices[n].res < 0)
+            return ctx->slices[n].res;
+    }
+    return 0;
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -256,6 +432,10 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
     ctx->src = src->params;
     ctx->dst = dst->params;
 
+    int threads = get_slice_threads(ctx, dst, src);
+    if (threads > 1)
+        return scale_sliced(ctx, dst, src, threads);
+
     int r = mp_sws_reinit(ctx);
     if (r < 0) {
         MP_ERR(ctx, "libswscale initialization failed.\n");
@@ -267,13 +447,77 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
     return 0;
 }
 
+// Idle contexts for mp_image_swscale(), most recently used last. Setting up
+// a libswscale context is expensive compared to small conversions (OSD,
+// thumbnails), so contexts used with the same parameters are reused.
+static pthread_mutex_t oneshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mp_sws_context *oneshot_cache[ONESHOT_CACHE_SIZE];
+static int oneshot_num;
+
+static bool oneshot_matches(struct mp_sws_context *ctx, int flags,
+                            struct mp_image_params *src,
+                            struct mp_image_params *dst)
+{
+    return ctx->cached->flags == flags &&
+           mp_image_params_equal(&ctx->cached->src, src) &&
+           mp_image_params_equal(&ctx->cached->dst, dst);
+}
+
+// Take a cached context that was set up for the given parameters, or a new
+// one. The caller owns it until oneshot_release().
+static struct mp_sws_context *oneshot_get(int flags, struct mp_image *dst,
+                                          struct mp_image *src)
+{
+    // Normalize the same way mp_sws_reinit() does for the cached state.
+    struct mp_image_params s = src->params, d = dst->params;
+    s.p_w = s.p_h = d.p_w = d.p_h = 0;
+    mp_image_params_guess_csp(&s);
+    mp_image_params_guess_csp(&d);
+
+    struct mp_sws_context *ctx = NULL;
+    pthread_mutex_lock(&oneshot_lock);
+    for (int n = oneshot_num - 1; n >= 0; n--) {
+        if (oneshot_matches(oneshot_cache[n], flags, &s, &d)) {
+            ctx = oneshot_cache[n];
+            MP_TARRAY_REMOVE_AT(oneshot_cache, oneshot_num, n);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&oneshot_lock);
+
+    if (!ctx)
+        ctx = mp_sws_alloc(NULL);
+    ctx->flags = flags;
+    return ctx;
+}
+
+static void oneshot_release(struct mp_sws_context *ctx)
+{
+    // Don't keep worker threads and band buffers around while idle.
+    free_slices(ctx);
+
+    struct mp_sws_context *evict = NULL;
+    pthread_mutex_lock(&oneshot_lock);
+    if (oneshot_num == ONESHOT_CACHE_SIZE) {
+        evict = oneshot_cache[0];
+        MP_TARRAY_REMOVE_AT(oneshot_cache, oneshot_num, 0);
+    }
+    oneshot_cache[oneshot_num++] = ctx;
+    pthread_mutex_unlock(&oneshot_lock);
+
+    talloc_free(evict);
+}
+
 int mp_image_swscale(struct mp_image *dst, struct mp_image *src,
                      int my_sws_flags)
 {
-    struct mp_sws_context *ctx = mp_sws_alloc(NULL);
-    ctx->flags = my_sws_flags;
+    struct mp_sws_context *ctx = oneshot_get(my_sws_flags, dst, src);
     int res = mp_sws_scale(ctx, dst, src);
-    talloc_free(ctx);
+    if (res < 0) {
+        talloc_free(ctx);
+    } else {
+        oneshot_release(ctx);
+    }
     return res;
 }
 
@@ -7,6 +7,8 @@
 
 struct mp_image;
 struct sws_opts;
+struct mp_thread_pool;
+struct mp_sws_slice;
 
 // libswscale currently requires 16 bytes alignment for row pointers and
 // strides. Otherwise, it will print warnings and use slow codepaths.
@@ -42,12 +44,23 @@ struct mp_sws_context {
     struct SwsFilter *src_filter, *dst_filter;
     double params[2];
 
+    // Number of threads used to convert horizontal bands of the image in
+    // parallel. 0 means auto-detect, 1 disables it. Slicing is done only if
+    // there is no vertical scaling and no src/dst filter.
+    int threads;
+
     // Cached context (if any)
     struct SwsContext *sws;
     bool supports_csp;
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
+
+    // Slice threading state
+    struct mp_thread_pool *pool;
+    int pool_threads;
+    struct mp_sws_slice *slices;
+    int num_slices;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
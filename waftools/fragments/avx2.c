@@ -0,0 +1,18 @@
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+void *a_ptr;
+
+int main(void)
+{
+    __m256i ymm0;
+    __m256i* p = (__m256i*)a_ptr;
+
+    _mm_sfence();
+
+    ymm0  = _mm256_stream_load_si256(p + 1);
+    _mm256_store_si256(p + 2, ymm0);
+
+    return 0;
+}
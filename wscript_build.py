@@ -134,6 +134,7 @@ def build(ctx):
         ( "audio/filter/af_rubberband.c",        "rubberband" ),
         ( "audio/filter/af_scaletempo.c" ),
         ( "audio/filter/af_volume.c" ),
+        ( "audio/filter/biquad.c" ),
         ( "audio/filter/tools.c" ),
         ( "audio/out/ao.c" ),
         ( "audio/out/ao_alsa.c",                 "alsa" ),
@@ -170,7 +171,9 @@ def build(ctx):
         ( "common/encode_lavc.c",                "encoding" ),
         ( "common/common.c" ),
         ( "common/tags.c" ),
+        ( "common/mem_usage.c" ),
         ( "common/msg.c" ),
+        ( "common/stats.c" ),
         ( "common/playlist.c" ),
         ( "common/recorder.c" ),
         ( "common/version.c" ),
@@ -194,7 +197,9 @@ def build(ctx):
         ( "demux/demux_timeline.c" ),
         ( "demux/demux_tv.c",                    "tv" ),
         ( "demux/ebml.c" ),
+        ( "demux/hls_prefetch.c" ),
         ( "demux/packet.c" ),
+        ( "demux/probe_cache.c" ),
         ( "demux/timeline.c" ),
 
         ## Input
@@ -212,10 +217,13 @@ def build(ctx):
         ( "misc/bstr.c" ),
         ( "misc/charset_conv.c" ),
         ( "misc/dispatch.c" ),
+        ( "misc/histogram.c" ),
         ( "misc/json.c" ),
         ( "misc/node.c" ),
+        ( "misc/mpsc_queue.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
+        ( "misc/thread_pool.c" ),
 
         ## Options
         ( "options/m_config.c" ),
@@ -228,6 +236,7 @@ def build(ctx):
 
         ## Player
         ( "player/audio.c" ),
+        ( "player/benchmark.c" ),
         ( "player/client.c" ),
         ( "player/command.c" ),
         ( "player/configfiles.c" ),
@@ -239,9 +248,13 @@ def build(ctx):
         ( "player/lua.c",                        "lua" ),
         ( "player/osd.c" ),
         ( "player/playloop.c" ),
+        ( "player/playlist_probe.c" ),
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
+        ( "player/startup_prof.c" ),
         ( "player/sub.c" ),
+        ( "player/sync_stats.c" ),
+        ( "player/thumbnail.c" ),
         ( "player/video.c" ),
 
         ## Streams
@@ -279,6 +292,7 @@ def build(ctx):
         ( "stream/tvi_v4l2.c",                   "tv-v4l2"),
 
         ## Subtitles
+        ( "sub/ass_index.c",                     "libass"),
         ( "sub/ass_mp.c",                        "libass"),
         ( "sub/dec_sub.c" ),
         ( "sub/draw_bmp.c" ),
@@ -327,6 +341,7 @@ def build(ctx):
         ( "video/filter/vf_gradfun.c" ),
         ( "video/filter/vf_lavfi.c" ),
         ( "video/filter/vf_mirror.c" ),
+        ( "video/filter/vf_mtdeint.c" ),
         ( "video/filter/vf_noformat.c" ),
         ( "video/filter/vf_pullup.c" ),
         ( "video/filter/vf_rotate.c" ),
@@ -390,6 +405,7 @@ def build(ctx):
         ( "video/out/vo_opengl.c",               "gl" ),
         ( "video/out/vo_opengl_cb.c",            "gl" ),
         ( "video/out/vo_sdl.c",                  "sdl2" ),
+        ( "video/out/vo_sw_cb.c" ),
         ( "video/out/vo_tct.c" ),
         ( "video/out/vo_vaapi.c",                "vaapi-x11" ),
         ( "video/out/vo_vdpau.c",                "vdpau" ),
@@ -462,7 +478,8 @@ def build(ctx):
                 ctx.path.find_node('osdep/mpv.rc'),
                 version)
 
-    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test'):
+    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test') \
+            or ctx.dependency_satisfied('bench'):
         ctx(
             target       = "objects",
             source       = ctx.filtered_sources(sources),
@@ -515,6 +532,16 @@ def build(ctx):
                 install_path = None,
             )
 
+    if ctx.dependency_satisfied('bench'):
+        ctx(
+            target       = "test/bench/bench",
+            source       = ctx.path.ant_glob("test/bench/*.c"),
+            use          = ctx.dependencies_use() + ['objects'],
+            includes     = _all_includes(ctx),
+            features     = "c cprogram",
+            install_path = None,
+        )
+
     build_shared = ctx.dependency_satisfied('libmpv-shared')
     build_static = ctx.dependency_satisfied('libmpv-static')
     if build_shared or build_static:
@@ -579,7 +606,8 @@ def build(ctx):
             PRIV_LIBS    = get_deps(),
         )
 
-        headers = ["client.h", "qthelper.hpp", "opengl_cb.h", "stream_cb.h"]
+        headers = ["client.h", "qthelper.hpp", "opengl_cb.h", "stream_cb.h",
+                   "sw_cb.h"]
         for f in headers:
             ctx.install_as(ctx.env.INCDIR + '/mpv/' + f, 'libmpv/' + f)
 